@@ -0,0 +1,529 @@
+#include "AnimationClip.h"
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+const float smallestThreeRange = 0.70710678f;     // the three smaller components of a unit quaternion are within +-1/sqrt(2)
+const UINT instancesPerBatch = 8;
+
+// * * * * * KEY ENCODING * * * * * //
+// values[i] = 15 bit component << 1 | one bit of the dropped component's index
+static AnimationKey encodeRotation( const XMFLOAT4& rotation )
+{
+    float q[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+    float invLength = 1.0f / sqrtf( q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3] );
+
+    UINT largest = 0;
+    for ( UINT c = 1; c < 4; c++ )
+        if ( fabsf( q[c] ) > fabsf( q[largest] ) )
+            largest = c;
+
+    // q and -q are the same rotation, the dropped component is made positive
+    float sign = ( q[largest] < 0.0f ) ? -invLength : invLength;
+
+    AnimationKey key;
+    for ( UINT c = 0, i = 0; c < 4; c++ ) {
+        if ( c == largest )
+            continue;
+
+        float unit = ( q[c] * sign / smallestThreeRange + 1.0f ) * 0.5f;
+        unit = std::min( std::max( unit, 0.0f ), 1.0f );
+        key.values[i] = (USHORT)( (UINT)( unit * 32767.0f + 0.5f ) << 1 );
+        i++;
+    }
+    key.values[0] |= largest & 1;
+    key.values[1] |= largest >> 1;
+    return key;
+}
+
+static void decodeRotation( const AnimationKey& key, float* pRotation )
+{
+    UINT largest = ( key.values[0] & 1 ) | ( ( key.values[1] & 1 ) << 1 );
+
+    float smaller[3], sum = 0.0f;
+    for ( UINT i = 0; i < 3; i++ ) {
+        smaller[i] = ( (float)( key.values[i] >> 1 ) / 32767.0f * 2.0f - 1.0f ) * smallestThreeRange;
+        sum += smaller[i] * smaller[i];
+    }
+
+    for ( UINT c = 0, i = 0; c < 4; c++ )
+        pRotation[c] = ( c == largest ) ? sqrtf( std::max( 1.0f - sum, 0.0f ) ) : smaller[i++];
+}
+
+static AnimationKey encodeTranslation( const XMFLOAT3& translation, const XMFLOAT3& minimum, const XMFLOAT3& extent )
+{
+    const float* pValue = &translation.x;
+    const float* pMin = &minimum.x;
+    const float* pExtent = &extent.x;
+
+    AnimationKey key;
+    for ( UINT c = 0; c < 3; c++ ) {
+        float unit = ( pExtent[c] > 0.0f ) ? ( pValue[c] - pMin[c] ) / pExtent[c] : 0.0f;
+        unit = std::min( std::max( unit, 0.0f ), 1.0f );
+        key.values[c] = (USHORT)( unit * 65535.0f + 0.5f );
+    }
+    return key;
+}
+
+static void decodeTranslation( const AnimationKey& key, const XMFLOAT3& minimum, const XMFLOAT3& extent, float* pTranslation )
+{
+    pTranslation[0] = minimum.x + (float)key.values[0] * ( extent.x / 65535.0f );
+    pTranslation[1] = minimum.y + (float)key.values[1] * ( extent.y / 65535.0f );
+    pTranslation[2] = minimum.z + (float)key.values[2] * ( extent.z / 65535.0f );
+}
+
+// - - - the interpolation the sampler uses, scalar, for the key reduction - - - //
+static void nlerp( const float* pA, const float* pB, float t, float* pOutput )
+{
+    float dot = pA[0] * pB[0] + pA[1] * pB[1] + pA[2] * pB[2] + pA[3] * pB[3];
+    float sign = ( dot < 0.0f ) ? -1.0f : 1.0f;
+
+    float lengthSq = 0.0f;
+    for ( UINT c = 0; c < 4; c++ ) {
+        pOutput[c] = pA[c] + ( pB[c] * sign - pA[c] ) * t;
+        lengthSq += pOutput[c] * pOutput[c];
+    }
+
+    float invLength = 1.0f / sqrtf( lengthSq );
+    for ( UINT c = 0; c < 4; c++ )
+        pOutput[c] *= invLength;
+}
+
+// Angle between two rotations from the chord: |a - b| = 2 sin( angle / 4 ), where acos( dot ) would
+// lose small angles to float precision
+static float rotationError( const float* pA, const XMFLOAT4& b )
+{
+    float dot = pA[0] * b.x + pA[1] * b.y + pA[2] * b.z + pA[3] * b.w;
+    float sign = ( dot < 0.0f ) ? -1.0f : 1.0f;
+
+    float dx = pA[0] - b.x * sign, dy = pA[1] - b.y * sign, dz = pA[2] - b.z * sign, dw = pA[3] - b.w * sign;
+    float chord = sqrtf( dx * dx + dy * dy + dz * dz + dw * dw );
+    return 4.0f * asinf( std::min( chord * 0.5f, 1.0f ) );
+}
+
+static float translationError( const float* pA, const XMFLOAT3& b )
+{
+    float dx = pA[0] - b.x, dy = pA[1] - b.y, dz = pA[2] - b.z;
+    return sqrtf( dx * dx + dy * dy + dz * dz );
+}
+
+// * * * * * COMPRESSION * * * * * //
+// Greedy: from the last kept key, the next key is the farthest frame for which interpolating the
+// quantized keys stays within tolerance of every source frame in between. Errors are measured
+// against the source, so quantization counts towards the tolerance.
+template<UINT Components, typename Decoded, typename Error>
+static void reduceCurve( UINT frameCount, const std::vector<AnimationKey>& quantized, const Decoded& decode, const Error& error,
+                         float tolerance, std::vector<USHORT>& keyFrames, std::vector<AnimationKey>& keys, AnimationCurve& curve )
+{
+    curve.keyStart = (UINT)keys.size();
+
+    // - - - constant curve: one key - - - //
+    float first[4];
+    decode( quantized[0], first );
+    bool constant = true;
+    for ( UINT f = 1; f < frameCount && constant; f++ )
+        constant = error( first, f ) <= tolerance;
+
+    keyFrames.push_back( 0 );
+    keys.push_back( quantized[0] );
+    if ( constant ) {
+        curve.keyCount = 1;
+        return;
+    }
+
+    UINT start = 0;
+    float startValue[4], endValue[4], value[4];
+    while ( start < frameCount - 1 ) {
+        decode( quantized[start], startValue );
+
+        UINT end = start + 1;
+        for ( UINT candidate = start + 2; candidate < frameCount; candidate++ ) {
+            decode( quantized[candidate], endValue );
+
+            bool fits = true;
+            for ( UINT f = start + 1; f < candidate && fits; f++ ) {
+                float t = (float)( f - start ) / ( candidate - start );
+                if ( Components == 4 ) {
+                    nlerp( startValue, endValue, t, value );
+                }
+                else {
+                    for ( UINT c = 0; c < Components; c++ )
+                        value[c] = startValue[c] + ( endValue[c] - startValue[c] ) * t;
+                }
+                fits = error( value, f ) <= tolerance;
+            }
+
+            if ( !fits )
+                break;
+            end = candidate;
+        }
+
+        keyFrames.push_back( (USHORT)end );
+        keys.push_back( quantized[end] );
+        start = end;
+    }
+
+    curve.keyCount = (UINT)keys.size() - curve.keyStart;
+}
+
+void compressAnimationClip( const AnimationSourceClip& source, const AnimationCompressionSettings& settings, AnimationClip& clip )
+{
+    UINT frameCount = std::min( source.frameCount, 65536u );      // key frames are 16 bit
+    UINT trackCount = source.trackCount;
+
+    clip.frameRate = source.frameRate;
+    clip.frameCount = frameCount;
+    clip.trackCount = trackCount;
+    clip.duration = ( frameCount > 1 ) ? ( frameCount - 1 ) / source.frameRate : 0.0f;
+
+    clip.rotationCurves.resize( trackCount );
+    clip.translationCurves.resize( trackCount );
+    clip.translationMins.resize( trackCount );
+    clip.translationExtents.resize( trackCount );
+    clip.scales.resize( trackCount );
+    clip.keyFrames.clear();
+    clip.keys.clear();
+
+    std::vector<AnimationKey> quantized( frameCount );
+
+    for ( UINT track = 0; track < trackCount; track++ ) {
+        auto sourcePose = [&]( UINT frame ) -> const BonePose& { return source.frames[(size_t)frame * trackCount + track]; };
+        clip.scales[track] = sourcePose( 0 ).scale;
+
+        // - - - rotation - - - //
+        for ( UINT f = 0; f < frameCount; f++ )
+            quantized[f] = encodeRotation( sourcePose( f ).rotation );
+
+        reduceCurve<4>( frameCount, quantized,
+                        []( const AnimationKey& key, float* pValue ) { decodeRotation( key, pValue ); },
+                        [&]( const float* pValue, UINT frame ) { return rotationError( pValue, sourcePose( frame ).rotation ); },
+                        settings.rotationTolerance, clip.keyFrames, clip.keys, clip.rotationCurves[track] );
+
+        // - - - translation, quantized within the track's range - - - //
+        XMFLOAT3 minimum( FLT_MAX, FLT_MAX, FLT_MAX ), maximum( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+        for ( UINT f = 0; f < frameCount; f++ ) {
+            const XMFLOAT3& p = sourcePose( f ).position;
+            minimum = XMFLOAT3( std::min( minimum.x, p.x ), std::min( minimum.y, p.y ), std::min( minimum.z, p.z ) );
+            maximum = XMFLOAT3( std::max( maximum.x, p.x ), std::max( maximum.y, p.y ), std::max( maximum.z, p.z ) );
+        }
+        XMFLOAT3 extent( maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z );
+        clip.translationMins[track] = minimum;
+        clip.translationExtents[track] = extent;
+
+        for ( UINT f = 0; f < frameCount; f++ )
+            quantized[f] = encodeTranslation( sourcePose( f ).position, minimum, extent );
+
+        reduceCurve<3>( frameCount, quantized,
+                        [&]( const AnimationKey& key, float* pValue ) { decodeTranslation( key, minimum, extent, pValue ); },
+                        [&]( const float* pValue, UINT frame ) { return translationError( pValue, sourcePose( frame ).position ); },
+                        settings.translationTolerance, clip.keyFrames, clip.keys, clip.translationCurves[track] );
+    }
+}
+
+size_t getAnimationClipBytes( const AnimationClip& clip )
+{
+    return sizeof(AnimationClip) +
+           ( clip.rotationCurves.size() + clip.translationCurves.size() ) * sizeof(AnimationCurve) +
+           ( clip.translationMins.size() + clip.translationExtents.size() + clip.scales.size() ) * sizeof(XMFLOAT3) +
+           clip.keyFrames.size() * sizeof(USHORT) + clip.keys.size() * sizeof(AnimationKey);
+}
+
+// * * * * * SAMPLING * * * * * //
+// Key pair around framePosition and the interpolation factor between them
+static UINT findKey( const AnimationClip& clip, const AnimationCurve& curve, float framePosition, float& t )
+{
+    if ( curve.keyCount == 1 ) {
+        t = 0.0f;
+        return curve.keyStart;
+    }
+
+    const USHORT* pFrames = clip.keyFrames.data() + curve.keyStart;
+    USHORT frame = (USHORT)framePosition;
+    UINT key = (UINT)( std::upper_bound( pFrames, pFrames + curve.keyCount, frame ) - pFrames );
+    key = std::min( std::max( key, 1u ), curve.keyCount - 1 ) - 1;
+
+    t = ( framePosition - pFrames[key] ) / (float)( pFrames[key + 1] - pFrames[key] );
+    t = std::min( std::max( t, 0.0f ), 1.0f );
+    return curve.keyStart + key;
+}
+
+// Quaternions of 4 tracks, one register per component: a + ( +-b - a ) * t, normalized
+static void nlerpLanes( const __m128* pA, __m128* pB, __m128 t, __m128* pOutput )
+{
+    const __m128 signMask = _mm_set1_ps( -0.0f );
+
+    __m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( pA[0], pB[0] ), _mm_mul_ps( pA[1], pB[1] ) ),
+                             _mm_add_ps( _mm_mul_ps( pA[2], pB[2] ), _mm_mul_ps( pA[3], pB[3] ) ) );
+    __m128 flip = _mm_and_ps( dot, signMask );
+
+    __m128 lengthSq = _mm_setzero_ps();
+    for ( UINT c = 0; c < 4; c++ ) {
+        __m128 b = _mm_xor_ps( pB[c], flip );
+        pOutput[c] = _mm_add_ps( pA[c], _mm_mul_ps( _mm_sub_ps( b, pA[c] ), t ) );
+        lengthSq = _mm_add_ps( lengthSq, _mm_mul_ps( pOutput[c], pOutput[c] ) );
+    }
+
+    __m128 invLength = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( lengthSq ) );
+    for ( UINT c = 0; c < 4; c++ )
+        pOutput[c] = _mm_mul_ps( pOutput[c], invLength );
+}
+
+// Raw key values of 4 tracks, one register per value, [value][lane]
+struct KeyLanes
+{
+    alignas(16) int values[3][4];
+};
+
+static void gatherKey( const AnimationKey& key, UINT lane, KeyLanes& lanes )
+{
+    lanes.values[0][lane] = key.values[0];
+    lanes.values[1][lane] = key.values[1];
+    lanes.values[2][lane] = key.values[2];
+}
+
+static __m128 selectLanes( __m128 mask, __m128 a, __m128 b )
+{
+    return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+// decodeRotation for 4 keys: the dropped component goes back to its place with lane masks
+static void decodeRotationLanes( const KeyLanes& keys, __m128* pRotation )
+{
+    const __m128i one = _mm_set1_epi32( 1 );
+    const __m128 scale = _mm_set1_ps( 2.0f * smallestThreeRange / 32767.0f );
+    const __m128 offset = _mm_set1_ps( -smallestThreeRange );
+
+    __m128i raw[3], largest;
+    __m128 smaller[3], sum = _mm_setzero_ps();
+    for ( UINT i = 0; i < 3; i++ ) {
+        raw[i] = _mm_load_si128( (const __m128i*)keys.values[i] );
+        smaller[i] = _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_srli_epi32( raw[i], 1 ) ), scale ), offset );
+        sum = _mm_add_ps( sum, _mm_mul_ps( smaller[i], smaller[i] ) );
+    }
+    largest = _mm_or_si128( _mm_and_si128( raw[0], one ), _mm_slli_epi32( _mm_and_si128( raw[1], one ), 1 ) );
+    __m128 dropped = _mm_sqrt_ps( _mm_max_ps( _mm_sub_ps( _mm_set1_ps( 1.0f ), sum ), _mm_setzero_ps() ) );
+
+    __m128 is[4];
+    for ( UINT c = 0; c < 4; c++ )
+        is[c] = _mm_castsi128_ps( _mm_cmpeq_epi32( largest, _mm_set1_epi32( c ) ) );
+
+    // Component c is stored at c before the dropped one, at c - 1 after it
+    pRotation[0] = selectLanes( is[0], dropped, smaller[0] );
+    pRotation[1] = selectLanes( is[1], dropped, selectLanes( is[0], smaller[0], smaller[1] ) );
+    pRotation[2] = selectLanes( is[2], dropped, selectLanes( is[3], smaller[2], smaller[1] ) );
+    pRotation[3] = selectLanes( is[3], dropped, smaller[2] );
+}
+
+// Keys are looked up per track, decoding and interpolation run on 4 tracks at once. A partial last
+// group repeats its last track in the unused lanes.
+static void sampleFrame( const AnimationClip& clip, float framePosition, BonePose* pOutput )
+{
+    const __m128 translationScale = _mm_set1_ps( 1.0f / 65535.0f );
+
+    for ( UINT base = 0; base < clip.trackCount; base += 4 ) {
+        UINT lanes = std::min( 4u, clip.trackCount - base );
+
+        KeyLanes rotationA, rotationB, translationA, translationB;
+        alignas(16) float rotationT[4], translationT[4];
+        alignas(16) float translationMin[3][4], translationExtent[3][4];     // [axis][lane]
+
+        for ( UINT lane = 0; lane < 4; lane++ ) {
+            UINT track = base + std::min( lane, lanes - 1 );
+            const AnimationCurve& rotationCurve = clip.rotationCurves[track];
+            const AnimationCurve& translationCurve = clip.translationCurves[track];
+
+            UINT key = findKey( clip, rotationCurve, framePosition, rotationT[lane] );
+            gatherKey( clip.keys[key], lane, rotationA );
+            gatherKey( clip.keys[std::min( key + 1, rotationCurve.keyStart + rotationCurve.keyCount - 1 )], lane, rotationB );
+
+            key = findKey( clip, translationCurve, framePosition, translationT[lane] );
+            gatherKey( clip.keys[key], lane, translationA );
+            gatherKey( clip.keys[std::min( key + 1, translationCurve.keyStart + translationCurve.keyCount - 1 )], lane, translationB );
+
+            const float* pMin = &clip.translationMins[track].x;
+            const float* pExtent = &clip.translationExtents[track].x;
+            for ( UINT c = 0; c < 3; c++ ) {
+                translationMin[c][lane] = pMin[c];
+                translationExtent[c][lane] = pExtent[c];
+            }
+        }
+
+        // - - - decode and interpolate 4 tracks - - - //
+        __m128 a[4], b[4], rotation[4];
+        decodeRotationLanes( rotationA, a );
+        decodeRotationLanes( rotationB, b );
+        nlerpLanes( a, b, _mm_load_ps( rotationT ), rotation );
+
+        // Component registers -> one quaternion per register
+        _MM_TRANSPOSE4_PS( rotation[0], rotation[1], rotation[2], rotation[3] );
+
+        alignas(16) float translation[3][4];
+        __m128 t = _mm_load_ps( translationT );
+        for ( UINT c = 0; c < 3; c++ ) {
+            __m128 minimum = _mm_load_ps( translationMin[c] );
+            __m128 step = _mm_mul_ps( _mm_load_ps( translationExtent[c] ), translationScale );
+            __m128 start = _mm_add_ps( minimum, _mm_mul_ps( _mm_cvtepi32_ps( _mm_load_si128( (const __m128i*)translationA.values[c] ) ), step ) );
+            __m128 end = _mm_add_ps( minimum, _mm_mul_ps( _mm_cvtepi32_ps( _mm_load_si128( (const __m128i*)translationB.values[c] ) ), step ) );
+            _mm_store_ps( translation[c], _mm_add_ps( start, _mm_mul_ps( _mm_sub_ps( end, start ), t ) ) );
+        }
+
+        for ( UINT lane = 0; lane < lanes; lane++ ) {
+            BonePose& pose = pOutput[base + lane];
+            _mm_storeu_ps( &pose.rotation.x, rotation[lane] );
+            pose.position = XMFLOAT3( translation[0][lane], translation[1][lane], translation[2][lane] );
+            pose.scale = clip.scales[base + lane];
+        }
+    }
+}
+
+void sampleAnimationClip( const AnimationClip& clip, float time, BonePose* pOutput )
+{
+    float framePosition = 0.0f;
+    if ( clip.duration > 0.0f ) {
+        float wrapped = fmodf( time, clip.duration );
+        if ( wrapped < 0.0f )
+            wrapped += clip.duration;
+        framePosition = std::min( wrapped * clip.frameRate, (float)( clip.frameCount - 1 ) );
+    }
+
+    sampleFrame( clip, framePosition, pOutput );
+}
+
+void blendPoses( const BonePose* pA, const BonePose* pB, float weight, UINT count, BonePose* pOutput )
+{
+    __m128 t = _mm_set1_ps( weight );
+
+    for ( UINT base = 0; base < count; base += 4 ) {
+        UINT lanes = std::min( 4u, count - base );
+
+        // One quaternion per register -> component registers
+        __m128 a[4], b[4], rotation[4];
+        for ( UINT lane = 0; lane < 4; lane++ ) {
+            UINT bone = base + std::min( lane, lanes - 1 );
+            a[lane] = _mm_loadu_ps( &pA[bone].rotation.x );
+            b[lane] = _mm_loadu_ps( &pB[bone].rotation.x );
+        }
+        _MM_TRANSPOSE4_PS( a[0], a[1], a[2], a[3] );
+        _MM_TRANSPOSE4_PS( b[0], b[1], b[2], b[3] );
+
+        nlerpLanes( a, b, t, rotation );
+        _MM_TRANSPOSE4_PS( rotation[0], rotation[1], rotation[2], rotation[3] );
+
+        for ( UINT lane = 0; lane < lanes; lane++ ) {
+            UINT bone = base + lane;
+            const BonePose& poseA = pA[bone];
+            const BonePose& poseB = pB[bone];
+            BonePose& pose = pOutput[bone];
+
+            _mm_storeu_ps( &pose.rotation.x, rotation[lane] );
+            pose.position = XMFLOAT3( poseA.position.x + ( poseB.position.x - poseA.position.x ) * weight,
+                                      poseA.position.y + ( poseB.position.y - poseA.position.y ) * weight,
+                                      poseA.position.z + ( poseB.position.z - poseA.position.z ) * weight );
+            pose.scale = XMFLOAT3( poseA.scale.x + ( poseB.scale.x - poseA.scale.x ) * weight,
+                                   poseA.scale.y + ( poseB.scale.y - poseA.scale.y ) * weight,
+                                   poseA.scale.z + ( poseB.scale.z - poseA.scale.z ) * weight );
+        }
+    }
+}
+
+AnimationCompressionError measureAnimationError( const AnimationSourceClip& source, const AnimationClip& clip )
+{
+    AnimationCompressionError error;
+    error.maxRotationError = 0.0f;
+    error.maxTranslationError = 0.0f;
+    error.rotationKeys = 0;
+    error.translationKeys = 0;
+
+    for ( UINT track = 0; track < clip.trackCount; track++ ) {
+        error.rotationKeys += clip.rotationCurves[track].keyCount;
+        error.translationKeys += clip.translationCurves[track].keyCount;
+    }
+
+    std::vector<BonePose> sampled( clip.trackCount );
+    for ( UINT f = 0; f < clip.frameCount; f++ ) {
+        sampleFrame( clip, (float)f, sampled.data() );
+
+        for ( UINT track = 0; track < clip.trackCount; track++ ) {
+            const BonePose& reference = source.frames[(size_t)f * source.trackCount + track];
+            error.maxRotationError = std::max( error.maxRotationError, rotationError( &sampled[track].rotation.x, reference.rotation ) );
+            error.maxTranslationError = std::max( error.maxTranslationError, translationError( &sampled[track].position.x, reference.position ) );
+        }
+    }
+    return error;
+}
+
+// * * * * * INSTANCES * * * * * //
+void evaluateAnimationInstances( AnimationInstance* pInstances, UINT count, JobSystem* pJobSystem )
+{
+    auto evaluate = [&]( UINT begin, UINT end ) {
+        std::vector<BonePose> clipLocals, blendLocals;
+
+        for ( UINT i = begin; i < end; i++ ) {
+            AnimationInstance& instance = pInstances[i];
+            SkeletonPose& pose = *instance.pPose;
+            UINT trackCount = std::min( instance.pClip->trackCount, (UINT)pose.locals.size() );
+
+            // The sampler writes every track of the clip: a clip with more tracks than the skeleton
+            // goes through clipLocals, and only the skeleton's bones are kept
+            if ( instance.pClip->trackCount <= pose.locals.size() ) {
+                sampleAnimationClip( *instance.pClip, instance.time, pose.locals.data() );
+            }
+            else {
+                clipLocals.resize( instance.pClip->trackCount );
+                sampleAnimationClip( *instance.pClip, instance.time, clipLocals.data() );
+                std::copy( clipLocals.begin(), clipLocals.begin() + trackCount, pose.locals.begin() );
+            }
+
+            // blendLocals is sized to the blend clip, blending stops at the shorter of the two
+            if ( instance.pBlendClip && instance.blendWeight > 0.0f ) {
+                blendLocals.resize( instance.pBlendClip->trackCount );
+                sampleAnimationClip( *instance.pBlendClip, instance.blendTime, blendLocals.data() );
+                blendPoses( pose.locals.data(), blendLocals.data(), instance.blendWeight, std::min( trackCount, instance.pBlendClip->trackCount ), pose.locals.data() );
+            }
+
+            updateSkeletonPose( *instance.pSkeleton, pose );
+        }
+    };
+
+    if ( pJobSystem )
+        pJobSystem->parallelFor( count, instancesPerBatch, evaluate );
+    else
+        evaluate( 0, count );
+}
+
+// * * * * * PROCEDURAL * * * * * //
+void createChainWaveClip( const Skeleton& skeleton, UINT frameCount, float frameRate, const XMFLOAT3& axis,
+                          float amplitude, float waves, float rootMotion, AnimationSourceClip& clip )
+{
+    SkeletonPose bindPose;
+    initSkeletonPose( skeleton, bindPose );
+
+    UINT trackCount = (UINT)skeleton.parents.size();
+    frameCount = std::max( frameCount, 2u );
+    clip.frameRate = frameRate;
+    clip.frameCount = frameCount;
+    clip.trackCount = trackCount;
+    clip.frames.resize( (size_t)frameCount * trackCount );
+
+    XMVECTOR rotationAxis = XMVector3Normalize( XMLoadFloat3( &axis ) );
+    for ( UINT f = 0; f < frameCount; f++ ) {
+        float progress = (float)f / ( frameCount - 1 );
+
+        for ( UINT track = 0; track < trackCount; track++ ) {
+            BonePose pose = bindPose.locals[track];
+
+            float phase = XM_2PI * waves * progress - track * 0.4f;
+            XMVECTOR wave = XMQuaternionRotationAxis( rotationAxis, amplitude * sinf( phase ) );
+            XMStoreFloat4( &pose.rotation, XMQuaternionMultiply( wave, XMLoadFloat4( &pose.rotation ) ) );
+
+            if ( track == 0 )
+                pose.position.x += rootMotion * sinf( XM_2PI * progress );
+
+            clip.frames[(size_t)f * trackCount + track] = pose;
+        }
+    }
+}
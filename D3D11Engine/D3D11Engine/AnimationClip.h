@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Skinning.h"
+#include "JobSystem.h"
+
+// * * * Uncompressed clip: every track (bone) sampled at every frame * * * //
+struct AnimationSourceClip
+{
+    float frameRate;
+    UINT frameCount;
+    UINT trackCount;
+    std::vector<BonePose> frames;       // [frame * trackCount + track]
+};
+
+struct AnimationCompressionSettings
+{
+    AnimationCompressionSettings() : rotationTolerance( 0.001f ), translationTolerance( 0.0005f ) { }
+
+    float rotationTolerance;            // radians
+    float translationTolerance;         // units
+};
+
+// * * * Compressed clip * * * //
+// Each track has a rotation and a translation curve made of the keys that linear interpolation
+// can't skip within the tolerance (a constant curve keeps one key). Rotations are stored as the
+// smallest three quaternion components (3 x 15 bits + index of the dropped one), translations
+// as 16 bit fractions of the track's range. Key frames and values of a curve are contiguous.
+// Scale is stored once per track, clips are expected not to animate it.
+struct AnimationCurve
+{
+    UINT keyStart;
+    UINT keyCount;
+};
+
+struct AnimationKey
+{
+    USHORT values[3];
+};
+
+struct AnimationClip
+{
+    float frameRate;
+    float duration;                     // ( frameCount - 1 ) / frameRate, sampling loops
+    UINT frameCount;
+    UINT trackCount;
+
+    std::vector<AnimationCurve> rotationCurves;         // per track
+    std::vector<AnimationCurve> translationCurves;
+    std::vector<DirectX::XMFLOAT3> translationMins;     // per track, decode: min + value / 65535 * extent
+    std::vector<DirectX::XMFLOAT3> translationExtents;
+    std::vector<DirectX::XMFLOAT3> scales;
+
+    std::vector<USHORT> keyFrames;                      // frame of every key, both curve kinds
+    std::vector<AnimationKey> keys;
+};
+
+struct AnimationCompressionError
+{
+    float maxRotationError;             // radians, over every frame of every track
+    float maxTranslationError;
+    UINT rotationKeys;
+    UINT translationKeys;
+};
+
+void compressAnimationClip( const AnimationSourceClip& source, const AnimationCompressionSettings& settings, AnimationClip& clip );
+AnimationCompressionError measureAnimationError( const AnimationSourceClip& source, const AnimationClip& clip );
+size_t getAnimationClipBytes( const AnimationClip& clip );
+
+// * * * Sampling * * * //
+// time in seconds, wraps around the clip. Four tracks are interpolated per SSE instruction.
+void sampleAnimationClip( const AnimationClip& clip, float time, BonePose* pOutput );
+
+// output = a * ( 1 - weight ) + b * weight, rotations take the shortest way (nlerp)
+void blendPoses( const BonePose* pA, const BonePose* pB, float weight, UINT count, BonePose* pOutput );
+
+// * * * Per instance evaluation: clip (optionally blended with a second one) -> locals -> palette * * * //
+struct AnimationInstance
+{
+    const Skeleton* pSkeleton;
+    SkeletonPose* pPose;                // locals and palette are written
+    const AnimationClip* pClip;
+    float time;
+    const AnimationClip* pBlendClip;    // NULL: pClip only
+    float blendTime;
+    float blendWeight;                  // 0 = pClip, 1 = pBlendClip
+};
+
+// Instances are independent, they are spread over the job system
+void evaluateAnimationInstances( AnimationInstance* pInstances, UINT count, JobSystem* pJobSystem = NULL );
+
+// * * * Procedural clip (tests / benchmarks) * * * //
+// Waves running up a bone chain: every bone rotates around axis by amplitude * sin( phase ),
+// starting from the bind pose. rootMotion moves the first bone along x and back once per clip.
+void createChainWaveClip( const Skeleton& skeleton, UINT frameCount, float frameRate, const DirectX::XMFLOAT3& axis,
+                          float amplitude, float waves, float rootMotion, AnimationSourceClip& clip );
@@ -0,0 +1,2756 @@
+#include "Benchmark.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <wchar.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+
+#include "Timer.h"
+#include "TextureArray.h"
+#include "QuadBatch.h"
+#include "Mesh.h"
+#include "VertexCompression.h"
+#include "MeshFile.h"
+#include "IndexCodec.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+#include "Lod.h"
+#include "ModelFile.h"
+#include "MeshImport.h"
+#include "JobSystem.h"
+#include "TransformHierarchy.h"
+#include "FrustumCuller.h"
+#include "Bvh.h"
+#include "OcclusionCuller.h"
+#include "EntityWorld.h"
+#include "Skinning.h"
+#include "AnimationClip.h"
+#include "ClusteredLighting.h"
+#include "PointShadowMap.h"
+#include "Lightmap.h"
+#include "DeferredShading.h"
+#include "VisibilityBuffer.h"
+#include "VariableRateShading.h"
+#include "IrradianceProbes.h"
+#include "PostProcess.h"
+#include "SceneShaders.h"
+#include "SimdLanes.h"
+
+// * * * Benchmarks * * * //
+static void benchQuadBatch( const BenchmarkContext& context );
+static void benchIndexCodec( const BenchmarkContext& context );
+static void benchMeshOptimizer( const BenchmarkContext& context );
+static void benchMeshlets( const BenchmarkContext& context );
+static void benchLod( const BenchmarkContext& context );
+static void benchModelLoad( const BenchmarkContext& context );
+static void benchImport( const BenchmarkContext& context );
+static void benchTransforms( const BenchmarkContext& context );
+static void benchCulling( const BenchmarkContext& context );
+static void benchBvh( const BenchmarkContext& context );
+static void benchOcclusion( const BenchmarkContext& context );
+static void benchEntities( const BenchmarkContext& context );
+static void benchSkinning( const BenchmarkContext& context );
+static void benchAnimation( const BenchmarkContext& context );
+static void benchLights( const BenchmarkContext& context );
+static void benchShadows( const BenchmarkContext& context );
+static void benchLightmap( const BenchmarkContext& context );
+static void benchDeferred( const BenchmarkContext& context );
+static void benchVisibility( const BenchmarkContext& context );
+static void benchShadingRate( const BenchmarkContext& context );
+static void benchProbes( const BenchmarkContext& context );
+static void benchPost( const BenchmarkContext& context );
+
+struct BenchmarkEntry
+{
+    const wchar_t* name;
+    void ( *run )( const BenchmarkContext& context );
+};
+
+static const BenchmarkEntry benchmarks[] = {
+    { L"quads", benchQuadBatch },
+    { L"indexcodec", benchIndexCodec },
+    { L"meshopt", benchMeshOptimizer },
+    { L"meshlets", benchMeshlets },
+    { L"lod", benchLod },
+    { L"modelload", benchModelLoad },
+    { L"import", benchImport },
+    { L"transforms", benchTransforms },
+    { L"culling", benchCulling },
+    { L"bvh", benchBvh },
+    { L"occlusion", benchOcclusion },
+    { L"ecs", benchEntities },
+    { L"skinning", benchSkinning },
+    { L"animation", benchAnimation },
+    { L"lights", benchLights },
+    { L"shadows", benchShadows },
+    { L"lightmap", benchLightmap },
+    { L"deferred", benchDeferred },
+    { L"visibility", benchVisibility },
+    { L"shadingrate", benchShadingRate },
+    { L"probes", benchProbes },
+    { L"post", benchPost },
+};
+
+// * * * Small deterministic random generator so runs are comparable * * * //
+static UINT randomState = 12345;
+static float randomFloat()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return (float)( randomState >> 8 ) / 16777216.0f;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void logBenchmark( const char* format, ... )
+{
+    char message[1024];
+
+    va_list args;
+    va_start( args, format );
+    vsnprintf_s( message, sizeof(message), _TRUNCATE, format, args );
+    va_end( args );
+
+    OutputDebugStringA( message );
+
+    FILE* pFile = NULL;
+    if ( fopen_s( &pFile, "benchmark.log", "a" ) == 0 && pFile ) {
+        fputs( message, pFile );
+        fclose( pFile );
+    }
+}
+
+static std::vector<std::wstring> splitCommandLine( const wchar_t* cmdLine )
+{
+    std::vector<std::wstring> tokens;
+    std::wstring token;
+
+    for ( const wchar_t* c = cmdLine; ; c++ ) {
+        if ( *c == L'\0' || *c == L' ' || *c == L'\t' ) {
+            if ( !token.empty() )
+                tokens.push_back( token );
+            token.clear();
+            if ( *c == L'\0' )
+                break;
+        }
+        else {
+            token += *c;
+        }
+    }
+    return tokens;
+}
+
+bool isBenchmarkRun( const wchar_t* cmdLine )
+{
+    return cmdLine && wcsstr( cmdLine, L"-bench" ) != NULL;
+}
+
+void runBenchmarks( const wchar_t* cmdLine, const BenchmarkContext& context )
+{
+    // Names listed after -bench, run everything if none are given
+    std::vector<std::wstring> tokens = splitCommandLine( cmdLine );
+    std::vector<std::wstring> names;
+    bool afterBench = false;
+    for ( size_t i = 0; i < tokens.size(); i++ ) {
+        if ( tokens[i] == L"-bench" )
+            afterBench = true;
+        else if ( afterBench && tokens[i][0] != L'-' )
+            names.push_back( tokens[i] );
+        else
+            afterBench = false;
+    }
+
+    logBenchmark( "* * * * * Benchmark run * * * * *\n" );
+
+    for ( size_t b = 0; b < ARRAYSIZE(benchmarks); b++ ) {
+        bool selected = names.empty();
+        for ( size_t n = 0; n < names.size(); n++ ) {
+            if ( names[n] == benchmarks[b].name )
+                selected = true;
+        }
+
+        if ( selected ) {
+            logBenchmark( "- - - %ls - - -\n", benchmarks[b].name );
+            benchmarks[b].run( context );
+        }
+    }
+}
+
+// * * * * * QUAD BATCH * * * * * //
+static void benchQuadBatch( const BenchmarkContext& context )
+{
+    const UINT textureCount = 4;
+    const UINT quadsPerFrame = 200000;
+    const UINT frameCount = 100;
+
+    // Same image in several slices, stands in for several same-size textures
+    TextureID textures[textureCount];
+    for ( UINT i = 0; i < textureCount; i++ )
+        textures[i] = context.pTextureArrays->loadTexture( L"Textures/gorilla.jpg" );
+
+    std::vector<DirectX::XMFLOAT2> positions( quadsPerFrame );
+    for ( UINT i = 0; i < quadsPerFrame; i++ )
+        positions[i] = DirectX::XMFLOAT2( randomFloat() * context.width, randomFloat() * context.height );
+
+    DirectX::XMMATRIX screenSpace = DirectX::XMMatrixOrthographicOffCenterLH( 0.0f, (float)context.width, 0.0f, (float)context.height, 0.0f, 1.0f );
+    DirectX::XMFLOAT2 size( 8.0f, 8.0f );
+    float backgroundColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    double submitMs = 0.0;
+    UINT drawCalls = 0;
+    Timer totalTimer;
+
+    for ( UINT frame = 0; frame < frameCount; frame++ ) {
+        context.pTextureArrays->beginFrame();
+        context.pDeviceContext->ClearRenderTargetView( context.pRenderTarget, backgroundColor );
+        context.pDeviceContext->OMSetRenderTargets( 1, &context.pRenderTarget, context.pDepthStencilView );
+
+        Timer submitTimer;
+        context.pQuadBatch->begin( QuadBatch::SORT_TEXTURE, screenSpace );
+        for ( UINT i = 0; i < quadsPerFrame; i++ )
+            context.pQuadBatch->draw( textures[i % textureCount], positions[i], size, (float)i * 0.001f );
+        context.pQuadBatch->end();
+        submitMs += submitTimer.elapsedMs();
+
+        drawCalls += context.pQuadBatch->getStats().drawCalls;
+        context.pSwapchain->Present( 0, 0 );
+    }
+
+    double totalMs = totalTimer.elapsedMs();
+    double quadCount = (double)quadsPerFrame * frameCount;
+
+    logBenchmark( "quads/frame: %u, frames: %u, draw calls/frame: %.1f\n", quadsPerFrame, frameCount, (double)drawCalls / frameCount );
+    logBenchmark( "CPU build + submit: %.2f ms/frame, %.2f million quads/sec\n", submitMs / frameCount, quadCount / ( submitMs * 1000.0 ) );
+    logBenchmark( "End to end (incl. Present): %.2f ms/frame, %.2f million quads/sec\n", totalMs / frameCount, quadCount / ( totalMs * 1000.0 ) );
+
+    for ( UINT i = 0; i < textureCount; i++ ) {
+        if ( textures[i] != INVALID_TEXTURE_ID )
+            context.pTextureArrays->unloadTexture( textures[i] );
+    }
+}
+
+// * * * * * INDEX BUFFERS - 16 bit selection and compression * * * * * //
+// Same triangles in the same order, each may come back rotated (IndexCodec.h)
+template<typename Index>
+static bool sameTriangles( const std::vector<Index>& source, const std::vector<Index>& decoded )
+{
+    if ( source.size() != decoded.size() )
+        return false;
+
+    for ( size_t i = 0; i + 2 < source.size(); i += 3 ) {
+        bool match = false;
+        for ( UINT rotation = 0; rotation < 3 && !match; rotation++ )
+            match = decoded[i] == source[i + rotation] && decoded[i + 1] == source[i + ( rotation + 1 ) % 3] && decoded[i + 2] == source[i + ( rotation + 2 ) % 3];
+        if ( !match )
+            return false;
+    }
+    return true;
+}
+
+static void benchIndexCodec( const BenchmarkContext& )
+{
+    // 1024 x 1024 cells -> ~1M vertices, 2M triangles, needs splitting for 16 bit indices
+    MeshData grid;
+    createGridMesh( 1024, 1024, 10.0f, 10.0f, grid );
+
+    Timer buildTimer;
+    PackedMeshData packedGrid;
+    buildPackedMesh( grid, packedGrid );
+    double buildMs = buildTimer.elapsedMs();
+
+    UINT indexCount = (UINT)packedGrid.indices16.size();
+    logBenchmark( "grid: %u vertices -> %u parts, %u vertices after split (%.2f%% duplicated), build %.2f ms\n",
+                  (UINT)grid.vertices.size(), (UINT)packedGrid.parts.size(), (UINT)packedGrid.vertices.size(),
+                  100.0 * ( (double)packedGrid.vertices.size() / grid.vertices.size() - 1.0 ), buildMs );
+
+    std::vector<BYTE> fileData;
+    MeshFileStats fileStats;
+    Timer encodeTimer;
+    serializeMesh( packedGrid, fileData, fileStats );
+    double encodeMs = encodeTimer.elapsedMs();
+
+    PackedMeshData decoded;
+    const UINT decodeRuns = 10;
+    bool decodedAll = true;
+    Timer decodeTimer;
+    for ( UINT run = 0; run < decodeRuns; run++ )
+        decodedAll = deserializeMesh( fileData.data(), fileData.size(), decoded ) && decodedAll;
+    double decodeMs = decodeTimer.elapsedMs() / decodeRuns;
+
+    size_t indexBytes = fileStats.compressedIndexBytes;
+    logBenchmark( "indices: %u | 32 bit %.2f MB | 16 bit %.2f MB | compressed %.2f MB (%.2f bytes/triangle)\n",
+                  indexCount, indexCount * 4.0 / 1048576.0, indexCount * 2.0 / 1048576.0, indexBytes / 1048576.0, indexBytes / ( indexCount / 3.0 ) );
+    logBenchmark( "encode %.2f ms | decode %.2f ms (%.1f million triangles/sec)\n",
+                  encodeMs, decodeMs, ( indexCount / 3.0 ) / ( decodeMs * 1000.0 ) );
+
+    bool identical = decodedAll && decoded.indexFormat == packedGrid.indexFormat &&
+                     sameTriangles( packedGrid.indices16, decoded.indices16 ) && sameTriangles( packedGrid.indices32, decoded.indices32 ) &&
+                     decoded.parts.size() == packedGrid.parts.size() && decoded.vertices.size() == packedGrid.vertices.size() &&
+                     memcmp( decoded.parts.data(), packedGrid.parts.data(), sizeof(MeshPart) * decoded.parts.size() ) == 0 &&
+                     memcmp( decoded.vertices.data(), packedGrid.vertices.data(), sizeof(PackedVertex) * decoded.vertices.size() ) == 0;
+    logBenchmark( "round trip: %s\n", identical ? "ok" : "FAILED" );
+}
+
+// * * * * * MESH OPTIMIZER * * * * * //
+static void benchMeshOptimizer( const BenchmarkContext& )
+{
+    // 3 x 3 x 3 overlapping spheres with the triangles shuffled, like an unoptimized export
+    MeshData sphere;
+    createSphereMesh( 64, 32, 1.0f, sphere );
+
+    MeshData mesh;
+    for ( UINT i = 0; i < 27; i++ )
+        appendMesh( mesh, sphere, DirectX::XMFLOAT3( ( i % 3 ) * 1.5f, ( i / 3 % 3 ) * 1.5f, ( i / 9 ) * 1.5f ) );
+
+    UINT triangleCount = (UINT)mesh.indices.size() / 3;
+    for ( UINT t = triangleCount - 1; t > 0; t-- ) {
+        UINT other = (UINT)( randomFloat() * ( t + 1 ) ) % ( t + 1 );
+        for ( UINT k = 0; k < 3; k++ )
+            std::swap( mesh.indices[t * 3 + k], mesh.indices[other * 3 + k] );
+    }
+
+    MeshOptimizationStats before = analyzeMesh( mesh );
+
+    Timer optimizeTimer;
+    UINT vertexCount = (UINT)mesh.vertices.size();
+    optimizeOverdraw( mesh.indices.data(), (UINT)mesh.indices.size(), mesh.vertices.data(), vertexCount );
+    vertexCount = optimizeVertexFetch( mesh.vertices.data(), mesh.indices.data(), (UINT)mesh.indices.size(), vertexCount );
+    mesh.vertices.resize( vertexCount );
+    double optimizeMs = optimizeTimer.elapsedMs();
+
+    MeshOptimizationStats after = analyzeMesh( mesh );
+
+    logBenchmark( "mesh: %u vertices, %u triangles, optimize %.2f ms\n", vertexCount, triangleCount, optimizeMs );
+    logBenchmark( "ACMR %.3f -> %.3f | ATVR %.3f -> %.3f | overdraw %.3f -> %.3f | overfetch %.3f -> %.3f\n",
+                  before.acmr, after.acmr, before.atvr, after.atvr, before.overdraw, after.overdraw, before.overfetch, after.overfetch );
+}
+
+// * * * * * MESHLET CULLING * * * * * //
+static void benchMeshlets( const BenchmarkContext& context )
+{
+    // 4 x 4 x 4 spheres in one mesh, the camera orbits the block from close by
+    MeshData sphere;
+    createSphereMesh( 64, 32, 0.5f, sphere );
+
+    MeshData mesh;
+    for ( UINT i = 0; i < 64; i++ )
+        appendMesh( mesh, sphere, DirectX::XMFLOAT3( ( i % 4 ) * 1.5f - 2.25f, ( i / 4 % 4 ) * 1.5f - 2.25f, ( i / 16 ) * 1.5f - 2.25f ) );
+    optimizeMesh( mesh, "meshlet block" );
+
+    Timer buildTimer;
+    MeshletMesh meshletMesh;
+    if ( !createMeshletMesh( context.pDevice, mesh, meshletMesh ) ) {
+        logBenchmark( "createMeshletMesh failed\n" );
+        return;
+    }
+    double buildMs = buildTimer.elapsedMs();
+
+    Camera camera;
+    camera.target = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+    camera.up = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    camera.fovY = DirectX::XM_PIDIV4;
+    camera.aspectRatio = (float)context.width / context.height;
+    camera.nearZ = 0.1f;
+    camera.farZ = 1000.0f;
+
+    const UINT frameCount = 360;
+    double cullMs = 0.0;
+    UINT64 frustumCulled = 0, backfaceCulled = 0, visibleTriangles = 0;
+
+    for ( UINT frame = 0; frame < frameCount; frame++ ) {
+        float angle = frame * DirectX::XM_2PI / frameCount;
+        camera.position = DirectX::XMFLOAT3( sinf( angle ) * 5.0f, 1.0f, cosf( angle ) * 5.0f );
+
+        Timer cullTimer;
+        cullMeshlets( context.pDeviceContext, meshletMesh, DirectX::XMMatrixIdentity(), camera );
+        cullMs += cullTimer.elapsedMs();
+
+        frustumCulled += meshletMesh.stats.frustumCulled;
+        backfaceCulled += meshletMesh.stats.backfaceCulled;
+        visibleTriangles += meshletMesh.stats.visibleTriangles;
+    }
+
+    const MeshletCullStats& stats = meshletMesh.stats;
+    logBenchmark( "%u triangles -> %u meshlets (%.1f triangles/meshlet), build %.2f ms\n",
+                  stats.totalTriangles, stats.meshletCount, (double)stats.totalTriangles / stats.meshletCount, buildMs );
+    logBenchmark( "per frame: frustum culled %.1f | backface culled %.1f | visible triangles %.1f%%\n",
+                  (double)frustumCulled / frameCount, (double)backfaceCulled / frameCount, 100.0 * visibleTriangles / ( (double)frameCount * stats.totalTriangles ) );
+    logBenchmark( "cull + index upload: %.3f ms/frame\n", cullMs / frameCount );
+
+    releaseMeshletMesh( meshletMesh );
+}
+
+// * * * * * LOD CHAIN + SELECTION * * * * * //
+static void benchLod( const BenchmarkContext& context )
+{
+    MeshData sphere;
+    createSphereMesh( 256, 128, 1.0f, sphere );
+
+    Timer generateTimer;
+    std::vector<LodLevel> lods;
+    generateLodChain( sphere, lods, 6 );
+    double generateMs = generateTimer.elapsedMs();
+
+    logBenchmark( "generated %u levels in %.2f ms\n", (UINT)lods.size(), generateMs );
+    for ( size_t i = 0; i < lods.size(); i++ )
+        logBenchmark( "  level %u: %u triangles, %u vertices, error %f\n", (UINT)i, (UINT)lods[i].mesh.indices.size() / 3, (UINT)lods[i].mesh.vertices.size(), lods[i].error );
+
+    LodSelection selection;
+    initLodSelection( lods, selection );
+
+    DirectX::XMMATRIX view = DirectX::XMMatrixLookAtLH( DirectX::XMVectorSet( 0.0f, 0.0f, 0.0f, 0.0f ), DirectX::XMVectorSet( 0.0f, 0.0f, 1.0f, 0.0f ), DirectX::XMVectorSet( 0.0f, 1.0f, 0.0f, 0.0f ) );
+    DirectX::XMMATRIX projection = DirectX::XMMatrixPerspectiveFovLH( DirectX::XM_PIDIV4, (float)context.width / context.height, 0.1f, 1000.0f );
+
+    // Fly away and back with a little jitter, count level switches (hysteresis keeps them low)
+    const UINT steps = 20000;
+    UINT switches = 0;
+    UINT64 drawnTriangles = 0, fullTriangles = 0;
+    UINT previous = 0;
+
+    Timer selectTimer;
+    for ( UINT step = 0; step < steps; step++ ) {
+        float t = (float)step / steps;
+        float distance = 2.0f + 98.0f * ( t < 0.5f ? t * 2.0f : ( 1.0f - t ) * 2.0f ) + ( randomFloat() - 0.5f ) * 0.2f;
+
+        DirectX::XMMATRIX world = DirectX::XMMatrixTranslation( 0.0f, 0.0f, distance );
+        UINT lod = selectLod( selection, world, view, projection, (float)context.height );
+
+        switches += ( lod != previous ) ? 1 : 0;
+        previous = lod;
+        drawnTriangles += lods[lod].mesh.indices.size() / 3;
+        fullTriangles += lods[0].mesh.indices.size() / 3;
+    }
+    double selectMs = selectTimer.elapsedMs();
+
+    logBenchmark( "selection: %.3f us/call, %u level switches over %u steps\n", selectMs * 1000.0 / steps, switches, steps );
+    logBenchmark( "triangles drawn: %.1f%% of full resolution\n", 100.0 * drawnTriangles / fullTriangles );
+}
+
+// * * * * * MODEL LOADING - SDKMESH / CMO / VBO, mapped vs read * * * * * //
+// Minimal writers for test files, the layouts follow DirectXTK's loaders (see ModelFile.cpp)
+template<typename T>
+static void appendBytes( std::vector<BYTE>& data, const T& value )
+{
+    const BYTE* p = (const BYTE*)&value;
+    data.insert( data.end(), p, p + sizeof(T) );
+}
+
+static void appendBytes( std::vector<BYTE>& data, const void* pSource, size_t size )
+{
+    const BYTE* p = (const BYTE*)pSource;
+    data.insert( data.end(), p, p + size );
+}
+
+static void appendFloats( std::vector<BYTE>& data, const Vertex& vertex, bool withTexcoord )
+{
+    appendBytes( data, vertex.pos );
+    appendBytes( data, vertex.normal );
+    if ( withTexcoord )
+        appendBytes( data, vertex.texcoord );
+}
+
+static bool writeFile( const wchar_t* fileName, const std::vector<BYTE>& data )
+{
+    FILE* pFile = NULL;
+    if ( _wfopen_s( &pFile, fileName, L"wb" ) != 0 || !pFile )
+        return false;
+
+    size_t written = fwrite( data.data(), 1, data.size(), pFile );
+    fclose( pFile );
+    return written == data.size();
+}
+
+static bool writeTestVBO( const wchar_t* fileName, const MeshData& mesh )
+{
+    std::vector<BYTE> data;
+    appendBytes( data, (UINT)mesh.vertices.size() );
+    appendBytes( data, (UINT)mesh.indices.size() );
+    for ( size_t v = 0; v < mesh.vertices.size(); v++ )
+        appendFloats( data, mesh.vertices[v], true );
+    for ( size_t i = 0; i < mesh.indices.size(); i++ )
+        appendBytes( data, (USHORT)mesh.indices[i] );
+    return writeFile( fileName, data );
+}
+
+// One vertex / 32 bit index buffer, a subset per piece
+static bool writeTestSDKMESH( const wchar_t* fileName, const MeshData& mesh, UINT pieceCount )
+{
+    const size_t headerSize = 104, vertexHeaderSize = 288, indexHeaderSize = 32, meshSize = 224, subsetSize = 144;
+    const UINT stride = 32;
+
+    UINT64 nonBufferSize = vertexHeaderSize + indexHeaderSize + meshSize + subsetSize * pieceCount + sizeof(UINT) * pieceCount;
+    UINT64 vertexDataOffset = headerSize + nonBufferSize;
+    UINT64 vertexBytes = (UINT64)mesh.vertices.size() * stride;
+    UINT64 indexDataOffset = vertexDataOffset + vertexBytes;
+    UINT64 indexBytes = (UINT64)mesh.indices.size() * sizeof(UINT);
+
+    std::vector<BYTE> data;
+    data.reserve( (size_t)( indexDataOffset + indexBytes ) );
+
+    // - - - header - - - //
+    UINT version = 101;
+    appendBytes( data, version );
+    data.resize( data.size() + 4, 0 );                                  // isBigEndian + padding
+    appendBytes( data, (UINT64)headerSize );
+    appendBytes( data, nonBufferSize );
+    appendBytes( data, vertexBytes + indexBytes );
+    UINT counts[6] = { 1, 1, 1, pieceCount, 0, 0 };
+    appendBytes( data, counts, sizeof(counts) );
+    UINT64 offsets[6] = { headerSize, headerSize + vertexHeaderSize, headerSize + vertexHeaderSize + indexHeaderSize,
+                          headerSize + vertexHeaderSize + indexHeaderSize + meshSize, 0, 0 };
+    appendBytes( data, offsets, sizeof(offsets) );
+
+    // - - - vertex buffer header: position float3, normal float3, texcoord float2 - - - //
+    appendBytes( data, (UINT64)mesh.vertices.size() );
+    appendBytes( data, vertexBytes );
+    appendBytes( data, (UINT64)stride );
+    // stream, offset, D3DDECLTYPE, method, D3DDECLUSAGE, usage index - the rest of the 32 elements stays zero
+    BYTE decl[32 * 8];
+    memset( decl, 0, sizeof(decl) );
+    const BYTE elements[4][3] = { { 0, 2, 0 }, { 12, 2, 3 }, { 24, 1, 5 }, { 0, 17, 0 } };   // float3 pos, float3 normal, float2 uv, end
+    for ( int e = 0; e < 4; e++ ) {
+        BYTE* pElement = decl + e * 8;
+        pElement[0] = ( e == 3 ) ? 0xFF : 0;
+        pElement[2] = elements[e][0];
+        pElement[4] = elements[e][1];
+        pElement[6] = elements[e][2];
+    }
+    appendBytes( data, decl, sizeof(decl) );
+    appendBytes( data, vertexDataOffset );
+
+    // - - - index buffer header - - - //
+    appendBytes( data, (UINT64)mesh.indices.size() );
+    appendBytes( data, indexBytes );
+    appendBytes( data, (UINT64)1 );                                     // 32 bit + padding
+    appendBytes( data, indexDataOffset );
+
+    // - - - mesh - - - //
+    size_t meshStart = data.size();
+    data.resize( meshStart + meshSize, 0 );
+    data[meshStart + 100] = 1;                                          // numVertexBuffers
+    UINT meshFields[3] = { 0, pieceCount, 0 };                          // indexBuffer, numSubsets, numFrameInfluences
+    memcpy( &data[meshStart + 168], meshFields, sizeof(meshFields) );
+    UINT64 subsetIndexOffset = offsets[3] + subsetSize * pieceCount;
+    memcpy( &data[meshStart + 208], &subsetIndexOffset, sizeof(UINT64) );
+
+    // - - - subsets - - - //
+    UINT piecesIndices = (UINT)mesh.indices.size() / pieceCount;
+    for ( UINT p = 0; p < pieceCount; p++ ) {
+        size_t subsetStart = data.size();
+        data.resize( subsetStart + subsetSize, 0 );
+        UINT64 range[4] = { (UINT64)p * piecesIndices, piecesIndices, 0, mesh.vertices.size() };
+        memcpy( &data[subsetStart + 112], range, sizeof(range) );
+    }
+    for ( UINT p = 0; p < pieceCount; p++ )
+        appendBytes( data, p );
+
+    // - - - buffer data - - - //
+    for ( size_t v = 0; v < mesh.vertices.size(); v++ )
+        appendFloats( data, mesh.vertices[v], true );
+    appendBytes( data, mesh.indices.data(), indexBytes );
+
+    return writeFile( fileName, data );
+}
+
+// One mesh, a 16 bit vertex / index buffer pair and submesh per piece
+static bool writeTestCMO( const wchar_t* fileName, const std::vector<MeshData>& pieces )
+{
+    std::vector<BYTE> data;
+    UINT pieceCount = (UINT)pieces.size();
+
+    appendBytes( data, (UINT)1 );                                       // meshes
+    appendBytes( data, (UINT)0 );                                       // name
+    appendBytes( data, (UINT)0 );                                       // materials
+    appendBytes( data, (BYTE)0 );                                       // no skeleton
+
+    appendBytes( data, pieceCount );
+    for ( UINT p = 0; p < pieceCount; p++ ) {
+        UINT subMesh[5] = { 0, p, p, 0, (UINT)pieces[p].indices.size() / 3 };
+        appendBytes( data, subMesh, sizeof(subMesh) );
+    }
+
+    appendBytes( data, pieceCount );
+    for ( UINT p = 0; p < pieceCount; p++ ) {
+        appendBytes( data, (UINT)pieces[p].indices.size() );
+        for ( size_t i = 0; i < pieces[p].indices.size(); i++ )
+            appendBytes( data, (USHORT)pieces[p].indices[i] );
+    }
+
+    appendBytes( data, pieceCount );
+    for ( UINT p = 0; p < pieceCount; p++ ) {
+        appendBytes( data, (UINT)pieces[p].vertices.size() );
+        for ( size_t v = 0; v < pieces[p].vertices.size(); v++ ) {
+            const Vertex& vertex = pieces[p].vertices[v];
+            appendFloats( data, vertex, false );
+            appendBytes( data, DirectX::XMFLOAT4( 1.0f, 0.0f, 0.0f, 1.0f ) );  // tangent
+            appendBytes( data, (UINT)0xFFFFFFFF );                              // color
+            appendBytes( data, vertex.texcoord );
+        }
+    }
+
+    appendBytes( data, (UINT)0 );                                       // skinning buffers
+    float extents[10] = { 0.0f };
+    appendBytes( data, extents, sizeof(extents) );
+
+    return writeFile( fileName, data );
+}
+
+static void timeModelLoad( const BenchmarkContext& context, const wchar_t* fileName )
+{
+    const UINT runs = 5;
+    double mapMs = 0.0, readMs = 0.0, bufferMs = 0.0, extractMs = 0.0;
+    size_t fileSize = 0;
+    ModelView view;
+
+    for ( UINT run = 0; run < runs; run++ ) {
+        // - - - mapped: headers parsed in place - - - //
+        Timer mapTimer;
+        MappedFile file;
+        if ( !loadModelFile( fileName, file, view ) ) {
+            logBenchmark( "%ls: load failed\n", fileName );
+            return;
+        }
+        mapMs += mapTimer.elapsedMs();
+        fileSize = file.getSize();
+
+        Timer bufferTimer;
+        ModelBuffers buffers;
+        createModelBuffers( context.pDevice, view, buffers );
+        bufferMs += bufferTimer.elapsedMs();
+        releaseModelBuffers( buffers );
+
+        Timer extractTimer;
+        MeshData mesh;
+        extractMeshData( view, 0, mesh );
+        extractMs += extractTimer.elapsedMs();
+
+        // - - - baseline: read everything into a vector first - - - //
+        Timer readTimer;
+        std::vector<BYTE> copy;
+        FILE* pFile = NULL;
+        if ( _wfopen_s( &pFile, fileName, L"rb" ) == 0 && pFile ) {
+            copy.resize( fileSize );
+            fread( copy.data(), 1, fileSize, pFile );
+            fclose( pFile );
+        }
+        ModelView copyView;
+        parseModel( copy.data(), copy.size(), getModelFormat( fileName ), copyView );
+        readMs += readTimer.elapsedMs();
+    }
+
+    UINT64 vertexCount = 0, indexCount = 0;
+    for ( size_t i = 0; i < view.vertexBuffers.size(); i++ ) vertexCount += view.vertexBuffers[i].vertexCount;
+    for ( size_t i = 0; i < view.indexBuffers.size(); i++ ) indexCount += view.indexBuffers[i].indexCount;
+
+    logBenchmark( "%ls: %.1f MB, %llu vertices, %llu indices, %u subsets\n", fileName, fileSize / 1048576.0, vertexCount, indexCount, (UINT)view.subsets.size() );
+    logBenchmark( "  map + parse %.3f ms | read + parse %.3f ms | create buffers from mapping %.2f ms | extract subset 0 %.2f ms\n",
+                  mapMs / runs, readMs / runs, bufferMs / runs, extractMs / runs );
+}
+
+static void benchModelLoad( const BenchmarkContext& context )
+{
+    // 32 spheres of 32768 vertices: ~1M vertices / 2M triangles for the formats that allow it
+    const UINT pieceCount = 32;
+    MeshData sphere;
+    createSphereMesh( 255, 127, 1.0f, sphere );
+
+    std::vector<MeshData> pieces( pieceCount, sphere );
+    MeshData merged;
+    for ( UINT p = 0; p < pieceCount; p++ )
+        appendMesh( merged, sphere, DirectX::XMFLOAT3( (float)p * 2.5f, 0.0f, 0.0f ) );
+
+    // VBO only has 16 bit indices, one sphere is as large as it gets
+    if ( !writeTestVBO( L"bench_model.vbo", sphere ) ||
+         !writeTestSDKMESH( L"bench_model.sdkmesh", merged, pieceCount ) ||
+         !writeTestCMO( L"bench_model.cmo", pieces ) ) {
+        logBenchmark( "writing test models failed\n" );
+        return;
+    }
+    logBenchmark( "(files were just written, timings are with a warm file cache)\n" );
+
+    timeModelLoad( context, L"bench_model.sdkmesh" );
+    timeModelLoad( context, L"bench_model.cmo" );
+    timeModelLoad( context, L"bench_model.vbo" );
+}
+
+// * * * * * IMPORT - OBJ parsing single / multi threaded, binary cache * * * * * //
+// Engine mesh -> OBJ text (back to right handed, counter clockwise, bottom left uv origin)
+static bool writeTestOBJ( const wchar_t* fileName, const MeshData& mesh )
+{
+    std::string text;
+    char line[256];
+
+    for ( size_t v = 0; v < mesh.vertices.size(); v++ ) {
+        const Vertex& vertex = mesh.vertices[v];
+        sprintf_s( line, "v %.7g %.7g %.7g\n", vertex.pos.x, vertex.pos.y, -vertex.pos.z );                     text += line;
+        sprintf_s( line, "vt %.7g %.7g\n", vertex.texcoord.x, 1.0f - vertex.texcoord.y );                       text += line;
+        sprintf_s( line, "vn %.7g %.7g %.7g\n", vertex.normal.x, vertex.normal.y, -vertex.normal.z );            text += line;
+    }
+    for ( size_t i = 0; i < mesh.indices.size(); i += 3 ) {
+        UINT a = mesh.indices[i] + 1, b = mesh.indices[i + 2] + 1, c = mesh.indices[i + 1] + 1;
+        sprintf_s( line, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c );
+        text += line;
+    }
+
+    return writeFile( fileName, std::vector<BYTE>( text.begin(), text.end() ) );
+}
+
+static void benchImport( const BenchmarkContext& )
+{
+    const wchar_t* fileName = L"bench_import.obj";
+
+    MeshData sphere;
+    createSphereMesh( 1024, 512, 1.0f, sphere );
+    if ( !writeTestOBJ( fileName, sphere ) ) {
+        logBenchmark( "writing the test OBJ failed\n" );
+        return;
+    }
+
+    UINT hardwareThreads = std::max( std::thread::hardware_concurrency(), 1u );
+    UINT threadCounts[] = { 1, 2, 4, hardwareThreads };
+
+    for ( UINT t = 0; t < ARRAYSIZE(threadCounts); t++ ) {
+        if ( t > 0 && threadCounts[t] > hardwareThreads )
+            continue;
+
+        Timer timer;
+        MeshData mesh;
+        bool imported = importOBJ( fileName, mesh, threadCounts[t] );
+        double ms = timer.elapsedMs();
+
+        logBenchmark( "OBJ %u threads: %.1f ms, %u vertices, %u triangles%s\n", threadCounts[t], ms,
+                      (UINT)mesh.vertices.size(), (UINT)mesh.indices.size() / 3, imported ? "" : " (failed)" );
+    }
+
+    // - - - cold: parse + optimize + pack + write cache, warm: cache only - - - //
+    std::wstring cacheFileName = std::wstring( fileName ) + L".mesh";
+    DeleteFileW( cacheFileName.c_str() );
+
+    Timer coldTimer;
+    PackedMeshData packedMesh;
+    importMeshCached( fileName, packedMesh );
+    double coldMs = coldTimer.elapsedMs();
+
+    Timer warmTimer;
+    PackedMeshData cachedMesh;
+    importMeshCached( fileName, cachedMesh );
+    double warmMs = warmTimer.elapsedMs();
+
+    logBenchmark( "cached import: first run %.1f ms, from cache %.1f ms (%.0fx)\n", coldMs, warmMs, coldMs / std::max( warmMs, 0.001 ) );
+}
+
+// * * * * * TRANSFORM HIERARCHY * * * * * //
+static void benchTransforms( const BenchmarkContext& context )
+{
+    // 1M nodes: 1024 roots, every node has up to 8 children -> 7 levels
+    const UINT nodeCount = 1 << 20;
+    const UINT rootCount = 1024;
+
+    TransformHierarchy hierarchy;
+    hierarchy.reserve( nodeCount );
+
+    std::vector<TransformID> nodes( nodeCount );
+    std::vector<DirectX::XMFLOAT3> positions( nodeCount ), scales( nodeCount );
+    std::vector<DirectX::XMFLOAT4> rotations( nodeCount );
+    for ( UINT i = 0; i < nodeCount; i++ ) {
+        TransformID parent = ( i < rootCount ) ? INVALID_TRANSFORM_ID : nodes[( i - rootCount ) / 8];
+
+        positions[i] = DirectX::XMFLOAT3( randomFloat() * 4.0f - 2.0f, randomFloat() * 4.0f - 2.0f, randomFloat() * 4.0f - 2.0f );
+        scales[i] = DirectX::XMFLOAT3( 0.8f + randomFloat() * 0.4f, 0.8f + randomFloat() * 0.4f, 0.8f + randomFloat() * 0.4f );
+        DirectX::XMStoreFloat4( &rotations[i], DirectX::XMQuaternionRotationRollPitchYaw( randomFloat() * 6.28f, randomFloat() * 6.28f, randomFloat() * 6.28f ) );
+
+        nodes[i] = hierarchy.addNode( parent, positions[i], rotations[i], scales[i] );
+    }
+
+    const UINT runs = 10;
+    std::vector<DirectX::XMFLOAT4X4> referenceWorlds( nodeCount );
+
+    // Reference: one XMMatrix composition per node, the way updateCBuffs used to build its world matrix
+    Timer referenceTimer;
+    for ( UINT run = 0; run < runs; run++ ) {
+        for ( UINT i = 0; i < nodeCount; i++ ) {
+            DirectX::XMMATRIX local = DirectX::XMMatrixScaling( scales[i].x, scales[i].y, scales[i].z ) *
+                                      DirectX::XMMatrixRotationQuaternion( DirectX::XMLoadFloat4( &rotations[i] ) ) *
+                                      DirectX::XMMatrixTranslation( positions[i].x, positions[i].y, positions[i].z );
+            if ( i >= rootCount )
+                local = local * DirectX::XMLoadFloat4x4( &referenceWorlds[( i - rootCount ) / 8] );
+            DirectX::XMStoreFloat4x4( &referenceWorlds[i], local );
+        }
+    }
+    double referenceMs = referenceTimer.elapsedMs() / runs;
+
+    // First update sorts by depth and builds every world matrix
+    Timer firstTimer;
+    hierarchy.update();
+    double firstMs = firstTimer.elapsedMs();
+
+    float maxError = 0.0f;
+    for ( UINT i = 0; i < nodeCount; i++ ) {
+        const DirectX::XMFLOAT4X4& world = hierarchy.getWorld( nodes[i] );
+        for ( UINT row = 0; row < 4; row++ )
+            for ( UINT column = 0; column < 4; column++ )
+                maxError = std::max( maxError, fabsf( world.m[row][column] - referenceWorlds[i].m[row][column] ) );
+    }
+
+    logBenchmark( "%u nodes, %u levels, first update (sort + build) %.2f ms, max error vs XMMatrix %g\n", nodeCount, hierarchy.getLevelCount(), firstMs, maxError );
+    logBenchmark( "XMMatrix per node: %.2f ms\n", referenceMs );
+
+    // - - - all roots moved: every world matrix is rebuilt - - - //
+    JobSystem* pJobSystems[] = { NULL, context.pJobSystem };
+    for ( UINT j = 0; j < ARRAYSIZE(pJobSystems); j++ ) {
+        if ( j > 0 && !pJobSystems[j] )
+            continue;
+
+        double ms = 0.0;
+        for ( UINT run = 0; run < runs; run++ ) {
+            for ( UINT r = 0; r < rootCount; r++ )
+                hierarchy.setPosition( nodes[r], DirectX::XMFLOAT3( (float)run, 0.0f, (float)r ) );
+
+            Timer timer;
+            hierarchy.update( pJobSystems[j] );
+            ms += timer.elapsedMs();
+        }
+        logBenchmark( "full update, %u threads: %.2f ms (%u nodes rebuilt)\n", pJobSystems[j] ? pJobSystems[j]->getThreadCount() : 1, ms / runs, hierarchy.getUpdatedCount() );
+    }
+
+    // - - - 1% of the leaves moved: only those are rebuilt - - - //
+    double partialMs = 0.0;
+    for ( UINT run = 0; run < runs; run++ ) {
+        for ( UINT i = nodeCount - 1; i >= nodeCount - nodeCount / 100; i-- )
+            hierarchy.setScale( nodes[i], DirectX::XMFLOAT3( 1.0f, 1.0f + run * 0.01f, 1.0f ) );
+
+        Timer timer;
+        hierarchy.update( context.pJobSystem );
+        partialMs += timer.elapsedMs();
+    }
+    logBenchmark( "1%% leaves dirty: %.2f ms (%u nodes rebuilt)\n", partialMs / runs, hierarchy.getUpdatedCount() );
+
+    Timer idleTimer;
+    hierarchy.update( context.pJobSystem );
+    hierarchy.update( context.pJobSystem );
+    logBenchmark( "nothing dirty: %.3f ms\n", idleTimer.elapsedMs() / 2 );
+}
+
+// * * * * * FRUSTUM CULLING * * * * * //
+static void benchCulling( const BenchmarkContext& context )
+{
+    // 1M objects in a 1000^3 block around the camera, half spheres, half boxes
+    const UINT objectCount = 1 << 20;
+
+    FrustumCuller culler;
+    culler.reserve( objectCount );
+
+    std::vector<DirectX::XMFLOAT3> centers( objectCount ), extents( objectCount );
+    for ( UINT i = 0; i < objectCount; i++ ) {
+        centers[i] = DirectX::XMFLOAT3( randomFloat() * 1000.0f - 500.0f, randomFloat() * 1000.0f - 500.0f, randomFloat() * 1000.0f - 500.0f );
+        extents[i] = DirectX::XMFLOAT3( 0.5f + randomFloat() * 4.0f, 0.5f + randomFloat() * 4.0f, 0.5f + randomFloat() * 4.0f );
+
+        if ( i & 1 )
+            culler.addBox( centers[i], extents[i] );
+        else
+            culler.addSphere( centers[i], extents[i].x );
+    }
+
+    Camera camera;
+    camera.position = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+    camera.up = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    camera.fovY = DirectX::XM_PIDIV4;
+    camera.aspectRatio = (float)context.width / context.height;
+    camera.nearZ = 0.1f;
+    camera.farZ = 1000.0f;
+
+    const UINT frameCount = 60;
+    double scalarMs = 0.0, simdMs = 0.0, threadedMs = 0.0;
+    UINT64 visibleTotal = 0;
+    UINT mismatches = 0;
+
+    std::vector<UINT> reference, visible, visibleThreaded;
+    reference.reserve( objectCount );
+
+    for ( UINT frame = 0; frame < frameCount; frame++ ) {
+        float angle = frame * DirectX::XM_2PI / frameCount;
+        camera.target = DirectX::XMFLOAT3( sinf( angle ), 0.0f, cosf( angle ) );
+
+        Frustum frustum;
+        extractFrustum( getViewMatrix( camera ) * getProjectionMatrix( camera ), frustum );
+
+        // Reference: one object at a time, the sphere test the meshlets use
+        Timer scalarTimer;
+        reference.clear();
+        for ( UINT i = 0; i < objectCount; i++ ) {
+            float radius = ( i & 1 ) ? sqrtf( extents[i].x * extents[i].x + extents[i].y * extents[i].y + extents[i].z * extents[i].z ) : extents[i].x;
+            if ( sphereInFrustum( frustum, centers[i], radius ) )
+                reference.push_back( i );
+        }
+        scalarMs += scalarTimer.elapsedMs();
+
+        Timer simdTimer;
+        culler.cull( frustum, visible );
+        simdMs += simdTimer.elapsedMs();
+
+        Timer threadedTimer;
+        culler.cull( frustum, visibleThreaded, context.pJobSystem );
+        threadedMs += threadedTimer.elapsedMs();
+
+        // Boxes can only cull more than their bounding sphere, never keep something the sphere culled
+        if ( visible != visibleThreaded || visible.size() > reference.size() || !std::includes( reference.begin(), reference.end(), visible.begin(), visible.end() ) )
+            mismatches++;
+        visibleTotal += visible.size();
+    }
+
+    logBenchmark( "%u objects, %.1f%% visible on average, %u mismatching frames\n", objectCount, 100.0 * visibleTotal / ( (double)frameCount * objectCount ), mismatches );
+    logBenchmark( "scalar spheres: %.3f ms | SIMD (%u lanes): %.3f ms | SIMD, %u threads: %.3f ms\n",
+                  scalarMs / frameCount, SimdLanes::width, simdMs / frameCount, context.pJobSystem ? context.pJobSystem->getThreadCount() : 1, threadedMs / frameCount );
+}
+
+// * * * * * BVH * * * * * //
+static bool boxesOverlap( const DirectX::XMFLOAT3& minA, const DirectX::XMFLOAT3& maxA, const DirectX::XMFLOAT3& minB, const DirectX::XMFLOAT3& maxB )
+{
+    return minA.x <= maxB.x && maxA.x >= minB.x && minA.y <= maxB.y && maxA.y >= minB.y && minA.z <= maxB.z && maxA.z >= minB.z;
+}
+
+static void benchBvh( const BenchmarkContext& context )
+{
+    // 1M boxes, clustered like a scene: dense blobs scattered through a 1000^3 block
+    const UINT objectCount = 1 << 20;
+    const UINT clusterCount = 256;
+
+    std::vector<DirectX::XMFLOAT3> clusters( clusterCount );
+    for ( UINT c = 0; c < clusterCount; c++ )
+        clusters[c] = DirectX::XMFLOAT3( randomFloat() * 1000.0f - 500.0f, randomFloat() * 1000.0f - 500.0f, randomFloat() * 1000.0f - 500.0f );
+
+    std::vector<DirectX::XMFLOAT3> mins( objectCount ), maxs( objectCount );
+    for ( UINT i = 0; i < objectCount; i++ ) {
+        const DirectX::XMFLOAT3& cluster = clusters[i % clusterCount];
+        DirectX::XMFLOAT3 center( cluster.x + ( randomFloat() - 0.5f ) * 60.0f, cluster.y + ( randomFloat() - 0.5f ) * 60.0f, cluster.z + ( randomFloat() - 0.5f ) * 60.0f );
+        float size = 0.1f + randomFloat() * 1.0f;
+        mins[i] = DirectX::XMFLOAT3( center.x - size, center.y - size, center.z - size );
+        maxs[i] = DirectX::XMFLOAT3( center.x + size, center.y + size, center.z + size );
+    }
+
+    // - - - build - - - //
+    Bvh bvh;
+    Timer serialTimer;
+    bvh.build( mins.data(), maxs.data(), objectCount );
+    double serialMs = serialTimer.elapsedMs();
+
+    double parallelMs = 0.0;
+    if ( context.pJobSystem ) {
+        Timer parallelTimer;
+        bvh.build( mins.data(), maxs.data(), objectCount, context.pJobSystem );
+        parallelMs = parallelTimer.elapsedMs();
+    }
+
+    logBenchmark( "%u objects -> %u nodes, SAH cost %.1f\n", objectCount, bvh.getNodeCount(), bvh.getSahCost() );
+    logBenchmark( "build: %.1f ms single threaded, %.1f ms on %u threads\n", serialMs, parallelMs, context.pJobSystem ? context.pJobSystem->getThreadCount() : 1 );
+
+    // - - - refit: a few movers (path refit) and everything moving (full sweep) - - - //
+    const UINT moverCount = objectCount / 1000;
+    Timer fewTimer;
+    for ( UINT m = 0; m < moverCount; m++ ) {
+        UINT i = ( m * 7919u ) % objectCount;
+        mins[i].x += 0.5f;
+        maxs[i].x += 0.5f;
+        bvh.setObjectBounds( i, mins[i], maxs[i] );
+    }
+    bvh.refit();
+    double fewMs = fewTimer.elapsedMs();
+
+    Timer allTimer;
+    for ( UINT i = 0; i < objectCount; i++ ) {
+        mins[i].y += 0.25f;
+        maxs[i].y += 0.25f;
+        bvh.setObjectBounds( i, mins[i], maxs[i] );
+    }
+    bvh.refit();
+    double allMs = allTimer.elapsedMs();
+
+    logBenchmark( "refit: %u movers %.3f ms, all moving %.1f ms, SAH cost after %.1f\n", moverCount, fewMs, allMs, bvh.getSahCost() );
+
+    // - - - frustum queries against a brute force box test - - - //
+    Camera camera;
+    camera.position = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+    camera.up = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    camera.fovY = DirectX::XM_PIDIV4;
+    camera.aspectRatio = (float)context.width / context.height;
+    camera.nearZ = 0.1f;
+    camera.farZ = 1000.0f;
+
+    const UINT frustumCount = 16;
+    double frustumMs = 0.0, bruteMs = 0.0;
+    UINT64 frustumResults = 0;
+    UINT mismatches = 0;
+    std::vector<UINT> results, bruteResults;
+
+    for ( UINT f = 0; f < frustumCount; f++ ) {
+        float angle = f * DirectX::XM_2PI / frustumCount;
+        camera.target = DirectX::XMFLOAT3( sinf( angle ), 0.0f, cosf( angle ) );
+
+        Frustum frustum;
+        extractFrustum( getViewMatrix( camera ) * getProjectionMatrix( camera ), frustum );
+
+        Timer queryTimer;
+        results.clear();
+        bvh.queryFrustum( frustum, results );
+        frustumMs += queryTimer.elapsedMs();
+
+        Timer bruteTimer;
+        bruteResults.clear();
+        for ( UINT i = 0; i < objectCount; i++ ) {
+            bool inside = true;
+            for ( UINT p = 0; p < FRUSTUM_PLANE_COUNT && inside; p++ ) {
+                const DirectX::XMFLOAT4& plane = frustum.planes[p];
+                DirectX::XMFLOAT3 positive( plane.x >= 0.0f ? maxs[i].x : mins[i].x, plane.y >= 0.0f ? maxs[i].y : mins[i].y, plane.z >= 0.0f ? maxs[i].z : mins[i].z );
+                inside = plane.x * positive.x + plane.y * positive.y + plane.z * positive.z + plane.w >= 0.0f;
+            }
+            if ( inside )
+                bruteResults.push_back( i );
+        }
+        bruteMs += bruteTimer.elapsedMs();
+
+        std::sort( results.begin(), results.end() );
+        mismatches += ( results.size() != bruteResults.size() ) ? 1 : 0;
+        frustumResults += results.size();
+    }
+
+    logBenchmark( "frustum: %.3f ms/query (brute force %.2f ms), %.0f objects/query, %u mismatching queries\n",
+                  frustumMs / frustumCount, bruteMs / frustumCount, (double)frustumResults / frustumCount, mismatches );
+
+    // - - - rays from the middle and light spheres - - - //
+    const UINT rayCount = 10000;
+    UINT rayHits = 0;
+    Timer rayTimer;
+    for ( UINT r = 0; r < rayCount; r++ ) {
+        DirectX::XMFLOAT3 direction( randomFloat() - 0.5f, randomFloat() - 0.5f, randomFloat() - 0.5f );
+        BvhRayHit hit;
+        rayHits += bvh.raycast( DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f ), direction, 10000.0f, hit ) ? 1 : 0;
+    }
+    double rayMs = rayTimer.elapsedMs();
+
+    const UINT sphereCount = 10000;
+    UINT64 sphereResults = 0;
+    UINT sphereMismatches = 0;
+    Timer sphereTimer;
+    for ( UINT s = 0; s < sphereCount; s++ ) {
+        const DirectX::XMFLOAT3& cluster = clusters[s % clusterCount];
+        DirectX::XMFLOAT3 center( cluster.x + ( randomFloat() - 0.5f ) * 60.0f, cluster.y, cluster.z );
+
+        results.clear();
+        bvh.querySphere( center, 5.0f, results );
+        sphereResults += results.size();
+
+        // Spot check: every result overlaps the sphere's box
+        if ( s % 1000 == 0 ) {
+            DirectX::XMFLOAT3 sphereMin( center.x - 5.0f, center.y - 5.0f, center.z - 5.0f ), sphereMax( center.x + 5.0f, center.y + 5.0f, center.z + 5.0f );
+            for ( size_t i = 0; i < results.size(); i++ )
+                sphereMismatches += boxesOverlap( mins[results[i]], maxs[results[i]], sphereMin, sphereMax ) ? 0 : 1;
+        }
+    }
+    double sphereMs = sphereTimer.elapsedMs();
+
+    logBenchmark( "rays: %.2f us/ray, %.1f%% hit | spheres (r = 5): %.2f us/query, %.1f objects/query, %u bad results\n",
+                  rayMs * 1000.0 / rayCount, 100.0 * rayHits / rayCount, sphereMs * 1000.0 / sphereCount, (double)sphereResults / sphereCount, sphereMismatches );
+}
+
+// * * * * * OCCLUSION * * * * * //
+static void benchOcclusion( const BenchmarkContext& context )
+{
+    // City block: a grid of buildings as occluders, street level clutter as the objects to cull
+    const UINT gridSize = 12;
+    const float spacing = 20.0f;
+    const UINT objectCount = 100000;
+
+    OccluderMesh building;
+    for ( UINT corner = 0; corner < 8; corner++ )
+        building.positions.push_back( DirectX::XMFLOAT3( ( corner & 1 ) ? 0.5f : -0.5f, ( corner & 2 ) ? 1.0f : 0.0f, ( corner & 4 ) ? 0.5f : -0.5f ) );
+
+    UINT boxIndices[] = {
+        0, 2, 3, 0, 3, 1,   4, 5, 7, 4, 7, 6,   0, 1, 5, 0, 5, 4,
+        2, 6, 7, 2, 7, 3,   0, 4, 6, 0, 6, 2,   1, 3, 7, 1, 7, 5,
+    };
+    building.indices.assign( boxIndices, boxIndices + ARRAYSIZE(boxIndices) );
+
+    std::vector<DirectX::XMFLOAT4X4> buildingWorlds;
+    float halfGrid = ( gridSize - 1 ) * spacing * 0.5f;
+    for ( UINT z = 0; z < gridSize; z++ ) {
+        for ( UINT x = 0; x < gridSize; x++ ) {
+            DirectX::XMFLOAT4X4 world;
+            DirectX::XMStoreFloat4x4( &world, DirectX::XMMatrixScaling( 12.0f, 10.0f + randomFloat() * 30.0f, 12.0f ) *
+                                              DirectX::XMMatrixTranslation( x * spacing - halfGrid, 0.0f, z * spacing - halfGrid ) );
+            buildingWorlds.push_back( world );
+        }
+    }
+
+    FrustumCuller culler;
+    culler.reserve( objectCount );
+    std::vector<DirectX::XMFLOAT3> centers( objectCount ), extents( objectCount );
+    for ( UINT i = 0; i < objectCount; i++ ) {
+        centers[i] = DirectX::XMFLOAT3( ( randomFloat() - 0.5f ) * gridSize * spacing, randomFloat() * 4.0f, ( randomFloat() - 0.5f ) * gridSize * spacing );
+        extents[i] = DirectX::XMFLOAT3( 0.25f + randomFloat() * 0.75f, 0.25f + randomFloat() * 0.75f, 0.25f + randomFloat() * 0.75f );
+        culler.addBox( centers[i], extents[i] );
+    }
+
+    // Walking down the middle street, looking around
+    Camera camera;
+    camera.position = DirectX::XMFLOAT3( spacing * 0.5f, 1.8f, -halfGrid );
+    camera.up = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    camera.fovY = DirectX::XM_PIDIV4;
+    camera.aspectRatio = (float)context.width / context.height;
+    camera.nearZ = 0.1f;
+    camera.farZ = 1000.0f;
+
+    UINT resolutions[][2] = { { 160, 96 }, { 320, 192 }, { 640, 384 } };
+    const UINT frameCount = 32;
+    std::vector<UINT> visible;
+
+    for ( UINT r = 0; r < ARRAYSIZE(resolutions); r++ ) {
+        OcclusionCuller occlusion;
+        occlusion.resize( resolutions[r][0], resolutions[r][1] );
+
+        double rasterMs = 0.0, testMs = 0.0;
+        UINT64 frustumVisible = 0, occluded = 0;
+
+        for ( UINT frame = 0; frame < frameCount; frame++ ) {
+            float angle = ( frame / (float)frameCount - 0.5f ) * DirectX::XM_PI;
+            camera.position.z = -halfGrid + frame * spacing * gridSize / frameCount;
+            camera.target = DirectX::XMFLOAT3( camera.position.x + sinf( angle ), camera.position.y, camera.position.z + cosf( angle ) );
+
+            DirectX::XMMATRIX viewProjection = getViewMatrix( camera ) * getProjectionMatrix( camera );
+            Frustum frustum;
+            extractFrustum( viewProjection, frustum );
+            culler.cull( frustum, visible, context.pJobSystem );
+            frustumVisible += visible.size();
+
+            occlusion.beginFrame( viewProjection );
+            for ( size_t b = 0; b < buildingWorlds.size(); b++ )
+                occlusion.renderOccluder( building, DirectX::XMLoadFloat4x4( &buildingWorlds[b] ) );
+            occlusion.cullObjects( centers.data(), extents.data(), visible );
+
+            const OcclusionStats& stats = occlusion.getStats();
+            rasterMs += stats.rasterMs;
+            testMs += stats.testMs;
+            occluded += stats.occludedObjects;
+        }
+
+        logBenchmark( "%ux%u: %.0f objects in the frustum, %.1f%% occluded | raster %.3f ms (%u triangles), tests %.3f ms per frame\n",
+                      occlusion.getWidth(), occlusion.getHeight(), (double)frustumVisible / frameCount, frustumVisible ? 100.0 * occluded / frustumVisible : 0.0,
+                      rasterMs / frameCount, (UINT)( buildingWorlds.size() * building.indices.size() / 3 ), testMs / frameCount );
+    }
+}
+
+// * * * * * ENTITY WORLD * * * * * //
+struct BenchPosition { float x, y, z; };
+struct BenchVelocity { float x, y, z; };
+struct BenchLifetime { float remaining; UINT respawns; };
+
+// Same state as one struct per object, the way per-object state used to be kept
+struct BenchObject
+{
+    BenchPosition position;
+    BenchVelocity velocity;
+    BenchLifetime lifetime;
+    bool hasVelocity, hasLifetime;
+};
+
+static const UINT entityBatchSize = 16384;
+static const float entityTimeStep = 1.0f / 60.0f;
+
+static void moveSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    world.parallelForEachChunk<BenchPosition, const BenchVelocity>( pJobSystem, entityBatchSize,
+        []( UINT count, const EntityID*, BenchPosition* pPositions, const BenchVelocity* pVelocities ) {
+        for ( UINT i = 0; i < count; i++ ) {
+            pPositions[i].x += pVelocities[i].x * entityTimeStep;
+            pPositions[i].y += pVelocities[i].y * entityTimeStep;
+            pPositions[i].z += pVelocities[i].z * entityTimeStep;
+        }
+    } );
+}
+
+// Expired entities are destroyed and replaced through deferred commands
+static void lifetimeSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    world.parallelForEachChunk<BenchLifetime>( pJobSystem, entityBatchSize,
+        [&]( UINT count, const EntityID* pEntities, BenchLifetime* pLifetimes ) {
+        for ( UINT i = 0; i < count; i++ ) {
+            pLifetimes[i].remaining -= entityTimeStep;
+            if ( pLifetimes[i].remaining > 0.0f )
+                continue;
+
+            BenchPosition position = { 0.0f, 0.0f, 0.0f };
+            BenchVelocity velocity = { 1.0f, 0.0f, 0.0f };
+            BenchLifetime lifetime = { 1.0f, pLifetimes[i].respawns + 1 };
+            world.deferDestroyEntity( pEntities[i] );
+            world.deferCreateEntity( position, velocity, lifetime );
+        }
+    } );
+}
+
+static void dragSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    world.parallelForEachChunk<BenchVelocity>( pJobSystem, entityBatchSize,
+        []( UINT count, const EntityID*, BenchVelocity* pVelocities ) {
+        for ( UINT i = 0; i < count; i++ ) {
+            pVelocities[i].x *= 0.999f;
+            pVelocities[i].y *= 0.999f;
+            pVelocities[i].z *= 0.999f;
+        }
+    } );
+}
+
+static void benchEntities( const BenchmarkContext& context )
+{
+    // 2M entities over three archetypes: static (position), moving (+ velocity), short lived (+ lifetime)
+    const UINT entityCount = 1 << 21;
+    const UINT frameCount = 20;
+
+    EntityWorld world;
+    world.reserve( entityCount );
+    std::vector<BenchObject> objects( entityCount );
+
+    Timer createTimer;
+    for ( UINT i = 0; i < entityCount; i++ ) {
+        BenchObject& object = objects[i];
+        object.position.x = randomFloat() * 100.0f;
+        object.position.y = randomFloat() * 100.0f;
+        object.position.z = randomFloat() * 100.0f;
+        object.velocity.x = randomFloat() - 0.5f;
+        object.velocity.y = randomFloat() - 0.5f;
+        object.velocity.z = randomFloat() - 0.5f;
+        object.lifetime.remaining = 0.1f + randomFloat() * 10.0f;
+        object.lifetime.respawns = 0;
+        object.hasVelocity = ( i % 4 ) != 0;
+        object.hasLifetime = ( i % 8 ) == 1;
+
+        if ( object.hasLifetime )
+            world.createEntity( object.position, object.velocity, object.lifetime );
+        else if ( object.hasVelocity )
+            world.createEntity( object.position, object.velocity );
+        else
+            world.createEntity( object.position );
+    }
+    logBenchmark( "%u entities in %u archetypes, created in %.2f ms\n", world.getEntityCount(), world.getArchetypeCount(), createTimer.elapsedMs() );
+
+    // Reference: one loop over the object structs, branching on what each object has
+    Timer referenceTimer;
+    for ( UINT frame = 0; frame < frameCount; frame++ ) {
+        for ( UINT i = 0; i < entityCount; i++ ) {
+            BenchObject& object = objects[i];
+            if ( !object.hasVelocity )
+                continue;
+
+            object.position.x += object.velocity.x * entityTimeStep;
+            object.position.y += object.velocity.y * entityTimeStep;
+            object.position.z += object.velocity.z * entityTimeStep;
+            object.velocity.x *= 0.999f;
+            object.velocity.y *= 0.999f;
+            object.velocity.z *= 0.999f;
+            if ( object.hasLifetime )
+                object.lifetime.remaining -= entityTimeStep;
+        }
+    }
+    logBenchmark( "object structs: %.2f ms per frame\n", referenceTimer.elapsedMs() / frameCount );
+
+    // move and lifetime touch different components and share a stage, drag writes what move reads
+    SystemScheduler scheduler;
+    scheduler.addSystem( "move", componentMask<BenchVelocity>(), componentMask<BenchPosition>(), moveSystem );
+    scheduler.addSystem( "lifetime", 0, componentMask<BenchLifetime>(), lifetimeSystem );
+    scheduler.addSystem( "drag", 0, componentMask<BenchVelocity>(), dragSystem );
+
+    JobSystem* pJobSystems[] = { NULL, context.pJobSystem };
+    for ( UINT j = 0; j < ARRAYSIZE(pJobSystems); j++ ) {
+        if ( j > 0 && !pJobSystems[j] )
+            continue;
+
+        double ms = 0.0, systemMs[3] = { 0.0, 0.0, 0.0 };
+        for ( UINT frame = 0; frame < frameCount; frame++ ) {
+            Timer timer;
+            scheduler.run( world, pJobSystems[j] );
+            ms += timer.elapsedMs();
+
+            for ( UINT s = 0; s < scheduler.getSystemCount(); s++ )
+                systemMs[s] += scheduler.getSystemMs( s );
+        }
+
+        logBenchmark( "systems, %u threads: %.2f ms per frame in %u stages (move %.2f, lifetime %.2f, drag %.2f ms), %u entities alive\n",
+                      pJobSystems[j] ? pJobSystems[j]->getThreadCount() : 1, ms / frameCount, scheduler.getStageCount(),
+                      systemMs[0] / frameCount, systemMs[1] / frameCount, systemMs[2] / frameCount, world.getEntityCount() );
+    }
+
+    // - - - structural changes: a quarter of the moving entities lose their velocity, then get it back - - - //
+    std::vector<EntityID> moving;
+    UINT visited = 0;
+    world.forEach<const BenchVelocity>( [&]( EntityID entity, const BenchVelocity& ) {
+        if ( ( visited++ & 3 ) == 0 )
+            moving.push_back( entity );
+    } );
+
+    Timer removeTimer;
+    for ( size_t i = 0; i < moving.size(); i++ )
+        world.deferRemoveComponent<BenchVelocity>( moving[i] );
+    world.flush();
+    double removeMs = removeTimer.elapsedMs();
+
+    BenchVelocity restVelocity = { 0.0f, 0.0f, 0.0f };
+    Timer addTimer;
+    for ( size_t i = 0; i < moving.size(); i++ )
+        world.deferAddComponent( moving[i], restVelocity );
+    world.flush();
+    double addMs = addTimer.elapsedMs();
+
+    logBenchmark( "%u deferred removes %.2f ms, adds %.2f ms, %u archetypes\n", (UINT)moving.size(), removeMs, addMs, world.getArchetypeCount() );
+}
+
+// * * * * * SKINNING * * * * * //
+static void benchSkinning( const BenchmarkContext& context )
+{
+    // 1M vertex tube on a 64 bone chain, two influences per vertex
+    std::vector<DirectX::VertexPositionNormalTangentColorTextureSkinning> vertices;
+    std::vector<UINT> indices;
+    Skeleton skeleton;
+    createSkinnedTubeMesh( 8192, 127, 8.0f, 0.25f, 64, vertices, indices, skeleton );
+
+    SkinnedMesh skinnedMesh;
+    buildSkinnedMesh( vertices.data(), (UINT)vertices.size(), skinnedMesh );
+    UINT vertexCount = skinnedMesh.vertexCount;
+
+    SkeletonPose pose;
+    initSkeletonPose( skeleton, pose );
+
+    const UINT runs = 10;
+    std::vector<PackedVertex> output( vertexCount ), referenceOutput( vertexCount );
+
+    // Bends the tube a little differently every run
+    auto animate = [&]( UINT run ) {
+        for ( UINT b = 0; b < (UINT)pose.locals.size(); b++ )
+            DirectX::XMStoreFloat4( &pose.locals[b].rotation, DirectX::XMQuaternionRotationRollPitchYaw( 0.05f * sinf( b * 0.3f + run ), 0.02f, 0.04f * cosf( b * 0.2f + run ) ) );
+    };
+
+    Timer paletteTimer;
+    for ( UINT run = 0; run < runs; run++ ) {
+        animate( run );
+        updateSkeletonPose( skeleton, pose );
+    }
+    double paletteMs = paletteTimer.elapsedMs() / runs;
+
+    Timer boundsTimer;
+    VertexQuantization quantization;
+    for ( UINT run = 0; run < runs; run++ )
+        quantization = computeSkinnedQuantization( skinnedMesh, pose.palette.data() );
+    double boundsMs = boundsTimer.elapsedMs() / runs;
+
+    logBenchmark( "%u vertices, %u bones: palette %.3f ms, bounds from bones %.4f ms\n", vertexCount, skinnedMesh.boneCount, paletteMs, boundsMs );
+
+    // Reference: per vertex XMMatrix blend and transform, packed with the import time compression
+    std::vector<DirectX::XMMATRIX> boneMatrices( pose.models.size() );
+    for ( size_t b = 0; b < boneMatrices.size(); b++ )
+        boneMatrices[b] = DirectX::XMLoadFloat4x4( &skeleton.inverseBindPoses[b] ) * DirectX::XMLoadFloat4x4( &pose.models[b] );
+
+    Timer referenceTimer;
+    for ( UINT run = 0; run < runs; run++ ) {
+        for ( UINT v = 0; v < vertexCount; v++ ) {
+            const DirectX::VertexPositionNormalTangentColorTextureSkinning& vertex = vertices[v];
+            DirectX::XMVECTOR position = DirectX::XMVectorZero();
+            DirectX::XMVECTOR normal = DirectX::XMVectorZero();
+            for ( UINT i = 0; i < 4; i++ ) {
+                float weight = (float)( ( vertex.weights >> ( i * 8 ) ) & 0xFF ) / 255.0f;
+                if ( weight == 0.0f )
+                    continue;
+
+                const DirectX::XMMATRIX& bone = boneMatrices[( vertex.indices >> ( i * 8 ) ) & 0xFF];
+                position = DirectX::XMVectorAdd( position, DirectX::XMVectorScale( DirectX::XMVector3TransformCoord( DirectX::XMLoadFloat3( &vertex.position ), bone ), weight ) );
+                normal = DirectX::XMVectorAdd( normal, DirectX::XMVectorScale( DirectX::XMVector3TransformNormal( DirectX::XMLoadFloat3( &vertex.normal ), bone ), weight ) );
+            }
+
+            Vertex skinned;
+            DirectX::XMStoreFloat3( &skinned.pos, position );
+            DirectX::XMStoreFloat3( &skinned.normal, DirectX::XMVector3Normalize( normal ) );
+            skinned.texcoord = vertex.textureCoordinate;
+            skinned.col = DirectX::XMFLOAT4( 1.0f, 1.0f, 1.0f, 1.0f );
+            compressVertices( &skinned, 1, quantization, &referenceOutput[v] );
+        }
+    }
+    double referenceMs = referenceTimer.elapsedMs() / runs;
+    logBenchmark( "XMMatrix per vertex: %.2f ms, %.1f M vertices/s\n", referenceMs, vertexCount / referenceMs / 1000.0 );
+
+    JobSystem* pJobSystems[] = { NULL, context.pJobSystem };
+    for ( UINT j = 0; j < ARRAYSIZE(pJobSystems); j++ ) {
+        if ( j > 0 && !pJobSystems[j] )
+            continue;
+
+        Timer timer;
+        for ( UINT run = 0; run < runs; run++ )
+            skinVertices( skinnedMesh, pose.palette.data(), quantization, output.data(), pJobSystems[j] );
+        double ms = timer.elapsedMs() / runs;
+
+        logBenchmark( "SSE, %u threads: %.2f ms, %.1f M vertices/s\n", pJobSystems[j] ? pJobSystems[j]->getThreadCount() : 1, ms, vertexCount / ms / 1000.0 );
+    }
+
+    // Both paths decoded, the difference is quantization noise
+    float maxError = 0.0f;
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        Vertex skinned = decompressVertex( output[v], quantization );
+        Vertex reference = decompressVertex( referenceOutput[v], quantization );
+        maxError = std::max( maxError, std::max( fabsf( skinned.pos.x - reference.pos.x ), std::max( fabsf( skinned.pos.y - reference.pos.y ), fabsf( skinned.pos.z - reference.pos.z ) ) ) );
+    }
+    logBenchmark( "max position difference vs reference: %g\n", maxError );
+
+    // - - - straight into a dynamic vertex buffer - - - //
+    if ( !context.pDevice )
+        return;
+
+    Mesh mesh;
+    if ( !createSkinnedMesh( context.pDevice, skinnedMesh, indices.data(), (UINT)indices.size(), mesh ) ) {
+        logBenchmark( "createSkinnedMesh failed\n" );
+        return;
+    }
+
+    Timer uploadTimer;
+    for ( UINT run = 0; run < runs; run++ )
+        uploadSkinnedMesh( context.pDeviceContext, skinnedMesh, pose.palette.data(), quantization, mesh, context.pJobSystem );
+    double uploadMs = uploadTimer.elapsedMs() / runs;
+    logBenchmark( "Map + skin + Unmap: %.2f ms, %.1f M vertices/s\n", uploadMs, vertexCount / uploadMs / 1000.0 );
+
+    releaseMesh( mesh );
+}
+
+// * * * * * ANIMATION * * * * * //
+static void benchAnimation( const BenchmarkContext& context )
+{
+    // 64 bone chain, 10 seconds at 30 fps, two clips to blend
+    std::vector<DirectX::VertexPositionNormalTangentColorTextureSkinning> vertices;
+    std::vector<UINT> indices;
+    Skeleton skeleton;
+    createSkinnedTubeMesh( 65, 8, 4.0f, 0.1f, 64, vertices, indices, skeleton );
+
+    AnimationSourceClip sources[2];
+    createChainWaveClip( skeleton, 301, 30.0f, DirectX::XMFLOAT3( 0.0f, 0.0f, 1.0f ), 0.3f, 4.0f, 0.5f, sources[0] );
+    createChainWaveClip( skeleton, 301, 30.0f, DirectX::XMFLOAT3( 1.0f, 0.0f, 0.0f ), 0.1f, 1.0f, 0.0f, sources[1] );
+
+    AnimationClip clips[2];
+    AnimationCompressionSettings settings;
+    Timer compressTimer;
+    for ( UINT c = 0; c < 2; c++ )
+        compressAnimationClip( sources[c], settings, clips[c] );
+    double compressMs = compressTimer.elapsedMs() / 2;
+
+    for ( UINT c = 0; c < 2; c++ ) {
+        size_t sourceBytes = sources[c].frames.size() * sizeof(BonePose);
+        size_t clipBytes = getAnimationClipBytes( clips[c] );
+        AnimationCompressionError error = measureAnimationError( sources[c], clips[c] );
+
+        logBenchmark( "clip %u: %u tracks x %u frames, %u -> %u bytes (%.1fx), keys %u rotation + %u translation, max error %.5f rad %.5f\n",
+                      c, clips[c].trackCount, clips[c].frameCount, (UINT)sourceBytes, (UINT)clipBytes, (double)sourceBytes / clipBytes,
+                      error.rotationKeys, error.translationKeys, error.maxRotationError, error.maxTranslationError );
+    }
+    logBenchmark( "compression %.2f ms per clip\n", compressMs );
+
+    // - - - sampling: compressed SSE vs uncompressed frames with XMQuaternionSlerp - - - //
+    const UINT samples = 20000;
+    UINT trackCount = clips[0].trackCount;
+    std::vector<BonePose> pose( trackCount );
+
+    Timer referenceTimer;
+    for ( UINT s = 0; s < samples; s++ ) {
+        float frame = fmodf( s * 0.37f, (float)( sources[0].frameCount - 1 ) );
+        UINT f = (UINT)frame;
+        float t = frame - f;
+        const BonePose* pA = &sources[0].frames[(size_t)f * trackCount];
+        const BonePose* pB = pA + trackCount;
+        for ( UINT track = 0; track < trackCount; track++ ) {
+            DirectX::XMStoreFloat4( &pose[track].rotation, DirectX::XMQuaternionSlerp( DirectX::XMLoadFloat4( &pA[track].rotation ), DirectX::XMLoadFloat4( &pB[track].rotation ), t ) );
+            DirectX::XMStoreFloat3( &pose[track].position, DirectX::XMVectorLerp( DirectX::XMLoadFloat3( &pA[track].position ), DirectX::XMLoadFloat3( &pB[track].position ), t ) );
+            pose[track].scale = pA[track].scale;
+        }
+    }
+    double referenceMs = referenceTimer.elapsedMs();
+
+    Timer sampleTimer;
+    for ( UINT s = 0; s < samples; s++ )
+        sampleAnimationClip( clips[0], s * 0.37f / clips[0].frameRate, pose.data() );
+    double sampleMs = sampleTimer.elapsedMs();
+
+    logBenchmark( "sampling, uncompressed slerp: %.1f M tracks/s, compressed SSE: %.1f M tracks/s\n",
+                  (double)samples * trackCount / referenceMs / 1000.0, (double)samples * trackCount / sampleMs / 1000.0 );
+
+    // - - - blended instances -> palettes - - - //
+    const UINT instanceCount = 1024;
+    const UINT runs = 10;
+    std::vector<SkeletonPose> poses( instanceCount );
+    std::vector<AnimationInstance> instances( instanceCount );
+    for ( UINT i = 0; i < instanceCount; i++ ) {
+        initSkeletonPose( skeleton, poses[i] );
+        AnimationInstance instance = { &skeleton, &poses[i], &clips[0], i * 0.013f, &clips[1], i * 0.029f, ( i % 8 ) / 7.0f };
+        instances[i] = instance;
+    }
+
+    JobSystem* pJobSystems[] = { NULL, context.pJobSystem };
+    for ( UINT j = 0; j < ARRAYSIZE(pJobSystems); j++ ) {
+        if ( j > 0 && !pJobSystems[j] )
+            continue;
+
+        Timer timer;
+        for ( UINT run = 0; run < runs; run++ )
+            evaluateAnimationInstances( instances.data(), instanceCount, pJobSystems[j] );
+        double ms = timer.elapsedMs() / runs;
+
+        logBenchmark( "%u blended instances, %u threads: %.2f ms, %.0f palettes/s\n", instanceCount, pJobSystems[j] ? pJobSystems[j]->getThreadCount() : 1, ms, instanceCount / ms * 1000.0 );
+    }
+}
+
+// * * * * * CLUSTERED LIGHTING * * * * * //
+// Diffuse term of one clustered light, as in ps_main
+static float shadePointLight( const PointLight& light, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal )
+{
+    float dx = light.position.x - position.x, dy = light.position.y - position.y, dz = light.position.z - position.z;
+    float distanceSq = dx * dx + dy * dy + dz * dz;
+    float falloff = std::max( 1.0f - distanceSq / ( light.radius * light.radius ), 0.0f );
+    if ( falloff <= 0.0f )
+        return 0.0f;
+
+    float cosine = ( dx * normal.x + dy * normal.y + dz * normal.z ) / sqrtf( std::max( distanceSq, 0.0001f ) );
+    return std::max( cosine, 0.0f ) * falloff * falloff * light.intensity;
+}
+
+static void benchLights( const BenchmarkContext& context )
+{
+    // Looking down a 60 x 60 floor at y = 0, lights hover above it
+    Camera camera;
+    camera.position = DirectX::XMFLOAT3( 0.0f, 6.0f, -30.0f );
+    camera.target = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+    camera.up = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    camera.fovY = DirectX::XM_PIDIV4;
+    camera.aspectRatio = 16.0f / 9.0f;
+    camera.nearZ = 0.1f;
+    camera.farZ = 200.0f;
+
+    DirectX::XMMATRIX view = getViewMatrix( camera );
+    DirectX::XMMATRIX inverseViewProjection = DirectX::XMMatrixInverse( nullptr, view * getProjectionMatrix( camera ) );
+    DirectX::XMFLOAT3 cameraPosition = camera.position;
+
+    // - - - floor point seen by every pixel of a 160 x 90 grid - - - //
+    const UINT gridWidth = 160, gridHeight = 90;
+    std::vector<DirectX::XMFLOAT3> positions;
+    std::vector<DirectX::XMFLOAT2> screenPositions;
+    std::vector<float> depths;
+
+    for ( UINT y = 0; y < gridHeight; y++ ) {
+        for ( UINT x = 0; x < gridWidth; x++ ) {
+            float u = ( x + 0.5f ) / gridWidth, v = ( y + 0.5f ) / gridHeight;
+            DirectX::XMVECTOR farPoint = DirectX::XMVector3TransformCoord( DirectX::XMVectorSet( u * 2.0f - 1.0f, 1.0f - v * 2.0f, 1.0f, 1.0f ), inverseViewProjection );
+            DirectX::XMFLOAT3 target;
+            DirectX::XMStoreFloat3( &target, farPoint );
+
+            float t = cameraPosition.y / ( cameraPosition.y - target.y );
+            if ( target.y >= cameraPosition.y || t <= 0.0f )
+                continue;
+
+            DirectX::XMFLOAT3 position( cameraPosition.x + ( target.x - cameraPosition.x ) * t, 0.0f, cameraPosition.z + ( target.z - cameraPosition.z ) * t );
+            if ( fabsf( position.x ) > 30.0f || fabsf( position.z ) > 30.0f )
+                continue;
+
+            DirectX::XMFLOAT3 viewPosition;
+            DirectX::XMStoreFloat3( &viewPosition, DirectX::XMVector3Transform( DirectX::XMLoadFloat3( &position ), view ) );
+
+            positions.push_back( position );
+            screenPositions.push_back( DirectX::XMFLOAT2( u, v ) );
+            depths.push_back( viewPosition.z );
+        }
+    }
+    UINT pixelCount = (UINT)positions.size();
+    DirectX::XMFLOAT3 up( 0.0f, 1.0f, 0.0f );
+
+    const UINT lightCounts[] = { 1000, 10000 };
+    for ( UINT l = 0; l < ARRAYSIZE(lightCounts); l++ ) {
+        UINT lightCount = lightCounts[l];
+        std::vector<PointLight> lights;
+        createRandomLights( lightCount, DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ), DirectX::XMFLOAT3( 30.0f, 1.0f, 30.0f ), 0.5f, 2.0f, 17, lights );
+
+        ClusteredLighting clusters;
+        const UINT runs = 20;
+
+        JobSystem* pJobSystems[] = { NULL, context.pJobSystem };
+        for ( UINT j = 0; j < ARRAYSIZE(pJobSystems); j++ ) {
+            if ( j > 0 && !pJobSystems[j] )
+                continue;
+
+            clusters.assignLights( lights.data(), lightCount, view, camera, pJobSystems[j] );
+            Timer timer;
+            for ( UINT run = 0; run < runs; run++ )
+                clusters.assignLights( lights.data(), lightCount, view, camera, pJobSystems[j] );
+            double ms = timer.elapsedMs() / runs;
+
+            logBenchmark( "%u lights, assignment on %u threads: %.3f ms\n", lightCount, pJobSystems[j] ? pJobSystems[j]->getThreadCount() : 1, ms );
+        }
+
+        const ClusterStats& stats = clusters.getStats();
+        logBenchmark( "%u in frustum depth, %u cluster entries, max %u per cluster\n",
+                      stats.visibleLights, stats.lightIndices, stats.maxClusterLights );
+
+        // - - - shading: every light vs the pixel's cluster list, CPU stand in for ps_main - - - //
+        Timer bruteTimer;
+        double bruteSum = 0.0;
+        for ( UINT p = 0; p < pixelCount; p++ ) {
+            for ( UINT i = 0; i < lightCount; i++ )
+                bruteSum += shadePointLight( lights[i], positions[p], up );
+        }
+        double bruteMs = bruteTimer.elapsedMs();
+
+        Timer clusterTimer;
+        double clusterSum = 0.0;
+        UINT64 evaluated = 0;
+        for ( UINT p = 0; p < pixelCount; p++ ) {
+            UINT cluster = clusters.getClusterIndex( screenPositions[p].x, screenPositions[p].y, depths[p] );
+            const UINT* pIndices = clusters.getLightIndices() + clusters.getClusterOffset( cluster );
+            UINT count = clusters.getClusterLightCount( cluster );
+
+            for ( UINT i = 0; i < count; i++ )
+                clusterSum += shadePointLight( lights[pIndices[i]], positions[p], up );
+            evaluated += count;
+        }
+        double clusterMs = clusterTimer.elapsedMs();
+
+        logBenchmark( "shading %u pixels: all lights %.2f ms, clustered %.3f ms (%.1f lights per pixel), lighting difference %.4f%%\n",
+                      pixelCount, bruteMs, clusterMs, (double)evaluated / pixelCount, bruteSum > 0.0 ? 100.0 * fabs( bruteSum - clusterSum ) / bruteSum : 0.0 );
+
+        // - - - upload to the structured buffers - - - //
+        if ( context.pDevice && clusters.init( context.pDevice, lightCount ) ) {
+            Timer uploadTimer;
+            for ( UINT run = 0; run < runs; run++ )
+                clusters.upload( context.pDeviceContext, lights.data(), context.width, context.height );
+            logBenchmark( "upload: %.3f ms\n", uploadTimer.elapsedMs() / runs );
+            clusters.release();
+        }
+    }
+}
+
+// * * * * * CUBE SHADOW MAP - cached faces vs every face every frame * * * * * //
+// GPU time of the commands between the two timestamps, waits for the result
+struct GpuTimer
+{
+    ID3D11Query* pDisjoint;
+    ID3D11Query* pStart;
+    ID3D11Query* pEnd;
+};
+
+static bool createGpuTimer( ID3D11Device* pDevice, GpuTimer& timer )
+{
+    ZeroMemory( &timer, sizeof(GpuTimer) );
+
+    D3D11_QUERY_DESC queryDesc;
+    ZeroMemory( &queryDesc, sizeof(D3D11_QUERY_DESC) );
+
+                queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+
+    if ( FAILED( pDevice->CreateQuery( &queryDesc, &timer.pDisjoint ) ) )
+        return false;
+
+    queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+    return SUCCEEDED( pDevice->CreateQuery( &queryDesc, &timer.pStart ) ) && SUCCEEDED( pDevice->CreateQuery( &queryDesc, &timer.pEnd ) );
+}
+
+static void releaseGpuTimer( GpuTimer& timer )
+{
+    if ( timer.pDisjoint ) timer.pDisjoint->Release();
+    if ( timer.pStart ) timer.pStart->Release();
+    if ( timer.pEnd ) timer.pEnd->Release();
+    ZeroMemory( &timer, sizeof(GpuTimer) );
+}
+
+static void beginGpuTimer( ID3D11DeviceContext* pDeviceContext, const GpuTimer& timer )
+{
+    pDeviceContext->Begin( timer.pDisjoint );
+    pDeviceContext->End( timer.pStart );
+}
+
+// Milliseconds, < 0 when the GPU clock wasn't stable
+static double endGpuTimer( ID3D11DeviceContext* pDeviceContext, const GpuTimer& timer )
+{
+    pDeviceContext->End( timer.pEnd );
+    pDeviceContext->End( timer.pDisjoint );
+
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    while ( pDeviceContext->GetData( timer.pDisjoint, &disjoint, sizeof(disjoint), 0 ) == S_FALSE )
+        std::this_thread::yield();
+
+    UINT64 start = 0, end = 0;
+    while ( pDeviceContext->GetData( timer.pStart, &start, sizeof(UINT64), 0 ) == S_FALSE )
+        std::this_thread::yield();
+    while ( pDeviceContext->GetData( timer.pEnd, &end, sizeof(UINT64), 0 ) == S_FALSE )
+        std::this_thread::yield();
+
+    if ( disjoint.Disjoint )
+        return -1.0;
+    return (double)( end - start ) * 1000.0 / (double)disjoint.Frequency;
+}
+
+static void benchShadows( const BenchmarkContext& context )
+{
+    // 1000 static spheres around the light, 8 dynamic ones circling on the +x side (they stay in the +x face)
+    MeshData sphere;
+    createSphereMesh( 24, 12, 0.2f, sphere );
+
+    PackedMeshData packedSphere;
+    buildPackedMesh( sphere, packedSphere );
+
+    Mesh sphereMesh;
+    PointShadowMap shadowMap;
+    GpuTimer gpuTimer;
+    if ( !createMesh( context.pDevice, packedSphere, sphereMesh ) || !shadowMap.init( context.pDevice, 1024 ) || !createGpuTimer( context.pDevice, gpuTimer ) ) {
+        logBenchmark( "shadow map setup failed\n" );
+        releaseGpuTimer( gpuTimer );
+        shadowMap.release();
+        releaseMesh( sphereMesh );
+        return;
+    }
+
+    const UINT staticCount = 1000;
+    const UINT dynamicCount = 8;
+    const DirectX::XMFLOAT3& extents = sphereMesh.quantization.positionScale;
+    const DirectX::XMFLOAT3& offset = sphereMesh.quantization.positionOffset;
+
+    std::vector<DirectX::XMFLOAT3> staticPositions;
+    while ( staticPositions.size() < staticCount ) {
+        DirectX::XMFLOAT3 position( randomFloat() * 12.0f - 6.0f, randomFloat() * 12.0f - 6.0f, randomFloat() * 12.0f - 6.0f );
+        if ( position.x * position.x + position.y * position.y + position.z * position.z > 1.0f )
+            staticPositions.push_back( position );
+    }
+
+    for ( UINT i = 0; i < staticCount; i++ ) {
+        UINT caster = shadowMap.addCaster( true );
+        const DirectX::XMFLOAT3& p = staticPositions[i];
+        shadowMap.setCaster( caster, DirectX::XMMatrixTranslation( p.x, p.y, p.z ), sphereMesh.quantization,
+                             DirectX::XMFLOAT3( p.x + offset.x, p.y + offset.y, p.z + offset.z ), extents );
+    }
+    for ( UINT i = 0; i < dynamicCount; i++ )
+        shadowMap.addCaster( false );
+
+    auto drawCaster = [&]( UINT, UINT ) { drawMesh( context.pDeviceContext, sphereMesh ); };
+
+    struct ShadowMode
+    {
+        const char* pName;
+        bool caching;
+        bool lightMoves;
+    };
+    const ShadowMode modes[] = {
+        { "cached, light still", true, false },
+        { "cached, light moving", true, true },
+        { "no caching", false, false },
+    };
+
+    const UINT frameCount = 200;
+    for ( UINT m = 0; m < ARRAYSIZE(modes); m++ ) {
+        const ShadowMode& mode = modes[m];
+        shadowMap.setCaching( mode.caching );
+        shadowMap.invalidate();
+
+        double cpuMs = 0.0, gpuMs = 0.0;
+        UINT64 renderedFaces = 0, casterDraws = 0;
+        UINT gpuFrames = 0;
+
+        // Frame 0 fills the cache and isn't counted
+        for ( UINT frame = 0; frame <= frameCount; frame++ ) {
+            float time = frame * 0.05f;
+            for ( UINT i = 0; i < dynamicCount; i++ ) {
+                float angle = time + i * DirectX::XM_2PI / dynamicCount;
+                DirectX::XMFLOAT3 p( 3.0f, sinf( angle ) * 0.6f, cosf( angle ) * 0.6f );
+                shadowMap.setCaster( staticCount + i, DirectX::XMMatrixTranslation( p.x, p.y, p.z ), sphereMesh.quantization,
+                                     DirectX::XMFLOAT3( p.x + offset.x, p.y + offset.y, p.z + offset.z ), extents );
+            }
+
+            DirectX::XMFLOAT3 light( mode.lightMoves ? sinf( time ) * 0.2f : 0.0f, 0.0f, 0.0f );
+            shadowMap.setLight( light, 0.05f, 20.0f );
+            shadowMap.update();
+
+            beginGpuTimer( context.pDeviceContext, gpuTimer );
+            shadowMap.render( context.pDeviceContext, drawCaster );
+            double frameGpuMs = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+            if ( frame == 0 )
+                continue;
+
+            const ShadowMapStats& stats = shadowMap.getStats();
+            cpuMs += stats.renderMs;
+            renderedFaces += stats.staticFaces + stats.dynamicFaces;
+            casterDraws += stats.casterDraws;
+            if ( frameGpuMs >= 0.0 ) {
+                gpuMs += frameGpuMs;
+                gpuFrames++;
+            }
+        }
+
+        logBenchmark( "%s: %.2f faces, %.0f caster draws, CPU %.3f ms, GPU %.3f ms per frame\n", mode.pName,
+                      (double)renderedFaces / frameCount, (double)casterDraws / frameCount, cpuMs / frameCount, gpuFrames ? gpuMs / gpuFrames : 0.0 );
+    }
+
+    logBenchmark( "%u static + %u dynamic casters, 1024 x 1024 per face, %u triangles per caster\n",
+                  staticCount, dynamicCount, (UINT)sphere.indices.size() / 3 );
+
+    releaseGpuTimer( gpuTimer );
+    shadowMap.release();
+    releaseMesh( sphereMesh );
+}
+
+static void benchLightmap( const BenchmarkContext& context )
+{
+    // 64 boxes on a 16 x 16 floor, a light above and one off to the side
+    LightmapMesh meshes[2];
+    createLightmapTestScene( 64, 16.0f, meshes[0], meshes[1] );
+    UINT triangleCount = (UINT)( meshes[0].mesh.indices.size() + meshes[1].mesh.indices.size() ) / 3;
+
+    LightmapLight lights[] = {
+        { DirectX::XMFLOAT3( 0.0f, 4.0f, 0.0f ), 4.0f, DirectX::XMFLOAT3( 1.0f, 0.95f, 0.9f ), DirectX::XMFLOAT3( 0.2f, 0.1f, 0.1f ), true },
+        { DirectX::XMFLOAT3( 6.0f, 1.5f, -4.0f ), 2.0f, DirectX::XMFLOAT3( 0.6f, 0.7f, 1.0f ), DirectX::XMFLOAT3( 0.2f, 0.1f, 0.1f ), false },
+    };
+
+    LightmapBakeSettings settings;
+    settings.width = 512;
+    settings.height = 512;
+
+    LightmapBakeStats unwrapStats;
+    ZeroMemory( &unwrapStats, sizeof(LightmapBakeStats) );
+    if ( !unwrapLightmap( meshes, ARRAYSIZE(meshes), settings, unwrapStats ) ) {
+        logBenchmark( "unwrap failed\n" );
+        return;
+    }
+    logBenchmark( "%u triangles: %u charts at %.1f texels per unit, unwrap %.2f ms\n", triangleCount, unwrapStats.charts, unwrapStats.texelsPerUnit, unwrapStats.unwrapMs );
+
+    // - - - bake: one thread vs the job system - - - //
+    Lightmap lightmap;
+    double singleTraceMs = 0.0;
+    JobSystem* pJobSystems[] = { NULL, context.pJobSystem };
+    for ( UINT j = 0; j < ARRAYSIZE(pJobSystems); j++ ) {
+        if ( j > 0 && !pJobSystems[j] )
+            continue;
+
+        LightmapBakeStats stats = unwrapStats;
+        Timer timer;
+        if ( !bakeLightmap( meshes, ARRAYSIZE(meshes), lights, ARRAYSIZE(lights), settings, lightmap, stats, pJobSystems[j] ) ) {
+            logBenchmark( "bake failed\n" );
+            return;
+        }
+        double bakeMs = timer.elapsedMs();
+
+        if ( j == 0 )
+            singleTraceMs = stats.traceMs;
+
+        logBenchmark( "%u threads: %u texels, %.1f M rays, %.0f texels/s, %.2f M rays/s (x%.2f), bake %.1f ms (raster %.1f, BVH %.1f, trace %.1f, denoise %.1f)\n",
+                      stats.threads, stats.texels, stats.rays / 1.0e6, stats.texelsPerSecond, stats.raysPerSecond / 1.0e6,
+                      stats.traceMs > 0.0 ? singleTraceMs / stats.traceMs : 0.0, bakeMs, stats.rasterizeMs, stats.buildMs, stats.traceMs, stats.denoiseMs );
+    }
+
+    // - - - cache: file instead of a bake - - - //
+    UINT64 bakeHash = getLightmapBakeHash( meshes, ARRAYSIZE(meshes), lights, ARRAYSIZE(lights), settings );
+    const wchar_t* fileName = L"benchmark.lmap";
+    Timer fileTimer;
+    Lightmap loaded;
+    bool cached = writeLightmapFile( fileName, lightmap, bakeHash ) && readLightmapFile( fileName, bakeHash, loaded );
+    logBenchmark( "lightmap file write + read: %s, %.2f ms\n", cached ? "ok" : "failed", fileTimer.elapsedMs() );
+    DeleteFileW( fileName );
+
+    // - - - runtime: one half4 texture fetch per pixel - - - //
+    ID3D11ShaderResourceView* pSRV = NULL;
+    if ( createLightmapTexture( context.pDevice, lightmap, &pSRV ) ) {
+        logBenchmark( "lightmap texture %u x %u, %u KB\n", lightmap.width, lightmap.height, (UINT)( lightmap.texels.size() * sizeof(DirectX::PackedVector::XMHALF4) / 1024 ) );
+        pSRV->Release();
+    }
+}
+
+// * * * * * DEFERRED vs CLUSTERED FORWARD - lit frame with heavy overdraw * * * * * //
+static bool createBenchmarkCBuffer( ID3D11Device* pDevice, UINT size, ID3D11Buffer** ppBuffer )
+{
+    D3D11_BUFFER_DESC cBufferDesc;
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = size;
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+    return SUCCEEDED( pDevice->CreateBuffer( &cBufferDesc, NULL, ppBuffer ) );
+}
+
+static void benchDeferred( const BenchmarkContext& context )
+{
+    // Layers of overlapping spheres in front of the camera, drawn back to front so every layer
+    // passes the depth test: forward shading lights each layer, deferred only the visible one
+    const UINT layers = 8, columns = 12, rows = 8;
+
+    Camera camera;
+    camera.position = DirectX::XMFLOAT3( 0.0f, 0.0f, -6.0f );
+    camera.target = DirectX::XMFLOAT3( 0.0f, 0.0f, 10.0f );
+    camera.up = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    camera.fovY = DirectX::XM_PIDIV4;
+    camera.aspectRatio = (float)context.width / context.height;
+    camera.nearZ = 0.1f;
+    camera.farZ = 100.0f;
+    DirectX::XMMATRIX viewProjection = getViewMatrix( camera ) * getProjectionMatrix( camera );
+
+    MeshData sphere;
+    createSphereMesh( 32, 16, 0.6f, sphere );
+
+    PackedMeshData packedSphere;
+    buildPackedMesh( sphere, packedSphere );
+
+    // - - - the scene shaders, as main.cpp builds them - - - //
+    SceneShaderDefines defines;
+    ID3DBlob* pVertexShaderBlob = compileShader( L"vertexShader.hlsl", defines.vertexShader, "vs_main", "vs_5_0" );
+    ID3DBlob* pForwardShaderBlob = compileShader( L"pixelShader.hlsl", defines.pixelShader, "ps_main", "ps_5_0" );
+    ID3DBlob* pGBufferShaderBlob = compileShader( L"pixelShader.hlsl", defines.pixelShader, "ps_gbuffer", "ps_5_0" );
+
+    D3D11_INPUT_ELEMENT_DESC inputElementDesc[] = {
+              { "POS", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "NOR", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "COL", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+
+    const UINT maxLights = 4096;
+    Mesh sphereMesh;
+    ID3D11VertexShader* pVertexShader = NULL;
+    ID3D11PixelShader* pForwardShader = NULL, * pGBufferShader = NULL;
+    ID3D11InputLayout* pInputLayout = NULL;
+    ID3D11Buffer* pObjectCBuffer = NULL, * pLightCBuffer = NULL, * pMaterialCBuffer = NULL;
+    ClusteredLighting clusteredLighting;
+    DeferredShading deferredShading;
+    GpuTimer gpuTimer;
+    ZeroMemory( &gpuTimer, sizeof(GpuTimer) );
+
+    bool ready = pVertexShaderBlob && pForwardShaderBlob && pGBufferShaderBlob &&
+                 SUCCEEDED( context.pDevice->CreateVertexShader( pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), NULL, &pVertexShader ) ) &&
+                 SUCCEEDED( context.pDevice->CreatePixelShader( pForwardShaderBlob->GetBufferPointer(), pForwardShaderBlob->GetBufferSize(), NULL, &pForwardShader ) ) &&
+                 SUCCEEDED( context.pDevice->CreatePixelShader( pGBufferShaderBlob->GetBufferPointer(), pGBufferShaderBlob->GetBufferSize(), NULL, &pGBufferShader ) ) &&
+                 SUCCEEDED( context.pDevice->CreateInputLayout( inputElementDesc, ARRAYSIZE(inputElementDesc), pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), &pInputLayout ) ) &&
+                 createBenchmarkCBuffer( context.pDevice, sizeof(cBuffer), &pObjectCBuffer ) &&
+                 createBenchmarkCBuffer( context.pDevice, sizeof(cBufferLight), &pLightCBuffer ) &&
+                 createBenchmarkCBuffer( context.pDevice, sizeof(cBufferMaterial), &pMaterialCBuffer ) &&
+                 createMesh( context.pDevice, packedSphere, sphereMesh ) &&
+                 clusteredLighting.init( context.pDevice, maxLights ) &&
+                 deferredShading.init( context.pDevice, context.width, context.height, maxLights ) &&
+                 createGpuTimer( context.pDevice, gpuTimer );
+
+    if ( pVertexShaderBlob ) pVertexShaderBlob->Release();
+    if ( pForwardShaderBlob ) pForwardShaderBlob->Release();
+    if ( pGBufferShaderBlob ) pGBufferShaderBlob->Release();
+
+    TextureID texture = INVALID_TEXTURE_ID;
+    if ( ready ) {
+        // Ambient only, no dynamic light: both paths differ in the point lights alone
+        cBufferLight light;
+        light.ambientLightColor() = DirectX::XMFLOAT3( 1.0f, 1.0f, 1.0f );
+        light.ambientLightStrength() = 0.2f;
+        light.dynamicLightColor() = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+        light.dynamicLightStrength() = 0.0f;
+        light.dynamicLightPosition() = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+        light.dynamicAttenuation() = DirectX::XMFLOAT3( 1.0f, 0.0f, 0.0f );
+        context.pDeviceContext->UpdateSubresource( pLightCBuffer, 0, NULL, &light, 0, 0 );
+
+        texture = context.pTextureArrays->loadTexture( L"Textures/gorilla.jpg" );
+    }
+
+    auto drawScene = [&]( ID3D11PixelShader* pPixelShader ) {
+        context.pDeviceContext->IASetInputLayout( pInputLayout );
+        context.pDeviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+        context.pDeviceContext->RSSetState( NULL );
+        context.pDeviceContext->OMSetDepthStencilState( NULL, 0 );
+        context.pDeviceContext->VSSetShader( pVertexShader, nullptr, 0 );
+        context.pDeviceContext->PSSetShader( pPixelShader, nullptr, 0 );
+        context.pDeviceContext->PSSetConstantBuffers( 0, 1, &pLightCBuffer );
+
+        context.pTextureArrays->beginFrame();
+        TextureSlot slot;
+        if ( context.pTextureArrays->useTexture( texture, slot ) ) {
+            cBufferMaterial material;
+            material.textureSlice() = slot.slice;
+            context.pDeviceContext->UpdateSubresource( pMaterialCBuffer, 0, NULL, &material, 0, 0 );
+            context.pDeviceContext->PSSetConstantBuffers( 1, 1, &pMaterialCBuffer );
+
+            ID3D11ShaderResourceView* pTextureArraySRV = context.pTextureArrays->getSRV( slot.arrayIndex );
+            context.pDeviceContext->PSSetShaderResources( 0, 1, &pTextureArraySRV );
+        }
+
+        for ( UINT layer = 0; layer < layers; layer++ ) {
+            float z = 16.0f - layer * 2.0f;
+            for ( UINT i = 0; i < columns * rows; i++ ) {
+                DirectX::XMMATRIX world = DirectX::XMMatrixTranslation( ( i % columns ) - ( columns - 1 ) * 0.5f, ( i / columns ) - ( rows - 1 ) * 0.5f, z );
+
+                cBuffer object;
+                object.worldViewProjection() = DirectX::XMMatrixTranspose( world * viewProjection );
+                object.world() = DirectX::XMMatrixTranspose( world );
+                object.positionScale() = sphereMesh.quantization.positionScale;
+                object.positionOffset() = sphereMesh.quantization.positionOffset;
+                context.pDeviceContext->UpdateSubresource( pObjectCBuffer, 0, NULL, &object, 0, 0 );
+                context.pDeviceContext->VSSetConstantBuffers( 0, 1, &pObjectCBuffer );
+
+                drawMesh( context.pDeviceContext, sphereMesh );
+            }
+        }
+    };
+
+    const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const UINT lightCounts[] = { 64, 256, 1024, 4096 };
+    const UINT frameCount = 50;
+    for ( UINT c = 0; ready && c < ARRAYSIZE(lightCounts); c++ ) {
+        std::vector<PointLight> lights;
+        createRandomLights( lightCounts[c], DirectX::XMFLOAT3( 0.0f, 0.0f, 9.0f ), DirectX::XMFLOAT3( 7.0f, 4.5f, 8.0f ), 0.8f, 1.6f, 7, lights );
+
+        double forwardGpuMs = 0.0, forwardCpuMs = 0.0, deferredGpuMs = 0.0, deferredCpuMs = 0.0;
+        UINT forwardFrames = 0, deferredFrames = 0;
+        UINT64 clusterIndices = 0, rectPixels = 0;
+
+        // Frame 0 of each path warms up and isn't counted
+        for ( UINT frame = 0; frame <= frameCount; frame++ ) {
+            // - - - forward: cluster light lists, every shaded pixel loops over its cluster - - - //
+            beginGpuTimer( context.pDeviceContext, gpuTimer );
+            context.pDeviceContext->ClearRenderTargetView( context.pRenderTarget, clearColor );
+            context.pDeviceContext->ClearDepthStencilView( context.pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0 );
+            context.pDeviceContext->OMSetRenderTargets( 1, &context.pRenderTarget, context.pDepthStencilView );
+
+            clusteredLighting.assignLights( lights.data(), (UINT)lights.size(), getViewMatrix( camera ), camera, context.pJobSystem );
+            if ( clusteredLighting.upload( context.pDeviceContext, lights.data(), context.width, context.height ) )
+                clusteredLighting.bind( context.pDeviceContext );
+            drawScene( pForwardShader );
+            double frameGpuMs = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+            if ( frame > 0 && frameGpuMs >= 0.0 ) {
+                forwardGpuMs += frameGpuMs;
+                forwardFrames++;
+            }
+            if ( frame > 0 ) {
+                forwardCpuMs += clusteredLighting.getStats().assignMs;
+                clusterIndices += clusteredLighting.getStats().lightIndices;
+            }
+
+            // - - - deferred: G-buffer, then one rect per light - - - //
+            beginGpuTimer( context.pDeviceContext, gpuTimer );
+            deferredShading.beginGeometry( context.pDeviceContext, context.pRenderTarget, clearColor );
+            drawScene( pGBufferShader );
+            deferredShading.accumulateLights( context.pDeviceContext, context.pRenderTarget, lights.data(), (UINT)lights.size(), camera );
+            frameGpuMs = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+            if ( frame > 0 && frameGpuMs >= 0.0 ) {
+                deferredGpuMs += frameGpuMs;
+                deferredFrames++;
+            }
+            if ( frame > 0 ) {
+                deferredCpuMs += deferredShading.getStats().setupMs;
+                rectPixels += deferredShading.getStats().rectPixels;
+            }
+        }
+
+        logBenchmark( "%u lights: forward GPU %.3f ms (CPU assign %.3f ms, %.0f cluster entries), deferred GPU %.3f ms (CPU %.3f ms, %u lights drawn, %.2f screens of rects)\n",
+                      lightCounts[c], forwardFrames ? forwardGpuMs / forwardFrames : 0.0, forwardCpuMs / frameCount, (double)clusterIndices / frameCount,
+                      deferredFrames ? deferredGpuMs / deferredFrames : 0.0, deferredCpuMs / frameCount, deferredShading.getStats().drawnLights,
+                      (double)rectPixels / frameCount / ( context.width * context.height ) );
+    }
+
+    if ( ready )
+        logBenchmark( "%u layers of %u x %u spheres back to front, %u x %u\n", layers, columns, rows, context.width, context.height );
+    else
+        logBenchmark( "deferred setup failed\n" );
+
+    if ( texture != INVALID_TEXTURE_ID )
+        context.pTextureArrays->unloadTexture( texture );
+    releaseGpuTimer( gpuTimer );
+    deferredShading.release();
+    clusteredLighting.release();
+    releaseMesh( sphereMesh );
+    if ( pMaterialCBuffer ) pMaterialCBuffer->Release();
+    if ( pLightCBuffer ) pLightCBuffer->Release();
+    if ( pObjectCBuffer ) pObjectCBuffer->Release();
+    if ( pInputLayout ) pInputLayout->Release();
+    if ( pGBufferShader ) pGBufferShader->Release();
+    if ( pForwardShader ) pForwardShader->Release();
+    if ( pVertexShader ) pVertexShader->Release();
+}
+
+// * * * * * VISIBILITY BUFFER vs CLUSTERED FORWARD - pixel shader work under overdraw * * * * * //
+// Pixel shader invocations between begin and end, waits for the result
+static UINT64 endPipelineStatistics( ID3D11DeviceContext* pDeviceContext, ID3D11Query* pQuery )
+{
+    pDeviceContext->End( pQuery );
+
+    D3D11_QUERY_DATA_PIPELINE_STATISTICS statistics;
+    while ( pDeviceContext->GetData( pQuery, &statistics, sizeof(statistics), 0 ) == S_FALSE )
+        std::this_thread::yield();
+    return statistics.PSInvocations;
+}
+
+static void benchVisibility( const BenchmarkContext& context )
+{
+    // benchDeferred's scene: layers of overlapping spheres drawn back to front, so forward shading
+    // runs for every layer while the visibility buffer shades each covered pixel once
+    const UINT layers = 8, columns = 12, rows = 8;
+    const UINT drawCount = layers * columns * rows;
+
+    Camera camera;
+    camera.position = DirectX::XMFLOAT3( 0.0f, 0.0f, -6.0f );
+    camera.target = DirectX::XMFLOAT3( 0.0f, 0.0f, 10.0f );
+    camera.up = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    camera.fovY = DirectX::XM_PIDIV4;
+    camera.aspectRatio = (float)context.width / context.height;
+    camera.nearZ = 0.1f;
+    camera.farZ = 100.0f;
+    DirectX::XMMATRIX viewProjection = getViewMatrix( camera ) * getProjectionMatrix( camera );
+
+    MeshData sphere;
+    createSphereMesh( 32, 16, 0.6f, sphere );
+
+    PackedMeshData packedSphere;
+    buildPackedMesh( sphere, packedSphere );
+
+    std::vector<DirectX::XMMATRIX> worlds( drawCount );
+    for ( UINT layer = 0; layer < layers; layer++ ) {
+        float z = 16.0f - layer * 2.0f;
+        for ( UINT i = 0; i < columns * rows; i++ )
+            worlds[layer * columns * rows + i] = DirectX::XMMatrixTranslation( ( i % columns ) - ( columns - 1 ) * 0.5f, ( i / columns ) - ( rows - 1 ) * 0.5f, z );
+    }
+
+    // - - - CPU reference at quarter resolution: shading work of both paths - - - //
+    std::vector<DirectX::XMFLOAT3> positions( sphere.vertices.size() );
+    for ( size_t i = 0; i < sphere.vertices.size(); i++ )
+        positions[i] = sphere.vertices[i].pos;
+
+    SoftwareVisibilityBuffer softwareBuffer;
+    softwareBuffer.resize( context.width / 4, context.height / 4 );
+    softwareBuffer.beginFrame( viewProjection );
+    for ( UINT d = 0; d < drawCount; d++ )
+        softwareBuffer.drawTriangles( positions.data(), sphere.indices.data(), (UINT)sphere.indices.size(), worlds[d], d + 1 );
+    softwareBuffer.endFrame();
+
+    const SoftwareVisibilityStats& softwareStats = softwareBuffer.getStats();
+    logBenchmark( "CPU %u x %u: %llu triangles, %llu fragments, forward shades %llu, visibility buffer %u (%.1f%% of the forward work), raster %.2f ms\n",
+                  context.width / 4, context.height / 4, softwareStats.triangles, softwareStats.fragments, softwareStats.depthPassed, softwareStats.visiblePixels,
+                  softwareStats.depthPassed ? 100.0 * softwareStats.visiblePixels / softwareStats.depthPassed : 0.0, softwareStats.rasterMs );
+
+    if ( !context.pDevice )
+        return;
+
+    // - - - the forward scene shaders, as main.cpp builds them - - - //
+    SceneShaderDefines defines;
+    ID3DBlob* pVertexShaderBlob = compileShader( L"vertexShader.hlsl", defines.vertexShader, "vs_main", "vs_5_0" );
+    ID3DBlob* pForwardShaderBlob = compileShader( L"pixelShader.hlsl", defines.pixelShader, "ps_main", "ps_5_0" );
+
+    D3D11_INPUT_ELEMENT_DESC inputElementDesc[] = {
+              { "POS", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "NOR", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "COL", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+
+    D3D11_QUERY_DESC queryDesc;
+    ZeroMemory( &queryDesc, sizeof(D3D11_QUERY_DESC) );
+
+                queryDesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+
+    const UINT lightCount = 256;
+    Mesh sphereMesh;
+    ID3D11VertexShader* pVertexShader = NULL;
+    ID3D11PixelShader* pForwardShader = NULL;
+    ID3D11InputLayout* pInputLayout = NULL;
+    ID3D11Buffer* pObjectCBuffer = NULL, * pLightCBuffer = NULL, * pMaterialCBuffer = NULL;
+    ID3D11Query* pStatisticsQuery = NULL;
+    ClusteredLighting clusteredLighting;
+    VisibilityBuffer visibilityBuffer;
+    GpuTimer gpuTimer;
+    ZeroMemory( &gpuTimer, sizeof(GpuTimer) );
+
+    UINT sphereGeometry = visibilityBuffer.addGeometry( packedSphere );
+
+    bool ready = pVertexShaderBlob && pForwardShaderBlob &&
+                 SUCCEEDED( context.pDevice->CreateVertexShader( pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), NULL, &pVertexShader ) ) &&
+                 SUCCEEDED( context.pDevice->CreatePixelShader( pForwardShaderBlob->GetBufferPointer(), pForwardShaderBlob->GetBufferSize(), NULL, &pForwardShader ) ) &&
+                 SUCCEEDED( context.pDevice->CreateInputLayout( inputElementDesc, ARRAYSIZE(inputElementDesc), pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), &pInputLayout ) ) &&
+                 SUCCEEDED( context.pDevice->CreateQuery( &queryDesc, &pStatisticsQuery ) ) &&
+                 createBenchmarkCBuffer( context.pDevice, sizeof(cBuffer), &pObjectCBuffer ) &&
+                 createBenchmarkCBuffer( context.pDevice, sizeof(cBufferLight), &pLightCBuffer ) &&
+                 createBenchmarkCBuffer( context.pDevice, sizeof(cBufferMaterial), &pMaterialCBuffer ) &&
+                 createMesh( context.pDevice, packedSphere, sphereMesh ) &&
+                 clusteredLighting.init( context.pDevice, lightCount ) &&
+                 visibilityBuffer.init( context.pDevice, context.width, context.height, drawCount ) &&
+                 visibilityBuffer.createGeometryBuffers( context.pDevice ) &&
+                 createGpuTimer( context.pDevice, gpuTimer );
+
+    if ( pVertexShaderBlob ) pVertexShaderBlob->Release();
+    if ( pForwardShaderBlob ) pForwardShaderBlob->Release();
+
+    TextureID texture = INVALID_TEXTURE_ID;
+    std::vector<PointLight> lights;
+    if ( ready ) {
+        // Ambient + point lights, the same lighting in both paths
+        cBufferLight light;
+        light.ambientLightColor() = DirectX::XMFLOAT3( 1.0f, 1.0f, 1.0f );
+        light.ambientLightStrength() = 0.2f;
+        light.dynamicLightColor() = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+        light.dynamicLightStrength() = 0.0f;
+        light.dynamicLightPosition() = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+        light.dynamicAttenuation() = DirectX::XMFLOAT3( 1.0f, 0.0f, 0.0f );
+        context.pDeviceContext->UpdateSubresource( pLightCBuffer, 0, NULL, &light, 0, 0 );
+
+        texture = context.pTextureArrays->loadTexture( L"Textures/gorilla.jpg" );
+        createRandomLights( lightCount, DirectX::XMFLOAT3( 0.0f, 0.0f, 9.0f ), DirectX::XMFLOAT3( 7.0f, 4.5f, 8.0f ), 0.8f, 1.6f, 7, lights );
+    }
+
+    // Scene constants, texture and light lists of ps_main, the visibility buffer's shading pass reads the same
+    UINT textureSlice = 0;
+    auto bindSceneShading = [&]() {
+        context.pDeviceContext->PSSetConstantBuffers( 0, 1, &pLightCBuffer );
+
+        context.pTextureArrays->beginFrame();
+        TextureSlot slot;
+        if ( context.pTextureArrays->useTexture( texture, slot ) ) {
+            cBufferMaterial material;
+            material.textureSlice() = slot.slice;
+            context.pDeviceContext->UpdateSubresource( pMaterialCBuffer, 0, NULL, &material, 0, 0 );
+            context.pDeviceContext->PSSetConstantBuffers( 1, 1, &pMaterialCBuffer );
+
+            ID3D11ShaderResourceView* pTextureArraySRV = context.pTextureArrays->getSRV( slot.arrayIndex );
+            context.pDeviceContext->PSSetShaderResources( 0, 1, &pTextureArraySRV );
+            textureSlice = slot.slice;
+        }
+
+        clusteredLighting.assignLights( lights.data(), (UINT)lights.size(), getViewMatrix( camera ), camera, context.pJobSystem );
+        if ( clusteredLighting.upload( context.pDeviceContext, lights.data(), context.width, context.height ) )
+            clusteredLighting.bind( context.pDeviceContext );
+    };
+
+    const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const UINT frameCount = 50;
+    double forwardGpuMs = 0.0, visibilityGpuMs = 0.0;
+    UINT forwardFrames = 0, visibilityFrames = 0;
+    UINT64 forwardInvocations = 0, idInvocations = 0, shadeInvocations = 0;
+
+    // Frame 0 of each path warms up and isn't counted
+    for ( UINT frame = 0; ready && frame <= frameCount; frame++ ) {
+        // - - - forward: ps_main for every fragment that passes the depth test - - - //
+        beginGpuTimer( context.pDeviceContext, gpuTimer );
+        context.pDeviceContext->Begin( pStatisticsQuery );
+        context.pDeviceContext->ClearRenderTargetView( context.pRenderTarget, clearColor );
+        context.pDeviceContext->ClearDepthStencilView( context.pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0 );
+        context.pDeviceContext->OMSetRenderTargets( 1, &context.pRenderTarget, context.pDepthStencilView );
+        context.pDeviceContext->IASetInputLayout( pInputLayout );
+        context.pDeviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+        context.pDeviceContext->RSSetState( NULL );
+        context.pDeviceContext->OMSetDepthStencilState( NULL, 0 );
+        context.pDeviceContext->VSSetShader( pVertexShader, nullptr, 0 );
+        context.pDeviceContext->PSSetShader( pForwardShader, nullptr, 0 );
+        bindSceneShading();
+
+        for ( UINT d = 0; d < drawCount; d++ ) {
+            cBuffer object;
+            object.worldViewProjection() = DirectX::XMMatrixTranspose( worlds[d] * viewProjection );
+            object.world() = DirectX::XMMatrixTranspose( worlds[d] );
+            object.positionScale() = sphereMesh.quantization.positionScale;
+            object.positionOffset() = sphereMesh.quantization.positionOffset;
+            context.pDeviceContext->UpdateSubresource( pObjectCBuffer, 0, NULL, &object, 0, 0 );
+            context.pDeviceContext->VSSetConstantBuffers( 0, 1, &pObjectCBuffer );
+
+            drawMesh( context.pDeviceContext, sphereMesh );
+        }
+        UINT64 invocations = endPipelineStatistics( context.pDeviceContext, pStatisticsQuery );
+        double frameGpuMs = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+        if ( frame > 0 && frameGpuMs >= 0.0 ) {
+            forwardGpuMs += frameGpuMs;
+            forwardFrames++;
+        }
+        if ( frame > 0 )
+            forwardInvocations += invocations;
+
+        // - - - visibility buffer: IDs for every fragment, lighting once per covered pixel - - - //
+        beginGpuTimer( context.pDeviceContext, gpuTimer );
+        context.pDeviceContext->Begin( pStatisticsQuery );
+        context.pDeviceContext->ClearRenderTargetView( context.pRenderTarget, clearColor );
+        context.pDeviceContext->ClearDepthStencilView( context.pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0 );
+        context.pDeviceContext->RSSetState( NULL );
+        context.pDeviceContext->OMSetDepthStencilState( NULL, 0 );
+
+        visibilityBuffer.beginFrame( context.pDeviceContext, context.pDepthStencilView, camera );
+        for ( UINT d = 0; d < drawCount; d++ )
+            visibilityBuffer.drawGeometry( context.pDeviceContext, sphereGeometry, worlds[d], textureSlice );
+        invocations = endPipelineStatistics( context.pDeviceContext, pStatisticsQuery );
+        if ( frame > 0 )
+            idInvocations += invocations;
+
+        context.pDeviceContext->Begin( pStatisticsQuery );
+        bindSceneShading();
+        visibilityBuffer.shade( context.pDeviceContext, context.pRenderTarget );
+        invocations = endPipelineStatistics( context.pDeviceContext, pStatisticsQuery );
+        frameGpuMs = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+        if ( frame > 0 && frameGpuMs >= 0.0 ) {
+            visibilityGpuMs += frameGpuMs;
+            visibilityFrames++;
+        }
+        if ( frame > 0 )
+            shadeInvocations += invocations;
+    }
+
+    if ( ready ) {
+        logBenchmark( "%u lights: forward GPU %.3f ms, %.0f lit pixel shader invocations; visibility buffer GPU %.3f ms, %.0f ID + %.0f lit invocations\n",
+                      lightCount, forwardFrames ? forwardGpuMs / forwardFrames : 0.0, (double)forwardInvocations / frameCount,
+                      visibilityFrames ? visibilityGpuMs / visibilityFrames : 0.0, (double)idInvocations / frameCount, (double)shadeInvocations / frameCount );
+        logBenchmark( "%u layers of %u x %u spheres back to front, %u triangles, %u x %u\n",
+                      layers, columns, rows, visibilityBuffer.getStats().triangles, context.width, context.height );
+    }
+    else
+        logBenchmark( "visibility buffer setup failed\n" );
+
+    if ( texture != INVALID_TEXTURE_ID )
+        context.pTextureArrays->unloadTexture( texture );
+    releaseGpuTimer( gpuTimer );
+    visibilityBuffer.release();
+    clusteredLighting.release();
+    releaseMesh( sphereMesh );
+    if ( pStatisticsQuery ) pStatisticsQuery->Release();
+    if ( pMaterialCBuffer ) pMaterialCBuffer->Release();
+    if ( pLightCBuffer ) pLightCBuffer->Release();
+    if ( pObjectCBuffer ) pObjectCBuffer->Release();
+    if ( pInputLayout ) pInputLayout->Release();
+    if ( pForwardShader ) pForwardShader->Release();
+    if ( pVertexShader ) pVertexShader->Release();
+}
+
+// * * * * * VARIABLE RATE SHADING - CPU visibility buffer, quality vs time per rate * * * * * //
+static void benchShadingRate( const BenchmarkContext& context )
+{
+    // A lit wall with a checker pattern behind a grid of spheres: large smooth areas, texture
+    // edges and silhouettes. Shaded from the CPU visibility buffer (no VRS in D3D11)
+    const UINT width = std::max( context.width / 2, 64u ), height = std::max( context.height / 2, 64u );
+    const UINT columns = 8, rows = 5;
+
+    Camera camera;
+    camera.position = DirectX::XMFLOAT3( 0.0f, 0.0f, -6.0f );
+    camera.target = DirectX::XMFLOAT3( 0.0f, 0.0f, 10.0f );
+    camera.up = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    camera.fovY = DirectX::XM_PIDIV4;
+    camera.aspectRatio = (float)width / height;
+    camera.nearZ = 0.1f;
+    camera.farZ = 100.0f;
+
+    MeshData sphere;
+    createSphereMesh( 32, 16, 0.6f, sphere );
+
+    std::vector<DirectX::XMFLOAT3> spherePositions( sphere.vertices.size() );
+    for ( size_t i = 0; i < sphere.vertices.size(); i++ )
+        spherePositions[i] = sphere.vertices[i].pos;
+
+    // Wall facing the camera, clockwise on screen
+    const DirectX::XMFLOAT3 wallPositions[] = {
+        DirectX::XMFLOAT3( -12.0f, 7.0f, 12.0f ), DirectX::XMFLOAT3( 12.0f, 7.0f, 12.0f ),
+        DirectX::XMFLOAT3( 12.0f, -7.0f, 12.0f ), DirectX::XMFLOAT3( -12.0f, -7.0f, 12.0f ),
+    };
+    const UINT wallIndices[] = { 0, 1, 2, 0, 2, 3 };
+
+    // drawId 1 = wall, 2.. = spheres
+    std::vector<DirectX::XMFLOAT4X4> sphereWorlds( columns * rows );
+    SoftwareVisibilityBuffer visibility;
+    visibility.resize( width, height );
+    visibility.beginFrame( getViewMatrix( camera ) * getProjectionMatrix( camera ) );
+    visibility.drawTriangles( wallPositions, wallIndices, ARRAYSIZE(wallIndices), DirectX::XMMatrixIdentity(), 1 );
+    for ( UINT i = 0; i < columns * rows; i++ ) {
+        DirectX::XMMATRIX world = DirectX::XMMatrixTranslation( ( ( i % columns ) - ( columns - 1 ) * 0.5f ) * 1.6f, ( ( i / columns ) - ( rows - 1 ) * 0.5f ) * 1.6f, 8.0f );
+        DirectX::XMStoreFloat4x4( &sphereWorlds[i], world );
+        visibility.drawTriangles( spherePositions.data(), sphere.indices.data(), (UINT)sphere.indices.size(), world, i + 2 );
+    }
+    visibility.endFrame();
+
+    std::vector<PointLight> lights;
+    createRandomLights( 32, DirectX::XMFLOAT3( 0.0f, 0.0f, 9.0f ), DirectX::XMFLOAT3( 8.0f, 5.0f, 3.0f ), 2.0f, 4.0f, 3, lights );
+
+    // Stand in for ps_main: checker albedo * ( ambient + point lights ), from the triangle under x, y
+    auto shade = [&]( UINT drawId, UINT triangle, float x, float y ) {
+        DirectX::XMFLOAT3 p[3], normal( 0.0f, 0.0f, -1.0f );
+        DirectX::XMFLOAT3 vertexNormals[3];
+        if ( drawId == 1 ) {
+            for ( UINT v = 0; v < 3; v++ ) {
+                p[v] = wallPositions[wallIndices[triangle * 3 + v]];
+                vertexNormals[v] = normal;
+            }
+        }
+        else {
+            DirectX::XMMATRIX world = DirectX::XMLoadFloat4x4( &sphereWorlds[drawId - 2] );
+            for ( UINT v = 0; v < 3; v++ ) {
+                const Vertex& vertex = sphere.vertices[sphere.indices[triangle * 3 + v]];
+                DirectX::XMStoreFloat3( &p[v], DirectX::XMVector3Transform( DirectX::XMLoadFloat3( &vertex.pos ), world ) );
+                vertexNormals[v] = vertex.normal;
+            }
+        }
+
+        DirectX::XMFLOAT3 b = visibility.getBarycentrics( x, y, p[0], p[1], p[2] );
+        DirectX::XMFLOAT3 position( b.x * p[0].x + b.y * p[1].x + b.z * p[2].x, b.x * p[0].y + b.y * p[1].y + b.z * p[2].y, b.x * p[0].z + b.y * p[1].z + b.z * p[2].z );
+        DirectX::XMStoreFloat3( &normal, DirectX::XMVector3Normalize( DirectX::XMVectorSet(
+            b.x * vertexNormals[0].x + b.y * vertexNormals[1].x + b.z * vertexNormals[2].x,
+            b.x * vertexNormals[0].y + b.y * vertexNormals[1].y + b.z * vertexNormals[2].y,
+            b.x * vertexNormals[0].z + b.y * vertexNormals[1].z + b.z * vertexNormals[2].z, 0.0f ) ) );
+
+        float albedo = ( ( (int)floorf( position.x ) + (int)floorf( position.y ) ) & 1 ) ? 0.8f : 0.5f;
+        DirectX::XMFLOAT3 light( 0.2f, 0.2f, 0.2f );
+        for ( size_t i = 0; i < lights.size(); i++ ) {
+            float intensity = shadePointLight( lights[i], position, normal );
+            light.x += lights[i].color.x * intensity;
+            light.y += lights[i].color.y * intensity;
+            light.z += lights[i].color.z * intensity;
+        }
+        return DirectX::XMFLOAT3( albedo * light.x, albedo * light.y, albedo * light.z );
+    };
+
+    auto getLuminance = []( const DirectX::XMFLOAT3& color ) {
+        return std::min( 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z, 1.0f );
+    };
+
+    // - - - full rate reference, its luminance stands in for the last frame - - - //
+    const DirectX::XMFLOAT3 background( 0.0f, 0.0f, 0.0f );
+    std::vector<DirectX::XMFLOAT3> reference( width * height, background ), colors( width * height, background );
+    std::vector<float> luminance( width * height );
+    VariableRateStats stats;
+
+    ShadingRateImage rates;
+    rates.resize( width, height, 16 );
+    rates.fill( SHADING_RATE_1X1 );
+    shadeVariableRate( visibility, rates, shade, reference.data(), stats );
+    for ( UINT i = 0; i < width * height; i++ )
+        luminance[i] = getLuminance( reference[i] );
+
+    struct RateMode
+    {
+        const char* pName;
+        int fill;                       // ShadingRate, 0 = contrast, -1 = foveated image
+    };
+    const RateMode modes[] = {
+        { "1x1", SHADING_RATE_1X1 },
+        { "2x2", SHADING_RATE_2X2 },
+        { "4x4", SHADING_RATE_4X4 },
+        { "contrast", 0 },
+        { "foveated image", -1 },
+    };
+
+    const ShadingRateSettings settings = { 0.08f, 0.02f };
+    const UINT runs = 5;
+    for ( UINT m = 0; m < ARRAYSIZE(modes); m++ ) {
+        const RateMode& mode = modes[m];
+
+        Timer selectTimer;
+        if ( mode.fill > 0 )
+            rates.fill( (ShadingRate)mode.fill );
+        else if ( mode.fill == 0 )
+            rates.selectFromContrast( luminance.data(), settings );
+        else {
+            // Supplied rate image: full rate in the middle, coarser towards the border
+            for ( UINT tileY = 0; tileY < rates.getTilesY(); tileY++ ) {
+                for ( UINT tileX = 0; tileX < rates.getTilesX(); tileX++ ) {
+                    float dx = ( ( tileX + 0.5f ) * rates.getTileSize() / width - 0.5f ) * 2.0f;
+                    float dy = ( ( tileY + 0.5f ) * rates.getTileSize() / height - 0.5f ) * 2.0f;
+                    float distance = sqrtf( dx * dx + dy * dy );
+                    rates.setTileRate( tileX, tileY, distance < 0.4f ? SHADING_RATE_1X1 : ( distance < 0.8f ? SHADING_RATE_2X2 : SHADING_RATE_4X4 ) );
+                }
+            }
+        }
+        double selectMs = selectTimer.elapsedMs();
+
+        double shadeMs = 0.0;
+        for ( UINT run = 0; run < runs; run++ ) {
+            shadeVariableRate( visibility, rates, shade, colors.data(), stats );
+            shadeMs += stats.shadeMs;
+        }
+
+        // Quality against the full rate image, colors clamped like the back buffer
+        double squaredError = 0.0;
+        float maxError = 0.0f;
+        for ( UINT i = 0; i < width * height; i++ ) {
+            const float* pA = &colors[i].x;
+            const float* pB = &reference[i].x;
+            for ( UINT c = 0; c < 3; c++ ) {
+                float error = fabsf( std::min( pA[c], 1.0f ) - std::min( pB[c], 1.0f ) );
+                squaredError += error * error;
+                maxError = std::max( maxError, error );
+            }
+        }
+        double mse = squaredError / ( width * height * 3.0 );
+        double psnr = mse > 0.0 ? 10.0 * log10( 1.0 / mse ) : 99.0;
+
+        logBenchmark( "%s: tiles %u / %u / %u (1x1 / 2x2 / 4x4), %llu shades for %llu pixels (%.2f per pixel), shading %.2f ms (rates %.3f ms), PSNR %.1f dB, max error %.3f\n",
+                      mode.pName, stats.tiles[0], stats.tiles[1], stats.tiles[2], stats.shadedSamples, stats.coveredPixels,
+                      stats.coveredPixels ? (double)stats.shadedSamples / stats.coveredPixels : 0.0, shadeMs / runs, selectMs, psnr, maxError );
+    }
+
+    logBenchmark( "%u x %u, %u x %u tiles, %u spheres in front of a wall, %u lights, contrast thresholds %.2f / %.2f\n",
+                  width, height, rates.getTileSize(), rates.getTileSize(), columns * rows, (UINT)lights.size(), settings.fineContrast, settings.coarseContrast );
+}
+
+// * * * * * IRRADIANCE PROBES - SH accuracy, bake, interpolation * * * * * //
+static DirectX::XMFLOAT3 randomDirection()
+{
+    float height = 1.0f - 2.0f * randomFloat();
+    float r = sqrtf( std::max( 0.0f, 1.0f - height * height ) );
+    float phi = DirectX::XM_2PI * randomFloat();
+    return DirectX::XMFLOAT3( r * cosf( phi ), height, r * sinf( phi ) );
+}
+
+// Blue sky, darker ground and a small warm sun: the kind of light L2 has to smooth over
+static DirectX::XMFLOAT3 testEnvironment( const DirectX::XMFLOAT3& d )
+{
+    float sky = std::max( d.y, 0.0f ), ground = std::max( -d.y, 0.0f );
+    float sun = powf( std::max( d.x * 0.6f + d.y * 0.8f, 0.0f ), 64.0f ) * 20.0f;
+    return DirectX::XMFLOAT3( 0.3f + 0.2f * sky - 0.2f * ground + sun, 0.4f + 0.3f * sky - 0.25f * ground + sun * 0.9f, 0.6f + 0.5f * sky - 0.3f * ground + sun * 0.7f );
+}
+
+static void benchProbes( const BenchmarkContext& context )
+{
+    // - - - SH vs brute force cosine integration of an analytic environment - - - //
+    const UINT sampleCount = 65536, normalCount = 256;
+    std::vector<DirectX::XMFLOAT3> directions( sampleCount ), radiance( sampleCount );
+    DirectX::XMFLOAT3 average( 0.0f, 0.0f, 0.0f );
+    for ( UINT i = 0; i < sampleCount; i++ ) {
+        directions[i] = randomDirection();
+        radiance[i] = testEnvironment( directions[i] );
+        average.x += radiance[i].x / sampleCount;
+        average.y += radiance[i].y / sampleCount;
+        average.z += radiance[i].z / sampleCount;
+    }
+
+    IrradianceProbe probe;
+    projectIrradiance( directions.data(), radiance.data(), sampleCount, probe );
+
+    // E(n) / pi = 4 / count * sum( L * max( n.d, 0 ) ), the flat ambient is the average radiance
+    double shError = 0.0, flatError = 0.0, reference = 0.0;
+    for ( UINT n = 0; n < normalCount; n++ ) {
+        DirectX::XMFLOAT3 normal = randomDirection();
+        DirectX::XMFLOAT3 exact( 0.0f, 0.0f, 0.0f );
+        for ( UINT i = 0; i < sampleCount; i++ ) {
+            float cosine = std::max( normal.x * directions[i].x + normal.y * directions[i].y + normal.z * directions[i].z, 0.0f ) * 4.0f / sampleCount;
+            exact.x += radiance[i].x * cosine;
+            exact.y += radiance[i].y * cosine;
+            exact.z += radiance[i].z * cosine;
+        }
+
+        DirectX::XMFLOAT3 sh = evaluateIrradiance( probe, normal );
+        shError += fabsf( sh.x - exact.x ) + fabsf( sh.y - exact.y ) + fabsf( sh.z - exact.z );
+        flatError += fabsf( average.x - exact.x ) + fabsf( average.y - exact.y ) + fabsf( average.z - exact.z );
+        reference += exact.x + exact.y + exact.z;
+    }
+    logBenchmark( "analytic sky + sun, %u normals: mean error L2 SH %.2f %%, flat ambient %.2f %%\n",
+                  normalCount, 100.0 * shError / reference, 100.0 * flatError / reference );
+
+    // - - - bake: one thread vs the job system, then a grid twice as dense - - - //
+    LightmapMesh meshes[2];
+    createLightmapTestScene( 64, 16.0f, meshes[0], meshes[1] );
+
+    LightmapLight light = { DirectX::XMFLOAT3( 0.0f, 4.0f, 0.0f ), 4.0f, DirectX::XMFLOAT3( 1.0f, 0.95f, 0.9f ), DirectX::XMFLOAT3( 0.2f, 0.1f, 0.1f ), true };
+    LightmapBakeSettings settings;
+    const UINT raysPerProbe = 256;
+
+    IrradianceProbeGrid grids[2];
+    const float spacings[] = { 1.0f, 0.5f };
+    double singleRaysPerSecond = 0.0;
+    for ( UINT pass = 0; pass < 3; pass++ ) {
+        JobSystem* pJobSystem = pass == 0 ? NULL : context.pJobSystem;
+        if ( pass == 1 && !pJobSystem )
+            continue;
+
+        IrradianceProbeGrid& grid = grids[pass == 2 ? 1 : 0];
+        initProbeGrid( DirectX::XMFLOAT3( -8.0f, 0.25f, -8.0f ), DirectX::XMFLOAT3( 8.0f, 3.0f, 8.0f ), spacings[pass == 2 ? 1 : 0], grid );
+
+        ProbeBakeStats stats;
+        Timer timer;
+        if ( !bakeIrradianceProbes( meshes, ARRAYSIZE(meshes), &light, 1, settings, raysPerProbe, grid, stats, pJobSystem ) ) {
+            logBenchmark( "probe bake failed\n" );
+            return;
+        }
+        double bakeMs = timer.elapsedMs();
+
+        if ( pass == 0 )
+            singleRaysPerSecond = stats.raysPerSecond;
+
+        logBenchmark( "spacing %.2f, %u threads: %u probes (%u inside), %.2f M rays/s (x%.2f), bake %.1f ms (trace %.1f)\n",
+                      grid.spacing, stats.threads, stats.probes, stats.insideProbes, stats.raysPerSecond / 1.0e6,
+                      singleRaysPerSecond > 0.0 ? stats.raysPerSecond / singleRaysPerSecond : 0.0, bakeMs, stats.traceMs );
+    }
+
+    // - - - interpolation: coarse grid against the dense one at random points - - - //
+    const UINT lookupCount = 1000000;
+    std::vector<DirectX::XMFLOAT3> positions( lookupCount ), normals( lookupCount );
+    for ( UINT i = 0; i < lookupCount; i++ ) {
+        positions[i] = DirectX::XMFLOAT3( randomFloat() * 16.0f - 8.0f, 0.25f + randomFloat() * 2.75f, randomFloat() * 16.0f - 8.0f );
+        normals[i] = randomDirection();
+    }
+
+    double difference = 0.0, dense = 0.0;
+    for ( UINT i = 0; i < lookupCount; i += 64 ) {
+        DirectX::XMFLOAT3 a = sampleIrradiance( grids[0], positions[i], normals[i] );
+        DirectX::XMFLOAT3 b = sampleIrradiance( grids[1], positions[i], normals[i] );
+        difference += fabsf( a.x - b.x ) + fabsf( a.y - b.y ) + fabsf( a.z - b.z );
+        dense += b.x + b.y + b.z;
+    }
+    logBenchmark( "spacing %.2f vs %.2f: mean difference %.2f %%\n", spacings[0], spacings[1], dense > 0.0 ? 100.0 * difference / dense : 0.0 );
+
+    // - - - runtime cost: trilinear blend + evaluation on the CPU, one 7 fetch lookup per pixel on the GPU - - - //
+    Timer lookupTimer;
+    DirectX::XMFLOAT3 sum( 0.0f, 0.0f, 0.0f );
+    for ( UINT i = 0; i < lookupCount; i++ ) {
+        DirectX::XMFLOAT3 irradiance = sampleIrradiance( grids[0], positions[i], normals[i] );
+        sum.x += irradiance.x;
+    }
+    double lookupMs = lookupTimer.elapsedMs();
+    logBenchmark( "%u CPU lookups: %.2f ms, %.1f ns each (checksum %.1f)\n", lookupCount, lookupMs, lookupMs * 1.0e6 / lookupCount, sum.x );
+
+    ID3D11ShaderResourceView* pSRV = NULL;
+    if ( createProbeTexture( context.pDevice, grids[0], &pSRV ) ) {
+        logBenchmark( "probe texture %u x %u x %u, %u KB\n", grids[0].sizeX * 7, grids[0].sizeY, grids[0].sizeZ,
+                      (UINT)( grids[0].probes.size() * 7 * sizeof(DirectX::PackedVector::XMHALF4) / 1024 ) );
+        pSRV->Release();
+    }
+}
+
+// * * * * * HDR POST CHAIN - CPU kernels per pass and thread count, GPU passes * * * * * //
+static void benchPost( const BenchmarkContext& context )
+{
+    const UINT width = context.width, height = context.height, bloomLevels = 6, runs = 20;
+
+    // Dim gradient with small lights far above 1, like the dynamic light up close
+    const UINT spotCount = 40;
+    DirectX::XMFLOAT3 spots[spotCount];
+    for ( UINT i = 0; i < spotCount; i++ )
+        spots[i] = DirectX::XMFLOAT3( randomFloat() * width, randomFloat() * height, 4.0f + randomFloat() * 30.0f );
+
+    std::vector<DirectX::PackedVector::XMHALF4> hdr( width * height );
+    UINT aboveOne = 0;
+    for ( UINT y = 0; y < height; y++ ) {
+        for ( UINT x = 0; x < width; x++ ) {
+            DirectX::XMFLOAT3 color( 0.05f + 0.5f * x / width, 0.1f + 0.3f * y / height, 0.2f );
+            for ( UINT i = 0; i < spotCount; i++ ) {
+                float dx = x - spots[i].x, dy = y - spots[i].y;
+                float falloff = std::max( 1.0f - ( dx * dx + dy * dy ) / 64.0f, 0.0f );
+                color.x += spots[i].z * falloff;
+                color.y += spots[i].z * falloff * 0.8f;
+                color.z += spots[i].z * falloff * 0.6f;
+            }
+
+            aboveOne += ( color.x > 1.0f || color.y > 1.0f || color.z > 1.0f ) ? 1 : 0;
+            DirectX::PackedVector::XMStoreHalf4( &hdr[y * width + x], DirectX::XMVectorSet( color.x, color.y, color.z, 1.0f ) );
+        }
+    }
+
+#if defined(__AVX2__)
+    const char* kernels = "AVX2 + F16C, 2 pixels per register";
+#else
+    const char* kernels = "SSE, 1 pixel per register";
+#endif
+    logBenchmark( "%u x %u, %.2f %% of the pixels above 1 (clipped without HDR), CPU kernels: %s\n", width, height, 100.0 * aboveOne / ( width * height ), kernels );
+
+    // - - - CPU: one thread vs the job system - - - //
+    PostProcessSettings settings;
+    SoftwarePostProcess software;
+    software.resize( width, height, bloomLevels );
+    std::vector<UINT> output( width * height );
+
+    double singleMs = 0.0;
+    JobSystem* pJobSystems[] = { NULL, context.pJobSystem };
+    for ( UINT j = 0; j < ARRAYSIZE(pJobSystems); j++ ) {
+        if ( j > 0 && !pJobSystems[j] )
+            continue;
+
+        software.process( hdr.data(), settings, output.data(), pJobSystems[j] );
+
+        PostProcessStats sum;
+        ZeroMemory( &sum, sizeof(PostProcessStats) );
+        for ( UINT run = 0; run < runs; run++ ) {
+            software.process( hdr.data(), settings, output.data(), pJobSystems[j] );
+            const PostProcessStats& stats = software.getStats();
+            sum.brightPassMs += stats.brightPassMs;
+            sum.downsampleMs += stats.downsampleMs;
+            sum.upsampleMs += stats.upsampleMs;
+            sum.toneMapMs += stats.toneMapMs;
+            sum.totalMs += stats.totalMs;
+        }
+
+        if ( j == 0 )
+            singleMs = sum.totalMs;
+
+        logBenchmark( "CPU %u threads, %u levels: bright pass %.3f ms, downsample %.3f, upsample %.3f, tone map %.3f, total %.3f ms (x%.2f), %.0f Mpixels/s\n",
+                      software.getStats().threads, software.getBloomLevels(), sum.brightPassMs / runs, sum.downsampleMs / runs, sum.upsampleMs / runs,
+                      sum.toneMapMs / runs, sum.totalMs / runs, sum.totalMs > 0.0 ? singleMs / sum.totalMs : 0.0, width * height * runs / ( sum.totalMs * 1000.0 ) );
+    }
+
+    // - - - operators: tone map pass and how much still clips - - - //
+    const char* operatorNames[] = { "saturate", "Reinhard", "ACES filmic" };
+    const char* transferNames[] = { "linear", "sRGB" };
+    for ( UINT op = 0; op < TONEMAP_OPERATOR_COUNT; op++ ) {
+        for ( UINT transfer = 0; transfer < 2; transfer++ ) {
+            settings.toneMapOperator = (ToneMapOperator)op;
+            settings.transferFunction = (TransferFunction)transfer;
+
+            double toneMapMs = 0.0;
+            for ( UINT run = 0; run < runs; run++ ) {
+                software.process( hdr.data(), settings, output.data(), context.pJobSystem );
+                toneMapMs += software.getStats().toneMapMs;
+            }
+
+            UINT saturated = 0;
+            for ( UINT i = 0; i < width * height; i++ )
+                saturated += ( ( output[i] & 0xFF ) == 0xFF || ( output[i] & 0xFF00 ) == 0xFF00 || ( output[i] & 0xFF0000 ) == 0xFF0000 ) ? 1 : 0;
+
+            logBenchmark( "%s, %s: tone map %.3f ms, %.2f %% of the pixels at 255\n", operatorNames[op], transferNames[transfer], toneMapMs / runs, 100.0 * saturated / ( width * height ) );
+        }
+    }
+
+    // - - - GPU: every pass between timestamps - - - //
+    PostProcess post;
+    GpuTimer gpuTimer;
+    ZeroMemory( &gpuTimer, sizeof(GpuTimer) );
+    if ( !post.init( context.pDevice, width, height, bloomLevels ) || !createGpuTimer( context.pDevice, gpuTimer ) ) {
+        logBenchmark( "post process setup failed\n" );
+        releaseGpuTimer( gpuTimer );
+        post.release();
+        return;
+    }
+
+    settings = PostProcessSettings();
+    const float sceneColor[4] = { 2.0f, 1.2f, 0.6f, 1.0f };
+    const UINT frameCount = 60;
+    double passMs[4] = { 0.0, 0.0, 0.0, 0.0 };
+    UINT timedFrames = 0;
+
+    for ( UINT frame = 0; frame < frameCount; frame++ ) {
+        context.pDeviceContext->ClearRenderTargetView( post.getSceneTarget(), sceneColor );
+        post.beginPasses( context.pDeviceContext );
+
+        double frameMs[4];
+        beginGpuTimer( context.pDeviceContext, gpuTimer );
+        post.brightPass( context.pDeviceContext, settings );
+        frameMs[0] = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+        beginGpuTimer( context.pDeviceContext, gpuTimer );
+        post.downsample( context.pDeviceContext );
+        frameMs[1] = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+        beginGpuTimer( context.pDeviceContext, gpuTimer );
+        post.upsample( context.pDeviceContext );
+        frameMs[2] = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+        beginGpuTimer( context.pDeviceContext, gpuTimer );
+        post.toneMap( context.pDeviceContext, context.pRenderTarget, settings );
+        frameMs[3] = endGpuTimer( context.pDeviceContext, gpuTimer );
+
+        post.endPasses( context.pDeviceContext );
+        context.pSwapchain->Present( 0, 0 );
+
+        if ( frame > 0 && frameMs[0] >= 0.0 && frameMs[1] >= 0.0 && frameMs[2] >= 0.0 && frameMs[3] >= 0.0 ) {
+            for ( UINT p = 0; p < 4; p++ )
+                passMs[p] += frameMs[p];
+            timedFrames++;
+        }
+    }
+
+    if ( timedFrames > 0 )
+        logBenchmark( "GPU %u levels: bright pass %.3f ms, downsample %.3f, upsample %.3f, tone map %.3f, total %.3f ms\n", post.getBloomLevels(),
+                      passMs[0] / timedFrames, passMs[1] / timedFrames, passMs[2] / timedFrames, passMs[3] / timedFrames,
+                      ( passMs[0] + passMs[1] + passMs[2] + passMs[3] ) / timedFrames );
+
+    releaseGpuTimer( gpuTimer );
+    post.release();
+}
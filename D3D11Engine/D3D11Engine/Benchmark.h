@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d11.h>
+#include <dxgi.h>
+
+class TextureArrayManager;
+class QuadBatch;
+class JobSystem;
+
+// * * * Everything a benchmark may need from the running engine * * * //
+struct BenchmarkContext
+{
+    ID3D11Device* pDevice;
+    ID3D11DeviceContext* pDeviceContext;
+    IDXGISwapChain* pSwapchain;
+    ID3D11RenderTargetView* pRenderTarget;
+    ID3D11DepthStencilView* pDepthStencilView;
+    UINT width, height;
+
+    TextureArrayManager* pTextureArrays;
+    QuadBatch* pQuadBatch;
+    JobSystem* pJobSystem;
+};
+
+// Command line: "-bench" runs every benchmark, "-bench name1 name2" runs the named ones.
+// Results go to the debugger output and to benchmark.log next to the executable.
+bool isBenchmarkRun( const wchar_t* cmdLine );
+void runBenchmarks( const wchar_t* cmdLine, const BenchmarkContext& context );
+
+// printf-style logging used by the benchmarks
+void logBenchmark( const char* format, ... );
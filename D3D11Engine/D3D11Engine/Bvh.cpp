@@ -0,0 +1,674 @@
+#include "Bvh.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "JobSystem.h"
+
+const UINT bvhBinCount = 16;
+const UINT bvhMaxLeafObjects = 4;           // nodes with more objects are split
+const float bvhTraversalCost = 1.0f;        // relative to testing one object, for getSahCost
+const UINT bvhParallelRangeSize = 65536;    // nodes with this many objects are binned on the job system
+const UINT bvhRangeBatchSize = 16384;
+const UINT bvhMinSubtreeSize = 1024;
+
+// * * * Build helpers * * * //
+struct BvhBox
+{
+    DirectX::XMFLOAT3 min;
+    DirectX::XMFLOAT3 max;
+};
+
+static void resetBox( BvhBox& box )
+{
+    box.min = DirectX::XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX );
+    box.max = DirectX::XMFLOAT3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+}
+
+static void growBox( BvhBox& box, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax )
+{
+    box.min.x = std::min( box.min.x, boundsMin.x );
+    box.min.y = std::min( box.min.y, boundsMin.y );
+    box.min.z = std::min( box.min.z, boundsMin.z );
+    box.max.x = std::max( box.max.x, boundsMax.x );
+    box.max.y = std::max( box.max.y, boundsMax.y );
+    box.max.z = std::max( box.max.z, boundsMax.z );
+}
+
+static float boxArea( const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax )
+{
+    float dx = boundsMax.x - boundsMin.x, dy = boundsMax.y - boundsMin.y, dz = boundsMax.z - boundsMin.z;
+    if ( dx < 0.0f || dy < 0.0f || dz < 0.0f )
+        return 0.0f;
+    return 2.0f * ( dx * dy + dy * dz + dz * dx );
+}
+
+static float axisValue( const DirectX::XMFLOAT3& v, UINT axis )
+{
+    return ( &v.x )[axis];
+}
+
+// Object box + id, moved around by the partitioning so every pass over a node reads one
+// contiguous range instead of gathering through the object order
+struct BvhBuildRef
+{
+    DirectX::XMFLOAT3 boundsMin;
+    UINT object;
+    DirectX::XMFLOAT3 boundsMax;
+};
+
+static float centroid( const BvhBuildRef& ref, UINT axis )
+{
+    return ( axisValue( ref.boundsMin, axis ) + axisValue( ref.boundsMax, axis ) ) * 0.5f;
+}
+
+struct BvhBin
+{
+    BvhBox bounds;
+    BvhBox centroidBounds;
+    UINT count;
+};
+
+static void resetBin( BvhBin& bin )
+{
+    resetBox( bin.bounds );
+    resetBox( bin.centroidBounds );
+    bin.count = 0;
+}
+
+static void growBin( BvhBin& bin, const BvhBin& other )
+{
+    growBox( bin.bounds, other.bounds.min, other.bounds.max );
+    growBox( bin.centroidBounds, other.centroidBounds.min, other.centroidBounds.max );
+    bin.count += other.count;
+}
+
+// Object bounds and centroid bounds of refs[first, first + count)
+static void rangeBounds( const BvhBuildRef* pRefs, UINT first, UINT count, BvhBox& bounds, BvhBox& centroidBounds )
+{
+    resetBox( bounds );
+    resetBox( centroidBounds );
+    for ( UINT i = first; i < first + count; i++ ) {
+        const BvhBuildRef& ref = pRefs[i];
+        DirectX::XMFLOAT3 center( centroid( ref, 0 ), centroid( ref, 1 ), centroid( ref, 2 ) );
+        growBox( bounds, ref.boundsMin, ref.boundsMax );
+        growBox( centroidBounds, center, center );
+    }
+}
+
+static void rangeBoundsParallel( const BvhBuildRef* pRefs, UINT first, UINT count, BvhBox& bounds, BvhBox& centroidBounds, JobSystem* pJobSystem )
+{
+    if ( !pJobSystem || count < bvhParallelRangeSize ) {
+        rangeBounds( pRefs, first, count, bounds, centroidBounds );
+        return;
+    }
+
+    UINT batchCount = ( count + bvhRangeBatchSize - 1 ) / bvhRangeBatchSize;
+    // Empty partials, a batch that doesn't run must not add the origin to the bounds
+    std::vector<BvhBox> partial( batchCount * 2 );
+    for ( size_t b = 0; b < partial.size(); b++ )
+        resetBox( partial[b] );
+
+    pJobSystem->parallelFor( count, bvhRangeBatchSize, [&]( UINT begin, UINT end ) {
+        UINT batch = begin / bvhRangeBatchSize;
+        rangeBounds( pRefs, first + begin, end - begin, partial[batch * 2], partial[batch * 2 + 1] );
+    } );
+
+    resetBox( bounds );
+    resetBox( centroidBounds );
+    for ( UINT b = 0; b < batchCount; b++ ) {
+        growBox( bounds, partial[b * 2].min, partial[b * 2].max );
+        growBox( centroidBounds, partial[b * 2 + 1].min, partial[b * 2 + 1].max );
+    }
+}
+
+static UINT binIndex( float value, float binStart, float binScale )
+{
+    int bin = (int)( ( value - binStart ) * binScale );
+    return (UINT)std::min( std::max( bin, 0 ), (int)bvhBinCount - 1 );
+}
+
+static void binRange( const BvhBuildRef* pRefs, UINT first, UINT count, UINT axis, float binStart, float binScale, BvhBin* pBins )
+{
+    for ( UINT b = 0; b < bvhBinCount; b++ )
+        resetBin( pBins[b] );
+
+    for ( UINT i = first; i < first + count; i++ ) {
+        const BvhBuildRef& ref = pRefs[i];
+        DirectX::XMFLOAT3 center( centroid( ref, 0 ), centroid( ref, 1 ), centroid( ref, 2 ) );
+        BvhBin& bin = pBins[binIndex( axisValue( center, axis ), binStart, binScale )];
+        growBox( bin.bounds, ref.boundsMin, ref.boundsMax );
+        growBox( bin.centroidBounds, center, center );
+        bin.count++;
+    }
+}
+
+// Best binned SAH split along the longest centroid axis, pSides gets the bounds of both halves
+// straight from the bins. False = no split exists (all centroids on one point)
+static bool findSplit( const BvhBuildRef* pRefs, const BvhNode& node, const BvhBox& centroidBounds, JobSystem* pJobSystem,
+                       UINT& splitAxis, UINT& splitBin, float& binStart, float& binScale, BvhBin* pSides )
+{
+    DirectX::XMFLOAT3 extent( centroidBounds.max.x - centroidBounds.min.x, centroidBounds.max.y - centroidBounds.min.y, centroidBounds.max.z - centroidBounds.min.z );
+    splitAxis = ( extent.x >= extent.y && extent.x >= extent.z ) ? 0 : ( extent.y >= extent.z ? 1 : 2 );
+
+    float axisExtent = axisValue( extent, splitAxis );
+    if ( !( axisExtent > 0.0f ) )
+        return false;
+
+    binStart = axisValue( centroidBounds.min, splitAxis );
+    binScale = bvhBinCount / axisExtent;
+
+    // - - - bin the centroids, in batches on the job system for big nodes - - - //
+    BvhBin bins[bvhBinCount];
+    if ( !pJobSystem || node.objectCount < bvhParallelRangeSize ) {
+        binRange( pRefs, node.firstObject, node.objectCount, splitAxis, binStart, binScale, bins );
+    }
+    else {
+        UINT batchCount = ( node.objectCount + bvhRangeBatchSize - 1 ) / bvhRangeBatchSize;
+        std::vector<BvhBin> partial( batchCount * bvhBinCount );
+        for ( size_t b = 0; b < partial.size(); b++ )
+            resetBin( partial[b] );
+
+        pJobSystem->parallelFor( node.objectCount, bvhRangeBatchSize, [&]( UINT begin, UINT end ) {
+            binRange( pRefs, node.firstObject + begin, end - begin, splitAxis, binStart, binScale, &partial[( begin / bvhRangeBatchSize ) * bvhBinCount] );
+        } );
+
+        for ( UINT b = 0; b < bvhBinCount; b++ ) {
+            resetBin( bins[b] );
+            for ( UINT batch = 0; batch < batchCount; batch++ )
+                growBin( bins[b], partial[batch * bvhBinCount + b] );
+        }
+    }
+
+    // - - - sweep: cost of splitting after bin b - - - //
+    float leftCost[bvhBinCount - 1];
+    BvhBox box;
+    resetBox( box );
+    UINT count = 0;
+    for ( UINT b = 0; b + 1 < bvhBinCount; b++ ) {
+        growBox( box, bins[b].bounds.min, bins[b].bounds.max );
+        count += bins[b].count;
+        leftCost[b] = count * boxArea( box.min, box.max );
+    }
+
+    float bestCost = FLT_MAX;
+    resetBox( box );
+    count = 0;
+    for ( UINT b = bvhBinCount - 1; b > 0; b-- ) {
+        growBox( box, bins[b].bounds.min, bins[b].bounds.max );
+        count += bins[b].count;
+
+        float cost = leftCost[b - 1] + count * boxArea( box.min, box.max );
+        if ( count > 0 && count < node.objectCount && cost < bestCost ) {
+            bestCost = cost;
+            splitBin = b - 1;
+        }
+    }
+
+    if ( bestCost == FLT_MAX )
+        return false;
+
+    resetBin( pSides[0] );
+    resetBin( pSides[1] );
+    for ( UINT b = 0; b < bvhBinCount; b++ )
+        growBin( pSides[b <= splitBin ? 0 : 1], bins[b] );
+    return true;
+}
+
+static void setNodeBounds( BvhNode& node, const BvhBox& bounds )
+{
+    node.boundsMin = bounds.min;
+    node.boundsMax = bounds.max;
+}
+
+// A node waiting to be split, with the centroid bounds of its objects
+struct BvhBuildTask
+{
+    UINT node;
+    BvhBox centroidBounds;
+};
+
+// Gives the node two children (pushed to the task stack), false when it stays a leaf
+static bool splitNode( BvhBuildRef* pRefs, std::vector<BvhNode>& nodes, const BvhBuildTask& task, JobSystem* pJobSystem, std::vector<BvhBuildTask>& tasks )
+{
+    BvhNode node = nodes[task.node];
+    if ( node.objectCount <= bvhMaxLeafObjects )
+        return false;
+
+    UINT splitAxis = 0, splitBin = 0;
+    float binStart = 0.0f, binScale = 0.0f;
+    BvhBin sides[2];
+
+    if ( findSplit( pRefs, node, task.centroidBounds, pJobSystem, splitAxis, splitBin, binStart, binScale, sides ) ) {
+        std::partition( pRefs + node.firstObject, pRefs + node.firstObject + node.objectCount, [&]( const BvhBuildRef& ref ) {
+            return binIndex( centroid( ref, splitAxis ), binStart, binScale ) <= splitBin;
+        } );
+    }
+    else {
+        // Centroids can't be told apart, halve the range to keep the leaves small
+        sides[0].count = node.objectCount / 2;
+        sides[1].count = node.objectCount - sides[0].count;
+        rangeBoundsParallel( pRefs, node.firstObject, sides[0].count, sides[0].bounds, sides[0].centroidBounds, pJobSystem );
+        rangeBoundsParallel( pRefs, node.firstObject + sides[0].count, sides[1].count, sides[1].bounds, sides[1].centroidBounds, pJobSystem );
+    }
+
+    UINT leftChild = (UINT)nodes.size();
+    nodes[task.node].leftChild = leftChild;
+
+    UINT firstObject = node.firstObject;
+    for ( UINT c = 0; c < 2; c++ ) {
+        BvhNode child;
+        child.leftChild = BVH_LEAF;
+        child.firstObject = firstObject;
+        child.objectCount = sides[c].count;
+        setNodeBounds( child, sides[c].bounds );
+        nodes.push_back( child );
+        firstObject += sides[c].count;
+
+        BvhBuildTask childTask;
+        childTask.node = leftChild + c;
+        childTask.centroidBounds = sides[c].centroidBounds;
+        tasks.push_back( childTask );
+    }
+    return true;
+}
+
+static void buildSubtree( BvhBuildRef* pRefs, std::vector<BvhNode>& nodes, const BvhBuildTask& root )
+{
+    std::vector<BvhBuildTask> tasks( 1, root );
+    while ( !tasks.empty() ) {
+        BvhBuildTask task = tasks.back();
+        tasks.pop_back();
+        splitNode( pRefs, nodes, task, NULL, tasks );
+    }
+}
+
+// * * * * * BUILD * * * * * //
+Bvh::Bvh()
+{
+}
+
+void Bvh::clear()
+{
+    nodes.clear();
+    nodeParents.clear();
+    objectOrder.clear();
+    objectSlots.clear();
+    objectLeaves.clear();
+    orderedMins.clear();
+    orderedMaxs.clear();
+    dirtyLeaves.clear();
+    leafDirty.clear();
+}
+
+void Bvh::build( const DirectX::XMFLOAT3* pMins, const DirectX::XMFLOAT3* pMaxs, UINT objectCount, JobSystem* pJobSystem )
+{
+    clear();
+    if ( objectCount == 0 )
+        return;
+
+    std::vector<BvhBuildRef> refs( objectCount );
+    for ( UINT i = 0; i < objectCount; i++ ) {
+        refs[i].boundsMin = pMins[i];
+        refs[i].object = i;
+        refs[i].boundsMax = pMaxs[i];
+    }
+
+    BvhNode root;
+    root.leftChild = BVH_LEAF;
+    root.firstObject = 0;
+    root.objectCount = objectCount;
+
+    BvhBuildTask rootTask;
+    rootTask.node = 0;
+    BvhBox bounds;
+    rangeBoundsParallel( refs.data(), 0, objectCount, bounds, rootTask.centroidBounds, pJobSystem );
+    setNodeBounds( root, bounds );
+
+    nodes.reserve( objectCount * 2 );
+    nodes.push_back( root );
+
+    // - - - top of the tree: split with parallel binning until there are enough subtrees - - - //
+    UINT threadCount = pJobSystem ? pJobSystem->getThreadCount() : 1;
+    UINT subtreeSize = ( threadCount > 1 ) ? std::max( objectCount / ( threadCount * 8 ), bvhMinSubtreeSize ) : objectCount;
+
+    std::vector<BvhBuildTask> pending( 1, rootTask );
+    std::vector<BvhBuildTask> subtrees;
+    while ( !pending.empty() ) {
+        BvhBuildTask task = pending.back();
+        pending.pop_back();
+
+        if ( nodes[task.node].objectCount <= subtreeSize )
+            subtrees.push_back( task );
+        else
+            splitNode( refs.data(), nodes, task, pJobSystem, pending );
+    }
+
+    // - - - subtrees: one serial build per job, local node arrays appended afterwards - - - //
+    if ( subtrees.size() == 1 || !pJobSystem ) {
+        for ( size_t s = 0; s < subtrees.size(); s++ )
+            buildSubtree( refs.data(), nodes, subtrees[s] );
+    }
+    else {
+        std::vector<std::vector<BvhNode>> localNodes( subtrees.size() );
+        pJobSystem->parallelFor( (UINT)subtrees.size(), 1, [&]( UINT begin, UINT end ) {
+            for ( UINT s = begin; s < end; s++ ) {
+                BvhBuildTask localRoot = subtrees[s];
+                localRoot.node = 0;
+                localNodes[s].push_back( nodes[subtrees[s].node] );
+                buildSubtree( refs.data(), localNodes[s], localRoot );
+            }
+        } );
+
+        // Local node k (k > 0) lands at base + k - 1, local node 0 is the subtree root already in nodes
+        for ( size_t s = 0; s < subtrees.size(); s++ ) {
+            const std::vector<BvhNode>& local = localNodes[s];
+            UINT base = (UINT)nodes.size();
+
+            for ( size_t k = 1; k < local.size(); k++ ) {
+                BvhNode node = local[k];
+                if ( node.leftChild != BVH_LEAF )
+                    node.leftChild = base + node.leftChild - 1;
+                nodes.push_back( node );
+            }
+
+            if ( local[0].leftChild != BVH_LEAF )
+                nodes[subtrees[s].node].leftChild = base + local[0].leftChild - 1;
+        }
+    }
+
+    // - - - object boxes in tree order, so leaves and refits read them sequentially - - - //
+    objectOrder.resize( objectCount );
+    objectSlots.resize( objectCount );
+    orderedMins.resize( objectCount );
+    orderedMaxs.resize( objectCount );
+    for ( UINT i = 0; i < objectCount; i++ ) {
+        objectOrder[i] = refs[i].object;
+        objectSlots[refs[i].object] = i;
+        orderedMins[i] = refs[i].boundsMin;
+        orderedMaxs[i] = refs[i].boundsMax;
+    }
+
+    // - - - parents and object -> leaf for refitting - - - //
+    nodeParents.assign( nodes.size(), BVH_LEAF );
+    objectLeaves.resize( objectCount );
+    for ( UINT n = 0; n < (UINT)nodes.size(); n++ ) {
+        const BvhNode& node = nodes[n];
+        if ( node.leftChild != BVH_LEAF ) {
+            nodeParents[node.leftChild] = n;
+            nodeParents[node.leftChild + 1] = n;
+        }
+        else {
+            for ( UINT i = node.firstObject; i < node.firstObject + node.objectCount; i++ )
+                objectLeaves[objectOrder[i]] = n;
+        }
+    }
+
+    leafDirty.assign( nodes.size(), 0 );
+}
+
+// * * * * * REFIT * * * * * //
+void Bvh::setObjectBounds( UINT object, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax )
+{
+    UINT slot = objectSlots[object];
+    orderedMins[slot] = boundsMin;
+    orderedMaxs[slot] = boundsMax;
+
+    UINT leaf = objectLeaves[object];
+    if ( !leafDirty[leaf] ) {
+        leafDirty[leaf] = 1;
+        dirtyLeaves.push_back( leaf );
+    }
+}
+
+void Bvh::refitNode( UINT nodeIndex )
+{
+    BvhNode& node = nodes[nodeIndex];
+
+    BvhBox box;
+    resetBox( box );
+    if ( node.leftChild == BVH_LEAF ) {
+        for ( UINT i = node.firstObject; i < node.firstObject + node.objectCount; i++ )
+            growBox( box, orderedMins[i], orderedMaxs[i] );
+    }
+    else {
+        growBox( box, nodes[node.leftChild].boundsMin, nodes[node.leftChild].boundsMax );
+        growBox( box, nodes[node.leftChild + 1].boundsMin, nodes[node.leftChild + 1].boundsMax );
+    }
+    setNodeBounds( node, box );
+}
+
+void Bvh::refit()
+{
+    if ( dirtyLeaves.empty() )
+        return;
+
+    if ( dirtyLeaves.size() * 8 > nodes.size() ) {
+        // Many objects moved: one sweep, children always sit after their parent
+        for ( UINT n = (UINT)nodes.size(); n-- > 0; )
+            refitNode( n );
+    }
+    else {
+        // Few objects moved: walk up from each leaf until a node's box stops changing
+        for ( size_t d = 0; d < dirtyLeaves.size(); d++ ) {
+            UINT nodeIndex = dirtyLeaves[d];
+            refitNode( nodeIndex );
+
+            for ( UINT parent = nodeParents[nodeIndex]; parent != BVH_LEAF; parent = nodeParents[parent] ) {
+                BvhNode before = nodes[parent];
+                refitNode( parent );
+                if ( memcmp( &before, &nodes[parent], sizeof(BvhNode) ) == 0 )
+                    break;
+            }
+        }
+    }
+
+    for ( size_t d = 0; d < dirtyLeaves.size(); d++ )
+        leafDirty[dirtyLeaves[d]] = 0;
+    dirtyLeaves.clear();
+}
+
+// * * * * * QUERIES * * * * * //
+void Bvh::queryFrustum( const Frustum& frustum, std::vector<UINT>& results ) const
+{
+    if ( nodes.empty() )
+        return;
+
+    // Box vs plane: distance of the center against the box's reach along the normal. A plane the
+    // box is fully inside of is dropped from the mask for the whole subtree.
+    auto classify = [&]( const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, UINT& planeMask ) {
+        DirectX::XMFLOAT3 center( ( boundsMin.x + boundsMax.x ) * 0.5f, ( boundsMin.y + boundsMax.y ) * 0.5f, ( boundsMin.z + boundsMax.z ) * 0.5f );
+        DirectX::XMFLOAT3 extents( ( boundsMax.x - boundsMin.x ) * 0.5f, ( boundsMax.y - boundsMin.y ) * 0.5f, ( boundsMax.z - boundsMin.z ) * 0.5f );
+
+        for ( UINT p = 0; p < FRUSTUM_PLANE_COUNT; p++ ) {
+            if ( !( planeMask & ( 1 << p ) ) )
+                continue;
+
+            const DirectX::XMFLOAT4& plane = frustum.planes[p];
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float reach = extents.x * fabsf( plane.x ) + extents.y * fabsf( plane.y ) + extents.z * fabsf( plane.z );
+
+            if ( distance < -reach )
+                return false;
+            if ( distance >= reach )
+                planeMask &= ~( 1 << p );
+        }
+        return true;
+    };
+
+    const UINT allPlanes = ( 1 << FRUSTUM_PLANE_COUNT ) - 1;
+    std::vector<UINT> stack;
+    stack.reserve( 64 );
+    stack.push_back( 0 );
+    stack.push_back( allPlanes );
+
+    while ( !stack.empty() ) {
+        UINT planeMask = stack.back();
+        stack.pop_back();
+        UINT nodeIndex = stack.back();
+        stack.pop_back();
+
+        const BvhNode& node = nodes[nodeIndex];
+        if ( !classify( node.boundsMin, node.boundsMax, planeMask ) )
+            continue;
+
+        if ( planeMask == 0 ) {
+            results.insert( results.end(), objectOrder.begin() + node.firstObject, objectOrder.begin() + node.firstObject + node.objectCount );
+            continue;
+        }
+
+        if ( node.leftChild == BVH_LEAF ) {
+            for ( UINT i = node.firstObject; i < node.firstObject + node.objectCount; i++ ) {
+                UINT objectMask = planeMask;
+                if ( classify( orderedMins[i], orderedMaxs[i], objectMask ) )
+                    results.push_back( objectOrder[i] );
+            }
+            continue;
+        }
+
+        stack.push_back( node.leftChild );
+        stack.push_back( planeMask );
+        stack.push_back( node.leftChild + 1 );
+        stack.push_back( planeMask );
+    }
+}
+
+// Squared distance from the point to the box, and to the box corner farthest away
+static void boxDistances( const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, const DirectX::XMFLOAT3& point, float& nearestSq, float& farthestSq )
+{
+    nearestSq = 0.0f;
+    farthestSq = 0.0f;
+    for ( UINT axis = 0; axis < 3; axis++ ) {
+        float p = axisValue( point, axis ), lo = axisValue( boundsMin, axis ), hi = axisValue( boundsMax, axis );
+        float nearest = ( p < lo ) ? lo - p : ( p > hi ? p - hi : 0.0f );
+        float farthest = std::max( fabsf( p - lo ), fabsf( p - hi ) );
+        nearestSq += nearest * nearest;
+        farthestSq += farthest * farthest;
+    }
+}
+
+void Bvh::querySphere( const DirectX::XMFLOAT3& center, float radius, std::vector<UINT>& results ) const
+{
+    if ( nodes.empty() )
+        return;
+
+    float radiusSq = radius * radius;
+    std::vector<UINT> stack;
+    stack.reserve( 64 );
+    stack.push_back( 0 );
+
+    while ( !stack.empty() ) {
+        const BvhNode& node = nodes[stack.back()];
+        stack.pop_back();
+
+        float nearestSq, farthestSq;
+        boxDistances( node.boundsMin, node.boundsMax, center, nearestSq, farthestSq );
+        if ( nearestSq > radiusSq )
+            continue;
+
+        if ( farthestSq <= radiusSq ) {
+            results.insert( results.end(), objectOrder.begin() + node.firstObject, objectOrder.begin() + node.firstObject + node.objectCount );
+            continue;
+        }
+
+        if ( node.leftChild == BVH_LEAF ) {
+            for ( UINT i = node.firstObject; i < node.firstObject + node.objectCount; i++ ) {
+                boxDistances( orderedMins[i], orderedMaxs[i], center, nearestSq, farthestSq );
+                if ( nearestSq <= radiusSq )
+                    results.push_back( objectOrder[i] );
+            }
+            continue;
+        }
+
+        stack.push_back( node.leftChild );
+        stack.push_back( node.leftChild + 1 );
+    }
+}
+
+// Slab test, entry distance or FLT_MAX on a miss
+static float rayBoxEntry( const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& invDirection, float maxDistance )
+{
+    float tNear = 0.0f, tFar = maxDistance;
+    for ( UINT axis = 0; axis < 3; axis++ ) {
+        float o = axisValue( origin, axis ), inv = axisValue( invDirection, axis );
+        float t0 = ( axisValue( boundsMin, axis ) - o ) * inv;
+        float t1 = ( axisValue( boundsMax, axis ) - o ) * inv;
+        if ( t0 > t1 )
+            std::swap( t0, t1 );
+
+        // NaN (origin on a slab of a parallel axis) fails both compares and leaves the interval alone
+        if ( t0 > tNear ) tNear = t0;
+        if ( t1 < tFar ) tFar = t1;
+    }
+    return ( tNear <= tFar ) ? tNear : FLT_MAX;
+}
+
+bool Bvh::raycast( const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, BvhRayHit& hit ) const
+{
+    if ( nodes.empty() )
+        return false;
+
+    DirectX::XMFLOAT3 invDirection( 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z );
+    float closest = maxDistance;
+    UINT closestObject = BVH_LEAF;
+
+    std::vector<UINT> stack;
+    stack.reserve( 64 );
+    if ( rayBoxEntry( nodes[0].boundsMin, nodes[0].boundsMax, origin, invDirection, closest ) != FLT_MAX )
+        stack.push_back( 0 );
+
+    while ( !stack.empty() ) {
+        const BvhNode& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if ( node.leftChild == BVH_LEAF ) {
+            for ( UINT i = node.firstObject; i < node.firstObject + node.objectCount; i++ ) {
+                float t = rayBoxEntry( orderedMins[i], orderedMaxs[i], origin, invDirection, closest );
+                if ( t != FLT_MAX && ( t < closest || closestObject == BVH_LEAF ) ) {
+                    closest = t;
+                    closestObject = objectOrder[i];
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top of the stack, so the far one is often skipped by the closer hit
+        float tLeft = rayBoxEntry( nodes[node.leftChild].boundsMin, nodes[node.leftChild].boundsMax, origin, invDirection, closest );
+        float tRight = rayBoxEntry( nodes[node.leftChild + 1].boundsMin, nodes[node.leftChild + 1].boundsMax, origin, invDirection, closest );
+        UINT nearChild = ( tLeft <= tRight ) ? node.leftChild : node.leftChild + 1;
+        UINT farChild = ( tLeft <= tRight ) ? node.leftChild + 1 : node.leftChild;
+        float tFar = std::max( tLeft, tRight );
+
+        if ( tFar != FLT_MAX )
+            stack.push_back( farChild );
+        if ( std::min( tLeft, tRight ) != FLT_MAX )
+            stack.push_back( nearChild );
+    }
+
+    if ( closestObject == BVH_LEAF )
+        return false;
+
+    hit.object = closestObject;
+    hit.distance = closest;
+    return true;
+}
+
+float Bvh::getSahCost() const
+{
+    if ( nodes.empty() )
+        return 0.0f;
+
+    float rootArea = boxArea( nodes[0].boundsMin, nodes[0].boundsMax );
+    if ( rootArea <= 0.0f )
+        return 0.0f;
+
+    double cost = 0.0;
+    for ( size_t n = 0; n < nodes.size(); n++ ) {
+        const BvhNode& node = nodes[n];
+        float area = boxArea( node.boundsMin, node.boundsMax );
+        cost += ( node.leftChild == BVH_LEAF ) ? area * node.objectCount : area * bvhTraversalCost;
+    }
+    return (float)( cost / rootArea );
+}
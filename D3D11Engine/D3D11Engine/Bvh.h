@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Camera.h"
+
+class JobSystem;
+
+// * * * Bounding volume hierarchy over object boxes * * * //
+// Binned SAH build: the top of the tree is split with the binning spread over the job system,
+// the subtrees below are built in parallel. Every node covers one contiguous range of the object
+// order, so a node that is fully inside a query hands its whole range over without visiting its
+// children. Moving objects are handled by refitting (the tree shape stays, boxes grow / shrink),
+// rebuild when the objects have moved far enough that the queries get slow.
+const UINT BVH_LEAF = 0xFFFFFFFF;
+
+struct BvhNode
+{
+    DirectX::XMFLOAT3 boundsMin;
+    UINT leftChild;             // BVH_LEAF, or the left child (the right one follows it)
+    DirectX::XMFLOAT3 boundsMax;
+    UINT firstObject;           // range in the object order
+    UINT objectCount;
+};
+
+struct BvhRayHit
+{
+    UINT object;
+    float distance;             // along the ray direction, in units of its length
+};
+
+class Bvh
+{
+public:
+    Bvh();
+
+    // The boxes are copied, query results are indices into these arrays
+    void build( const DirectX::XMFLOAT3* pMins, const DirectX::XMFLOAT3* pMaxs, UINT objectCount, JobSystem* pJobSystem = NULL );
+    void clear();
+
+    // Moving objects: set the new boxes, then refit() updates the nodes above them
+    void setObjectBounds( UINT object, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax );
+    void refit();
+
+    // Objects whose box intersects the frustum (unordered, appended to results)
+    void queryFrustum( const Frustum& frustum, std::vector<UINT>& results ) const;
+    // Objects whose box touches the sphere, e.g. the objects a point light reaches
+    void querySphere( const DirectX::XMFLOAT3& center, float radius, std::vector<UINT>& results ) const;
+    // Closest object box hit by origin + t * direction, 0 <= t <= maxDistance
+    bool raycast( const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, BvhRayHit& hit ) const;
+
+    UINT getObjectCount() const { return (UINT)objectOrder.size(); }
+    UINT getNodeCount() const { return (UINT)nodes.size(); }
+    const BvhNode& getNode( UINT index ) const { return nodes[index]; }
+    // Object at a position of the object order, node ranges index this
+    UINT getOrderedObject( UINT slot ) const { return objectOrder[slot]; }
+
+    // Surface area heuristic cost of the tree relative to its root box, lower is better
+    float getSahCost() const;
+
+private:
+    void refitNode( UINT nodeIndex );
+
+    std::vector<BvhNode> nodes;                 // nodes[0] is the root, children come after their parent
+    std::vector<UINT> nodeParents;
+    std::vector<UINT> objectOrder;              // node ranges index this
+    std::vector<UINT> objectSlots;              // per object, its position in the order
+    std::vector<UINT> objectLeaves;             // per object, the leaf it sits in
+    std::vector<DirectX::XMFLOAT3> orderedMins; // object boxes in the object order
+    std::vector<DirectX::XMFLOAT3> orderedMaxs;
+
+    std::vector<UINT> dirtyLeaves;
+    std::vector<BYTE> leafDirty;                // per node
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+
+// * * * Useful * * * //
+#include <string>
+#include <stdio.h>
+
+// * * * Constant buffer layout, computed at compile time from one field list * * * //
+// HLSL packs constants into 16 byte registers: a vector may not straddle two registers, matrices
+// start on a register and fill whole ones. DECLARE_CBUFFER takes an X-macro field list, places the
+// fields largest first into the first register they fit (fewest registers for the types below),
+// static_asserts the result and gives a C++ struct with an accessor per field. The matching HLSL
+// declaration (packoffset on every field) comes from getCBufferDeclaration, shaders get it as a
+// macro, so both sides always use the same offsets. Arrays and nested structs aren't supported.
+/*
+    #define LIGHT_FIELDS( FIELD ) \
+        FIELD( DirectX::XMFLOAT3, color ) \
+        FIELD( float, strength )
+    DECLARE_CBUFFER( cBufferLight, LIGHT_FIELDS )
+
+    cBufferLight light;
+    light.color() = DirectX::XMFLOAT3( 1.0f, 1.0f, 1.0f );
+*/
+const UINT CBUFFER_REGISTER_BYTES = 16;
+
+struct CBufferField
+{
+    const char* hlslType;
+    const char* name;
+    UINT size;
+    bool wholeRegisters;
+};
+
+// HLSL type of a C++ field type, only these can be fields
+template<typename T> struct CBufferFieldType;
+
+#define CBUFFER_FIELD_TYPE( CppType, HlslType, WholeRegisters ) \
+    template<> struct CBufferFieldType<CppType> \
+    { \
+        static constexpr const char* hlsl = HlslType; \
+        static constexpr UINT size = sizeof(CppType); \
+        static constexpr bool wholeRegisters = WholeRegisters; \
+    };
+
+CBUFFER_FIELD_TYPE( float, "float", false )
+CBUFFER_FIELD_TYPE( DirectX::XMFLOAT2, "float2", false )
+CBUFFER_FIELD_TYPE( DirectX::XMFLOAT3, "float3", false )
+CBUFFER_FIELD_TYPE( DirectX::XMFLOAT4, "float4", false )
+CBUFFER_FIELD_TYPE( int, "int", false )
+CBUFFER_FIELD_TYPE( UINT, "uint", false )
+CBUFFER_FIELD_TYPE( DirectX::XMUINT2, "uint2", false )
+CBUFFER_FIELD_TYPE( DirectX::XMUINT3, "uint3", false )
+CBUFFER_FIELD_TYPE( DirectX::XMUINT4, "uint4", false )
+CBUFFER_FIELD_TYPE( DirectX::XMFLOAT4X4, "float4x4", true )     // uploaded transposed, HLSL default is column major
+CBUFFER_FIELD_TYPE( DirectX::XMMATRIX, "float4x4", true )
+
+template<UINT N>
+struct CBufferLayout
+{
+    UINT offsets[N];        // bytes, in declaration order
+    UINT size;              // whole registers
+    UINT declaredSize;      // size with the fields packed in declaration order
+};
+
+// First offset at or after offset where the field doesn't straddle a register
+constexpr UINT placeCBufferField( UINT offset, const CBufferField& field )
+{
+    if ( field.wholeRegisters || offset % CBUFFER_REGISTER_BYTES + field.size > CBUFFER_REGISTER_BYTES )
+        return ( offset + CBUFFER_REGISTER_BYTES - 1 ) / CBUFFER_REGISTER_BYTES * CBUFFER_REGISTER_BYTES;
+    return offset;
+}
+
+// First fit decreasing: all sizes are multiples of 4 bytes and at most one register (or whole
+// registers), for these first fit decreasing uses the fewest registers possible
+template<UINT N>
+constexpr CBufferLayout<N> packCBufferFields( const CBufferField ( &fields )[N] )
+{
+    CBufferLayout<N> layout = {};
+
+    UINT offset = 0;
+    for ( UINT i = 0; i < N; i++ )
+        offset = placeCBufferField( offset, fields[i] ) + fields[i].size;
+    layout.declaredSize = ( offset + CBUFFER_REGISTER_BYTES - 1 ) / CBUFFER_REGISTER_BYTES * CBUFFER_REGISTER_BYTES;
+
+    // - - - whole register fields first, then by size, ties keep their declaration order - - - //
+    UINT order[N] = {};
+    for ( UINT i = 0; i < N; i++ ) {
+        UINT j = i;
+        for ( ; j > 0; j-- ) {
+            const CBufferField& previous = fields[order[j - 1]];
+            bool before = fields[i].wholeRegisters ? !previous.wholeRegisters || fields[i].size > previous.size
+                                                   : !previous.wholeRegisters && fields[i].size > previous.size;
+            if ( !before )
+                break;
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    // - - - into the first register with room - - - //
+    UINT used[N * 4 + 1] = {};      // bytes used per register, a field takes at most 4 registers
+    UINT registerCount = 0;
+    for ( UINT i = 0; i < N; i++ ) {
+        const CBufferField& field = fields[order[i]];
+
+        UINT r = 0;
+        if ( !field.wholeRegisters ) {
+            while ( r < registerCount && used[r] + field.size > CBUFFER_REGISTER_BYTES )
+                r++;
+        }
+        else {
+            r = registerCount;
+        }
+
+        layout.offsets[order[i]] = r * CBUFFER_REGISTER_BYTES + used[r];
+
+        UINT bytes = used[r] + field.size;
+        for ( ; bytes > 0; r++ ) {
+            UINT registerBytes = bytes < CBUFFER_REGISTER_BYTES ? bytes : CBUFFER_REGISTER_BYTES;
+            used[r] = registerBytes;
+            bytes -= registerBytes;
+            registerCount = r + 1 > registerCount ? r + 1 : registerCount;
+        }
+    }
+
+    layout.size = ( registerCount > 0 ? registerCount : 1 ) * CBUFFER_REGISTER_BYTES;
+    return layout;
+}
+
+// No field straddles a register or overlaps another, nothing got bigger than declaration order
+template<UINT N>
+constexpr bool isCBufferLayoutValid( const CBufferField ( &fields )[N], const CBufferLayout<N>& layout )
+{
+    for ( UINT i = 0; i < N; i++ ) {
+        UINT offset = layout.offsets[i];
+        if ( placeCBufferField( offset, fields[i] ) != offset || offset + fields[i].size > layout.size )
+            return false;
+
+        for ( UINT j = 0; j < i; j++ ) {
+            if ( offset < layout.offsets[j] + fields[j].size && layout.offsets[j] < offset + fields[i].size )
+                return false;
+        }
+    }
+
+    return layout.size % CBUFFER_REGISTER_BYTES == 0 && layout.size <= layout.declaredSize;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+#define CBUFFER_FIELD_INDEX( Type, name ) name##Field,
+#define CBUFFER_FIELD_DESC( Type, name ) { CBufferFieldType<Type>::hlsl, #name, CBufferFieldType<Type>::size, CBufferFieldType<Type>::wholeRegisters },
+#define CBUFFER_FIELD_ACCESSOR( Type, name ) \
+    Type& name() { return *(Type*)( data + layout.offsets[name##Field] ); } \
+    const Type& name() const { return *(const Type*)( data + layout.offsets[name##Field] ); }
+
+#define DECLARE_CBUFFER( Name, FIELDS ) \
+    struct Name \
+    { \
+        enum Field { FIELDS( CBUFFER_FIELD_INDEX ) fieldCount }; \
+        static constexpr CBufferField fields[fieldCount] = { FIELDS( CBUFFER_FIELD_DESC ) }; \
+        static constexpr CBufferLayout<fieldCount> layout = packCBufferFields( fields ); \
+        static_assert( isCBufferLayoutValid( fields, layout ), #Name ": invalid constant buffer layout" ); \
+        \
+        Name() { ZeroMemory( data, sizeof(data) ); } \
+        FIELDS( CBUFFER_FIELD_ACCESSOR ) \
+        \
+        alignas(16) BYTE data[layout.size]; \
+    }; \
+    static_assert( sizeof(Name) == Name::layout.size, #Name ": struct and constant buffer sizes differ" );
+
+// "cbuffer name : register(bN) { float3 color : packoffset(c0); float strength : packoffset(c0.w); };"
+// on one line, usable as a shader macro definition (D3D_SHADER_MACRO)
+template<typename Buffer>
+std::string getCBufferDeclaration( const char* name, UINT slot )
+{
+    const char components[] = "xyzw";
+    char line[160];
+
+    sprintf_s( line, "cbuffer %s : register(b%u) {", name, slot );
+    std::string declaration = line;
+
+    for ( UINT i = 0; i < Buffer::fieldCount; i++ ) {
+        const CBufferField& field = Buffer::fields[i];
+        UINT offset = Buffer::layout.offsets[i];
+        if ( offset % CBUFFER_REGISTER_BYTES == 0 )
+            sprintf_s( line, " %s %s : packoffset(c%u);", field.hlslType, field.name, offset / CBUFFER_REGISTER_BYTES );
+        else
+            sprintf_s( line, " %s %s : packoffset(c%u.%c);", field.hlslType, field.name, offset / CBUFFER_REGISTER_BYTES,
+                       components[offset % CBUFFER_REGISTER_BYTES / 4] );
+        declaration += line;
+    }
+
+    declaration += " };";
+    return declaration;
+}
@@ -0,0 +1,61 @@
+#include "Camera.h"
+
+#include <math.h>
+
+DirectX::XMMATRIX getViewMatrix( const Camera& camera )
+{
+    DirectX::XMVECTOR eyePosition = DirectX::XMLoadFloat3( &camera.position );
+    DirectX::XMVECTOR targetPosition = DirectX::XMLoadFloat3( &camera.target );
+    DirectX::XMVECTOR camUpVector = DirectX::XMLoadFloat3( &camera.up );
+
+    return DirectX::XMMatrixLookAtLH( eyePosition, targetPosition, camUpVector );
+}
+
+DirectX::XMMATRIX getProjectionMatrix( const Camera& camera )
+{
+    return DirectX::XMMatrixPerspectiveFovLH( camera.fovY, camera.aspectRatio, camera.nearZ, camera.farZ );
+}
+
+void extractFrustum( DirectX::FXMMATRIX viewProjection, Frustum& frustum )
+{
+    // Gribb / Hartmann: row vectors, clip = p * M, so the planes are sums of the matrix columns.
+    // D3D clip space has 0 <= z <= w.
+    DirectX::XMFLOAT4X4 m;
+    DirectX::XMStoreFloat4x4( &m, viewProjection );
+
+    float column[4][4];
+    for ( int c = 0; c < 4; c++ ) {
+        for ( int r = 0; r < 4; r++ )
+            column[c][r] = m.m[r][c];
+    }
+
+    for ( int k = 0; k < 4; k++ ) {
+        ( &frustum.planes[FRUSTUM_LEFT].x )[k] = column[3][k] + column[0][k];
+        ( &frustum.planes[FRUSTUM_RIGHT].x )[k] = column[3][k] - column[0][k];
+        ( &frustum.planes[FRUSTUM_BOTTOM].x )[k] = column[3][k] + column[1][k];
+        ( &frustum.planes[FRUSTUM_TOP].x )[k] = column[3][k] - column[1][k];
+        ( &frustum.planes[FRUSTUM_NEAR].x )[k] = column[2][k];
+        ( &frustum.planes[FRUSTUM_FAR].x )[k] = column[3][k] - column[2][k];
+    }
+
+    for ( int p = 0; p < FRUSTUM_PLANE_COUNT; p++ ) {
+        DirectX::XMFLOAT4& plane = frustum.planes[p];
+        float length = sqrtf( plane.x * plane.x + plane.y * plane.y + plane.z * plane.z );
+        float invLength = ( length > 0.0f ) ? 1.0f / length : 0.0f;
+
+        plane.x *= invLength;
+        plane.y *= invLength;
+        plane.z *= invLength;
+        plane.w *= invLength;
+    }
+}
+
+bool sphereInFrustum( const Frustum& frustum, const DirectX::XMFLOAT3& center, float radius )
+{
+    for ( int p = 0; p < FRUSTUM_PLANE_COUNT; p++ ) {
+        const DirectX::XMFLOAT4& plane = frustum.planes[p];
+        if ( plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius )
+            return false;
+    }
+    return true;
+}
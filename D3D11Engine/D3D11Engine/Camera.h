@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+
+// * * * Perspective camera, left handed * * * //
+struct Camera
+{
+    DirectX::XMFLOAT3 position;
+    DirectX::XMFLOAT3 target;
+    DirectX::XMFLOAT3 up;
+
+    float fovY;             // radians
+    float aspectRatio;
+    float nearZ;
+    float farZ;
+};
+
+DirectX::XMMATRIX getViewMatrix( const Camera& camera );
+DirectX::XMMATRIX getProjectionMatrix( const Camera& camera );
+
+// * * * Frustum planes, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 * * * //
+enum FrustumPlane
+{
+    FRUSTUM_LEFT,
+    FRUSTUM_RIGHT,
+    FRUSTUM_BOTTOM,
+    FRUSTUM_TOP,
+    FRUSTUM_NEAR,
+    FRUSTUM_FAR,
+    FRUSTUM_PLANE_COUNT
+};
+
+struct Frustum
+{
+    DirectX::XMFLOAT4 planes[FRUSTUM_PLANE_COUNT];      // normalized
+};
+
+// Planes come out in the space the matrix transforms from: view * projection gives world space
+// planes, world * view * projection gives object space planes (no need to transform the bounds)
+void extractFrustum( DirectX::FXMMATRIX viewProjection, Frustum& frustum );
+
+bool sphereInFrustum( const Frustum& frustum, const DirectX::XMFLOAT3& center, float radius );
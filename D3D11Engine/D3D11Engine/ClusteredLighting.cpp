@@ -0,0 +1,447 @@
+#include "ClusteredLighting.h"
+
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+#include "JobSystem.h"
+#include "SimdLanes.h"
+#include "Timer.h"
+
+const UINT lightsPerBatch = 1024;   // view space transform, lights per job batch
+const UINT minIndexCapacity = 4096;
+const UINT tilesPerSlice = ClusteredLighting::tilesX * ClusteredLighting::tilesY;
+
+static_assert( ClusteredLighting::tilesX % simdMaxWidth == 0, "cluster rows are tested in whole SIMD batches" );
+static_assert( ClusteredLighting::slices <= 255, "light slice ranges are stored in bytes" );
+
+// * * * * * GPU BUFFERS * * * * * //
+static bool createStructuredBuffer( ID3D11Device* pDevice, UINT stride, UINT count, ID3D11Buffer** ppBuffer, ID3D11ShaderResourceView** ppSRV )
+{
+    D3D11_BUFFER_DESC bufferDesc;
+    ZeroMemory( &bufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+                bufferDesc.ByteWidth = stride * count;
+                bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+                bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+                bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+                bufferDesc.StructureByteStride = stride;
+
+    HRESULT hr = pDevice->CreateBuffer( &bufferDesc, NULL, ppBuffer );
+    if ( FAILED(hr) )
+        return false;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    ZeroMemory( &srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC) );
+
+                srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+                srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+                srvDesc.Buffer.FirstElement = 0;
+                srvDesc.Buffer.NumElements = count;
+
+    hr = pDevice->CreateShaderResourceView( *ppBuffer, &srvDesc, ppSRV );
+    if ( FAILED(hr) ) {
+        ( *ppBuffer )->Release();
+        *ppBuffer = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+// Map( WRITE_DISCARD ) + copy
+static bool writeBuffer( ID3D11DeviceContext* pDeviceContext, ID3D11Buffer* pBuffer, const void* pData, size_t bytes )
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = pDeviceContext->Map( pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
+    if ( FAILED(hr) )
+        return false;
+
+    if ( bytes > 0 )
+        memcpy( mapped.pData, pData, bytes );
+    pDeviceContext->Unmap( pBuffer, 0 );
+    return true;
+}
+
+// * * * * * CLUSTERED LIGHTING * * * * * //
+ClusteredLighting::ClusteredLighting()
+    : boundsFovY( 0.0f ), boundsAspectRatio( 0.0f ), boundsNearZ( 0.0f ), boundsFarZ( 0.0f ), sliceScale( 0.0f ), sliceBias( 0.0f ),
+      viewDepth( 0.0f, 0.0f, 1.0f, 0.0f ),
+      pDevice( NULL ), pLightBuffer( NULL ), pClusterBuffer( NULL ), pIndexBuffer( NULL ), pCBuffer( NULL ),
+      pLightSRV( NULL ), pClusterSRV( NULL ), pIndexSRV( NULL ), maxLights( 0 ), indexCapacity( 0 )
+{
+    ZeroMemory( &stats, sizeof(ClusterStats) );
+
+    clusterCounts.resize( clusterCount, 0 );
+    clusterOffsets.resize( clusterCount, 0 );
+}
+
+bool ClusteredLighting::init( ID3D11Device* pDevice, UINT maxLights )
+{
+    this->pDevice = pDevice;
+    this->maxLights = maxLights;
+
+    // A light is in a few clusters on average, the index buffer starts at 8 entries per light
+    if ( !createStructuredBuffer( pDevice, sizeof(PointLight), std::max( maxLights, 1u ), &pLightBuffer, &pLightSRV ) ||
+         !createStructuredBuffer( pDevice, sizeof(UINT) * 2, clusterCount, &pClusterBuffer, &pClusterSRV ) ||
+         !createIndexBuffer( std::max( maxLights * 8, minIndexCapacity ) ) ) {
+        release();
+        return false;
+    }
+
+    D3D11_BUFFER_DESC cBufferDesc;
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = sizeof( cBufferClusters );
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                cBufferDesc.CPUAccessFlags = 0;
+                cBufferDesc.MiscFlags = 0;
+
+    HRESULT hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pCBuffer );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    return true;
+}
+
+void ClusteredLighting::release()
+{
+    if ( pIndexSRV ) pIndexSRV->Release();
+    if ( pClusterSRV ) pClusterSRV->Release();
+    if ( pLightSRV ) pLightSRV->Release();
+    if ( pCBuffer ) pCBuffer->Release();
+    if ( pIndexBuffer ) pIndexBuffer->Release();
+    if ( pClusterBuffer ) pClusterBuffer->Release();
+    if ( pLightBuffer ) pLightBuffer->Release();
+
+    pIndexSRV = NULL; pClusterSRV = NULL; pLightSRV = NULL;
+    pCBuffer = NULL; pIndexBuffer = NULL; pClusterBuffer = NULL; pLightBuffer = NULL;
+    indexCapacity = 0;
+}
+
+bool ClusteredLighting::createIndexBuffer( UINT capacity )
+{
+    if ( pIndexSRV ) pIndexSRV->Release();
+    if ( pIndexBuffer ) pIndexBuffer->Release();
+    pIndexSRV = NULL; pIndexBuffer = NULL;
+    indexCapacity = 0;
+
+    if ( !createStructuredBuffer( pDevice, sizeof(UINT), capacity, &pIndexBuffer, &pIndexSRV ) )
+        return false;
+
+    indexCapacity = capacity;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+// View space boxes of the clusters, rebuilt only when the projection changes. A cluster is a piece of
+// the frustum, its box spans the tile's corners at both slice depths.
+void ClusteredLighting::buildClusterBounds( const Camera& camera )
+{
+    boundsFovY = camera.fovY;
+    boundsAspectRatio = camera.aspectRatio;
+    boundsNearZ = camera.nearZ;
+    boundsFarZ = camera.farZ;
+
+    float tanY = tanf( camera.fovY * 0.5f );
+    float tanX = tanY * camera.aspectRatio;
+    float depthRatio = logf( camera.farZ / camera.nearZ );
+
+    sliceScale = slices / depthRatio;
+    sliceBias = -(float)slices * logf( camera.nearZ ) / depthRatio;
+
+    sliceDepths.resize( slices + 1 );
+    for ( UINT s = 0; s <= slices; s++ )
+        sliceDepths[s] = camera.nearZ * expf( depthRatio * s / slices );
+    sliceDepths[slices] = camera.farZ;
+
+    std::vector<float>* arrays[] = { &clusterMinX, &clusterMinY, &clusterMinZ, &clusterMaxX, &clusterMaxY, &clusterMaxZ };
+    for ( UINT a = 0; a < ARRAYSIZE(arrays); a++ )
+        arrays[a]->resize( clusterCount );
+
+    for ( UINT s = 0; s < slices; s++ ) {
+        float zNear = sliceDepths[s], zFar = sliceDepths[s + 1];
+
+        for ( UINT y = 0; y < tilesY; y++ ) {
+            // Row 0 is the top of the screen
+            float top = ( 1.0f - 2.0f * y / tilesY ) * tanY;
+            float bottom = ( 1.0f - 2.0f * ( y + 1 ) / tilesY ) * tanY;
+
+            for ( UINT x = 0; x < tilesX; x++ ) {
+                float left = ( -1.0f + 2.0f * x / tilesX ) * tanX;
+                float right = ( -1.0f + 2.0f * ( x + 1 ) / tilesX ) * tanX;
+
+                UINT cluster = ( s * tilesY + y ) * tilesX + x;
+                clusterMinX[cluster] = std::min( left * zNear, left * zFar );
+                clusterMaxX[cluster] = std::max( right * zNear, right * zFar );
+                clusterMinY[cluster] = std::min( bottom * zNear, bottom * zFar );
+                clusterMaxY[cluster] = std::max( top * zNear, top * zFar );
+                clusterMinZ[cluster] = zNear;
+                clusterMaxZ[cluster] = zFar;
+            }
+        }
+    }
+}
+
+// Sphere vs box: squared distance from the center to the box, per axis the one side it can be outside of
+template<typename Lanes>
+static UINT testClusters( const float* const* ppBounds, UINT first, typename Lanes::Reg cx, typename Lanes::Reg cy,
+                          typename Lanes::Reg cz, typename Lanes::Reg radiusSq )
+{
+    typedef typename Lanes::Reg Reg;
+    Reg zero = Lanes::set( 0.0f );
+
+    Reg dx = Lanes::max( Lanes::max( Lanes::sub( Lanes::load( ppBounds[0] + first ), cx ), Lanes::sub( cx, Lanes::load( ppBounds[3] + first ) ) ), zero );
+    Reg dy = Lanes::max( Lanes::max( Lanes::sub( Lanes::load( ppBounds[1] + first ), cy ), Lanes::sub( cy, Lanes::load( ppBounds[4] + first ) ) ), zero );
+    Reg dz = Lanes::max( Lanes::max( Lanes::sub( Lanes::load( ppBounds[2] + first ), cz ), Lanes::sub( cz, Lanes::load( ppBounds[5] + first ) ) ), zero );
+    Reg distanceSq = Lanes::add( Lanes::add( Lanes::mul( dx, dx ), Lanes::mul( dy, dy ) ), Lanes::mul( dz, dz ) );
+
+    return Lanes::maskBits( Lanes::greaterEqual( radiusSq, distanceSq ) );
+}
+
+// Every cluster of one slice, written only by this slice's job
+void ClusteredLighting::assignSlice( UINT slice )
+{
+    typedef SimdLanes::Reg Reg;
+    const float* ppBounds[] = { clusterMinX.data(), clusterMinY.data(), clusterMinZ.data(), clusterMaxX.data(), clusterMaxY.data(), clusterMaxZ.data() };
+
+    UINT* pCounts = clusterCounts.data() + slice * tilesPerSlice;
+    memset( pCounts, 0, tilesPerSlice * sizeof(UINT) );
+
+    std::vector<ClusterEntry>& entries = sliceEntries[slice];
+    entries.clear();
+
+    const std::vector<UINT>& lights = sliceLights[slice];
+    for ( size_t l = 0; l < lights.size(); l++ ) {
+        UINT light = lights[l];
+        float x = lightX[light], y = lightY[light], z = lightZ[light];
+        float radiusSq = lightRadius[light] * lightRadius[light];
+
+        Reg cx = SimdLanes::set( x ), cy = SimdLanes::set( y ), cz = SimdLanes::set( z ), r2 = SimdLanes::set( radiusSq );
+
+        for ( UINT row = 0; row < tilesY; row++ ) {
+            UINT first = ( slice * tilesY + row ) * tilesX;
+
+            // The clusters of a row share their y range, most rows are rejected here
+            float dy = std::max( std::max( clusterMinY[first] - y, y - clusterMaxY[first] ), 0.0f );
+            if ( dy * dy > radiusSq )
+                continue;
+
+            for ( UINT tile = 0; tile < tilesX; tile += SimdLanes::width ) {
+                UINT bits = testClusters<SimdLanes>( ppBounds, first + tile, cx, cy, cz, r2 );
+
+                for ( UINT lane = 0; bits != 0; lane++, bits >>= 1 ) {
+                    if ( !( bits & 1 ) )
+                        continue;
+
+                    ClusterEntry entry = { row * tilesX + tile + lane, light };
+                    entries.push_back( entry );
+                    pCounts[entry.tile]++;
+                }
+            }
+        }
+    }
+}
+
+// Counting sort of the slice's entries into lightIndices, the offsets are set
+void ClusteredLighting::packSlice( UINT slice )
+{
+    UINT cursors[tilesPerSlice];
+    memcpy( cursors, clusterOffsets.data() + slice * tilesPerSlice, sizeof(cursors) );
+
+    const std::vector<ClusterEntry>& entries = sliceEntries[slice];
+    for ( size_t e = 0; e < entries.size(); e++ )
+        lightIndices[cursors[entries[e].tile]++] = entries[e].light;
+}
+
+void ClusteredLighting::assignLights( const PointLight* pLights, UINT lightCount, DirectX::FXMMATRIX view, const Camera& camera, JobSystem* pJobSystem )
+{
+    Timer timer;
+
+    if ( camera.fovY != boundsFovY || camera.aspectRatio != boundsAspectRatio || camera.nearZ != boundsNearZ || camera.farZ != boundsFarZ )
+        buildClusterBounds( camera );
+
+    DirectX::XMFLOAT4X4 viewMatrix;
+    DirectX::XMStoreFloat4x4( &viewMatrix, view );
+    viewDepth = DirectX::XMFLOAT4( viewMatrix._13, viewMatrix._23, viewMatrix._33, viewMatrix._43 );
+
+    // - - - lights into view space, slice range from the z extent of the sphere - - - //
+    std::vector<float>* arrays[] = { &lightX, &lightY, &lightZ, &lightRadius };
+    for ( UINT a = 0; a < ARRAYSIZE(arrays); a++ )
+        arrays[a]->resize( lightCount );
+    lightFirstSlice.resize( lightCount );
+    lightLastSlice.resize( lightCount );
+
+    auto transformLights = [&]( UINT begin, UINT end ) {
+        DirectX::XMMATRIX viewSpace = DirectX::XMLoadFloat4x4( &viewMatrix );
+
+        for ( UINT i = begin; i < end; i++ ) {
+            DirectX::XMFLOAT3 center;
+            DirectX::XMStoreFloat3( &center, DirectX::XMVector3Transform( DirectX::XMLoadFloat3( &pLights[i].position ), viewSpace ) );
+            float radius = pLights[i].radius;
+
+            lightX[i] = center.x;
+            lightY[i] = center.y;
+            lightZ[i] = center.z;
+            lightRadius[i] = radius;
+
+            float zMin = center.z - radius, zMax = center.z + radius;
+            if ( zMax < boundsNearZ || zMin > boundsFarZ || radius <= 0.0f ) {
+                lightFirstSlice[i] = 1;
+                lightLastSlice[i] = 0;
+                continue;
+            }
+
+            float firstSlice = logf( std::max( zMin, boundsNearZ ) ) * sliceScale + sliceBias;
+            float lastSlice = logf( std::min( zMax, boundsFarZ ) ) * sliceScale + sliceBias;
+            lightFirstSlice[i] = (BYTE)std::min( std::max( (int)firstSlice, 0 ), (int)slices - 1 );
+            lightLastSlice[i] = (BYTE)std::min( std::max( (int)lastSlice, 0 ), (int)slices - 1 );
+        }
+    };
+
+    if ( pJobSystem )
+        pJobSystem->parallelFor( lightCount, lightsPerBatch, transformLights );
+    else
+        transformLights( 0, lightCount );
+
+    // - - - bin by slice - - - //
+    UINT visibleLights = 0;
+    for ( UINT s = 0; s < slices; s++ )
+        sliceLights[s].clear();
+
+    for ( UINT i = 0; i < lightCount; i++ ) {
+        if ( lightFirstSlice[i] > lightLastSlice[i] )
+            continue;
+
+        visibleLights++;
+        for ( UINT s = lightFirstSlice[i]; s <= lightLastSlice[i]; s++ )
+            sliceLights[s].push_back( i );
+    }
+
+    // - - - clusters of every slice, in parallel - - - //
+    if ( pJobSystem ) {
+        pJobSystem->parallelFor( slices, 1, [&]( UINT begin, UINT end ) {
+            for ( UINT s = begin; s < end; s++ )
+                assignSlice( s );
+        } );
+    }
+    else {
+        for ( UINT s = 0; s < slices; s++ )
+            assignSlice( s );
+    }
+
+    // - - - pack the lists - - - //
+    UINT offset = 0, maxClusterLights = 0;
+    for ( UINT c = 0; c < clusterCount; c++ ) {
+        clusterOffsets[c] = offset;
+        offset += clusterCounts[c];
+        maxClusterLights = std::max( maxClusterLights, clusterCounts[c] );
+    }
+
+    lightIndices.resize( offset );
+    if ( pJobSystem ) {
+        pJobSystem->parallelFor( slices, 1, [&]( UINT begin, UINT end ) {
+            for ( UINT s = begin; s < end; s++ )
+                packSlice( s );
+        } );
+    }
+    else {
+        for ( UINT s = 0; s < slices; s++ )
+            packSlice( s );
+    }
+
+    stats.lightCount = lightCount;
+    stats.visibleLights = visibleLights;
+    stats.lightIndices = offset;
+    stats.maxClusterLights = maxClusterLights;
+    stats.assignMs = timer.elapsedMs();
+}
+
+UINT ClusteredLighting::getClusterIndex( float screenX, float screenY, float viewDepth ) const
+{
+    int x = std::min( std::max( (int)( screenX * tilesX ), 0 ), (int)tilesX - 1 );
+    int y = std::min( std::max( (int)( screenY * tilesY ), 0 ), (int)tilesY - 1 );
+    int slice = std::min( std::max( (int)( logf( std::max( viewDepth, boundsNearZ ) ) * sliceScale + sliceBias ), 0 ), (int)slices - 1 );
+
+    return ( slice * tilesY + y ) * tilesX + x;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+bool ClusteredLighting::upload( ID3D11DeviceContext* pDeviceContext, const PointLight* pLights, UINT width, UINT height )
+{
+    if ( !pCBuffer )
+        return false;
+
+    if ( stats.lightCount > maxLights ) {
+        char message[128];
+        sprintf_s( message, "[ClusteredLighting] %u lights, buffers hold %u\n", stats.lightCount, maxLights );
+        OutputDebugStringA( message );
+        return false;
+    }
+
+    // (offset, count) pairs, what the shader reads per pixel
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = pDeviceContext->Map( pClusterBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
+    if ( FAILED(hr) )
+        return false;
+
+    UINT* pRanges = (UINT*)mapped.pData;
+    for ( UINT c = 0; c < clusterCount; c++ ) {
+        pRanges[c * 2 + 0] = clusterOffsets[c];
+        pRanges[c * 2 + 1] = clusterCounts[c];
+    }
+    pDeviceContext->Unmap( pClusterBuffer, 0 );
+
+    if ( lightIndices.size() > indexCapacity && !createIndexBuffer( std::max( (UINT)lightIndices.size(), indexCapacity * 2 ) ) )
+        return false;
+
+    if ( !writeBuffer( pDeviceContext, pLightBuffer, pLights, stats.lightCount * sizeof(PointLight) ) ||
+         !writeBuffer( pDeviceContext, pIndexBuffer, lightIndices.data(), lightIndices.size() * sizeof(UINT) ) )
+        return false;
+
+    cBufferClusters constants;
+    constants.viewDepth() = viewDepth;
+    constants.tileScale() = DirectX::XMFLOAT2( (float)tilesX / width, (float)tilesY / height );
+    constants.sliceScale() = sliceScale;
+    constants.sliceBias() = sliceBias;
+    constants.clusterCounts() = DirectX::XMUINT3( tilesX, tilesY, slices );
+
+    pDeviceContext->UpdateSubresource( pCBuffer, 0, NULL, &constants, 0, 0 );
+    return true;
+}
+
+void ClusteredLighting::bind( ID3D11DeviceContext* pDeviceContext )
+{
+    ID3D11ShaderResourceView* pSRVs[] = { pLightSRV, pClusterSRV, pIndexSRV };
+    pDeviceContext->PSSetShaderResources( 1, ARRAYSIZE(pSRVs), pSRVs );
+    pDeviceContext->PSSetConstantBuffers( 2, 1, &pCBuffer );
+}
+
+// * * * * * PROCEDURAL * * * * * //
+void createRandomLights( UINT count, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents,
+                         float minRadius, float maxRadius, UINT seed, std::vector<PointLight>& lights )
+{
+    UINT state = seed;
+    auto random = [&]() {
+        state = state * 1664525u + 1013904223u;
+        return (float)( state >> 8 ) / 16777216.0f;
+    };
+
+    lights.resize( count );
+    for ( UINT i = 0; i < count; i++ ) {
+        PointLight& light = lights[i];
+        light.position = DirectX::XMFLOAT3( center.x + ( random() * 2.0f - 1.0f ) * extents.x,
+                                            center.y + ( random() * 2.0f - 1.0f ) * extents.y,
+                                            center.z + ( random() * 2.0f - 1.0f ) * extents.z );
+        light.radius = minRadius + random() * ( maxRadius - minRadius );
+        light.color = DirectX::XMFLOAT3( 0.3f + 0.7f * random(), 0.3f + 0.7f * random(), 0.3f + 0.7f * random() );
+        light.intensity = 1.0f;
+    }
+}
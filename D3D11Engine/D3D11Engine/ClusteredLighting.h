@@ -0,0 +1,131 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Camera.h"
+#include "CBufferLayout.h"
+
+class JobSystem;
+
+// * * * Point light, same layout as PointLight in pixelShader.hlsl * * * //
+// Falloff reaches zero at radius, so a light only has to be in the clusters its sphere touches
+struct PointLight
+{
+    DirectX::XMFLOAT3 position;     // world space
+    float radius;
+    DirectX::XMFLOAT3 color;
+    float intensity;
+};
+
+// Grid constants for the pixel shader (b2), main.cpp declares them to the shader
+#define CLUSTER_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMFLOAT4, viewDepth )           /* view space z = dot( float4( world, 1 ), viewDepth ) */ \
+    FIELD( DirectX::XMFLOAT2, tileScale )           /* pixel -> tile */ \
+    FIELD( float, sliceScale )                      /* slice = log( z ) * sliceScale + sliceBias */ \
+    FIELD( float, sliceBias ) \
+    FIELD( DirectX::XMUINT3, clusterCounts )        /* tiles x, tiles y, slices */
+DECLARE_CBUFFER( cBufferClusters, CLUSTER_CBUFFER_FIELDS )
+
+// Per frame counters, reset by assignLights
+struct ClusterStats
+{
+    UINT lightCount;
+    UINT visibleLights;             // touch at least one slice of the frustum
+    UINT lightIndices;              // sum of all cluster light counts
+    UINT maxClusterLights;
+    double assignMs;
+};
+
+// * * * Clustered forward lighting * * * //
+// The view frustum is split into tiles on screen and exponential slices in depth. Every frame the
+// lights go to view space, each depth slice collects the lights whose z range reaches it, and then
+// the slices (in parallel) test their lights against the view space boxes of their clusters, 8 or
+// 4 clusters of a row per SIMD test. The hits are counting sorted into one index array, grouped by
+// cluster, so a cluster's list has no size limit. The
+// pixel shader finds its cluster from the pixel position and view depth and only loops over that
+// cluster's lights: t1 = lights, t2 = cluster (offset, count), t3 = light indices, b2 = grid constants.
+class ClusteredLighting
+{
+public:
+    static const UINT tilesX = 16;
+    static const UINT tilesY = 9;
+    static const UINT slices = 24;
+    static const UINT clusterCount = tilesX * tilesY * slices;
+
+    ClusteredLighting();
+
+    // GPU buffers for up to maxLights lights, the index buffer grows when needed. Not needed for
+    // CPU only use (assignment, benchmarks)
+    bool init( ID3D11Device* pDevice, UINT maxLights );
+    void release();
+
+    // Light lists for the camera's frustum, view = getViewMatrix( camera )
+    void assignLights( const PointLight* pLights, UINT lightCount, DirectX::FXMMATRIX view, const Camera& camera, JobSystem* pJobSystem = NULL );
+
+    // Lights, cluster lists and grid constants into the GPU buffers. pLights must be what
+    // assignLights got, fails when that was more than maxLights.
+    bool upload( ID3D11DeviceContext* pDeviceContext, const PointLight* pLights, UINT width, UINT height );
+    void bind( ID3D11DeviceContext* pDeviceContext );
+
+    // Cluster of a view space point, pixel coordinates in [0, 1) across the screen, y down
+    UINT getClusterIndex( float screenX, float screenY, float viewDepth ) const;
+
+    UINT getClusterOffset( UINT cluster ) const { return clusterOffsets[cluster]; }
+    UINT getClusterLightCount( UINT cluster ) const { return clusterCounts[cluster]; }
+    const UINT* getLightIndices() const { return lightIndices.data(); }
+
+    const ClusterStats& getStats() const { return stats; }
+
+private:
+    // Light in a cluster of a slice, before the counting sort
+    struct ClusterEntry
+    {
+        UINT tile;                  // ( y * tilesX + x ) within the slice
+        UINT light;
+    };
+
+    void buildClusterBounds( const Camera& camera );
+    void assignSlice( UINT slice );
+    void packSlice( UINT slice );
+    bool createIndexBuffer( UINT capacity );
+
+    // - - - cluster boxes in view space, [ ( slice * tilesY + y ) * tilesX + x ] - - - //
+    std::vector<float> clusterMinX, clusterMinY, clusterMinZ;
+    std::vector<float> clusterMaxX, clusterMaxY, clusterMaxZ;
+    std::vector<float> sliceDepths;                 // slices + 1 boundaries, near .. far
+    float boundsFovY, boundsAspectRatio, boundsNearZ, boundsFarZ;
+    float sliceScale, sliceBias;
+
+    // - - - this frame's lights in view space, structure of arrays - - - //
+    std::vector<float> lightX, lightY, lightZ, lightRadius;
+    std::vector<BYTE> lightFirstSlice, lightLastSlice;
+    std::vector<UINT> sliceLights[slices];
+    DirectX::XMFLOAT4 viewDepth;
+
+    // - - - results - - - //
+    std::vector<ClusterEntry> sliceEntries[slices];
+    std::vector<UINT> clusterCounts;
+    std::vector<UINT> clusterOffsets;
+    std::vector<UINT> lightIndices;
+    ClusterStats stats;
+
+    // - - - GPU - - - //
+    ID3D11Device* pDevice;
+    ID3D11Buffer* pLightBuffer, * pClusterBuffer, * pIndexBuffer, * pCBuffer;
+    ID3D11ShaderResourceView* pLightSRV, * pClusterSRV, * pIndexSRV;
+    UINT maxLights;
+    UINT indexCapacity;
+};
+
+// * * * Procedural lights (tests / benchmarks) * * * //
+// count lights spread over a box around center, radius in [minRadius, maxRadius], random colors
+void createRandomLights( UINT count, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents,
+                         float minRadius, float maxRadius, UINT seed, std::vector<PointLight>& lights );
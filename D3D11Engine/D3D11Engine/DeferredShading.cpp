@@ -0,0 +1,372 @@
+#include "DeferredShading.h"
+
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <algorithm>
+
+#include "SceneShaders.h"
+
+// * * * * * G-BUFFER TARGETS * * * * * //
+static bool createGBufferTarget( ID3D11Device* pDevice, UINT width, UINT height, DXGI_FORMAT format,
+                                 ID3D11Texture2D** ppTexture, ID3D11RenderTargetView** ppRTV, ID3D11ShaderResourceView** ppSRV )
+{
+    D3D11_TEXTURE2D_DESC textureDesc;
+    ZeroMemory( &textureDesc, sizeof(D3D11_TEXTURE2D_DESC) );
+
+                textureDesc.Width = width;
+                textureDesc.Height = height;
+                textureDesc.MipLevels = 1;
+                textureDesc.ArraySize = 1;
+                textureDesc.Format = format;
+                textureDesc.SampleDesc.Count = 1;
+                textureDesc.SampleDesc.Quality = 0;
+                textureDesc.Usage = D3D11_USAGE_DEFAULT;
+                textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+                textureDesc.CPUAccessFlags = 0;
+                textureDesc.MiscFlags = 0;
+
+    if ( FAILED( pDevice->CreateTexture2D( &textureDesc, NULL, ppTexture ) ) )
+        return false;
+
+    return SUCCEEDED( pDevice->CreateRenderTargetView( *ppTexture, NULL, ppRTV ) ) &&
+           SUCCEEDED( pDevice->CreateShaderResourceView( *ppTexture, NULL, ppSRV ) );
+}
+
+// * * * * * DEFERRED SHADING * * * * * //
+DeferredShading::DeferredShading()
+    : pAlbedoTexture( NULL ), pNormalTexture( NULL ), pDepthTexture( NULL ), pAlbedoRTV( NULL ), pNormalRTV( NULL ),
+      pAlbedoSRV( NULL ), pNormalSRV( NULL ), pDepthSRV( NULL ), pDepthDSV( NULL ), width( 0 ), height( 0 ),
+      pLightBuffer( NULL ), pCBuffer( NULL ), pLightSRV( NULL ), pVertexShader( NULL ), pPixelShader( NULL ),
+      pBlendState( NULL ), pDepthStencilState( NULL ), pRasterizerState( NULL ), maxLights( 0 )
+{
+    ZeroMemory( &stats, sizeof(DeferredStats) );
+}
+
+bool DeferredShading::init( ID3D11Device* pDevice, UINT width, UINT height, UINT maxLights )
+{
+    this->width = width;
+    this->height = height;
+    this->maxLights = maxLights;
+
+    // * * * * * G-BUFFER * * * * * //
+    if ( !createGBufferTarget( pDevice, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, &pAlbedoTexture, &pAlbedoRTV, &pAlbedoSRV ) ||
+         !createGBufferTarget( pDevice, width, height, DXGI_FORMAT_R10G10B10A2_UNORM, &pNormalTexture, &pNormalRTV, &pNormalSRV ) ) {
+        release();
+        return false;
+    }
+
+    // Typeless so the light pass can read the 24 depth bits
+    D3D11_TEXTURE2D_DESC depthDesc;
+    ZeroMemory( &depthDesc, sizeof(D3D11_TEXTURE2D_DESC) );
+
+                depthDesc.Width = width;
+                depthDesc.Height = height;
+                depthDesc.MipLevels = 1;
+                depthDesc.ArraySize = 1;
+                depthDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
+                depthDesc.SampleDesc.Count = 1;
+                depthDesc.SampleDesc.Quality = 0;
+                depthDesc.Usage = D3D11_USAGE_DEFAULT;
+                depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+                depthDesc.CPUAccessFlags = 0;
+                depthDesc.MiscFlags = 0;
+
+    HRESULT hr = pDevice->CreateTexture2D( &depthDesc, NULL, &pDepthTexture );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+    ZeroMemory( &dsvDesc, sizeof(D3D11_DEPTH_STENCIL_VIEW_DESC) );
+
+                dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+                dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+                dsvDesc.Texture2D.MipSlice = 0;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    ZeroMemory( &srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC) );
+
+                srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+                srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+                srvDesc.Texture2D.MostDetailedMip = 0;
+                srvDesc.Texture2D.MipLevels = 1;
+
+    if ( FAILED( pDevice->CreateDepthStencilView( pDepthTexture, &dsvDesc, &pDepthDSV ) ) ||
+         FAILED( pDevice->CreateShaderResourceView( pDepthTexture, &srvDesc, &pDepthSRV ) ) ) {
+        release();
+        return false;
+    }
+
+    // * * * * * LIGHT BUFFERS * * * * * //
+    D3D11_BUFFER_DESC lightBufferDesc;
+    ZeroMemory( &lightBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                lightBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+                lightBufferDesc.ByteWidth = sizeof(DeferredLight) * std::max( maxLights, 1u );
+                lightBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+                lightBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+                lightBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+                lightBufferDesc.StructureByteStride = sizeof(DeferredLight);
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC lightSrvDesc;
+    ZeroMemory( &lightSrvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC) );
+
+                lightSrvDesc.Format = DXGI_FORMAT_UNKNOWN;
+                lightSrvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+                lightSrvDesc.Buffer.FirstElement = 0;
+                lightSrvDesc.Buffer.NumElements = std::max( maxLights, 1u );
+
+    if ( FAILED( pDevice->CreateBuffer( &lightBufferDesc, NULL, &pLightBuffer ) ) ||
+         FAILED( pDevice->CreateShaderResourceView( pLightBuffer, &lightSrvDesc, &pLightSRV ) ) ) {
+        release();
+        return false;
+    }
+
+    D3D11_BUFFER_DESC cBufferDesc;
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = sizeof( cBufferDeferred );
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                cBufferDesc.CPUAccessFlags = 0;
+                cBufferDesc.MiscFlags = 0;
+
+    hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pCBuffer );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    // * * * * * LIGHT PASS SHADERS * * * * * //
+    std::string deferredDeclaration = getCBufferDeclaration<cBufferDeferred>( "cBufferDeferred", 0 );
+    D3D_SHADER_MACRO defines[] = {
+        { "CBUFFER_DEFERRED", deferredDeclaration.c_str() },
+        { NULL, NULL },
+    };
+
+    ID3DBlob* pVertexShaderBlob = compileShader( L"deferredLights.hlsl", defines, "vs_main", "vs_5_0" );
+    ID3DBlob* pPixelShaderBlob = compileShader( L"deferredLights.hlsl", defines, "ps_main", "ps_5_0" );
+    if ( !pVertexShaderBlob || !pPixelShaderBlob ) {
+        if ( pVertexShaderBlob ) pVertexShaderBlob->Release();
+        if ( pPixelShaderBlob ) pPixelShaderBlob->Release();
+        release();
+        return false;
+    }
+
+    hr = pDevice->CreateVertexShader( pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), NULL, &pVertexShader );
+    assert( SUCCEEDED(hr) );
+
+    hr = pDevice->CreatePixelShader( pPixelShaderBlob->GetBufferPointer(), pPixelShaderBlob->GetBufferSize(), NULL, &pPixelShader );
+    assert( SUCCEEDED(hr) );
+
+    pVertexShaderBlob->Release();
+    pPixelShaderBlob->Release();
+
+    // * * * * * STATES * * * * * //
+    // Lights add up in the color target
+    D3D11_BLEND_DESC blendDesc;
+    ZeroMemory( &blendDesc, sizeof( D3D11_BLEND_DESC ) );
+
+                blendDesc.RenderTarget[0].BlendEnable = TRUE;
+                blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+                blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+                blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+                blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+                blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+                blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+                blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+
+    hr = pDevice->CreateBlendState( &blendDesc, &pBlendState );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    // The depth range test is in the pixel shader, the depth buffer is a shader input
+    D3D11_DEPTH_STENCIL_DESC depthStencilDesc;
+    ZeroMemory( &depthStencilDesc, sizeof( D3D11_DEPTH_STENCIL_DESC ) );
+
+                depthStencilDesc.DepthEnable = FALSE;
+                depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+                depthStencilDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+
+    hr = pDevice->CreateDepthStencilState( &depthStencilDesc, &pDepthStencilState );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    D3D11_RASTERIZER_DESC rasterizerStateDesc;
+    ZeroMemory( &rasterizerStateDesc, sizeof( D3D11_RASTERIZER_DESC ) );
+
+                rasterizerStateDesc.FillMode = D3D11_FILL_SOLID;
+                rasterizerStateDesc.CullMode = D3D11_CULL_NONE;
+                rasterizerStateDesc.DepthClipEnable = FALSE;
+
+    hr = pDevice->CreateRasterizerState( &rasterizerStateDesc, &pRasterizerState );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    return true;
+}
+
+void DeferredShading::release()
+{
+    if ( pAlbedoSRV ) pAlbedoSRV->Release();
+    if ( pNormalSRV ) pNormalSRV->Release();
+    if ( pDepthSRV ) pDepthSRV->Release();
+    if ( pAlbedoRTV ) pAlbedoRTV->Release();
+    if ( pNormalRTV ) pNormalRTV->Release();
+    if ( pDepthDSV ) pDepthDSV->Release();
+    if ( pAlbedoTexture ) pAlbedoTexture->Release();
+    if ( pNormalTexture ) pNormalTexture->Release();
+    if ( pDepthTexture ) pDepthTexture->Release();
+    if ( pLightSRV ) pLightSRV->Release();
+    if ( pLightBuffer ) pLightBuffer->Release();
+    if ( pCBuffer ) pCBuffer->Release();
+    if ( pVertexShader ) pVertexShader->Release();
+    if ( pPixelShader ) pPixelShader->Release();
+    if ( pBlendState ) pBlendState->Release();
+    if ( pDepthStencilState ) pDepthStencilState->Release();
+    if ( pRasterizerState ) pRasterizerState->Release();
+
+    pAlbedoSRV = NULL; pNormalSRV = NULL; pDepthSRV = NULL;
+    pAlbedoRTV = NULL; pNormalRTV = NULL; pDepthDSV = NULL;
+    pAlbedoTexture = NULL; pNormalTexture = NULL; pDepthTexture = NULL;
+    pLightSRV = NULL; pLightBuffer = NULL; pCBuffer = NULL;
+    pVertexShader = NULL; pPixelShader = NULL;
+    pBlendState = NULL; pDepthStencilState = NULL; pRasterizerState = NULL;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void DeferredShading::beginGeometry( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pColorTarget, const float clearColor[4] )
+{
+    const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    pDeviceContext->ClearRenderTargetView( pColorTarget, clearColor );
+    pDeviceContext->ClearRenderTargetView( pAlbedoRTV, zero );
+    pDeviceContext->ClearRenderTargetView( pNormalRTV, zero );
+    pDeviceContext->ClearDepthStencilView( pDepthDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0 );
+
+    ID3D11RenderTargetView* pTargets[] = { pColorTarget, pAlbedoRTV, pNormalRTV };
+    pDeviceContext->OMSetRenderTargets( ARRAYSIZE(pTargets), pTargets, pDepthDSV );
+}
+
+bool DeferredShading::getLightBounds( const PointLight& light, DirectX::FXMMATRIX view, const Camera& camera, DeferredLight& bounds ) const
+{
+    DirectX::XMFLOAT3 center;
+    DirectX::XMStoreFloat3( &center, DirectX::XMVector3TransformCoord( DirectX::XMLoadFloat3( &light.position ), view ) );
+
+    float r = light.radius;
+    if ( center.z - r > camera.farZ || center.z + r < camera.nearZ )
+        return false;
+
+    bounds.position = light.position;
+    bounds.radius = r;
+    bounds.color = DirectX::XMFLOAT3( light.color.x * light.intensity, light.color.y * light.intensity, light.color.z * light.intensity );
+    bounds.minDepth = std::max( center.z - r, camera.nearZ );
+    bounds.maxDepth = std::min( center.z + r, camera.farZ );
+    bounds.pad[0] = bounds.pad[1] = bounds.pad[2] = 0.0f;
+
+    // Reaches behind the near plane: the projection of the sphere is unbounded, cover the screen
+    if ( center.z - r <= camera.nearZ ) {
+        bounds.rect = DirectX::XMFLOAT4( -1.0f, -1.0f, 1.0f, 1.0f );
+        return true;
+    }
+
+    // Projected view space box around the sphere, x / z and y / z are extreme at its corners
+    float scaleY = 1.0f / tanf( camera.fovY * 0.5f );
+    float scaleX = scaleY / camera.aspectRatio;
+    float nearZ = center.z - r, farZ = center.z + r;
+
+    float minX = std::min( ( center.x - r ) / nearZ, ( center.x - r ) / farZ ) * scaleX;
+    float maxX = std::max( ( center.x + r ) / nearZ, ( center.x + r ) / farZ ) * scaleX;
+    float minY = std::min( ( center.y - r ) / nearZ, ( center.y - r ) / farZ ) * scaleY;
+    float maxY = std::max( ( center.y + r ) / nearZ, ( center.y + r ) / farZ ) * scaleY;
+
+    bounds.rect = DirectX::XMFLOAT4( std::max( minX, -1.0f ), std::max( minY, -1.0f ), std::min( maxX, 1.0f ), std::min( maxY, 1.0f ) );
+    return bounds.rect.x < bounds.rect.z && bounds.rect.y < bounds.rect.w;
+}
+
+bool DeferredShading::accumulateLights( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pColorTarget,
+                                        const PointLight* pLights, UINT lightCount, const Camera& camera )
+{
+    setupTimer.reset();
+    ZeroMemory( &stats, sizeof(DeferredStats) );
+    stats.lightCount = lightCount;
+
+    if ( !pCBuffer )
+        return false;
+
+    if ( lightCount > maxLights ) {
+        char message[128];
+        sprintf_s( message, "[DeferredShading] %u lights, buffer holds %u\n", lightCount, maxLights );
+        OutputDebugStringA( message );
+        return false;
+    }
+
+    // - - - screen rects - - - //
+    DirectX::XMMATRIX view = getViewMatrix( camera );
+    drawnLights.clear();
+    for ( UINT i = 0; i < lightCount; i++ ) {
+        DeferredLight bounds;
+        if ( !getLightBounds( pLights[i], view, camera, bounds ) )
+            continue;
+
+        drawnLights.push_back( bounds );
+        stats.rectPixels += (UINT64)( ( bounds.rect.z - bounds.rect.x ) * 0.5f * width * ( bounds.rect.w - bounds.rect.y ) * 0.5f * height );
+    }
+    stats.drawnLights = (UINT)drawnLights.size();
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = pDeviceContext->Map( pLightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
+    if ( FAILED(hr) )
+        return false;
+
+    if ( !drawnLights.empty() )
+        memcpy( mapped.pData, drawnLights.data(), drawnLights.size() * sizeof(DeferredLight) );
+    pDeviceContext->Unmap( pLightBuffer, 0 );
+
+    // - - - constants - - - //
+    DirectX::XMFLOAT4X4 viewMatrix;
+    DirectX::XMStoreFloat4x4( &viewMatrix, view );
+
+    cBufferDeferred constants;
+    constants.inverseViewProjection() = DirectX::XMMatrixTranspose( DirectX::XMMatrixInverse( nullptr, view * getProjectionMatrix( camera ) ) );
+    constants.viewDepth() = DirectX::XMFLOAT4( viewMatrix._13, viewMatrix._23, viewMatrix._33, viewMatrix._43 );
+    constants.inverseScreenSize() = DirectX::XMFLOAT2( 1.0f / width, 1.0f / height );
+    pDeviceContext->UpdateSubresource( pCBuffer, 0, NULL, &constants, 0, 0 );
+
+    // - - - one quad per light, corners from SV_VertexID - - - //
+    pDeviceContext->OMSetRenderTargets( 1, &pColorTarget, NULL );
+    pDeviceContext->OMSetBlendState( pBlendState, NULL, 0xffffffff );
+    pDeviceContext->OMSetDepthStencilState( pDepthStencilState, 0 );
+    pDeviceContext->RSSetState( pRasterizerState );
+
+    pDeviceContext->IASetInputLayout( NULL );
+    pDeviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP );
+
+    ID3D11ShaderResourceView* pSRVs[] = { pLightSRV, pAlbedoSRV, pNormalSRV, pDepthSRV };
+    pDeviceContext->VSSetShader( pVertexShader, nullptr, 0 );
+    pDeviceContext->VSSetShaderResources( 0, 1, &pLightSRV );
+    pDeviceContext->PSSetShader( pPixelShader, nullptr, 0 );
+    pDeviceContext->PSSetShaderResources( 0, ARRAYSIZE(pSRVs), pSRVs );
+    pDeviceContext->PSSetConstantBuffers( 0, 1, &pCBuffer );
+
+    if ( stats.drawnLights > 0 )
+        pDeviceContext->DrawInstanced( 4, stats.drawnLights, 0, 0 );
+
+    // The G-buffer is a render target again next frame
+    ID3D11ShaderResourceView* pNullSRVs[ARRAYSIZE(pSRVs)] = { NULL };
+    pDeviceContext->VSSetShaderResources( 0, 1, pNullSRVs );
+    pDeviceContext->PSSetShaderResources( 0, ARRAYSIZE(pNullSRVs), pNullSRVs );
+    pDeviceContext->OMSetBlendState( NULL, NULL, 0xffffffff );
+
+    stats.setupMs = setupTimer.elapsedMs();
+    return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Camera.h"
+#include "ClusteredLighting.h"
+#include "CBufferLayout.h"
+#include "Timer.h"
+
+// Constants of the light pass (deferredLights.hlsl, b0)
+#define DEFERRED_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMMATRIX, inverseViewProjection )   /* NDC + depth -> world */ \
+    FIELD( DirectX::XMFLOAT4, viewDepth )               /* view space z = dot( float4( world, 1 ), viewDepth ) */ \
+    FIELD( DirectX::XMFLOAT2, inverseScreenSize )
+DECLARE_CBUFFER( cBufferDeferred, DEFERRED_CBUFFER_FIELDS )
+
+// Light as the light pass reads it, same layout as DeferredLight in deferredLights.hlsl
+struct DeferredLight
+{
+    DirectX::XMFLOAT4 rect;             // NDC min x, min y, max x, max y
+    DirectX::XMFLOAT3 position;
+    float radius;
+    DirectX::XMFLOAT3 color;            // * intensity
+    float minDepth;                     // view space z range of the light's sphere
+    float maxDepth;
+    float pad[3];
+};
+
+// Counters of the last accumulateLights
+struct DeferredStats
+{
+    UINT lightCount;
+    UINT drawnLights;                   // rect on screen and in front of the far plane
+    UINT64 rectPixels;                  // sum of the drawn rects, what the light pass shades at most
+    double setupMs;                     // CPU, rects + upload + draw
+};
+
+// * * * Deferred shading * * * //
+// The geometry pass writes surface attributes instead of lighting every light per pixel:
+//
+//     target 0    color target, what the scene shaders light themselves (ambient, lightmap, shadowed dynamic light)
+//     target 1    albedo, R8G8B8A8
+//     target 2    world normal * 0.5 + 0.5, R10G10B10A2
+//     depth       own D24S8 buffer, read back as R24 by the light pass
+//
+// The point lights are added afterwards: every light's sphere becomes a screen rectangle (a full
+// screen one when the camera is inside the sphere or the sphere reaches behind the near plane),
+// all rectangles go out as one instanced draw with additive blending. The light pass reads depth,
+// albedo and normal, rebuilds the world position and skips pixels outside the light's depth range,
+// so a light only costs the pixels its range covers, no matter how often the scene overdraws them.
+// t0 = lights, t1 = albedo, t2 = normal, t3 = depth.
+class DeferredShading
+{
+public:
+    DeferredShading();
+
+    // G-buffer of width x height, up to maxLights per accumulateLights
+    bool init( ID3D11Device* pDevice, UINT width, UINT height, UINT maxLights );
+    void release();
+
+    // Clears and binds [pColorTarget, albedo, normal] with the G-buffer depth, draw the scene with
+    // the G-buffer pixel shaders (ps_gbuffer / ps_gbuffer_lightmapped) afterwards
+    void beginGeometry( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pColorTarget, const float clearColor[4] );
+
+    // Adds the lights to pColorTarget. Changes input layout, shaders, blend / depth / rasterizer
+    // state; blend state is back to default afterwards and the G-buffer is unbound
+    bool accumulateLights( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pColorTarget,
+                           const PointLight* pLights, UINT lightCount, const Camera& camera );
+
+    ID3D11DepthStencilView* getDepthStencilView() const { return pDepthDSV; }
+    const DeferredStats& getStats() const { return stats; }
+
+private:
+    // Screen rect + depth range of a light, false when nothing of it can be on screen
+    bool getLightBounds( const PointLight& light, DirectX::FXMMATRIX view, const Camera& camera, DeferredLight& bounds ) const;
+
+    std::vector<DeferredLight> drawnLights;
+    DeferredStats stats;
+    Timer setupTimer;
+
+    // - - - G-buffer - - - //
+    ID3D11Texture2D* pAlbedoTexture, * pNormalTexture, * pDepthTexture;
+    ID3D11RenderTargetView* pAlbedoRTV, * pNormalRTV;
+    ID3D11ShaderResourceView* pAlbedoSRV, * pNormalSRV, * pDepthSRV;
+    ID3D11DepthStencilView* pDepthDSV;
+    UINT width, height;
+
+    // - - - light pass - - - //
+    ID3D11Buffer* pLightBuffer, * pCBuffer;
+    ID3D11ShaderResourceView* pLightSRV;
+    ID3D11VertexShader* pVertexShader;
+    ID3D11PixelShader* pPixelShader;
+    ID3D11BlendState* pBlendState;
+    ID3D11DepthStencilState* pDepthStencilState;
+    ID3D11RasterizerState* pRasterizerState;
+    UINT maxLights;
+};
@@ -0,0 +1,414 @@
+#include "EntityWorld.h"
+
+#include <assert.h>
+#include <atomic>
+
+#include "Timer.h"
+
+const UINT INVALID_ARCHETYPE = 0xFFFFFFFF;
+const UINT retiredGeneration = 0xFFFFFFFF;
+const UINT archetypeMinCapacity = 64;
+
+// * * * Component type registry * * * //
+// Types register from their first use, possibly on several threads at once
+static UINT componentSizes[MAX_COMPONENT_TYPES];
+static std::atomic<UINT> componentTypeCount( 0 );
+
+UINT registerComponentType( UINT size )
+{
+    UINT type = componentTypeCount.fetch_add( 1 );
+    if ( type >= MAX_COMPONENT_TYPES ) {
+        OutputDebugStringA( "[EntityWorld] Too many component types\n" );
+        assert( false );
+        return MAX_COMPONENT_TYPES - 1;
+    }
+
+    componentSizes[type] = size;
+    return type;
+}
+
+UINT getComponentSize( UINT type )
+{
+    return componentSizes[type];
+}
+
+static UINT lowestComponentType( ComponentMask mask )
+{
+    UINT type = 0;
+    while ( !( mask & ( (ComponentMask)1 << type ) ) )
+        type++;
+    return type;
+}
+
+// * * * * * ENTITY WORLD * * * * * //
+EntityWorld::EntityWorld()
+    : indexEnd( 0 ), aliveCount( 0 )
+{
+}
+
+void EntityWorld::reserve( UINT entityCount )
+{
+    records.reserve( entityCount );
+}
+
+void EntityWorld::clear()
+{
+    archetypes.clear();
+    archetypeLookup.clear();
+    records.clear();
+    aliveCount = 0;
+
+    std::lock_guard<std::mutex> lock( commandMutex );
+    freeIndices.clear();
+    indexEnd = 0;
+    commands.clear();
+    payload.clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+// Immediate create: the ID, then its record
+EntityID EntityWorld::allocateEntity()
+{
+    std::lock_guard<std::mutex> lock( commandMutex );
+    EntityID entity = takeEntityID();
+    growRecords();
+    return entity;
+}
+
+// A free slot or a fresh index past the end of records (generation 0 once its record exists).
+// Only reads records, so deferCreateEntity can take IDs while systems read the world. commandMutex held
+EntityID EntityWorld::takeEntityID()
+{
+    if ( !freeIndices.empty() ) {
+        UINT index = freeIndices.back();
+        freeIndices.pop_back();
+        return index | ( (EntityID)records[index].generation << ENTITY_INDEX_BITS );
+    }
+
+    assert( indexEnd < ENTITY_INDEX_MASK );
+    return indexEnd++;
+}
+
+// Records for every index handed out, only outside of iteration (it may reallocate)
+void EntityWorld::growRecords()
+{
+    EntityRecord record = { INVALID_ARCHETYPE, 0, 0 };
+    records.resize( indexEnd, record );
+}
+
+bool EntityWorld::isAlive( EntityID entity ) const
+{
+    UINT index = getEntityIndex( entity );
+    return index < records.size() && records[index].archetype != INVALID_ARCHETYPE && records[index].generation == getEntityGeneration( entity );
+}
+
+UINT EntityWorld::findArchetype( ComponentMask mask )
+{
+    std::unordered_map<ComponentMask, UINT>::iterator found = archetypeLookup.find( mask );
+    if ( found != archetypeLookup.end() )
+        return found->second;
+
+    EntityArchetype archetype;
+    archetype.mask = mask;
+    archetype.count = 0;
+    archetype.capacity = 0;
+    memset( archetype.columnIndex, 0xFF, sizeof(archetype.columnIndex) );
+
+    for ( UINT type = 0; type < MAX_COMPONENT_TYPES; type++ ) {
+        if ( mask & ( (ComponentMask)1 << type ) ) {
+            archetype.columnIndex[type] = (UINT)archetype.types.size();
+            archetype.types.push_back( type );
+        }
+    }
+    archetype.columns.resize( archetype.types.size() );
+
+    UINT index = (UINT)archetypes.size();
+    archetypes.push_back( archetype );
+    archetypeLookup[mask] = index;
+    return index;
+}
+
+// New row at the end of the archetype, zero filled
+static UINT appendRow( EntityArchetype& archetype, EntityID entity )
+{
+    if ( archetype.count == archetype.capacity ) {
+        archetype.capacity = std::max( archetype.capacity * 2, archetypeMinCapacity );
+        for ( size_t c = 0; c < archetype.types.size(); c++ )
+            archetype.columns[c].resize( (size_t)archetype.capacity * getComponentSize( archetype.types[c] ) );
+        archetype.entities.resize( archetype.capacity );
+    }
+
+    UINT row = archetype.count++;
+    archetype.entities[row] = entity;
+    for ( size_t c = 0; c < archetype.types.size(); c++ ) {
+        UINT size = getComponentSize( archetype.types[c] );
+        memset( archetype.columns[c].data() + (size_t)row * size, 0, size );
+    }
+    return row;
+}
+
+void EntityWorld::placeEntity( EntityID entity, ComponentMask mask )
+{
+    UINT archetype = findArchetype( mask );
+
+    EntityRecord& record = records[getEntityIndex( entity )];
+    record.archetype = archetype;
+    record.row = appendRow( archetypes[archetype], entity );
+    aliveCount++;
+}
+
+// Row into the archetype of mask, the components both archetypes have are copied over
+void EntityWorld::moveEntity( EntityID entity, ComponentMask mask )
+{
+    UINT target = findArchetype( mask );
+    EntityRecord& record = records[getEntityIndex( entity )];
+    UINT source = record.archetype, sourceRow = record.row;
+
+    EntityArchetype& to = archetypes[target];
+    EntityArchetype& from = archetypes[source];
+    UINT row = appendRow( to, entity );
+
+    for ( size_t c = 0; c < to.types.size(); c++ ) {
+        UINT type = to.types[c];
+        UINT fromColumn = from.columnIndex[type];
+        if ( fromColumn == 0xFFFFFFFF )
+            continue;
+
+        UINT size = getComponentSize( type );
+        memcpy( to.columns[c].data() + (size_t)row * size, from.columns[fromColumn].data() + (size_t)sourceRow * size, size );
+    }
+
+    removeRow( source, sourceRow );
+    record.archetype = target;
+    record.row = row;
+}
+
+// The last row fills the hole
+void EntityWorld::removeRow( UINT archetypeIndex, UINT row )
+{
+    EntityArchetype& archetype = archetypes[archetypeIndex];
+    UINT last = archetype.count - 1;
+
+    if ( row != last ) {
+        for ( size_t c = 0; c < archetype.types.size(); c++ ) {
+            UINT size = getComponentSize( archetype.types[c] );
+            BYTE* pColumn = archetype.columns[c].data();
+            memcpy( pColumn + (size_t)row * size, pColumn + (size_t)last * size, size );
+        }
+
+        archetype.entities[row] = archetype.entities[last];
+        records[getEntityIndex( archetype.entities[row] )].row = row;
+    }
+
+    archetype.count--;
+}
+
+void EntityWorld::destroyEntity( EntityID entity )
+{
+    if ( !isAlive( entity ) )
+        return;
+
+    EntityRecord& record = records[getEntityIndex( entity )];
+    removeRow( record.archetype, record.row );
+    record.archetype = INVALID_ARCHETYPE;
+    record.generation++;
+
+    if ( record.generation != retiredGeneration )
+        freeIndices.push_back( getEntityIndex( entity ) );
+    aliveCount--;
+}
+
+void EntityWorld::writeComponent( EntityID entity, UINT type, const void* pComponent )
+{
+    const EntityRecord& record = records[getEntityIndex( entity )];
+    EntityArchetype& archetype = archetypes[record.archetype];
+
+    UINT size = getComponentSize( type );
+    memcpy( archetype.columns[archetype.columnIndex[type]].data() + (size_t)record.row * size, pComponent, size );
+}
+
+void* EntityWorld::addComponentType( EntityID entity, UINT type )
+{
+    if ( !isAlive( entity ) )
+        return NULL;
+
+    ComponentMask mask = archetypes[records[getEntityIndex( entity )].archetype].mask;
+    if ( !( mask & ( (ComponentMask)1 << type ) ) )
+        moveEntity( entity, mask | ( (ComponentMask)1 << type ) );
+
+    return getComponentType( entity, type );
+}
+
+void EntityWorld::removeComponentType( EntityID entity, UINT type )
+{
+    if ( !isAlive( entity ) )
+        return;
+
+    ComponentMask mask = archetypes[records[getEntityIndex( entity )].archetype].mask;
+    if ( mask & ( (ComponentMask)1 << type ) )
+        moveEntity( entity, mask & ~( (ComponentMask)1 << type ) );
+}
+
+void* EntityWorld::getComponentType( EntityID entity, UINT type )
+{
+    if ( !isAlive( entity ) )
+        return NULL;
+
+    const EntityRecord& record = records[getEntityIndex( entity )];
+    EntityArchetype& archetype = archetypes[record.archetype];
+
+    UINT column = archetype.columnIndex[type];
+    if ( column == 0xFFFFFFFF )
+        return NULL;
+    return archetype.columns[column].data() + (size_t)record.row * getComponentSize( type );
+}
+
+// * * * * * DEFERRED COMMANDS * * * * * //
+void EntityWorld::recordCommand( EntityCommandKind kind, EntityID entity, ComponentMask mask )
+{
+    EntityCommand command = { kind, entity, mask, payload.size() };
+    commands.push_back( command );
+}
+
+void EntityWorld::recordPayload( UINT type, const void* pComponent )
+{
+    UINT size = getComponentSize( type );
+    size_t offset = payload.size();
+    payload.resize( offset + sizeof(UINT) + size );
+
+    memcpy( payload.data() + offset, &type, sizeof(UINT) );
+    memcpy( payload.data() + offset + sizeof(UINT), pComponent, size );
+}
+
+void EntityWorld::deferDestroyEntity( EntityID entity )
+{
+    std::lock_guard<std::mutex> lock( commandMutex );
+    recordCommand( ENTITY_COMMAND_DESTROY, entity, 0 );
+}
+
+void EntityWorld::flush()
+{
+    std::lock_guard<std::mutex> lock( commandMutex );
+    growRecords();
+
+    for ( size_t c = 0; c < commands.size(); c++ ) {
+        const EntityCommand& command = commands[c];
+        const BYTE* pPayload = payload.data() + command.payloadOffset;
+
+        switch ( command.kind ) {
+        case ENTITY_COMMAND_CREATE: {
+            // Still waiting for its create: right generation, no archetype yet
+            const EntityRecord& record = records[getEntityIndex( command.entity )];
+            if ( record.archetype != INVALID_ARCHETYPE || record.generation != getEntityGeneration( command.entity ) )
+                break;
+
+            placeEntity( command.entity, command.mask );
+            for ( ComponentMask remaining = command.mask; remaining != 0; remaining &= remaining - 1 ) {
+                UINT type;
+                memcpy( &type, pPayload, sizeof(UINT) );
+                writeComponent( command.entity, type, pPayload + sizeof(UINT) );
+                pPayload += sizeof(UINT) + getComponentSize( type );
+            }
+            break;
+        }
+
+        case ENTITY_COMMAND_DESTROY:
+            destroyEntity( command.entity );
+            break;
+
+        case ENTITY_COMMAND_ADD: {
+            UINT type;
+            memcpy( &type, pPayload, sizeof(UINT) );
+            void* pComponent = addComponentType( command.entity, type );
+            if ( pComponent )
+                memcpy( pComponent, pPayload + sizeof(UINT), getComponentSize( type ) );
+            break;
+        }
+
+        case ENTITY_COMMAND_REMOVE:
+            removeComponentType( command.entity, lowestComponentType( command.mask ) );
+            break;
+        }
+    }
+
+    commands.clear();
+    payload.clear();
+}
+
+// * * * * * SYSTEM SCHEDULER * * * * * //
+SystemScheduler::SystemScheduler()
+    : stagesValid( false )
+{
+}
+
+void SystemScheduler::addSystem( const char* pName, ComponentMask reads, ComponentMask writes, SystemFunction pFunction )
+{
+    System system = { pName, reads, writes, pFunction, 0, 0.0 };
+    systems.push_back( system );
+    stagesValid = false;
+}
+
+// A system goes one stage after the last earlier system it conflicts with
+void SystemScheduler::buildStages()
+{
+    if ( stagesValid )
+        return;
+
+    UINT stageCount = 0;
+    for ( size_t s = 0; s < systems.size(); s++ ) {
+        System& system = systems[s];
+        system.stage = 0;
+
+        for ( size_t earlier = 0; earlier < s; earlier++ ) {
+            const System& other = systems[earlier];
+            bool conflict = ( system.writes & ( other.reads | other.writes ) ) != 0 || ( system.reads & other.writes ) != 0;
+            if ( conflict )
+                system.stage = std::max( system.stage, other.stage + 1 );
+        }
+        stageCount = std::max( stageCount, system.stage + 1 );
+    }
+
+    // - - - group by stage, keeping the order within a stage - - - //
+    stageStarts.assign( stageCount + 1, 0 );
+    for ( size_t s = 0; s < systems.size(); s++ )
+        stageStarts[systems[s].stage + 1]++;
+    for ( UINT stage = 0; stage < stageCount; stage++ )
+        stageStarts[stage + 1] += stageStarts[stage];
+
+    std::vector<UINT> fill( stageStarts.begin(), stageStarts.end() - 1 );
+    stageSystems.resize( systems.size() );
+    for ( size_t s = 0; s < systems.size(); s++ )
+        stageSystems[fill[systems[s].stage]++] = (UINT)s;
+
+    stagesValid = true;
+}
+
+void SystemScheduler::run( EntityWorld& world, JobSystem* pJobSystem )
+{
+    buildStages();
+
+    auto runSystems = [&]( UINT begin, UINT end ) {
+        for ( UINT i = begin; i < end; i++ ) {
+            System& system = systems[stageSystems[i]];
+            Timer timer;
+            system.pFunction( world, pJobSystem );
+            system.lastMs = timer.elapsedMs();
+        }
+    };
+
+    for ( size_t stage = 0; stage + 1 < stageStarts.size(); stage++ ) {
+        UINT begin = stageStarts[stage], end = stageStarts[stage + 1];
+
+        if ( !pJobSystem || end - begin == 1 ) {
+            runSystems( begin, end );
+        }
+        else {
+            pJobSystem->parallelFor( end - begin, 1, [&]( UINT first, UINT last ) {
+                runSystems( begin + first, begin + last );
+            } );
+        }
+    }
+
+    world.flush();
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <Windows.h>
+
+// * * * Useful * * * //
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <type_traits>
+#include <string.h>
+
+#include "JobSystem.h"
+
+// * * * Entity IDs: slot index + generation, the ID of a destroyed entity never comes back * * * //
+// A slot is retired instead of reused once its 32 bit generation runs out
+typedef UINT64 EntityID;
+const EntityID INVALID_ENTITY_ID = 0xFFFFFFFFFFFFFFFF;
+const UINT ENTITY_INDEX_BITS = 32;
+const EntityID ENTITY_INDEX_MASK = 0xFFFFFFFF;
+
+inline UINT getEntityIndex( EntityID entity ) { return (UINT)( entity & ENTITY_INDEX_MASK ); }
+inline UINT getEntityGeneration( EntityID entity ) { return (UINT)( entity >> ENTITY_INDEX_BITS ); }
+
+// * * * Component types * * * //
+// Components are plain structs (trivially copyable, moved between archetypes with memcpy). Every
+// type gets a bit the first time it is used, masks of those bits name archetypes and the read /
+// write sets of systems. State outside the world (the device context, a culler) can be declared
+// through an empty tag struct.
+const UINT MAX_COMPONENT_TYPES = 64;
+typedef UINT64 ComponentMask;
+
+UINT registerComponentType( UINT size );
+UINT getComponentSize( UINT type );
+
+template<typename Component>
+struct ComponentTypeID
+{
+    static UINT get()
+    {
+        static_assert( std::is_trivially_copyable<Component>::value, "Components are moved with memcpy" );
+        static_assert( alignof(Component) <= 16, "Component columns are 16 byte aligned" );
+        static const UINT type = registerComponentType( sizeof(Component) );
+        return type;
+    }
+};
+
+template<typename T>
+UINT componentType()
+{
+    return ComponentTypeID<typename std::remove_const<T>::type>::get();
+}
+
+template<typename... Ts>
+ComponentMask componentMask()
+{
+    return ( (ComponentMask)0 | ... | ( (ComponentMask)1 << componentType<Ts>() ) );
+}
+
+// * * * Archetype: all entities with one exact component set * * * //
+// One column per component, row r of every column belongs to entities[r]. Rows stay packed,
+// removing an entity moves the last row into its place.
+struct EntityArchetype
+{
+    ComponentMask mask;
+    std::vector<UINT> types;                        // ascending
+    std::vector<std::vector<BYTE>> columns;         // per entry of types, capacity * size bytes
+    UINT columnIndex[MAX_COMPONENT_TYPES];          // type -> column, 0xFFFFFFFF when missing
+    std::vector<EntityID> entities;
+    UINT count;
+    UINT capacity;
+
+    template<typename T>
+    T* column()
+    {
+        UINT index = columnIndex[componentType<T>()];
+        return ( index == 0xFFFFFFFF ) ? NULL : (T*)columns[index].data();
+    }
+};
+
+// * * * Entity world * * * //
+// Archetype storage: iteration walks contiguous columns, a system touching two components of a
+// million entities streams through two arrays. Structural changes (create, destroy, add / remove
+// component) move rows between archetypes, so they are not allowed while systems iterate: systems
+// record them with the defer* calls (thread safe) and flush() applies them in order, once per
+// frame.
+class EntityWorld
+{
+public:
+    EntityWorld();
+
+    void reserve( UINT entityCount );
+    void clear();
+
+    // - - - immediate structural changes, not while iterating - - - //
+    template<typename... Ts>
+    EntityID createEntity( const Ts&... components )
+    {
+        EntityID entity = allocateEntity();
+        placeEntity( entity, componentMask<Ts...>() );
+        ( writeComponent( entity, componentType<Ts>(), &components ), ... );
+        return entity;
+    }
+
+    void destroyEntity( EntityID entity );
+
+    template<typename T>
+    void addComponent( EntityID entity, const T& component )
+    {
+        void* pComponent = addComponentType( entity, componentType<T>() );
+        if ( pComponent )
+            memcpy( pComponent, &component, sizeof(T) );
+    }
+
+    template<typename T>
+    void removeComponent( EntityID entity )
+    {
+        removeComponentType( entity, componentType<T>() );
+    }
+
+    // - - - deferred: recorded from any thread, applied by flush() - - - //
+    // The ID is valid right away, the entity exists (isAlive) after the flush
+    template<typename... Ts>
+    EntityID deferCreateEntity( const Ts&... components )
+    {
+        std::lock_guard<std::mutex> lock( commandMutex );
+        EntityID entity = takeEntityID();
+        recordCommand( ENTITY_COMMAND_CREATE, entity, componentMask<Ts...>() );
+        ( recordPayload( componentType<Ts>(), &components ), ... );
+        return entity;
+    }
+
+    void deferDestroyEntity( EntityID entity );
+
+    template<typename T>
+    void deferAddComponent( EntityID entity, const T& component )
+    {
+        std::lock_guard<std::mutex> lock( commandMutex );
+        recordCommand( ENTITY_COMMAND_ADD, entity, (ComponentMask)1 << componentType<T>() );
+        recordPayload( componentType<T>(), &component );
+    }
+
+    template<typename T>
+    void deferRemoveComponent( EntityID entity )
+    {
+        std::lock_guard<std::mutex> lock( commandMutex );
+        recordCommand( ENTITY_COMMAND_REMOVE, entity, (ComponentMask)1 << componentType<T>() );
+    }
+
+    // Applies the deferred commands in the order they were recorded
+    void flush();
+
+    // - - - access - - - //
+    bool isAlive( EntityID entity ) const;
+
+    // NULL when the entity is dead or doesn't have the component
+    template<typename T>
+    T* getComponent( EntityID entity )
+    {
+        return (T*)getComponentType( entity, componentType<T>() );
+    }
+
+    template<typename T>
+    bool hasComponent( EntityID entity ) const
+    {
+        return isAlive( entity ) && ( archetypes[records[getEntityIndex( entity )].archetype].mask & ( (ComponentMask)1 << componentType<T>() ) ) != 0;
+    }
+
+    UINT getEntityCount() const { return aliveCount; }
+    UINT getArchetypeCount() const { return (UINT)archetypes.size(); }
+
+    // - - - iteration over every entity that has all of Ts - - - //
+    // function( UINT count, const EntityID* pEntities, Ts* pColumns... ) once per archetype, for loops
+    // over whole columns. const Ts give const columns.
+    template<typename... Ts, typename Function>
+    void forEachChunk( const Function& function )
+    {
+        ComponentMask required = componentMask<Ts...>();
+        for ( size_t a = 0; a < archetypes.size(); a++ ) {
+            EntityArchetype& archetype = archetypes[a];
+            if ( archetype.count > 0 && ( archetype.mask & required ) == required )
+                function( archetype.count, archetype.entities.data(), archetype.template column<Ts>()... );
+        }
+    }
+
+    // function( EntityID entity, Ts& components... )
+    template<typename... Ts, typename Function>
+    void forEach( const Function& function )
+    {
+        forEachChunk<Ts...>( [&]( UINT count, const EntityID* pEntities, Ts*... pColumns ) {
+            for ( UINT i = 0; i < count; i++ )
+                function( pEntities[i], pColumns[i]... );
+        } );
+    }
+
+    // forEachChunk with every archetype cut into batches of up to batchSize rows, spread over the
+    // job system. The batches of one call never share a row.
+    template<typename... Ts, typename Function>
+    void parallelForEachChunk( JobSystem* pJobSystem, UINT batchSize, const Function& function )
+    {
+        ComponentMask required = componentMask<Ts...>();
+        std::vector<EntityBatch> batches;
+        for ( UINT a = 0; a < (UINT)archetypes.size(); a++ ) {
+            const EntityArchetype& archetype = archetypes[a];
+            if ( archetype.count == 0 || ( archetype.mask & required ) != required )
+                continue;
+
+            for ( UINT first = 0; first < archetype.count; first += batchSize ) {
+                EntityBatch batch = { a, first, std::min( batchSize, archetype.count - first ) };
+                batches.push_back( batch );
+            }
+        }
+
+        auto runBatches = [&]( UINT begin, UINT end ) {
+            for ( UINT b = begin; b < end; b++ ) {
+                EntityArchetype& archetype = archetypes[batches[b].archetype];
+                UINT first = batches[b].first;
+                function( batches[b].count, archetype.entities.data() + first, ( archetype.template column<Ts>() + first )... );
+            }
+        };
+
+        if ( pJobSystem )
+            pJobSystem->parallelFor( (UINT)batches.size(), 1, runBatches );
+        else
+            runBatches( 0, (UINT)batches.size() );
+    }
+
+private:
+    enum EntityCommandKind
+    {
+        ENTITY_COMMAND_CREATE,
+        ENTITY_COMMAND_DESTROY,
+        ENTITY_COMMAND_ADD,
+        ENTITY_COMMAND_REMOVE,
+    };
+
+    struct EntityCommand
+    {
+        EntityCommandKind kind;
+        EntityID entity;
+        ComponentMask mask;         // create: all components, add / remove: the one component
+        size_t payloadOffset;       // components as (type, bytes) pairs
+    };
+
+    struct EntityRecord
+    {
+        UINT archetype;             // 0xFFFFFFFF while dead or waiting for a deferred create
+        UINT row;
+        UINT generation;            // retiredGeneration: never handed out again
+    };
+
+    struct EntityBatch
+    {
+        UINT archetype;
+        UINT first;
+        UINT count;
+    };
+
+    EntityID allocateEntity();
+    EntityID takeEntityID();
+    void growRecords();
+    UINT findArchetype( ComponentMask mask );
+    void placeEntity( EntityID entity, ComponentMask mask );
+    void moveEntity( EntityID entity, ComponentMask mask );
+    void removeRow( UINT archetype, UINT row );
+    void writeComponent( EntityID entity, UINT type, const void* pComponent );
+    void* addComponentType( EntityID entity, UINT type );
+    void removeComponentType( EntityID entity, UINT type );
+    void* getComponentType( EntityID entity, UINT type );
+
+    void recordCommand( EntityCommandKind kind, EntityID entity, ComponentMask mask );
+    void recordPayload( UINT type, const void* pComponent );
+
+    std::vector<EntityArchetype> archetypes;
+    std::unordered_map<ComponentMask, UINT> archetypeLookup;
+
+    std::vector<EntityRecord> records;          // per entity index
+    std::vector<UINT> freeIndices;              // taken under commandMutex, deferCreateEntity runs on workers
+    UINT indexEnd;                              // indices handed out, records grows to it outside of iteration
+    UINT aliveCount;
+
+    std::mutex commandMutex;
+    std::vector<EntityCommand> commands;
+    std::vector<BYTE> payload;
+};
+
+// * * * Systems: functions over the world, with the components they read and write * * * //
+typedef void (*SystemFunction)( EntityWorld& world, JobSystem* pJobSystem );
+
+// Systems whose sets conflict (one writes what the other reads or writes) run in the order they
+// were added, the others share a stage and run in parallel on the job system. A stage with a
+// single system runs on the calling thread, so the system's own parallel loops get every worker.
+class SystemScheduler
+{
+public:
+    SystemScheduler();
+
+    void addSystem( const char* pName, ComponentMask reads, ComponentMask writes, SystemFunction pFunction );
+
+    // One frame: the stages in order, then world.flush()
+    void run( EntityWorld& world, JobSystem* pJobSystem );
+
+    UINT getSystemCount() const { return (UINT)systems.size(); }
+    const char* getSystemName( UINT system ) const { return systems[system].pName; }
+    UINT getSystemStage( UINT system ) { buildStages(); return systems[system].stage; }
+    double getSystemMs( UINT system ) const { return systems[system].lastMs; }
+    UINT getStageCount() { buildStages(); return (UINT)stageStarts.size() - 1; }
+
+private:
+    struct System
+    {
+        const char* pName;
+        ComponentMask reads;
+        ComponentMask writes;
+        SystemFunction pFunction;
+        UINT stage;
+        double lastMs;              // time of the last run, for profiling
+    };
+
+    void buildStages();
+
+    std::vector<System> systems;
+    std::vector<UINT> stageSystems;             // system indices grouped by stage
+    std::vector<UINT> stageStarts;              // stage s = stageSystems[stageStarts[s], stageStarts[s + 1])
+    bool stagesValid;
+};
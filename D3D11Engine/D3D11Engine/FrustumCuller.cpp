@@ -0,0 +1,209 @@
+#include "FrustumCuller.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "JobSystem.h"
+#include "SimdLanes.h"
+
+const UINT cullChunkSize = 16384;   // objects per job batch, a multiple of simdMaxWidth
+
+// * * * Frustum planes broadcast into lanes * * * //
+template<typename Lanes>
+struct FrustumLanes
+{
+    typename Lanes::Reg normal[FRUSTUM_PLANE_COUNT][3];
+    typename Lanes::Reg absNormal[FRUSTUM_PLANE_COUNT][3];
+    typename Lanes::Reg distance[FRUSTUM_PLANE_COUNT];
+
+    FrustumLanes( const Frustum& frustum )
+    {
+        for ( UINT p = 0; p < FRUSTUM_PLANE_COUNT; p++ ) {
+            const DirectX::XMFLOAT4& plane = frustum.planes[p];
+            normal[p][0] = Lanes::set( plane.x );
+            normal[p][1] = Lanes::set( plane.y );
+            normal[p][2] = Lanes::set( plane.z );
+            absNormal[p][0] = Lanes::set( fabsf( plane.x ) );
+            absNormal[p][1] = Lanes::set( fabsf( plane.y ) );
+            absNormal[p][2] = Lanes::set( fabsf( plane.z ) );
+            distance[p] = Lanes::set( plane.w );
+        }
+    }
+};
+
+// Bit per lane, set when the object is not outside any plane:
+// dot(n, center) + d >= -min(radius, dot(|n|, extents))
+template<typename Lanes>
+static UINT testLanes( const FrustumLanes<Lanes>& planes, const float* const* ppBounds, UINT first )
+{
+    typedef typename Lanes::Reg Reg;
+
+    Reg cx = Lanes::load( ppBounds[0] + first );
+    Reg cy = Lanes::load( ppBounds[1] + first );
+    Reg cz = Lanes::load( ppBounds[2] + first );
+    Reg ex = Lanes::load( ppBounds[3] + first );
+    Reg ey = Lanes::load( ppBounds[4] + first );
+    Reg ez = Lanes::load( ppBounds[5] + first );
+    Reg r = Lanes::load( ppBounds[6] + first );
+    Reg zero = Lanes::set( 0.0f );
+
+    Reg inside = Lanes::maskAll();
+    for ( UINT p = 0; p < FRUSTUM_PLANE_COUNT; p++ ) {
+        Reg d = Lanes::add( Lanes::add( Lanes::mul( cx, planes.normal[p][0] ), Lanes::mul( cy, planes.normal[p][1] ) ),
+                            Lanes::add( Lanes::mul( cz, planes.normal[p][2] ), planes.distance[p] ) );
+        Reg boxReach = Lanes::add( Lanes::add( Lanes::mul( ex, planes.absNormal[p][0] ), Lanes::mul( ey, planes.absNormal[p][1] ) ),
+                                   Lanes::mul( ez, planes.absNormal[p][2] ) );
+        Reg reach = Lanes::min( r, boxReach );
+
+        inside = Lanes::maskAnd( inside, Lanes::greaterEqual( Lanes::add( d, reach ), zero ) );
+    }
+
+    return Lanes::maskBits( inside );
+}
+
+// * * * * * CULLER * * * * * //
+FrustumCuller::FrustumCuller()
+    : objectCount( 0 )
+{
+}
+
+void FrustumCuller::reserve( UINT objectCount )
+{
+    std::vector<float>* arrays[] = { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius };
+    for ( UINT a = 0; a < ARRAYSIZE(arrays); a++ )
+        arrays[a]->reserve( objectCount + simdMaxWidth );
+}
+
+void FrustumCuller::clear()
+{
+    std::vector<float>* arrays[] = { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius };
+    for ( UINT a = 0; a < ARRAYSIZE(arrays); a++ )
+        arrays[a]->clear();
+
+    objectCount = 0;
+}
+
+void FrustumCuller::resizeArrays( UINT count )
+{
+    std::vector<float>* arrays[] = { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius };
+    for ( UINT a = 0; a < ARRAYSIZE(arrays); a++ )
+        arrays[a]->resize( count + simdMaxWidth, 0.0f );
+
+    objectCount = count;
+}
+
+UINT FrustumCuller::addSphere( const DirectX::XMFLOAT3& center, float radius )
+{
+    UINT index = objectCount;
+    resizeArrays( objectCount + 1 );
+    setSphere( index, center, radius );
+    return index;
+}
+
+UINT FrustumCuller::addBox( const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents )
+{
+    UINT index = objectCount;
+    resizeArrays( objectCount + 1 );
+    setBox( index, center, extents );
+    return index;
+}
+
+void FrustumCuller::setSphere( UINT index, const DirectX::XMFLOAT3& center, float radius )
+{
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    extentX[index] = radius;
+    extentY[index] = radius;
+    extentZ[index] = radius;
+    this->radius[index] = radius;
+}
+
+void FrustumCuller::setBox( UINT index, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents )
+{
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    extentX[index] = extents.x;
+    extentY[index] = extents.y;
+    extentZ[index] = extents.z;
+    radius[index] = sqrtf( extents.x * extents.x + extents.y * extents.y + extents.z * extents.z );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+// Blocks of 8: one AVX test or two SSE tests, then the visible indices are written without branches
+UINT FrustumCuller::cullRange( const Frustum& frustum, UINT begin, UINT end, UINT* pVisible ) const
+{
+    FrustumLanes<SimdLanes> planes( frustum );
+    const float* ppBounds[] = { centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data(), radius.data() };
+
+    UINT count = 0;
+    for ( UINT first = begin; first < end; first += simdMaxWidth ) {
+        UINT bits = 0;
+        for ( UINT lane = 0; lane < simdMaxWidth; lane += SimdLanes::width )
+            bits |= testLanes<SimdLanes>( planes, ppBounds, first + lane ) << lane;
+
+        UINT laneCount = ( end - first < simdMaxWidth ) ? end - first : simdMaxWidth;
+        for ( UINT lane = 0; lane < laneCount; lane++ ) {
+            pVisible[count] = first + lane;
+            count += ( bits >> lane ) & 1;
+        }
+    }
+
+    return count;
+}
+
+void FrustumCuller::cull( const Frustum& frustum, std::vector<UINT>& visible, JobSystem* pJobSystem )
+{
+    // Results go to a scratch array that only ever grows, so visible isn't zero filled every call
+    if ( chunkVisible.size() < objectCount )
+        chunkVisible.resize( objectCount );
+
+    if ( !pJobSystem || objectCount <= cullChunkSize ) {
+        UINT visibleCount = cullRange( frustum, 0, objectCount, chunkVisible.data() );
+        visible.assign( chunkVisible.begin(), chunkVisible.begin() + visibleCount );
+        return;
+    }
+
+    // - - - every chunk culls into its own slice, then the slices are packed together - - - //
+    UINT chunkCount = ( objectCount + cullChunkSize - 1 ) / cullChunkSize;
+    // Zeroed every call: counts of an earlier, bigger call must never reach the packing below
+    chunkCounts.assign( chunkCount, 0 );
+
+    pJobSystem->parallelFor( objectCount, cullChunkSize, [&]( UINT begin, UINT end ) {
+        chunkCounts[begin / cullChunkSize] = cullRange( frustum, begin, end, chunkVisible.data() + begin );
+    } );
+
+    UINT visibleCount = 0;
+    for ( UINT c = 0; c < chunkCount; c++ )
+        visibleCount += chunkCounts[c];
+    visible.resize( visibleCount );
+
+    pJobSystem->parallelFor( chunkCount, 1, [&]( UINT begin, UINT end ) {
+        UINT offset = 0;
+        for ( UINT c = 0; c < begin; c++ )
+            offset += chunkCounts[c];
+
+        for ( UINT c = begin; c < end; c++ ) {
+            if ( chunkCounts[c] > 0 )
+                memcpy( visible.data() + offset, chunkVisible.data() + c * cullChunkSize, chunkCounts[c] * sizeof(UINT) );
+            offset += chunkCounts[c];
+        }
+    } );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void transformBox( const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents, DirectX::FXMMATRIX world,
+                   DirectX::XMFLOAT3& worldCenter, DirectX::XMFLOAT3& worldExtents )
+{
+    DirectX::XMFLOAT4X4 m;
+    DirectX::XMStoreFloat4x4( &m, world );
+
+    DirectX::XMStoreFloat3( &worldCenter, DirectX::XMVector3Transform( DirectX::XMLoadFloat3( &center ), world ) );
+
+    worldExtents.x = extents.x * fabsf( m._11 ) + extents.y * fabsf( m._21 ) + extents.z * fabsf( m._31 );
+    worldExtents.y = extents.x * fabsf( m._12 ) + extents.y * fabsf( m._22 ) + extents.z * fabsf( m._32 );
+    worldExtents.z = extents.x * fabsf( m._13 ) + extents.y * fabsf( m._23 ) + extents.z * fabsf( m._33 );
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Camera.h"
+
+class JobSystem;
+
+// * * * Frustum culling for large object counts * * * //
+// World space bounds live in structure of arrays and are tested against the 6 planes 8 objects at a
+// time (two SSE batches of 4, or one AVX batch when the build enables it). Every object has a box
+// and a sphere: a sphere gets the box around it, a box the sphere around it, and per plane the
+// tighter of the two decides. Large sets are split over the job system, the visible indices come
+// back compacted and in ascending order.
+class FrustumCuller
+{
+public:
+    FrustumCuller();
+
+    void reserve( UINT objectCount );
+    void clear();
+
+    // Returns the object index used by cull()
+    UINT addSphere( const DirectX::XMFLOAT3& center, float radius );
+    UINT addBox( const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents );
+
+    void setSphere( UINT index, const DirectX::XMFLOAT3& center, float radius );
+    void setBox( UINT index, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents );
+
+    UINT getObjectCount() const { return objectCount; }
+
+    // Indices of the objects that intersect the frustum. pJobSystem NULL = single threaded
+    void cull( const Frustum& frustum, std::vector<UINT>& visible, JobSystem* pJobSystem = NULL );
+
+private:
+    void resizeArrays( UINT count );
+    UINT cullRange( const Frustum& frustum, UINT begin, UINT end, UINT* pVisible ) const;
+
+    // Padded with simdMaxWidth elements for the last batch
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> radius;
+    UINT objectCount;
+
+    // Per chunk results before compaction
+    std::vector<UINT> chunkVisible;
+    std::vector<UINT> chunkCounts;
+};
+
+// Box around a local box after the world transform (center moves, extents = |rotation scale| * extents)
+void transformBox( const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents, DirectX::FXMMATRIX world,
+                   DirectX::XMFLOAT3& worldCenter, DirectX::XMFLOAT3& worldExtents );
@@ -0,0 +1,546 @@
+#include "MeshImport.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "Json.h"
+#include "MappedFile.h"
+
+// * * * * * glTF 2.0 * * * * * //
+// JSON is parsed into a small DOM, vertex / index data is read in place from the mapped .glb or
+// .bin files, only data URIs are decoded into memory.
+
+namespace GLTF
+{
+    const UINT glbMagic = 0x46546C67;           // "glTF"
+    const UINT glbVersion = 2;
+    const UINT glbChunkJson = 0x4E4F534A;       // "JSON"
+    const UINT glbChunkBin = 0x004E4942;        // "BIN\0"
+
+    enum ComponentType
+    {
+        COMPONENT_BYTE = 5120,
+        COMPONENT_UNSIGNED_BYTE = 5121,
+        COMPONENT_SHORT = 5122,
+        COMPONENT_UNSIGNED_SHORT = 5123,
+        COMPONENT_UNSIGNED_INT = 5125,
+        COMPONENT_FLOAT = 5126
+    };
+
+    const UINT modeTriangles = 4;
+    const UINT maxNodeDepth = 64;               // node graphs are trees, this only stops cycles in broken files
+}
+
+struct GltfBuffer
+{
+    const BYTE* pData;
+    size_t size;
+};
+
+// Everything the buffer pointers point into
+struct GltfFile
+{
+    MappedFile file;
+    JsonValue root;
+    std::vector<GltfBuffer> buffers;
+    std::vector<std::unique_ptr<MappedFile>> externalFiles;
+    std::vector<std::unique_ptr<std::vector<BYTE>>> decodedBuffers;
+};
+
+struct GltfAccessor
+{
+    const BYTE* pData;                          // NULL when the accessor has no buffer view (all zeros)
+    UINT count;
+    UINT componentType;
+    UINT componentCount;
+    UINT stride;
+    bool normalized;
+};
+
+static bool gltfError( const wchar_t* fileName, const char* error )
+{
+    char message[512];
+    sprintf_s( message, "[MeshImport] %ls: %s\n", fileName, error );
+    OutputDebugStringA( message );
+    return false;
+}
+
+// * * * Buffers * * * //
+static int getBase64Value( char c )
+{
+    if ( c >= 'A' && c <= 'Z' ) return c - 'A';
+    if ( c >= 'a' && c <= 'z' ) return c - 'a' + 26;
+    if ( c >= '0' && c <= '9' ) return c - '0' + 52;
+    if ( c == '+' ) return 62;
+    if ( c == '/' ) return 63;
+    return -1;
+}
+
+static bool decodeBase64( const char* pText, size_t length, std::vector<BYTE>& data )
+{
+    data.clear();
+    data.reserve( length / 4 * 3 );
+
+    UINT bits = 0, bitCount = 0;
+    for ( size_t i = 0; i < length && pText[i] != '='; i++ ) {
+        int value = getBase64Value( pText[i] );
+        if ( value < 0 )
+            return false;
+
+        bits = ( bits << 6 ) | (UINT)value;
+        bitCount += 6;
+        if ( bitCount >= 8 ) {
+            bitCount -= 8;
+            data.push_back( (BYTE)( bits >> bitCount ) );
+        }
+    }
+    return true;
+}
+
+// Relative URI -> path next to the .gltf
+static std::wstring resolveUri( const wchar_t* fileName, const char* uri )
+{
+    // - - - percent decoding - - - //
+    std::string path;
+    for ( const char* p = uri; *p; p++ ) {
+        if ( p[0] == '%' && p[1] && p[2] ) {
+            char hex[3] = { p[1], p[2], 0 };
+            path += (char)strtol( hex, NULL, 16 );
+            p += 2;
+        }
+        else {
+            path += *p;
+        }
+    }
+
+    // - - - UTF-8 -> UTF-16 - - - //
+    std::wstring widePath;
+    int length = MultiByteToWideChar( CP_UTF8, 0, path.c_str(), (int)path.size(), NULL, 0 );
+    if ( length > 0 ) {
+        widePath.resize( length );
+        MultiByteToWideChar( CP_UTF8, 0, path.c_str(), (int)path.size(), &widePath[0], length );
+    }
+
+    std::wstring directory( fileName );
+    size_t slash = directory.find_last_of( L"\\/" );
+    directory = ( slash == std::wstring::npos ) ? std::wstring() : directory.substr( 0, slash + 1 );
+
+    return directory + widePath;
+}
+
+static bool loadBuffers( GltfFile& gltf, const wchar_t* fileName, const GltfBuffer& glbBin )
+{
+    const JsonValue* pBuffers = gltf.root.find( "buffers" );
+    if ( !pBuffers )
+        return true;
+
+    for ( size_t i = 0; i < pBuffers->size(); i++ ) {
+        const JsonValue& buffer = ( *pBuffers )[i];
+        size_t byteLength = buffer.getUInt( "byteLength", 0 );
+        const char* uri = buffer.getString( "uri", NULL );
+
+        GltfBuffer data = { NULL, 0 };
+        if ( !uri ) {
+            // The .glb BIN chunk
+            if ( i != 0 || !glbBin.pData )
+                return gltfError( fileName, "buffer without uri" );
+            data = glbBin;
+        }
+        else if ( strncmp( uri, "data:", 5 ) == 0 ) {
+            const char* pBase64 = strstr( uri, ";base64," );
+            if ( !pBase64 )
+                return gltfError( fileName, "unsupported data uri" );
+
+            pBase64 += 8;
+            gltf.decodedBuffers.push_back( std::unique_ptr<std::vector<BYTE>>( new std::vector<BYTE>() ) );
+            std::vector<BYTE>& decoded = *gltf.decodedBuffers.back();
+            if ( !decodeBase64( pBase64, strlen( pBase64 ), decoded ) )
+                return gltfError( fileName, "malformed base64 buffer" );
+
+            data.pData = decoded.data();
+            data.size = decoded.size();
+        }
+        else {
+            gltf.externalFiles.push_back( std::unique_ptr<MappedFile>( new MappedFile() ) );
+            MappedFile& external = *gltf.externalFiles.back();
+            if ( !external.open( resolveUri( fileName, uri ).c_str() ) )
+                return gltfError( fileName, "missing buffer file" );
+
+            data.pData = external.getData();
+            data.size = external.getSize();
+        }
+
+        if ( data.size < byteLength )
+            return gltfError( fileName, "buffer shorter than its byteLength" );
+
+        data.size = byteLength;
+        gltf.buffers.push_back( data );
+    }
+
+    return true;
+}
+
+// * * * Accessors * * * //
+static UINT getComponentSize( UINT componentType )
+{
+    switch ( componentType ) {
+    case GLTF::COMPONENT_BYTE:
+    case GLTF::COMPONENT_UNSIGNED_BYTE: return 1;
+    case GLTF::COMPONENT_SHORT:
+    case GLTF::COMPONENT_UNSIGNED_SHORT: return 2;
+    case GLTF::COMPONENT_UNSIGNED_INT:
+    case GLTF::COMPONENT_FLOAT: return 4;
+    default: return 0;
+    }
+}
+
+static UINT getComponentCount( const char* type )
+{
+    if ( strcmp( type, "SCALAR" ) == 0 ) return 1;
+    if ( strcmp( type, "VEC2" ) == 0 ) return 2;
+    if ( strcmp( type, "VEC3" ) == 0 ) return 3;
+    if ( strcmp( type, "VEC4" ) == 0 ) return 4;
+    return 0;
+}
+
+// Validates that every element lies inside the buffer view and the buffer
+static bool getAccessor( const GltfFile& gltf, UINT index, GltfAccessor& accessor )
+{
+    const JsonValue* pAccessors = gltf.root.find( "accessors" );
+    if ( !pAccessors || index >= pAccessors->size() )
+        return false;
+
+    const JsonValue& json = ( *pAccessors )[index];
+    if ( json.find( "sparse" ) )
+        return false;
+
+    accessor.count = json.getUInt( "count", 0 );
+    accessor.componentType = json.getUInt( "componentType", 0 );
+    accessor.componentCount = getComponentCount( json.getString( "type", "" ) );
+    accessor.normalized = json.getBool( "normalized", false );
+
+    UINT elementSize = getComponentSize( accessor.componentType ) * accessor.componentCount;
+    if ( elementSize == 0 || accessor.count == 0 )
+        return false;
+
+    accessor.pData = NULL;
+    accessor.stride = elementSize;
+
+    const JsonValue* pViewIndex = json.find( "bufferView" );
+    if ( !pViewIndex )
+        return true;
+
+    const JsonValue* pViews = gltf.root.find( "bufferViews" );
+    UINT viewIndex = json.getUInt( "bufferView", 0xFFFFFFFF );
+    if ( !pViews || viewIndex >= pViews->size() )
+        return false;
+
+    const JsonValue& view = ( *pViews )[viewIndex];
+    UINT bufferIndex = view.getUInt( "buffer", 0xFFFFFFFF );
+    UINT64 viewOffset = view.getUInt( "byteOffset", 0 );
+    UINT64 viewLength = view.getUInt( "byteLength", 0 );
+    accessor.stride = view.getUInt( "byteStride", elementSize );
+    if ( bufferIndex >= gltf.buffers.size() || accessor.stride < elementSize ||
+         viewOffset + viewLength > gltf.buffers[bufferIndex].size )
+        return false;
+
+    UINT64 accessorOffset = json.getUInt( "byteOffset", 0 );
+    if ( accessorOffset + (UINT64)( accessor.count - 1 ) * accessor.stride + elementSize > viewLength )
+        return false;
+
+    accessor.pData = gltf.buffers[bufferIndex].pData + viewOffset + accessorOffset;
+    return true;
+}
+
+static float readComponent( const GltfAccessor& accessor, UINT element, UINT component )
+{
+    if ( !accessor.pData || component >= accessor.componentCount )
+        return 0.0f;
+
+    const BYTE* p = accessor.pData + (size_t)element * accessor.stride + component * getComponentSize( accessor.componentType );
+    switch ( accessor.componentType ) {
+    case GLTF::COMPONENT_FLOAT: {
+        float value;
+        memcpy( &value, p, sizeof(float) );
+        return value;
+    }
+    case GLTF::COMPONENT_UNSIGNED_BYTE: {
+        return accessor.normalized ? *p / 255.0f : (float)*p;
+    }
+    case GLTF::COMPONENT_BYTE: {
+        float value = (float)(signed char)*p;
+        return accessor.normalized ? std::max( value / 127.0f, -1.0f ) : value;
+    }
+    case GLTF::COMPONENT_UNSIGNED_SHORT: {
+        USHORT value;
+        memcpy( &value, p, sizeof(USHORT) );
+        return accessor.normalized ? value / 65535.0f : (float)value;
+    }
+    case GLTF::COMPONENT_SHORT: {
+        SHORT value;
+        memcpy( &value, p, sizeof(SHORT) );
+        return accessor.normalized ? std::max( value / 32767.0f, -1.0f ) : (float)value;
+    }
+    case GLTF::COMPONENT_UNSIGNED_INT: {
+        UINT value;
+        memcpy( &value, p, sizeof(UINT) );
+        return (float)value;
+    }
+    default:
+        return 0.0f;
+    }
+}
+
+static UINT readIndex( const GltfAccessor& accessor, UINT element )
+{
+    const BYTE* p = accessor.pData + (size_t)element * accessor.stride;
+    switch ( accessor.componentType ) {
+    case GLTF::COMPONENT_UNSIGNED_BYTE: return *p;
+    case GLTF::COMPONENT_UNSIGNED_SHORT: { USHORT value; memcpy( &value, p, sizeof(USHORT) ); return value; }
+    case GLTF::COMPONENT_UNSIGNED_INT: { UINT value; memcpy( &value, p, sizeof(UINT) ); return value; }
+    default: return 0xFFFFFFFF;
+    }
+}
+
+// * * * Meshes * * * //
+// Optional attribute, false (and no data) when the primitive doesn't have it
+static bool getAttribute( const GltfFile& gltf, const JsonValue& attributes, const char* name, UINT vertexCount, GltfAccessor& accessor )
+{
+    const JsonValue* pIndex = attributes.find( name );
+    if ( !pIndex )
+        return false;
+
+    return getAccessor( gltf, attributes.getUInt( name, 0xFFFFFFFF ), accessor ) && accessor.count == vertexCount;
+}
+
+static bool importPrimitive( const wchar_t* fileName, const GltfFile& gltf, const JsonValue& primitive, DirectX::FXMMATRIX world, MeshData& mesh )
+{
+    if ( primitive.getUInt( "mode", GLTF::modeTriangles ) != GLTF::modeTriangles )
+        return true;                                    // lines / points / strips are skipped
+
+    const JsonValue* pAttributes = primitive.find( "attributes" );
+    GltfAccessor positions;
+    if ( !pAttributes || !getAccessor( gltf, pAttributes->getUInt( "POSITION", 0xFFFFFFFF ), positions ) || positions.componentCount != 3 )
+        return gltfError( fileName, "primitive without valid POSITION" );
+
+    UINT vertexCount = positions.count;
+    GltfAccessor normals, texcoords, colors;
+    bool hasNormals = getAttribute( gltf, *pAttributes, "NORMAL", vertexCount, normals );
+    bool hasTexcoords = getAttribute( gltf, *pAttributes, "TEXCOORD_0", vertexCount, texcoords );
+    bool hasColors = getAttribute( gltf, *pAttributes, "COLOR_0", vertexCount, colors );
+
+    // - - - vertices: node transform, then right handed -> left handed - - - //
+    DirectX::XMMATRIX normalMatrix = DirectX::XMMatrixTranspose( DirectX::XMMatrixInverse( NULL, world ) );
+    bool mirrored = DirectX::XMVectorGetX( DirectX::XMMatrixDeterminant( world ) ) < 0.0f;
+
+    UINT baseVertex = (UINT)mesh.vertices.size();
+    mesh.vertices.resize( baseVertex + vertexCount );
+
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        Vertex& vertex = mesh.vertices[baseVertex + v];
+
+        DirectX::XMVECTOR position = DirectX::XMVectorSet( readComponent( positions, v, 0 ), readComponent( positions, v, 1 ), readComponent( positions, v, 2 ), 1.0f );
+        DirectX::XMStoreFloat3( &vertex.pos, DirectX::XMVector3TransformCoord( position, world ) );
+        vertex.pos.z = -vertex.pos.z;
+
+        vertex.normal = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+        if ( hasNormals ) {
+            DirectX::XMVECTOR normal = DirectX::XMVectorSet( readComponent( normals, v, 0 ), readComponent( normals, v, 1 ), readComponent( normals, v, 2 ), 0.0f );
+            DirectX::XMStoreFloat3( &vertex.normal, DirectX::XMVector3Normalize( DirectX::XMVector3TransformNormal( normal, normalMatrix ) ) );
+            vertex.normal.z = -vertex.normal.z;
+        }
+
+        // Top left origin like D3D, no flip needed
+        vertex.texcoord = hasTexcoords ? DirectX::XMFLOAT2( readComponent( texcoords, v, 0 ), readComponent( texcoords, v, 1 ) ) : DirectX::XMFLOAT2( 0.0f, 0.0f );
+
+        vertex.col = DirectX::XMFLOAT4( 1.0f, 1.0f, 1.0f, 1.0f );
+        if ( hasColors ) {
+            vertex.col = DirectX::XMFLOAT4( readComponent( colors, v, 0 ), readComponent( colors, v, 1 ), readComponent( colors, v, 2 ),
+                                            colors.componentCount == 4 ? readComponent( colors, v, 3 ) : 1.0f );
+        }
+    }
+
+    // - - - indices, already welded by the exporter - - - //
+    GltfAccessor indices;
+    bool indexed = primitive.find( "indices" ) != NULL;
+    if ( indexed && ( !getAccessor( gltf, primitive.getUInt( "indices", 0xFFFFFFFF ), indices ) || indices.componentCount != 1 || !indices.pData ) )
+        return gltfError( fileName, "invalid index accessor" );
+
+    UINT indexCount = indexed ? indices.count : vertexCount;
+    if ( indexCount % 3 != 0 )
+        return gltfError( fileName, "index count isn't a multiple of 3" );
+
+    // The z flip reverses the winding, unless the node transform already mirrored it
+    UINT second = mirrored ? 1 : 2, third = mirrored ? 2 : 1;
+
+    size_t indexStart = mesh.indices.size();
+    mesh.indices.resize( indexStart + indexCount );
+    for ( UINT i = 0; i < indexCount; i += 3 ) {
+        UINT triangle[3];
+        for ( UINT k = 0; k < 3; k++ ) {
+            triangle[k] = indexed ? readIndex( indices, i + k ) : i + k;
+            if ( triangle[k] >= vertexCount )
+                return gltfError( fileName, "index out of range" );
+        }
+
+        mesh.indices[indexStart + i] = baseVertex + triangle[0];
+        mesh.indices[indexStart + i + 1] = baseVertex + triangle[second];
+        mesh.indices[indexStart + i + 2] = baseVertex + triangle[third];
+    }
+
+    return true;
+}
+
+static DirectX::XMMATRIX getNodeMatrix( const JsonValue& node )
+{
+    // Column major column vector matrix = row major row vector matrix (DirectXMath)
+    const JsonValue* pMatrix = node.find( "matrix" );
+    if ( pMatrix && pMatrix->size() == 16 ) {
+        DirectX::XMFLOAT4X4 matrix;
+        for ( int i = 0; i < 16; i++ )
+            matrix.m[i / 4][i % 4] = (float)( *pMatrix )[i].number;
+        return DirectX::XMLoadFloat4x4( &matrix );
+    }
+
+    float t[3] = { 0.0f, 0.0f, 0.0f }, r[4] = { 0.0f, 0.0f, 0.0f, 1.0f }, s[3] = { 1.0f, 1.0f, 1.0f };
+    const JsonValue* pTranslation = node.find( "translation" );
+    const JsonValue* pRotation = node.find( "rotation" );
+    const JsonValue* pScale = node.find( "scale" );
+    for ( int i = 0; i < 3 && pTranslation && pTranslation->size() == 3; i++ ) t[i] = (float)( *pTranslation )[i].number;
+    for ( int i = 0; i < 4 && pRotation && pRotation->size() == 4; i++ ) r[i] = (float)( *pRotation )[i].number;
+    for ( int i = 0; i < 3 && pScale && pScale->size() == 3; i++ ) s[i] = (float)( *pScale )[i].number;
+
+    return DirectX::XMMatrixScaling( s[0], s[1], s[2] ) *
+           DirectX::XMMatrixRotationQuaternion( DirectX::XMVectorSet( r[0], r[1], r[2], r[3] ) ) *
+           DirectX::XMMatrixTranslation( t[0], t[1], t[2] );
+}
+
+static bool importMeshPrimitives( const wchar_t* fileName, const GltfFile& gltf, UINT meshIndex, DirectX::FXMMATRIX world, MeshData& mesh )
+{
+    const JsonValue* pMeshes = gltf.root.find( "meshes" );
+    if ( !pMeshes || meshIndex >= pMeshes->size() )
+        return gltfError( fileName, "mesh index out of range" );
+
+    const JsonValue* pPrimitives = ( *pMeshes )[meshIndex].find( "primitives" );
+    for ( size_t p = 0; pPrimitives && p < pPrimitives->size(); p++ ) {
+        if ( !importPrimitive( fileName, gltf, ( *pPrimitives )[p], world, mesh ) )
+            return false;
+    }
+    return true;
+}
+
+static bool importNode( const wchar_t* fileName, const GltfFile& gltf, UINT nodeIndex, DirectX::FXMMATRIX parent, MeshData& mesh, UINT depth )
+{
+    const JsonValue* pNodes = gltf.root.find( "nodes" );
+    if ( !pNodes || nodeIndex >= pNodes->size() || depth > GLTF::maxNodeDepth )
+        return gltfError( fileName, "invalid node hierarchy" );
+
+    const JsonValue& node = ( *pNodes )[nodeIndex];
+    DirectX::XMMATRIX world = getNodeMatrix( node ) * parent;
+
+    if ( node.find( "mesh" ) ) {
+        // Skinned vertices are already in model space (bind pose), the node transform doesn't apply
+        DirectX::XMMATRIX meshWorld = node.find( "skin" ) ? DirectX::XMMatrixIdentity() : world;
+        if ( !importMeshPrimitives( fileName, gltf, node.getUInt( "mesh", 0xFFFFFFFF ), meshWorld, mesh ) )
+            return false;
+    }
+
+    const JsonValue* pChildren = node.find( "children" );
+    for ( size_t c = 0; pChildren && c < pChildren->size(); c++ ) {
+        if ( !importNode( fileName, gltf, (UINT)( *pChildren )[c].number, world, mesh, depth + 1 ) )
+            return false;
+    }
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+bool importGLTF( const wchar_t* fileName, MeshData& mesh )
+{
+    GltfFile gltf;
+    if ( !gltf.file.open( fileName ) )
+        return false;
+
+    const BYTE* pData = gltf.file.getData();
+    size_t size = gltf.file.getSize();
+
+    // - - - .glb container: header, JSON chunk, optional BIN chunk - - - //
+    const char* pJson = (const char*)pData;
+    size_t jsonLength = size;
+    GltfBuffer glbBin = { NULL, 0 };
+
+    UINT magic = 0;
+    if ( size >= 4 )
+        memcpy( &magic, pData, sizeof(UINT) );
+
+    if ( magic == GLTF::glbMagic ) {
+        UINT header[5];                             // magic, version, length, JSON chunk length, JSON chunk type
+        if ( size < sizeof(header) )
+            return gltfError( fileName, "truncated glb" );
+        memcpy( header, pData, sizeof(header) );
+
+        if ( header[1] != GLTF::glbVersion || header[2] > size || header[4] != GLTF::glbChunkJson || header[3] > header[2] - sizeof(header) )
+            return gltfError( fileName, "invalid glb header" );
+
+        pJson = (const char*)pData + sizeof(header);
+        jsonLength = header[3];
+
+        size_t binChunk = sizeof(header) + ( ( jsonLength + 3 ) & ~(size_t)3 );
+        if ( binChunk + 8 <= header[2] ) {
+            UINT chunk[2];                          // length, type
+            memcpy( chunk, pData + binChunk, sizeof(chunk) );
+            if ( chunk[1] == GLTF::glbChunkBin && chunk[0] <= header[2] - binChunk - 8 ) {
+                glbBin.pData = pData + binChunk + 8;
+                glbBin.size = chunk[0];
+            }
+        }
+    }
+
+    if ( !parseJson( pJson, jsonLength, gltf.root ) )
+        return gltfError( fileName, "malformed JSON" );
+
+    const JsonValue* pAsset = gltf.root.find( "asset" );
+    if ( !pAsset || pAsset->getString( "version", "" )[0] != '2' )
+        return gltfError( fileName, "not a glTF 2.0 file" );
+
+    if ( !loadBuffers( gltf, fileName, glbBin ) )
+        return false;
+
+    // - - - default scene, every mesh when the file has no scenes - - - //
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    const JsonValue* pScenes = gltf.root.find( "scenes" );
+    if ( pScenes && pScenes->size() > 0 ) {
+        UINT sceneIndex = gltf.root.getUInt( "scene", 0 );
+        if ( sceneIndex >= pScenes->size() )
+            return gltfError( fileName, "scene index out of range" );
+
+        const JsonValue* pRoots = ( *pScenes )[sceneIndex].find( "nodes" );
+        for ( size_t n = 0; pRoots && n < pRoots->size(); n++ ) {
+            if ( !importNode( fileName, gltf, (UINT)( *pRoots )[n].number, DirectX::XMMatrixIdentity(), mesh, 0 ) )
+                return false;
+        }
+    }
+    else {
+        const JsonValue* pMeshes = gltf.root.find( "meshes" );
+        for ( UINT m = 0; pMeshes && m < pMeshes->size(); m++ ) {
+            if ( !importMeshPrimitives( fileName, gltf, m, DirectX::XMMatrixIdentity(), mesh ) )
+                return false;
+        }
+    }
+
+    for ( size_t v = 0; v < mesh.vertices.size(); v++ ) {
+        const DirectX::XMFLOAT3& normal = mesh.vertices[v].normal;
+        if ( normal.x == 0.0f && normal.y == 0.0f && normal.z == 0.0f ) {
+            generateMissingNormals( mesh );
+            break;
+        }
+    }
+
+    return !mesh.indices.empty();
+}
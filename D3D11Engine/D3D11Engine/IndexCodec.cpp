@@ -0,0 +1,306 @@
+#include "IndexCodec.h"
+
+#include <assert.h>
+
+#include <algorithm>
+
+// * * * Codec constants * * * //
+const BYTE indexCodecVersion = 1;
+
+const UINT edgeFifoSize = 16;
+const UINT vertexFifoSize = 16;
+
+const UINT noEdgeHit = 15;          // high nibble of control byte when no edge in the FIFO matched
+const UINT codeNextVertex = 0;      // vertex is the next never-seen-before index
+const UINT codeExplicit = 15;       // vertex stored as a varint; 1..14 = vertex FIFO hit
+
+// * * * Coder state shared by encoder and decoder so they stay in lock-step * * * //
+struct IndexCodecState
+{
+    UINT edgeFifo[edgeFifoSize][2];
+    UINT vertexFifo[vertexFifoSize];
+    UINT edgeOffset;
+    UINT vertexOffset;
+    UINT next;      // next new vertex index
+    UINT last;      // last explicitly coded vertex
+
+    IndexCodecState()
+    {
+        // Invalid entries can never match a real triangle
+        for ( UINT i = 0; i < edgeFifoSize; i++ ) {
+            edgeFifo[i][0] = 0xFFFFFFFF;
+            edgeFifo[i][1] = 0xFFFFFFFF;
+        }
+        for ( UINT i = 0; i < vertexFifoSize; i++ )
+            vertexFifo[i] = 0xFFFFFFFF;
+
+        edgeOffset = 0;
+        vertexOffset = 0;
+        next = 0;
+        last = 0;
+    }
+
+    void pushEdge( UINT a, UINT b )
+    {
+        edgeFifo[edgeOffset][0] = a;
+        edgeFifo[edgeOffset][1] = b;
+        edgeOffset = ( edgeOffset + 1 ) & ( edgeFifoSize - 1 );
+    }
+
+    void pushVertex( UINT v )
+    {
+        vertexFifo[vertexOffset] = v;
+        vertexOffset = ( vertexOffset + 1 ) & ( vertexFifoSize - 1 );
+    }
+
+    // Distance from the newest entry, 0 = most recent
+    const UINT* getEdge( UINT distance ) const
+    {
+        return edgeFifo[( edgeOffset - 1 - distance ) & ( edgeFifoSize - 1 )];
+    }
+
+    UINT getVertex( UINT distance ) const
+    {
+        return vertexFifo[( vertexOffset - 1 - distance ) & ( vertexFifoSize - 1 )];
+    }
+};
+
+// * * * Varint helpers * * * //
+static BYTE* writeVarint( BYTE* pData, UINT value )
+{
+    while ( value >= 0x80 ) {
+        *pData++ = (BYTE)( value | 0x80 );
+        value >>= 7;
+    }
+    *pData++ = (BYTE)value;
+    return pData;
+}
+
+static const BYTE* readVarint( const BYTE* pData, const BYTE* pEnd, UINT& value )
+{
+    value = 0;
+    for ( UINT shift = 0; shift < 35; shift += 7 ) {
+        if ( pData >= pEnd )
+            return NULL;
+
+        BYTE b = *pData++;
+        value |= (UINT)( b & 0x7F ) << shift;
+        if ( ( b & 0x80 ) == 0 )
+            return pData;
+    }
+    return NULL;
+}
+
+static UINT zigzagEncode( int value )
+{
+    return ( (UINT)value << 1 ) ^ (UINT)( value >> 31 );
+}
+
+static int zigzagDecode( UINT value )
+{
+    return (int)( value >> 1 ) ^ -(int)( value & 1 );
+}
+
+// * * * Encoder * * * //
+static UINT encodeVertex( IndexCodecState& state, UINT v, BYTE*& pData )
+{
+    if ( v == state.next ) {
+        state.next++;
+        state.pushVertex( v );
+        return codeNextVertex;
+    }
+
+    for ( UINT i = 0; i < codeExplicit - 1; i++ ) {
+        if ( state.getVertex( i ) == v )
+            return i + 1;
+    }
+
+    pData = writeVarint( pData, zigzagEncode( (int)( v - state.last ) ) );
+    state.last = v;
+    state.pushVertex( v );
+    return codeExplicit;
+}
+
+static UINT findEdge( const IndexCodecState& state, UINT a, UINT b )
+{
+    for ( UINT i = 0; i < noEdgeHit; i++ ) {
+        const UINT* edge = state.getEdge( i );
+        if ( edge[0] == a && edge[1] == b )
+            return i;
+    }
+    return noEdgeHit;
+}
+
+template<typename T>
+static size_t encodeIndexBufferT( BYTE* pBuffer, size_t bufferSize, const T* pIndices, UINT indexCount )
+{
+    assert( indexCount % 3 == 0 );
+
+    UINT triangleCount = indexCount / 3;
+    if ( bufferSize < 1 + (size_t)triangleCount )
+        return 0;
+
+    IndexCodecState state;
+    BYTE* pControl = pBuffer + 1;
+    BYTE* pData = pControl + triangleCount;
+    const BYTE* pEnd = pBuffer + bufferSize;
+
+    pBuffer[0] = indexCodecVersion;
+
+    for ( UINT t = 0; t < triangleCount; t++ ) {
+        // Worst case for one triangle: 1 extra code byte + 3 varints of 5 bytes
+        if ( pData + 16 > pEnd )
+            return 0;
+
+        UINT tri[3] = { (UINT)pIndices[t * 3 + 0], (UINT)pIndices[t * 3 + 1], (UINT)pIndices[t * 3 + 2] };
+
+        // Neighbours traverse a shared edge in the opposite direction, edges are stored reversed.
+        // Try all three rotations of the triangle (keeps the winding).
+        UINT edgeHit = noEdgeHit;
+        UINT rotation = 0;
+        for ( UINT r = 0; r < 3 && edgeHit == noEdgeHit; r++ ) {
+            edgeHit = findEdge( state, tri[r], tri[( r + 1 ) % 3] );
+            rotation = r;
+        }
+
+        if ( edgeHit != noEdgeHit ) {
+            UINT a = tri[rotation], b = tri[( rotation + 1 ) % 3], c = tri[( rotation + 2 ) % 3];
+
+            UINT code = encodeVertex( state, c, pData );
+            *pControl++ = (BYTE)( ( edgeHit << 4 ) | code );
+
+            state.pushEdge( c, b );
+            state.pushEdge( a, c );
+        }
+        else {
+            UINT a = tri[0], b = tri[1], c = tri[2];
+
+            // Control byte carries a's code, one data byte carries b's and c's codes.
+            // The varints of a, b and c follow that byte in the data stream.
+            BYTE* pCodes = pData++;
+            UINT codeA = encodeVertex( state, a, pData );
+            UINT codeB = encodeVertex( state, b, pData );
+            UINT codeC = encodeVertex( state, c, pData );
+
+            *pControl++ = (BYTE)( ( noEdgeHit << 4 ) | codeA );
+            *pCodes = (BYTE)( ( codeB << 4 ) | codeC );
+
+            state.pushEdge( b, a );
+            state.pushEdge( c, b );
+            state.pushEdge( a, c );
+        }
+    }
+
+    return (size_t)( pData - pBuffer );
+}
+
+size_t getIndexBufferEncodeBound( UINT indexCount, UINT vertexCount )
+{
+    // version + control byte and worst case data per triangle
+    UINT triangleCount = indexCount / 3;
+    // Zigzag deltas stay below 2 * vertexCount, a 32 bit varint takes 5 bytes at most
+    UINT64 maxZigzag = (UINT64)vertexCount << 1;
+    UINT varintBytes = 1;
+    while ( varintBytes < 5 && ( maxZigzag >> ( 7 * varintBytes ) ) )
+        varintBytes++;
+
+    return 1 + (size_t)triangleCount * ( 2 + 3 * varintBytes ) + 16;
+}
+
+size_t encodeIndexBuffer( BYTE* pBuffer, size_t bufferSize, const UINT* pIndices, UINT indexCount )
+{
+    return encodeIndexBufferT( pBuffer, bufferSize, pIndices, indexCount );
+}
+
+size_t encodeIndexBuffer( BYTE* pBuffer, size_t bufferSize, const USHORT* pIndices, UINT indexCount )
+{
+    return encodeIndexBufferT( pBuffer, bufferSize, pIndices, indexCount );
+}
+
+// * * * Decoder * * * //
+static inline bool decodeVertex( IndexCodecState& state, UINT code, const BYTE*& pData, const BYTE* pEnd, UINT& v )
+{
+    if ( code == codeNextVertex ) {
+        v = state.next++;
+        state.pushVertex( v );
+    }
+    else if ( code < codeExplicit ) {
+        v = state.getVertex( code - 1 );
+    }
+    else {
+        UINT zigzag;
+        pData = readVarint( pData, pEnd, zigzag );
+        if ( !pData )
+            return false;
+
+        v = state.last + (UINT)zigzagDecode( zigzag );
+        state.last = v;
+        state.pushVertex( v );
+    }
+    return true;
+}
+
+template<typename T>
+static bool decodeIndexBufferT( T* pIndices, UINT indexCount, UINT vertexCount, const BYTE* pBuffer, size_t bufferSize )
+{
+    UINT triangleCount = indexCount / 3;
+    if ( indexCount % 3 != 0 || bufferSize < 1 + (size_t)triangleCount || pBuffer[0] != indexCodecVersion )
+        return false;
+
+    IndexCodecState state;
+    const BYTE* pControl = pBuffer + 1;
+    const BYTE* pData = pControl + triangleCount;
+    const BYTE* pEnd = pBuffer + bufferSize;
+
+    for ( UINT t = 0; t < triangleCount; t++ ) {
+        BYTE control = *pControl++;
+        UINT edgeHit = control >> 4;
+        UINT a, b, c;
+
+        if ( edgeHit != noEdgeHit ) {
+            const UINT* edge = state.getEdge( edgeHit );
+            a = edge[0];
+            b = edge[1];
+
+            if ( !decodeVertex( state, control & 15, pData, pEnd, c ) )
+                return false;
+
+            state.pushEdge( c, b );
+            state.pushEdge( a, c );
+        }
+        else {
+            if ( pData >= pEnd )
+                return false;
+            BYTE codes = *pData++;
+
+            if ( !decodeVertex( state, control & 15, pData, pEnd, a ) ||
+                 !decodeVertex( state, codes >> 4, pData, pEnd, b ) ||
+                 !decodeVertex( state, codes & 15, pData, pEnd, c ) )
+                return false;
+
+            state.pushEdge( b, a );
+            state.pushEdge( c, b );
+            state.pushEdge( a, c );
+        }
+
+        // Also catches edge hits on the invalid entries of a FIFO that isn't full yet
+        if ( a >= vertexCount || b >= vertexCount || c >= vertexCount )
+            return false;
+
+        pIndices[t * 3 + 0] = (T)a;
+        pIndices[t * 3 + 1] = (T)b;
+        pIndices[t * 3 + 2] = (T)c;
+    }
+
+    return pData == pEnd;
+}
+
+bool decodeIndexBuffer( UINT* pIndices, UINT indexCount, UINT vertexCount, const BYTE* pBuffer, size_t bufferSize )
+{
+    return decodeIndexBufferT( pIndices, indexCount, vertexCount, pBuffer, bufferSize );
+}
+
+bool decodeIndexBuffer( USHORT* pIndices, UINT indexCount, UINT vertexCount, const BYTE* pBuffer, size_t bufferSize )
+{
+    return decodeIndexBufferT( pIndices, indexCount, std::min( vertexCount, 65536u ), pBuffer, bufferSize );
+}
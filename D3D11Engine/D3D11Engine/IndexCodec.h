@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Windows.h>
+
+// * * * Triangle list index compression * * * //
+// Every triangle gets one control byte. Triangles sharing an edge with one of the 15 most recent
+// edges only store their third vertex, and vertices are coded as "next new vertex", a hit in a
+// small recently-used vertex FIFO, or as a zigzag varint delta. Works best on vertex cache
+// optimized meshes, where most triangles cost about one byte (vs 6 bytes raw 16 bit).
+// Triangles may come back rotated (winding is preserved).
+//
+// Layout: [version][control byte per triangle][data bytes]
+
+// Worst case size of an encoded index buffer
+size_t getIndexBufferEncodeBound( UINT indexCount, UINT vertexCount );
+
+// Returns the number of bytes written, 0 on failure
+size_t encodeIndexBuffer( BYTE* pBuffer, size_t bufferSize, const UINT* pIndices, UINT indexCount );
+size_t encodeIndexBuffer( BYTE* pBuffer, size_t bufferSize, const USHORT* pIndices, UINT indexCount );
+
+// Returns false when the data is corrupt or an index is >= vertexCount
+bool decodeIndexBuffer( UINT* pIndices, UINT indexCount, UINT vertexCount, const BYTE* pBuffer, size_t bufferSize );
+bool decodeIndexBuffer( USHORT* pIndices, UINT indexCount, UINT vertexCount, const BYTE* pBuffer, size_t bufferSize );
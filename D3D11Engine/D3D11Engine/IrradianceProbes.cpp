@@ -0,0 +1,191 @@
+#include "IrradianceProbes.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include <DirectXPackedVector.h>
+
+// * * * * * SPHERICAL HARMONICS * * * * * //
+// Y_lm = shBasisScale * the polynomial of evaluateIrradiance
+static const float shBasisScale[shCoefficientCount] = {
+    0.282095f,
+    0.488603f, 0.488603f, 0.488603f,
+    1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f,
+};
+
+// Clamped cosine convolution per band / pi (Ramamoorthi and Hanrahan 2001)
+static const float shCosineLobe[shCoefficientCount] = {
+    1.0f,
+    2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+    0.25f, 0.25f, 0.25f, 0.25f, 0.25f,
+};
+
+static void getShPolynomials( const DirectX::XMFLOAT3& d, float polynomials[shCoefficientCount] )
+{
+    polynomials[0] = 1.0f;
+    polynomials[1] = d.y;
+    polynomials[2] = d.z;
+    polynomials[3] = d.x;
+    polynomials[4] = d.x * d.y;
+    polynomials[5] = d.y * d.z;
+    polynomials[6] = 3.0f * d.z * d.z - 1.0f;
+    polynomials[7] = d.x * d.z;
+    polynomials[8] = d.x * d.x - d.y * d.y;
+}
+
+void projectIrradiance( const DirectX::XMFLOAT3* pDirections, const DirectX::XMFLOAT3* pRadiance, UINT count, IrradianceProbe& probe )
+{
+    ZeroMemory( &probe, sizeof(IrradianceProbe) );
+    if ( count == 0 )
+        return;
+
+    // Monte Carlo over the sphere: L_lm = 4 pi / count * sum( L * Y_lm )
+    DirectX::XMFLOAT3 sums[shCoefficientCount];
+    ZeroMemory( sums, sizeof(sums) );
+    for ( UINT i = 0; i < count; i++ ) {
+        float polynomials[shCoefficientCount];
+        getShPolynomials( pDirections[i], polynomials );
+
+        const DirectX::XMFLOAT3& radiance = pRadiance[i];
+        for ( UINT c = 0; c < shCoefficientCount; c++ ) {
+            sums[c].x += radiance.x * polynomials[c];
+            sums[c].y += radiance.y * polynomials[c];
+            sums[c].z += radiance.z * polynomials[c];
+        }
+    }
+
+    // Y_lm twice (projection and evaluation) and the cosine lobe
+    for ( UINT c = 0; c < shCoefficientCount; c++ ) {
+        float scale = 4.0f * DirectX::XM_PI / count * shBasisScale[c] * shBasisScale[c] * shCosineLobe[c];
+        probe.coefficients[c] = DirectX::XMFLOAT3( sums[c].x * scale, sums[c].y * scale, sums[c].z * scale );
+    }
+}
+
+DirectX::XMFLOAT3 evaluateIrradiance( const IrradianceProbe& probe, const DirectX::XMFLOAT3& normal )
+{
+    float polynomials[shCoefficientCount];
+    getShPolynomials( normal, polynomials );
+
+    DirectX::XMFLOAT3 irradiance( 0.0f, 0.0f, 0.0f );
+    for ( UINT c = 0; c < shCoefficientCount; c++ ) {
+        irradiance.x += probe.coefficients[c].x * polynomials[c];
+        irradiance.y += probe.coefficients[c].y * polynomials[c];
+        irradiance.z += probe.coefficients[c].z * polynomials[c];
+    }
+
+    // Ringing can dip below 0 opposite of strong light
+    return DirectX::XMFLOAT3( std::max( irradiance.x, 0.0f ), std::max( irradiance.y, 0.0f ), std::max( irradiance.z, 0.0f ) );
+}
+
+// * * * * * PROBE GRID * * * * * //
+void initProbeGrid( const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, float spacing, IrradianceProbeGrid& grid )
+{
+    grid.gridMin = boundsMin;
+    grid.spacing = std::max( spacing, 0.001f );
+    grid.sizeX = std::max( (UINT)ceilf( ( boundsMax.x - boundsMin.x ) / grid.spacing ) + 1, 2u );
+    grid.sizeY = std::max( (UINT)ceilf( ( boundsMax.y - boundsMin.y ) / grid.spacing ) + 1, 2u );
+    grid.sizeZ = std::max( (UINT)ceilf( ( boundsMax.z - boundsMin.z ) / grid.spacing ) + 1, 2u );
+
+    IrradianceProbe black;
+    ZeroMemory( &black, sizeof(IrradianceProbe) );
+    grid.probes.assign( grid.sizeX * grid.sizeY * grid.sizeZ, black );
+}
+
+DirectX::XMFLOAT3 sampleIrradiance( const IrradianceProbeGrid& grid, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal )
+{
+    if ( grid.probes.empty() )
+        return DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+
+    // Probe space, clamped like the shader's texture coordinates
+    const float inverseSpacing = 1.0f / grid.spacing;
+    const UINT sizes[3] = { grid.sizeX, grid.sizeY, grid.sizeZ };
+    const float coordinates[3] = { ( position.x - grid.gridMin.x ) * inverseSpacing, ( position.y - grid.gridMin.y ) * inverseSpacing, ( position.z - grid.gridMin.z ) * inverseSpacing };
+
+    UINT cell[3];
+    float fraction[3];
+    for ( UINT axis = 0; axis < 3; axis++ ) {
+        float coordinate = std::min( std::max( coordinates[axis], 0.0f ), (float)( sizes[axis] - 1 ) );
+        cell[axis] = std::min( (UINT)coordinate, sizes[axis] - 2 );
+        fraction[axis] = coordinate - cell[axis];
+    }
+
+    IrradianceProbe blended;
+    ZeroMemory( &blended, sizeof(IrradianceProbe) );
+    for ( UINT corner = 0; corner < 8; corner++ ) {
+        UINT dx = corner & 1, dy = ( corner >> 1 ) & 1, dz = corner >> 2;
+        float weight = ( dx ? fraction[0] : 1.0f - fraction[0] ) * ( dy ? fraction[1] : 1.0f - fraction[1] ) * ( dz ? fraction[2] : 1.0f - fraction[2] );
+        const IrradianceProbe& probe = grid.probes[( ( cell[2] + dz ) * grid.sizeY + cell[1] + dy ) * grid.sizeX + cell[0] + dx];
+
+        for ( UINT c = 0; c < shCoefficientCount; c++ ) {
+            blended.coefficients[c].x += probe.coefficients[c].x * weight;
+            blended.coefficients[c].y += probe.coefficients[c].y * weight;
+            blended.coefficients[c].z += probe.coefficients[c].z * weight;
+        }
+    }
+
+    return evaluateIrradiance( blended, normal );
+}
+
+// * * * * * GPU * * * * * //
+bool createProbeTexture( ID3D11Device* pDevice, const IrradianceProbeGrid& grid, ID3D11ShaderResourceView** ppSRV )
+{
+    *ppSRV = NULL;
+    if ( grid.probes.empty() )
+        return false;
+
+    // 27 floats + 1 unused per probe -> 7 texels, texel k of every probe in block k
+    const UINT texelsPerProbe = 7;
+    const UINT width = grid.sizeX * texelsPerProbe;
+    std::vector<DirectX::PackedVector::XMHALF4> texels( width * grid.sizeY * grid.sizeZ );
+
+    for ( UINT z = 0; z < grid.sizeZ; z++ ) {
+        for ( UINT y = 0; y < grid.sizeY; y++ ) {
+            for ( UINT x = 0; x < grid.sizeX; x++ ) {
+                float values[texelsPerProbe * 4] = {};
+                memcpy( values, grid.probes[( z * grid.sizeY + y ) * grid.sizeX + x].coefficients, sizeof(IrradianceProbe) );
+
+                for ( UINT k = 0; k < texelsPerProbe; k++ ) {
+                    UINT texel = ( z * grid.sizeY + y ) * width + k * grid.sizeX + x;
+                    DirectX::PackedVector::XMStoreHalf4( &texels[texel], DirectX::XMVectorSet( values[k * 4], values[k * 4 + 1], values[k * 4 + 2], values[k * 4 + 3] ) );
+                }
+            }
+        }
+    }
+
+    D3D11_TEXTURE3D_DESC textureDesc;
+    ZeroMemory( &textureDesc, sizeof(D3D11_TEXTURE3D_DESC) );
+
+                textureDesc.Width = width;
+                textureDesc.Height = grid.sizeY;
+                textureDesc.Depth = grid.sizeZ;
+                textureDesc.MipLevels = 1;
+                textureDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+                textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+                textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA textureData;
+    ZeroMemory( &textureData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                textureData.pSysMem = texels.data();
+                textureData.SysMemPitch = width * sizeof(DirectX::PackedVector::XMHALF4);
+                textureData.SysMemSlicePitch = width * grid.sizeY * sizeof(DirectX::PackedVector::XMHALF4);
+
+    ID3D11Texture3D* pTexture = NULL;
+    HRESULT hr = pDevice->CreateTexture3D( &textureDesc, &textureData, &pTexture );
+    if ( FAILED(hr) )
+        return false;
+
+    // The view keeps the texture alive
+    hr = pDevice->CreateShaderResourceView( pTexture, NULL, ppSRV );
+    pTexture->Release();
+
+    return SUCCEEDED(hr);
+}
+
+void getProbeConstants( const IrradianceProbeGrid& grid, cBufferProbes& constants )
+{
+    constants.probeGridMin() = grid.gridMin;
+    constants.probeInverseSpacing() = 1.0f / grid.spacing;
+    constants.probeGridSize() = DirectX::XMFLOAT3( (float)grid.sizeX, (float)grid.sizeY, (float)grid.sizeZ );
+}
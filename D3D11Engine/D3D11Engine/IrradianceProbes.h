@@ -0,0 +1,66 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "CBufferLayout.h"
+
+// Probe grid of the pixel shader (b6), main.cpp declares it to the shader
+#define PROBES_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMFLOAT3, probeGridMin )            /* world position of probe 0, 0, 0 */ \
+    FIELD( float, probeInverseSpacing ) \
+    FIELD( DirectX::XMFLOAT3, probeGridSize )           /* probes per axis, float for the shader's clamp */
+DECLARE_CBUFFER( cBufferProbes, PROBES_CBUFFER_FIELDS )
+
+// * * * Irradiance probes * * * //
+// Light arriving from every direction at a grid of points, stored as order 2 (L2) spherical
+// harmonics: 9 coefficients per channel. The radiance is projected once, then convolved with the
+// clamped cosine, so a surface with normal n gets its irradiance as one polynomial:
+//
+//     E(n) = c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz + c8 (x^2 - y^2)
+//
+// 9 MADs per channel. The basis constants and the cosine lobe are folded into the coefficients,
+// and E is divided by pi: a sky of radiance L gives L, like the lightmap (Lightmap.h).
+// Between probes the coefficients are blended trilinearly. bakeIrradianceProbes (Lightmap.h)
+// traces the probes against the static geometry.
+const UINT shCoefficientCount = 9;
+
+struct IrradianceProbe
+{
+    DirectX::XMFLOAT3 coefficients[shCoefficientCount];     // rgb
+};
+
+// sizeX * sizeY * sizeZ probes, spacing apart from gridMin, x fastest
+struct IrradianceProbeGrid
+{
+    DirectX::XMFLOAT3 gridMin;
+    float spacing;
+    UINT sizeX, sizeY, sizeZ;
+    std::vector<IrradianceProbe> probes;
+};
+
+// Probes covering boundsMin - boundsMax, at least 2 per axis
+void initProbeGrid( const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, float spacing, IrradianceProbeGrid& grid );
+
+// Radiance seen along count unit directions spread uniformly over the sphere -> probe
+void projectIrradiance( const DirectX::XMFLOAT3* pDirections, const DirectX::XMFLOAT3* pRadiance, UINT count, IrradianceProbe& probe );
+
+// The polynomial above
+DirectX::XMFLOAT3 evaluateIrradiance( const IrradianceProbe& probe, const DirectX::XMFLOAT3& normal );
+
+// Trilinear blend of the 8 probes around position (clamped to the grid), then evaluated.
+// Same as getProbeIrradiance in pixelShader.hlsl
+DirectX::XMFLOAT3 sampleIrradiance( const IrradianceProbeGrid& grid, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal );
+
+// * * * GPU * * * //
+// Texture3D, R16G16B16A16_FLOAT: the 27 coefficients of a probe are 7 texels, stored as 7 blocks of
+// sizeX texels side by side in x, so the sampler blends between probes within a block (t11)
+bool createProbeTexture( ID3D11Device* pDevice, const IrradianceProbeGrid& grid, ID3D11ShaderResourceView** ppSRV );
+void getProbeConstants( const IrradianceProbeGrid& grid, cBufferProbes& constants );
@@ -0,0 +1,114 @@
+#include "JobSystem.h"
+
+#include <stdio.h>
+
+thread_local bool JobSystem::insideJob = false;
+
+JobSystem::JobSystem()
+    : pJob( NULL ), pFunction( NULL ), count( 0 ), batchSize( 0 ), batchCount( 0 ), nextBatch( 0 ), generation( 0 ), activeWorkers( 0 ), quit( false )
+{
+}
+
+JobSystem::~JobSystem()
+{
+    release();
+}
+
+bool JobSystem::init( UINT threadCount )
+{
+    release();
+
+    if ( threadCount == 0 )
+        threadCount = std::thread::hardware_concurrency();
+    if ( threadCount == 0 )
+        threadCount = 1;
+
+    quit = false;
+    for ( UINT t = 1; t < threadCount; t++ )
+        workers.push_back( std::thread( &JobSystem::workerLoop, this ) );
+
+    char message[128];
+    sprintf_s( message, "[JobSystem] %u threads (%u workers + caller)\n", threadCount, threadCount - 1 );
+    OutputDebugStringA( message );
+    return true;
+}
+
+void JobSystem::release()
+{
+    if ( workers.empty() )
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        quit = true;
+    }
+    wakeCondition.notify_all();
+
+    for ( size_t t = 0; t < workers.size(); t++ )
+        workers[t].join();
+    workers.clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void JobSystem::run( UINT count, UINT batchSize, JobFunction pJob, const void* pFunction )
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        this->pJob = pJob;
+        this->pFunction = pFunction;
+        this->count = count;
+        this->batchSize = batchSize;
+        batchCount = ( count + batchSize - 1 ) / batchSize;
+        nextBatch.store( 0 );
+        generation++;
+    }
+    wakeCondition.notify_all();
+
+    insideJob = true;
+    runBatches();
+    insideJob = false;
+
+    // Every batch has been claimed, wait for the workers still running theirs. A worker that wakes
+    // up after the job was taken down finds no job and goes back to sleep.
+    std::unique_lock<std::mutex> lock( mutex );
+    doneCondition.wait( lock, [this]() { return activeWorkers == 0; } );
+    this->pJob = NULL;
+    this->pFunction = NULL;
+}
+
+void JobSystem::runBatches()
+{
+    for ( ;; ) {
+        UINT batch = nextBatch.fetch_add( 1 );
+        if ( batch >= batchCount )
+            break;
+
+        UINT begin = batch * batchSize;
+        UINT end = ( count - begin < batchSize ) ? count : begin + batchSize;
+        pJob( pFunction, begin, end );
+    }
+}
+
+void JobSystem::workerLoop()
+{
+    insideJob = true;
+    UINT64 seenGeneration = 0;
+
+    std::unique_lock<std::mutex> lock( mutex );
+    for ( ;; ) {
+        wakeCondition.wait( lock, [&]() { return quit || ( pJob && generation != seenGeneration ); } );
+        if ( quit )
+            break;
+
+        seenGeneration = generation;
+        activeWorkers++;
+        lock.unlock();
+
+        runBatches();
+
+        lock.lock();
+        if ( --activeWorkers == 0 )
+            doneCondition.notify_one();
+    }
+}
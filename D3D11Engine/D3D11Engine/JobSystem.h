@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Windows.h>
+
+// * * * Useful * * * //
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// * * * Persistent worker threads for data parallel loops * * * //
+// Workers sleep between jobs, so per frame work doesn't pay for creating threads. The calling
+// thread takes part in every job. One job runs at a time: parallelFor is meant to be called from
+// the main thread, calls made from inside a job run inline on the calling worker.
+class JobSystem
+{
+public:
+    JobSystem();
+    ~JobSystem();
+
+    // threadCount 0 = one thread per hardware thread (the caller counts as one)
+    bool init( UINT threadCount = 0 );
+    void release();
+
+    // Threads that work on a job, workers + caller
+    UINT getThreadCount() const { return (UINT)workers.size() + 1; }
+
+    // Calls function( begin, end ) for consecutive ranges of batchSize items (the last one may be
+    // shorter) and returns when all of them are done
+    template<typename Function>
+    void parallelFor( UINT count, UINT batchSize, const Function& function )
+    {
+        if ( count == 0 )
+            return;
+
+        if ( batchSize == 0 )
+            batchSize = 1;
+
+        // Same ranges inline, callers index per batch results by begin / batchSize
+        if ( workers.empty() || count <= batchSize || insideJob ) {
+            for ( UINT begin = 0; begin < count; begin += batchSize )
+                function( begin, count - begin > batchSize ? begin + batchSize : count );
+            return;
+        }
+
+        run( count, batchSize, &invoke<Function>, &function );
+    }
+
+private:
+    typedef void (*JobFunction)( const void* pFunction, UINT begin, UINT end );
+
+    template<typename Function>
+    static void invoke( const void* pFunction, UINT begin, UINT end )
+    {
+        ( *(const Function*)pFunction )( begin, end );
+    }
+
+    void run( UINT count, UINT batchSize, JobFunction pJob, const void* pFunction );
+    void runBatches();
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;  // workers: new job or shutdown
+    std::condition_variable doneCondition;  // caller: last worker left the job
+
+    // Current job, written under the mutex before the generation is bumped
+    JobFunction pJob;
+    const void* pFunction;
+    UINT count;
+    UINT batchSize;
+    UINT batchCount;
+    std::atomic<UINT> nextBatch;
+
+    UINT64 generation;
+    UINT activeWorkers;
+    bool quit;
+
+    static thread_local bool insideJob;
+};
@@ -0,0 +1,306 @@
+#include "Json.h"
+
+#include <charconv>
+#include <string.h>
+
+// Nesting limit, keeps malformed files from running the parser out of stack
+const UINT maxJsonDepth = 128;
+
+// * * * Recursive descent parser * * * //
+class JsonParser
+{
+public:
+    JsonParser( const char* pText, size_t length ) : p( pText ), pEnd( pText + length ), depth( 0 ) { }
+
+    bool parseDocument( JsonValue& root )
+    {
+        if ( !parseValue( root ) )
+            return false;
+
+        skipWhitespace();
+        return p == pEnd;
+    }
+
+private:
+    void skipWhitespace()
+    {
+        while ( p < pEnd && ( *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' ) )
+            p++;
+    }
+
+    bool consume( const char* literal )
+    {
+        size_t length = strlen( literal );
+        if ( (size_t)( pEnd - p ) < length || memcmp( p, literal, length ) != 0 )
+            return false;
+
+        p += length;
+        return true;
+    }
+
+    bool parseValue( JsonValue& value )
+    {
+        skipWhitespace();
+        if ( p == pEnd )
+            return false;
+
+        switch ( *p ) {
+        case '{': return parseObject( value );
+        case '[': return parseArray( value );
+        case '"': value.type = JSON_STRING; return parseString( value.string );
+        case 't': value.type = JSON_BOOL; value.boolean = true; return consume( "true" );
+        case 'f': value.type = JSON_BOOL; value.boolean = false; return consume( "false" );
+        case 'n': value.type = JSON_NULL; return consume( "null" );
+        default: return parseNumber( value );
+        }
+    }
+
+    bool parseNumber( JsonValue& value )
+    {
+        std::from_chars_result result = std::from_chars( p, pEnd, value.number );
+        if ( result.ec != std::errc() )
+            return false;
+
+        value.type = JSON_NUMBER;
+        p = result.ptr;
+        return true;
+    }
+
+    static void appendUtf8( std::string& text, UINT codePoint )
+    {
+        if ( codePoint < 0x80 ) {
+            text += (char)codePoint;
+        }
+        else if ( codePoint < 0x800 ) {
+            text += (char)( 0xC0 | ( codePoint >> 6 ) );
+            text += (char)( 0x80 | ( codePoint & 0x3F ) );
+        }
+        else if ( codePoint < 0x10000 ) {
+            text += (char)( 0xE0 | ( codePoint >> 12 ) );
+            text += (char)( 0x80 | ( ( codePoint >> 6 ) & 0x3F ) );
+            text += (char)( 0x80 | ( codePoint & 0x3F ) );
+        }
+        else {
+            text += (char)( 0xF0 | ( codePoint >> 18 ) );
+            text += (char)( 0x80 | ( ( codePoint >> 12 ) & 0x3F ) );
+            text += (char)( 0x80 | ( ( codePoint >> 6 ) & 0x3F ) );
+            text += (char)( 0x80 | ( codePoint & 0x3F ) );
+        }
+    }
+
+    bool parseHex4( UINT& value )
+    {
+        if ( pEnd - p < 4 )
+            return false;
+
+        value = 0;
+        for ( int i = 0; i < 4; i++, p++ ) {
+            char c = *p;
+            UINT digit;
+            if ( c >= '0' && c <= '9' ) digit = c - '0';
+            else if ( c >= 'a' && c <= 'f' ) digit = c - 'a' + 10;
+            else if ( c >= 'A' && c <= 'F' ) digit = c - 'A' + 10;
+            else return false;
+            value = ( value << 4 ) | digit;
+        }
+        return true;
+    }
+
+    bool parseString( std::string& text )
+    {
+        p++;                                        // opening quote
+        text.clear();
+
+        while ( p < pEnd && *p != '"' ) {
+            // - - - plain run - - - //
+            const char* pRun = p;
+            while ( p < pEnd && *p != '"' && *p != '\\' )
+                p++;
+            text.append( pRun, p );
+
+            if ( p == pEnd || *p == '"' )
+                break;
+
+            // - - - escape - - - //
+            p++;
+            if ( p == pEnd )
+                return false;
+
+            char c = *p++;
+            switch ( c ) {
+            case '"': text += '"'; break;
+            case '\\': text += '\\'; break;
+            case '/': text += '/'; break;
+            case 'b': text += '\b'; break;
+            case 'f': text += '\f'; break;
+            case 'n': text += '\n'; break;
+            case 'r': text += '\r'; break;
+            case 't': text += '\t'; break;
+            case 'u': {
+                UINT codePoint;
+                if ( !parseHex4( codePoint ) )
+                    return false;
+
+                // Surrogate pair
+                if ( codePoint >= 0xD800 && codePoint < 0xDC00 ) {
+                    UINT low;
+                    if ( !consume( "\\u" ) || !parseHex4( low ) || low < 0xDC00 || low >= 0xE000 )
+                        return false;
+                    codePoint = 0x10000 + ( ( codePoint - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+                }
+                appendUtf8( text, codePoint );
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+
+        if ( p == pEnd )
+            return false;
+
+        p++;                                        // closing quote
+        return true;
+    }
+
+    bool parseArray( JsonValue& value )
+    {
+        if ( ++depth > maxJsonDepth )
+            return false;
+
+        p++;
+        value.type = JSON_ARRAY;
+
+        skipWhitespace();
+        if ( p < pEnd && *p == ']' ) {
+            p++;
+            depth--;
+            return true;
+        }
+
+        for ( ;; ) {
+            value.elements.push_back( JsonValue() );
+            if ( !parseValue( value.elements.back() ) )
+                return false;
+
+            skipWhitespace();
+            if ( p == pEnd )
+                return false;
+            if ( *p == ']' )
+                break;
+            if ( *p != ',' )
+                return false;
+            p++;
+        }
+
+        p++;
+        depth--;
+        return true;
+    }
+
+    bool parseObject( JsonValue& value )
+    {
+        if ( ++depth > maxJsonDepth )
+            return false;
+
+        p++;
+        value.type = JSON_OBJECT;
+
+        skipWhitespace();
+        if ( p < pEnd && *p == '}' ) {
+            p++;
+            depth--;
+            return true;
+        }
+
+        for ( ;; ) {
+            skipWhitespace();
+            if ( p == pEnd || *p != '"' )
+                return false;
+
+            value.keys.push_back( std::string() );
+            if ( !parseString( value.keys.back() ) )
+                return false;
+
+            skipWhitespace();
+            if ( p == pEnd || *p != ':' )
+                return false;
+            p++;
+
+            value.elements.push_back( JsonValue() );
+            if ( !parseValue( value.elements.back() ) )
+                return false;
+
+            skipWhitespace();
+            if ( p == pEnd )
+                return false;
+            if ( *p == '}' )
+                break;
+            if ( *p != ',' )
+                return false;
+            p++;
+        }
+
+        p++;
+        depth--;
+        return true;
+    }
+
+    const char* p;
+    const char* pEnd;
+    UINT depth;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+const JsonValue* JsonValue::find( const char* key ) const
+{
+    if ( type != JSON_OBJECT )
+        return NULL;
+
+    for ( size_t i = 0; i < keys.size(); i++ ) {
+        if ( keys[i] == key )
+            return &elements[i];
+    }
+    return NULL;
+}
+
+double JsonValue::getNumber( const char* key, double fallback ) const
+{
+    const JsonValue* pValue = find( key );
+    return ( pValue && pValue->type == JSON_NUMBER ) ? pValue->number : fallback;
+}
+
+UINT JsonValue::getUInt( const char* key, UINT fallback ) const
+{
+    const JsonValue* pValue = find( key );
+    if ( !pValue || pValue->type != JSON_NUMBER || pValue->number < 0.0 || pValue->number > 4294967295.0 )
+        return fallback;
+    return (UINT)pValue->number;
+}
+
+bool JsonValue::getBool( const char* key, bool fallback ) const
+{
+    const JsonValue* pValue = find( key );
+    return ( pValue && pValue->type == JSON_BOOL ) ? pValue->boolean : fallback;
+}
+
+const char* JsonValue::getString( const char* key, const char* fallback ) const
+{
+    const JsonValue* pValue = find( key );
+    return ( pValue && pValue->type == JSON_STRING ) ? pValue->string.c_str() : fallback;
+}
+
+bool parseJson( const char* pText, size_t length, JsonValue& root )
+{
+    root = JsonValue();
+
+    // UTF-8 byte order mark
+    if ( length >= 3 && memcmp( pText, "\xEF\xBB\xBF", 3 ) == 0 ) {
+        pText += 3;
+        length -= 3;
+    }
+
+    JsonParser parser( pText, length );
+    return parser.parseDocument( root );
+}
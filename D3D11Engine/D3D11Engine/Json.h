@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Windows.h>
+
+// * * * Useful * * * //
+#include <string>
+#include <vector>
+
+// * * * Minimal JSON DOM (glTF import) * * * //
+// Strings are kept as UTF-8, numbers as double. Objects keep their members in file order.
+
+enum JsonType
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+struct JsonValue
+{
+    JsonValue() : type( JSON_NULL ), number( 0.0 ), boolean( false ) { }
+
+    JsonType type;
+    double number;
+    bool boolean;
+    std::string string;
+    std::vector<std::string> keys;          // object member names, keys[i] belongs to elements[i]
+    std::vector<JsonValue> elements;        // array elements / object member values
+
+    bool isArray() const { return type == JSON_ARRAY; }
+    bool isObject() const { return type == JSON_OBJECT; }
+    size_t size() const { return elements.size(); }
+    const JsonValue& operator[]( size_t index ) const { return elements[index]; }
+
+    // Object member, NULL when this isn't an object or has no such member
+    const JsonValue* find( const char* key ) const;
+
+    // Typed member access, fallback when missing or of another type
+    double getNumber( const char* key, double fallback ) const;
+    UINT getUInt( const char* key, UINT fallback ) const;
+    bool getBool( const char* key, bool fallback ) const;
+    const char* getString( const char* key, const char* fallback ) const;
+};
+
+bool parseJson( const char* pText, size_t length, JsonValue& root );
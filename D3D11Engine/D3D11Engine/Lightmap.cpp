@@ -0,0 +1,1262 @@
+#include "Lightmap.h"
+
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <xmmintrin.h>
+#include <atomic>
+#include <algorithm>
+
+#include "Bvh.h"
+#include "JobSystem.h"
+#include "Timer.h"
+
+const UINT lightmapBakerVersion = 1;        // part of the bake hash, bump when the baked result changes
+const UINT texelsPerTraceBatch = 64;
+const UINT rowsPerDenoiseBatch = 4;
+const UINT probesPerTraceBatch = 4;
+const float insideProbeShare = 0.25f;       // more back face hits than this: the probe sits inside geometry
+const UINT maxPackAttempts = 32;
+const float packShrink = 0.9f;              // texelsPerUnit per failed packing attempt
+const UINT traceStackSize = 128;
+const float rayMaxDistance = 1.0e30f;
+
+LightmapBakeSettings::LightmapBakeSettings()
+    : width( 256 ), height( 256 ), texelsPerUnit( 32.0f ), padding( 2 ), chartAngle( DirectX::XM_PIDIV4 ), bounceRays( 64 ),
+      skyColor( 0.2f, 0.2f, 0.2f ), denoiseRadius( 3 ), rayBias( 0.002f )
+{
+}
+
+// Orthonormal tangent / bitangent for a unit normal (branchless, Duff et al. 2017)
+static void getTangentFrame( const DirectX::XMFLOAT3& n, DirectX::XMFLOAT3& tangent, DirectX::XMFLOAT3& bitangent )
+{
+    float sign = copysignf( 1.0f, n.z );
+    float a = -1.0f / ( sign + n.z );
+    float b = n.x * n.y * a;
+    tangent = DirectX::XMFLOAT3( 1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x );
+    bitangent = DirectX::XMFLOAT3( b, sign + n.y * n.y * a, -n.y );
+}
+
+static float dot3( const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b )
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Clockwise seen from the front (left handed), like every mesh of the engine
+static DirectX::XMFLOAT3 getFaceNormal( const DirectX::XMFLOAT3& p0, const DirectX::XMFLOAT3& p1, const DirectX::XMFLOAT3& p2 )
+{
+    DirectX::XMVECTOR v0 = DirectX::XMLoadFloat3( &p0 );
+    DirectX::XMVECTOR cross = DirectX::XMVector3Cross( DirectX::XMVectorSubtract( DirectX::XMLoadFloat3( &p1 ), v0 ), DirectX::XMVectorSubtract( DirectX::XMLoadFloat3( &p2 ), v0 ) );
+
+    DirectX::XMFLOAT3 normal( 0.0f, 0.0f, 0.0f );
+    if ( DirectX::XMVectorGetX( DirectX::XMVector3LengthSq( cross ) ) > 1.0e-20f )
+        DirectX::XMStoreFloat3( &normal, DirectX::XMVector3Normalize( cross ) );
+    return normal;
+}
+
+static float getLuminance( DirectX::FXMVECTOR color )
+{
+    return DirectX::XMVectorGetX( DirectX::XMVector3Dot( color, DirectX::XMVectorSet( 0.2126f, 0.7152f, 0.0722f, 0.0f ) ) );
+}
+
+// * * * * * UNWRAP * * * * * //
+struct LightmapChart
+{
+    UINT mesh;
+    std::vector<UINT> triangles;
+    DirectX::XMFLOAT3 axisU, axisV;     // projection plane
+    float minU, minV;                   // world units along the axes
+    float sizeU, sizeV;
+    UINT x, y;                          // atlas texels, padding included
+    UINT width, height;
+};
+
+// Size in the atlas at texelsPerUnit: the chart starts on a texel center, padding on every side
+static void sizeChart( LightmapChart& chart, float texelsPerUnit, UINT padding )
+{
+    chart.width = (UINT)ceilf( chart.sizeU * texelsPerUnit ) + 1 + 2 * padding;
+    chart.height = (UINT)ceilf( chart.sizeV * texelsPerUnit ) + 1 + 2 * padding;
+}
+
+// Triangles flood filled over shared edges (welded positions) while they face within chartAngle of the first one
+static void buildCharts( const MeshData& mesh, UINT meshIndex, float cosChartAngle, std::vector<LightmapChart>& charts )
+{
+    const UINT invalid = 0xFFFFFFFF;
+    UINT vertexCount = (UINT)mesh.vertices.size();
+    UINT triangleCount = (UINT)mesh.indices.size() / 3;
+
+    // - - - welded vertex ids, split vertices (UV / normal seams) still connect triangles - - - //
+    std::vector<UINT> sorted( vertexCount );
+    for ( UINT v = 0; v < vertexCount; v++ )
+        sorted[v] = v;
+
+    auto positionLess = [&]( UINT a, UINT b ) {
+        const DirectX::XMFLOAT3& pa = mesh.vertices[a].pos;
+        const DirectX::XMFLOAT3& pb = mesh.vertices[b].pos;
+        if ( pa.x != pb.x ) return pa.x < pb.x;
+        if ( pa.y != pb.y ) return pa.y < pb.y;
+        return pa.z < pb.z;
+    };
+    std::sort( sorted.begin(), sorted.end(), positionLess );
+
+    std::vector<UINT> positionIds( vertexCount );
+    UINT positionCount = 0;
+    for ( UINT i = 0; i < vertexCount; i++ ) {
+        if ( i > 0 && positionLess( sorted[i - 1], sorted[i] ) )
+            positionCount++;
+        positionIds[sorted[i]] = positionCount;
+    }
+
+    // - - - triangles sharing an edge - - - //
+    struct Edge
+    {
+        UINT a, b;
+        UINT triangle;
+    };
+
+    std::vector<Edge> edges;
+    edges.reserve( triangleCount * 3 );
+    for ( UINT t = 0; t < triangleCount; t++ ) {
+        for ( UINT e = 0; e < 3; e++ ) {
+            UINT a = positionIds[mesh.indices[t * 3 + e]];
+            UINT b = positionIds[mesh.indices[t * 3 + ( e + 1 ) % 3]];
+            if ( a == b )
+                continue;
+
+            Edge edge = { std::min( a, b ), std::max( a, b ), t };
+            edges.push_back( edge );
+        }
+    }
+    std::sort( edges.begin(), edges.end(), []( const Edge& l, const Edge& r ) {
+        return l.a != r.a ? l.a < r.a : ( l.b != r.b ? l.b < r.b : l.triangle < r.triangle );
+    } );
+
+    std::vector<std::vector<UINT>> neighbours( triangleCount );
+    for ( size_t begin = 0; begin < edges.size(); ) {
+        size_t end = begin + 1;
+        while ( end < edges.size() && edges[end].a == edges[begin].a && edges[end].b == edges[begin].b )
+            end++;
+
+        for ( size_t i = begin; i < end; i++ ) {
+            for ( size_t j = begin; j < end; j++ ) {
+                if ( i != j )
+                    neighbours[edges[i].triangle].push_back( edges[j].triangle );
+            }
+        }
+        begin = end;
+    }
+
+    std::vector<DirectX::XMFLOAT3> faceNormals( triangleCount );
+    for ( UINT t = 0; t < triangleCount; t++ ) {
+        faceNormals[t] = getFaceNormal( mesh.vertices[mesh.indices[t * 3]].pos, mesh.vertices[mesh.indices[t * 3 + 1]].pos, mesh.vertices[mesh.indices[t * 3 + 2]].pos );
+
+        // Degenerate: no area, so it never gets texels, the vertex normal keeps it in a sensible chart
+        if ( dot3( faceNormals[t], faceNormals[t] ) == 0.0f )
+            faceNormals[t] = mesh.vertices[mesh.indices[t * 3]].normal;
+    }
+
+    // - - - flood fill - - - //
+    std::vector<UINT> triangleCharts( triangleCount, invalid );
+    std::vector<UINT> stack;
+
+    for ( UINT seed = 0; seed < triangleCount; seed++ ) {
+        if ( triangleCharts[seed] != invalid )
+            continue;
+
+        UINT chartIndex = (UINT)charts.size();
+        charts.push_back( LightmapChart() );
+        LightmapChart& chart = charts.back();
+        chart.mesh = meshIndex;
+
+        // Every triangle is within chartAngle of the seed, so the seed's plane never sees one edge on
+        DirectX::XMFLOAT3 normal = faceNormals[seed];
+        if ( dot3( normal, normal ) < 0.5f )
+            normal = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+        getTangentFrame( normal, chart.axisU, chart.axisV );
+
+        triangleCharts[seed] = chartIndex;
+        stack.push_back( seed );
+        while ( !stack.empty() ) {
+            UINT t = stack.back();
+            stack.pop_back();
+            chart.triangles.push_back( t );
+
+            for ( size_t n = 0; n < neighbours[t].size(); n++ ) {
+                UINT neighbour = neighbours[t][n];
+                if ( triangleCharts[neighbour] == invalid && dot3( faceNormals[neighbour], normal ) >= cosChartAngle ) {
+                    triangleCharts[neighbour] = chartIndex;
+                    stack.push_back( neighbour );
+                }
+            }
+        }
+        std::sort( chart.triangles.begin(), chart.triangles.end() );
+
+        // - - - world space extent on the plane - - - //
+        float maxU = -FLT_MAX, maxV = -FLT_MAX;
+        chart.minU = FLT_MAX;
+        chart.minV = FLT_MAX;
+        for ( size_t i = 0; i < chart.triangles.size(); i++ ) {
+            for ( UINT c = 0; c < 3; c++ ) {
+                const DirectX::XMFLOAT3& position = mesh.vertices[mesh.indices[chart.triangles[i] * 3 + c]].pos;
+                float u = dot3( position, chart.axisU );
+                float v = dot3( position, chart.axisV );
+                chart.minU = std::min( chart.minU, u );
+                chart.minV = std::min( chart.minV, v );
+                maxU = std::max( maxU, u );
+                maxV = std::max( maxV, v );
+            }
+        }
+        chart.sizeU = maxU - chart.minU;
+        chart.sizeV = maxV - chart.minV;
+    }
+}
+
+// Skyline: every chart, tallest first, goes where it ends up lowest (then leftmost) on top of the
+// charts already placed, so short charts fill the room next to tall ones
+static bool packCharts( std::vector<LightmapChart>& charts, const std::vector<UINT>& order, UINT width, UINT height )
+{
+    std::vector<UINT> skyline( width, 0 );     // per texel column, first free row
+
+    for ( size_t i = 0; i < order.size(); i++ ) {
+        LightmapChart& chart = charts[order[i]];
+        if ( chart.width > width || chart.height > height )
+            return false;
+
+        UINT bestX = 0, bestY = UINT_MAX;
+        for ( UINT x = 0; x + chart.width <= width; x++ ) {
+            UINT y = 0;
+            for ( UINT column = x; column < x + chart.width && y < bestY; column++ )
+                y = std::max( y, skyline[column] );
+
+            if ( y < bestY ) {
+                bestX = x;
+                bestY = y;
+            }
+        }
+
+        if ( bestY + chart.height > height )
+            return false;
+
+        chart.x = bestX;
+        chart.y = bestY;
+        for ( UINT column = bestX; column < bestX + chart.width; column++ )
+            skyline[column] = bestY + chart.height;
+    }
+    return true;
+}
+
+bool unwrapLightmap( LightmapMesh* pMeshes, UINT meshCount, const LightmapBakeSettings& settings, LightmapBakeStats& stats )
+{
+    Timer timer;
+
+    std::vector<LightmapChart> charts;
+    for ( UINT m = 0; m < meshCount; m++ )
+        buildCharts( pMeshes[m].mesh, m, cosf( settings.chartAngle ), charts );
+
+    // - - - atlas: same density for every chart, lowered until everything fits - - - //
+    std::vector<UINT> order( charts.size() );
+    bool packed = false;
+    float texelsPerUnit = settings.texelsPerUnit;
+    for ( UINT attempt = 0; attempt < maxPackAttempts && !packed; attempt++ ) {
+        if ( attempt > 0 )
+            texelsPerUnit *= packShrink;
+
+        for ( size_t c = 0; c < charts.size(); c++ ) {
+            sizeChart( charts[c], texelsPerUnit, settings.padding );
+            order[c] = (UINT)c;
+        }
+        std::sort( order.begin(), order.end(), [&]( UINT a, UINT b ) {
+            return charts[a].height != charts[b].height ? charts[a].height > charts[b].height : charts[a].width > charts[b].width;
+        } );
+
+        packed = packCharts( charts, order, settings.width, settings.height );
+    }
+
+    if ( !packed ) {
+        char message[160];
+        sprintf_s( message, "[Lightmap] %u charts don't fit %u x %u texels\n", (UINT)charts.size(), settings.width, settings.height );
+        OutputDebugStringA( message );
+        return false;
+    }
+
+    // - - - vertices split per chart, lightmap UV = chart position + plane projection - - - //
+    for ( UINT m = 0; m < meshCount; m++ ) {
+        const MeshData source = pMeshes[m].mesh;
+        MeshData& mesh = pMeshes[m].mesh;
+        std::vector<DirectX::XMFLOAT2>& lightmapUvs = pMeshes[m].lightmapUvs;
+
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        lightmapUvs.clear();
+
+        const UINT invalid = 0xFFFFFFFF;
+        std::vector<UINT> remap( source.vertices.size(), invalid );
+        std::vector<UINT> remapChart( source.vertices.size(), invalid );
+
+        for ( UINT c = 0; c < (UINT)charts.size(); c++ ) {
+            const LightmapChart& chart = charts[c];
+            if ( chart.mesh != m )
+                continue;
+
+            for ( size_t i = 0; i < chart.triangles.size(); i++ ) {
+                for ( UINT corner = 0; corner < 3; corner++ ) {
+                    UINT v = source.indices[chart.triangles[i] * 3 + corner];
+                    if ( remapChart[v] != c ) {
+                        const DirectX::XMFLOAT3& position = source.vertices[v].pos;
+                        float s = chart.x + settings.padding + 0.5f + ( dot3( position, chart.axisU ) - chart.minU ) * texelsPerUnit;
+                        float t = chart.y + settings.padding + 0.5f + ( dot3( position, chart.axisV ) - chart.minV ) * texelsPerUnit;
+
+                        remapChart[v] = c;
+                        remap[v] = (UINT)mesh.vertices.size();
+                        mesh.vertices.push_back( source.vertices[v] );
+                        lightmapUvs.push_back( DirectX::XMFLOAT2( s / settings.width, t / settings.height ) );
+                    }
+                    mesh.indices.push_back( remap[v] );
+                }
+            }
+        }
+    }
+
+    stats.charts = (UINT)charts.size();
+    stats.texelsPerUnit = texelsPerUnit;
+    stats.unwrapMs = timer.elapsedMs();
+    return true;
+}
+
+// * * * * * RAY TRACING * * * * * //
+// Four triangles of a BVH leaf as SSE lanes: v0, edge1 = v1 - v0, edge2 = v2 - v0 per axis
+struct alignas(16) TrianglePacket
+{
+    __m128 v0[3];
+    __m128 edge1[3];
+    __m128 edge2[3];
+    UINT triangles[4];
+};
+
+struct LightmapScene
+{
+    Bvh bvh;
+    std::vector<TrianglePacket> packets;        // leaves' triangles in leaf order
+    std::vector<UINT> nodePackets;              // per node, its first packet (leaves only)
+    std::vector<DirectX::XMFLOAT3> faceNormals; // per triangle
+    std::vector<DirectX::XMFLOAT3> albedos;
+};
+
+struct LightmapRay
+{
+    DirectX::XMFLOAT3 origin, direction, invDirection;
+    __m128 lanesOrigin[3], lanesDirection[3];
+};
+
+static void setRay( LightmapRay& ray, const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction )
+{
+    ray.origin = origin;
+    ray.direction = direction;
+    ray.invDirection = DirectX::XMFLOAT3( 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z );
+
+    const float* pOrigin = &origin.x;
+    const float* pDirection = &direction.x;
+    for ( UINT axis = 0; axis < 3; axis++ ) {
+        ray.lanesOrigin[axis] = _mm_set1_ps( pOrigin[axis] );
+        ray.lanesDirection[axis] = _mm_set1_ps( pDirection[axis] );
+    }
+}
+
+static void buildLightmapScene( const LightmapMesh* pMeshes, UINT meshCount, LightmapScene& scene, JobSystem* pJobSystem )
+{
+    std::vector<DirectX::XMFLOAT3> corners;
+    std::vector<DirectX::XMFLOAT3> mins, maxs;
+
+    for ( UINT m = 0; m < meshCount; m++ ) {
+        const MeshData& mesh = pMeshes[m].mesh;
+        for ( size_t i = 0; i + 2 < mesh.indices.size(); i += 3 ) {
+            DirectX::XMFLOAT3 p[3];
+            for ( UINT c = 0; c < 3; c++ ) {
+                p[c] = mesh.vertices[mesh.indices[i + c]].pos;
+                corners.push_back( p[c] );
+            }
+
+            mins.push_back( DirectX::XMFLOAT3( std::min( p[0].x, std::min( p[1].x, p[2].x ) ), std::min( p[0].y, std::min( p[1].y, p[2].y ) ), std::min( p[0].z, std::min( p[1].z, p[2].z ) ) ) );
+            maxs.push_back( DirectX::XMFLOAT3( std::max( p[0].x, std::max( p[1].x, p[2].x ) ), std::max( p[0].y, std::max( p[1].y, p[2].y ) ), std::max( p[0].z, std::max( p[1].z, p[2].z ) ) ) );
+            scene.faceNormals.push_back( getFaceNormal( p[0], p[1], p[2] ) );
+            scene.albedos.push_back( pMeshes[m].albedo );
+        }
+    }
+
+    scene.bvh.build( mins.data(), maxs.data(), (UINT)mins.size(), pJobSystem );
+
+    // - - - leaves into packets, unused lanes are degenerate (zero edges never hit) - - - //
+    scene.nodePackets.assign( scene.bvh.getNodeCount(), 0 );
+    for ( UINT n = 0; n < scene.bvh.getNodeCount(); n++ ) {
+        const BvhNode& node = scene.bvh.getNode( n );
+        if ( node.leftChild != BVH_LEAF )
+            continue;
+
+        scene.nodePackets[n] = (UINT)scene.packets.size();
+        for ( UINT first = 0; first < node.objectCount; first += 4 ) {
+            float lanes[9][4] = {};
+            TrianglePacket packet;
+            for ( UINT lane = 0; lane < 4; lane++ ) {
+                packet.triangles[lane] = 0;
+                if ( first + lane >= node.objectCount )
+                    continue;
+
+                UINT triangle = scene.bvh.getOrderedObject( node.firstObject + first + lane );
+                const DirectX::XMFLOAT3* p = &corners[triangle * 3];
+                packet.triangles[lane] = triangle;
+
+                lanes[0][lane] = p[0].x;            lanes[1][lane] = p[0].y;            lanes[2][lane] = p[0].z;
+                lanes[3][lane] = p[1].x - p[0].x;   lanes[4][lane] = p[1].y - p[0].y;   lanes[5][lane] = p[1].z - p[0].z;
+                lanes[6][lane] = p[2].x - p[0].x;   lanes[7][lane] = p[2].y - p[0].y;   lanes[8][lane] = p[2].z - p[0].z;
+            }
+
+            for ( UINT axis = 0; axis < 3; axis++ ) {
+                packet.v0[axis] = _mm_loadu_ps( lanes[axis] );
+                packet.edge1[axis] = _mm_loadu_ps( lanes[3 + axis] );
+                packet.edge2[axis] = _mm_loadu_ps( lanes[6 + axis] );
+            }
+            scene.packets.push_back( packet );
+        }
+    }
+}
+
+static float rayNodeEntry( const BvhNode& node, const LightmapRay& ray, float maxDistance )
+{
+    const float* pMin = &node.boundsMin.x;
+    const float* pMax = &node.boundsMax.x;
+    const float* pOrigin = &ray.origin.x;
+    const float* pInv = &ray.invDirection.x;
+
+    float tNear = 0.0f, tFar = maxDistance;
+    for ( UINT axis = 0; axis < 3; axis++ ) {
+        float t0 = ( pMin[axis] - pOrigin[axis] ) * pInv[axis];
+        float t1 = ( pMax[axis] - pOrigin[axis] ) * pInv[axis];
+        if ( t0 > t1 )
+            std::swap( t0, t1 );
+
+        // NaN (origin on a slab of a parallel axis) fails both compares and leaves the interval alone
+        if ( t0 > tNear ) tNear = t0;
+        if ( t1 < tFar ) tFar = t1;
+    }
+    return ( tNear <= tFar ) ? tNear : FLT_MAX;
+}
+
+// Moller-Trumbore against four triangles, both sides. Returns the lanes hit at 0 < t < maxDistance,
+// zero area lanes divide by zero and fail every compare
+static int intersectPacket( const TrianglePacket& packet, const LightmapRay& ray, __m128 maxDistance, __m128& t )
+{
+    const __m128* d = ray.lanesDirection;
+    const __m128* e1 = packet.edge1;
+    const __m128* e2 = packet.edge2;
+
+    __m128 px = _mm_sub_ps( _mm_mul_ps( d[1], e2[2] ), _mm_mul_ps( d[2], e2[1] ) );
+    __m128 py = _mm_sub_ps( _mm_mul_ps( d[2], e2[0] ), _mm_mul_ps( d[0], e2[2] ) );
+    __m128 pz = _mm_sub_ps( _mm_mul_ps( d[0], e2[1] ), _mm_mul_ps( d[1], e2[0] ) );
+    __m128 det = _mm_add_ps( _mm_add_ps( _mm_mul_ps( e1[0], px ), _mm_mul_ps( e1[1], py ) ), _mm_mul_ps( e1[2], pz ) );
+    __m128 invDet = _mm_div_ps( _mm_set1_ps( 1.0f ), det );
+
+    __m128 sx = _mm_sub_ps( ray.lanesOrigin[0], packet.v0[0] );
+    __m128 sy = _mm_sub_ps( ray.lanesOrigin[1], packet.v0[1] );
+    __m128 sz = _mm_sub_ps( ray.lanesOrigin[2], packet.v0[2] );
+    __m128 u = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( sx, px ), _mm_mul_ps( sy, py ) ), _mm_mul_ps( sz, pz ) ), invDet );
+
+    __m128 qx = _mm_sub_ps( _mm_mul_ps( sy, e1[2] ), _mm_mul_ps( sz, e1[1] ) );
+    __m128 qy = _mm_sub_ps( _mm_mul_ps( sz, e1[0] ), _mm_mul_ps( sx, e1[2] ) );
+    __m128 qz = _mm_sub_ps( _mm_mul_ps( sx, e1[1] ), _mm_mul_ps( sy, e1[0] ) );
+    __m128 v = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( d[0], qx ), _mm_mul_ps( d[1], qy ) ), _mm_mul_ps( d[2], qz ) ), invDet );
+    t = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( e2[0], qx ), _mm_mul_ps( e2[1], qy ) ), _mm_mul_ps( e2[2], qz ) ), invDet );
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 hit = _mm_and_ps( _mm_cmpge_ps( u, zero ), _mm_cmpge_ps( v, zero ) );
+    hit = _mm_and_ps( hit, _mm_cmple_ps( _mm_add_ps( u, v ), _mm_set1_ps( 1.0f ) ) );
+    hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpgt_ps( t, zero ), _mm_cmplt_ps( t, maxDistance ) ) );
+    return _mm_movemask_ps( hit );
+}
+
+// Closest triangle, near child first so far subtrees are mostly skipped
+static bool traceClosest( const LightmapScene& scene, const LightmapRay& ray, float maxDistance, UINT& triangle, float& distance )
+{
+    UINT stack[traceStackSize];
+    UINT stackSize = 0;
+    float closest = maxDistance;
+    bool found = false;
+
+    if ( rayNodeEntry( scene.bvh.getNode( 0 ), ray, closest ) != FLT_MAX )
+        stack[stackSize++] = 0;
+
+    while ( stackSize > 0 ) {
+        UINT nodeIndex = stack[--stackSize];
+        const BvhNode& node = scene.bvh.getNode( nodeIndex );
+
+        // Pushed before a closer hit was found
+        if ( rayNodeEntry( node, ray, closest ) == FLT_MAX )
+            continue;
+
+        if ( node.leftChild == BVH_LEAF ) {
+            UINT packetCount = ( node.objectCount + 3 ) / 4;
+            for ( UINT p = 0; p < packetCount; p++ ) {
+                const TrianglePacket& packet = scene.packets[scene.nodePackets[nodeIndex] + p];
+
+                __m128 t;
+                int mask = intersectPacket( packet, ray, _mm_set1_ps( closest ), t );
+                if ( !mask )
+                    continue;
+
+                float distances[4];
+                _mm_storeu_ps( distances, t );
+                for ( UINT lane = 0; lane < 4; lane++ ) {
+                    if ( ( mask & ( 1 << lane ) ) && distances[lane] < closest ) {
+                        closest = distances[lane];
+                        triangle = packet.triangles[lane];
+                        found = true;
+                    }
+                }
+            }
+            continue;
+        }
+
+        UINT left = node.leftChild, right = node.leftChild + 1;
+        float leftEntry = rayNodeEntry( scene.bvh.getNode( left ), ray, closest );
+        float rightEntry = rayNodeEntry( scene.bvh.getNode( right ), ray, closest );
+        if ( leftEntry > rightEntry ) {
+            std::swap( left, right );
+            std::swap( leftEntry, rightEntry );
+        }
+
+        assert( stackSize + 2 <= traceStackSize );
+        if ( rightEntry != FLT_MAX )
+            stack[stackSize++] = right;
+        if ( leftEntry != FLT_MAX )
+            stack[stackSize++] = left;
+    }
+
+    distance = closest;
+    return found;
+}
+
+// Any triangle before maxDistance
+static bool traceOccluded( const LightmapScene& scene, const LightmapRay& ray, float maxDistance )
+{
+    UINT stack[traceStackSize];
+    UINT stackSize = 0;
+    __m128 lanesMaxDistance = _mm_set1_ps( maxDistance );
+
+    if ( rayNodeEntry( scene.bvh.getNode( 0 ), ray, maxDistance ) != FLT_MAX )
+        stack[stackSize++] = 0;
+
+    while ( stackSize > 0 ) {
+        UINT nodeIndex = stack[--stackSize];
+        const BvhNode& node = scene.bvh.getNode( nodeIndex );
+
+        if ( node.leftChild == BVH_LEAF ) {
+            UINT packetCount = ( node.objectCount + 3 ) / 4;
+            for ( UINT p = 0; p < packetCount; p++ ) {
+                __m128 t;
+                if ( intersectPacket( scene.packets[scene.nodePackets[nodeIndex] + p], ray, lanesMaxDistance, t ) )
+                    return true;
+            }
+            continue;
+        }
+
+        assert( stackSize + 2 <= traceStackSize );
+        for ( UINT child = node.leftChild; child <= node.leftChild + 1; child++ ) {
+            if ( rayNodeEntry( scene.bvh.getNode( child ), ray, maxDistance ) != FLT_MAX )
+                stack[stackSize++] = child;
+        }
+    }
+
+    return false;
+}
+
+// Light arriving at a surface point, dynamicLight = the part from lights with a runtime shadow map
+static DirectX::XMVECTOR computeDirectLight( const LightmapScene& scene, const LightmapLight* pLights, UINT lightCount, const DirectX::XMFLOAT3& position,
+                                             const DirectX::XMFLOAT3& normal, float rayBias, DirectX::XMVECTOR& dynamicLight, UINT64& rayCount )
+{
+    DirectX::XMVECTOR light = DirectX::XMVectorZero();
+    dynamicLight = DirectX::XMVectorZero();
+
+    DirectX::XMFLOAT3 origin( position.x + normal.x * rayBias, position.y + normal.y * rayBias, position.z + normal.z * rayBias );
+
+    for ( UINT l = 0; l < lightCount; l++ ) {
+        const LightmapLight& source = pLights[l];
+        DirectX::XMFLOAT3 toLight( source.position.x - origin.x, source.position.y - origin.y, source.position.z - origin.z );
+        float distance = sqrtf( dot3( toLight, toLight ) );
+        if ( distance <= rayBias )
+            continue;
+
+        DirectX::XMFLOAT3 direction( toLight.x / distance, toLight.y / distance, toLight.z / distance );
+        float cosine = dot3( normal, direction );
+        if ( cosine <= 0.0f )
+            continue;
+
+        LightmapRay ray;
+        setRay( ray, origin, direction );
+        rayCount++;
+        if ( traceOccluded( scene, ray, distance ) )
+            continue;
+
+        float attenuation = source.attenuation.x + source.attenuation.y * distance + source.attenuation.z * distance * distance;
+        DirectX::XMVECTOR contribution = DirectX::XMVectorScale( DirectX::XMLoadFloat3( &source.color ), source.intensity * cosine / attenuation );
+
+        light = DirectX::XMVectorAdd( light, contribution );
+        if ( source.dynamicShadows )
+            dynamicLight = DirectX::XMVectorAdd( dynamicLight, contribution );
+    }
+
+    return light;
+}
+
+// Per texel seed, the bake doesn't depend on how texels are spread over threads
+static UINT hashTexel( UINT x )
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static float nextRandom( UINT& state )
+{
+    state = state * 1664525u + 1013904223u;
+    return ( state >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+// One bounce: cosine weighted rays, stratified on a square grid. Hits reflect their direct light, misses see the sky
+static DirectX::XMVECTOR computeBounceLight( const LightmapScene& scene, const LightmapLight* pLights, UINT lightCount, const LightmapBakeSettings& settings,
+                                             const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal, UINT seed, UINT64& rayCount )
+{
+    UINT strata = (UINT)sqrtf( (float)settings.bounceRays );
+    if ( strata == 0 )
+        return DirectX::XMVectorZero();
+
+    DirectX::XMFLOAT3 tangent, bitangent;
+    getTangentFrame( normal, tangent, bitangent );
+    DirectX::XMFLOAT3 origin( position.x + normal.x * settings.rayBias, position.y + normal.y * settings.rayBias, position.z + normal.z * settings.rayBias );
+
+    DirectX::XMVECTOR sky = DirectX::XMLoadFloat3( &settings.skyColor );
+    DirectX::XMVECTOR sum = DirectX::XMVectorZero();
+    UINT random = hashTexel( seed );
+
+    for ( UINT sy = 0; sy < strata; sy++ ) {
+        for ( UINT sx = 0; sx < strata; sx++ ) {
+            float u1 = ( sx + nextRandom( random ) ) / strata;
+            float u2 = ( sy + nextRandom( random ) ) / strata;
+            float r = sqrtf( u1 );
+            float phi = DirectX::XM_2PI * u2;
+            float lx = r * cosf( phi ), ly = r * sinf( phi ), lz = sqrtf( std::max( 0.0f, 1.0f - u1 ) );
+
+            DirectX::XMFLOAT3 direction( tangent.x * lx + bitangent.x * ly + normal.x * lz,
+                                         tangent.y * lx + bitangent.y * ly + normal.y * lz,
+                                         tangent.z * lx + bitangent.z * ly + normal.z * lz );
+
+            LightmapRay ray;
+            setRay( ray, origin, direction );
+            rayCount++;
+
+            UINT triangle;
+            float distance;
+            if ( !traceClosest( scene, ray, rayMaxDistance, triangle, distance ) ) {
+                sum = DirectX::XMVectorAdd( sum, sky );
+                continue;
+            }
+
+            // Back side: the ray started inside closed geometry (e.g. floor under a box), nothing arrives
+            const DirectX::XMFLOAT3& hitNormal = scene.faceNormals[triangle];
+            if ( dot3( hitNormal, direction ) >= 0.0f )
+                continue;
+
+            DirectX::XMFLOAT3 hitPosition( origin.x + direction.x * distance, origin.y + direction.y * distance, origin.z + direction.z * distance );
+            DirectX::XMVECTOR dynamicLight;
+            DirectX::XMVECTOR hitLight = computeDirectLight( scene, pLights, lightCount, hitPosition, hitNormal, settings.rayBias, dynamicLight, rayCount );
+            sum = DirectX::XMVectorAdd( sum, DirectX::XMVectorMultiply( hitLight, DirectX::XMLoadFloat3( &scene.albedos[triangle] ) ) );
+        }
+    }
+
+    return DirectX::XMVectorScale( sum, 1.0f / ( strata * strata ) );
+}
+
+// * * * * * BAKE * * * * * //
+struct LightmapTexel
+{
+    DirectX::XMFLOAT3 position;
+    DirectX::XMFLOAT3 normal;
+};
+
+// Texel centers inside a triangle in UV space get its interpolated position / normal, the first triangle wins
+static void rasterizeTriangle( const DirectX::XMFLOAT2 uvs[3], const Vertex* pVertices[3], UINT width, UINT height,
+                               std::vector<LightmapTexel>& texels, std::vector<BYTE>& covered )
+{
+    float x[3], y[3];
+    for ( UINT c = 0; c < 3; c++ ) {
+        x[c] = uvs[c].x * width;
+        y[c] = uvs[c].y * height;
+    }
+
+    float area = ( x[1] - x[0] ) * ( y[2] - y[0] ) - ( x[2] - x[0] ) * ( y[1] - y[0] );
+    if ( fabsf( area ) < 1.0e-8f )
+        return;
+
+    int minX = std::max( 0, (int)floorf( std::min( x[0], std::min( x[1], x[2] ) ) - 0.5f ) );
+    int minY = std::max( 0, (int)floorf( std::min( y[0], std::min( y[1], y[2] ) ) - 0.5f ) );
+    int maxX = std::min( (int)width - 1, (int)ceilf( std::max( x[0], std::max( x[1], x[2] ) ) - 0.5f ) );
+    int maxY = std::min( (int)height - 1, (int)ceilf( std::max( y[0], std::max( y[1], y[2] ) ) - 0.5f ) );
+
+    // Texel centers on a chart's edge count as inside
+    const float edgeEpsilon = -1.0e-4f;
+    for ( int ty = minY; ty <= maxY; ty++ ) {
+        for ( int tx = minX; tx <= maxX; tx++ ) {
+            float px = tx + 0.5f, py = ty + 0.5f;
+            float w0 = ( ( x[1] - px ) * ( y[2] - py ) - ( x[2] - px ) * ( y[1] - py ) ) / area;
+            float w1 = ( ( x[2] - px ) * ( y[0] - py ) - ( x[0] - px ) * ( y[2] - py ) ) / area;
+            float w2 = 1.0f - w0 - w1;
+            if ( w0 < edgeEpsilon || w1 < edgeEpsilon || w2 < edgeEpsilon )
+                continue;
+
+            UINT index = ty * width + tx;
+            if ( covered[index] )
+                continue;
+
+            DirectX::XMVECTOR position = DirectX::XMVectorAdd( DirectX::XMVectorScale( DirectX::XMLoadFloat3( &pVertices[0]->pos ), w0 ),
+                                         DirectX::XMVectorAdd( DirectX::XMVectorScale( DirectX::XMLoadFloat3( &pVertices[1]->pos ), w1 ),
+                                                               DirectX::XMVectorScale( DirectX::XMLoadFloat3( &pVertices[2]->pos ), w2 ) ) );
+            DirectX::XMVECTOR normal = DirectX::XMVectorAdd( DirectX::XMVectorScale( DirectX::XMLoadFloat3( &pVertices[0]->normal ), w0 ),
+                                       DirectX::XMVectorAdd( DirectX::XMVectorScale( DirectX::XMLoadFloat3( &pVertices[1]->normal ), w1 ),
+                                                             DirectX::XMVectorScale( DirectX::XMLoadFloat3( &pVertices[2]->normal ), w2 ) ) );
+
+            DirectX::XMStoreFloat3( &texels[index].position, position );
+            DirectX::XMStoreFloat3( &texels[index].normal, DirectX::XMVector3Normalize( normal ) );
+            covered[index] = 1;
+        }
+    }
+}
+
+bool bakeLightmap( const LightmapMesh* pMeshes, UINT meshCount, const LightmapLight* pLights, UINT lightCount,
+                   const LightmapBakeSettings& settings, Lightmap& lightmap, LightmapBakeStats& stats, JobSystem* pJobSystem )
+{
+    UINT width = settings.width, height = settings.height;
+    UINT texelCount = width * height;
+    if ( texelCount == 0 )
+        return false;
+
+    // - - - charts -> texels - - - //
+    Timer phaseTimer;
+    std::vector<LightmapTexel> texels( texelCount );
+    std::vector<BYTE> covered( texelCount, 0 );
+
+    for ( UINT m = 0; m < meshCount; m++ ) {
+        const LightmapMesh& mesh = pMeshes[m];
+        if ( mesh.lightmapUvs.size() != mesh.mesh.vertices.size() )
+            return false;
+
+        for ( size_t i = 0; i + 2 < mesh.mesh.indices.size(); i += 3 ) {
+            DirectX::XMFLOAT2 uvs[3];
+            const Vertex* pVertices[3];
+            for ( UINT c = 0; c < 3; c++ ) {
+                UINT v = mesh.mesh.indices[i + c];
+                uvs[c] = mesh.lightmapUvs[v];
+                pVertices[c] = &mesh.mesh.vertices[v];
+            }
+            rasterizeTriangle( uvs, pVertices, width, height, texels, covered );
+        }
+    }
+
+    std::vector<UINT> coveredTexels;
+    for ( UINT i = 0; i < texelCount; i++ ) {
+        if ( covered[i] )
+            coveredTexels.push_back( i );
+    }
+    stats.texels = (UINT)coveredTexels.size();
+    stats.rasterizeMs = phaseTimer.elapsedMs();
+
+    // - - - triangles -> BVH + SSE packets - - - //
+    phaseTimer.reset();
+    LightmapScene scene;
+    buildLightmapScene( pMeshes, meshCount, scene, pJobSystem );
+    stats.buildMs = phaseTimer.elapsedMs();
+
+    if ( scene.bvh.getNodeCount() == 0 )
+        return false;
+
+    // - - - direct + bounce per texel, batches of texels over the job system - - - //
+    phaseTimer.reset();
+    std::vector<DirectX::XMFLOAT3> direct( texelCount, DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f ) );
+    std::vector<DirectX::XMFLOAT3> bounce( texelCount, DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f ) );
+    std::vector<float> dynamicShare( texelCount, 0.0f );   // luminance of the dynamically shadowed direct light
+    std::atomic<UINT64> rayCount( 0 );
+
+    auto traceTexels = [&]( UINT begin, UINT end ) {
+        UINT64 rays = 0;
+        for ( UINT i = begin; i < end; i++ ) {
+            UINT index = coveredTexels[i];
+            const LightmapTexel& texel = texels[index];
+
+            DirectX::XMVECTOR dynamicLight;
+            DirectX::XMStoreFloat3( &direct[index], computeDirectLight( scene, pLights, lightCount, texel.position, texel.normal, settings.rayBias, dynamicLight, rays ) );
+            dynamicShare[index] = getLuminance( dynamicLight );
+            DirectX::XMStoreFloat3( &bounce[index], computeBounceLight( scene, pLights, lightCount, settings, texel.position, texel.normal, index, rays ) );
+        }
+        rayCount += rays;
+    };
+
+    if ( pJobSystem )
+        pJobSystem->parallelFor( (UINT)coveredTexels.size(), texelsPerTraceBatch, traceTexels );
+    else
+        traceTexels( 0, (UINT)coveredTexels.size() );
+
+    stats.traceMs = phaseTimer.elapsedMs();
+    stats.rays = rayCount;
+    stats.threads = pJobSystem ? pJobSystem->getThreadCount() : 1;
+    stats.texelsPerSecond = stats.traceMs > 0.0 ? stats.texels / stats.traceMs * 1000.0 : 0.0;
+    stats.raysPerSecond = stats.traceMs > 0.0 ? stats.rays / stats.traceMs * 1000.0 : 0.0;
+
+    // - - - denoise the bounce: weights fall off with world distance and normal difference - - - //
+    // World distance instead of texel distance keeps neighbouring charts (other surfaces) apart
+    phaseTimer.reset();
+    std::vector<DirectX::XMFLOAT3> filtered( bounce );
+    int radius = (int)settings.denoiseRadius;
+    float sigma = std::max( radius * 0.5f, 0.5f );
+    float texelsPerUnit = stats.texelsPerUnit > 0.0f ? stats.texelsPerUnit : settings.texelsPerUnit;
+    float distanceFalloff = texelsPerUnit * texelsPerUnit / ( 2.0f * sigma * sigma );
+
+    auto denoiseRows = [&]( UINT begin, UINT end ) {
+        for ( UINT y = begin; y < end; y++ ) {
+            for ( UINT x = 0; x < width; x++ ) {
+                UINT index = y * width + x;
+                if ( !covered[index] )
+                    continue;
+
+                const LightmapTexel& center = texels[index];
+                DirectX::XMVECTOR sum = DirectX::XMVectorZero();
+                float weightSum = 0.0f;
+
+                for ( int dy = -radius; dy <= radius; dy++ ) {
+                    int ny = (int)y + dy;
+                    if ( ny < 0 || ny >= (int)height )
+                        continue;
+
+                    for ( int dx = -radius; dx <= radius; dx++ ) {
+                        int nx = (int)x + dx;
+                        if ( nx < 0 || nx >= (int)width )
+                            continue;
+
+                        UINT neighbour = ny * width + nx;
+                        if ( !covered[neighbour] )
+                            continue;
+
+                        const LightmapTexel& other = texels[neighbour];
+                        float normalWeight = std::max( dot3( center.normal, other.normal ), 0.0f );
+                        normalWeight *= normalWeight;
+                        normalWeight *= normalWeight;
+                        normalWeight *= normalWeight;
+
+                        DirectX::XMFLOAT3 offset( other.position.x - center.position.x, other.position.y - center.position.y, other.position.z - center.position.z );
+                        float weight = normalWeight * expf( -dot3( offset, offset ) * distanceFalloff );
+
+                        sum = DirectX::XMVectorAdd( sum, DirectX::XMVectorScale( DirectX::XMLoadFloat3( &bounce[neighbour] ), weight ) );
+                        weightSum += weight;
+                    }
+                }
+
+                if ( weightSum > 0.0f )
+                    DirectX::XMStoreFloat3( &filtered[index], DirectX::XMVectorScale( sum, 1.0f / weightSum ) );
+            }
+        }
+    };
+
+    if ( radius > 0 ) {
+        if ( pJobSystem )
+            pJobSystem->parallelFor( height, rowsPerDenoiseBatch, denoiseRows );
+        else
+            denoiseRows( 0, height );
+    }
+    stats.denoiseMs = phaseTimer.elapsedMs();
+
+    // - - - compose: rgb = direct + bounce, a = dynamically shadowed share - - - //
+    std::vector<DirectX::XMFLOAT4> result( texelCount, DirectX::XMFLOAT4( 0.0f, 0.0f, 0.0f, 0.0f ) );
+    for ( size_t i = 0; i < coveredTexels.size(); i++ ) {
+        UINT index = coveredTexels[i];
+        DirectX::XMVECTOR light = DirectX::XMVectorAdd( DirectX::XMLoadFloat3( &direct[index] ), DirectX::XMLoadFloat3( &filtered[index] ) );
+        float luminance = getLuminance( light );
+        float share = luminance > 1.0e-6f ? std::min( dynamicShare[index] / luminance, 1.0f ) : 0.0f;
+
+        DirectX::XMStoreFloat4( &result[index], DirectX::XMVectorSetW( light, share ) );
+    }
+
+    // - - - dilate into the padding, bilinear filtering at chart edges reads these - - - //
+    std::vector<BYTE> filled( covered );
+    for ( UINT pass = 0; pass < settings.padding; pass++ ) {
+        std::vector<BYTE> previous( filled );
+        for ( UINT y = 0; y < height; y++ ) {
+            for ( UINT x = 0; x < width; x++ ) {
+                UINT index = y * width + x;
+                if ( previous[index] )
+                    continue;
+
+                DirectX::XMVECTOR sum = DirectX::XMVectorZero();
+                UINT count = 0;
+                for ( int dy = -1; dy <= 1; dy++ ) {
+                    for ( int dx = -1; dx <= 1; dx++ ) {
+                        int nx = (int)x + dx, ny = (int)y + dy;
+                        if ( nx < 0 || ny < 0 || nx >= (int)width || ny >= (int)height || !previous[ny * width + nx] )
+                            continue;
+
+                        sum = DirectX::XMVectorAdd( sum, DirectX::XMLoadFloat4( &result[ny * width + nx] ) );
+                        count++;
+                    }
+                }
+
+                if ( count > 0 ) {
+                    DirectX::XMStoreFloat4( &result[index], DirectX::XMVectorScale( sum, 1.0f / count ) );
+                    filled[index] = 1;
+                }
+            }
+        }
+    }
+
+    lightmap.width = width;
+    lightmap.height = height;
+    lightmap.texels.resize( texelCount );
+    for ( UINT i = 0; i < texelCount; i++ )
+        DirectX::PackedVector::XMStoreHalf4( &lightmap.texels[i], DirectX::XMLoadFloat4( &result[i] ) );
+
+    return true;
+}
+
+// * * * * * IRRADIANCE PROBES * * * * * //
+bool bakeIrradianceProbes( const LightmapMesh* pMeshes, UINT meshCount, const LightmapLight* pLights, UINT lightCount, const LightmapBakeSettings& settings,
+                           UINT raysPerProbe, IrradianceProbeGrid& grid, ProbeBakeStats& stats, JobSystem* pJobSystem )
+{
+    ZeroMemory( &stats, sizeof(ProbeBakeStats) );
+    UINT probeCount = (UINT)grid.probes.size();
+    UINT strata = (UINT)sqrtf( (float)raysPerProbe );
+    if ( probeCount == 0 || strata == 0 )
+        return false;
+
+    LightmapScene scene;
+    buildLightmapScene( pMeshes, meshCount, scene, pJobSystem );
+    if ( scene.bvh.getNodeCount() == 0 )
+        return false;
+
+    // - - - radiance along stratified directions over the whole sphere, projected per probe - - - //
+    Timer traceTimer;
+    std::vector<BYTE> inside( probeCount, 0 );
+    std::atomic<UINT64> rayCount( 0 );
+    DirectX::XMVECTOR sky = DirectX::XMLoadFloat3( &settings.skyColor );
+
+    auto traceProbes = [&]( UINT begin, UINT end ) {
+        std::vector<DirectX::XMFLOAT3> directions( strata * strata ), radiance( strata * strata );
+        UINT64 rays = 0;
+
+        for ( UINT p = begin; p < end; p++ ) {
+            UINT x = p % grid.sizeX, y = ( p / grid.sizeX ) % grid.sizeY, z = p / ( grid.sizeX * grid.sizeY );
+            DirectX::XMFLOAT3 origin( grid.gridMin.x + x * grid.spacing, grid.gridMin.y + y * grid.spacing, grid.gridMin.z + z * grid.spacing );
+            UINT random = hashTexel( p );
+            UINT backFaces = 0;
+
+            for ( UINT sy = 0; sy < strata; sy++ ) {
+                for ( UINT sx = 0; sx < strata; sx++ ) {
+                    // Uniform on the sphere: height and angle uniform
+                    float u1 = ( sx + nextRandom( random ) ) / strata;
+                    float u2 = ( sy + nextRandom( random ) ) / strata;
+                    float height = 1.0f - 2.0f * u1;
+                    float r = sqrtf( std::max( 0.0f, 1.0f - height * height ) );
+                    float phi = DirectX::XM_2PI * u2;
+
+                    UINT sample = sy * strata + sx;
+                    DirectX::XMFLOAT3& direction = directions[sample];
+                    direction = DirectX::XMFLOAT3( r * cosf( phi ), r * sinf( phi ), height );
+                    radiance[sample] = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+
+                    LightmapRay ray;
+                    setRay( ray, origin, direction );
+                    rays++;
+
+                    UINT triangle;
+                    float distance;
+                    if ( !traceClosest( scene, ray, rayMaxDistance, triangle, distance ) ) {
+                        DirectX::XMStoreFloat3( &radiance[sample], sky );
+                        continue;
+                    }
+
+                    const DirectX::XMFLOAT3& hitNormal = scene.faceNormals[triangle];
+                    if ( dot3( hitNormal, direction ) >= 0.0f ) {
+                        backFaces++;
+                        continue;
+                    }
+
+                    DirectX::XMFLOAT3 hitPosition( origin.x + direction.x * distance, origin.y + direction.y * distance, origin.z + direction.z * distance );
+                    DirectX::XMVECTOR dynamicLight;
+                    DirectX::XMVECTOR hitLight = computeDirectLight( scene, pLights, lightCount, hitPosition, hitNormal, settings.rayBias, dynamicLight, rays );
+                    DirectX::XMStoreFloat3( &radiance[sample], DirectX::XMVectorMultiply( hitLight, DirectX::XMLoadFloat3( &scene.albedos[triangle] ) ) );
+                }
+            }
+
+            projectIrradiance( directions.data(), radiance.data(), strata * strata, grid.probes[p] );
+            inside[p] = ( backFaces > insideProbeShare * strata * strata ) ? 1 : 0;
+        }
+        rayCount += rays;
+    };
+
+    if ( pJobSystem )
+        pJobSystem->parallelFor( probeCount, probesPerTraceBatch, traceProbes );
+    else
+        traceProbes( 0, probeCount );
+
+    stats.probes = probeCount;
+    stats.traceMs = traceTimer.elapsedMs();
+    stats.rays = rayCount;
+    stats.threads = pJobSystem ? pJobSystem->getThreadCount() : 1;
+    stats.raysPerSecond = stats.traceMs > 0.0 ? stats.rays / stats.traceMs * 1000.0 : 0.0;
+
+    // - - - probes inside geometry only saw back faces (black), they take the average of their outside neighbours - - - //
+    for ( UINT p = 0; p < probeCount; p++ )
+        stats.insideProbes += inside[p];
+
+    const int offsets[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+    for ( bool filling = true; filling; ) {
+        filling = false;
+        std::vector<BYTE> previous( inside );
+
+        for ( UINT p = 0; p < probeCount; p++ ) {
+            if ( !previous[p] )
+                continue;
+
+            int x = (int)( p % grid.sizeX ), y = (int)( ( p / grid.sizeX ) % grid.sizeY ), z = (int)( p / ( grid.sizeX * grid.sizeY ) );
+            IrradianceProbe sum;
+            ZeroMemory( &sum, sizeof(IrradianceProbe) );
+            UINT count = 0;
+
+            for ( UINT n = 0; n < 6; n++ ) {
+                int nx = x + offsets[n][0], ny = y + offsets[n][1], nz = z + offsets[n][2];
+                if ( nx < 0 || ny < 0 || nz < 0 || nx >= (int)grid.sizeX || ny >= (int)grid.sizeY || nz >= (int)grid.sizeZ )
+                    continue;
+
+                UINT neighbour = ( nz * grid.sizeY + ny ) * grid.sizeX + nx;
+                if ( previous[neighbour] )
+                    continue;
+
+                for ( UINT c = 0; c < shCoefficientCount; c++ ) {
+                    sum.coefficients[c].x += grid.probes[neighbour].coefficients[c].x;
+                    sum.coefficients[c].y += grid.probes[neighbour].coefficients[c].y;
+                    sum.coefficients[c].z += grid.probes[neighbour].coefficients[c].z;
+                }
+                count++;
+            }
+
+            if ( count > 0 ) {
+                for ( UINT c = 0; c < shCoefficientCount; c++ )
+                    grid.probes[p].coefficients[c] = DirectX::XMFLOAT3( sum.coefficients[c].x / count, sum.coefficients[c].y / count, sum.coefficients[c].z / count );
+                inside[p] = 0;
+                filling = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+// * * * * * CACHE * * * * * //
+// FNV-1a
+static UINT64 hashBytes( UINT64 hash, const void* pData, size_t size )
+{
+    const BYTE* pBytes = (const BYTE*)pData;
+    for ( size_t i = 0; i < size; i++ ) {
+        hash ^= pBytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template<typename T>
+static UINT64 hashValue( UINT64 hash, const T& value )
+{
+    return hashBytes( hash, &value, sizeof(T) );
+}
+
+UINT64 getLightmapBakeHash( const LightmapMesh* pMeshes, UINT meshCount, const LightmapLight* pLights, UINT lightCount, const LightmapBakeSettings& settings )
+{
+    UINT64 hash = 14695981039346656037ull;
+    hash = hashValue( hash, lightmapBakerVersion );
+
+    // Field by field, padding bytes would make the hash random
+    for ( UINT m = 0; m < meshCount; m++ ) {
+        const LightmapMesh& mesh = pMeshes[m];
+        for ( size_t v = 0; v < mesh.mesh.vertices.size(); v++ ) {
+            hash = hashValue( hash, mesh.mesh.vertices[v].pos );
+            hash = hashValue( hash, mesh.mesh.vertices[v].normal );
+        }
+        if ( !mesh.mesh.indices.empty() )
+            hash = hashBytes( hash, mesh.mesh.indices.data(), mesh.mesh.indices.size() * sizeof(UINT) );
+        if ( !mesh.lightmapUvs.empty() )
+            hash = hashBytes( hash, mesh.lightmapUvs.data(), mesh.lightmapUvs.size() * sizeof(DirectX::XMFLOAT2) );
+        hash = hashValue( hash, mesh.albedo );
+    }
+
+    for ( UINT l = 0; l < lightCount; l++ ) {
+        hash = hashValue( hash, pLights[l].position );
+        hash = hashValue( hash, pLights[l].intensity );
+        hash = hashValue( hash, pLights[l].color );
+        hash = hashValue( hash, pLights[l].attenuation );
+        hash = hashValue( hash, pLights[l].dynamicShadows );
+    }
+
+    hash = hashValue( hash, settings.width );
+    hash = hashValue( hash, settings.height );
+    hash = hashValue( hash, settings.texelsPerUnit );
+    hash = hashValue( hash, settings.padding );
+    hash = hashValue( hash, settings.chartAngle );
+    hash = hashValue( hash, settings.bounceRays );
+    hash = hashValue( hash, settings.skyColor );
+    hash = hashValue( hash, settings.denoiseRadius );
+    hash = hashValue( hash, settings.rayBias );
+    return hash;
+}
+
+bool writeLightmapFile( const wchar_t* fileName, const Lightmap& lightmap, UINT64 bakeHash )
+{
+    if ( lightmap.texels.size() != (size_t)lightmap.width * lightmap.height )
+        return false;
+
+    LightmapFileHeader header;
+    ZeroMemory( &header, sizeof(LightmapFileHeader) );
+
+                memcpy( header.magic, "LMAP", 4 );
+                header.version = lightmapFileVersion;
+                header.width = lightmap.width;
+                header.height = lightmap.height;
+                header.bakeHash = bakeHash;
+
+    FILE* pFile = NULL;
+    if ( _wfopen_s( &pFile, fileName, L"wb" ) != 0 || !pFile )
+        return false;
+
+    size_t texelBytes = sizeof(DirectX::PackedVector::XMHALF4) * lightmap.texels.size();
+    bool written = fwrite( &header, sizeof(LightmapFileHeader), 1, pFile ) == 1 &&
+                   ( texelBytes == 0 || fwrite( lightmap.texels.data(), texelBytes, 1, pFile ) == 1 );
+    fclose( pFile );
+
+    return written;
+}
+
+bool readLightmapFile( const wchar_t* fileName, UINT64 bakeHash, Lightmap& lightmap )
+{
+    FILE* pFile = NULL;
+    if ( _wfopen_s( &pFile, fileName, L"rb" ) != 0 || !pFile )
+        return false;
+
+    LightmapFileHeader header;
+    bool valid = fread( &header, sizeof(LightmapFileHeader), 1, pFile ) == 1 &&
+                 memcmp( header.magic, "LMAP", 4 ) == 0 && header.version == lightmapFileVersion && header.bakeHash == bakeHash;
+
+    if ( valid ) {
+        lightmap.width = header.width;
+        lightmap.height = header.height;
+        lightmap.texels.resize( (size_t)header.width * header.height );
+
+        size_t texelBytes = sizeof(DirectX::PackedVector::XMHALF4) * lightmap.texels.size();
+        valid = texelBytes > 0 && fread( lightmap.texels.data(), texelBytes, 1, pFile ) == 1;
+    }
+    fclose( pFile );
+
+    return valid;
+}
+
+// * * * * * GPU * * * * * //
+bool createLightmapTexture( ID3D11Device* pDevice, const Lightmap& lightmap, ID3D11ShaderResourceView** ppSRV )
+{
+    *ppSRV = NULL;
+    if ( lightmap.texels.empty() )
+        return false;
+
+    D3D11_TEXTURE2D_DESC textureDesc;
+    ZeroMemory( &textureDesc, sizeof(D3D11_TEXTURE2D_DESC) );
+
+                textureDesc.Width = lightmap.width;
+                textureDesc.Height = lightmap.height;
+                textureDesc.MipLevels = 1;
+                textureDesc.ArraySize = 1;
+                textureDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+                textureDesc.SampleDesc.Count = 1;
+                textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+                textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA textureData;
+    ZeroMemory( &textureData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                textureData.pSysMem = lightmap.texels.data();
+                textureData.SysMemPitch = lightmap.width * sizeof(DirectX::PackedVector::XMHALF4);
+
+    ID3D11Texture2D* pTexture = NULL;
+    HRESULT hr = pDevice->CreateTexture2D( &textureDesc, &textureData, &pTexture );
+    if ( FAILED(hr) )
+        return false;
+
+    // The view keeps the texture alive
+    hr = pDevice->CreateShaderResourceView( pTexture, NULL, ppSRV );
+    pTexture->Release();
+
+    return SUCCEEDED(hr);
+}
+
+bool createLightmapUvBuffer( ID3D11Device* pDevice, const std::vector<DirectX::XMFLOAT2>& lightmapUvs, ID3D11Buffer** ppBuffer )
+{
+    *ppBuffer = NULL;
+    if ( lightmapUvs.empty() )
+        return false;
+
+    // UVs are inside [0, 1], 16 bit UNORM is 1/256 texel at 256 texels
+    std::vector<DirectX::PackedVector::XMUSHORTN2> packedUvs( lightmapUvs.size() );
+    for ( size_t i = 0; i < lightmapUvs.size(); i++ )
+        DirectX::PackedVector::XMStoreUShortN2( &packedUvs[i], DirectX::XMLoadFloat2( &lightmapUvs[i] ) );
+
+    D3D11_BUFFER_DESC bufferDesc;
+    ZeroMemory( &bufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+                bufferDesc.ByteWidth = (UINT)( sizeof(DirectX::PackedVector::XMUSHORTN2) * packedUvs.size() );
+                bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+                bufferDesc.CPUAccessFlags = 0;
+                bufferDesc.MiscFlags = 0;
+
+    D3D11_SUBRESOURCE_DATA bufferData;
+    ZeroMemory( &bufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                bufferData.pSysMem = packedUvs.data();
+
+    return SUCCEEDED( pDevice->CreateBuffer( &bufferDesc, &bufferData, ppBuffer ) );
+}
+
+// * * * * * PROCEDURAL * * * * * //
+void createLightmapTestScene( UINT boxCount, float floorSize, LightmapMesh& floor, LightmapMesh& boxes )
+{
+    // Floor: grid turned from facing -z to facing up, at y = 0
+    createGridMesh( 16, 16, floorSize, floorSize, floor.mesh );
+    transformMesh( floor.mesh, DirectX::XMMatrixRotationX( DirectX::XM_PIDIV2 ) );
+    floor.albedo = DirectX::XMFLOAT3( 0.6f, 0.6f, 0.6f );
+    floor.lightmapUvs.clear();
+
+    // Boxes of different heights on a jittered grid
+    boxes.mesh.vertices.clear();
+    boxes.mesh.indices.clear();
+    boxes.albedo = DirectX::XMFLOAT3( 0.7f, 0.5f, 0.4f );
+    boxes.lightmapUvs.clear();
+
+    UINT perRow = (UINT)ceilf( sqrtf( (float)boxCount ) );
+    float spacing = floorSize / ( perRow + 1 );
+    UINT random = 12345;
+
+    MeshData box;
+    for ( UINT i = 0; i < boxCount; i++ ) {
+        DirectX::XMFLOAT3 extents( spacing * ( 0.15f + 0.15f * nextRandom( random ) ), spacing * ( 0.2f + 0.6f * nextRandom( random ) ), spacing * ( 0.15f + 0.15f * nextRandom( random ) ) );
+        createBoxMesh( extents, box );
+
+        float x = ( i % perRow + 1 ) * spacing - floorSize * 0.5f + ( nextRandom( random ) - 0.5f ) * spacing * 0.3f;
+        float z = ( i / perRow + 1 ) * spacing - floorSize * 0.5f + ( nextRandom( random ) - 0.5f ) * spacing * 0.3f;
+        appendMesh( boxes.mesh, box, DirectX::XMFLOAT3( x, extents.y, z ) );
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Mesh.h"
+#include "IrradianceProbes.h"
+
+class JobSystem;
+
+// * * * Baked lighting for static geometry * * * //
+// unwrapLightmap gives the static meshes a second, unique UV set: triangles are grouped into
+// charts of similar facing, every chart is projected onto its plane at the same world size per
+// texel and the charts are packed into one atlas (skyline). bakeLightmap rasterizes the charts in UV
+// space and traces per texel a shadow ray to every light plus a stratified hemisphere of bounce
+// rays (one bounce, sky radiance for the rays that escape) through a BVH over the triangles, four
+// triangles per SSE test, with the texels spread over the job system. The noisy bounce term is
+// filtered along the surface (edge stopping on normal and position), then the charts are dilated
+// into their padding so bilinear filtering never reads empty atlas texels.
+//
+// Lighting uses the pixel shader's conventions: a light adds intensity * color * N.L / attenuation,
+// a sky of radiance L lights an open surface with L. At runtime the lightmap is one fetch:
+//
+//     rgb     everything the static lights and the sky leave on the texel
+//     a       share of rgb from lights with a runtime shadow map, moving casters take that out
+//
+// Baking is slow compared to a frame: bake once, writeLightmapFile, and load it on later runs as
+// long as getLightmapBakeHash of the inputs hasn't changed.
+struct LightmapLight
+{
+    DirectX::XMFLOAT3 position;
+    float intensity;
+    DirectX::XMFLOAT3 color;
+    DirectX::XMFLOAT3 attenuation;      // 1 / ( x + y * d + z * d * d )
+    bool dynamicShadows;                // shadowed again at runtime (PointShadowMap), goes into alpha
+};
+
+struct LightmapBakeSettings
+{
+    LightmapBakeSettings();
+
+    UINT width, height;
+    float texelsPerUnit;                // wanted density, lowered until the charts fit the atlas
+    UINT padding;                       // texels around every chart
+    float chartAngle;                   // radians, largest angle between a chart's triangles and its first one
+    UINT bounceRays;                    // per texel, rounded down to a square (stratified)
+    DirectX::XMFLOAT3 skyColor;         // radiance of the rays that hit nothing
+    UINT denoiseRadius;                 // texels
+    float rayBias;                      // ray origins move this far off the surface
+};
+
+// Static mesh in world space, unwrapLightmap splits vertices on chart seams and fills lightmapUvs
+// (one per vertex). Upload it unchanged (no optimizeMesh after unwrapping) so the UV stream
+// created from lightmapUvs lines up with the vertex buffer.
+struct LightmapMesh
+{
+    MeshData mesh;
+    std::vector<DirectX::XMFLOAT2> lightmapUvs;
+    DirectX::XMFLOAT3 albedo;           // for the bounce
+};
+
+struct LightmapBakeStats
+{
+    UINT charts;
+    float texelsPerUnit;                // what the charts got
+    UINT texels;                        // covered by triangles
+    UINT64 rays;
+    UINT threads;
+    double unwrapMs, rasterizeMs, buildMs, traceMs, denoiseMs;
+    double texelsPerSecond, raysPerSecond;      // trace phase
+};
+
+struct Lightmap
+{
+    UINT width, height;
+    std::vector<DirectX::PackedVector::XMHALF4> texels;     // R16G16B16A16_FLOAT, row major
+};
+
+// Charts + atlas layout for all meshes together (one lightmap), false if they don't fit at any density
+bool unwrapLightmap( LightmapMesh* pMeshes, UINT meshCount, const LightmapBakeSettings& settings, LightmapBakeStats& stats );
+
+bool bakeLightmap( const LightmapMesh* pMeshes, UINT meshCount, const LightmapLight* pLights, UINT lightCount,
+                   const LightmapBakeSettings& settings, Lightmap& lightmap, LightmapBakeStats& stats, JobSystem* pJobSystem = NULL );
+
+// Changes whenever anything the bake reads changes (geometry, UVs, albedo, lights, settings)
+UINT64 getLightmapBakeHash( const LightmapMesh* pMeshes, UINT meshCount, const LightmapLight* pLights, UINT lightCount, const LightmapBakeSettings& settings );
+
+// * * * Irradiance probes (IrradianceProbes.h) * * * //
+struct ProbeBakeStats
+{
+    UINT probes;
+    UINT insideProbes;                  // in closed geometry, filled from their neighbours
+    UINT64 rays;
+    UINT threads;
+    double traceMs;
+    double raysPerSecond;
+};
+
+// Traces raysPerProbe rays (rounded down to a square, stratified over the sphere) from every probe of
+// grid (initProbeGrid) through the same BVH as bakeLightmap. Probes get the indirect light only: the
+// sky (settings.skyColor) and the lights bounced once off the meshes, the lights' direct part is
+// added at runtime
+bool bakeIrradianceProbes( const LightmapMesh* pMeshes, UINT meshCount, const LightmapLight* pLights, UINT lightCount, const LightmapBakeSettings& settings,
+                           UINT raysPerProbe, IrradianceProbeGrid& grid, ProbeBakeStats& stats, JobSystem* pJobSystem = NULL );
+
+// * * * Lightmap file (.lmap) * * * //
+// [LightmapFileHeader][XMHALF4 * width * height]
+const UINT lightmapFileVersion = 1;
+
+struct LightmapFileHeader
+{
+    char magic[4];                      // "LMAP"
+    UINT version;
+    UINT width;
+    UINT height;
+    UINT64 bakeHash;
+};
+
+bool writeLightmapFile( const wchar_t* fileName, const Lightmap& lightmap, UINT64 bakeHash );
+// false when the file is missing, broken or baked from different inputs
+bool readLightmapFile( const wchar_t* fileName, UINT64 bakeHash, Lightmap& lightmap );
+
+// * * * GPU * * * //
+bool createLightmapTexture( ID3D11Device* pDevice, const Lightmap& lightmap, ID3D11ShaderResourceView** ppSRV );
+// Second vertex stream next to the mesh's PackedVertex buffer, R16G16_UNORM per vertex
+bool createLightmapUvBuffer( ID3D11Device* pDevice, const std::vector<DirectX::XMFLOAT2>& lightmapUvs, ID3D11Buffer** ppBuffer );
+
+// * * * Procedural (tests / benchmarks) * * * //
+// Floor grid with boxes standing on it, in world space, ready for unwrapLightmap
+void createLightmapTestScene( UINT boxCount, float floorSize, LightmapMesh& floor, LightmapMesh& boxes );
@@ -0,0 +1,125 @@
+#include "Lod.h"
+
+#include <math.h>
+#include <float.h>
+
+#include "Simplifier.h"
+
+void generateLodChain( const MeshData& mesh, std::vector<LodLevel>& lods, UINT maxLods, float reduction, float maxError )
+{
+    lods.clear();
+    lods.resize( 1 );
+    lods[0].mesh = mesh;
+    lods[0].error = 0.0f;
+
+    // Every level is simplified from the full mesh so errors don't stack up
+    UINT targetIndexCount = (UINT)mesh.indices.size();
+    while ( lods.size() < maxLods ) {
+        targetIndexCount = (UINT)( targetIndexCount * reduction ) / 3 * 3;
+        if ( targetIndexCount < 3 )
+            break;
+
+        SimplifySettings settings = getDefaultSimplifySettings( targetIndexCount );
+        settings.targetError = maxError;
+
+        LodLevel level;
+        level.error = simplifyMesh( mesh, settings, level.mesh );
+
+        // No real progress, the error limit or locked vertices stopped it
+        if ( level.mesh.indices.size() >= lods.back().mesh.indices.size() * ( 1.0f + reduction ) * 0.5f )
+            break;
+
+        lods.push_back( level );
+    }
+}
+
+void initLodSelection( const std::vector<LodLevel>& lods, LodSelection& selection )
+{
+    selection.errors.resize( lods.size() );
+    for ( size_t i = 0; i < lods.size(); i++ )
+        selection.errors[i] = lods[i].error;
+
+    // Bounding sphere of the full mesh around its box center
+    const std::vector<Vertex>& vertices = lods[0].mesh.vertices;
+    float minPos[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxPos[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for ( size_t v = 0; v < vertices.size(); v++ ) {
+        const float* p = &vertices[v].pos.x;
+        for ( int k = 0; k < 3; k++ ) {
+            minPos[k] = ( p[k] < minPos[k] ) ? p[k] : minPos[k];
+            maxPos[k] = ( p[k] > maxPos[k] ) ? p[k] : maxPos[k];
+        }
+    }
+
+    selection.center = DirectX::XMFLOAT3( ( minPos[0] + maxPos[0] ) * 0.5f, ( minPos[1] + maxPos[1] ) * 0.5f, ( minPos[2] + maxPos[2] ) * 0.5f );
+
+    float radiusSq = 0.0f;
+    for ( size_t v = 0; v < vertices.size(); v++ ) {
+        float dx = vertices[v].pos.x - selection.center.x;
+        float dy = vertices[v].pos.y - selection.center.y;
+        float dz = vertices[v].pos.z - selection.center.z;
+        radiusSq = ( dx * dx + dy * dy + dz * dz > radiusSq ) ? dx * dx + dy * dy + dz * dz : radiusSq;
+    }
+    selection.radius = sqrtf( radiusSq );
+    selection.currentLod = 0;
+}
+
+float getScreenSpaceError( float error, float depth, DirectX::FXMMATRIX projection, float viewportHeight )
+{
+    DirectX::XMFLOAT4X4 p;
+    DirectX::XMStoreFloat4x4( &p, projection );
+
+    // Projected size in NDC is error * _22 / depth, NDC spans 2 units over the viewport height
+    return error * p._22 / depth * viewportHeight * 0.5f;
+}
+
+UINT selectLod( LodSelection& selection, DirectX::FXMMATRIX world, DirectX::CXMMATRIX view, DirectX::CXMMATRIX projection,
+                float viewportHeight, float pixelThreshold, float hysteresis )
+{
+    if ( selection.errors.size() <= 1 )
+        return selection.currentLod = 0;
+
+    // World scale of the object (largest axis) and view depth of the nearest point of its sphere
+    DirectX::XMVECTOR scale, rotation, translation;
+    DirectX::XMMatrixDecompose( &scale, &rotation, &translation, world );
+    DirectX::XMFLOAT3 scales;
+    DirectX::XMStoreFloat3( &scales, scale );
+    float maxScale = fabsf( scales.x ) > fabsf( scales.y ) ? fabsf( scales.x ) : fabsf( scales.y );
+    maxScale = maxScale > fabsf( scales.z ) ? maxScale : fabsf( scales.z );
+
+    DirectX::XMVECTOR center = DirectX::XMVector3TransformCoord( DirectX::XMLoadFloat3( &selection.center ), world * view );
+    float depth = DirectX::XMVectorGetZ( center ) - selection.radius * maxScale;
+
+    // Inside the sphere or behind the camera: nearest distance is undefined, use the full mesh
+    if ( depth <= 0.0f )
+        return selection.currentLod = 0;
+
+    UINT levelCount = (UINT)selection.errors.size();
+    UINT current = selection.currentLod < levelCount ? selection.currentLod : levelCount - 1;
+
+    // Coarsest acceptable level
+    UINT desired = 0;
+    for ( UINT i = levelCount; i-- > 0; ) {
+        if ( getScreenSpaceError( selection.errors[i] * maxScale, depth, projection, viewportHeight ) <= pixelThreshold ) {
+            desired = i;
+            break;
+        }
+    }
+
+    if ( desired > current ) {
+        // Coarser only once the error is clearly below the threshold
+        float coarserThreshold = pixelThreshold * ( 1.0f - hysteresis );
+        UINT coarser = current;
+        for ( UINT i = current + 1; i <= desired; i++ ) {
+            if ( getScreenSpaceError( selection.errors[i] * maxScale, depth, projection, viewportHeight ) <= coarserThreshold )
+                coarser = i;
+        }
+        current = coarser;
+    }
+    else {
+        // Finer right away, the error is visible
+        current = desired;
+    }
+
+    return selection.currentLod = current;
+}
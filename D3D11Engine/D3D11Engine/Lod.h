@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Mesh.h"
+
+// * * * Import time LOD chain * * * //
+struct LodLevel
+{
+    MeshData mesh;
+    float error;            // object space, 0 for the full resolution mesh
+};
+
+// lods[0] is the input, every further level has about reduction times the triangles of the previous.
+// Stops early when the simplifier can't reach the target without exceeding maxError (relative).
+void generateLodChain( const MeshData& mesh, std::vector<LodLevel>& lods, UINT maxLods = 4, float reduction = 0.5f, float maxError = 0.05f );
+
+// * * * Runtime selection by projected error * * * //
+struct LodSelection
+{
+    LodSelection() : currentLod( 0 ) { }
+
+    std::vector<float> errors;          // per level, object space
+    DirectX::XMFLOAT3 center;           // object space bounding sphere
+    float radius;
+    UINT currentLod;
+};
+
+void initLodSelection( const std::vector<LodLevel>& lods, LodSelection& selection );
+
+// Pixels an object space error covers at the given view depth, from the projection matrix the
+// scene is drawn with (projection._22 = 1 / tan(fovY / 2))
+float getScreenSpaceError( float error, float depth, DirectX::FXMMATRIX projection, float viewportHeight );
+
+// Picks the coarsest level whose error stays below pixelThreshold. Switching to a coarser level
+// additionally needs the error below pixelThreshold * (1 - hysteresis), so levels don't pop back and forth.
+UINT selectLod( LodSelection& selection, DirectX::FXMMATRIX world, DirectX::CXMMATRIX view, DirectX::CXMMATRIX projection,
+                float viewportHeight, float pixelThreshold = 1.0f, float hysteresis = 0.25f );
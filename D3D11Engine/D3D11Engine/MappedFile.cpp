@@ -0,0 +1,52 @@
+#include "MappedFile.h"
+
+MappedFile::MappedFile() : hFile( INVALID_HANDLE_VALUE ), hMapping( NULL ), pData( NULL ), size( 0 )
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open( const wchar_t* fileName )
+{
+    close();
+
+    hFile = CreateFileW( fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if ( hFile == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if ( !GetFileSizeEx( hFile, &fileSize ) || fileSize.QuadPart == 0 ) {
+        close();
+        return false;
+    }
+
+    hMapping = CreateFileMappingW( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+    if ( !hMapping ) {
+        close();
+        return false;
+    }
+
+    pData = (const BYTE*)MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+    if ( !pData ) {
+        close();
+        return false;
+    }
+
+    size = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( pData ) UnmapViewOfFile( pData );
+    if ( hMapping ) CloseHandle( hMapping );
+    if ( hFile != INVALID_HANDLE_VALUE ) CloseHandle( hFile );
+
+    pData = NULL;
+    hMapping = NULL;
+    hFile = INVALID_HANDLE_VALUE;
+    size = 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Windows.h>
+
+// * * * Read only memory mapped file * * * //
+// Pages come in from the OS file cache on first touch, nothing is copied up front.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open( const wchar_t* fileName );
+    void close();
+
+    const BYTE* getData() const { return pData; }
+    size_t getSize() const { return size; }
+
+private:
+    // Owns the mapping, no copies
+    MappedFile( const MappedFile& );
+    MappedFile& operator=( const MappedFile& );
+
+    HANDLE hFile;
+    HANDLE hMapping;
+    const BYTE* pData;
+    size_t size;
+};
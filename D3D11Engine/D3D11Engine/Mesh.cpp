@@ -0,0 +1,336 @@
+#include "Mesh.h"
+
+#include <math.h>
+#include <assert.h>
+
+#include "VertexCompression.h"
+
+// Splits the triangle list into parts of at most maxVerticesPer16BitPart vertices.
+// Vertices shared between parts are duplicated, each part's vertices are contiguous.
+static void splitInto16BitParts( const MeshData& mesh, std::vector<Vertex>& partVertices, PackedMeshData& packedMesh )
+{
+    const UINT invalid = 0xFFFFFFFF;
+    std::vector<UINT> localIndex( mesh.vertices.size(), invalid );
+    std::vector<UINT> partStamp( mesh.vertices.size(), invalid );
+
+    MeshPart part = { 0, 0, 0, 0 };
+    UINT partNumber = 0;
+
+    for ( size_t t = 0; t + 2 < mesh.indices.size(); t += 3 ) {
+        // How many of the triangle's vertices are new to the current part
+        UINT newVertices = 0;
+        for ( int k = 0; k < 3; k++ ) {
+            UINT v = mesh.indices[t + k];
+            bool duplicate = ( k > 0 && mesh.indices[t] == v ) || ( k > 1 && mesh.indices[t + 1] == v );
+            if ( partStamp[v] != partNumber && !duplicate )
+                newVertices++;
+        }
+
+        if ( part.vertexCount + newVertices > maxVerticesPer16BitPart ) {
+            packedMesh.parts.push_back( part );
+
+            partNumber++;
+            part.indexStart = (UINT)packedMesh.indices16.size();
+            part.indexCount = 0;
+            part.baseVertex = (UINT)partVertices.size();
+            part.vertexCount = 0;
+        }
+
+        for ( int k = 0; k < 3; k++ ) {
+            UINT v = mesh.indices[t + k];
+            if ( partStamp[v] != partNumber ) {
+                partStamp[v] = partNumber;
+                localIndex[v] = part.vertexCount++;
+                partVertices.push_back( mesh.vertices[v] );
+            }
+            packedMesh.indices16.push_back( (USHORT)localIndex[v] );
+        }
+        part.indexCount += 3;
+    }
+
+    if ( part.indexCount > 0 )
+        packedMesh.parts.push_back( part );
+}
+
+void buildPackedMesh( const MeshData& mesh, PackedMeshData& packedMesh, bool splitLargeMeshes )
+{
+    packedMesh.vertices.clear();
+    packedMesh.indices16.clear();
+    packedMesh.indices32.clear();
+    packedMesh.parts.clear();
+
+    UINT vertexCount = (UINT)mesh.vertices.size();
+    UINT indexCount = (UINT)mesh.indices.size();
+
+    // Quantization covers the whole mesh so every part decodes with the same constants
+    packedMesh.quantization = computeVertexQuantization( mesh.vertices.data(), vertexCount );
+
+    if ( vertexCount <= maxVerticesPer16BitPart ) {
+        // - - - fits 16 bit as is - - - //
+        packedMesh.indexFormat = DXGI_FORMAT_R16_UINT;
+        packedMesh.indices16.resize( indexCount );
+        for ( UINT i = 0; i < indexCount; i++ )
+            packedMesh.indices16[i] = (USHORT)mesh.indices[i];
+
+        packedMesh.vertices.resize( vertexCount );
+        compressVertices( mesh.vertices.data(), vertexCount, packedMesh.quantization, packedMesh.vertices.data() );
+
+        MeshPart part = { 0, indexCount, 0, vertexCount };
+        packedMesh.parts.push_back( part );
+    }
+    else if ( splitLargeMeshes ) {
+        // - - - split into 16 bit parts - - - //
+        packedMesh.indexFormat = DXGI_FORMAT_R16_UINT;
+
+        std::vector<Vertex> partVertices;
+        partVertices.reserve( vertexCount );
+        splitInto16BitParts( mesh, partVertices, packedMesh );
+
+        packedMesh.vertices.resize( partVertices.size() );
+        compressVertices( partVertices.data(), (UINT)partVertices.size(), packedMesh.quantization, packedMesh.vertices.data() );
+    }
+    else {
+        // - - - 32 bit fallback - - - //
+        packedMesh.indexFormat = DXGI_FORMAT_R32_UINT;
+        packedMesh.indices32 = mesh.indices;
+
+        packedMesh.vertices.resize( vertexCount );
+        compressVertices( mesh.vertices.data(), vertexCount, packedMesh.quantization, packedMesh.vertices.data() );
+
+        MeshPart part = { 0, indexCount, 0, vertexCount };
+        packedMesh.parts.push_back( part );
+    }
+}
+
+bool createMesh( ID3D11Device* pDevice, const PackedMeshData& packedMesh, Mesh& mesh, bool dynamicVertices )
+{
+    bool use16Bit = ( packedMesh.indexFormat == DXGI_FORMAT_R16_UINT );
+    UINT indexCount = (UINT)( use16Bit ? packedMesh.indices16.size() : packedMesh.indices32.size() );
+    UINT indexSize = use16Bit ? sizeof(USHORT) : sizeof(UINT);
+
+    if ( packedMesh.vertices.empty() || indexCount == 0 )
+        return false;
+
+    // Vertex buffer desciption
+    D3D11_BUFFER_DESC vertexBufferDesc;
+    ZeroMemory( &vertexBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                vertexBufferDesc.Usage = dynamicVertices ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_IMMUTABLE;
+                vertexBufferDesc.ByteWidth = (UINT)( sizeof(PackedVertex) * packedMesh.vertices.size() );
+                vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+                vertexBufferDesc.CPUAccessFlags = dynamicVertices ? D3D11_CPU_ACCESS_WRITE : 0;
+                vertexBufferDesc.MiscFlags = 0;
+
+    D3D11_SUBRESOURCE_DATA vertexBufferData;
+    ZeroMemory( &vertexBufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                vertexBufferData.pSysMem = packedMesh.vertices.data();
+
+    HRESULT hr = pDevice->CreateBuffer( &vertexBufferDesc, &vertexBufferData, &mesh.pVertexBuffer );
+    if ( FAILED(hr) )
+        return false;
+
+    // Index buffer description
+    D3D11_BUFFER_DESC indexBufferDesc;
+    ZeroMemory( &indexBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+                indexBufferDesc.ByteWidth = indexSize * indexCount;
+                indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+                indexBufferDesc.CPUAccessFlags = 0;
+                indexBufferDesc.MiscFlags = 0;
+
+    D3D11_SUBRESOURCE_DATA indexBufferData;
+    ZeroMemory( &indexBufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                indexBufferData.pSysMem = use16Bit ? (const void*)packedMesh.indices16.data() : (const void*)packedMesh.indices32.data();
+
+    hr = pDevice->CreateBuffer( &indexBufferDesc, &indexBufferData, &mesh.pIndexBuffer );
+    if ( FAILED(hr) ) {
+        mesh.pVertexBuffer->Release();
+        mesh.pVertexBuffer = NULL;
+        return false;
+    }
+
+    mesh.indexFormat = packedMesh.indexFormat;
+    mesh.quantization = packedMesh.quantization;
+    mesh.parts = packedMesh.parts;
+    mesh.indexCount = indexCount;
+    mesh.vertexCount = (UINT)packedMesh.vertices.size();
+    return true;
+}
+
+void releaseMesh( Mesh& mesh )
+{
+    if ( mesh.pIndexBuffer ) mesh.pIndexBuffer->Release();
+    if ( mesh.pVertexBuffer ) mesh.pVertexBuffer->Release();
+
+    mesh.pIndexBuffer = NULL;
+    mesh.pVertexBuffer = NULL;
+    mesh.parts.clear();
+}
+
+void drawMesh( ID3D11DeviceContext* pDeviceContext, const Mesh& mesh )
+{
+    UINT stride = sizeof(PackedVertex);
+    UINT offset = 0;
+
+    pDeviceContext->IASetVertexBuffers( 0, 1, &mesh.pVertexBuffer, &stride, &offset );
+    pDeviceContext->IASetIndexBuffer( mesh.pIndexBuffer, mesh.indexFormat, 0 );
+
+    for ( size_t i = 0; i < mesh.parts.size(); i++ ) {
+        const MeshPart& part = mesh.parts[i];
+        pDeviceContext->DrawIndexed( part.indexCount, part.indexStart, (INT)part.baseVertex );
+    }
+}
+
+UINT getMeshIndexBytes( const Mesh& mesh )
+{
+    return mesh.indexCount * ( mesh.indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4 );
+}
+
+void createGridMesh( UINT cellsX, UINT cellsY, float sizeX, float sizeY, MeshData& mesh )
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.vertices.reserve( ( cellsX + 1 ) * ( cellsY + 1 ) );
+    mesh.indices.reserve( cellsX * cellsY * 6 );
+
+    for ( UINT y = 0; y <= cellsY; y++ ) {
+        for ( UINT x = 0; x <= cellsX; x++ ) {
+            float u = (float)x / cellsX;
+            float v = (float)y / cellsY;
+            mesh.vertices.push_back( Vertex( ( u - 0.5f ) * sizeX, ( v - 0.5f ) * sizeY, 0.0f,
+                                             1.0f, 1.0f, 1.0f, 1.0f,
+                                             u, 1.0f - v,
+                                             0.0f, 0.0f, -1.0f ) );
+        }
+    }
+
+    // Same winding as the scene quad (0 1 2, 0 2 3 with 0 = bottom-left)
+    for ( UINT y = 0; y < cellsY; y++ ) {
+        for ( UINT x = 0; x < cellsX; x++ ) {
+            UINT bottomLeft = y * ( cellsX + 1 ) + x;
+            UINT topLeft = bottomLeft + ( cellsX + 1 );
+            UINT topRight = topLeft + 1;
+            UINT bottomRight = bottomLeft + 1;
+
+            mesh.indices.push_back( bottomLeft );
+            mesh.indices.push_back( topLeft );
+            mesh.indices.push_back( topRight );
+            mesh.indices.push_back( bottomLeft );
+            mesh.indices.push_back( topRight );
+            mesh.indices.push_back( bottomRight );
+        }
+    }
+}
+
+void createSphereMesh( UINT slices, UINT stacks, float radius, MeshData& mesh )
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.vertices.reserve( ( slices + 1 ) * ( stacks + 1 ) );
+    mesh.indices.reserve( slices * stacks * 6 );
+
+    for ( UINT stack = 0; stack <= stacks; stack++ ) {
+        float v = (float)stack / stacks;
+        float phi = v * DirectX::XM_PI;             // 0 at the top
+        for ( UINT slice = 0; slice <= slices; slice++ ) {
+            float u = (float)slice / slices;
+            float theta = u * DirectX::XM_2PI;
+
+            float nx = sinf( phi ) * cosf( theta );
+            float ny = cosf( phi );
+            float nz = sinf( phi ) * sinf( theta );
+            mesh.vertices.push_back( Vertex( nx * radius, ny * radius, nz * radius,
+                                             1.0f, 1.0f, 1.0f, 1.0f,
+                                             u, v,
+                                             nx, ny, nz ) );
+        }
+    }
+
+    // Clockwise seen from outside (left handed, like the scene quad)
+    for ( UINT stack = 0; stack < stacks; stack++ ) {
+        for ( UINT slice = 0; slice < slices; slice++ ) {
+            UINT topLeft = stack * ( slices + 1 ) + slice;
+            UINT bottomLeft = topLeft + ( slices + 1 );
+            UINT topRight = topLeft + 1;
+            UINT bottomRight = bottomLeft + 1;
+
+            mesh.indices.push_back( topLeft );
+            mesh.indices.push_back( bottomRight );
+            mesh.indices.push_back( bottomLeft );
+            mesh.indices.push_back( topLeft );
+            mesh.indices.push_back( topRight );
+            mesh.indices.push_back( bottomRight );
+        }
+    }
+}
+
+void appendMesh( MeshData& mesh, const MeshData& source, const DirectX::XMFLOAT3& translation )
+{
+    UINT baseVertex = (UINT)mesh.vertices.size();
+
+    for ( size_t v = 0; v < source.vertices.size(); v++ ) {
+        Vertex vertex = source.vertices[v];
+        vertex.pos.x += translation.x;
+        vertex.pos.y += translation.y;
+        vertex.pos.z += translation.z;
+        mesh.vertices.push_back( vertex );
+    }
+
+    for ( size_t i = 0; i < source.indices.size(); i++ )
+        mesh.indices.push_back( source.indices[i] + baseVertex );
+}
+
+void createBoxMesh( const DirectX::XMFLOAT3& extents, MeshData& mesh )
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.vertices.reserve( 24 );
+    mesh.indices.reserve( 36 );
+
+    // Per side: outward normal and the up axis as seen from outside, right = normal x up
+    const DirectX::XMFLOAT3 sides[6][2] = {
+        { DirectX::XMFLOAT3( 1.0f, 0.0f, 0.0f ), DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ) },
+        { DirectX::XMFLOAT3( -1.0f, 0.0f, 0.0f ), DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ) },
+        { DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ), DirectX::XMFLOAT3( 0.0f, 0.0f, 1.0f ) },
+        { DirectX::XMFLOAT3( 0.0f, -1.0f, 0.0f ), DirectX::XMFLOAT3( 0.0f, 0.0f, -1.0f ) },
+        { DirectX::XMFLOAT3( 0.0f, 0.0f, 1.0f ), DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ) },
+        { DirectX::XMFLOAT3( 0.0f, 0.0f, -1.0f ), DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ) },
+    };
+    const float corners[4][2] = { { -1.0f, -1.0f }, { -1.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, -1.0f } };  // bottom-left first, clockwise
+
+    DirectX::XMVECTOR size = DirectX::XMLoadFloat3( &extents );
+    for ( UINT side = 0; side < 6; side++ ) {
+        DirectX::XMVECTOR normal = DirectX::XMLoadFloat3( &sides[side][0] );
+        DirectX::XMVECTOR up = DirectX::XMLoadFloat3( &sides[side][1] );
+        DirectX::XMVECTOR right = DirectX::XMVector3Cross( normal, up );
+
+        UINT baseVertex = (UINT)mesh.vertices.size();
+        for ( UINT c = 0; c < 4; c++ ) {
+            DirectX::XMVECTOR corner = DirectX::XMVectorAdd( normal, DirectX::XMVectorAdd( DirectX::XMVectorScale( right, corners[c][0] ), DirectX::XMVectorScale( up, corners[c][1] ) ) );
+            DirectX::XMFLOAT3 position;
+            DirectX::XMStoreFloat3( &position, DirectX::XMVectorMultiply( corner, size ) );
+
+            mesh.vertices.push_back( Vertex( position.x, position.y, position.z,
+                                             1.0f, 1.0f, 1.0f, 1.0f,
+                                             corners[c][0] * 0.5f + 0.5f, 0.5f - corners[c][1] * 0.5f,
+                                             sides[side][0].x, sides[side][0].y, sides[side][0].z ) );
+        }
+
+        // Same winding as the grid
+        const UINT sideIndices[6] = { 0, 1, 2, 0, 2, 3 };
+        for ( UINT i = 0; i < 6; i++ )
+            mesh.indices.push_back( baseVertex + sideIndices[i] );
+    }
+}
+
+void transformMesh( MeshData& mesh, DirectX::FXMMATRIX transform )
+{
+    for ( size_t v = 0; v < mesh.vertices.size(); v++ ) {
+        Vertex& vertex = mesh.vertices[v];
+        DirectX::XMStoreFloat3( &vertex.pos, DirectX::XMVector3TransformCoord( DirectX::XMLoadFloat3( &vertex.pos ), transform ) );
+        DirectX::XMStoreFloat3( &vertex.normal, DirectX::XMVector3Normalize( DirectX::XMVector3TransformNormal( DirectX::XMLoadFloat3( &vertex.normal ), transform ) ) );
+    }
+}
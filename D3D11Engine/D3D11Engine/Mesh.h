@@ -0,0 +1,78 @@
+#pragma once
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Vertex.h"
+
+// * * * Import time mesh - full precision, 32 bit indices * * * //
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<UINT> indices;      // triangle list
+};
+
+// A range of the index buffer drawn with one DrawIndexed, 16 bit indices are relative to baseVertex
+struct MeshPart
+{
+    UINT indexStart;
+    UINT indexCount;
+    UINT baseVertex;
+    UINT vertexCount;
+};
+
+// * * * Runtime ready mesh - packed vertices, 16 bit indices whenever possible * * * //
+struct PackedMeshData
+{
+    std::vector<PackedVertex> vertices;
+    std::vector<USHORT> indices16;  // used when indexFormat == DXGI_FORMAT_R16_UINT
+    std::vector<UINT> indices32;    // used when indexFormat == DXGI_FORMAT_R32_UINT
+    DXGI_FORMAT indexFormat;
+    VertexQuantization quantization;
+    std::vector<MeshPart> parts;
+};
+
+// * * * GPU mesh * * * //
+struct Mesh
+{
+    Mesh() : pVertexBuffer( NULL ), pIndexBuffer( NULL ), indexFormat( DXGI_FORMAT_R16_UINT ), indexCount( 0 ), vertexCount( 0 ) { }
+
+    ID3D11Buffer* pVertexBuffer;
+    ID3D11Buffer* pIndexBuffer;
+    DXGI_FORMAT indexFormat;
+    VertexQuantization quantization;
+    std::vector<MeshPart> parts;
+    UINT indexCount;
+    UINT vertexCount;
+};
+
+const UINT maxVerticesPer16BitPart = 65536;
+
+// Quantizes vertices and picks the index format. Meshes with more than 65536 vertices are split
+// into parts that each fit 16 bit indices, unless splitLargeMeshes is false (then 32 bit is used)
+void buildPackedMesh( const MeshData& mesh, PackedMeshData& packedMesh, bool splitLargeMeshes = true );
+
+// dynamicVertices: the vertex buffer is rewritten by the CPU (Map with WRITE_DISCARD), e.g. skinning
+bool createMesh( ID3D11Device* pDevice, const PackedMeshData& packedMesh, Mesh& mesh, bool dynamicVertices = false );
+void releaseMesh( Mesh& mesh );
+
+// Binds vertex/index buffers and draws every part, input layout / shaders are set by the caller
+void drawMesh( ID3D11DeviceContext* pDeviceContext, const Mesh& mesh );
+
+UINT getMeshIndexBytes( const Mesh& mesh );
+
+// * * * Procedural meshes (tests / benchmarks) * * * //
+// Flat grid in the xy-plane facing -z, cellsX * cellsY * 2 triangles
+void createGridMesh( UINT cellsX, UINT cellsY, float sizeX, float sizeY, MeshData& mesh );
+// UV sphere around the origin, front faces outwards
+void createSphereMesh( UINT slices, UINT stacks, float radius, MeshData& mesh );
+// Box around the origin, 4 vertices per side (flat normals), front faces outwards
+void createBoxMesh( const DirectX::XMFLOAT3& extents, MeshData& mesh );
+// Appends source to mesh, offset by translation
+void appendMesh( MeshData& mesh, const MeshData& source, const DirectX::XMFLOAT3& translation );
+// Positions and normals by transform (no non uniform scale), e.g. static geometry into world space
+void transformMesh( MeshData& mesh, DirectX::FXMMATRIX transform );
@@ -0,0 +1,168 @@
+#include "MeshFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "IndexCodec.h"
+
+bool serializeMesh( const PackedMeshData& packedMesh, std::vector<BYTE>& fileData, MeshFileStats& stats )
+{
+    ZeroMemory( &stats, sizeof(MeshFileStats) );
+
+    bool use16Bit = ( packedMesh.indexFormat == DXGI_FORMAT_R16_UINT );
+    UINT indexCount = (UINT)( use16Bit ? packedMesh.indices16.size() : packedMesh.indices32.size() );
+
+    // - - - compress every part on its own, indices are relative to the part - - - //
+    std::vector<MeshFilePart> fileParts( packedMesh.parts.size() );
+    std::vector<BYTE> indexData;
+
+    for ( size_t p = 0; p < packedMesh.parts.size(); p++ ) {
+        const MeshPart& part = packedMesh.parts[p];
+
+        size_t bound = getIndexBufferEncodeBound( part.indexCount, part.vertexCount );
+        size_t offset = indexData.size();
+        indexData.resize( offset + bound );
+
+        size_t size = use16Bit
+            ? encodeIndexBuffer( indexData.data() + offset, bound, packedMesh.indices16.data() + part.indexStart, part.indexCount )
+            : encodeIndexBuffer( indexData.data() + offset, bound, packedMesh.indices32.data() + part.indexStart, part.indexCount );
+        if ( size == 0 )
+            return false;
+
+        indexData.resize( offset + size );
+
+        fileParts[p].part = part;
+        fileParts[p].dataOffset = (UINT)offset;
+        fileParts[p].dataSize = (UINT)size;
+    }
+
+    MeshFileHeader header;
+    ZeroMemory( &header, sizeof(MeshFileHeader) );
+
+                memcpy( header.magic, "MESH", 4 );
+                header.version = meshFileVersion;
+                header.vertexCount = (UINT)packedMesh.vertices.size();
+                header.indexCount = indexCount;
+                header.partCount = (UINT)fileParts.size();
+                header.indexFormat = (UINT)packedMesh.indexFormat;
+                header.indexDataSize = (UINT)indexData.size();
+                header.quantization = packedMesh.quantization;
+
+    size_t vertexBytes = sizeof(PackedVertex) * packedMesh.vertices.size();
+    size_t partBytes = sizeof(MeshFilePart) * fileParts.size();
+
+    fileData.resize( sizeof(MeshFileHeader) + partBytes + vertexBytes + indexData.size() );
+    BYTE* pWrite = fileData.data();
+
+    memcpy( pWrite, &header, sizeof(MeshFileHeader) );  pWrite += sizeof(MeshFileHeader);
+    if ( partBytes )        { memcpy( pWrite, fileParts.data(), partBytes );                pWrite += partBytes; }
+    if ( vertexBytes )      { memcpy( pWrite, packedMesh.vertices.data(), vertexBytes );    pWrite += vertexBytes; }
+    if ( !indexData.empty() )  memcpy( pWrite, indexData.data(), indexData.size() );
+
+    stats.indexCount = indexCount;
+    stats.rawIndexBytes = indexCount * ( use16Bit ? 2 : 4 );
+    stats.compressedIndexBytes = (UINT)indexData.size();
+
+    return true;
+}
+
+bool deserializeMesh( const BYTE* pFileData, size_t fileSize, PackedMeshData& packedMesh )
+{
+    if ( fileSize < sizeof(MeshFileHeader) )
+        return false;
+
+    MeshFileHeader header;
+    memcpy( &header, pFileData, sizeof(MeshFileHeader) );
+
+    if ( memcmp( header.magic, "MESH", 4 ) != 0 || header.version != meshFileVersion ||
+         ( header.indexFormat != DXGI_FORMAT_R16_UINT && header.indexFormat != DXGI_FORMAT_R32_UINT ) )
+        return false;
+
+    size_t partBytes = sizeof(MeshFilePart) * header.partCount;
+    size_t vertexBytes = sizeof(PackedVertex) * header.vertexCount;
+    if ( fileSize != sizeof(MeshFileHeader) + partBytes + vertexBytes + header.indexDataSize )
+        return false;
+
+    const BYTE* pRead = pFileData + sizeof(MeshFileHeader);
+
+    std::vector<MeshFilePart> fileParts( header.partCount );
+    if ( partBytes )
+        memcpy( fileParts.data(), pRead, partBytes );
+    pRead += partBytes;
+
+    packedMesh.vertices.resize( header.vertexCount );
+    if ( vertexBytes )
+        memcpy( packedMesh.vertices.data(), pRead, vertexBytes );
+    pRead += vertexBytes;
+
+    const BYTE* pIndexData = pRead;
+
+    packedMesh.indexFormat = (DXGI_FORMAT)header.indexFormat;
+    packedMesh.quantization = header.quantization;
+    packedMesh.parts.resize( header.partCount );
+    packedMesh.indices16.clear();
+    packedMesh.indices32.clear();
+
+    bool use16Bit = ( packedMesh.indexFormat == DXGI_FORMAT_R16_UINT );
+    if ( use16Bit )
+        packedMesh.indices16.resize( header.indexCount );
+    else
+        packedMesh.indices32.resize( header.indexCount );
+
+    for ( UINT p = 0; p < header.partCount; p++ ) {
+        const MeshFilePart& filePart = fileParts[p];
+        const MeshPart& part = filePart.part;
+
+        if ( (size_t)filePart.dataOffset + filePart.dataSize > header.indexDataSize ||
+             (size_t)part.indexStart + part.indexCount > header.indexCount ||
+             (UINT64)part.baseVertex + part.vertexCount > header.vertexCount )
+            return false;
+
+        // Indices are relative to the part, the decoder rejects any outside of it
+        bool decoded = use16Bit
+            ? decodeIndexBuffer( packedMesh.indices16.data() + part.indexStart, part.indexCount, part.vertexCount, pIndexData + filePart.dataOffset, filePart.dataSize )
+            : decodeIndexBuffer( packedMesh.indices32.data() + part.indexStart, part.indexCount, part.vertexCount, pIndexData + filePart.dataOffset, filePart.dataSize );
+        if ( !decoded )
+            return false;
+
+        packedMesh.parts[p] = part;
+    }
+
+    return true;
+}
+
+bool writeMeshFile( const wchar_t* fileName, const PackedMeshData& packedMesh, MeshFileStats& stats )
+{
+    std::vector<BYTE> fileData;
+    if ( !serializeMesh( packedMesh, fileData, stats ) )
+        return false;
+
+    FILE* pFile = NULL;
+    if ( _wfopen_s( &pFile, fileName, L"wb" ) != 0 || !pFile )
+        return false;
+
+    size_t written = fwrite( fileData.data(), 1, fileData.size(), pFile );
+    fclose( pFile );
+
+    return written == fileData.size();
+}
+
+bool readMeshFile( const wchar_t* fileName, PackedMeshData& packedMesh )
+{
+    FILE* pFile = NULL;
+    if ( _wfopen_s( &pFile, fileName, L"rb" ) != 0 || !pFile )
+        return false;
+
+    fseek( pFile, 0, SEEK_END );
+    long fileSize = ftell( pFile );
+    fseek( pFile, 0, SEEK_SET );
+
+    std::vector<BYTE> fileData( fileSize > 0 ? (size_t)fileSize : 0 );
+    size_t read = fileData.empty() ? 0 : fread( fileData.data(), 1, fileData.size(), pFile );
+    fclose( pFile );
+
+    if ( read != fileData.size() )
+        return false;
+
+    return deserializeMesh( fileData.data(), fileData.size(), packedMesh );
+}
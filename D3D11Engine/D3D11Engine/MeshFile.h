@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "Mesh.h"
+
+// * * * Engine binary mesh file (.mesh) * * * //
+// Stores a PackedMeshData ready for createMesh(): quantized vertices as is, and each part's
+// index range compressed with the index codec (IndexCodec.h).
+//
+// [MeshFileHeader][MeshFilePart * partCount][PackedVertex * vertexCount][compressed indices]
+
+const UINT meshFileVersion = 1;
+
+struct MeshFileHeader
+{
+    char magic[4];                  // "MESH"
+    UINT version;
+    UINT vertexCount;
+    UINT indexCount;
+    UINT partCount;
+    UINT indexFormat;               // DXGI_FORMAT_R16_UINT / DXGI_FORMAT_R32_UINT at runtime
+    UINT indexDataSize;             // compressed bytes for all parts
+    VertexQuantization quantization;
+};
+
+struct MeshFilePart
+{
+    MeshPart part;
+    UINT dataOffset;                // into the compressed index data
+    UINT dataSize;
+};
+
+struct MeshFileStats
+{
+    UINT indexCount;
+    UINT rawIndexBytes;             // at the runtime index format
+    UINT compressedIndexBytes;
+};
+
+bool writeMeshFile( const wchar_t* fileName, const PackedMeshData& packedMesh, MeshFileStats& stats );
+bool readMeshFile( const wchar_t* fileName, PackedMeshData& packedMesh );
+
+// Same as the file functions, on memory
+bool serializeMesh( const PackedMeshData& packedMesh, std::vector<BYTE>& fileData, MeshFileStats& stats );
+bool deserializeMesh( const BYTE* pFileData, size_t fileSize, PackedMeshData& packedMesh );
@@ -0,0 +1,145 @@
+#include "MeshImport.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <string>
+#include <unordered_map>
+
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "Timer.h"
+
+bool importMesh( const wchar_t* fileName, MeshData& mesh )
+{
+    const wchar_t* pExtension = wcsrchr( fileName, L'.' );
+    if ( !pExtension )
+        return false;
+
+    if ( _wcsicmp( pExtension, L".obj" ) == 0 )
+        return importOBJ( fileName, mesh );
+    if ( _wcsicmp( pExtension, L".gltf" ) == 0 || _wcsicmp( pExtension, L".glb" ) == 0 )
+        return importGLTF( fileName, mesh );
+    return false;
+}
+
+// * * * * * NORMALS * * * * * //
+// Vertices on the same position are summed together, so texture seams don't show up as hard edges
+struct PositionKey
+{
+    UINT bits[3];
+    bool operator==( const PositionKey& other ) const { return memcmp( bits, other.bits, sizeof(bits) ) == 0; }
+};
+
+struct PositionKeyHash
+{
+    size_t operator()( const PositionKey& key ) const
+    {
+        return ( key.bits[0] * 73856093u ) ^ ( key.bits[1] * 19349663u ) ^ ( key.bits[2] * 83492791u );
+    }
+};
+
+void generateMissingNormals( MeshData& mesh )
+{
+    UINT vertexCount = (UINT)mesh.vertices.size();
+
+    std::vector<bool> missing( vertexCount );
+    std::vector<UINT> group( vertexCount );
+    std::unordered_map<PositionKey, UINT, PositionKeyHash> groups;
+
+    UINT missingCount = 0;
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        const DirectX::XMFLOAT3& normal = mesh.vertices[v].normal;
+        missing[v] = ( normal.x == 0.0f && normal.y == 0.0f && normal.z == 0.0f );
+        if ( !missing[v] )
+            continue;
+
+        PositionKey key;
+        memcpy( key.bits, &mesh.vertices[v].pos, sizeof(key.bits) );
+        group[v] = groups.insert( std::make_pair( key, (UINT)groups.size() ) ).first->second;
+        missingCount++;
+    }
+
+    if ( missingCount == 0 )
+        return;
+
+    // - - - sum face normals (cross product length = 2 * area) - - - //
+    std::vector<DirectX::XMFLOAT3> sums( groups.size(), DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f ) );
+    for ( size_t i = 0; i + 2 < mesh.indices.size(); i += 3 ) {
+        UINT corners[3] = { mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] };
+
+        DirectX::XMVECTOR a = DirectX::XMLoadFloat3( &mesh.vertices[corners[0]].pos );
+        DirectX::XMVECTOR b = DirectX::XMLoadFloat3( &mesh.vertices[corners[1]].pos );
+        DirectX::XMVECTOR c = DirectX::XMLoadFloat3( &mesh.vertices[corners[2]].pos );
+        DirectX::XMFLOAT3 faceNormal;
+        DirectX::XMStoreFloat3( &faceNormal, DirectX::XMVector3Cross( DirectX::XMVectorSubtract( b, a ), DirectX::XMVectorSubtract( c, a ) ) );
+
+        for ( int k = 0; k < 3; k++ ) {
+            if ( !missing[corners[k]] )
+                continue;
+
+            DirectX::XMFLOAT3& sum = sums[group[corners[k]]];
+            sum.x += faceNormal.x;
+            sum.y += faceNormal.y;
+            sum.z += faceNormal.z;
+        }
+    }
+
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        if ( !missing[v] )
+            continue;
+
+        DirectX::XMVECTOR sum = DirectX::XMLoadFloat3( &sums[group[v]] );
+        if ( DirectX::XMVectorGetX( DirectX::XMVector3LengthSq( sum ) ) > 0.0f )
+            DirectX::XMStoreFloat3( &mesh.vertices[v].normal, DirectX::XMVector3Normalize( sum ) );
+        else
+            mesh.vertices[v].normal = DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f );
+    }
+}
+
+// * * * * * BINARY CACHE * * * * * //
+static bool isCacheFresh( const wchar_t* fileName, const wchar_t* cacheFileName )
+{
+    WIN32_FILE_ATTRIBUTE_DATA source, cache;
+    if ( !GetFileAttributesExW( fileName, GetFileExInfoStandard, &source ) ||
+         !GetFileAttributesExW( cacheFileName, GetFileExInfoStandard, &cache ) )
+        return false;
+
+    return CompareFileTime( &cache.ftLastWriteTime, &source.ftLastWriteTime ) >= 0;
+}
+
+bool importMeshCached( const wchar_t* fileName, PackedMeshData& packedMesh )
+{
+    std::wstring cacheFileName = std::wstring( fileName ) + L".mesh";
+    char message[512];
+
+    Timer timer;
+    if ( isCacheFresh( fileName, cacheFileName.c_str() ) && readMeshFile( cacheFileName.c_str(), packedMesh ) ) {
+        sprintf_s( message, "[MeshImport] %ls: cache hit, %u vertices in %.2f ms\n", fileName, (UINT)packedMesh.vertices.size(), timer.elapsedMs() );
+        OutputDebugStringA( message );
+        return true;
+    }
+
+    MeshData mesh;
+    if ( !importMesh( fileName, mesh ) ) {
+        sprintf_s( message, "[MeshImport] %ls: import failed\n", fileName );
+        OutputDebugStringA( message );
+        return false;
+    }
+    double importMs = timer.elapsedMs();
+
+    char meshName[256];
+    sprintf_s( meshName, "%ls", fileName );
+    optimizeMesh( mesh, meshName );
+    buildPackedMesh( mesh, packedMesh );
+
+    // A cache that can't be written only costs the next run the import
+    MeshFileStats fileStats;
+    bool cached = writeMeshFile( cacheFileName.c_str(), packedMesh, fileStats );
+
+    sprintf_s( message, "[MeshImport] %ls: imported %u vertices / %u triangles in %.2f ms, %.2f ms total, indices %u -> %u bytes%s\n",
+               fileName, (UINT)mesh.vertices.size(), (UINT)mesh.indices.size() / 3, importMs, timer.elapsedMs(),
+               fileStats.rawIndexBytes, fileStats.compressedIndexBytes, cached ? "" : " (cache not written)" );
+    OutputDebugStringA( message );
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "Mesh.h"
+
+// * * * Source asset import: Wavefront OBJ and glTF 2.0 -> MeshData * * * //
+// Both formats are right handed with counter clockwise front faces, the importers flip z and the
+// winding to match the engine (left handed, clockwise front faces). Vertices without a normal get
+// a zero normal from the parsers and are filled in by generateMissingNormals.
+
+// The file is split into line aligned chunks that are parsed in parallel (threadCount 0 = one
+// per hardware thread), identical position / texcoord / normal triples become one vertex
+bool importOBJ( const wchar_t* fileName, MeshData& mesh, UINT threadCount = 0 );
+
+// .gltf (buffers in .bin files or data URIs) and .glb. Every triangle primitive of the default
+// scene, with the node transforms applied
+bool importGLTF( const wchar_t* fileName, MeshData& mesh );
+
+// By extension: .obj, .gltf, .glb
+bool importMesh( const wchar_t* fileName, MeshData& mesh );
+
+// Area weighted normals for the vertices that have a zero normal
+void generateMissingNormals( MeshData& mesh );
+
+// * * * Binary cache * * * //
+// Loads <fileName>.mesh (MeshFile.h) when it is at least as new as the source. Otherwise the
+// source is imported, optimized (MeshOptimizer.h) and packed, and the cache is written for the
+// next run, so later loads skip parsing entirely.
+bool importMeshCached( const wchar_t* fileName, PackedMeshData& packedMesh );
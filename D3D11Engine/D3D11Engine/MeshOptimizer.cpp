@@ -0,0 +1,465 @@
+#include "MeshOptimizer.h"
+
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+
+// * * * Triangle adjacency: vertex -> triangles using it * * * //
+struct TriangleAdjacency
+{
+    std::vector<UINT> offsets;      // vertexCount + 1
+    std::vector<UINT> triangles;
+
+    void build( const UINT* pIndices, UINT indexCount, UINT vertexCount )
+    {
+        offsets.assign( vertexCount + 1, 0 );
+        for ( UINT i = 0; i < indexCount; i++ )
+            offsets[pIndices[i] + 1]++;
+
+        for ( UINT v = 0; v < vertexCount; v++ )
+            offsets[v + 1] += offsets[v];
+
+        std::vector<UINT> fill( offsets.begin(), offsets.end() - 1 );
+        triangles.resize( indexCount );
+        for ( UINT i = 0; i < indexCount; i++ )
+            triangles[fill[pIndices[i]]++] = i / 3;
+    }
+};
+
+// * * * FIFO cache simulation with timestamps, returns misses for the triangle * * * //
+static UINT simulateCache( std::vector<UINT>& cacheTime, UINT& timestamp, UINT a, UINT b, UINT c )
+{
+    UINT misses = 0;
+    UINT tri[3] = { a, b, c };
+    for ( int k = 0; k < 3; k++ ) {
+        if ( timestamp - cacheTime[tri[k]] > vertexCacheSize ) {
+            cacheTime[tri[k]] = timestamp++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// * * * * * VERTEX CACHE - TIPSIFY * * * * * //
+static int skipDeadEnd( const std::vector<UINT>& liveTriangles, std::vector<UINT>& deadEndStack, UINT& cursor, UINT vertexCount )
+{
+    // Most recently used vertex that still has triangles left
+    while ( !deadEndStack.empty() ) {
+        UINT v = deadEndStack.back();
+        deadEndStack.pop_back();
+        if ( liveTriangles[v] > 0 )
+            return (int)v;
+    }
+
+    // Otherwise the next vertex in input order with triangles left
+    while ( cursor < vertexCount ) {
+        if ( liveTriangles[cursor] > 0 )
+            return (int)cursor;
+        cursor++;
+    }
+    return -1;
+}
+
+void optimizeVertexCache( UINT* pIndices, UINT indexCount, UINT vertexCount, std::vector<UINT>* pClusters )
+{
+    assert( indexCount % 3 == 0 );
+    UINT triangleCount = indexCount / 3;
+    if ( triangleCount == 0 )
+        return;
+
+    TriangleAdjacency adjacency;
+    adjacency.build( pIndices, indexCount, vertexCount );
+
+    std::vector<UINT> liveTriangles( vertexCount );
+    for ( UINT v = 0; v < vertexCount; v++ )
+        liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+    std::vector<UINT> cacheTime( vertexCount, 0 );
+    std::vector<bool> emitted( triangleCount, false );
+    std::vector<UINT> deadEndStack;
+    std::vector<UINT> candidates;
+    std::vector<UINT> result;
+    result.reserve( indexCount );
+
+    if ( pClusters ) {
+        pClusters->clear();
+        pClusters->push_back( 0 );
+    }
+
+    UINT timestamp = vertexCacheSize + 1;
+    UINT cursor = 0;
+    int fanning = skipDeadEnd( liveTriangles, deadEndStack, cursor, vertexCount );
+
+    while ( fanning >= 0 ) {
+        candidates.clear();
+
+        // Emit every remaining triangle around the fanning vertex
+        for ( UINT i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; i++ ) {
+            UINT t = adjacency.triangles[i];
+            if ( emitted[t] )
+                continue;
+
+            for ( int k = 0; k < 3; k++ ) {
+                UINT v = pIndices[t * 3 + k];
+                result.push_back( v );
+                deadEndStack.push_back( v );
+                candidates.push_back( v );
+                liveTriangles[v]--;
+
+                if ( timestamp - cacheTime[v] > vertexCacheSize )
+                    cacheTime[v] = timestamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // Next fanning vertex: the candidate that stays in cache longest while still having work left
+        int next = -1;
+        int bestPriority = -1;
+        for ( size_t c = 0; c < candidates.size(); c++ ) {
+            UINT v = candidates[c];
+            if ( liveTriangles[v] == 0 )
+                continue;
+
+            int priority = 0;
+            if ( timestamp - cacheTime[v] + 2 * liveTriangles[v] <= vertexCacheSize )
+                priority = (int)( timestamp - cacheTime[v] );
+
+            if ( priority > bestPriority ) {
+                bestPriority = priority;
+                next = (int)v;
+            }
+        }
+
+        if ( next < 0 ) {
+            next = skipDeadEnd( liveTriangles, deadEndStack, cursor, vertexCount );
+
+            // Jumping away from the current area - a hard cluster boundary
+            if ( pClusters && next >= 0 && result.size() < indexCount )
+                pClusters->push_back( (UINT)result.size() / 3 );
+        }
+        fanning = next;
+    }
+
+    assert( result.size() == indexCount );
+    memcpy( pIndices, result.data(), sizeof(UINT) * indexCount );
+}
+
+// * * * * * OVERDRAW - cluster sorting * * * * * //
+void optimizeOverdraw( UINT* pIndices, UINT indexCount, const Vertex* pVertices, UINT vertexCount, float threshold )
+{
+    UINT triangleCount = indexCount / 3;
+    if ( triangleCount == 0 )
+        return;
+
+    std::vector<UINT> hardClusters;
+    optimizeVertexCache( pIndices, indexCount, vertexCount, &hardClusters );
+
+    float acmr, atvr;
+    analyzeVertexCache( pIndices, indexCount, vertexCount, acmr, atvr );
+
+    // - - - soft boundaries: cut a hard cluster wherever its ACMR so far is within the threshold - - - //
+    std::vector<UINT> clusters;
+    std::vector<UINT> cacheTime( vertexCount, 0 );
+    UINT timestamp = vertexCacheSize + 1;
+
+    for ( size_t h = 0; h < hardClusters.size(); h++ ) {
+        UINT start = hardClusters[h];
+        UINT end = ( h + 1 < hardClusters.size() ) ? hardClusters[h + 1] : triangleCount;
+
+        timestamp += vertexCacheSize + 1;   // flush the cache
+        UINT clusterStart = start;
+        UINT clusterMisses = 0;
+        clusters.push_back( start );
+
+        for ( UINT t = start; t < end; t++ ) {
+            clusterMisses += simulateCache( cacheTime, timestamp, pIndices[t * 3], pIndices[t * 3 + 1], pIndices[t * 3 + 2] );
+
+            UINT clusterTriangles = t - clusterStart + 1;
+            if ( t + 1 < end && (float)clusterMisses <= (float)clusterTriangles * acmr * threshold ) {
+                clusters.push_back( t + 1 );
+                clusterStart = t + 1;
+                clusterMisses = 0;
+                timestamp += vertexCacheSize + 1;
+            }
+        }
+    }
+
+    // - - - mesh centroid - - - //
+    double meshCenter[3] = { 0.0, 0.0, 0.0 };
+    double meshArea = 0.0;
+    std::vector<float> triangleData( triangleCount * 7 );   // centroid xyz, area, normal xyz (unnormalized)
+
+    for ( UINT t = 0; t < triangleCount; t++ ) {
+        const DirectX::XMFLOAT3& a = pVertices[pIndices[t * 3 + 0]].pos;
+        const DirectX::XMFLOAT3& b = pVertices[pIndices[t * 3 + 1]].pos;
+        const DirectX::XMFLOAT3& c = pVertices[pIndices[t * 3 + 2]].pos;
+
+        float e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+        float e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float area = sqrtf( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] ) * 0.5f;
+
+        float* pData = &triangleData[t * 7];
+        pData[0] = ( a.x + b.x + c.x ) / 3.0f;
+        pData[1] = ( a.y + b.y + c.y ) / 3.0f;
+        pData[2] = ( a.z + b.z + c.z ) / 3.0f;
+        pData[3] = area;
+        pData[4] = n[0]; pData[5] = n[1]; pData[6] = n[2];
+
+        meshCenter[0] += pData[0] * area;
+        meshCenter[1] += pData[1] * area;
+        meshCenter[2] += pData[2] * area;
+        meshArea += area;
+    }
+
+    if ( meshArea > 0.0 ) {
+        meshCenter[0] /= meshArea; meshCenter[1] /= meshArea; meshCenter[2] /= meshArea;
+    }
+
+    // - - - sort key per cluster: how much the cluster faces away from the mesh center - - - //
+    size_t clusterCount = clusters.size();
+    std::vector<float> sortKey( clusterCount );
+    std::vector<UINT> order( clusterCount );
+
+    for ( size_t c = 0; c < clusterCount; c++ ) {
+        UINT start = clusters[c];
+        UINT end = ( c + 1 < clusterCount ) ? clusters[c + 1] : triangleCount;
+
+        float center[3] = { 0.0f, 0.0f, 0.0f }, normal[3] = { 0.0f, 0.0f, 0.0f }, area = 0.0f;
+        for ( UINT t = start; t < end; t++ ) {
+            const float* pData = &triangleData[t * 7];
+            center[0] += pData[0] * pData[3];
+            center[1] += pData[1] * pData[3];
+            center[2] += pData[2] * pData[3];
+            area += pData[3];
+            normal[0] += pData[4]; normal[1] += pData[5]; normal[2] += pData[6];
+        }
+
+        float invArea = ( area > 0.0f ) ? 1.0f / area : 0.0f;
+        float normalLength = sqrtf( normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] );
+        float invNormal = ( normalLength > 0.0f ) ? 1.0f / normalLength : 0.0f;
+
+        float toCluster[3] = { center[0] * invArea - (float)meshCenter[0], center[1] * invArea - (float)meshCenter[1], center[2] * invArea - (float)meshCenter[2] };
+        sortKey[c] = ( toCluster[0] * normal[0] + toCluster[1] * normal[1] + toCluster[2] * normal[2] ) * invNormal;
+        order[c] = (UINT)c;
+    }
+
+    // Outward facing clusters first, they are the ones most likely to occlude the rest
+    std::stable_sort( order.begin(), order.end(), [&sortKey]( UINT a, UINT b ) { return sortKey[a] > sortKey[b]; } );
+
+    std::vector<UINT> result;
+    result.reserve( indexCount );
+    for ( size_t i = 0; i < clusterCount; i++ ) {
+        UINT c = order[i];
+        UINT start = clusters[c];
+        UINT end = ( c + 1 < clusterCount ) ? clusters[c + 1] : triangleCount;
+        result.insert( result.end(), pIndices + start * 3, pIndices + end * 3 );
+    }
+
+    memcpy( pIndices, result.data(), sizeof(UINT) * indexCount );
+}
+
+// * * * * * VERTEX FETCH - first use order * * * * * //
+UINT optimizeVertexFetch( Vertex* pVertices, UINT* pIndices, UINT indexCount, UINT vertexCount )
+{
+    const UINT unused = 0xFFFFFFFF;
+    std::vector<UINT> remap( vertexCount, unused );
+    UINT nextVertex = 0;
+
+    for ( UINT i = 0; i < indexCount; i++ ) {
+        UINT v = pIndices[i];
+        if ( remap[v] == unused )
+            remap[v] = nextVertex++;
+        pIndices[i] = remap[v];
+    }
+
+    std::vector<Vertex> reordered( nextVertex );
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        if ( remap[v] != unused )
+            reordered[remap[v]] = pVertices[v];
+    }
+
+    std::copy( reordered.begin(), reordered.end(), pVertices );
+    return nextVertex;
+}
+
+// * * * * * ANALYZERS * * * * * //
+void analyzeVertexCache( const UINT* pIndices, UINT indexCount, UINT vertexCount, float& acmr, float& atvr )
+{
+    std::vector<UINT> cacheTime( vertexCount, 0 );
+    UINT timestamp = vertexCacheSize + 1;
+    UINT misses = 0;
+
+    for ( UINT i = 0; i + 2 < indexCount; i += 3 )
+        misses += simulateCache( cacheTime, timestamp, pIndices[i], pIndices[i + 1], pIndices[i + 2] );
+
+    acmr = ( indexCount > 0 ) ? (float)misses / ( indexCount / 3 ) : 0.0f;
+    atvr = ( vertexCount > 0 ) ? (float)misses / vertexCount : 0.0f;
+}
+
+float analyzeOverdraw( const UINT* pIndices, UINT indexCount, const Vertex* pVertices, UINT vertexCount )
+{
+    const int gridSize = 256;
+
+    float minPos[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxPos[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        const float* p = &pVertices[v].pos.x;
+        for ( int k = 0; k < 3; k++ ) {
+            minPos[k] = ( p[k] < minPos[k] ) ? p[k] : minPos[k];
+            maxPos[k] = ( p[k] > maxPos[k] ) ? p[k] : maxPos[k];
+        }
+    }
+
+    float extent = 0.0f;
+    for ( int k = 0; k < 3; k++ )
+        extent = ( maxPos[k] - minPos[k] > extent ) ? maxPos[k] - minPos[k] : extent;
+    float scale = ( extent > 0.0f ) ? 1.0f / extent : 0.0f;
+
+    std::vector<float> depth( gridSize * gridSize );
+    double shaded = 0.0, covered = 0.0;
+
+    // 6 axis views, the left handed basis (right = up x forward) keeps clockwise = front facing
+    for ( int axis = 0; axis < 3; axis++ ) {
+        for ( int side = 0; side < 2; side++ ) {
+            int forwardAxis = axis;
+            int rightAxis = ( axis + 1 ) % 3;
+            int upAxis = ( axis + 2 ) % 3;
+            float forwardSign = side ? -1.0f : 1.0f;
+            float rightSign = side ? -1.0f : 1.0f;
+
+            std::fill( depth.begin(), depth.end(), FLT_MAX );
+            UINT viewShaded = 0;
+
+            for ( UINT i = 0; i + 2 < indexCount; i += 3 ) {
+                float sx[3], sy[3], sz[3];
+                for ( int k = 0; k < 3; k++ ) {
+                    const float* p = &pVertices[pIndices[i + k]].pos.x;
+                    sx[k] = ( ( p[rightAxis] - minPos[rightAxis] ) * scale * rightSign + ( side ? 1.0f : 0.0f ) ) * gridSize;
+                    sy[k] = ( p[upAxis] - minPos[upAxis] ) * scale * gridSize;
+                    sz[k] = ( p[forwardAxis] - minPos[forwardAxis] ) * scale * forwardSign;
+                }
+
+                // Clockwise in y-up screen space = negative area = front facing
+                float area = ( sx[1] - sx[0] ) * ( sy[2] - sy[0] ) - ( sy[1] - sy[0] ) * ( sx[2] - sx[0] );
+                if ( area >= 0.0f )
+                    continue;
+
+                int minX = (int)floorf( std::min( sx[0], std::min( sx[1], sx[2] ) ) );
+                int maxX = (int)ceilf( std::max( sx[0], std::max( sx[1], sx[2] ) ) );
+                int minY = (int)floorf( std::min( sy[0], std::min( sy[1], sy[2] ) ) );
+                int maxY = (int)ceilf( std::max( sy[0], std::max( sy[1], sy[2] ) ) );
+                minX = std::max( minX, 0 ); minY = std::max( minY, 0 );
+                maxX = std::min( maxX, gridSize - 1 ); maxY = std::min( maxY, gridSize - 1 );
+
+                float invArea = 1.0f / area;
+                for ( int y = minY; y <= maxY; y++ ) {
+                    for ( int x = minX; x <= maxX; x++ ) {
+                        float px = x + 0.5f, py = y + 0.5f;
+                        float w0 = ( ( sx[2] - sx[1] ) * ( py - sy[1] ) - ( sy[2] - sy[1] ) * ( px - sx[1] ) ) * invArea;
+                        float w1 = ( ( sx[0] - sx[2] ) * ( py - sy[2] ) - ( sy[0] - sy[2] ) * ( px - sx[2] ) ) * invArea;
+                        float w2 = 1.0f - w0 - w1;
+                        if ( w0 < 0.0f || w1 < 0.0f || w2 < 0.0f )
+                            continue;
+
+                        float z = w0 * sz[0] + w1 * sz[1] + w2 * sz[2];
+                        float& stored = depth[y * gridSize + x];
+                        if ( z <= stored ) {
+                            stored = z;
+                            viewShaded++;
+                        }
+                    }
+                }
+            }
+
+            for ( size_t p = 0; p < depth.size(); p++ )
+                covered += ( depth[p] != FLT_MAX ) ? 1.0 : 0.0;
+            shaded += viewShaded;
+        }
+    }
+
+    return ( covered > 0.0 ) ? (float)( shaded / covered ) : 0.0f;
+}
+
+float analyzeVertexFetch( const UINT* pIndices, UINT indexCount, UINT vertexCount, UINT vertexSize )
+{
+    // Small fully associative LRU cache of 64 byte lines
+    const UINT lineSize = 64;
+    const UINT lineCount = 16;
+
+    UINT64 lines[lineCount];
+    UINT64 lineTime[lineCount];
+    for ( UINT l = 0; l < lineCount; l++ ) {
+        lines[l] = ~0ull;
+        lineTime[l] = 0;
+    }
+
+    UINT64 time = 1;
+    UINT64 fetchedBytes = 0;
+
+    for ( UINT i = 0; i < indexCount; i++ ) {
+        UINT64 first = (UINT64)pIndices[i] * vertexSize / lineSize;
+        UINT64 last = ( (UINT64)pIndices[i] * vertexSize + vertexSize - 1 ) / lineSize;
+
+        for ( UINT64 line = first; line <= last; line++ ) {
+            UINT hit = lineCount, oldest = 0;
+            for ( UINT l = 0; l < lineCount; l++ ) {
+                if ( lines[l] == line )
+                    hit = l;
+                if ( lineTime[l] < lineTime[oldest] )
+                    oldest = l;
+            }
+
+            if ( hit == lineCount ) {
+                lines[oldest] = line;
+                lineTime[oldest] = time++;
+                fetchedBytes += lineSize;
+            }
+            else {
+                lineTime[hit] = time++;
+            }
+        }
+    }
+
+    UINT64 bufferBytes = (UINT64)vertexCount * vertexSize;
+    return ( bufferBytes > 0 ) ? (float)( (double)fetchedBytes / bufferBytes ) : 0.0f;
+}
+
+MeshOptimizationStats analyzeMesh( const MeshData& mesh )
+{
+    MeshOptimizationStats stats;
+    UINT vertexCount = (UINT)mesh.vertices.size();
+    UINT indexCount = (UINT)mesh.indices.size();
+
+    analyzeVertexCache( mesh.indices.data(), indexCount, vertexCount, stats.acmr, stats.atvr );
+    stats.overdraw = analyzeOverdraw( mesh.indices.data(), indexCount, mesh.vertices.data(), vertexCount );
+    stats.overfetch = analyzeVertexFetch( mesh.indices.data(), indexCount, vertexCount, sizeof(PackedVertex) );
+    return stats;
+}
+
+void logMeshStats( const char* meshName, const char* label, const MeshOptimizationStats& stats )
+{
+    char message[256];
+    sprintf_s( message, "[MeshOptimizer] %s %s: ACMR %.3f | ATVR %.3f | overdraw %.3f | overfetch %.3f\n",
+               meshName, label, stats.acmr, stats.atvr, stats.overdraw, stats.overfetch );
+    OutputDebugStringA( message );
+}
+
+void optimizeMesh( MeshData& mesh, const char* meshName, float overdrawThreshold )
+{
+    if ( mesh.indices.empty() )
+        return;
+
+    logMeshStats( meshName, "before", analyzeMesh( mesh ) );
+
+    UINT vertexCount = (UINT)mesh.vertices.size();
+    optimizeOverdraw( mesh.indices.data(), (UINT)mesh.indices.size(), mesh.vertices.data(), vertexCount, overdrawThreshold );
+
+    vertexCount = optimizeVertexFetch( mesh.vertices.data(), mesh.indices.data(), (UINT)mesh.indices.size(), vertexCount );
+    mesh.vertices.resize( vertexCount );
+
+    logMeshStats( meshName, "after", analyzeMesh( mesh ) );
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "Mesh.h"
+
+// * * * Import time mesh optimization * * * //
+// 1. Vertex cache: Tipsify triangle reordering (Sander et al. 2007) for post-transform cache hits
+// 2. Overdraw: the Tipsify output is cut into clusters, which are sorted so outward facing clusters
+//    come first (view independent). Clusters are only cut where the cache efficiency stays within
+//    overdrawThreshold of the cache optimized order.
+// 3. Vertex fetch: vertices are reordered in first-use order so fetches walk memory linearly.
+
+const UINT vertexCacheSize = 16;    // simulated FIFO post-transform cache
+
+struct MeshOptimizationStats
+{
+    float acmr;         // average cache miss ratio - transformed vertices per triangle (0.5 .. 3)
+    float atvr;         // average transformed vertex ratio - transformed vertices per vertex (1 = optimal)
+    float overdraw;     // shaded pixels / covered pixels, averaged over 6 axis views (1 = optimal)
+    float overfetch;    // fetched vertex bytes / vertex buffer bytes (1 = optimal)
+};
+
+// Triangle reordering, indices are rewritten in place. clusters gets the first triangle of each
+// cluster (hard boundaries where Tipsify had to jump to a new area) when not NULL.
+void optimizeVertexCache( UINT* pIndices, UINT indexCount, UINT vertexCount, std::vector<UINT>* pClusters = NULL );
+
+void optimizeOverdraw( UINT* pIndices, UINT indexCount, const Vertex* pVertices, UINT vertexCount, float threshold = 1.05f );
+
+// Returns the number of vertices left (unused vertices are dropped)
+UINT optimizeVertexFetch( Vertex* pVertices, UINT* pIndices, UINT indexCount, UINT vertexCount );
+
+// * * * Analyzers * * * //
+void analyzeVertexCache( const UINT* pIndices, UINT indexCount, UINT vertexCount, float& acmr, float& atvr );
+float analyzeOverdraw( const UINT* pIndices, UINT indexCount, const Vertex* pVertices, UINT vertexCount );
+float analyzeVertexFetch( const UINT* pIndices, UINT indexCount, UINT vertexCount, UINT vertexSize );
+
+MeshOptimizationStats analyzeMesh( const MeshData& mesh );
+
+// Runs all three passes on the mesh and logs stats before / after
+void optimizeMesh( MeshData& mesh, const char* meshName, float overdrawThreshold = 1.05f );
+void logMeshStats( const char* meshName, const char* label, const MeshOptimizationStats& stats );
@@ -0,0 +1,331 @@
+#include "Meshlet.h"
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <assert.h>
+
+// * * * Small float3 helpers * * * //
+static inline float dot3( const float* a, const float* b )
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void normalize3( float* v )
+{
+    float length = sqrtf( dot3( v, v ) );
+    if ( length > 0.0f ) {
+        v[0] /= length; v[1] /= length; v[2] /= length;
+    }
+}
+
+// * * * * * BOUNDS * * * * * //
+static void computeMeshletBounds( const MeshData& mesh, const MeshletData& meshletData, Meshlet& meshlet )
+{
+    const UINT* pVertexIndices = &meshletData.vertices[meshlet.vertexOffset];
+    const BYTE* pTriangles = &meshletData.triangles[meshlet.triangleOffset * 3];
+
+    // - - - sphere around the bounding box center - - - //
+    float minPos[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxPos[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for ( UINT v = 0; v < meshlet.vertexCount; v++ ) {
+        const float* p = &mesh.vertices[pVertexIndices[v]].pos.x;
+        for ( int k = 0; k < 3; k++ ) {
+            minPos[k] = ( p[k] < minPos[k] ) ? p[k] : minPos[k];
+            maxPos[k] = ( p[k] > maxPos[k] ) ? p[k] : maxPos[k];
+        }
+    }
+
+    float center[3] = { ( minPos[0] + maxPos[0] ) * 0.5f, ( minPos[1] + maxPos[1] ) * 0.5f, ( minPos[2] + maxPos[2] ) * 0.5f };
+    float radiusSq = 0.0f;
+    for ( UINT v = 0; v < meshlet.vertexCount; v++ ) {
+        const float* p = &mesh.vertices[pVertexIndices[v]].pos.x;
+        float d[3] = { p[0] - center[0], p[1] - center[1], p[2] - center[2] };
+        radiusSq = ( dot3( d, d ) > radiusSq ) ? dot3( d, d ) : radiusSq;
+    }
+
+    meshlet.center = DirectX::XMFLOAT3( center[0], center[1], center[2] );
+    meshlet.radius = sqrtf( radiusSq );
+
+    // - - - normal cone from the triangle normals (clockwise = front, see the quad in main) - - - //
+    std::vector<float> normals( meshlet.triangleCount * 3 );
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    UINT validNormals = 0;
+
+    for ( UINT t = 0; t < meshlet.triangleCount; t++ ) {
+        const float* a = &mesh.vertices[pVertexIndices[pTriangles[t * 3 + 0]]].pos.x;
+        const float* b = &mesh.vertices[pVertexIndices[pTriangles[t * 3 + 1]]].pos.x;
+        const float* c = &mesh.vertices[pVertexIndices[pTriangles[t * 3 + 2]]].pos.x;
+
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float* n = &normals[t * 3];
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+        // Degenerate triangles don't constrain the cone
+        if ( dot3( n, n ) == 0.0f )
+            continue;
+
+        normalize3( n );
+        axis[0] += n[0]; axis[1] += n[1]; axis[2] += n[2];
+        validNormals++;
+    }
+    normalize3( axis );
+
+    float minDot = 1.0f;
+    for ( UINT t = 0; t < meshlet.triangleCount; t++ ) {
+        const float* n = &normals[t * 3];
+        if ( dot3( n, n ) == 0.0f )
+            continue;
+        float d = dot3( n, axis );
+        minDot = ( d < minDot ) ? d : minDot;
+    }
+
+    meshlet.coneAxis = DirectX::XMFLOAT3( axis[0], axis[1], axis[2] );
+    meshlet.coneApex = meshlet.center;
+
+    // Normals spread over more than ~84 degrees from the axis: no useful cone
+    if ( validNormals == 0 || minDot <= 0.1f ) {
+        meshlet.coneCutoff = 1.0f;
+        return;
+    }
+
+    // Apex: move back along the axis until every triangle plane is in front of it
+    float maxT = 0.0f;
+    for ( UINT t = 0; t < meshlet.triangleCount; t++ ) {
+        const float* n = &normals[t * 3];
+        if ( dot3( n, n ) == 0.0f )
+            continue;
+
+        const float* a = &mesh.vertices[pVertexIndices[pTriangles[t * 3]]].pos.x;
+        float toCenter[3] = { center[0] - a[0], center[1] - a[1], center[2] - a[2] };
+        float distance = dot3( toCenter, n ) / dot3( axis, n );
+        maxT = ( distance > maxT ) ? distance : maxT;
+    }
+
+    meshlet.coneApex = DirectX::XMFLOAT3( center[0] - axis[0] * maxT, center[1] - axis[1] * maxT, center[2] - axis[2] * maxT );
+    meshlet.coneCutoff = sqrtf( 1.0f - minDot * minDot );
+}
+
+// * * * * * BUILD * * * * * //
+void buildMeshlets( const MeshData& mesh, MeshletData& meshletData )
+{
+    meshletData.meshlets.clear();
+    meshletData.vertices.clear();
+    meshletData.triangles.clear();
+
+    const BYTE unused = 0xFF;
+    std::vector<BYTE> localIndex( mesh.vertices.size(), unused );
+
+    Meshlet meshlet;
+    ZeroMemory( &meshlet, sizeof(Meshlet) );
+
+    for ( size_t i = 0; i + 2 < mesh.indices.size(); i += 3 ) {
+        UINT a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+        UINT newVertices = ( localIndex[a] == unused ) + ( localIndex[b] == unused && b != a ) + ( localIndex[c] == unused && c != a && c != b );
+
+        // - - - close the meshlet when the triangle does not fit - - - //
+        if ( meshlet.vertexCount + newVertices > maxMeshletVertices || meshlet.triangleCount + 1 > maxMeshletTriangles ) {
+            for ( UINT v = 0; v < meshlet.vertexCount; v++ )
+                localIndex[meshletData.vertices[meshlet.vertexOffset + v]] = unused;
+
+            meshletData.meshlets.push_back( meshlet );
+
+            meshlet.vertexOffset = (UINT)meshletData.vertices.size();
+            meshlet.triangleOffset = (UINT)( meshletData.triangles.size() / 3 );
+            meshlet.vertexCount = 0;
+            meshlet.triangleCount = 0;
+        }
+
+        UINT triangle[3] = { a, b, c };
+        for ( int k = 0; k < 3; k++ ) {
+            UINT v = triangle[k];
+            if ( localIndex[v] == unused ) {
+                localIndex[v] = (BYTE)meshlet.vertexCount++;
+                meshletData.vertices.push_back( v );
+            }
+            meshletData.triangles.push_back( localIndex[v] );
+        }
+        meshlet.triangleCount++;
+    }
+
+    if ( meshlet.triangleCount > 0 )
+        meshletData.meshlets.push_back( meshlet );
+
+    for ( size_t m = 0; m < meshletData.meshlets.size(); m++ )
+        computeMeshletBounds( mesh, meshletData, meshletData.meshlets[m] );
+}
+
+// * * * * * GPU MESH * * * * * //
+bool createMeshletMesh( ID3D11Device* pDevice, const MeshData& mesh, MeshletMesh& meshletMesh )
+{
+    buildMeshlets( mesh, meshletMesh.meshletData );
+    const MeshletData& meshletData = meshletMesh.meshletData;
+
+    // Packed vertices in mesh order, a single part (meshlets index the whole vertex buffer)
+    PackedMeshData packedMesh;
+    buildPackedMesh( mesh, packedMesh, false );
+    if ( packedMesh.vertices.empty() || meshletData.meshlets.empty() )
+        return false;
+
+    meshletMesh.indexFormat = packedMesh.indexFormat;
+    meshletMesh.indexSize = ( packedMesh.indexFormat == DXGI_FORMAT_R16_UINT ) ? 2 : 4;
+    meshletMesh.quantization = packedMesh.quantization;
+
+    // - - - mesh indices of every meshlet back to back, culling copies whole ranges - - - //
+    UINT indexCount = (UINT)meshletData.triangles.size();
+    meshletMesh.indexData.resize( indexCount * meshletMesh.indexSize );
+
+    for ( size_t m = 0; m < meshletData.meshlets.size(); m++ ) {
+        const Meshlet& meshlet = meshletData.meshlets[m];
+        for ( UINT i = meshlet.triangleOffset * 3; i < ( meshlet.triangleOffset + meshlet.triangleCount ) * 3; i++ ) {
+            UINT v = meshletData.vertices[meshlet.vertexOffset + meshletData.triangles[i]];
+            if ( meshletMesh.indexSize == 2 )
+                ( (USHORT*)meshletMesh.indexData.data() )[i] = (USHORT)v;
+            else
+                ( (UINT*)meshletMesh.indexData.data() )[i] = v;
+        }
+    }
+
+    // Vertex buffer desciption
+    D3D11_BUFFER_DESC vertexBufferDesc;
+    ZeroMemory( &vertexBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                vertexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+                vertexBufferDesc.ByteWidth = (UINT)( sizeof(PackedVertex) * packedMesh.vertices.size() );
+                vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+                vertexBufferDesc.CPUAccessFlags = 0;
+                vertexBufferDesc.MiscFlags = 0;
+
+    D3D11_SUBRESOURCE_DATA vertexBufferData;
+    ZeroMemory( &vertexBufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                vertexBufferData.pSysMem = packedMesh.vertices.data();
+
+    HRESULT hr = pDevice->CreateBuffer( &vertexBufferDesc, &vertexBufferData, &meshletMesh.pVertexBuffer );
+    if ( FAILED(hr) )
+        return false;
+
+    // Index buffer description - worst case everything is visible
+    D3D11_BUFFER_DESC indexBufferDesc;
+    ZeroMemory( &indexBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                indexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+                indexBufferDesc.ByteWidth = (UINT)meshletMesh.indexData.size();
+                indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+                indexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+                indexBufferDesc.MiscFlags = 0;
+
+    hr = pDevice->CreateBuffer( &indexBufferDesc, NULL, &meshletMesh.pIndexBuffer );
+    if ( FAILED(hr) ) {
+        meshletMesh.pVertexBuffer->Release();
+        meshletMesh.pVertexBuffer = NULL;
+        return false;
+    }
+
+    ZeroMemory( &meshletMesh.stats, sizeof(MeshletCullStats) );
+    meshletMesh.stats.meshletCount = (UINT)meshletData.meshlets.size();
+    meshletMesh.stats.totalTriangles = indexCount / 3;
+    meshletMesh.visibleIndexCount = 0;
+    return true;
+}
+
+void releaseMeshletMesh( MeshletMesh& meshletMesh )
+{
+    if ( meshletMesh.pIndexBuffer ) meshletMesh.pIndexBuffer->Release();
+    if ( meshletMesh.pVertexBuffer ) meshletMesh.pVertexBuffer->Release();
+
+    meshletMesh.pIndexBuffer = NULL;
+    meshletMesh.pVertexBuffer = NULL;
+    meshletMesh.meshletData.meshlets.clear();
+    meshletMesh.indexData.clear();
+}
+
+// * * * * * CULLING * * * * * //
+void cullMeshlets( ID3D11DeviceContext* pDeviceContext, MeshletMesh& meshletMesh, const Frustum& frustum, const DirectX::XMFLOAT3& eyePosition )
+{
+    MeshletCullStats& stats = meshletMesh.stats;
+    stats.frustumCulled = 0;
+    stats.backfaceCulled = 0;
+    stats.visibleTriangles = 0;
+    meshletMesh.visibleIndexCount = 0;
+
+    D3D11_MAPPED_SUBRESOURCE mappedIndices;
+    HRESULT hr = pDeviceContext->Map( meshletMesh.pIndexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedIndices );
+    if ( FAILED(hr) )
+        return;
+
+    BYTE* pDestination = (BYTE*)mappedIndices.pData;
+    const BYTE* pSource = meshletMesh.indexData.data();
+    const std::vector<Meshlet>& meshlets = meshletMesh.meshletData.meshlets;
+    UINT triangleBytes = meshletMesh.indexSize * 3;
+
+    // Adjacent survivors are copied as one range
+    UINT runStart = 0, runTriangles = 0;
+
+    for ( size_t m = 0; m < meshlets.size(); m++ ) {
+        const Meshlet& meshlet = meshlets[m];
+
+        bool visible = sphereInFrustum( frustum, meshlet.center, meshlet.radius );
+        if ( !visible ) {
+            stats.frustumCulled++;
+        }
+        else if ( meshlet.coneCutoff < 1.0f ) {
+            float toApex[3] = { meshlet.coneApex.x - eyePosition.x, meshlet.coneApex.y - eyePosition.y, meshlet.coneApex.z - eyePosition.z };
+            float distance = sqrtf( dot3( toApex, toApex ) );
+            if ( dot3( toApex, &meshlet.coneAxis.x ) >= meshlet.coneCutoff * distance ) {
+                stats.backfaceCulled++;
+                visible = false;
+            }
+        }
+
+        if ( visible && runStart + runTriangles == meshlet.triangleOffset ) {
+            runTriangles += meshlet.triangleCount;
+            continue;
+        }
+
+        if ( runTriangles > 0 ) {
+            memcpy( pDestination, pSource + runStart * triangleBytes, runTriangles * triangleBytes );
+            pDestination += runTriangles * triangleBytes;
+            stats.visibleTriangles += runTriangles;
+        }
+
+        runStart = meshlet.triangleOffset;
+        runTriangles = visible ? meshlet.triangleCount : 0;
+    }
+
+    if ( runTriangles > 0 ) {
+        memcpy( pDestination, pSource + runStart * triangleBytes, runTriangles * triangleBytes );
+        stats.visibleTriangles += runTriangles;
+    }
+
+    pDeviceContext->Unmap( meshletMesh.pIndexBuffer, 0 );
+    meshletMesh.visibleIndexCount = stats.visibleTriangles * 3;
+}
+
+void cullMeshlets( ID3D11DeviceContext* pDeviceContext, MeshletMesh& meshletMesh, DirectX::FXMMATRIX world, const Camera& camera )
+{
+    Frustum objectFrustum;
+    extractFrustum( world * getViewMatrix( camera ) * getProjectionMatrix( camera ), objectFrustum );
+
+    DirectX::XMVECTOR eyePosition = DirectX::XMVector3TransformCoord( DirectX::XMLoadFloat3( &camera.position ), DirectX::XMMatrixInverse( NULL, world ) );
+    DirectX::XMFLOAT3 objectEye;
+    DirectX::XMStoreFloat3( &objectEye, eyePosition );
+
+    cullMeshlets( pDeviceContext, meshletMesh, objectFrustum, objectEye );
+}
+
+void drawMeshletMesh( ID3D11DeviceContext* pDeviceContext, const MeshletMesh& meshletMesh )
+{
+    if ( meshletMesh.visibleIndexCount == 0 )
+        return;
+
+    UINT stride = sizeof(PackedVertex);
+    UINT offset = 0;
+
+    pDeviceContext->IASetVertexBuffers( 0, 1, &meshletMesh.pVertexBuffer, &stride, &offset );
+    pDeviceContext->IASetIndexBuffer( meshletMesh.pIndexBuffer, meshletMesh.indexFormat, 0 );
+    pDeviceContext->DrawIndexed( meshletMesh.visibleIndexCount, 0, 0 );
+}
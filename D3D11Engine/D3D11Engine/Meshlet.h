@@ -0,0 +1,82 @@
+#pragma once
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Mesh.h"
+#include "Camera.h"
+
+// * * * Meshlets - small triangle clusters that are culled on their own * * * //
+// Limits match what mesh shader hardware likes, so the data can be reused there later
+const UINT maxMeshletVertices = 64;
+const UINT maxMeshletTriangles = 124;
+
+struct Meshlet
+{
+    UINT vertexOffset;      // into MeshletData::vertices
+    UINT vertexCount;
+    UINT triangleOffset;    // into MeshletData::triangles (3 local indices per triangle)
+    UINT triangleCount;
+
+    // Bounding sphere
+    DirectX::XMFLOAT3 center;
+    float radius;
+
+    // Normal cone, the whole meshlet faces away when dot(normalize(coneApex - eye), coneAxis) >= coneCutoff
+    DirectX::XMFLOAT3 coneApex;
+    DirectX::XMFLOAT3 coneAxis;
+    float coneCutoff;       // 1 = cone too wide, never backface culled
+};
+
+struct MeshletData
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<UINT> vertices;     // mesh vertex index per meshlet vertex
+    std::vector<BYTE> triangles;    // meshlet local vertex indices
+};
+
+// Greedy split in index order, run optimizeMesh first so meshlets come out compact
+void buildMeshlets( const MeshData& mesh, MeshletData& meshletData );
+
+// * * * Culling counters, updated by cullMeshlets * * * //
+struct MeshletCullStats
+{
+    UINT meshletCount;
+    UINT frustumCulled;
+    UINT backfaceCulled;
+    UINT visibleTriangles;
+    UINT totalTriangles;
+};
+
+// * * * GPU mesh drawn through a per-frame compacted index buffer * * * //
+struct MeshletMesh
+{
+    MeshletMesh() : pVertexBuffer( NULL ), pIndexBuffer( NULL ), indexFormat( DXGI_FORMAT_R16_UINT ), indexSize( 2 ), visibleIndexCount( 0 ) { ZeroMemory( &stats, sizeof(MeshletCullStats) ); }
+
+    ID3D11Buffer* pVertexBuffer;    // immutable, packed vertices
+    ID3D11Buffer* pIndexBuffer;     // dynamic, rewritten by cullMeshlets
+    DXGI_FORMAT indexFormat;
+    UINT indexSize;
+    VertexQuantization quantization;
+
+    MeshletData meshletData;
+    std::vector<BYTE> indexData;    // mesh indices of all meshlets back to back, in indexFormat
+    UINT visibleIndexCount;
+    MeshletCullStats stats;
+};
+
+bool createMeshletMesh( ID3D11Device* pDevice, const MeshData& mesh, MeshletMesh& meshletMesh );
+void releaseMeshletMesh( MeshletMesh& meshletMesh );
+
+// Culls against an object space frustum (extractFrustum of world * view * projection) and an
+// object space eye position, then copies the surviving meshlets' indices into the index buffer
+void cullMeshlets( ID3D11DeviceContext* pDeviceContext, MeshletMesh& meshletMesh, const Frustum& frustum, const DirectX::XMFLOAT3& eyePosition );
+// Same, frustum and eye are moved into object space from the world matrix and camera
+void cullMeshlets( ID3D11DeviceContext* pDeviceContext, MeshletMesh& meshletMesh, DirectX::FXMMATRIX world, const Camera& camera );
+
+// Input layout / shaders are set by the caller
+void drawMeshletMesh( ID3D11DeviceContext* pDeviceContext, const MeshletMesh& meshletMesh );
@@ -0,0 +1,702 @@
+#include "ModelFile.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <DirectXPackedVector.h>
+
+// * * * * * SDKMESH layout (DXUT, version 101) * * * * * //
+namespace SDKMesh
+{
+    const UINT fileVersion = 101;
+    const UINT maxVertexElements = 32;
+    const UINT maxVertexStreams = 16;
+    const UINT maxName = 100;
+
+    enum IndexType { INDEX_16BIT = 0, INDEX_32BIT = 1 };
+    enum PrimitiveType { PRIMITIVE_TRIANGLE_LIST = 0 };
+
+    // D3DDECLTYPE / D3DDECLUSAGE values used in the vertex declarations
+    enum DeclType { DECL_FLOAT2 = 1, DECL_FLOAT3 = 2, DECL_FLOAT4 = 3, DECL_D3DCOLOR = 4, DECL_UBYTE4N = 8, DECL_FLOAT16_2 = 15, DECL_FLOAT16_4 = 16 };
+    enum DeclUsage { USAGE_POSITION = 0, USAGE_NORMAL = 3, USAGE_TEXCOORD = 5, USAGE_COLOR = 10 };
+    const WORD declEnd = 0xFF;
+
+#pragma pack(push, 8)
+    struct Header
+    {
+        UINT version;
+        BYTE isBigEndian;
+        UINT64 headerSize;
+        UINT64 nonBufferDataSize;
+        UINT64 bufferDataSize;
+
+        UINT numVertexBuffers;
+        UINT numIndexBuffers;
+        UINT numMeshes;
+        UINT numTotalSubsets;
+        UINT numFrames;
+        UINT numMaterials;
+
+        UINT64 vertexStreamHeadersOffset;
+        UINT64 indexStreamHeadersOffset;
+        UINT64 meshDataOffset;
+        UINT64 subsetDataOffset;
+        UINT64 frameDataOffset;
+        UINT64 materialDataOffset;
+    };
+
+    struct VertexElement
+    {
+        WORD stream;
+        WORD offset;
+        BYTE type;
+        BYTE method;
+        BYTE usage;
+        BYTE usageIndex;
+    };
+
+    struct VertexBufferHeader
+    {
+        UINT64 numVertices;
+        UINT64 sizeBytes;
+        UINT64 strideBytes;
+        VertexElement decl[maxVertexElements];
+        UINT64 dataOffset;              // from the start of the file
+    };
+
+    struct IndexBufferHeader
+    {
+        UINT64 numIndices;
+        UINT64 sizeBytes;
+        UINT indexType;
+        UINT64 dataOffset;              // from the start of the file
+    };
+
+    struct Mesh
+    {
+        char name[maxName];
+        BYTE numVertexBuffers;
+        UINT vertexBuffers[maxVertexStreams];
+        UINT indexBuffer;
+        UINT numSubsets;
+        UINT numFrameInfluences;
+        DirectX::XMFLOAT3 boundingBoxCenter;
+        DirectX::XMFLOAT3 boundingBoxExtents;
+        UINT64 subsetOffset;            // UINT subset indices
+        UINT64 frameInfluenceOffset;
+    };
+
+    struct Subset
+    {
+        char name[maxName];
+        UINT materialID;
+        UINT primitiveType;
+        UINT64 indexStart;
+        UINT64 indexCount;
+        UINT64 vertexStart;
+        UINT64 vertexCount;
+    };
+#pragma pack(pop)
+
+    // Same sizes DirectXTK checks for
+    static_assert( sizeof(Header) == 104, "SDKMESH header size mismatch" );
+    static_assert( sizeof(VertexBufferHeader) == 288, "SDKMESH vertex buffer header size mismatch" );
+    static_assert( sizeof(IndexBufferHeader) == 32, "SDKMESH index buffer header size mismatch" );
+    static_assert( sizeof(Mesh) == 224, "SDKMESH mesh size mismatch" );
+    static_assert( sizeof(Subset) == 144, "SDKMESH subset size mismatch" );
+}
+
+// * * * * * CMO layout (VSD3DStarter) * * * * * //
+namespace CMO
+{
+    const UINT maxTextures = 8;
+
+#pragma pack(push, 1)
+    struct Material
+    {
+        DirectX::XMFLOAT4 ambient;
+        DirectX::XMFLOAT4 diffuse;
+        DirectX::XMFLOAT4 specular;
+        float specularPower;
+        DirectX::XMFLOAT4 emissive;
+        DirectX::XMFLOAT4X4 uvTransform;
+    };
+
+    struct SubMesh
+    {
+        UINT materialIndex;
+        UINT indexBufferIndex;
+        UINT vertexBufferIndex;
+        UINT startIndex;
+        UINT primCount;
+    };
+
+    struct Vertex
+    {
+        DirectX::XMFLOAT3 position;
+        DirectX::XMFLOAT3 normal;
+        DirectX::XMFLOAT4 tangent;
+        UINT color;
+        DirectX::XMFLOAT2 textureCoordinates;
+    };
+#pragma pack(pop)
+
+    const size_t skinningVertexSize = 32;       // 4 bone indices + 4 weights
+    const size_t meshExtentsSize = 40;          // center, radius, min, max
+    const size_t boneSize = 196;                // parent + 3 matrices
+    const size_t clipSize = 12;                 // start, end, key count
+    const size_t keyframeSize = 72;             // bone, time, matrix
+
+    static_assert( sizeof(Material) == 132, "CMO material size mismatch" );
+    static_assert( sizeof(SubMesh) == 20, "CMO submesh size mismatch" );
+    static_assert( sizeof(Vertex) == 52, "CMO vertex size mismatch" );
+}
+
+// * * * * * VBO layout (DirectXTK) * * * * * //
+namespace VBO
+{
+    struct Header
+    {
+        UINT numVertices;
+        UINT numIndices;
+    };
+
+    // VertexPositionNormalTexture
+    struct Vertex
+    {
+        DirectX::XMFLOAT3 position;
+        DirectX::XMFLOAT3 normal;
+        DirectX::XMFLOAT2 textureCoordinate;
+    };
+
+    static_assert( sizeof(Vertex) == 32, "VBO vertex size mismatch" );
+}
+
+// * * * Bounds checked reading in place * * * //
+class ByteReader
+{
+public:
+    ByteReader( const BYTE* pData, size_t size ) : pData( pData ), size( size ), position( 0 ), failed( false ) { }
+
+    // Pointer to count * elementSize bytes at the cursor, NULL (and failed) if they aren't there
+    const BYTE* take( size_t elementSize, size_t count )
+    {
+        if ( failed || ( elementSize != 0 && count > ( size - position ) / elementSize ) ) {
+            failed = true;
+            return NULL;
+        }
+
+        const BYTE* pResult = pData + position;
+        position += elementSize * count;
+        return pResult;
+    }
+
+    UINT readUInt()
+    {
+        const BYTE* p = take( sizeof(UINT), 1 );
+        UINT value = 0;
+        if ( p )
+            memcpy( &value, p, sizeof(UINT) );
+        return value;
+    }
+
+    BYTE readByte()
+    {
+        const BYTE* p = take( 1, 1 );
+        return p ? *p : 0;
+    }
+
+    // Length prefixed UTF-16 string, skipped
+    void skipString()
+    {
+        UINT length = readUInt();
+        take( 2, length );                  // UTF-16 code units
+    }
+
+    bool hasFailed() const { return failed; }
+
+private:
+    const BYTE* pData;
+    size_t size;
+    size_t position;
+    bool failed;
+};
+
+static inline bool rangeInFile( UINT64 offset, UINT64 bytes, size_t fileSize )
+{
+    return offset <= fileSize && bytes <= fileSize - offset;
+}
+
+static ModelAttribute makeAttribute( UINT offset, DXGI_FORMAT format )
+{
+    ModelAttribute attribute = { offset, format };
+    return attribute;
+}
+
+static ModelAttribute missingAttribute()
+{
+    return makeAttribute( modelAttributeMissing, DXGI_FORMAT_UNKNOWN );
+}
+
+// * * * * * SDKMESH * * * * * //
+static DXGI_FORMAT getDeclFormat( BYTE type )
+{
+    switch ( type ) {
+    case SDKMesh::DECL_FLOAT2: return DXGI_FORMAT_R32G32_FLOAT;
+    case SDKMesh::DECL_FLOAT3: return DXGI_FORMAT_R32G32B32_FLOAT;
+    case SDKMesh::DECL_FLOAT4: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+    case SDKMesh::DECL_D3DCOLOR: return DXGI_FORMAT_B8G8R8A8_UNORM;
+    case SDKMesh::DECL_UBYTE4N: return DXGI_FORMAT_R8G8B8A8_UNORM;
+    case SDKMesh::DECL_FLOAT16_2: return DXGI_FORMAT_R16G16_FLOAT;
+    case SDKMesh::DECL_FLOAT16_4: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    default: return DXGI_FORMAT_UNKNOWN;
+    }
+}
+
+// Bytes an element of getDeclFormat's formats takes in the vertex, 0 for unknown
+static UINT getDeclFormatSize( DXGI_FORMAT format )
+{
+    switch ( format ) {
+    case DXGI_FORMAT_R32G32_FLOAT: return 8;
+    case DXGI_FORMAT_R32G32B32_FLOAT: return 12;
+    case DXGI_FORMAT_R32G32B32A32_FLOAT: return 16;
+    case DXGI_FORMAT_B8G8R8A8_UNORM: return 4;
+    case DXGI_FORMAT_R8G8B8A8_UNORM: return 4;
+    case DXGI_FORMAT_R16G16_FLOAT: return 4;
+    case DXGI_FORMAT_R16G16B16A16_FLOAT: return 8;
+    default: return 0;
+    }
+}
+
+static bool parseSDKMESH( const BYTE* pFileData, size_t fileSize, ModelView& view )
+{
+    if ( fileSize < sizeof(SDKMesh::Header) )
+        return false;
+
+    const SDKMesh::Header* pHeader = (const SDKMesh::Header*)pFileData;
+    if ( pHeader->version != SDKMesh::fileVersion || pHeader->isBigEndian )
+        return false;
+
+    if ( !rangeInFile( pHeader->vertexStreamHeadersOffset, (UINT64)pHeader->numVertexBuffers * sizeof(SDKMesh::VertexBufferHeader), fileSize ) ||
+         !rangeInFile( pHeader->indexStreamHeadersOffset, (UINT64)pHeader->numIndexBuffers * sizeof(SDKMesh::IndexBufferHeader), fileSize ) ||
+         !rangeInFile( pHeader->meshDataOffset, (UINT64)pHeader->numMeshes * sizeof(SDKMesh::Mesh), fileSize ) ||
+         !rangeInFile( pHeader->subsetDataOffset, (UINT64)pHeader->numTotalSubsets * sizeof(SDKMesh::Subset), fileSize ) )
+        return false;
+
+    const SDKMesh::VertexBufferHeader* pVertexHeaders = (const SDKMesh::VertexBufferHeader*)( pFileData + pHeader->vertexStreamHeadersOffset );
+    const SDKMesh::IndexBufferHeader* pIndexHeaders = (const SDKMesh::IndexBufferHeader*)( pFileData + pHeader->indexStreamHeadersOffset );
+    const SDKMesh::Mesh* pMeshes = (const SDKMesh::Mesh*)( pFileData + pHeader->meshDataOffset );
+    const SDKMesh::Subset* pSubsets = (const SDKMesh::Subset*)( pFileData + pHeader->subsetDataOffset );
+
+    // - - - vertex buffers - - - //
+    view.vertexBuffers.resize( pHeader->numVertexBuffers );
+    for ( UINT i = 0; i < pHeader->numVertexBuffers; i++ ) {
+        const SDKMesh::VertexBufferHeader& header = pVertexHeaders[i];
+        // Stride capped like the input assembler's, counts checked by division so nothing wraps
+        if ( header.strideBytes == 0 || header.strideBytes > D3D11_REQ_MULTI_ELEMENT_STRUCTURE_SIZE_IN_BYTES || header.numVertices > 0xFFFFFFFF ||
+             header.numVertices > header.sizeBytes / header.strideBytes || !rangeInFile( header.dataOffset, header.sizeBytes, fileSize ) )
+            return false;
+
+        ModelVertexBufferView& vertexBuffer = view.vertexBuffers[i];
+        vertexBuffer.pData = pFileData + header.dataOffset;
+        vertexBuffer.vertexCount = (UINT)header.numVertices;
+        vertexBuffer.stride = (UINT)header.strideBytes;
+        vertexBuffer.position = missingAttribute();
+        vertexBuffer.normal = missingAttribute();
+        vertexBuffer.texcoord = missingAttribute();
+        vertexBuffer.color = missingAttribute();
+
+        for ( UINT e = 0; e < SDKMesh::maxVertexElements && header.decl[e].stream != SDKMesh::declEnd; e++ ) {
+            const SDKMesh::VertexElement& element = header.decl[e];
+            if ( element.stream != 0 || element.usageIndex != 0 )
+                continue;
+
+            // Elements the readers know must lie inside the vertex
+            ModelAttribute attribute = makeAttribute( element.offset, getDeclFormat( element.type ) );
+            UINT formatSize = getDeclFormatSize( attribute.format );
+            if ( formatSize != 0 && (UINT64)element.offset + formatSize > header.strideBytes )
+                return false;
+
+            switch ( element.usage ) {
+            case SDKMesh::USAGE_POSITION: vertexBuffer.position = attribute; break;
+            case SDKMesh::USAGE_NORMAL: vertexBuffer.normal = attribute; break;
+            case SDKMesh::USAGE_TEXCOORD: vertexBuffer.texcoord = attribute; break;
+            case SDKMesh::USAGE_COLOR: vertexBuffer.color = attribute; break;
+            }
+        }
+    }
+
+    // - - - index buffers - - - //
+    view.indexBuffers.resize( pHeader->numIndexBuffers );
+    for ( UINT i = 0; i < pHeader->numIndexBuffers; i++ ) {
+        const SDKMesh::IndexBufferHeader& header = pIndexHeaders[i];
+        UINT indexSize = ( header.indexType == SDKMesh::INDEX_32BIT ) ? 4 : 2;
+        if ( header.numIndices > 0xFFFFFFFF || header.numIndices > header.sizeBytes / indexSize ||
+             !rangeInFile( header.dataOffset, header.sizeBytes, fileSize ) )
+            return false;
+
+        ModelIndexBufferView& indexBuffer = view.indexBuffers[i];
+        indexBuffer.pData = pFileData + header.dataOffset;
+        indexBuffer.indexCount = (UINT)header.numIndices;
+        indexBuffer.format = ( indexSize == 4 ) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+    }
+
+    // - - - meshes -> subsets - - - //
+    view.subsets.clear();
+    for ( UINT m = 0; m < pHeader->numMeshes; m++ ) {
+        const SDKMesh::Mesh& mesh = pMeshes[m];
+        if ( mesh.numVertexBuffers == 0 || mesh.vertexBuffers[0] >= pHeader->numVertexBuffers || mesh.indexBuffer >= pHeader->numIndexBuffers ||
+             !rangeInFile( mesh.subsetOffset, (UINT64)mesh.numSubsets * sizeof(UINT), fileSize ) )
+            return false;
+
+        const UINT* pSubsetIndices = (const UINT*)( pFileData + mesh.subsetOffset );
+        for ( UINT s = 0; s < mesh.numSubsets; s++ ) {
+            if ( pSubsetIndices[s] >= pHeader->numTotalSubsets )
+                return false;
+
+            const SDKMesh::Subset& subset = pSubsets[pSubsetIndices[s]];
+            if ( subset.primitiveType != SDKMesh::PRIMITIVE_TRIANGLE_LIST )
+                continue;
+            UINT indexCount = view.indexBuffers[mesh.indexBuffer].indexCount;
+            if ( subset.indexStart > indexCount || subset.indexCount > indexCount - subset.indexStart ||
+                 subset.vertexStart > view.vertexBuffers[mesh.vertexBuffers[0]].vertexCount )
+                return false;
+
+            ModelSubsetView subsetView;
+            subsetView.vertexBuffer = mesh.vertexBuffers[0];
+            subsetView.indexBuffer = mesh.indexBuffer;
+            subsetView.indexStart = (UINT)subset.indexStart;
+            subsetView.indexCount = (UINT)subset.indexCount;
+            subsetView.baseVertex = (UINT)subset.vertexStart;
+            subsetView.materialIndex = subset.materialID;
+            view.subsets.push_back( subsetView );
+        }
+    }
+
+    return true;
+}
+
+// * * * * * VBO * * * * * //
+static bool parseVBO( const BYTE* pFileData, size_t fileSize, ModelView& view )
+{
+    ByteReader reader( pFileData, fileSize );
+    const BYTE* pHeaderData = reader.take( sizeof(VBO::Header), 1 );
+    if ( !pHeaderData )
+        return false;
+
+    VBO::Header header;
+    memcpy( &header, pHeaderData, sizeof(VBO::Header) );
+
+    const BYTE* pVertices = reader.take( sizeof(VBO::Vertex), header.numVertices );
+    const BYTE* pIndices = reader.take( sizeof(USHORT), header.numIndices );
+    if ( reader.hasFailed() || header.numVertices == 0 || header.numIndices == 0 || header.numIndices % 3 != 0 )
+        return false;
+
+    ModelVertexBufferView vertexBuffer;
+    vertexBuffer.pData = pVertices;
+    vertexBuffer.vertexCount = header.numVertices;
+    vertexBuffer.stride = sizeof(VBO::Vertex);
+    vertexBuffer.position = makeAttribute( offsetof( VBO::Vertex, position ), DXGI_FORMAT_R32G32B32_FLOAT );
+    vertexBuffer.normal = makeAttribute( offsetof( VBO::Vertex, normal ), DXGI_FORMAT_R32G32B32_FLOAT );
+    vertexBuffer.texcoord = makeAttribute( offsetof( VBO::Vertex, textureCoordinate ), DXGI_FORMAT_R32G32_FLOAT );
+    vertexBuffer.color = missingAttribute();
+
+    ModelIndexBufferView indexBuffer = { pIndices, header.numIndices, DXGI_FORMAT_R16_UINT };
+    ModelSubsetView subset = { 0, 0, 0, header.numIndices, 0, 0 };
+
+    view.vertexBuffers.assign( 1, vertexBuffer );
+    view.indexBuffers.assign( 1, indexBuffer );
+    view.subsets.assign( 1, subset );
+    return true;
+}
+
+// * * * * * CMO * * * * * //
+static bool parseCMO( const BYTE* pFileData, size_t fileSize, ModelView& view )
+{
+    ByteReader reader( pFileData, fileSize );
+    UINT meshCount = reader.readUInt();
+    if ( reader.hasFailed() || meshCount == 0 )
+        return false;
+
+    view.vertexBuffers.clear();
+    view.indexBuffers.clear();
+    view.subsets.clear();
+
+    for ( UINT m = 0; m < meshCount; m++ ) {
+        reader.skipString();                            // mesh name
+
+        UINT materialCount = reader.readUInt();
+        for ( UINT i = 0; i < materialCount && !reader.hasFailed(); i++ ) {
+            reader.skipString();                        // material name
+            reader.take( sizeof(CMO::Material), 1 );
+            reader.skipString();                        // pixel shader name
+            for ( UINT t = 0; t < CMO::maxTextures; t++ )
+                reader.skipString();                    // texture names
+        }
+
+        bool hasSkeleton = reader.readByte() != 0;
+
+        UINT subMeshCount = reader.readUInt();
+        const CMO::SubMesh* pSubMeshes = (const CMO::SubMesh*)reader.take( sizeof(CMO::SubMesh), subMeshCount );
+
+        // Buffers are numbered per mesh in the file, the view numbers them for the whole model
+        UINT firstIndexBuffer = (UINT)view.indexBuffers.size();
+        UINT indexBufferCount = reader.readUInt();
+        for ( UINT i = 0; i < indexBufferCount && !reader.hasFailed(); i++ ) {
+            UINT indexCount = reader.readUInt();
+            ModelIndexBufferView indexBuffer = { reader.take( sizeof(USHORT), indexCount ), indexCount, DXGI_FORMAT_R16_UINT };
+            view.indexBuffers.push_back( indexBuffer );
+        }
+
+        UINT firstVertexBuffer = (UINT)view.vertexBuffers.size();
+        UINT vertexBufferCount = reader.readUInt();
+        for ( UINT i = 0; i < vertexBufferCount && !reader.hasFailed(); i++ ) {
+            ModelVertexBufferView vertexBuffer;
+            vertexBuffer.vertexCount = reader.readUInt();
+            vertexBuffer.pData = reader.take( sizeof(CMO::Vertex), vertexBuffer.vertexCount );
+            vertexBuffer.stride = sizeof(CMO::Vertex);
+            vertexBuffer.position = makeAttribute( offsetof( CMO::Vertex, position ), DXGI_FORMAT_R32G32B32_FLOAT );
+            vertexBuffer.normal = makeAttribute( offsetof( CMO::Vertex, normal ), DXGI_FORMAT_R32G32B32_FLOAT );
+            vertexBuffer.texcoord = makeAttribute( offsetof( CMO::Vertex, textureCoordinates ), DXGI_FORMAT_R32G32_FLOAT );
+            vertexBuffer.color = makeAttribute( offsetof( CMO::Vertex, color ), DXGI_FORMAT_R8G8B8A8_UNORM );
+            view.vertexBuffers.push_back( vertexBuffer );
+        }
+
+        UINT skinningBufferCount = reader.readUInt();
+        for ( UINT i = 0; i < skinningBufferCount && !reader.hasFailed(); i++ ) {
+            UINT vertexCount = reader.readUInt();
+            reader.take( CMO::skinningVertexSize, vertexCount );
+        }
+
+        reader.take( CMO::meshExtentsSize, 1 );
+
+        if ( hasSkeleton ) {
+            UINT boneCount = reader.readUInt();
+            for ( UINT i = 0; i < boneCount && !reader.hasFailed(); i++ ) {
+                reader.skipString();
+                reader.take( CMO::boneSize, 1 );
+            }
+
+            UINT clipCount = reader.readUInt();
+            for ( UINT i = 0; i < clipCount && !reader.hasFailed(); i++ ) {
+                reader.skipString();
+                const BYTE* pClip = reader.take( CMO::clipSize, 1 );
+                UINT keyCount = 0;
+                if ( pClip )
+                    memcpy( &keyCount, pClip + 8, sizeof(UINT) );
+                reader.take( CMO::keyframeSize, keyCount );
+            }
+        }
+
+        if ( reader.hasFailed() )
+            return false;
+
+        // - - - submeshes -> subsets - - - //
+        for ( UINT s = 0; s < subMeshCount; s++ ) {
+            CMO::SubMesh subMesh;
+            memcpy( &subMesh, pSubMeshes + s, sizeof(CMO::SubMesh) );
+
+            if ( subMesh.indexBufferIndex >= indexBufferCount || subMesh.vertexBufferIndex >= vertexBufferCount )
+                return false;
+
+            ModelSubsetView subset;
+            subset.vertexBuffer = firstVertexBuffer + subMesh.vertexBufferIndex;
+            subset.indexBuffer = firstIndexBuffer + subMesh.indexBufferIndex;
+            subset.indexStart = subMesh.startIndex;
+            subset.indexCount = subMesh.primCount * 3;
+            subset.baseVertex = 0;
+            subset.materialIndex = subMesh.materialIndex;
+
+            if ( (UINT64)subset.indexStart + subset.indexCount > view.indexBuffers[subset.indexBuffer].indexCount )
+                return false;
+
+            view.subsets.push_back( subset );
+        }
+    }
+
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+ModelFormat getModelFormat( const wchar_t* fileName )
+{
+    const wchar_t* pExtension = wcsrchr( fileName, L'.' );
+    if ( !pExtension )
+        return MODEL_FORMAT_UNKNOWN;
+
+    if ( _wcsicmp( pExtension, L".sdkmesh" ) == 0 ) return MODEL_FORMAT_SDKMESH;
+    if ( _wcsicmp( pExtension, L".vbo" ) == 0 ) return MODEL_FORMAT_VBO;
+    if ( _wcsicmp( pExtension, L".cmo" ) == 0 ) return MODEL_FORMAT_CMO;
+    return MODEL_FORMAT_UNKNOWN;
+}
+
+bool parseModel( const BYTE* pFileData, size_t fileSize, ModelFormat format, ModelView& view )
+{
+    view.format = format;
+
+    switch ( format ) {
+    case MODEL_FORMAT_SDKMESH: return parseSDKMESH( pFileData, fileSize, view );
+    case MODEL_FORMAT_VBO: return parseVBO( pFileData, fileSize, view );
+    case MODEL_FORMAT_CMO: return parseCMO( pFileData, fileSize, view );
+    default: return false;
+    }
+}
+
+bool loadModelFile( const wchar_t* fileName, MappedFile& file, ModelView& view )
+{
+    ModelFormat format = getModelFormat( fileName );
+    if ( format == MODEL_FORMAT_UNKNOWN || !file.open( fileName ) )
+        return false;
+
+    if ( !parseModel( file.getData(), file.getSize(), format, view ) ) {
+        char message[512];
+        sprintf_s( message, "[ModelFile] Malformed model file %ls\n", fileName );
+        OutputDebugStringA( message );
+
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+// * * * * * D3D11 PATH * * * * * //
+static ID3D11Buffer* createImmutableBuffer( ID3D11Device* pDevice, const void* pData, UINT byteWidth, UINT bindFlags )
+{
+    D3D11_BUFFER_DESC bufferDesc;
+    ZeroMemory( &bufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+                bufferDesc.ByteWidth = byteWidth;
+                bufferDesc.BindFlags = bindFlags;
+                bufferDesc.CPUAccessFlags = 0;
+                bufferDesc.MiscFlags = 0;
+
+    // Initial data straight from the mapped file, the driver's upload is the only copy
+    D3D11_SUBRESOURCE_DATA bufferData;
+    ZeroMemory( &bufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                bufferData.pSysMem = pData;
+
+    ID3D11Buffer* pBuffer = NULL;
+    HRESULT hr = pDevice->CreateBuffer( &bufferDesc, &bufferData, &pBuffer );
+    return SUCCEEDED(hr) ? pBuffer : NULL;
+}
+
+bool createModelBuffers( ID3D11Device* pDevice, const ModelView& view, ModelBuffers& buffers )
+{
+    for ( size_t i = 0; i < view.vertexBuffers.size(); i++ ) {
+        const ModelVertexBufferView& vertexBuffer = view.vertexBuffers[i];
+        UINT64 byteWidth = (UINT64)vertexBuffer.vertexCount * vertexBuffer.stride;
+        ID3D11Buffer* pBuffer = byteWidth <= 0xFFFFFFFF ? createImmutableBuffer( pDevice, vertexBuffer.pData, (UINT)byteWidth, D3D11_BIND_VERTEX_BUFFER ) : NULL;
+        if ( !pBuffer ) {
+            releaseModelBuffers( buffers );
+            return false;
+        }
+        buffers.vertexBuffers.push_back( pBuffer );
+    }
+
+    for ( size_t i = 0; i < view.indexBuffers.size(); i++ ) {
+        const ModelIndexBufferView& indexBuffer = view.indexBuffers[i];
+        UINT indexSize = ( indexBuffer.format == DXGI_FORMAT_R32_UINT ) ? 4 : 2;
+        UINT64 byteWidth = (UINT64)indexBuffer.indexCount * indexSize;
+        ID3D11Buffer* pBuffer = byteWidth <= 0xFFFFFFFF ? createImmutableBuffer( pDevice, indexBuffer.pData, (UINT)byteWidth, D3D11_BIND_INDEX_BUFFER ) : NULL;
+        if ( !pBuffer ) {
+            releaseModelBuffers( buffers );
+            return false;
+        }
+        buffers.indexBuffers.push_back( pBuffer );
+    }
+
+    return true;
+}
+
+void releaseModelBuffers( ModelBuffers& buffers )
+{
+    for ( size_t i = 0; i < buffers.vertexBuffers.size(); i++ )
+        buffers.vertexBuffers[i]->Release();
+    for ( size_t i = 0; i < buffers.indexBuffers.size(); i++ )
+        buffers.indexBuffers[i]->Release();
+
+    buffers.vertexBuffers.clear();
+    buffers.indexBuffers.clear();
+}
+
+// * * * * * CPU PATH * * * * * //
+static DirectX::XMFLOAT2 readFloat2( const BYTE* pVertex, const ModelAttribute& attribute, const DirectX::XMFLOAT2& fallback )
+{
+    DirectX::XMFLOAT2 value = fallback;
+    if ( attribute.format == DXGI_FORMAT_R32G32_FLOAT ) {
+        memcpy( &value, pVertex + attribute.offset, sizeof(DirectX::XMFLOAT2) );
+    }
+    else if ( attribute.format == DXGI_FORMAT_R16G16_FLOAT ) {
+        DirectX::PackedVector::HALF half[2];
+        memcpy( half, pVertex + attribute.offset, sizeof(half) );
+        value.x = DirectX::PackedVector::XMConvertHalfToFloat( half[0] );
+        value.y = DirectX::PackedVector::XMConvertHalfToFloat( half[1] );
+    }
+    return value;
+}
+
+static DirectX::XMFLOAT3 readFloat3( const BYTE* pVertex, const ModelAttribute& attribute, const DirectX::XMFLOAT3& fallback )
+{
+    DirectX::XMFLOAT3 value = fallback;
+    if ( attribute.format == DXGI_FORMAT_R32G32B32_FLOAT || attribute.format == DXGI_FORMAT_R32G32B32A32_FLOAT )
+        memcpy( &value, pVertex + attribute.offset, sizeof(DirectX::XMFLOAT3) );
+    return value;
+}
+
+static DirectX::XMFLOAT4 readColor( const BYTE* pVertex, const ModelAttribute& attribute )
+{
+    if ( attribute.format != DXGI_FORMAT_R8G8B8A8_UNORM && attribute.format != DXGI_FORMAT_B8G8R8A8_UNORM )
+        return DirectX::XMFLOAT4( 1.0f, 1.0f, 1.0f, 1.0f );
+
+    const BYTE* c = pVertex + attribute.offset;
+    bool bgra = ( attribute.format == DXGI_FORMAT_B8G8R8A8_UNORM );
+    return DirectX::XMFLOAT4( c[bgra ? 2 : 0] / 255.0f, c[1] / 255.0f, c[bgra ? 0 : 2] / 255.0f, c[3] / 255.0f );
+}
+
+bool extractMeshData( const ModelView& view, UINT subset, MeshData& mesh )
+{
+    if ( subset >= view.subsets.size() )
+        return false;
+
+    const ModelSubsetView& subsetView = view.subsets[subset];
+    const ModelVertexBufferView& vertexBuffer = view.vertexBuffers[subsetView.vertexBuffer];
+    const ModelIndexBufferView& indexBuffer = view.indexBuffers[subsetView.indexBuffer];
+    if ( vertexBuffer.position.format != DXGI_FORMAT_R32G32B32_FLOAT && vertexBuffer.position.format != DXGI_FORMAT_R32G32B32A32_FLOAT )
+        return false;
+
+    // Only the vertices the subset references, in first use order
+    const UINT unused = 0xFFFFFFFF;
+    std::vector<UINT> remap( vertexBuffer.vertexCount, unused );
+
+    mesh.vertices.clear();
+    mesh.indices.resize( subsetView.indexCount );
+
+    for ( UINT i = 0; i < subsetView.indexCount; i++ ) {
+        UINT index = ( indexBuffer.format == DXGI_FORMAT_R32_UINT )
+                   ? ( (const UINT*)indexBuffer.pData )[subsetView.indexStart + i]
+                   : ( (const USHORT*)indexBuffer.pData )[subsetView.indexStart + i];
+        UINT64 v = (UINT64)index + subsetView.baseVertex;
+        if ( v >= vertexBuffer.vertexCount )
+            return false;
+
+        if ( remap[v] == unused ) {
+            const BYTE* pVertex = vertexBuffer.pData + (size_t)v * vertexBuffer.stride;
+
+            Vertex vertex;
+            vertex.pos = readFloat3( pVertex, vertexBuffer.position, DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f ) );
+            vertex.normal = readFloat3( pVertex, vertexBuffer.normal, DirectX::XMFLOAT3( 0.0f, 0.0f, -1.0f ) );
+            vertex.texcoord = readFloat2( pVertex, vertexBuffer.texcoord, DirectX::XMFLOAT2( 0.0f, 0.0f ) );
+            vertex.col = readColor( pVertex, vertexBuffer.color );
+
+            remap[v] = (UINT)mesh.vertices.size();
+            mesh.vertices.push_back( vertex );
+        }
+        mesh.indices[i] = remap[v];
+    }
+
+    return true;
+}
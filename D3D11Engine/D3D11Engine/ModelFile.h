@@ -0,0 +1,92 @@
+#pragma once
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Mesh.h"
+#include "MappedFile.h"
+
+// * * * In place loader for the DirectXTK model formats (Model.h: CreateFromSDKMESH / VBO / CMO) * * * //
+// The file is memory mapped and parsed where it lies: the views below point straight into the
+// mapping, vertex / index data is never copied on the CPU. Parsing needs no device, so the same
+// views serve buffer creation (createModelBuffers) and CPU side processing (extractMeshData).
+
+enum ModelFormat
+{
+    MODEL_FORMAT_UNKNOWN,
+    MODEL_FORMAT_SDKMESH,       // DXUT .sdkmesh version 101
+    MODEL_FORMAT_VBO,           // DirectXTK .vbo: VertexPositionNormalTexture + 16 bit indices
+    MODEL_FORMAT_CMO            // Visual Studio starter kit .cmo
+};
+
+const UINT modelAttributeMissing = 0xFFFFFFFF;
+
+struct ModelAttribute
+{
+    UINT offset;                // modelAttributeMissing when the vertex format has none
+    DXGI_FORMAT format;
+};
+
+struct ModelVertexBufferView
+{
+    const BYTE* pData;          // into the mapped file
+    UINT vertexCount;
+    UINT stride;
+
+    ModelAttribute position;
+    ModelAttribute normal;
+    ModelAttribute texcoord;
+    ModelAttribute color;
+};
+
+struct ModelIndexBufferView
+{
+    const BYTE* pData;          // into the mapped file
+    UINT indexCount;
+    DXGI_FORMAT format;         // DXGI_FORMAT_R16_UINT / DXGI_FORMAT_R32_UINT
+};
+
+// One draw: a triangle list range of an index buffer
+struct ModelSubsetView
+{
+    UINT vertexBuffer;
+    UINT indexBuffer;
+    UINT indexStart;
+    UINT indexCount;
+    UINT baseVertex;
+    UINT materialIndex;
+};
+
+struct ModelView
+{
+    ModelFormat format;
+    std::vector<ModelVertexBufferView> vertexBuffers;
+    std::vector<ModelIndexBufferView> indexBuffers;
+    std::vector<ModelSubsetView> subsets;
+};
+
+// Format from the file extension (.sdkmesh, .vbo, .cmo)
+ModelFormat getModelFormat( const wchar_t* fileName );
+
+// Parsers validate every offset / count against fileSize and return false on anything malformed
+bool parseModel( const BYTE* pFileData, size_t fileSize, ModelFormat format, ModelView& view );
+
+// Maps the file and parses it, the views stay valid as long as the MappedFile is open
+bool loadModelFile( const wchar_t* fileName, MappedFile& file, ModelView& view );
+
+// * * * D3D11 path: immutable buffers initialized straight from the mapping * * * //
+struct ModelBuffers
+{
+    std::vector<ID3D11Buffer*> vertexBuffers;
+    std::vector<ID3D11Buffer*> indexBuffers;
+};
+
+bool createModelBuffers( ID3D11Device* pDevice, const ModelView& view, ModelBuffers& buffers );
+void releaseModelBuffers( ModelBuffers& buffers );
+
+// * * * CPU path: one subset as engine MeshData (for the optimizer, LODs, meshlets, PackedVertex) * * * //
+bool extractMeshData( const ModelView& view, UINT subset, MeshData& mesh );
@@ -0,0 +1,468 @@
+#include "MeshImport.h"
+
+#include <algorithm>
+#include <charconv>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#include "MappedFile.h"
+
+// * * * * * Wavefront OBJ * * * * * //
+// Two parallel passes over line aligned chunks of the mapped file: the first only counts v / vt / vn
+// lines, so every chunk knows where its elements go in the file wide arrays, the second parses
+// straight into those arrays and resolves face indices (relative ones too) to file wide indices.
+// Faces are then welded into vertices in file order through a hash table on the index triple.
+
+const UINT objMissing = 0xFFFFFFFF;
+const size_t minObjChunkSize = 256 * 1024;     // below this a thread costs more than it saves
+
+enum ObjLineType
+{
+    OBJ_LINE_OTHER,
+    OBJ_LINE_POSITION,
+    OBJ_LINE_TEXCOORD,
+    OBJ_LINE_NORMAL,
+    OBJ_LINE_FACE
+};
+
+struct ObjCorner
+{
+    UINT position;
+    UINT texcoord;                  // objMissing when the face has none
+    UINT normal;
+};
+
+struct ObjArrays
+{
+    std::vector<DirectX::XMFLOAT3> positions;
+    std::vector<DirectX::XMFLOAT4> colors;          // "v x y z r g b", white otherwise
+    std::vector<DirectX::XMFLOAT2> texcoords;
+    std::vector<DirectX::XMFLOAT3> normals;
+};
+
+struct ObjChunk
+{
+    const char* pBegin;
+    const char* pEnd;
+
+    UINT positionCount;             // elements in this chunk (first pass)
+    UINT texcoordCount;
+    UINT normalCount;
+    UINT positionBase;              // elements in all chunks before this one
+    UINT texcoordBase;
+    UINT normalBase;
+
+    std::vector<ObjCorner> corners; // 3 per triangle, polygons are fanned
+    bool failed;
+};
+
+static inline bool isBlank( char c )
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline const char* skipBlanks( const char* p, const char* pEnd )
+{
+    while ( p < pEnd && isBlank( *p ) )
+        p++;
+    return p;
+}
+
+static inline const char* findLineEnd( const char* p, const char* pEnd )
+{
+    const char* pNewline = (const char*)memchr( p, '\n', pEnd - p );
+    return pNewline ? pNewline : pEnd;
+}
+
+// p points at the first non blank character of a line
+static inline ObjLineType classifyLine( const char* p, const char* pLineEnd )
+{
+    if ( pLineEnd - p < 2 )
+        return OBJ_LINE_OTHER;
+
+    if ( p[0] == 'f' && isBlank( p[1] ) )
+        return OBJ_LINE_FACE;
+    if ( p[0] != 'v' )
+        return OBJ_LINE_OTHER;
+    if ( isBlank( p[1] ) )
+        return OBJ_LINE_POSITION;
+    if ( pLineEnd - p >= 3 && isBlank( p[2] ) ) {
+        if ( p[1] == 't' ) return OBJ_LINE_TEXCOORD;
+        if ( p[1] == 'n' ) return OBJ_LINE_NORMAL;
+    }
+    return OBJ_LINE_OTHER;
+}
+
+// from_chars is locale independent and exact, and much faster than strtof / sscanf
+static inline const char* parseFloat( const char* p, const char* pEnd, float& value )
+{
+    p = skipBlanks( p, pEnd );
+    if ( p < pEnd && *p == '+' )
+        p++;
+
+    std::from_chars_result result = std::from_chars( p, pEnd, value );
+    return ( result.ec == std::errc() ) ? result.ptr : NULL;
+}
+
+static inline const char* parseInt( const char* p, const char* pEnd, int& value )
+{
+    std::from_chars_result result = std::from_chars( p, pEnd, value );
+    return ( result.ec == std::errc() ) ? result.ptr : NULL;
+}
+
+// 1 based, negative = relative to the elements read so far
+static inline bool resolveIndex( int value, UINT elementsSoFar, UINT& index )
+{
+    if ( value > 0 ) {
+        index = (UINT)( value - 1 );
+        return true;
+    }
+    if ( value < 0 && (INT64)elementsSoFar + value >= 0 ) {
+        index = (UINT)( (INT64)elementsSoFar + value );
+        return true;
+    }
+    return false;
+}
+
+// * * * First pass * * * //
+static void countChunk( ObjChunk& chunk )
+{
+    chunk.positionCount = chunk.texcoordCount = chunk.normalCount = 0;
+
+    for ( const char* p = chunk.pBegin; p < chunk.pEnd; ) {
+        const char* pLineEnd = findLineEnd( p, chunk.pEnd );
+        switch ( classifyLine( skipBlanks( p, pLineEnd ), pLineEnd ) ) {
+        case OBJ_LINE_POSITION: chunk.positionCount++; break;
+        case OBJ_LINE_TEXCOORD: chunk.texcoordCount++; break;
+        case OBJ_LINE_NORMAL: chunk.normalCount++; break;
+        default: break;
+        }
+        p = pLineEnd + 1;
+    }
+}
+
+// * * * Second pass * * * //
+static bool parseFace( const char* p, const char* pLineEnd, const ObjChunk& chunk, UINT positions, UINT texcoords, UINT normals,
+                       std::vector<ObjCorner>& polygon )
+{
+    polygon.clear();
+
+    for ( ;; ) {
+        p = skipBlanks( p, pLineEnd );
+        if ( p == pLineEnd || *p == '\r' || *p == '#' )
+            break;
+
+        // v, v/vt, v//vn or v/vt/vn
+        ObjCorner corner = { objMissing, objMissing, objMissing };
+        int value;
+
+        p = parseInt( p, pLineEnd, value );
+        if ( !p || !resolveIndex( value, chunk.positionBase + positions, corner.position ) )
+            return false;
+
+        if ( p < pLineEnd && *p == '/' ) {
+            p++;
+            if ( p < pLineEnd && *p != '/' ) {
+                p = parseInt( p, pLineEnd, value );
+                if ( !p || !resolveIndex( value, chunk.texcoordBase + texcoords, corner.texcoord ) )
+                    return false;
+            }
+            if ( p < pLineEnd && *p == '/' ) {
+                p = parseInt( p + 1, pLineEnd, value );
+                if ( !p || !resolveIndex( value, chunk.normalBase + normals, corner.normal ) )
+                    return false;
+            }
+        }
+
+        if ( p < pLineEnd && !isBlank( *p ) && *p != '\r' )
+            return false;
+
+        polygon.push_back( corner );
+    }
+
+    return polygon.size() >= 3;
+}
+
+static void parseChunk( ObjChunk& chunk, ObjArrays& arrays )
+{
+    UINT positions = 0, texcoords = 0, normals = 0;
+    std::vector<ObjCorner> polygon;
+
+    chunk.failed = false;
+    chunk.corners.clear();
+
+    for ( const char* pLine = chunk.pBegin; pLine < chunk.pEnd && !chunk.failed; ) {
+        const char* pLineEnd = findLineEnd( pLine, chunk.pEnd );
+        const char* p = skipBlanks( pLine, pLineEnd );
+
+        switch ( classifyLine( p, pLineEnd ) ) {
+        case OBJ_LINE_POSITION: {
+            DirectX::XMFLOAT3& position = arrays.positions[chunk.positionBase + positions];
+            p = parseFloat( p + 1, pLineEnd, position.x );
+            if ( p ) p = parseFloat( p, pLineEnd, position.y );
+            if ( p ) p = parseFloat( p, pLineEnd, position.z );
+            chunk.failed = ( p == NULL );
+
+            // Optional vertex color (w is not supported, it's next to never written)
+            DirectX::XMFLOAT4& color = arrays.colors[chunk.positionBase + positions];
+            color = DirectX::XMFLOAT4( 1.0f, 1.0f, 1.0f, 1.0f );
+            if ( p ) {
+                DirectX::XMFLOAT3 rgb;
+                const char* pColor = parseFloat( p, pLineEnd, rgb.x );
+                if ( pColor ) pColor = parseFloat( pColor, pLineEnd, rgb.y );
+                if ( pColor ) pColor = parseFloat( pColor, pLineEnd, rgb.z );
+                if ( pColor )
+                    color = DirectX::XMFLOAT4( rgb.x, rgb.y, rgb.z, 1.0f );
+            }
+            positions++;
+            break;
+        }
+        case OBJ_LINE_TEXCOORD: {
+            DirectX::XMFLOAT2& texcoord = arrays.texcoords[chunk.texcoordBase + texcoords];
+            texcoord.y = 0.0f;
+            p = parseFloat( p + 2, pLineEnd, texcoord.x );
+            if ( p ) parseFloat( p, pLineEnd, texcoord.y );      // v is optional
+            chunk.failed = ( p == NULL );
+            texcoords++;
+            break;
+        }
+        case OBJ_LINE_NORMAL: {
+            DirectX::XMFLOAT3& normal = arrays.normals[chunk.normalBase + normals];
+            p = parseFloat( p + 2, pLineEnd, normal.x );
+            if ( p ) p = parseFloat( p, pLineEnd, normal.y );
+            if ( p ) p = parseFloat( p, pLineEnd, normal.z );
+            chunk.failed = ( p == NULL );
+            normals++;
+            break;
+        }
+        case OBJ_LINE_FACE: {
+            if ( !parseFace( p + 1, pLineEnd, chunk, positions, texcoords, normals, polygon ) ) {
+                chunk.failed = true;
+                break;
+            }
+            for ( size_t i = 1; i + 1 < polygon.size(); i++ ) {
+                chunk.corners.push_back( polygon[0] );
+                chunk.corners.push_back( polygon[i] );
+                chunk.corners.push_back( polygon[i + 1] );
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        pLine = pLineEnd + 1;
+    }
+}
+
+template<typename Function>
+static void forEachChunk( std::vector<ObjChunk>& chunks, Function function )
+{
+    std::vector<std::thread> threads;
+    for ( size_t c = 1; c < chunks.size(); c++ )
+        threads.push_back( std::thread( function, std::ref( chunks[c] ) ) );
+
+    function( chunks[0] );
+
+    for ( size_t t = 0; t < threads.size(); t++ )
+        threads[t].join();
+}
+
+// * * * Vertex welding: open addressing table on the index triple * * * //
+class ObjCornerTable
+{
+public:
+    explicit ObjCornerTable( size_t expectedCount ) : count( 0 )
+    {
+        size_t capacity = 64;
+        while ( capacity < expectedCount * 2 )
+            capacity *= 2;
+
+        mask = capacity - 1;
+        slots.resize( capacity, objMissing );
+    }
+
+    // Vertex index of corner, newIndex if it wasn't in the table yet. vertexCorners[i] is the corner of vertex i
+    UINT findOrInsert( const ObjCorner& corner, UINT newIndex, const std::vector<ObjCorner>& vertexCorners )
+    {
+        size_t slot = hash( corner ) & mask;
+        for ( ;; ) {
+            UINT index = slots[slot];
+            if ( index == objMissing )
+                break;
+
+            const ObjCorner& other = vertexCorners[index];
+            if ( other.position == corner.position && other.texcoord == corner.texcoord && other.normal == corner.normal )
+                return index;
+
+            slot = ( slot + 1 ) & mask;
+        }
+
+        slots[slot] = newIndex;
+        if ( ++count * 2 > slots.size() )
+            grow( vertexCorners, corner );
+        return newIndex;
+    }
+
+private:
+    static size_t hash( const ObjCorner& corner )
+    {
+        UINT h = corner.position * 0x9E3779B1u;
+        h ^= corner.texcoord * 0x85EBCA77u + ( h >> 15 );
+        h ^= corner.normal * 0xC2B2AE3Du + ( h >> 13 );
+        return h ^ ( h >> 16 );
+    }
+
+    // newCorner is the entry just inserted, it isn't in vertexCorners yet
+    void grow( const std::vector<ObjCorner>& vertexCorners, const ObjCorner& newCorner )
+    {
+        slots.assign( slots.size() * 2, objMissing );
+        mask = slots.size() - 1;
+
+        for ( UINT index = 0; index <= (UINT)vertexCorners.size(); index++ ) {
+            const ObjCorner& corner = ( index < vertexCorners.size() ) ? vertexCorners[index] : newCorner;
+            size_t slot = hash( corner ) & mask;
+            while ( slots[slot] != objMissing )
+                slot = ( slot + 1 ) & mask;
+            slots[slot] = index;
+        }
+    }
+
+    std::vector<UINT> slots;
+    size_t mask;
+    size_t count;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+bool importOBJ( const wchar_t* fileName, MeshData& mesh, UINT threadCount )
+{
+    char message[512];
+
+    MappedFile file;
+    if ( !file.open( fileName ) )
+        return false;
+
+    const char* pText = (const char*)file.getData();
+    size_t size = file.getSize();
+
+    // - - - line aligned chunks - - - //
+    if ( threadCount == 0 )
+        threadCount = std::thread::hardware_concurrency();
+    size_t chunkCount = std::min( (size_t)std::max( threadCount, 1u ), size / minObjChunkSize + 1 );
+
+    std::vector<ObjChunk> chunks( chunkCount );
+    const char* pChunkBegin = pText;
+    for ( size_t c = 0; c < chunkCount; c++ ) {
+        const char* pChunkEnd = pText + size;
+        if ( c + 1 < chunkCount ) {
+            pChunkEnd = std::max( pChunkBegin, pText + size * ( c + 1 ) / chunkCount );
+            pChunkEnd = std::min( findLineEnd( pChunkEnd, pText + size ) + 1, pText + size );
+        }
+        chunks[c].pBegin = pChunkBegin;
+        chunks[c].pEnd = pChunkEnd;
+        pChunkBegin = pChunkEnd;
+    }
+
+    // - - - pass 1: where every chunk's elements go - - - //
+    forEachChunk( chunks, countChunk );
+
+    UINT positionCount = 0, texcoordCount = 0, normalCount = 0;
+    for ( size_t c = 0; c < chunkCount; c++ ) {
+        chunks[c].positionBase = positionCount;
+        chunks[c].texcoordBase = texcoordCount;
+        chunks[c].normalBase = normalCount;
+        positionCount += chunks[c].positionCount;
+        texcoordCount += chunks[c].texcoordCount;
+        normalCount += chunks[c].normalCount;
+    }
+
+    // - - - pass 2: parse into the file wide arrays - - - //
+    ObjArrays arrays;
+    arrays.positions.resize( positionCount );
+    arrays.colors.resize( positionCount );
+    arrays.texcoords.resize( texcoordCount );
+    arrays.normals.resize( normalCount );
+
+    forEachChunk( chunks, [&arrays]( ObjChunk& chunk ) { parseChunk( chunk, arrays ); } );
+
+    size_t cornerCount = 0;
+    for ( size_t c = 0; c < chunkCount; c++ ) {
+        if ( chunks[c].failed ) {
+            sprintf_s( message, "[MeshImport] %ls: malformed OBJ\n", fileName );
+            OutputDebugStringA( message );
+            return false;
+        }
+        cornerCount += chunks[c].corners.size();
+    }
+
+    // - - - weld corners into vertices, in file order - - - //
+    std::vector<ObjCorner> vertexCorners;
+    vertexCorners.reserve( cornerCount / 4 );
+    ObjCornerTable table( cornerCount / 4 );
+
+    mesh.vertices.clear();
+    mesh.indices.resize( cornerCount );
+
+    size_t indexCount = 0;
+    for ( size_t c = 0; c < chunkCount; c++ ) {
+        const std::vector<ObjCorner>& corners = chunks[c].corners;
+        for ( size_t i = 0; i < corners.size(); i += 3 ) {
+            // Counter clockwise (OBJ) -> clockwise (engine)
+            const ObjCorner* triangle[3] = { &corners[i], &corners[i + 2], &corners[i + 1] };
+
+            for ( int k = 0; k < 3; k++ ) {
+                const ObjCorner& corner = *triangle[k];
+                if ( corner.position >= positionCount ||
+                     ( corner.texcoord != objMissing && corner.texcoord >= texcoordCount ) ||
+                     ( corner.normal != objMissing && corner.normal >= normalCount ) ) {
+                    sprintf_s( message, "[MeshImport] %ls: OBJ face index out of range\n", fileName );
+                    OutputDebugStringA( message );
+                    return false;
+                }
+
+                UINT newIndex = (UINT)vertexCorners.size();
+                UINT index = table.findOrInsert( corner, newIndex, vertexCorners );
+                if ( index == newIndex )
+                    vertexCorners.push_back( corner );
+                mesh.indices[indexCount++] = index;
+            }
+        }
+
+        // Corners aren't needed once welded
+        std::vector<ObjCorner>().swap( chunks[c].corners );
+    }
+
+    // - - - vertices, right handed -> left handed - - - //
+    mesh.vertices.resize( vertexCorners.size() );
+    bool missingNormals = false;
+    for ( size_t v = 0; v < vertexCorners.size(); v++ ) {
+        const ObjCorner& corner = vertexCorners[v];
+        Vertex& vertex = mesh.vertices[v];
+
+        const DirectX::XMFLOAT3& position = arrays.positions[corner.position];
+        vertex.pos = DirectX::XMFLOAT3( position.x, position.y, -position.z );
+        vertex.col = arrays.colors[corner.position];
+
+        vertex.texcoord = DirectX::XMFLOAT2( 0.0f, 0.0f );
+        if ( corner.texcoord != objMissing ) {
+            const DirectX::XMFLOAT2& texcoord = arrays.texcoords[corner.texcoord];
+            vertex.texcoord = DirectX::XMFLOAT2( texcoord.x, 1.0f - texcoord.y );      // bottom left -> top left origin
+        }
+
+        vertex.normal = DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f );
+        if ( corner.normal != objMissing ) {
+            const DirectX::XMFLOAT3& normal = arrays.normals[corner.normal];
+            vertex.normal = DirectX::XMFLOAT3( normal.x, normal.y, -normal.z );
+        }
+        else {
+            missingNormals = true;
+        }
+    }
+
+    if ( missingNormals )
+        generateMissingNormals( mesh );
+
+    return !mesh.indices.empty();
+}
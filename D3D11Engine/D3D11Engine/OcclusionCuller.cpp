@@ -0,0 +1,352 @@
+#include "OcclusionCuller.h"
+
+#include <float.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <algorithm>
+
+#include "Timer.h"
+
+const UINT occlusionDefaultWidth = 320;
+const UINT occlusionDefaultHeight = 192;
+const float occlusionMinW = 1e-4f;          // vertices closer than this to the eye plane count as clipped
+
+void buildOccluderMesh( const MeshData& mesh, OccluderMesh& occluder )
+{
+    occluder.positions.resize( mesh.vertices.size() );
+    for ( size_t i = 0; i < mesh.vertices.size(); i++ )
+        occluder.positions[i] = mesh.vertices[i].pos;
+
+    occluder.indices = mesh.indices;
+}
+
+// * * * Tile helpers * * * //
+// Bits [begin, end) of a 32 pixel row, both clamped to the row
+static UINT rowBits( int begin, int end )
+{
+    begin = std::max( begin, 0 );
+    end = std::min( end, (int)OCCLUSION_TILE_WIDTH );
+    if ( begin >= end )
+        return 0;
+
+    UINT high = ( end >= (int)OCCLUSION_TILE_WIDTH ) ? 0xFFFFFFFF : ( 1u << end ) - 1;
+    return high & ~( ( 1u << begin ) - 1 );
+}
+
+static bool maskEmpty( __m128i mask )
+{
+    return _mm_movemask_epi8( _mm_cmpeq_epi32( mask, _mm_setzero_si128() ) ) == 0xFFFF;
+}
+
+static bool maskFull( __m128i mask )
+{
+    return _mm_movemask_epi8( _mm_cmpeq_epi32( mask, _mm_set1_epi32( -1 ) ) ) == 0xFFFF;
+}
+
+// ceil() for values already clamped to >= 0 (SSE2 has no rounding instruction)
+static __m128i ceilPositive( __m128 value )
+{
+    __m128i truncated = _mm_cvttps_epi32( value );
+    __m128 roundedUp = _mm_cmplt_ps( _mm_cvtepi32_ps( truncated ), value );
+    return _mm_sub_epi32( truncated, _mm_castps_si128( roundedUp ) );
+}
+
+static float horizontalMax( __m128 value )
+{
+    value = _mm_max_ps( value, _mm_shuffle_ps( value, value, _MM_SHUFFLE(1, 0, 3, 2) ) );
+    value = _mm_max_ps( value, _mm_shuffle_ps( value, value, _MM_SHUFFLE(2, 3, 0, 1) ) );
+    return _mm_cvtss_f32( value );
+}
+
+// * * * * * OCCLUSION CULLER * * * * * //
+OcclusionCuller::OcclusionCuller()
+    : width( 0 ), height( 0 ), tilesX( 0 ), tilesY( 0 )
+{
+    DirectX::XMStoreFloat4x4( &viewProjection, DirectX::XMMatrixIdentity() );
+    ZeroMemory( &stats, sizeof(OcclusionStats) );
+    resize( occlusionDefaultWidth, occlusionDefaultHeight );
+}
+
+void OcclusionCuller::resize( UINT width, UINT height )
+{
+    tilesX = std::max( ( width + OCCLUSION_TILE_WIDTH - 1 ) / OCCLUSION_TILE_WIDTH, 1u );
+    tilesY = std::max( ( height + OCCLUSION_TILE_HEIGHT - 1 ) / OCCLUSION_TILE_HEIGHT, 1u );
+    this->width = tilesX * OCCLUSION_TILE_WIDTH;
+    this->height = tilesY * OCCLUSION_TILE_HEIGHT;
+    tiles.resize( tilesX * tilesY );
+}
+
+void OcclusionCuller::beginFrame( DirectX::FXMMATRIX viewProjection )
+{
+    DirectX::XMStoreFloat4x4( &this->viewProjection, viewProjection );
+
+    // Nothing rendered: every pixel may be infinitely far away
+    for ( size_t t = 0; t < tiles.size(); t++ ) {
+        ZeroMemory( tiles[t].mask, sizeof(tiles[t].mask) );
+        tiles[t].zMax[0] = FLT_MAX;
+        tiles[t].zMax[1] = 0.0f;
+    }
+
+    ZeroMemory( &stats, sizeof(OcclusionStats) );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void OcclusionCuller::renderOccluder( const OccluderMesh& occluder, DirectX::FXMMATRIX world )
+{
+    Timer timer;
+
+    // - - - vertices to pixels + depth, once per vertex - - - //
+    DirectX::XMMATRIX worldViewProjection = world * DirectX::XMLoadFloat4x4( &viewProjection );
+    UINT vertexCount = (UINT)occluder.positions.size();
+    screenVertices.resize( vertexCount );
+    vertexClipped.resize( vertexCount );
+
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        DirectX::XMFLOAT4 clip;
+        DirectX::XMStoreFloat4( &clip, DirectX::XMVector3Transform( DirectX::XMLoadFloat3( &occluder.positions[v] ), worldViewProjection ) );
+
+        // Near plane crossings aren't clipped, the triangles are skipped (less occlusion, never wrong)
+        vertexClipped[v] = ( clip.w < occlusionMinW || clip.z < 0.0f ) ? 1 : 0;
+        if ( vertexClipped[v] )
+            continue;
+
+        float invW = 1.0f / clip.w;
+        screenVertices[v] = DirectX::XMFLOAT3( ( clip.x * invW * 0.5f + 0.5f ) * width, ( 0.5f - clip.y * invW * 0.5f ) * height, clip.z * invW );
+    }
+
+    // - - - triangles, both windings: a back face still hides what is behind it - - - //
+    UINT triangleCount = (UINT)occluder.indices.size() / 3;
+    for ( UINT t = 0; t < triangleCount; t++ ) {
+        const UINT* pTriangle = &occluder.indices[t * 3];
+        if ( vertexClipped[pTriangle[0]] || vertexClipped[pTriangle[1]] || vertexClipped[pTriangle[2]] )
+            continue;
+
+        if ( rasterizeTriangle( screenVertices[pTriangle[0]], screenVertices[pTriangle[1]], screenVertices[pTriangle[2]] ) )
+            stats.rasterizedTriangles++;
+    }
+
+    stats.occluderTriangles += triangleCount;
+    stats.rasterMs += timer.elapsedMs();
+}
+
+// Pixel centers inside the triangle are covered. Rows are walked one tile row (4 pixel rows, one
+// SSE vector) at a time: the long edge and the short edge give each row's span, then every tile the
+// spans touch gets its coverage bits and the triangle's farthest depth over the tile.
+bool OcclusionCuller::rasterizeTriangle( const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const DirectX::XMFLOAT3& c )
+{
+    // - - - sort by y: v0 top, v2 bottom - - - //
+    const DirectX::XMFLOAT3* pV0 = &a, * pV1 = &b, * pV2 = &c;
+    if ( pV1->y < pV0->y ) std::swap( pV0, pV1 );
+    if ( pV2->y < pV1->y ) std::swap( pV1, pV2 );
+    if ( pV1->y < pV0->y ) std::swap( pV0, pV1 );
+    const DirectX::XMFLOAT3& v0 = *pV0, & v1 = *pV1, & v2 = *pV2;
+
+    float area = ( v1.x - v0.x ) * ( v2.y - v0.y ) - ( v2.x - v0.x ) * ( v1.y - v0.y );
+    if ( area == 0.0f || !( v2.y > v0.y ) )
+        return false;
+
+    float minX = std::min( v0.x, std::min( v1.x, v2.x ) ), maxX = std::max( v0.x, std::max( v1.x, v2.x ) );
+    if ( maxX < 0.0f || minX > (float)width || v2.y < 0.0f || v0.y > (float)height )
+        return false;
+
+    // Rows whose pixel centers lie in [v0.y, v2.y)
+    int rowBegin = (int)ceilf( std::max( v0.y - 0.5f, 0.0f ) );
+    int rowEnd = (int)ceilf( std::min( v2.y - 0.5f, (float)height ) );
+    if ( rowBegin >= rowEnd )
+        return false;
+
+    // - - - depth plane z = z0 + dzdx * (x - x0) + dzdy * (y - y0) - - - //
+    float dzdx = ( ( v1.z - v0.z ) * ( v2.y - v0.y ) - ( v2.z - v0.z ) * ( v1.y - v0.y ) ) / area;
+    float dzdy = ( ( v2.z - v0.z ) * ( v1.x - v0.x ) - ( v1.z - v0.z ) * ( v2.x - v0.x ) ) / area;
+    float triangleZMax = std::max( v0.z, std::max( v1.z, v2.z ) );
+
+    // - - - edge slopes (x per row), flat edges never cover a row - - - //
+    float longSlope = ( v2.x - v0.x ) / ( v2.y - v0.y );
+    float upperSlope = ( v1.y > v0.y ) ? ( v1.x - v0.x ) / ( v1.y - v0.y ) : 0.0f;
+    float lowerSlope = ( v2.y > v1.y ) ? ( v2.x - v1.x ) / ( v2.y - v1.y ) : 0.0f;
+
+    const __m128 rowCenters = _mm_setr_ps( 0.5f, 1.5f, 2.5f, 3.5f );
+    const __m128 half = _mm_set1_ps( 0.5f ), zero = _mm_setzero_ps(), right = _mm_set1_ps( (float)width );
+
+    int tileRowBegin = rowBegin / (int)OCCLUSION_TILE_HEIGHT, tileRowEnd = ( rowEnd - 1 ) / (int)OCCLUSION_TILE_HEIGHT;
+    for ( int tileY = tileRowBegin; tileY <= tileRowEnd; tileY++ ) {
+        float rowTop = (float)( tileY * OCCLUSION_TILE_HEIGHT );
+        __m128 y = _mm_add_ps( _mm_set1_ps( rowTop ), rowCenters );
+
+        __m128 xLong = _mm_add_ps( _mm_set1_ps( v0.x ), _mm_mul_ps( _mm_sub_ps( y, _mm_set1_ps( v0.y ) ), _mm_set1_ps( longSlope ) ) );
+        __m128 xUpper = _mm_add_ps( _mm_set1_ps( v0.x ), _mm_mul_ps( _mm_sub_ps( y, _mm_set1_ps( v0.y ) ), _mm_set1_ps( upperSlope ) ) );
+        __m128 xLower = _mm_add_ps( _mm_set1_ps( v1.x ), _mm_mul_ps( _mm_sub_ps( y, _mm_set1_ps( v1.y ) ), _mm_set1_ps( lowerSlope ) ) );
+        __m128 upper = _mm_cmplt_ps( y, _mm_set1_ps( v1.y ) );
+        __m128 xShort = _mm_or_ps( _mm_and_ps( upper, xUpper ), _mm_andnot_ps( upper, xLower ) );
+
+        // Pixels [ceil(left - 0.5), ceil(right - 0.5)) have their centers inside the span
+        __m128 spanLeft = _mm_min_ps( _mm_max_ps( _mm_sub_ps( _mm_min_ps( xLong, xShort ), half ), zero ), right );
+        __m128 spanRight = _mm_min_ps( _mm_max_ps( _mm_sub_ps( _mm_max_ps( xLong, xShort ), half ), zero ), right );
+
+        __m128i rowValid = _mm_castps_si128( _mm_and_ps( _mm_cmpge_ps( y, _mm_set1_ps( v0.y ) ), _mm_cmplt_ps( y, _mm_set1_ps( v2.y ) ) ) );
+        alignas(16) int spanBegin[OCCLUSION_TILE_HEIGHT], spanEnd[OCCLUSION_TILE_HEIGHT];
+        _mm_store_si128( (__m128i*)spanBegin, _mm_and_si128( ceilPositive( spanLeft ), rowValid ) );
+        _mm_store_si128( (__m128i*)spanEnd, _mm_and_si128( ceilPositive( spanRight ), rowValid ) );
+
+        int pixelBegin = (int)width, pixelEnd = 0;
+        for ( UINT r = 0; r < OCCLUSION_TILE_HEIGHT; r++ ) {
+            if ( spanBegin[r] < spanEnd[r] ) {
+                pixelBegin = std::min( pixelBegin, spanBegin[r] );
+                pixelEnd = std::max( pixelEnd, spanEnd[r] );
+            }
+        }
+        if ( pixelBegin >= pixelEnd )
+            continue;
+
+        // Farthest depth of the triangle over the tile and triangle bounds overlap: the plane's max over that rectangle
+        // is at a corner, clamped by the farthest vertex
+        float boxTop = std::max( rowTop, v0.y ), boxBottom = std::min( rowTop + OCCLUSION_TILE_HEIGHT, v2.y );
+        __m128 cornerY = _mm_setr_ps( boxTop, boxTop, boxBottom, boxBottom );
+        __m128 planeY = _mm_add_ps( _mm_set1_ps( v0.z ), _mm_mul_ps( _mm_sub_ps( cornerY, _mm_set1_ps( v0.y ) ), _mm_set1_ps( dzdy ) ) );
+
+        for ( int tileX = pixelBegin / (int)OCCLUSION_TILE_WIDTH; tileX <= ( pixelEnd - 1 ) / (int)OCCLUSION_TILE_WIDTH; tileX++ ) {
+            int tileLeft = tileX * (int)OCCLUSION_TILE_WIDTH;
+
+            UINT coverage[OCCLUSION_TILE_HEIGHT];
+            UINT anyCoverage = 0;
+            for ( UINT r = 0; r < OCCLUSION_TILE_HEIGHT; r++ ) {
+                coverage[r] = rowBits( spanBegin[r] - tileLeft, spanEnd[r] - tileLeft );
+                anyCoverage |= coverage[r];
+            }
+            if ( !anyCoverage )
+                continue;
+
+            float boxLeft = std::max( (float)tileLeft, minX ), boxRight = std::min( (float)( tileLeft + OCCLUSION_TILE_WIDTH ), maxX );
+            __m128 cornerX = _mm_setr_ps( boxLeft, boxRight, boxLeft, boxRight );
+            __m128 cornerZ = _mm_add_ps( planeY, _mm_mul_ps( _mm_sub_ps( cornerX, _mm_set1_ps( v0.x ) ), _mm_set1_ps( dzdx ) ) );
+            float tileZMax = std::min( horizontalMax( cornerZ ), triangleZMax );
+
+            updateTile( tiles[tileY * tilesX + tileX], coverage, tileZMax );
+        }
+    }
+
+    return true;
+}
+
+// Merge of one triangle's coverage into a tile, every step keeps both layers conservative
+void OcclusionCuller::updateTile( OcclusionTile& tile, const UINT* pCoverage, float triangleZMax )
+{
+    // Not nearer than what the whole tile already guarantees
+    if ( triangleZMax >= tile.zMax[0] )
+        return;
+
+    __m128i mask = _mm_loadu_si128( (const __m128i*)tile.mask );
+    __m128i coverage = _mm_loadu_si128( (const __m128i*)pCoverage );
+
+    if ( maskEmpty( mask ) ) {
+        tile.zMax[1] = triangleZMax;
+    }
+    else if ( tile.zMax[1] - triangleZMax > tile.zMax[0] - tile.zMax[1] ) {
+        // Much nearer than the masked layer: start the layer over, the old masked pixels fall back to zMax[0]
+        mask = _mm_setzero_si128();
+        tile.zMax[1] = triangleZMax;
+    }
+    else {
+        tile.zMax[1] = std::max( tile.zMax[1], triangleZMax );
+    }
+
+    mask = _mm_or_si128( mask, coverage );
+    if ( maskFull( mask ) ) {
+        tile.zMax[0] = std::min( tile.zMax[0], tile.zMax[1] );
+        mask = _mm_setzero_si128();
+    }
+
+    _mm_storeu_si128( (__m128i*)tile.mask, mask );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+bool OcclusionCuller::testBox( const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents )
+{
+    Timer timer;
+    bool visible = boxVisible( center, extents );
+    stats.testMs += timer.elapsedMs();
+    return visible;
+}
+
+void OcclusionCuller::cullObjects( const DirectX::XMFLOAT3* pCenters, const DirectX::XMFLOAT3* pExtents, std::vector<UINT>& visible )
+{
+    Timer timer;
+
+    size_t kept = 0;
+    for ( size_t i = 0; i < visible.size(); i++ ) {
+        UINT object = visible[i];
+        if ( boxVisible( pCenters[object], pExtents[object] ) )
+            visible[kept++] = object;
+    }
+    visible.resize( kept );
+
+    stats.testMs += timer.elapsedMs();
+}
+
+// The box's screen rectangle at its nearest depth: hidden when every tile under the rectangle is
+// nearer than that, in the masked and unmasked part alike
+bool OcclusionCuller::boxVisible( const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents )
+{
+    stats.testedObjects++;
+
+    // - - - project the 8 corners: clip space center +- the matrix rows scaled by the extents - - - //
+    DirectX::XMMATRIX viewProj = DirectX::XMLoadFloat4x4( &viewProjection );
+    DirectX::XMVECTOR clipCenter = DirectX::XMVector3Transform( DirectX::XMLoadFloat3( &center ), viewProj );
+    DirectX::XMVECTOR axisX = DirectX::XMVectorScale( viewProj.r[0], extents.x );
+    DirectX::XMVECTOR axisY = DirectX::XMVectorScale( viewProj.r[1], extents.y );
+    DirectX::XMVECTOR axisZ = DirectX::XMVectorScale( viewProj.r[2], extents.z );
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for ( UINT corner = 0; corner < 8; corner++ ) {
+        DirectX::XMVECTOR clipCorner = clipCenter;
+        clipCorner = ( corner & 1 ) ? DirectX::XMVectorAdd( clipCorner, axisX ) : DirectX::XMVectorSubtract( clipCorner, axisX );
+        clipCorner = ( corner & 2 ) ? DirectX::XMVectorAdd( clipCorner, axisY ) : DirectX::XMVectorSubtract( clipCorner, axisY );
+        clipCorner = ( corner & 4 ) ? DirectX::XMVectorAdd( clipCorner, axisZ ) : DirectX::XMVectorSubtract( clipCorner, axisZ );
+
+        DirectX::XMFLOAT4 clip;
+        DirectX::XMStoreFloat4( &clip, clipCorner );
+
+        // Reaches the near plane, can't be behind anything
+        if ( clip.w < occlusionMinW || clip.z < 0.0f )
+            return true;
+
+        float invW = 1.0f / clip.w;
+        float x = ( clip.x * invW * 0.5f + 0.5f ) * width, y = ( 0.5f - clip.y * invW * 0.5f ) * height;
+        minX = std::min( minX, x ); maxX = std::max( maxX, x );
+        minY = std::min( minY, y ); maxY = std::max( maxY, y );
+        minZ = std::min( minZ, clip.z * invW );
+    }
+
+    // Every pixel the rectangle touches. Off screen is the frustum culler's call
+    int pixelLeft = (int)floorf( std::max( minX, 0.0f ) ), pixelRight = (int)floorf( std::min( maxX, (float)width - 1.0f ) ) + 1;
+    int pixelTop = (int)floorf( std::max( minY, 0.0f ) ), pixelBottom = (int)floorf( std::min( maxY, (float)height - 1.0f ) ) + 1;
+    if ( pixelLeft >= pixelRight || pixelTop >= pixelBottom )
+        return true;
+
+    // - - - tiles under the rectangle - - - //
+    for ( int tileY = pixelTop / (int)OCCLUSION_TILE_HEIGHT; tileY <= ( pixelBottom - 1 ) / (int)OCCLUSION_TILE_HEIGHT; tileY++ ) {
+        int rowTop = tileY * (int)OCCLUSION_TILE_HEIGHT;
+        bool rowInside[OCCLUSION_TILE_HEIGHT];
+        for ( UINT r = 0; r < OCCLUSION_TILE_HEIGHT; r++ )
+            rowInside[r] = rowTop + (int)r >= pixelTop && rowTop + (int)r < pixelBottom;
+
+        for ( int tileX = pixelLeft / (int)OCCLUSION_TILE_WIDTH; tileX <= ( pixelRight - 1 ) / (int)OCCLUSION_TILE_WIDTH; tileX++ ) {
+            const OcclusionTile& tile = tiles[tileY * tilesX + tileX];
+            int tileLeft = tileX * (int)OCCLUSION_TILE_WIDTH;
+            UINT bits = rowBits( pixelLeft - tileLeft, pixelRight - tileLeft );
+
+            __m128i rect = _mm_setr_epi32( rowInside[0] ? bits : 0, rowInside[1] ? bits : 0, rowInside[2] ? bits : 0, rowInside[3] ? bits : 0 );
+            __m128i mask = _mm_loadu_si128( (const __m128i*)tile.mask );
+
+            if ( minZ <= tile.zMax[0] && !maskEmpty( _mm_andnot_si128( mask, rect ) ) )
+                return true;
+            if ( minZ <= std::min( tile.zMax[0], tile.zMax[1] ) && !maskEmpty( _mm_and_si128( mask, rect ) ) )
+                return true;
+        }
+    }
+
+    stats.occludedObjects++;
+    return false;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Mesh.h"
+
+// * * * Occluder geometry, positions only * * * //
+// Occluders should be few and simple (walls, terrain, big props, or low LODs of them)
+struct OccluderMesh
+{
+    std::vector<DirectX::XMFLOAT3> positions;
+    std::vector<UINT> indices;      // triangle list
+};
+
+void buildOccluderMesh( const MeshData& mesh, OccluderMesh& occluder );
+
+// * * * Per frame counters, reset by beginFrame * * * //
+struct OcclusionStats
+{
+    UINT occluderTriangles;
+    UINT rasterizedTriangles;       // survived the near plane / off screen / zero area rejection
+    UINT testedObjects;
+    UINT occludedObjects;
+    double rasterMs;
+    double testMs;
+};
+
+// * * * Masked software occlusion culling * * * //
+// Occluders are rasterized on the CPU into a small depth buffer made of 32x4 pixel tiles. A tile
+// doesn't store a depth per pixel, it keeps a coverage mask (bit per pixel) and two conservative
+// depths: zMax[0] bounds every pixel of the tile, zMax[1] the pixels in the mask. New triangles are
+// merged into the masked layer, once the mask covers the whole tile it replaces zMax[0]. Depths only
+// ever move farther than the real occluder surface, so a box that tests as hidden is really hidden.
+// Rasterization works 4 rows (one tile row) per SSE vector, tests check whole tiles at once.
+const UINT OCCLUSION_TILE_WIDTH = 32;
+const UINT OCCLUSION_TILE_HEIGHT = 4;
+
+struct OcclusionTile
+{
+    UINT mask[OCCLUSION_TILE_HEIGHT];   // bit x of row y = pixel (tileX * 32 + x, tileY * 4 + y)
+    float zMax[2];
+};
+
+class OcclusionCuller
+{
+public:
+    OcclusionCuller();
+
+    // Rounded up to whole tiles, the buffer covers the full viewport whatever its aspect ratio
+    void resize( UINT width, UINT height );
+
+    // Clears the buffer, occluders and tests of this frame use viewProjection
+    void beginFrame( DirectX::FXMMATRIX viewProjection );
+    void renderOccluder( const OccluderMesh& occluder, DirectX::FXMMATRIX world );
+
+    // False when the world space box is certainly hidden behind the occluders
+    bool testBox( const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents );
+    // Drops the hidden objects from visible (indices into the bounds arrays)
+    void cullObjects( const DirectX::XMFLOAT3* pCenters, const DirectX::XMFLOAT3* pExtents, std::vector<UINT>& visible );
+
+    const OcclusionStats& getStats() const { return stats; }
+    UINT getWidth() const { return width; }
+    UINT getHeight() const { return height; }
+    const OcclusionTile& getTile( UINT tileX, UINT tileY ) const { return tiles[tileY * tilesX + tileX]; }
+
+private:
+    bool rasterizeTriangle( const DirectX::XMFLOAT3& v0, const DirectX::XMFLOAT3& v1, const DirectX::XMFLOAT3& v2 );
+    void updateTile( OcclusionTile& tile, const UINT* pCoverage, float triangleZMax );
+    bool boxVisible( const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents );
+
+    UINT width, height;
+    UINT tilesX, tilesY;
+    std::vector<OcclusionTile> tiles;
+
+    DirectX::XMFLOAT4X4 viewProjection;
+    std::vector<DirectX::XMFLOAT3> screenVertices;     // x, y in pixels, z = depth, per occluder vertex
+    std::vector<BYTE> vertexClipped;                   // in front of the near plane
+
+    OcclusionStats stats;
+};
@@ -0,0 +1,506 @@
+#include "PointShadowMap.h"
+
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+// Look direction and up of every cube face, in D3D cube map order
+static const DirectX::XMFLOAT3 faceDirections[PointShadowMap::faceCount] = {
+    DirectX::XMFLOAT3( 1.0f, 0.0f, 0.0f ), DirectX::XMFLOAT3( -1.0f, 0.0f, 0.0f ),
+    DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ), DirectX::XMFLOAT3( 0.0f, -1.0f, 0.0f ),
+    DirectX::XMFLOAT3( 0.0f, 0.0f, 1.0f ), DirectX::XMFLOAT3( 0.0f, 0.0f, -1.0f ),
+};
+static const DirectX::XMFLOAT3 faceUps[PointShadowMap::faceCount] = {
+    DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ), DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ),
+    DirectX::XMFLOAT3( 0.0f, 0.0f, -1.0f ), DirectX::XMFLOAT3( 0.0f, 0.0f, 1.0f ),
+    DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ), DirectX::XMFLOAT3( 0.0f, 1.0f, 0.0f ),
+};
+
+// D32 depth: the constant bias is in units of 2^-23 of the depth's exponent, point light depths are close to 1
+const INT shadowDepthBias = 64;
+const float shadowSlopeBias = 2.0f;
+
+static UINT countFaces( UINT mask )
+{
+    UINT count = 0;
+    for ( ; mask; mask &= mask - 1 )
+        count++;
+    return count;
+}
+
+// Box against the 6 planes, conservative (boxes near a corner may pass)
+static bool boxInFrustum( const Frustum& frustum, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents )
+{
+    for ( UINT i = 0; i < FRUSTUM_PLANE_COUNT; i++ ) {
+        const DirectX::XMFLOAT4& plane = frustum.planes[i];
+        float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        float radius = fabsf( plane.x ) * extents.x + fabsf( plane.y ) * extents.y + fabsf( plane.z ) * extents.z;
+        if ( distance + radius < 0.0f )
+            return false;
+    }
+    return true;
+}
+
+// * * * * * SHADOW MAP * * * * * //
+PointShadowMap::PointShadowMap()
+    : lightPosition( 0.0f, 0.0f, 0.0f ), nearZ( 0.05f ), farZ( 20.0f ), redrawAll( true ),
+      caching( true ), staticDirty( 0 ), dynamicDirty( 0 ),
+      pStaticTexture( NULL ), pShadowTexture( NULL ), pShadowSRV( NULL ), pVertexShader( NULL ), pInputLayout( NULL ),
+      pRasterizerState( NULL ), pDepthStencilState( NULL ), pComparisonSampler( NULL ), pObjectCBuffer( NULL ), pShadowCBuffer( NULL ),
+      size( 0 )
+{
+    ZeroMemory( &stats, sizeof(ShadowMapStats) );
+    ZeroMemory( &savedViewport, sizeof(D3D11_VIEWPORT) );
+
+    for ( UINT face = 0; face < faceCount; face++ ) {
+        pStaticDSVs[face] = NULL;
+        pShadowDSVs[face] = NULL;
+    }
+
+    setLight( lightPosition, nearZ, farZ );
+}
+
+bool PointShadowMap::init( ID3D11Device* pDevice, UINT size )
+{
+    this->size = size;
+
+    // * * * * * DEPTH CUBES * * * * * //
+    // Typeless so the shadow cube can be a D32 depth target and an R32 texture, the static cube only needs the same format for the copy
+    D3D11_TEXTURE2D_DESC textureDesc;
+    ZeroMemory( &textureDesc, sizeof(D3D11_TEXTURE2D_DESC) );
+
+                textureDesc.Width = size;
+                textureDesc.Height = size;
+                textureDesc.MipLevels = 1;
+                textureDesc.ArraySize = faceCount;
+                textureDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+                textureDesc.SampleDesc.Count = 1;
+                textureDesc.Usage = D3D11_USAGE_DEFAULT;
+                textureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+                textureDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+
+    HRESULT hr = pDevice->CreateTexture2D( &textureDesc, NULL, &pStaticTexture );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    textureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+    hr = pDevice->CreateTexture2D( &textureDesc, NULL, &pShadowTexture );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    for ( UINT face = 0; face < faceCount; face++ ) {
+        D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+        ZeroMemory( &dsvDesc, sizeof(D3D11_DEPTH_STENCIL_VIEW_DESC) );
+
+                    dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+                    dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+                    dsvDesc.Texture2DArray.MipSlice = 0;
+                    dsvDesc.Texture2DArray.FirstArraySlice = face;
+                    dsvDesc.Texture2DArray.ArraySize = 1;
+
+        if ( FAILED( pDevice->CreateDepthStencilView( pStaticTexture, &dsvDesc, &pStaticDSVs[face] ) ) ||
+             FAILED( pDevice->CreateDepthStencilView( pShadowTexture, &dsvDesc, &pShadowDSVs[face] ) ) ) {
+            release();
+            return false;
+        }
+    }
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    ZeroMemory( &srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC) );
+
+                srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+                srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+                srvDesc.TextureCube.MostDetailedMip = 0;
+                srvDesc.TextureCube.MipLevels = 1;
+
+    hr = pDevice->CreateShaderResourceView( pShadowTexture, &srvDesc, &pShadowSRV );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    // * * * * * DEPTH ONLY VERTEX SHADER * * * * * //
+    std::string objectDeclaration = getCBufferDeclaration<cBufferShadowObject>( "cBufferShadowObject", 0 );
+    D3D_SHADER_MACRO defines[] = {
+        { "CBUFFER_SHADOW_OBJECT", objectDeclaration.c_str() },
+        { NULL, NULL },
+    };
+
+    ID3DBlob* pVertexShaderBlob = NULL, * pErrorBlob = NULL;
+    hr = D3DCompileFromFile( L"shadowVertexShader.hlsl", defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, "vs_main", "vs_5_0", NULL, NULL, &pVertexShaderBlob, &pErrorBlob );
+    if ( FAILED(hr) ) {
+        if ( pErrorBlob ) {
+            OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
+            pErrorBlob->Release();
+        }
+        release();
+        return false;
+    }
+
+    hr = pDevice->CreateVertexShader( pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), NULL, &pVertexShader );
+    assert( SUCCEEDED(hr) );
+
+    // Only the position of the PackedVertex is read
+    D3D11_INPUT_ELEMENT_DESC inputElementDesc[] = {
+              { "POS", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+
+    hr = pDevice->CreateInputLayout( inputElementDesc, ARRAYSIZE(inputElementDesc), pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), &pInputLayout );
+    pVertexShaderBlob->Release();
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    // * * * * * STATES * * * * * //
+    D3D11_RASTERIZER_DESC rasterizerStateDesc;
+    ZeroMemory( &rasterizerStateDesc, sizeof( D3D11_RASTERIZER_DESC ) );
+
+                rasterizerStateDesc.FillMode = D3D11_FILL_SOLID;
+                rasterizerStateDesc.CullMode = D3D11_CULL_BACK;
+                rasterizerStateDesc.DepthBias = shadowDepthBias;
+                rasterizerStateDesc.SlopeScaledDepthBias = shadowSlopeBias;
+                rasterizerStateDesc.DepthClipEnable = true;
+
+    D3D11_DEPTH_STENCIL_DESC depthStencilStateDesc;
+    ZeroMemory( &depthStencilStateDesc, sizeof( D3D11_DEPTH_STENCIL_DESC) );
+
+                depthStencilStateDesc.DepthEnable = true;
+                depthStencilStateDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+                depthStencilStateDesc.DepthFunc = D3D11_COMPARISON_LESS;
+
+    // 2 x 2 PCF from the hardware: the comparison result is filtered
+    D3D11_SAMPLER_DESC samplerDesc;
+    ZeroMemory( &samplerDesc, sizeof(D3D11_SAMPLER_DESC) );
+
+                samplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+                samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+                samplerDesc.MinLOD = 0;
+                samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+    if ( FAILED( pDevice->CreateRasterizerState( &rasterizerStateDesc, &pRasterizerState ) ) ||
+         FAILED( pDevice->CreateDepthStencilState( &depthStencilStateDesc, &pDepthStencilState ) ) ||
+         FAILED( pDevice->CreateSamplerState( &samplerDesc, &pComparisonSampler ) ) ) {
+        release();
+        return false;
+    }
+
+    // * * * * * CONSTANT BUFFERS * * * * * //
+    D3D11_BUFFER_DESC cBufferDesc;
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = sizeof( cBufferShadowObject );
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                cBufferDesc.CPUAccessFlags = 0;
+                cBufferDesc.MiscFlags = 0;
+
+    hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pObjectCBuffer );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    cBufferDesc.ByteWidth = sizeof( cBufferShadow );
+    hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pShadowCBuffer );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    invalidate();
+    return true;
+}
+
+void PointShadowMap::release()
+{
+    for ( UINT face = 0; face < faceCount; face++ ) {
+        if ( pStaticDSVs[face] ) pStaticDSVs[face]->Release();
+        if ( pShadowDSVs[face] ) pShadowDSVs[face]->Release();
+        pStaticDSVs[face] = NULL;
+        pShadowDSVs[face] = NULL;
+    }
+
+    if ( pShadowSRV ) pShadowSRV->Release();
+    if ( pShadowTexture ) pShadowTexture->Release();
+    if ( pStaticTexture ) pStaticTexture->Release();
+    if ( pVertexShader ) pVertexShader->Release();
+    if ( pInputLayout ) pInputLayout->Release();
+    if ( pRasterizerState ) pRasterizerState->Release();
+    if ( pDepthStencilState ) pDepthStencilState->Release();
+    if ( pComparisonSampler ) pComparisonSampler->Release();
+    if ( pObjectCBuffer ) pObjectCBuffer->Release();
+    if ( pShadowCBuffer ) pShadowCBuffer->Release();
+
+    pShadowSRV = NULL; pShadowTexture = NULL; pStaticTexture = NULL;
+    pVertexShader = NULL; pInputLayout = NULL;
+    pRasterizerState = NULL; pDepthStencilState = NULL; pComparisonSampler = NULL;
+    pObjectCBuffer = NULL; pShadowCBuffer = NULL;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+UINT PointShadowMap::addCaster( bool isStatic )
+{
+    ShadowCaster caster;
+    ZeroMemory( &caster, sizeof(ShadowCaster) );
+    caster.isStatic = isStatic;
+
+    casters.push_back( caster );
+    return (UINT)casters.size() - 1;
+}
+
+void PointShadowMap::setCaster( UINT index, DirectX::FXMMATRIX world, const VertexQuantization& quantization,
+                                const DirectX::XMFLOAT3& worldCenter, const DirectX::XMFLOAT3& worldExtents, UINT shapeVersion )
+{
+    ShadowCaster& caster = casters[index];
+
+    DirectX::XMFLOAT4X4 newWorld;
+    DirectX::XMStoreFloat4x4( &newWorld, world );
+
+    // Bit exact compare: a caster that didn't move produces the same numbers
+    if ( caster.valid && caster.shapeVersion == shapeVersion &&
+         memcmp( &caster.world, &newWorld, sizeof(DirectX::XMFLOAT4X4) ) == 0 &&
+         memcmp( &caster.quantization, &quantization, sizeof(VertexQuantization) ) == 0 &&
+         memcmp( &caster.center, &worldCenter, sizeof(DirectX::XMFLOAT3) ) == 0 &&
+         memcmp( &caster.extents, &worldExtents, sizeof(DirectX::XMFLOAT3) ) == 0 )
+        return;
+
+    caster.world = newWorld;
+    caster.quantization = quantization;
+    caster.center = worldCenter;
+    caster.extents = worldExtents;
+    caster.shapeVersion = shapeVersion;
+    caster.valid = true;
+    caster.changed = true;
+}
+
+void PointShadowMap::setLight( const DirectX::XMFLOAT3& position, float nearZ, float farZ )
+{
+    if ( position.x == lightPosition.x && position.y == lightPosition.y && position.z == lightPosition.z &&
+         nearZ == this->nearZ && farZ == this->farZ && !redrawAll )
+        return;
+
+    lightPosition = position;
+    this->nearZ = nearZ;
+    this->farZ = farZ;
+    redrawAll = true;
+
+    DirectX::XMVECTOR eye = DirectX::XMLoadFloat3( &position );
+    DirectX::XMMATRIX projection = DirectX::XMMatrixPerspectiveFovLH( DirectX::XM_PIDIV2, 1.0f, nearZ, farZ );
+
+    for ( UINT face = 0; face < faceCount; face++ ) {
+        DirectX::XMMATRIX view = DirectX::XMMatrixLookToLH( eye, DirectX::XMLoadFloat3( &faceDirections[face] ), DirectX::XMLoadFloat3( &faceUps[face] ) );
+        DirectX::XMMATRIX viewProjection = view * projection;
+
+        DirectX::XMStoreFloat4x4( &faceViewProjections[face], viewProjection );
+        extractFrustum( viewProjection, faceFrustums[face] );
+    }
+}
+
+void PointShadowMap::setCaching( bool enabled )
+{
+    // The static layer isn't kept up to date without caching
+    if ( enabled && !caching )
+        invalidate();
+    caching = enabled;
+}
+
+void PointShadowMap::invalidate()
+{
+    redrawAll = true;
+}
+
+UINT PointShadowMap::getFaceMask( const ShadowCaster& caster ) const
+{
+    UINT mask = 0;
+    for ( UINT face = 0; face < faceCount; face++ ) {
+        if ( boxInFrustum( faceFrustums[face], caster.center, caster.extents ) )
+            mask |= 1 << face;
+    }
+    return mask;
+}
+
+void PointShadowMap::update()
+{
+    for ( size_t i = 0; i < casters.size(); i++ ) {
+        ShadowCaster& caster = casters[i];
+        if ( !caster.valid || !( caster.changed || redrawAll ) )
+            continue;
+
+        caster.faceMask = (BYTE)getFaceMask( caster );
+
+        // The faces it is in now get it, the faces it was drawn into lose it
+        if ( caster.changed ) {
+            UINT faces = caster.faceMask | caster.drawnMask;
+            if ( caster.isStatic )
+                staticDirty |= faces;
+            dynamicDirty |= faces;
+        }
+    }
+
+    if ( redrawAll ) {
+        staticDirty = allFaces;
+        dynamicDirty = allFaces;
+    }
+
+    if ( caching ) {
+        stats.staticFaces = countFaces( staticDirty );
+        stats.dynamicFaces = countFaces( dynamicDirty );
+    }
+    else {
+        stats.staticFaces = 0;
+        stats.dynamicFaces = faceCount;
+    }
+    stats.cachedFaces = faceCount - stats.dynamicFaces;
+    stats.casterDraws = 0;
+    stats.renderMs = 0.0;
+}
+
+bool PointShadowMap::isCasterDrawn( UINT index ) const
+{
+    const ShadowCaster& caster = casters[index];
+    if ( !caching )
+        return caster.faceMask != 0;
+    return ( caster.faceMask & ( caster.isStatic ? staticDirty : dynamicDirty ) ) != 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void PointShadowMap::beginRender( ID3D11DeviceContext* pDeviceContext )
+{
+    renderTimer.reset();
+
+    UINT viewportCount = 1;
+    pDeviceContext->RSGetViewports( &viewportCount, &savedViewport );
+
+    D3D11_VIEWPORT viewport;
+    ZeroMemory( &viewport, sizeof(D3D11_VIEWPORT) );
+
+    viewport.Width = (float)size;
+    viewport.Height = (float)size;
+    viewport.MinDepth = 0.0f;
+    viewport.MaxDepth = 1.0f;
+
+    // The cube can't be read while it is written
+    ID3D11ShaderResourceView* pNullSRV = NULL;
+    pDeviceContext->PSSetShaderResources( 4, 1, &pNullSRV );
+
+    // Depth only: no pixel shader, no render target
+    pDeviceContext->RSSetViewports( 1, &viewport );
+    pDeviceContext->RSSetState( pRasterizerState );
+    pDeviceContext->OMSetDepthStencilState( pDepthStencilState, 0 );
+    pDeviceContext->IASetInputLayout( pInputLayout );
+    pDeviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+    pDeviceContext->VSSetShader( pVertexShader, nullptr, 0 );
+    pDeviceContext->PSSetShader( NULL, nullptr, 0 );
+    pDeviceContext->VSSetConstantBuffers( 0, 1, &pObjectCBuffer );
+}
+
+bool PointShadowMap::beginFace( ID3D11DeviceContext* pDeviceContext, UINT face, ShadowPass pass )
+{
+    UINT faceBit = 1 << face;
+
+    switch ( pass ) {
+    case SHADOW_PASS_STATIC:
+        if ( !caching || !( staticDirty & faceBit ) )
+            return false;
+
+        pDeviceContext->OMSetRenderTargets( 0, NULL, pStaticDSVs[face] );
+        pDeviceContext->ClearDepthStencilView( pStaticDSVs[face], D3D11_CLEAR_DEPTH, 1.0f, 0 );
+        return true;
+
+    case SHADOW_PASS_DYNAMIC: {
+        if ( !caching || !( dynamicDirty & faceBit ) )
+            return false;
+
+        // Depth copies take whole subresources, one face is one array slice
+        UINT subresource = D3D11CalcSubresource( 0, face, 1 );
+        pDeviceContext->OMSetRenderTargets( 0, NULL, NULL );
+        pDeviceContext->CopySubresourceRegion( pShadowTexture, subresource, 0, 0, 0, pStaticTexture, subresource, NULL );
+        pDeviceContext->OMSetRenderTargets( 0, NULL, pShadowDSVs[face] );
+        return true;
+    }
+
+    case SHADOW_PASS_ALL:
+        if ( caching )
+            return false;
+
+        pDeviceContext->OMSetRenderTargets( 0, NULL, pShadowDSVs[face] );
+        pDeviceContext->ClearDepthStencilView( pShadowDSVs[face], D3D11_CLEAR_DEPTH, 1.0f, 0 );
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool PointShadowMap::isCasterInPass( const ShadowCaster& caster, UINT face, ShadowPass pass ) const
+{
+    if ( !caster.valid || !( caster.faceMask & ( 1 << face ) ) )
+        return false;
+
+    if ( pass == SHADOW_PASS_ALL )
+        return true;
+    return caster.isStatic == ( pass == SHADOW_PASS_STATIC );
+}
+
+void PointShadowMap::drawCasterDepth( ID3D11DeviceContext* pDeviceContext, const ShadowCaster& caster, UINT face )
+{
+    cBufferShadowObject constants;
+    constants.worldViewProjection() = DirectX::XMMatrixTranspose( DirectX::XMLoadFloat4x4( &caster.world ) * DirectX::XMLoadFloat4x4( &faceViewProjections[face] ) );
+    constants.positionScale() = caster.quantization.positionScale;
+    constants.positionOffset() = caster.quantization.positionOffset;
+
+    pDeviceContext->UpdateSubresource( pObjectCBuffer, 0, NULL, &constants, 0, 0 );
+    stats.casterDraws++;
+}
+
+void PointShadowMap::endRender( ID3D11DeviceContext* pDeviceContext )
+{
+    pDeviceContext->OMSetRenderTargets( 0, NULL, NULL );
+    pDeviceContext->RSSetViewports( 1, &savedViewport );
+
+    // Re-rendered faces now hold exactly the casters whose bounds touch them
+    for ( size_t i = 0; i < casters.size(); i++ ) {
+        ShadowCaster& caster = casters[i];
+        UINT rendered = !caching ? allFaces : caster.isStatic ? staticDirty : dynamicDirty;
+
+        caster.drawnMask = (BYTE)( ( caster.drawnMask & ~rendered ) | ( caster.faceMask & rendered ) );
+        caster.changed = false;
+    }
+
+    // Without caching the static layer falls behind
+    redrawAll = !caching;
+    staticDirty = 0;
+    dynamicDirty = 0;
+
+    stats.renderMs = renderTimer.elapsedMs();
+}
+
+void PointShadowMap::bind( ID3D11DeviceContext* pDeviceContext )
+{
+    // Projected depth of a face: farZ / ( farZ - nearZ ) - farZ * nearZ / ( ( farZ - nearZ ) * z )
+    cBufferShadow constants;
+    constants.shadowLightPosition() = lightPosition;
+    constants.shadowDepthScale() = -farZ * nearZ / ( farZ - nearZ );
+    constants.shadowDepthOffset() = farZ / ( farZ - nearZ );
+
+    pDeviceContext->UpdateSubresource( pShadowCBuffer, 0, NULL, &constants, 0, 0 );
+    pDeviceContext->PSSetConstantBuffers( 3, 1, &pShadowCBuffer );
+    pDeviceContext->PSSetShaderResources( 4, 1, &pShadowSRV );
+    pDeviceContext->PSSetSamplers( 1, 1, &pComparisonSampler );
+}
+
+DirectX::XMMATRIX PointShadowMap::getFaceViewProjection( UINT face ) const
+{
+    return DirectX::XMLoadFloat4x4( &faceViewProjections[face] );
+}
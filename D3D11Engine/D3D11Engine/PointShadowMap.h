@@ -0,0 +1,176 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Camera.h"
+#include "Vertex.h"
+#include "CBufferLayout.h"
+#include "Timer.h"
+
+// Per caster constants of the depth only vertex shader (shadowVertexShader.hlsl)
+#define SHADOW_OBJECT_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMMATRIX, worldViewProjection )     /* world * face view * projection */ \
+    FIELD( DirectX::XMFLOAT3, positionScale ) \
+    FIELD( DirectX::XMFLOAT3, positionOffset )
+DECLARE_CBUFFER( cBufferShadowObject, SHADOW_OBJECT_CBUFFER_FIELDS )
+
+// Lookup constants for the pixel shader (b3), main.cpp declares them to the shader
+#define SHADOW_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMFLOAT3, shadowLightPosition ) \
+    FIELD( float, shadowDepthScale )                    /* depth = shadowDepthOffset + shadowDepthScale / major axis distance */ \
+    FIELD( float, shadowDepthOffset )
+DECLARE_CBUFFER( cBufferShadow, SHADOW_CBUFFER_FIELDS )
+
+// Counters of the last update / render
+struct ShadowMapStats
+{
+    UINT staticFaces;               // static layer faces re-rendered
+    UINT dynamicFaces;              // faces rebuilt from the static layer + dynamic casters
+    UINT cachedFaces;               // faces kept from an earlier frame
+    UINT casterDraws;
+    double renderMs;                // CPU, state setup + draw submission
+};
+
+// * * * Cached omnidirectional shadow map for one point light * * * //
+// Six 90 degree faces rendered depth only (no pixel shader, no render target) into a cube.
+// Casters are static or dynamic and are kept in two layers: static casters render into a static
+// cube, the shadow cube face is a copy of the static face with the dynamic casters on top. A
+// face is only re-rendered when something that is (or was, last time) inside its frustum
+// changes: the light moving dirties everything, a static caster dirties both layers of its
+// faces, a dynamic caster only the shadow cube's. Faces nothing touched keep last frame's depth.
+//
+//     update()                 dirty faces from this frame's setLight / setCaster
+//     isCasterDrawn()          e.g. skin a mesh only when the shadow map needs it
+//     render( ctx, draw )      draw( caster, face ) binds the caster's buffers and draws
+//     bind()                   t4 = shadow cube, s1 = comparison sampler, b3 = lookup constants
+class PointShadowMap
+{
+public:
+    static const UINT faceCount = 6;    // +x, -x, +y, -y, +z, -z
+    static const UINT allFaces = ( 1 << faceCount ) - 1;
+
+    PointShadowMap();
+
+    // size x size texels per face
+    bool init( ID3D11Device* pDevice, UINT size );
+    void release();
+
+    // Returns the caster index for setCaster / the draw callback
+    UINT addCaster( bool isStatic );
+
+    // World space bounds decide the faces, a caster is dirty when any of this differs from last frame.
+    // Casters whose vertices change in place (skinning) pass a new shapeVersion whenever they do
+    void setCaster( UINT caster, DirectX::FXMMATRIX world, const VertexQuantization& quantization,
+                    const DirectX::XMFLOAT3& worldCenter, const DirectX::XMFLOAT3& worldExtents, UINT shapeVersion = 0 );
+    void setLight( const DirectX::XMFLOAT3& position, float nearZ, float farZ );
+
+    // false: every caster into every face each frame, straight into the shadow cube (reference)
+    void setCaching( bool enabled );
+    // Everything is re-rendered next frame
+    void invalidate();
+
+    void update();
+    bool isCasterDrawn( UINT caster ) const;
+
+    template<typename DrawCaster>
+    void render( ID3D11DeviceContext* pDeviceContext, const DrawCaster& drawCaster );
+
+    void bind( ID3D11DeviceContext* pDeviceContext );
+
+    DirectX::XMMATRIX getFaceViewProjection( UINT face ) const;
+    const DirectX::XMFLOAT3& getLightPosition() const { return lightPosition; }
+    UINT getCasterCount() const { return (UINT)casters.size(); }
+    const ShadowMapStats& getStats() const { return stats; }
+
+private:
+    enum ShadowPass
+    {
+        SHADOW_PASS_STATIC,         // static casters -> static cube
+        SHADOW_PASS_DYNAMIC,        // static face copied to the shadow cube, dynamic casters on top
+        SHADOW_PASS_ALL,            // caching off: every caster -> shadow cube
+        SHADOW_PASS_COUNT
+    };
+
+    struct ShadowCaster
+    {
+        bool isStatic;
+        bool valid;                 // setCaster was called
+        bool changed;               // since the last update
+        BYTE faceMask;              // faces the bounds touch
+        BYTE drawnMask;             // faces the caster was last rendered into
+        DirectX::XMFLOAT4X4 world;
+        VertexQuantization quantization;
+        DirectX::XMFLOAT3 center, extents;
+        UINT shapeVersion;
+    };
+
+    UINT getFaceMask( const ShadowCaster& caster ) const;
+
+    void beginRender( ID3D11DeviceContext* pDeviceContext );
+    bool beginFace( ID3D11DeviceContext* pDeviceContext, UINT face, ShadowPass pass );
+    bool isCasterInPass( const ShadowCaster& caster, UINT face, ShadowPass pass ) const;
+    void drawCasterDepth( ID3D11DeviceContext* pDeviceContext, const ShadowCaster& caster, UINT face );
+    void endRender( ID3D11DeviceContext* pDeviceContext );
+
+    std::vector<ShadowCaster> casters;
+
+    // - - - light - - - //
+    DirectX::XMFLOAT3 lightPosition;
+    float nearZ, farZ;
+    bool redrawAll;                 // light moved, caching turned on or invalidate()
+    DirectX::XMFLOAT4X4 faceViewProjections[faceCount];
+    Frustum faceFrustums[faceCount];
+
+    // - - - dirty faces, bit per face - - - //
+    bool caching;
+    UINT staticDirty;
+    UINT dynamicDirty;              // includes the static dirty faces, they have to be composed again
+    ShadowMapStats stats;
+    Timer renderTimer;
+
+    // - - - GPU - - - //
+    ID3D11Texture2D* pStaticTexture, * pShadowTexture;
+    ID3D11DepthStencilView* pStaticDSVs[faceCount], * pShadowDSVs[faceCount];
+    ID3D11ShaderResourceView* pShadowSRV;
+    ID3D11VertexShader* pVertexShader;
+    ID3D11InputLayout* pInputLayout;
+    ID3D11RasterizerState* pRasterizerState;
+    ID3D11DepthStencilState* pDepthStencilState;
+    ID3D11SamplerState* pComparisonSampler;
+    ID3D11Buffer* pObjectCBuffer, * pShadowCBuffer;
+    UINT size;
+    D3D11_VIEWPORT savedViewport;
+};
+
+template<typename DrawCaster>
+void PointShadowMap::render( ID3D11DeviceContext* pDeviceContext, const DrawCaster& drawCaster )
+{
+    beginRender( pDeviceContext );
+
+    // Per face the static layer first, the dynamic pass copies from it
+    for ( UINT face = 0; face < faceCount; face++ ) {
+        for ( UINT pass = 0; pass < SHADOW_PASS_COUNT; pass++ ) {
+            if ( !beginFace( pDeviceContext, face, (ShadowPass)pass ) )
+                continue;
+
+            for ( UINT i = 0; i < (UINT)casters.size(); i++ ) {
+                if ( !isCasterInPass( casters[i], face, (ShadowPass)pass ) )
+                    continue;
+
+                drawCasterDepth( pDeviceContext, casters[i], face );
+                drawCaster( i, face );
+            }
+        }
+    }
+
+    endRender( pDeviceContext );
+}
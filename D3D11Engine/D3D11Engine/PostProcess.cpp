@@ -0,0 +1,699 @@
+#include "PostProcess.h"
+
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <immintrin.h>
+
+#include "SceneShaders.h"
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+const UINT postTileRows = 16;           // target rows per job batch
+
+// Bloom level below a level of width x height: half, rounded up. false when it would get smaller than 2 x 2
+static bool getNextLevelSize( UINT& width, UINT& height )
+{
+    width = ( width + 1 ) / 2;
+    height = ( height + 1 ) / 2;
+    return width >= 2 && height >= 2;
+}
+
+PostProcessSettings::PostProcessSettings()
+    : exposure( 0.0f ), toneMapOperator( TONEMAP_ACES_FILMIC ), transferFunction( TRANSFER_LINEAR ),
+      bloomThreshold( 1.0f ), bloomStrength( 0.5f )
+{
+}
+
+void getPostConstants( const PostProcessSettings& settings, UINT bloomLevels, cBufferPost& constants )
+{
+    constants.sourceTexelSize() = XMFLOAT2( 0.0f, 0.0f );
+    constants.targetTexelSize() = XMFLOAT2( 0.0f, 0.0f );
+    constants.bloomTexelSize() = XMFLOAT2( 0.0f, 0.0f );
+    constants.bloomThreshold() = settings.bloomThreshold;
+    constants.bloomScale() = bloomLevels > 0 ? settings.bloomStrength / bloomLevels : 0.0f;
+    constants.linearExposure() = powf( 2.0f, settings.exposure );
+    constants.toneMapOperator() = (UINT)settings.toneMapOperator;
+    constants.transferFunction() = (UINT)settings.transferFunction;
+}
+
+// * * * * * TARGETS * * * * * //
+static bool createPostTarget( ID3D11Device* pDevice, UINT width, UINT height,
+                              ID3D11Texture2D** ppTexture, ID3D11RenderTargetView** ppRTV, ID3D11ShaderResourceView** ppSRV )
+{
+    D3D11_TEXTURE2D_DESC textureDesc;
+    ZeroMemory( &textureDesc, sizeof(D3D11_TEXTURE2D_DESC) );
+
+                textureDesc.Width = width;
+                textureDesc.Height = height;
+                textureDesc.MipLevels = 1;
+                textureDesc.ArraySize = 1;
+                textureDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+                textureDesc.SampleDesc.Count = 1;
+                textureDesc.SampleDesc.Quality = 0;
+                textureDesc.Usage = D3D11_USAGE_DEFAULT;
+                textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+                textureDesc.CPUAccessFlags = 0;
+                textureDesc.MiscFlags = 0;
+
+    if ( FAILED( pDevice->CreateTexture2D( &textureDesc, NULL, ppTexture ) ) )
+        return false;
+
+    return SUCCEEDED( pDevice->CreateRenderTargetView( *ppTexture, NULL, ppRTV ) ) &&
+           SUCCEEDED( pDevice->CreateShaderResourceView( *ppTexture, NULL, ppSRV ) );
+}
+
+// * * * * * POST PROCESS * * * * * //
+PostProcess::PostProcess()
+    : width( 0 ), height( 0 ), pSceneTexture( NULL ), pSceneRTV( NULL ), pSceneSRV( NULL ),
+      pCBuffer( NULL ), pVertexShader( NULL ), pBrightPassShader( NULL ), pDownsampleShader( NULL ), pUpsampleShader( NULL ),
+      pToneMapShader( NULL ), pSamplerState( NULL ), pAddBlendState( NULL ), pRasterizerState( NULL )
+{
+    ZeroMemory( &savedViewport, sizeof(D3D11_VIEWPORT) );
+    getPostConstants( PostProcessSettings(), 0, constants );
+}
+
+bool PostProcess::init( ID3D11Device* pDevice, UINT width, UINT height, UINT bloomLevelCount )
+{
+    this->width = width;
+    this->height = height;
+
+    // * * * * * TARGETS * * * * * //
+    if ( !createPostTarget( pDevice, width, height, &pSceneTexture, &pSceneRTV, &pSceneSRV ) ) {
+        release();
+        return false;
+    }
+
+    UINT levelWidth = width, levelHeight = height;
+    for ( UINT i = 0; i < bloomLevelCount && getNextLevelSize( levelWidth, levelHeight ); i++ ) {
+        BloomLevel level;
+        ZeroMemory( &level, sizeof(BloomLevel) );
+        level.width = levelWidth;
+        level.height = levelHeight;
+
+        // In the list before it is complete, so release() frees what got created
+        bool created = createPostTarget( pDevice, levelWidth, levelHeight, &level.pTexture, &level.pRTV, &level.pSRV );
+        bloomLevels.push_back( level );
+        if ( !created ) {
+            release();
+            return false;
+        }
+    }
+
+    // * * * * * CONSTANTS + SHADERS * * * * * //
+    D3D11_BUFFER_DESC cBufferDesc;
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = sizeof( cBufferPost );
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                cBufferDesc.CPUAccessFlags = 0;
+                cBufferDesc.MiscFlags = 0;
+
+    HRESULT hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pCBuffer );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    std::string postDeclaration = getCBufferDeclaration<cBufferPost>( "cBufferPost", 0 );
+    D3D_SHADER_MACRO defines[] = {
+        { "CBUFFER_POST", postDeclaration.c_str() },
+        { NULL, NULL },
+    };
+
+    const char* entryPoints[] = { "ps_brightPass", "ps_downsample", "ps_upsample", "ps_toneMap" };
+    ID3D11PixelShader** ppPixelShaders[] = { &pBrightPassShader, &pDownsampleShader, &pUpsampleShader, &pToneMapShader };
+
+    ID3DBlob* pVertexShaderBlob = compileShader( L"postProcess.hlsl", defines, "vs_main", "vs_5_0" );
+    if ( !pVertexShaderBlob ) {
+        release();
+        return false;
+    }
+
+    hr = pDevice->CreateVertexShader( pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), NULL, &pVertexShader );
+    assert( SUCCEEDED(hr) );
+    pVertexShaderBlob->Release();
+
+    for ( UINT i = 0; i < ARRAYSIZE(entryPoints); i++ ) {
+        ID3DBlob* pPixelShaderBlob = compileShader( L"postProcess.hlsl", defines, entryPoints[i], "ps_5_0" );
+        if ( !pPixelShaderBlob ) {
+            release();
+            return false;
+        }
+
+        hr = pDevice->CreatePixelShader( pPixelShaderBlob->GetBufferPointer(), pPixelShaderBlob->GetBufferSize(), NULL, ppPixelShaders[i] );
+        assert( SUCCEEDED(hr) );
+        pPixelShaderBlob->Release();
+    }
+
+    // * * * * * STATES * * * * * //
+    // Bilinear taps never read past the edge of a level
+    D3D11_SAMPLER_DESC samplerDesc;
+    ZeroMemory( &samplerDesc, sizeof(D3D11_SAMPLER_DESC) );
+
+                samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+                samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+                samplerDesc.MinLOD = 0;
+                samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+    hr = pDevice->CreateSamplerState( &samplerDesc, &pSamplerState );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    // Upsampled levels add onto the level above
+    D3D11_BLEND_DESC blendDesc;
+    ZeroMemory( &blendDesc, sizeof( D3D11_BLEND_DESC ) );
+
+                blendDesc.RenderTarget[0].BlendEnable = TRUE;
+                blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+                blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+                blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+                blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+                blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+                blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+                blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+
+    hr = pDevice->CreateBlendState( &blendDesc, &pAddBlendState );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    D3D11_RASTERIZER_DESC rasterizerStateDesc;
+    ZeroMemory( &rasterizerStateDesc, sizeof( D3D11_RASTERIZER_DESC ) );
+
+                rasterizerStateDesc.FillMode = D3D11_FILL_SOLID;
+                rasterizerStateDesc.CullMode = D3D11_CULL_NONE;
+                rasterizerStateDesc.DepthClipEnable = TRUE;
+
+    hr = pDevice->CreateRasterizerState( &rasterizerStateDesc, &pRasterizerState );
+    if ( FAILED(hr) ) {
+        release();
+        return false;
+    }
+
+    return true;
+}
+
+void PostProcess::release()
+{
+    for ( size_t i = 0; i < bloomLevels.size(); i++ ) {
+        if ( bloomLevels[i].pSRV ) bloomLevels[i].pSRV->Release();
+        if ( bloomLevels[i].pRTV ) bloomLevels[i].pRTV->Release();
+        if ( bloomLevels[i].pTexture ) bloomLevels[i].pTexture->Release();
+    }
+    bloomLevels.clear();
+
+    if ( pSceneSRV ) pSceneSRV->Release();
+    if ( pSceneRTV ) pSceneRTV->Release();
+    if ( pSceneTexture ) pSceneTexture->Release();
+    if ( pCBuffer ) pCBuffer->Release();
+    if ( pVertexShader ) pVertexShader->Release();
+    if ( pBrightPassShader ) pBrightPassShader->Release();
+    if ( pDownsampleShader ) pDownsampleShader->Release();
+    if ( pUpsampleShader ) pUpsampleShader->Release();
+    if ( pToneMapShader ) pToneMapShader->Release();
+    if ( pSamplerState ) pSamplerState->Release();
+    if ( pAddBlendState ) pAddBlendState->Release();
+    if ( pRasterizerState ) pRasterizerState->Release();
+
+    pSceneSRV = NULL; pSceneRTV = NULL; pSceneTexture = NULL; pCBuffer = NULL;
+    pVertexShader = NULL; pBrightPassShader = NULL; pDownsampleShader = NULL; pUpsampleShader = NULL; pToneMapShader = NULL;
+    pSamplerState = NULL; pAddBlendState = NULL; pRasterizerState = NULL;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void PostProcess::render( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pOutputTarget, const PostProcessSettings& settings )
+{
+    if ( !pCBuffer )
+        return;
+
+    beginPasses( pDeviceContext );
+    brightPass( pDeviceContext, settings );
+    downsample( pDeviceContext );
+    upsample( pDeviceContext );
+    toneMap( pDeviceContext, pOutputTarget, settings );
+    endPasses( pDeviceContext );
+}
+
+void PostProcess::beginPasses( ID3D11DeviceContext* pDeviceContext )
+{
+    UINT viewportCount = 1;
+    pDeviceContext->RSGetViewports( &viewportCount, &savedViewport );
+
+    pDeviceContext->IASetInputLayout( NULL );
+    pDeviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+    pDeviceContext->VSSetShader( pVertexShader, nullptr, 0 );
+    pDeviceContext->RSSetState( pRasterizerState );
+    pDeviceContext->PSSetConstantBuffers( 0, 1, &pCBuffer );
+    pDeviceContext->PSSetSamplers( 0, 1, &pSamplerState );
+}
+
+void PostProcess::drawPass( ID3D11DeviceContext* pDeviceContext, ID3D11PixelShader* pPixelShader, ID3D11ShaderResourceView* pSource, UINT sourceWidth, UINT sourceHeight,
+                            ID3D11RenderTargetView* pTarget, UINT targetWidth, UINT targetHeight )
+{
+    constants.sourceTexelSize() = XMFLOAT2( 1.0f / sourceWidth, 1.0f / sourceHeight );
+    constants.targetTexelSize() = XMFLOAT2( 1.0f / targetWidth, 1.0f / targetHeight );
+    pDeviceContext->UpdateSubresource( pCBuffer, 0, NULL, &constants, 0, 0 );
+
+    // The last pass's source may be this pass's target: unbind it first
+    ID3D11ShaderResourceView* pNullSRV = NULL;
+    pDeviceContext->PSSetShaderResources( 0, 1, &pNullSRV );
+    pDeviceContext->OMSetRenderTargets( 1, &pTarget, NULL );
+
+    D3D11_VIEWPORT viewport;
+    ZeroMemory( &viewport, sizeof(D3D11_VIEWPORT) );
+
+                viewport.Width = (float)targetWidth;
+                viewport.Height = (float)targetHeight;
+                viewport.MinDepth = 0.0f;
+                viewport.MaxDepth = 1.0f;
+
+    pDeviceContext->RSSetViewports( 1, &viewport );
+    pDeviceContext->PSSetShader( pPixelShader, nullptr, 0 );
+    pDeviceContext->PSSetShaderResources( 0, 1, &pSource );
+    pDeviceContext->Draw( 3, 0 );
+}
+
+void PostProcess::brightPass( ID3D11DeviceContext* pDeviceContext, const PostProcessSettings& settings )
+{
+    getPostConstants( settings, (UINT)bloomLevels.size(), constants );
+    if ( bloomLevels.empty() )
+        return;
+
+    drawPass( pDeviceContext, pBrightPassShader, pSceneSRV, width, height, bloomLevels[0].pRTV, bloomLevels[0].width, bloomLevels[0].height );
+}
+
+void PostProcess::downsample( ID3D11DeviceContext* pDeviceContext )
+{
+    for ( size_t i = 1; i < bloomLevels.size(); i++ ) {
+        const BloomLevel& source = bloomLevels[i - 1];
+        drawPass( pDeviceContext, pDownsampleShader, source.pSRV, source.width, source.height, bloomLevels[i].pRTV, bloomLevels[i].width, bloomLevels[i].height );
+    }
+}
+
+void PostProcess::upsample( ID3D11DeviceContext* pDeviceContext )
+{
+    pDeviceContext->OMSetBlendState( pAddBlendState, NULL, 0xffffffff );
+
+    for ( size_t i = bloomLevels.size(); i > 1; i-- ) {
+        const BloomLevel& source = bloomLevels[i - 1];
+        const BloomLevel& target = bloomLevels[i - 2];
+        drawPass( pDeviceContext, pUpsampleShader, source.pSRV, source.width, source.height, target.pRTV, target.width, target.height );
+    }
+
+    pDeviceContext->OMSetBlendState( NULL, NULL, 0xffffffff );
+}
+
+void PostProcess::toneMap( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pOutputTarget, const PostProcessSettings& settings )
+{
+    getPostConstants( settings, (UINT)bloomLevels.size(), constants );
+
+    ID3D11ShaderResourceView* pBloomSRV = bloomLevels.empty() ? NULL : bloomLevels[0].pSRV;
+    if ( !bloomLevels.empty() )
+        constants.bloomTexelSize() = XMFLOAT2( 1.0f / bloomLevels[0].width, 1.0f / bloomLevels[0].height );
+    pDeviceContext->PSSetShaderResources( 1, 1, &pBloomSRV );
+    drawPass( pDeviceContext, pToneMapShader, pSceneSRV, width, height, pOutputTarget, width, height );
+}
+
+void PostProcess::endPasses( ID3D11DeviceContext* pDeviceContext )
+{
+    // The scene and the levels are render targets again next frame
+    ID3D11ShaderResourceView* pNullSRVs[2] = { NULL, NULL };
+    pDeviceContext->PSSetShaderResources( 0, ARRAYSIZE(pNullSRVs), pNullSRVs );
+    pDeviceContext->RSSetViewports( 1, &savedViewport );
+}
+
+// * * * * * PIXEL LANES * * * * * //
+// The CPU kernels are written once against these. An RGBA pixel fills an SSE register; with AVX2
+// (the ReleaseAVX2|x64 configuration, /arch:AVX2 brings F16C and FMA) two pixels share an AVX register and halves convert in
+// one instruction. Loads take a pointer per pixel, so filter taps and clamped edges gather freely
+struct SsePixels
+{
+    typedef __m128 Reg;
+    static const UINT pixels = 1;
+
+    static Reg loadHalf( const XMHALF4* pFirst, const XMHALF4* ) { return XMLoadHalf4( pFirst ); }
+    static void storeHalf( XMHALF4* pFirst, XMHALF4*, Reg r ) { XMStoreHalf4( pFirst, r ); }
+    static Reg loadFloat( const float* pFirst, const float* ) { return _mm_loadu_ps( pFirst ); }
+    static void storeFloat( float* p, Reg r ) { _mm_storeu_ps( p, r ); }
+
+    static Reg set( float f ) { return _mm_set1_ps( f ); }
+    static Reg add( Reg a, Reg b ) { return _mm_add_ps( a, b ); }
+    static Reg sub( Reg a, Reg b ) { return _mm_sub_ps( a, b ); }
+    static Reg mul( Reg a, Reg b ) { return _mm_mul_ps( a, b ); }
+    static Reg div( Reg a, Reg b ) { return _mm_div_ps( a, b ); }
+    static Reg madd( Reg a, Reg b, Reg c ) { return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+    static Reg min( Reg a, Reg b ) { return _mm_min_ps( a, b ); }
+    static Reg max( Reg a, Reg b ) { return _mm_max_ps( a, b ); }
+    static Reg sqrt( Reg a ) { return _mm_sqrt_ps( a ); }
+    static Reg select( Reg mask, Reg a, Reg b ) { return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) ); }
+    static Reg lessEqual( Reg a, Reg b ) { return _mm_cmple_ps( a, b ); }
+
+    // dot( rgb, Rec. 709 weights ) in all four lanes of the pixel
+    static Reg luminance( Reg r )
+    {
+        Reg weighted = _mm_mul_ps( r, _mm_set_ps( 0.0f, 0.0722f, 0.7152f, 0.2126f ) );
+        Reg sum = _mm_add_ps( weighted, _mm_shuffle_ps( weighted, weighted, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+        return _mm_add_ps( sum, _mm_shuffle_ps( sum, sum, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    }
+
+    // 0 - 1 -> R8G8B8A8, alpha 255
+    static void storeColor( UINT* p, Reg r )
+    {
+        __m128i words = _mm_cvtps_epi32( _mm_mul_ps( r, _mm_set1_ps( 255.0f ) ) );
+        words = _mm_packs_epi32( words, words );
+        *p = (UINT)_mm_cvtsi128_si32( _mm_packus_epi16( words, words ) ) | 0xFF000000;
+    }
+};
+
+#if defined(__AVX2__)
+struct AvxPixels
+{
+    typedef __m256 Reg;
+    static const UINT pixels = 2;
+
+    static Reg loadHalf( const XMHALF4* pFirst, const XMHALF4* pSecond )
+    {
+        return _mm256_cvtph_ps( _mm_unpacklo_epi64( _mm_loadl_epi64( (const __m128i*)pFirst ), _mm_loadl_epi64( (const __m128i*)pSecond ) ) );
+    }
+    static void storeHalf( XMHALF4* pFirst, XMHALF4* pSecond, Reg r )
+    {
+        __m128i halves = _mm256_cvtps_ph( r, _MM_FROUND_TO_NEAREST_INT );
+        _mm_storel_epi64( (__m128i*)pFirst, halves );
+        _mm_storel_epi64( (__m128i*)pSecond, _mm_unpackhi_epi64( halves, halves ) );
+    }
+    static Reg loadFloat( const float* pFirst, const float* pSecond )
+    {
+        return _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( pFirst ) ), _mm_loadu_ps( pSecond ), 1 );
+    }
+    static void storeFloat( float* p, Reg r ) { _mm256_storeu_ps( p, r ); }
+
+    static Reg set( float f ) { return _mm256_set1_ps( f ); }
+    static Reg add( Reg a, Reg b ) { return _mm256_add_ps( a, b ); }
+    static Reg sub( Reg a, Reg b ) { return _mm256_sub_ps( a, b ); }
+    static Reg mul( Reg a, Reg b ) { return _mm256_mul_ps( a, b ); }
+    static Reg div( Reg a, Reg b ) { return _mm256_div_ps( a, b ); }
+    static Reg madd( Reg a, Reg b, Reg c ) { return _mm256_fmadd_ps( a, b, c ); }
+    static Reg min( Reg a, Reg b ) { return _mm256_min_ps( a, b ); }
+    static Reg max( Reg a, Reg b ) { return _mm256_max_ps( a, b ); }
+    static Reg sqrt( Reg a ) { return _mm256_sqrt_ps( a ); }
+    static Reg select( Reg mask, Reg a, Reg b ) { return _mm256_blendv_ps( b, a, mask ); }
+    static Reg lessEqual( Reg a, Reg b ) { return _mm256_cmp_ps( a, b, _CMP_LE_OQ ); }
+
+    static Reg luminance( Reg r )
+    {
+        Reg weighted = _mm256_mul_ps( r, _mm256_set_ps( 0.0f, 0.0722f, 0.7152f, 0.2126f, 0.0f, 0.0722f, 0.7152f, 0.2126f ) );
+        Reg sum = _mm256_add_ps( weighted, _mm256_permute_ps( weighted, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+        return _mm256_add_ps( sum, _mm256_permute_ps( sum, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    }
+
+    static void storeColor( UINT* p, Reg r )
+    {
+        __m256i words = _mm256_cvtps_epi32( _mm256_mul_ps( r, _mm256_set1_ps( 255.0f ) ) );
+        __m128i shorts = _mm_packs_epi32( _mm256_castsi256_si128( words ), _mm256_extracti128_si256( words, 1 ) );
+        _mm_storel_epi64( (__m128i*)p, _mm_or_si128( _mm_packus_epi16( shorts, shorts ), _mm_set1_epi32( (int)0xFF000000 ) ) );
+    }
+};
+typedef AvxPixels WidePixels;
+#else
+typedef SsePixels WidePixels;
+#endif
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+static UINT clampTap( int i, UINT last )
+{
+    return (UINT)std::min( std::max( i, 0 ), (int)last );
+}
+
+// Upsampling: fine pixel x gets 3/4 of coarse pixel x / 2 and 1/4 of the coarse neighbour on its side
+static UINT getUpsampleSide( UINT x, UINT last )
+{
+    return ( x & 1 ) ? std::min( x / 2 + 1, last ) : ( x > 1 ? x / 2 - 1 : 0 );
+}
+
+// [1 3 3 1] / 8 around source pixels 2x and 2x + 1 (and 2x + 2, 2x + 3 for the second pixel)
+template<typename Pixels>
+static typename Pixels::Reg downsampleTaps( const XMHALF4* pRow, UINT last, UINT x )
+{
+    static const float weights[4] = { 0.125f, 0.375f, 0.375f, 0.125f };
+
+    typename Pixels::Reg sum = Pixels::set( 0.0f );
+    for ( int k = 0; k < 4; k++ ) {
+        int first = 2 * (int)x + k - 1;
+        sum = Pixels::madd( Pixels::loadHalf( pRow + clampTap( first, last ), pRow + clampTap( first + 2, last ) ), Pixels::set( weights[k] ), sum );
+    }
+    return sum;
+}
+
+template<typename Pixels>
+static typename Pixels::Reg upsampleTaps( const float* pRow, UINT last, UINT x )
+{
+    typename Pixels::Reg nearTaps = Pixels::loadFloat( pRow + 4 * ( x / 2 ), pRow + 4 * std::min( ( x + 1 ) / 2, last ) );
+    typename Pixels::Reg sideTaps = Pixels::loadFloat( pRow + 4 * getUpsampleSide( x, last ), pRow + 4 * getUpsampleSide( x + 1, last ) );
+    return Pixels::madd( nearTaps, Pixels::set( 0.75f ), Pixels::mul( sideTaps, Pixels::set( 0.25f ) ) );
+}
+
+// Runs [0, count) through WidePixels and the rest one pixel at a time: function( Pixels(), x )
+template<typename Function>
+static void forEachPixel( UINT count, const Function& function )
+{
+    UINT x = 0;
+    for ( ; x + WidePixels::pixels <= count; x += WidePixels::pixels )
+        function( WidePixels(), x );
+    for ( ; x < count; x++ )
+        function( SsePixels(), x );
+}
+
+// Vertical half of the upsample for fine row y: 3/4 near + 1/4 side coarse row, coarseWidth floats * 4
+static void upsampleColumns( const XMHALF4* pCoarse, UINT coarseWidth, UINT coarseHeight, UINT y, float* pRow )
+{
+    const XMHALF4* pNear = pCoarse + std::min( y / 2, coarseHeight - 1 ) * coarseWidth;
+    const XMHALF4* pSide = pCoarse + getUpsampleSide( y, coarseHeight - 1 ) * coarseWidth;
+
+    forEachPixel( coarseWidth, [&]( auto pixels, UINT x ) {
+        typedef decltype( pixels ) Pixels;
+        typename Pixels::Reg nearRow = Pixels::loadHalf( pNear + x, pNear + x + 1 );
+        typename Pixels::Reg sideRow = Pixels::loadHalf( pSide + x, pSide + x + 1 );
+        Pixels::storeFloat( pRow + 4 * x, Pixels::madd( nearRow, Pixels::set( 0.75f ), Pixels::mul( sideRow, Pixels::set( 0.25f ) ) ) );
+    } );
+}
+
+template<typename Function>
+static void forEachTile( UINT rows, JobSystem* pJobSystem, const Function& function )
+{
+    if ( pJobSystem )
+        pJobSystem->parallelFor( rows, postTileRows, function );
+    else
+        function( 0, rows );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+// Source -> target (half size), horizontal taps into float rows, then the vertical taps.
+// threshold >= 0 makes it the bright pass
+static void downsampleLevel( const XMHALF4* pSource, UINT sourceWidth, UINT sourceHeight,
+                             XMHALF4* pTarget, UINT targetWidth, UINT targetHeight, float threshold, JobSystem* pJobSystem )
+{
+    forEachTile( targetHeight, pJobSystem, [&]( UINT begin, UINT end ) {
+        // A target row reads 4 consecutive source rows, ring slot = row & 3, so every row is filtered once per tile
+        std::vector<float> rows( 4 * targetWidth * 4 );
+        int rowTags[4] = { -1, -1, -1, -1 };
+
+        for ( UINT y = begin; y < end; y++ ) {
+            const float* ppRows[4];
+            for ( int k = 0; k < 4; k++ ) {
+                int row = 2 * (int)y + k - 1;
+                UINT slot = (UINT)( row + 4 ) & 3;
+                UINT sourceY = clampTap( row, sourceHeight - 1 );
+                float* pSlot = rows.data() + slot * targetWidth * 4;
+
+                if ( rowTags[slot] != (int)sourceY ) {
+                    const XMHALF4* pRow = pSource + sourceY * sourceWidth;
+                    forEachPixel( targetWidth, [&]( auto pixels, UINT x ) {
+                        typedef decltype( pixels ) Pixels;
+                        Pixels::storeFloat( pSlot + 4 * x, downsampleTaps<Pixels>( pRow, sourceWidth - 1, x ) );
+                    } );
+                    rowTags[slot] = (int)sourceY;
+                }
+                ppRows[k] = pSlot;
+            }
+
+            XMHALF4* pOut = pTarget + y * targetWidth;
+            forEachPixel( targetWidth, [&]( auto pixels, UINT x ) {
+                typedef decltype( pixels ) Pixels;
+                typedef typename Pixels::Reg Reg;
+
+                const float* p0 = ppRows[0] + 4 * x, * p1 = ppRows[1] + 4 * x, * p2 = ppRows[2] + 4 * x, * p3 = ppRows[3] + 4 * x;
+                Reg sum = Pixels::mul( Pixels::add( Pixels::loadFloat( p0, p0 + 4 ), Pixels::loadFloat( p3, p3 + 4 ) ), Pixels::set( 0.125f ) );
+                sum = Pixels::madd( Pixels::add( Pixels::loadFloat( p1, p1 + 4 ), Pixels::loadFloat( p2, p2 + 4 ) ), Pixels::set( 0.375f ), sum );
+
+                // Bright pass: only the luminance above the threshold, same as ps_brightPass
+                if ( threshold >= 0.0f ) {
+                    Reg luminance = Pixels::luminance( sum );
+                    Reg above = Pixels::max( Pixels::sub( luminance, Pixels::set( threshold ) ), Pixels::set( 0.0f ) );
+                    sum = Pixels::mul( sum, Pixels::div( above, Pixels::max( luminance, Pixels::set( 0.0001f ) ) ) );
+                }
+
+                Pixels::storeHalf( pOut + x, pOut + x + 1, sum );
+            } );
+        }
+    } );
+}
+
+// Fine += 2x upsample of coarse
+static void upsampleLevel( const XMHALF4* pCoarse, UINT coarseWidth, UINT coarseHeight,
+                           XMHALF4* pFine, UINT fineWidth, UINT fineHeight, JobSystem* pJobSystem )
+{
+    forEachTile( fineHeight, pJobSystem, [&]( UINT begin, UINT end ) {
+        std::vector<float> row( coarseWidth * 4 );
+
+        for ( UINT y = begin; y < end; y++ ) {
+            upsampleColumns( pCoarse, coarseWidth, coarseHeight, y, row.data() );
+
+            XMHALF4* pOut = pFine + y * fineWidth;
+            forEachPixel( fineWidth, [&]( auto pixels, UINT x ) {
+                typedef decltype( pixels ) Pixels;
+                typename Pixels::Reg up = upsampleTaps<Pixels>( row.data(), coarseWidth - 1, x );
+                Pixels::storeHalf( pOut + x, pOut + x + 1, Pixels::add( Pixels::loadHalf( pOut + x, pOut + x + 1 ), up ) );
+            } );
+        }
+    } );
+}
+
+// - - - tone map operators, the same as ps_toneMap - - - //
+template<typename Pixels, ToneMapOperator Operator, TransferFunction Transfer>
+static typename Pixels::Reg toneMapColor( typename Pixels::Reg color )
+{
+    typedef typename Pixels::Reg Reg;
+    const Reg zero = Pixels::set( 0.0f ), one = Pixels::set( 1.0f );
+    color = Pixels::max( color, zero );
+
+    if ( Operator == TONEMAP_REINHARD ) {
+        color = Pixels::div( color, Pixels::add( color, one ) );
+    }
+    else if ( Operator == TONEMAP_ACES_FILMIC ) {
+        Reg numerator = Pixels::mul( color, Pixels::madd( color, Pixels::set( 2.51f ), Pixels::set( 0.03f ) ) );
+        Reg denominator = Pixels::madd( color, Pixels::madd( color, Pixels::set( 2.43f ), Pixels::set( 0.59f ) ), Pixels::set( 0.14f ) );
+        color = Pixels::div( numerator, denominator );
+    }
+    color = Pixels::min( color, one );
+
+    // sRGB: linear segment, square root fit above it
+    if ( Transfer == TRANSFER_SRGB ) {
+        Reg s1 = Pixels::sqrt( color ), s2 = Pixels::sqrt( s1 ), s3 = Pixels::sqrt( s2 );
+        Reg curve = Pixels::mul( s1, Pixels::set( 0.662002687f ) );
+        curve = Pixels::madd( s2, Pixels::set( 0.684122060f ), curve );
+        curve = Pixels::madd( s3, Pixels::set( -0.323583601f ), curve );
+        curve = Pixels::madd( color, Pixels::set( -0.0225411470f ), curve );
+        Reg linear = Pixels::mul( color, Pixels::set( 12.92f ) );
+        color = Pixels::min( Pixels::max( Pixels::select( Pixels::lessEqual( color, Pixels::set( 0.0031308f ) ), linear, curve ), zero ), one );
+    }
+    return color;
+}
+
+template<ToneMapOperator Operator, TransferFunction Transfer>
+static void toneMapRow( const XMHALF4* pHdr, const float* pBloom, UINT bloomLast, float bloomScale, float exposure, UINT width, UINT* pOut )
+{
+    forEachPixel( width, [&]( auto pixels, UINT x ) {
+        typedef decltype( pixels ) Pixels;
+        typedef typename Pixels::Reg Reg;
+
+        Reg color = Pixels::loadHalf( pHdr + x, pHdr + x + 1 );
+        if ( pBloom )
+            color = Pixels::madd( upsampleTaps<Pixels>( pBloom, bloomLast, x ), Pixels::set( bloomScale ), color );
+
+        Pixels::storeColor( pOut + x, toneMapColor<Pixels, Operator, Transfer>( Pixels::mul( color, Pixels::set( exposure ) ) ) );
+    } );
+}
+
+typedef void (*ToneMapRowFunction)( const XMHALF4* pHdr, const float* pBloom, UINT bloomLast, float bloomScale, float exposure, UINT width, UINT* pOut );
+
+// [operator][transfer]
+static const ToneMapRowFunction toneMapRows[TONEMAP_OPERATOR_COUNT][2] = {
+    { toneMapRow<TONEMAP_SATURATE, TRANSFER_LINEAR>, toneMapRow<TONEMAP_SATURATE, TRANSFER_SRGB> },
+    { toneMapRow<TONEMAP_REINHARD, TRANSFER_LINEAR>, toneMapRow<TONEMAP_REINHARD, TRANSFER_SRGB> },
+    { toneMapRow<TONEMAP_ACES_FILMIC, TRANSFER_LINEAR>, toneMapRow<TONEMAP_ACES_FILMIC, TRANSFER_SRGB> },
+};
+
+// * * * * * CPU POST PROCESS * * * * * //
+SoftwarePostProcess::SoftwarePostProcess()
+    : width( 0 ), height( 0 )
+{
+    ZeroMemory( &stats, sizeof(PostProcessStats) );
+}
+
+void SoftwarePostProcess::resize( UINT width, UINT height, UINT bloomLevels )
+{
+    this->width = width;
+    this->height = height;
+    levels.clear();
+
+    UINT levelWidth = width, levelHeight = height;
+    for ( UINT i = 0; i < bloomLevels && getNextLevelSize( levelWidth, levelHeight ); i++ ) {
+        Level level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.pixels.resize( levelWidth * levelHeight );
+        levels.push_back( std::move( level ) );
+    }
+}
+
+void SoftwarePostProcess::process( const XMHALF4* pHdr, const PostProcessSettings& settings, UINT* pOutput, JobSystem* pJobSystem )
+{
+    Timer totalTimer, passTimer;
+    ZeroMemory( &stats, sizeof(PostProcessStats) );
+    stats.threads = pJobSystem ? pJobSystem->getThreadCount() : 1;
+
+    // - - - bright pass + downsample chain - - - //
+    if ( !levels.empty() )
+        downsampleLevel( pHdr, width, height, levels[0].pixels.data(), levels[0].width, levels[0].height, std::max( settings.bloomThreshold, 0.0f ), pJobSystem );
+    stats.brightPassMs = passTimer.elapsedMs();
+
+    passTimer.reset();
+    for ( size_t i = 1; i < levels.size(); i++ ) {
+        const Level& source = levels[i - 1];
+        downsampleLevel( source.pixels.data(), source.width, source.height, levels[i].pixels.data(), levels[i].width, levels[i].height, -1.0f, pJobSystem );
+    }
+    stats.downsampleMs = passTimer.elapsedMs();
+
+    // - - - upsample chain - - - //
+    passTimer.reset();
+    for ( size_t i = levels.size(); i > 1; i-- ) {
+        const Level& source = levels[i - 1];
+        Level& target = levels[i - 2];
+        upsampleLevel( source.pixels.data(), source.width, source.height, target.pixels.data(), target.width, target.height, pJobSystem );
+    }
+    stats.upsampleMs = passTimer.elapsedMs();
+
+    // - - - tone map, bloom level 0 upsampled on the fly - - - //
+    passTimer.reset();
+    cBufferPost constants;
+    getPostConstants( settings, (UINT)levels.size(), constants );
+    ToneMapRowFunction toneMap = toneMapRows[std::min( (UINT)settings.toneMapOperator, (UINT)TONEMAP_OPERATOR_COUNT - 1 )][settings.transferFunction == TRANSFER_SRGB ? 1 : 0];
+
+    forEachTile( height, pJobSystem, [&]( UINT begin, UINT end ) {
+        const Level* pBloom = levels.empty() ? NULL : &levels[0];
+        std::vector<float> bloomRow( pBloom ? pBloom->width * 4 : 0 );
+
+        for ( UINT y = begin; y < end; y++ ) {
+            if ( pBloom )
+                upsampleColumns( pBloom->pixels.data(), pBloom->width, pBloom->height, y, bloomRow.data() );
+
+            toneMap( pHdr + y * width, pBloom ? bloomRow.data() : NULL, pBloom ? pBloom->width - 1 : 0,
+                     constants.bloomScale(), constants.linearExposure(), width, pOutput + y * width );
+        }
+    } );
+    stats.toneMapMs = passTimer.elapsedMs();
+    stats.totalMs = totalTimer.elapsedMs();
+}
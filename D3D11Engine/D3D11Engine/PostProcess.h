@@ -0,0 +1,173 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "CBufferLayout.h"
+#include "JobSystem.h"
+#include "Timer.h"
+
+// Constants of the post passes (postProcess.hlsl, b0)
+#define POST_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMFLOAT2, sourceTexelSize )         /* 1 / size of the texture the pass reads */ \
+    FIELD( DirectX::XMFLOAT2, targetTexelSize )         /* 1 / size of the target */ \
+    FIELD( float, bloomThreshold ) \
+    FIELD( float, bloomScale )                          /* bloomStrength / levels */ \
+    FIELD( DirectX::XMFLOAT2, bloomTexelSize )          /* tone map: 1 / size of bloom level 0 */ \
+    FIELD( float, linearExposure )                      /* 2^exposure */ \
+    FIELD( UINT, toneMapOperator ) \
+    FIELD( UINT, transferFunction )
+DECLARE_CBUFFER( cBufferPost, POST_CBUFFER_FIELDS )
+
+// The operators of DirectXTK's ToneMapPostProcess
+enum ToneMapOperator
+{
+    TONEMAP_SATURATE,           // clip at 1, what writing straight into the back buffer did
+    TONEMAP_REINHARD,           // x / ( 1 + x )
+    TONEMAP_ACES_FILMIC,        // Narkowicz's fit of the ACES filmic curve
+    TONEMAP_OPERATOR_COUNT,
+};
+
+enum TransferFunction
+{
+    TRANSFER_LINEAR,            // linear values into the UNORM back buffer, how the scene was tuned
+    TRANSFER_SRGB,              // sRGB encoded (sqrt based fit, same on CPU and GPU)
+};
+
+struct PostProcessSettings
+{
+    PostProcessSettings();
+
+    float exposure;                     // stops, the scene is scaled by 2^exposure before tone mapping
+    ToneMapOperator toneMapOperator;
+    TransferFunction transferFunction;
+    float bloomThreshold;               // luminance above this blooms
+    float bloomStrength;                // average of the bloom levels added to the scene, 0 = no bloom
+};
+
+// Timings of the last SoftwarePostProcess::process
+struct PostProcessStats
+{
+    double brightPassMs;                // threshold + downsample to level 0
+    double downsampleMs;                // the other levels
+    double upsampleMs;
+    double toneMapMs;
+    double totalMs;
+    UINT threads;
+};
+
+// * * * HDR post chain * * * //
+// The scene renders into an R16G16B16A16_FLOAT target instead of the back buffer, so the dynamic
+// light above 1 survives until the end of the frame. The chain then runs:
+//
+//     bright pass     scene -> bloom level 0 (half size), luminance above bloomThreshold is kept
+//     downsample      level i -> level i + 1, half size each
+//     upsample        smallest level back up: every level adds the 2x upsample of the one below
+//     tone map        ( scene + bloom level 0 * bloomScale ) * 2^exposure -> operator -> transfer
+//                     -> back buffer
+//
+// Both filters are separable: downsampling is [1 3 3 1] / 8 per axis (4 bilinear taps 0.75 source
+// texels out on the GPU), upsampling the 2x tent [1/4 3/4] (one bilinear tap). Levels round odd sizes
+// up, so both sides map target pixel x to source texels 2x - 1 .. 2x + 2 and x / 2 by index, not by the
+// size ratio. SoftwarePostProcess runs the same chain on the CPU. t0 = source, t1 = bloom (tone map), s0 = linear clamp.
+class PostProcess
+{
+public:
+    PostProcess();
+
+    // Scene target of width x height and bloomLevels levels below it (fewer if they would get smaller than 2 x 2)
+    bool init( ID3D11Device* pDevice, UINT width, UINT height, UINT bloomLevels );
+    void release();
+
+    // Render the scene into this instead of the back buffer
+    ID3D11RenderTargetView* getSceneTarget() const { return pSceneRTV; }
+
+    // The whole chain into pOutputTarget (the back buffer, width x height). Changes input layout,
+    // shaders, sampler s0, blend and rasterizer state; the viewport is restored and the scene
+    // target unbound from the pixel shader afterwards
+    void render( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pOutputTarget, const PostProcessSettings& settings );
+
+    // The passes of render one by one, for timing them. beginPasses sets the shared state,
+    // endPasses restores the viewport and unbinds the sources
+    void beginPasses( ID3D11DeviceContext* pDeviceContext );
+    void brightPass( ID3D11DeviceContext* pDeviceContext, const PostProcessSettings& settings );
+    void downsample( ID3D11DeviceContext* pDeviceContext );
+    void upsample( ID3D11DeviceContext* pDeviceContext );
+    void toneMap( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pOutputTarget, const PostProcessSettings& settings );
+    void endPasses( ID3D11DeviceContext* pDeviceContext );
+
+    UINT getBloomLevels() const { return (UINT)bloomLevels.size(); }
+
+private:
+    struct BloomLevel
+    {
+        UINT width, height;
+        ID3D11Texture2D* pTexture;
+        ID3D11RenderTargetView* pRTV;
+        ID3D11ShaderResourceView* pSRV;
+    };
+
+    // Draws the full screen triangle from pSource into pTarget (sourceWidth / Height for the constants)
+    void drawPass( ID3D11DeviceContext* pDeviceContext, ID3D11PixelShader* pPixelShader, ID3D11ShaderResourceView* pSource, UINT sourceWidth, UINT sourceHeight,
+                   ID3D11RenderTargetView* pTarget, UINT targetWidth, UINT targetHeight );
+
+    UINT width, height;
+    cBufferPost constants;
+
+    // - - - targets - - - //
+    ID3D11Texture2D* pSceneTexture;
+    ID3D11RenderTargetView* pSceneRTV;
+    ID3D11ShaderResourceView* pSceneSRV;
+    std::vector<BloomLevel> bloomLevels;
+
+    // - - - passes - - - //
+    ID3D11Buffer* pCBuffer;
+    ID3D11VertexShader* pVertexShader;
+    ID3D11PixelShader* pBrightPassShader, * pDownsampleShader, * pUpsampleShader, * pToneMapShader;
+    ID3D11SamplerState* pSamplerState;
+    ID3D11BlendState* pAddBlendState;
+    ID3D11RasterizerState* pRasterizerState;
+    D3D11_VIEWPORT savedViewport;
+};
+
+// * * * CPU post chain * * * //
+// Same passes and filters over an XMHALF4 image, R8G8B8A8 out. Levels are XMHALF4 as on the GPU.
+// Rows are split into tiles for the job system; the kernels convert halves with F16C and work on
+// two RGBA pixels per AVX register when the build has AVX2 (ReleaseAVX2|x64), one pixel per SSE
+// register otherwise. Separable filters go through one float row per source row and tile
+class SoftwarePostProcess
+{
+public:
+    SoftwarePostProcess();
+
+    void resize( UINT width, UINT height, UINT bloomLevels );
+
+    // pHdr: width * height, pOutput: width * height R8G8B8A8 (red in the low byte)
+    void process( const DirectX::PackedVector::XMHALF4* pHdr, const PostProcessSettings& settings, UINT* pOutput, JobSystem* pJobSystem = NULL );
+
+    UINT getBloomLevels() const { return (UINT)levels.size(); }
+    const PostProcessStats& getStats() const { return stats; }
+
+private:
+    struct Level
+    {
+        UINT width, height;
+        std::vector<DirectX::PackedVector::XMHALF4> pixels;
+    };
+
+    UINT width, height;
+    std::vector<Level> levels;
+    PostProcessStats stats;
+};
+
+// Constants of render / process, bloomLevels for bloomScale
+void getPostConstants( const PostProcessSettings& settings, UINT bloomLevels, cBufferPost& constants );
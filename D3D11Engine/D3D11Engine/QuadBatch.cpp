@@ -0,0 +1,373 @@
+#include "QuadBatch.h"
+
+#include <math.h>
+#include <assert.h>
+
+QuadBatch::QuadBatch()
+    : pDevice( NULL ), pDeviceContext( NULL ), pTextureArrays( NULL ),
+      pVertexBuffer( NULL ), pIndexBuffer( NULL ), pCBuffer( NULL ), pInputLayout( NULL ),
+      pVertexShader( NULL ), pPixelShader( NULL ), pBlendState( NULL ), pDepthStencilState( NULL ),
+      pRasterizerState( NULL ), pSamplerState( NULL ),
+      vertexBufferPosition( 0 ), inBeginEnd( false ), sortMode( SORT_TEXTURE )
+{
+    ZeroMemory( &stats, sizeof(Stats) );
+    DirectX::XMStoreFloat4x4( &transform, DirectX::XMMatrixIdentity() );
+}
+
+bool QuadBatch::init( ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, TextureArrayManager* pTextureArrays )
+{
+    this->pDevice = pDevice;
+    this->pDeviceContext = pDeviceContext;
+    this->pTextureArrays = pTextureArrays;
+
+    // * * * * * VERTEX- AND PIXEL-SHADER * * * * * //
+    ID3DBlob* pVertexShaderBlob = NULL, * pPixelShaderBlob = NULL, * pErrorBlob = NULL;
+
+    std::string quadDeclaration = getCBufferDeclaration<cBufferQuad>( "cBufferQuad", 0 );
+    D3D_SHADER_MACRO defines[] = {
+        { "CBUFFER_QUAD", quadDeclaration.c_str() },
+        { NULL, NULL },
+    };
+
+    HRESULT hr = D3DCompileFromFile( L"quadVertexShader.hlsl", defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, "vs_main", "vs_5_0", NULL, NULL, &pVertexShaderBlob, &pErrorBlob );
+    if ( FAILED(hr) ) {
+        if ( pErrorBlob ) {
+            OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
+            pErrorBlob->Release();
+        }
+        return false;
+    }
+
+    hr = D3DCompileFromFile( L"quadPixelShader.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "ps_main", "ps_5_0", NULL, NULL, &pPixelShaderBlob, &pErrorBlob );
+    if ( FAILED(hr) ) {
+        if ( pErrorBlob ) {
+            OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
+            pErrorBlob->Release();
+        }
+        pVertexShaderBlob->Release();
+        return false;
+    }
+
+    hr = pDevice->CreateVertexShader( pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), NULL, &pVertexShader );
+    assert( SUCCEEDED(hr) );
+
+    hr = pDevice->CreatePixelShader( pPixelShaderBlob->GetBufferPointer(), pPixelShaderBlob->GetBufferSize(), NULL, &pPixelShader );
+    assert( SUCCEEDED(hr) );
+
+    // * * * * * INPUT LAYOUT * * * * * //
+    D3D11_INPUT_ELEMENT_DESC inputElementDesc[] = {
+              { "POS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "SLICE", 0, DXGI_FORMAT_R32_UINT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "COL", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+
+    hr = pDevice->CreateInputLayout( inputElementDesc, ARRAYSIZE(inputElementDesc), pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), &pInputLayout );
+    assert( SUCCEEDED(hr) );
+
+    pVertexShaderBlob->Release();
+    pPixelShaderBlob->Release();
+
+    // * * * * * DYNAMIC VERTEX BUFFER * * * * * //
+    D3D11_BUFFER_DESC vertexBufferDesc;
+    ZeroMemory( &vertexBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+                vertexBufferDesc.ByteWidth = sizeof(QuadVertex) * 4 * vertexBufferQuads;
+                vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+                vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+                vertexBufferDesc.MiscFlags = 0;
+
+    hr = pDevice->CreateBuffer( &vertexBufferDesc, NULL, &pVertexBuffer );
+    assert( SUCCEEDED(hr) );
+
+    // * * * * * STATIC INDEX BUFFER (0 1 2, 0 2 3 per quad) * * * * * //
+    std::vector<USHORT> indices( maxQuadsPerDraw * 6 );
+    for ( UINT i = 0; i < maxQuadsPerDraw; i++ ) {
+        USHORT base = (USHORT)( i * 4 );
+        indices[i * 6 + 0] = base + 0;
+        indices[i * 6 + 1] = base + 1;
+        indices[i * 6 + 2] = base + 2;
+        indices[i * 6 + 3] = base + 0;
+        indices[i * 6 + 4] = base + 2;
+        indices[i * 6 + 5] = base + 3;
+    }
+
+    D3D11_BUFFER_DESC indexBufferDesc;
+    ZeroMemory( &indexBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+                indexBufferDesc.ByteWidth = (UINT)( sizeof(USHORT) * indices.size() );
+                indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+                indexBufferDesc.CPUAccessFlags = 0;
+                indexBufferDesc.MiscFlags = 0;
+
+    D3D11_SUBRESOURCE_DATA indexBufferData;
+    ZeroMemory( &indexBufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                indexBufferData.pSysMem = indices.data();
+
+    hr = pDevice->CreateBuffer( &indexBufferDesc, &indexBufferData, &pIndexBuffer );
+    assert( SUCCEEDED(hr) );
+
+    // * * * * * CONSTANT BUFFER (transform) * * * * * //
+    D3D11_BUFFER_DESC cBufferDesc;
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = sizeof( cBufferQuad );
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                cBufferDesc.CPUAccessFlags = 0;
+                cBufferDesc.MiscFlags = 0;
+
+    hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pCBuffer );
+    assert( SUCCEEDED(hr) );
+
+    // * * * * * STATES - alpha blend, no depth, no culling * * * * * //
+    D3D11_BLEND_DESC blendDesc;
+    ZeroMemory( &blendDesc, sizeof(D3D11_BLEND_DESC) );
+
+                blendDesc.RenderTarget[0].BlendEnable = true;
+                blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+                blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+                blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+                blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+                blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+                blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+                blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+
+    hr = pDevice->CreateBlendState( &blendDesc, &pBlendState );
+    assert( SUCCEEDED(hr) );
+
+    D3D11_DEPTH_STENCIL_DESC depthStencilStateDesc;
+    ZeroMemory( &depthStencilStateDesc, sizeof(D3D11_DEPTH_STENCIL_DESC) );
+
+                depthStencilStateDesc.DepthEnable = false;
+                depthStencilStateDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+                depthStencilStateDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+
+    hr = pDevice->CreateDepthStencilState( &depthStencilStateDesc, &pDepthStencilState );
+    assert( SUCCEEDED(hr) );
+
+    D3D11_RASTERIZER_DESC rasterizerStateDesc;
+    ZeroMemory( &rasterizerStateDesc, sizeof(D3D11_RASTERIZER_DESC) );
+
+                rasterizerStateDesc.FillMode = D3D11_FILL_SOLID;
+                rasterizerStateDesc.CullMode = D3D11_CULL_NONE;
+                rasterizerStateDesc.DepthClipEnable = true;
+
+    hr = pDevice->CreateRasterizerState( &rasterizerStateDesc, &pRasterizerState );
+    assert( SUCCEEDED(hr) );
+
+    D3D11_SAMPLER_DESC samplerDesc;
+    ZeroMemory( &samplerDesc, sizeof(D3D11_SAMPLER_DESC) );
+
+                samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+                samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+                samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+                samplerDesc.MinLOD = 0;
+                samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+    hr = pDevice->CreateSamplerState( &samplerDesc, &pSamplerState );
+    assert( SUCCEEDED(hr) );
+
+    quads.reserve( maxQuadsPerDraw );
+    return true;
+}
+
+void QuadBatch::release()
+{
+    if ( pSamplerState ) pSamplerState->Release();
+    if ( pRasterizerState ) pRasterizerState->Release();
+    if ( pDepthStencilState ) pDepthStencilState->Release();
+    if ( pBlendState ) pBlendState->Release();
+    if ( pCBuffer ) pCBuffer->Release();
+    if ( pIndexBuffer ) pIndexBuffer->Release();
+    if ( pVertexBuffer ) pVertexBuffer->Release();
+    if ( pInputLayout ) pInputLayout->Release();
+    if ( pPixelShader ) pPixelShader->Release();
+    if ( pVertexShader ) pVertexShader->Release();
+
+    pSamplerState = NULL; pRasterizerState = NULL; pDepthStencilState = NULL; pBlendState = NULL;
+    pCBuffer = NULL; pIndexBuffer = NULL; pVertexBuffer = NULL; pInputLayout = NULL;
+    pPixelShader = NULL; pVertexShader = NULL;
+}
+
+void QuadBatch::begin( SortMode sortMode, DirectX::FXMMATRIX transform )
+{
+    assert( !inBeginEnd );
+    inBeginEnd = true;
+
+    this->sortMode = sortMode;
+    DirectX::XMStoreFloat4x4( &this->transform, transform );
+
+    quads.clear();
+    ZeroMemory( &stats, sizeof(Stats) );
+}
+
+void QuadBatch::draw( TextureID texture, const DirectX::XMFLOAT2& position, const DirectX::XMFLOAT2& size,
+                      float rotation, const DirectX::XMFLOAT4& color, float depth )
+{
+    assert( inBeginEnd );
+
+    QuadInfo quad;
+    if ( !pTextureArrays->useTexture( texture, quad.slot ) )
+        return;
+
+    quad.position = position;
+    quad.size = size;
+    quad.rotation = rotation;
+    quad.depth = depth;
+
+    // Pack RGBA8 once here instead of once per vertex
+    UINT r = (UINT)( color.x * 255.0f + 0.5f ) & 0xFF;
+    UINT g = (UINT)( color.y * 255.0f + 0.5f ) & 0xFF;
+    UINT b = (UINT)( color.z * 255.0f + 0.5f ) & 0xFF;
+    UINT a = (UINT)( color.w * 255.0f + 0.5f ) & 0xFF;
+    quad.color = r | ( g << 8 ) | ( b << 16 ) | ( a << 24 );
+
+    quads.push_back( quad );
+    stats.quadCount++;
+}
+
+void QuadBatch::end()
+{
+    assert( inBeginEnd );
+    inBeginEnd = false;
+
+    if ( quads.empty() )
+        return;
+
+    prepareForRendering();
+
+    const QuadInfo* pQuads = quads.data();
+    if ( sortMode == SORT_TEXTURE ) {
+        sortQuads();
+        pQuads = sortedQuads.data();
+    }
+
+    // Flush each run of quads that share a texture array
+    UINT count = (UINT)quads.size();
+    UINT runStart = 0;
+    for ( UINT i = 1; i <= count; i++ ) {
+        if ( i == count || pQuads[i].slot.arrayIndex != pQuads[runStart].slot.arrayIndex ) {
+            flush( pQuads + runStart, i - runStart );
+            runStart = i;
+        }
+    }
+}
+
+void QuadBatch::sortQuads()
+{
+    // Counting sort on the array index, there are only a handful of arrays so this is O(n)
+    UINT arrayCount = pTextureArrays->getArrayCount();
+    arrayCounts.assign( arrayCount + 1, 0 );
+
+    for ( size_t i = 0; i < quads.size(); i++ )
+        arrayCounts[quads[i].slot.arrayIndex + 1]++;
+
+    for ( UINT a = 1; a <= arrayCount; a++ )
+        arrayCounts[a] += arrayCounts[a - 1];
+
+    sortedQuads.resize( quads.size() );
+    for ( size_t i = 0; i < quads.size(); i++ )
+        sortedQuads[arrayCounts[quads[i].slot.arrayIndex]++] = quads[i];
+}
+
+void QuadBatch::prepareForRendering()
+{
+    cBufferQuad constants;
+    DirectX::XMStoreFloat4x4( &constants.transform(), DirectX::XMMatrixTranspose( DirectX::XMLoadFloat4x4( &transform ) ) );
+    pDeviceContext->UpdateSubresource( pCBuffer, 0, NULL, &constants, 0, 0 );
+
+    UINT stride = sizeof(QuadVertex);
+    UINT offset = 0;
+
+    pDeviceContext->IASetInputLayout( pInputLayout );
+    pDeviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+    pDeviceContext->IASetVertexBuffers( 0, 1, &pVertexBuffer, &stride, &offset );
+    pDeviceContext->IASetIndexBuffer( pIndexBuffer, DXGI_FORMAT_R16_UINT, 0 );
+
+    pDeviceContext->VSSetShader( pVertexShader, nullptr, 0 );
+    pDeviceContext->VSSetConstantBuffers( 0, 1, &pCBuffer );
+    pDeviceContext->PSSetShader( pPixelShader, nullptr, 0 );
+    pDeviceContext->PSSetSamplers( 0, 1, &pSamplerState );
+
+    float blendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    pDeviceContext->OMSetBlendState( pBlendState, blendFactor, 0xFFFFFFFF );
+    pDeviceContext->OMSetDepthStencilState( pDepthStencilState, 0 );
+    pDeviceContext->RSSetState( pRasterizerState );
+}
+
+void QuadBatch::flush( const QuadInfo* pQuads, UINT count )
+{
+    ID3D11ShaderResourceView* pSRV = pTextureArrays->getSRV( pQuads[0].slot.arrayIndex );
+    pDeviceContext->PSSetShaderResources( 0, 1, &pSRV );
+
+    while ( count > 0 ) {
+        // Wrap around when the buffer is full, DISCARD gives us a fresh buffer without stalling
+        if ( vertexBufferPosition >= vertexBufferQuads ) {
+            vertexBufferPosition = 0;
+        }
+
+        D3D11_MAP mapType = ( vertexBufferPosition == 0 ) ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+        if ( mapType == D3D11_MAP_WRITE_DISCARD )
+            stats.discards++;
+
+        UINT batchSize = count;
+        if ( batchSize > maxQuadsPerDraw )
+            batchSize = maxQuadsPerDraw;
+        if ( batchSize > vertexBufferQuads - vertexBufferPosition )
+            batchSize = vertexBufferQuads - vertexBufferPosition;
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        HRESULT hr = pDeviceContext->Map( pVertexBuffer, 0, mapType, 0, &mapped );
+        if ( FAILED(hr) )
+            return;
+
+        // Write-combined memory - write sequentially, never read back
+        QuadVertex* pVertices = (QuadVertex*)mapped.pData + vertexBufferPosition * 4;
+        for ( UINT i = 0; i < batchSize; i++ )
+            writeQuad( pQuads[i], pVertices + i * 4 );
+
+        pDeviceContext->Unmap( pVertexBuffer, 0 );
+
+        pDeviceContext->DrawIndexed( batchSize * 6, 0, vertexBufferPosition * 4 );
+        stats.drawCalls++;
+
+        vertexBufferPosition += batchSize;
+        pQuads += batchSize;
+        count -= batchSize;
+    }
+}
+
+void QuadBatch::writeQuad( const QuadInfo& quad, QuadVertex* pVertices ) const
+{
+    float halfW = quad.size.x * 0.5f;
+    float halfH = quad.size.y * 0.5f;
+
+    // Corner offsets in the same order as the scene quad: bottom-left, top-left, top-right, bottom-right
+    float cornerX[4] = { -halfW, -halfW, halfW, halfW };
+    float cornerY[4] = { -halfH, halfH, halfH, -halfH };
+    const float cornerU[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+    const float cornerV[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
+
+    float cosR = 1.0f, sinR = 0.0f;
+    if ( quad.rotation != 0.0f ) {
+        cosR = cosf( quad.rotation );
+        sinR = sinf( quad.rotation );
+    }
+
+    for ( int c = 0; c < 4; c++ ) {
+        QuadVertex& v = pVertices[c];
+        v.pos.x = quad.position.x + cornerX[c] * cosR - cornerY[c] * sinR;
+        v.pos.y = quad.position.y + cornerX[c] * sinR + cornerY[c] * cosR;
+        v.pos.z = quad.depth;
+        v.texcoord.x = cornerU[c];
+        v.texcoord.y = cornerV[c];
+        v.slice = quad.slot.slice;
+        v.color = quad.color;
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "CBufferLayout.h"
+#include "TextureArray.h"
+
+// Constants of quadVertexShader.hlsl (b0)
+#define QUAD_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMFLOAT4X4, transform )             /* quad space -> clip space, transposed */
+DECLARE_CBUFFER( cBufferQuad, QUAD_CBUFFER_FIELDS )
+
+// * * * Immediate mode batcher for textured quads * * * //
+// begin() / draw() ... / end(). Quads are collected on the CPU, grouped by texture array
+// (quads in different slices of the same array share a batch) and streamed into one
+// dynamic vertex buffer that is appended to with MAP_WRITE_NO_OVERWRITE and only
+// discarded when it wraps around. The index buffer is static.
+class QuadBatch
+{
+public:
+    enum SortMode
+    {
+        SORT_DEFERRED,  // keep submission order, flush whenever the texture array changes
+        SORT_TEXTURE,   // group all quads by texture array, fewest possible draws
+    };
+
+    // Counters since the last begin()
+    struct Stats
+    {
+        UINT quadCount;
+        UINT drawCalls;
+        UINT discards;  // times the vertex buffer wrapped around
+    };
+
+    QuadBatch();
+
+    bool init( ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, TextureArrayManager* pTextureArrays );
+    void release();
+
+    void begin( SortMode sortMode = SORT_TEXTURE, DirectX::FXMMATRIX transform = DirectX::XMMatrixIdentity() );
+
+    // position = center of quad, size = full width/height, rotation in radians around the center
+    void draw( TextureID texture, const DirectX::XMFLOAT2& position, const DirectX::XMFLOAT2& size,
+               float rotation = 0.0f, const DirectX::XMFLOAT4& color = DirectX::XMFLOAT4( 1.0f, 1.0f, 1.0f, 1.0f ), float depth = 0.0f );
+
+    void end();
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct QuadVertex
+    {
+        DirectX::XMFLOAT3 pos;
+        DirectX::XMFLOAT2 texcoord;
+        UINT slice;
+        UINT color;     // RGBA8
+    };
+
+    struct QuadInfo
+    {
+        DirectX::XMFLOAT2 position;
+        DirectX::XMFLOAT2 size;
+        float rotation;
+        float depth;
+        UINT color;
+        TextureSlot slot;
+    };
+
+    void sortQuads();
+    void flush( const QuadInfo* pQuads, UINT count );
+    void writeQuad( const QuadInfo& quad, QuadVertex* pVertices ) const;
+    void prepareForRendering();
+
+    // Quads per draw is limited by 16 bit indices, the vertex buffer holds several draws
+    static const UINT maxQuadsPerDraw = 16384;
+    static const UINT vertexBufferQuads = maxQuadsPerDraw * 4;
+
+    ID3D11Device* pDevice;
+    ID3D11DeviceContext* pDeviceContext;
+    TextureArrayManager* pTextureArrays;
+
+    ID3D11Buffer* pVertexBuffer, * pIndexBuffer, * pCBuffer;
+    ID3D11InputLayout* pInputLayout;
+    ID3D11VertexShader* pVertexShader;
+    ID3D11PixelShader* pPixelShader;
+    ID3D11BlendState* pBlendState;
+    ID3D11DepthStencilState* pDepthStencilState;
+    ID3D11RasterizerState* pRasterizerState;
+    ID3D11SamplerState* pSamplerState;
+
+    UINT vertexBufferPosition;  // in quads
+
+    bool inBeginEnd;
+    SortMode sortMode;
+    DirectX::XMFLOAT4X4 transform;
+
+    std::vector<QuadInfo> quads;
+    std::vector<QuadInfo> sortedQuads;
+    std::vector<UINT> arrayCounts;
+
+    Stats stats;
+};
@@ -0,0 +1,43 @@
+#include "SceneShaders.h"
+
+#include "ClusteredLighting.h"
+#include "PointShadowMap.h"
+#include "IrradianceProbes.h"
+
+SceneShaderDefines::SceneShaderDefines()
+    : objectDeclaration( getCBufferDeclaration<cBuffer>( "constantBuffer", 0 ) ),
+      lightDeclaration( getCBufferDeclaration<cBufferLight>( "cBufferLight", 0 ) ),
+      materialDeclaration( getCBufferDeclaration<cBufferMaterial>( "cBufferMaterial", 1 ) ),
+      clustersDeclaration( getCBufferDeclaration<cBufferClusters>( "cBufferClusters", 2 ) ),
+      shadowDeclaration( getCBufferDeclaration<cBufferShadow>( "cBufferShadow", 3 ) ),
+      probesDeclaration( getCBufferDeclaration<cBufferProbes>( "cBufferProbes", 6 ) )
+{
+    vertexShader[0].Name = "CBUFFER_OBJECT";        vertexShader[0].Definition = objectDeclaration.c_str();
+    vertexShader[1].Name = NULL;                    vertexShader[1].Definition = NULL;
+
+    pixelShader[0].Name = "CBUFFER_LIGHT";          pixelShader[0].Definition = lightDeclaration.c_str();
+    pixelShader[1].Name = "CBUFFER_MATERIAL";       pixelShader[1].Definition = materialDeclaration.c_str();
+    pixelShader[2].Name = "CBUFFER_CLUSTERS";       pixelShader[2].Definition = clustersDeclaration.c_str();
+    pixelShader[3].Name = "CBUFFER_SHADOW";         pixelShader[3].Definition = shadowDeclaration.c_str();
+    pixelShader[4].Name = "CBUFFER_PROBES";         pixelShader[4].Definition = probesDeclaration.c_str();
+    pixelShader[5].Name = NULL;                     pixelShader[5].Definition = NULL;
+}
+
+ID3DBlob* compileShader( const wchar_t* fileName, const D3D_SHADER_MACRO* pDefines, const char* entryPoint, const char* target )
+{
+    ID3DBlob* pBlob = NULL, * pErrorBlob = NULL;
+    HRESULT hr = D3DCompileFromFile( fileName, pDefines, D3D_COMPILE_STANDARD_FILE_INCLUDE, entryPoint, target, NULL, NULL, &pBlob, &pErrorBlob );
+    if ( FAILED(hr) ) {
+        if ( pErrorBlob ) {
+            OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
+            pErrorBlob->Release();
+        }
+
+        if ( pBlob ) {
+            pBlob->Release();
+        }
+        return NULL;
+    }
+
+    return pBlob;
+}
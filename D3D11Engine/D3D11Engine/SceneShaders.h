@@ -0,0 +1,57 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+// * * * Useful * * * //
+#include <string>
+
+#include "CBufferLayout.h"
+
+// * * * Constant buffers of vertexShader.hlsl / pixelShader.hlsl * * * //
+// Packed by CBufferLayout.h, the shaders get the matching declarations as macros (SceneShaderDefines)
+#define OBJECT_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMMATRIX, worldViewProjection ) \
+    FIELD( DirectX::XMMATRIX, world )                           /* for lightning */ \
+    FIELD( DirectX::XMFLOAT3, positionScale )                   /* decode quantized positions: pos = snorm * scale + offset */ \
+    FIELD( DirectX::XMFLOAT3, positionOffset )
+DECLARE_CBUFFER( cBuffer, OBJECT_CBUFFER_FIELDS )
+
+#define LIGHT_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMFLOAT3, ambientLightColor ) \
+    FIELD( float, ambientLightStrength ) \
+    FIELD( DirectX::XMFLOAT3, dynamicLightColor ) \
+    FIELD( float, dynamicLightStrength ) \
+    FIELD( DirectX::XMFLOAT3, dynamicLightPosition ) \
+    FIELD( DirectX::XMFLOAT3, dynamicAttenuation )              /* how lightning decreases when moving away from object */
+DECLARE_CBUFFER( cBufferLight, LIGHT_CBUFFER_FIELDS )
+
+// Which Texture2DArray slice the draw samples from
+#define MATERIAL_CBUFFER_FIELDS( FIELD ) \
+    FIELD( UINT, textureSlice )
+DECLARE_CBUFFER( cBufferMaterial, MATERIAL_CBUFFER_FIELDS )
+
+// Declarations of every scene constant buffer, vertex shader: b0 = cBuffer, pixel shader:
+// b0 = cBufferLight, b1 = cBufferMaterial, b2 = cBufferClusters, b3 = cBufferShadow, b6 = cBufferProbes.
+// The macros point into the strings it keeps, so it isn't copyable.
+struct SceneShaderDefines
+{
+    SceneShaderDefines();
+
+    D3D_SHADER_MACRO vertexShader[2];
+    D3D_SHADER_MACRO pixelShader[6];
+
+private:
+    SceneShaderDefines( const SceneShaderDefines& );
+    SceneShaderDefines& operator=( const SceneShaderDefines& );
+
+    std::string objectDeclaration, lightDeclaration, materialDeclaration, clustersDeclaration, shadowDeclaration, probesDeclaration;
+};
+
+// Compiles one entry point of a shader file, errors go to the debugger output. NULL on failure
+ID3DBlob* compileShader( const wchar_t* fileName, const D3D_SHADER_MACRO* pDefines, const char* entryPoint, const char* target );
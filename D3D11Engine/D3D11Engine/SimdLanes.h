@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Windows.h>
+#include <immintrin.h>
+
+// * * * SIMD lanes: data parallel kernels are written once against these * * * //
+// SseLanes is always available (x64 baseline), AvxLanes when the build enables AVX
+// (/arch:AVX or the ReleaseAVX2|x64 configuration).
+// SimdLanes is the widest one the build allows. Masks are lane wide all-ones / all-zeros.
+const UINT simdMaxWidth = 8;    // pad structure of arrays data by this many elements
+
+struct SseLanes
+{
+    typedef __m128 Reg;
+    static const UINT width = 4;
+
+    static Reg load( const float* p ) { return _mm_loadu_ps( p ); }
+    static Reg loadAligned( const float* p ) { return _mm_load_ps( p ); }
+    static void storeAligned( float* p, Reg r ) { _mm_store_ps( p, r ); }
+    static Reg set( float f ) { return _mm_set1_ps( f ); }
+    static Reg add( Reg a, Reg b ) { return _mm_add_ps( a, b ); }
+    static Reg sub( Reg a, Reg b ) { return _mm_sub_ps( a, b ); }
+    static Reg mul( Reg a, Reg b ) { return _mm_mul_ps( a, b ); }
+    static Reg min( Reg a, Reg b ) { return _mm_min_ps( a, b ); }
+    static Reg max( Reg a, Reg b ) { return _mm_max_ps( a, b ); }
+
+    static Reg greaterEqual( Reg a, Reg b ) { return _mm_cmpge_ps( a, b ); }
+    static Reg maskAnd( Reg a, Reg b ) { return _mm_and_ps( a, b ); }
+    static Reg maskAll() { return _mm_castsi128_ps( _mm_set1_epi32( -1 ) ); }
+    static UINT maskBits( Reg mask ) { return (UINT)_mm_movemask_ps( mask ); }
+};
+
+#if defined(__AVX__)
+struct AvxLanes
+{
+    typedef __m256 Reg;
+    static const UINT width = 8;
+
+    static Reg load( const float* p ) { return _mm256_loadu_ps( p ); }
+    static Reg loadAligned( const float* p ) { return _mm256_load_ps( p ); }
+    static void storeAligned( float* p, Reg r ) { _mm256_store_ps( p, r ); }
+    static Reg set( float f ) { return _mm256_set1_ps( f ); }
+    static Reg add( Reg a, Reg b ) { return _mm256_add_ps( a, b ); }
+    static Reg sub( Reg a, Reg b ) { return _mm256_sub_ps( a, b ); }
+    static Reg mul( Reg a, Reg b ) { return _mm256_mul_ps( a, b ); }
+    static Reg min( Reg a, Reg b ) { return _mm256_min_ps( a, b ); }
+    static Reg max( Reg a, Reg b ) { return _mm256_max_ps( a, b ); }
+
+    static Reg greaterEqual( Reg a, Reg b ) { return _mm256_cmp_ps( a, b, _CMP_GE_OQ ); }
+    static Reg maskAnd( Reg a, Reg b ) { return _mm256_and_ps( a, b ); }
+    static Reg maskAll() { return _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) ); }
+    static UINT maskBits( Reg mask ) { return (UINT)_mm256_movemask_ps( mask ); }
+};
+typedef AvxLanes SimdLanes;
+#else
+typedef SseLanes SimdLanes;
+#endif
@@ -0,0 +1,380 @@
+#include "Simplifier.h"
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+// * * * Symmetric 4x4 plane quadric, error(p) = sum of weighted squared plane distances * * * //
+struct Quadric
+{
+    double a2, b2, c2, d2;
+    double ab, ac, ad;
+    double bc, bd, cd;
+    double weight;
+
+    void addPlane( double a, double b, double c, double d, double w )
+    {
+        a2 += w * a * a; b2 += w * b * b; c2 += w * c * c; d2 += w * d * d;
+        ab += w * a * b; ac += w * a * c; ad += w * a * d;
+        bc += w * b * c; bd += w * b * d; cd += w * c * d;
+        weight += w;
+    }
+
+    void add( const Quadric& other )
+    {
+        a2 += other.a2; b2 += other.b2; c2 += other.c2; d2 += other.d2;
+        ab += other.ab; ac += other.ac; ad += other.ad;
+        bc += other.bc; bd += other.bd; cd += other.cd;
+        weight += other.weight;
+    }
+
+    double evaluate( const DirectX::XMFLOAT3& p ) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double error = a2 * x * x + b2 * y * y + c2 * z * z + d2
+                     + 2.0 * ( ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z );
+        return ( error > 0.0 ) ? error : 0.0;
+    }
+};
+
+enum VertexKind
+{
+    VERTEX_MANIFOLD,        // collapses to any neighbour
+    VERTEX_BORDER,          // collapses only along a border edge
+    VERTEX_LOCKED           // attribute seam / border corner, never moves
+};
+
+static inline UINT64 edgeKey( UINT a, UINT b )
+{
+    return ( (UINT64)a << 32 ) | b;
+}
+
+static void triangleNormal( const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const DirectX::XMFLOAT3& c, double* n )
+{
+    double e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+    double e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Same position, bitwise - the vertices attribute seams are made of
+static void weldPositions( const MeshData& mesh, std::vector<UINT>& positionRemap, std::vector<bool>& isSeam )
+{
+    struct PositionHash
+    {
+        size_t operator()( const DirectX::XMFLOAT3& p ) const
+        {
+            UINT bits[3];
+            memcpy( bits, &p, sizeof(bits) );
+            return (size_t)( bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u );
+        }
+    };
+    struct PositionEqual
+    {
+        bool operator()( const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b ) const
+        {
+            return memcmp( &a, &b, sizeof(DirectX::XMFLOAT3) ) == 0;
+        }
+    };
+
+    UINT vertexCount = (UINT)mesh.vertices.size();
+    std::unordered_map<DirectX::XMFLOAT3, UINT, PositionHash, PositionEqual> firstVertex;
+    firstVertex.reserve( vertexCount );
+
+    positionRemap.resize( vertexCount );
+    isSeam.assign( vertexCount, false );
+
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        auto inserted = firstVertex.insert( std::make_pair( mesh.vertices[v].pos, v ) );
+        positionRemap[v] = inserted.first->second;
+        if ( !inserted.second ) {
+            isSeam[v] = true;
+            isSeam[inserted.first->second] = true;
+        }
+    }
+}
+
+// * * * * * SIMPLIFY * * * * * //
+SimplifySettings getDefaultSimplifySettings( UINT targetIndexCount )
+{
+    SimplifySettings settings;
+    settings.targetIndexCount = targetIndexCount;
+    settings.targetError = 0.05f;
+    settings.normalWeight = 0.05f;
+    settings.texcoordWeight = 0.05f;
+    return settings;
+}
+
+float simplifyMesh( const MeshData& mesh, const SimplifySettings& settings, MeshData& simplified )
+{
+    UINT vertexCount = (UINT)mesh.vertices.size();
+    std::vector<UINT> indices( mesh.indices );
+    const std::vector<Vertex>& vertices = mesh.vertices;
+
+    // - - - extent, errors are relative to it - - - //
+    float minPos[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxPos[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        const float* p = &vertices[v].pos.x;
+        for ( int k = 0; k < 3; k++ ) {
+            minPos[k] = ( p[k] < minPos[k] ) ? p[k] : minPos[k];
+            maxPos[k] = ( p[k] > maxPos[k] ) ? p[k] : maxPos[k];
+        }
+    }
+    double extent = 0.0;
+    for ( int k = 0; k < 3; k++ )
+        extent = std::max( extent, (double)( maxPos[k] - minPos[k] ) );
+
+    double errorLimit = (double)settings.targetError * extent;
+    double normalScale = (double)settings.normalWeight * extent;
+    double texcoordScale = (double)settings.texcoordWeight * extent;
+
+    // - - - seams: every vertex that shares its position with another one is locked - - - //
+    std::vector<UINT> positionRemap;
+    std::vector<bool> isSeam;
+    weldPositions( mesh, positionRemap, isSeam );
+
+    // - - - plane quadrics, area weighted - - - //
+    Quadric zero;
+    memset( &zero, 0, sizeof(Quadric) );
+    std::vector<Quadric> quadrics( vertexCount, zero );
+
+    for ( size_t i = 0; i + 2 < indices.size(); i += 3 ) {
+        const DirectX::XMFLOAT3& a = vertices[indices[i]].pos;
+        double n[3];
+        triangleNormal( a, vertices[indices[i + 1]].pos, vertices[indices[i + 2]].pos, n );
+
+        double length = sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+        if ( length == 0.0 )
+            continue;
+
+        n[0] /= length; n[1] /= length; n[2] /= length;
+        double d = -( n[0] * a.x + n[1] * a.y + n[2] * a.z );
+        for ( int k = 0; k < 3; k++ )
+            quadrics[indices[i + k]].addPlane( n[0], n[1], n[2], d, length * 0.5 );
+    }
+
+    std::vector<UINT> remap( vertexCount );
+    std::vector<VertexKind> kinds( vertexCount );
+    std::vector<UINT> borderEdgeCount( vertexCount );
+    std::vector<bool> touched( vertexCount );
+    std::unordered_set<UINT64> edges, borderEdges;
+
+    std::vector<UINT> triangleOffsets, vertexTriangles;
+
+    struct Collapse
+    {
+        UINT from, to;
+        double error;       // squared, object space units
+    };
+    std::vector<Collapse> collapses;
+
+    double maxError = 0.0;
+    bool firstPass = true;
+
+    while ( indices.size() > settings.targetIndexCount ) {
+        UINT triangleCount = (UINT)indices.size() / 3;
+
+        // - - - topology on welded positions: open edges are borders - - - //
+        edges.clear();
+        borderEdges.clear();
+        for ( size_t i = 0; i < indices.size(); i++ ) {
+            UINT a = positionRemap[indices[i]];
+            UINT b = positionRemap[indices[i - i % 3 + ( i + 1 ) % 3]];
+            edges.insert( edgeKey( a, b ) );
+        }
+
+        std::fill( borderEdgeCount.begin(), borderEdgeCount.end(), 0 );
+        for ( size_t i = 0; i < indices.size(); i++ ) {
+            UINT a = indices[i];
+            UINT b = indices[i - i % 3 + ( i + 1 ) % 3];
+            if ( edges.count( edgeKey( positionRemap[b], positionRemap[a] ) ) == 0 ) {
+                borderEdges.insert( edgeKey( a, b ) );
+                borderEdgeCount[a]++;
+                borderEdgeCount[b]++;
+            }
+        }
+
+        for ( UINT v = 0; v < vertexCount; v++ ) {
+            if ( isSeam[v] || ( borderEdgeCount[v] != 0 && borderEdgeCount[v] != 2 ) )
+                kinds[v] = VERTEX_LOCKED;
+            else
+                kinds[v] = borderEdgeCount[v] ? VERTEX_BORDER : VERTEX_MANIFOLD;
+        }
+
+        // Borders keep their shape: a plane through the edge, perpendicular to the triangle
+        if ( firstPass ) {
+            for ( size_t i = 0; i < indices.size(); i++ ) {
+                UINT a = indices[i];
+                UINT b = indices[i - i % 3 + ( i + 1 ) % 3];
+                UINT c = indices[i - i % 3 + ( i + 2 ) % 3];
+                if ( borderEdges.count( edgeKey( a, b ) ) == 0 )
+                    continue;
+
+                const DirectX::XMFLOAT3& pa = vertices[a].pos;
+                const DirectX::XMFLOAT3& pb = vertices[b].pos;
+                double n[3];
+                triangleNormal( pa, pb, vertices[c].pos, n );
+
+                double e[3] = { pb.x - pa.x, pb.y - pa.y, pb.z - pa.z };
+                double edgeLengthSq = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+                double p[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+                double length = sqrt( p[0] * p[0] + p[1] * p[1] + p[2] * p[2] );
+                if ( length == 0.0 )
+                    continue;
+
+                p[0] /= length; p[1] /= length; p[2] /= length;
+                double d = -( p[0] * pa.x + p[1] * pa.y + p[2] * pa.z );
+                quadrics[a].addPlane( p[0], p[1], p[2], d, edgeLengthSq * 10.0 );
+                quadrics[b].addPlane( p[0], p[1], p[2], d, edgeLengthSq * 10.0 );
+            }
+            firstPass = false;
+        }
+
+        // - - - vertex -> triangles - - - //
+        triangleOffsets.assign( vertexCount + 1, 0 );
+        for ( size_t i = 0; i < indices.size(); i++ )
+            triangleOffsets[indices[i] + 1]++;
+        for ( UINT v = 0; v < vertexCount; v++ )
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        vertexTriangles.resize( indices.size() );
+        {
+            std::vector<UINT> fill( triangleOffsets.begin(), triangleOffsets.end() - 1 );
+            for ( size_t i = 0; i < indices.size(); i++ )
+                vertexTriangles[fill[indices[i]]++] = (UINT)( i / 3 );
+        }
+
+        // - - - candidate collapses, cheapest direction per edge - - - //
+        collapses.clear();
+        for ( size_t i = 0; i < indices.size(); i++ ) {
+            UINT a = indices[i];
+            UINT b = indices[i - i % 3 + ( i + 1 ) % 3];
+
+            Collapse best = { 0, 0, DBL_MAX };
+            UINT ends[2][2] = { { a, b }, { b, a } };
+            for ( int d = 0; d < 2; d++ ) {
+                UINT from = ends[d][0], to = ends[d][1];
+                if ( kinds[from] == VERTEX_LOCKED )
+                    continue;
+                if ( kinds[from] == VERTEX_BORDER && borderEdges.count( edgeKey( a, b ) ) == 0 && borderEdges.count( edgeKey( b, a ) ) == 0 )
+                    continue;
+
+                Quadric q = quadrics[from];
+                q.add( quadrics[to] );
+                double error = ( q.weight > 0.0 ) ? q.evaluate( vertices[to].pos ) / q.weight : 0.0;
+
+                // Attribute differences, the collapsed vertex takes the target's attributes
+                const Vertex& vf = vertices[from];
+                const Vertex& vt = vertices[to];
+                double dn[3] = { vf.normal.x - vt.normal.x, vf.normal.y - vt.normal.y, vf.normal.z - vt.normal.z };
+                double duv[2] = { vf.texcoord.x - vt.texcoord.x, vf.texcoord.y - vt.texcoord.y };
+                error += normalScale * normalScale * ( dn[0] * dn[0] + dn[1] * dn[1] + dn[2] * dn[2] );
+                error += texcoordScale * texcoordScale * ( duv[0] * duv[0] + duv[1] * duv[1] );
+
+                if ( error < best.error ) {
+                    best.from = from;
+                    best.to = to;
+                    best.error = error;
+                }
+            }
+
+            if ( best.error != DBL_MAX )
+                collapses.push_back( best );
+        }
+
+        std::sort( collapses.begin(), collapses.end(), []( const Collapse& a, const Collapse& b ) { return a.error < b.error; } );
+
+        // - - - collapse, each vertex neighbourhood at most once per pass - - - //
+        for ( UINT v = 0; v < vertexCount; v++ )
+            remap[v] = v;
+        std::fill( touched.begin(), touched.end(), false );
+
+        UINT collapsesWanted = ( triangleCount - settings.targetIndexCount / 3 ) / 2 + 1;
+        UINT collapseCount = 0;
+
+        for ( size_t c = 0; c < collapses.size() && collapseCount < collapsesWanted; c++ ) {
+            const Collapse& collapse = collapses[c];
+            if ( collapse.error > errorLimit * errorLimit )
+                break;
+            if ( touched[collapse.from] || touched[collapse.to] )
+                continue;
+
+            // Moving "from" onto "to" must not flip any remaining triangle
+            bool flips = false;
+            for ( UINT t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1] && !flips; t++ ) {
+                const UINT* tri = &indices[vertexTriangles[t] * 3];
+                if ( tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to )
+                    continue;
+
+                DirectX::XMFLOAT3 p[3];
+                for ( int k = 0; k < 3; k++ )
+                    p[k] = vertices[tri[k]].pos;
+
+                double before[3], after[3];
+                triangleNormal( p[0], p[1], p[2], before );
+                for ( int k = 0; k < 3; k++ ) {
+                    if ( tri[k] == collapse.from )
+                        p[k] = vertices[collapse.to].pos;
+                }
+                triangleNormal( p[0], p[1], p[2], after );
+
+                // Also reject large rotations, several of them in a row add up to a flip
+                double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+                double lengths = sqrt( ( before[0] * before[0] + before[1] * before[1] + before[2] * before[2] ) *
+                                       ( after[0] * after[0] + after[1] * after[1] + after[2] * after[2] ) );
+                flips = dot <= 0.5 * lengths;
+            }
+            if ( flips )
+                continue;
+
+            // Lock the one-ring, its triangles change with this collapse
+            for ( UINT t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; t++ ) {
+                const UINT* tri = &indices[vertexTriangles[t] * 3];
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add( quadrics[collapse.from] );
+            maxError = std::max( maxError, collapse.error );
+            collapseCount++;
+        }
+
+        if ( collapseCount == 0 )
+            break;
+
+        // - - - apply, drop the triangles that became degenerate - - - //
+        size_t write = 0;
+        for ( size_t i = 0; i + 2 < indices.size(); i += 3 ) {
+            UINT a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if ( a == b || b == c || c == a )
+                continue;
+
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+        indices.resize( write );
+    }
+
+    // - - - compact the vertices that are still used - - - //
+    const UINT unused = 0xFFFFFFFF;
+    std::vector<UINT> compact( vertexCount, unused );
+
+    simplified.vertices.clear();
+    simplified.indices.resize( indices.size() );
+    for ( size_t i = 0; i < indices.size(); i++ ) {
+        UINT v = indices[i];
+        if ( compact[v] == unused ) {
+            compact[v] = (UINT)simplified.vertices.size();
+            simplified.vertices.push_back( vertices[v] );
+        }
+        simplified.indices[i] = compact[v];
+    }
+
+    return (float)sqrt( maxError );
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "Mesh.h"
+
+// * * * Import time mesh simplification * * * //
+// Quadric error metrics (Garland & Heckbert 1997) with half-edge collapses, so every output vertex
+// is an input vertex and keeps its attributes. Normal / UV differences add to the collapse cost.
+// Open boundaries get extra perpendicular quadrics and only collapse along the boundary, vertices
+// on attribute seams (same position, different attributes) are locked so seams can't tear.
+
+struct SimplifySettings
+{
+    UINT targetIndexCount;
+    float targetError;          // relative to the mesh extent, collapses above this are not done
+    float normalWeight;         // attribute cost weights, relative to the mesh extent
+    float texcoordWeight;
+};
+
+SimplifySettings getDefaultSimplifySettings( UINT targetIndexCount );
+
+// Returns the largest error of a collapse that was done, in object space units
+float simplifyMesh( const MeshData& mesh, const SimplifySettings& settings, MeshData& simplified );
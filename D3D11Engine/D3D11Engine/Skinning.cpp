@@ -0,0 +1,412 @@
+#include "Skinning.h"
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <emmintrin.h>
+#include <DirectXPackedVector.h>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+const UINT skinGroupsPerBatch = 256;        // 1024 vertices per job batch
+
+// * * * * * SKELETON * * * * * //
+void initSkeletonPose( const Skeleton& skeleton, SkeletonPose& pose )
+{
+    UINT boneCount = (UINT)skeleton.parents.size();
+    pose.locals.resize( boneCount );
+    pose.models.resize( boneCount );
+    pose.palette.resize( boneCount );
+
+    // Locals start in the bind pose: model = inverse( inverseBind ), local = model * inverse( parent model )
+    for ( UINT b = 0; b < boneCount; b++ ) {
+        XMMATRIX model = XMMatrixInverse( nullptr, XMLoadFloat4x4( &skeleton.inverseBindPoses[b] ) );
+        XMMATRIX local = model;
+        if ( skeleton.parents[b] >= 0 )
+            local = model * XMLoadFloat4x4( &skeleton.inverseBindPoses[skeleton.parents[b]] );
+
+        XMVECTOR scale, rotation, position;
+        XMMatrixDecompose( &scale, &rotation, &position, local );
+        XMStoreFloat3( &pose.locals[b].position, position );
+        XMStoreFloat4( &pose.locals[b].rotation, rotation );
+        XMStoreFloat3( &pose.locals[b].scale, scale );
+    }
+
+    updateSkeletonPose( skeleton, pose );
+}
+
+void updateSkeletonPose( const Skeleton& skeleton, SkeletonPose& pose )
+{
+    for ( UINT b = 0; b < (UINT)skeleton.parents.size(); b++ ) {
+        const BonePose& local = pose.locals[b];
+        XMMATRIX model = XMMatrixScaling( local.scale.x, local.scale.y, local.scale.z ) *
+                         XMMatrixRotationQuaternion( XMLoadFloat4( &local.rotation ) ) *
+                         XMMatrixTranslation( local.position.x, local.position.y, local.position.z );
+
+        // Parents come first, their model matrix is already this frame's
+        if ( skeleton.parents[b] >= 0 )
+            model = model * XMLoadFloat4x4( &pose.models[skeleton.parents[b]] );
+        XMStoreFloat4x4( &pose.models[b], model );
+
+        // Row vectors (p * M): the columns of M are the rows of the 3x4 skinning matrix
+        XMMATRIX skin = XMMatrixTranspose( XMLoadFloat4x4( &skeleton.inverseBindPoses[b] ) * model );
+        XMStoreFloat4( &pose.palette[b].rows[0], skin.r[0] );
+        XMStoreFloat4( &pose.palette[b].rows[1], skin.r[1] );
+        XMStoreFloat4( &pose.palette[b].rows[2], skin.r[2] );
+    }
+}
+
+// * * * * * SKINNED MESH * * * * * //
+void buildSkinnedMesh( const VertexPositionNormalTangentColorTextureSkinning* pVertices, UINT vertexCount, SkinnedMesh& mesh )
+{
+    UINT groupCount = ( vertexCount + 3 ) / 4;
+    mesh.groups.assign( groupCount, SkinVertexGroup() );
+    mesh.restVertices.resize( vertexCount );
+    mesh.boneMins.assign( SKINNING_MAX_BONES, XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX ) );
+    mesh.boneMaxs.assign( SKINNING_MAX_BONES, XMFLOAT3( -FLT_MAX, -FLT_MAX, -FLT_MAX ) );
+    mesh.vertexCount = vertexCount;
+    mesh.boneCount = 0;
+
+    // Padding lanes: origin, fully bound to bone 0, never written out
+    for ( UINT g = 0; g < groupCount; g++ ) {
+        SkinVertexGroup& group = mesh.groups[g];
+        memset( &group, 0, sizeof(SkinVertexGroup) );
+        for ( UINT lane = 0; lane < 4; lane++ ) {
+            group.normals[1][lane] = 1.0f;
+            group.weights[lane][0] = 1.0f;
+        }
+    }
+
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        const VertexPositionNormalTangentColorTextureSkinning& vertex = pVertices[v];
+        SkinVertexGroup& group = mesh.groups[v / 4];
+        UINT lane = v % 4;
+
+        group.positions[0][lane] = vertex.position.x;
+        group.positions[1][lane] = vertex.position.y;
+        group.positions[2][lane] = vertex.position.z;
+
+        XMFLOAT3 normal;
+        XMStoreFloat3( &normal, XMVector3Normalize( XMLoadFloat3( &vertex.normal ) ) );
+        group.normals[0][lane] = normal.x;
+        group.normals[1][lane] = normal.y;
+        group.normals[2][lane] = normal.z;
+
+        // UNORM8 weights rarely sum to exactly 1, renormalize so the bounds stay conservative
+        float weights[4], weightSum = 0.0f;
+        for ( UINT i = 0; i < 4; i++ ) {
+            weights[i] = (float)( ( vertex.weights >> ( i * 8 ) ) & 0xFF ) / 255.0f;
+            weightSum += weights[i];
+        }
+        if ( weightSum <= 0.0f ) {
+            weights[0] = 1.0f;
+            weightSum = 1.0f;
+        }
+
+        for ( UINT i = 0; i < 4; i++ ) {
+            BYTE bone = (BYTE)( ( vertex.indices >> ( i * 8 ) ) & 0xFF );
+            group.bones[lane][i] = bone;
+            group.weights[lane][i] = weights[i] / weightSum;
+            if ( group.weights[lane][i] <= 0.0f )
+                continue;
+
+            XMFLOAT3& boneMin = mesh.boneMins[bone];
+            XMFLOAT3& boneMax = mesh.boneMaxs[bone];
+            boneMin = XMFLOAT3( std::min( boneMin.x, vertex.position.x ), std::min( boneMin.y, vertex.position.y ), std::min( boneMin.z, vertex.position.z ) );
+            boneMax = XMFLOAT3( std::max( boneMax.x, vertex.position.x ), std::max( boneMax.y, vertex.position.y ), std::max( boneMax.z, vertex.position.z ) );
+            mesh.boneCount = std::max( mesh.boneCount, (UINT)bone + 1 );
+        }
+
+        // The parts skinning doesn't touch
+        PackedVertex& rest = mesh.restVertices[v];
+        memset( &rest, 0, sizeof(PackedVertex) );
+        XMStoreHalf2( &rest.texcoord, XMLoadFloat2( &vertex.textureCoordinate ) );
+        memcpy( &rest.col, &vertex.color, sizeof(UINT) );     // both R8G8B8A8_UNORM
+    }
+
+    mesh.boneMins.resize( std::max( mesh.boneCount, 1u ) );
+    mesh.boneMaxs.resize( std::max( mesh.boneCount, 1u ) );
+}
+
+VertexQuantization computeSkinnedQuantization( const SkinnedMesh& mesh, const SkinMatrix* pPalette )
+{
+    XMFLOAT3 minPos( FLT_MAX, FLT_MAX, FLT_MAX );
+    XMFLOAT3 maxPos( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+    for ( UINT b = 0; b < mesh.boneCount; b++ ) {
+        const XMFLOAT3& boneMin = mesh.boneMins[b];
+        const XMFLOAT3& boneMax = mesh.boneMaxs[b];
+        if ( boneMin.x > boneMax.x )
+            continue;       // moves no vertex
+
+        // Box through the affine matrix: center transformed, extents through the absolute 3x3
+        float center[3] = { ( boneMin.x + boneMax.x ) * 0.5f, ( boneMin.y + boneMax.y ) * 0.5f, ( boneMin.z + boneMax.z ) * 0.5f };
+        float extents[3] = { ( boneMax.x - boneMin.x ) * 0.5f, ( boneMax.y - boneMin.y ) * 0.5f, ( boneMax.z - boneMin.z ) * 0.5f };
+
+        float boxMin[3], boxMax[3];
+        for ( UINT k = 0; k < 3; k++ ) {
+            const XMFLOAT4& row = pPalette[b].rows[k];
+            float c = row.x * center[0] + row.y * center[1] + row.z * center[2] + row.w;
+            float e = fabsf( row.x ) * extents[0] + fabsf( row.y ) * extents[1] + fabsf( row.z ) * extents[2];
+            boxMin[k] = c - e;
+            boxMax[k] = c + e;
+        }
+
+        minPos = XMFLOAT3( std::min( minPos.x, boxMin[0] ), std::min( minPos.y, boxMin[1] ), std::min( minPos.z, boxMin[2] ) );
+        maxPos = XMFLOAT3( std::max( maxPos.x, boxMax[0] ), std::max( maxPos.y, boxMax[1] ), std::max( maxPos.z, boxMax[2] ) );
+    }
+
+    VertexQuantization quantization;
+    if ( minPos.x > maxPos.x ) {
+        quantization.positionScale = XMFLOAT3( 1.0f, 1.0f, 1.0f );
+        quantization.positionOffset = XMFLOAT3( 0.0f, 0.0f, 0.0f );
+        return quantization;
+    }
+
+    // Same convention as computeVertexQuantization: center -> offset, half extents -> scale
+    quantization.positionOffset = XMFLOAT3( ( minPos.x + maxPos.x ) * 0.5f, ( minPos.y + maxPos.y ) * 0.5f, ( minPos.z + maxPos.z ) * 0.5f );
+    quantization.positionScale = XMFLOAT3( ( maxPos.x - minPos.x ) * 0.5f, ( maxPos.y - minPos.y ) * 0.5f, ( maxPos.z - minPos.z ) * 0.5f );
+
+    if ( quantization.positionScale.x <= 0.0f ) quantization.positionScale.x = 1.0f;
+    if ( quantization.positionScale.y <= 0.0f ) quantization.positionScale.y = 1.0f;
+    if ( quantization.positionScale.z <= 0.0f ) quantization.positionScale.z = 1.0f;
+
+    return quantization;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+// Per vertex the weighted bone matrices are blended row by row. The 4 blended matrices of a group
+// are then transposed, so the transform, normalization, octahedral encoding and quantization
+// work on 4 vertices per instruction.
+static void skinGroups( const SkinnedMesh& mesh, const SkinMatrix* pPalette, const VertexQuantization& quantization, PackedVertex* pOutput, UINT begin, UINT end )
+{
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 minusOne = _mm_set1_ps( -1.0f );
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 snormScale = _mm_set1_ps( 32767.0f );
+    const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7FFFFFFF ) );
+
+    const __m128 offsetX = _mm_set1_ps( quantization.positionOffset.x );
+    const __m128 offsetY = _mm_set1_ps( quantization.positionOffset.y );
+    const __m128 offsetZ = _mm_set1_ps( quantization.positionOffset.z );
+    const __m128 invScaleX = _mm_set1_ps( 1.0f / quantization.positionScale.x );
+    const __m128 invScaleY = _mm_set1_ps( 1.0f / quantization.positionScale.y );
+    const __m128 invScaleZ = _mm_set1_ps( 1.0f / quantization.positionScale.z );
+
+    for ( UINT g = begin; g < end; g++ ) {
+        const SkinVertexGroup& group = mesh.groups[g];
+
+        // - - - blend: rows[k][v] = sum of weight * palette row k, for vertex v - - - //
+        __m128 rows[3][4];
+        for ( UINT v = 0; v < 4; v++ ) {
+            const BYTE* pBones = group.bones[v];
+            const float* pWeights = group.weights[v];
+
+            const SkinMatrix& first = pPalette[pBones[0]];
+            __m128 weight = _mm_set1_ps( pWeights[0] );
+            __m128 row0 = _mm_mul_ps( _mm_loadu_ps( &first.rows[0].x ), weight );
+            __m128 row1 = _mm_mul_ps( _mm_loadu_ps( &first.rows[1].x ), weight );
+            __m128 row2 = _mm_mul_ps( _mm_loadu_ps( &first.rows[2].x ), weight );
+
+            for ( UINT i = 1; i < 4; i++ ) {
+                if ( pWeights[i] == 0.0f )
+                    continue;
+
+                const SkinMatrix& bone = pPalette[pBones[i]];
+                weight = _mm_set1_ps( pWeights[i] );
+                row0 = _mm_add_ps( row0, _mm_mul_ps( _mm_loadu_ps( &bone.rows[0].x ), weight ) );
+                row1 = _mm_add_ps( row1, _mm_mul_ps( _mm_loadu_ps( &bone.rows[1].x ), weight ) );
+                row2 = _mm_add_ps( row2, _mm_mul_ps( _mm_loadu_ps( &bone.rows[2].x ), weight ) );
+            }
+
+            rows[0][v] = row0;
+            rows[1][v] = row1;
+            rows[2][v] = row2;
+        }
+
+        // rows[k][c] now holds matrix element ( k, c ) of the 4 vertices
+        _MM_TRANSPOSE4_PS( rows[0][0], rows[0][1], rows[0][2], rows[0][3] );
+        _MM_TRANSPOSE4_PS( rows[1][0], rows[1][1], rows[1][2], rows[1][3] );
+        _MM_TRANSPOSE4_PS( rows[2][0], rows[2][1], rows[2][2], rows[2][3] );
+
+        // - - - transform - - - //
+        __m128 px = _mm_load_ps( group.positions[0] );
+        __m128 py = _mm_load_ps( group.positions[1] );
+        __m128 pz = _mm_load_ps( group.positions[2] );
+        __m128 nx = _mm_load_ps( group.normals[0] );
+        __m128 ny = _mm_load_ps( group.normals[1] );
+        __m128 nz = _mm_load_ps( group.normals[2] );
+
+        __m128 position[3], normal[3];
+        for ( UINT k = 0; k < 3; k++ ) {
+            position[k] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( rows[k][0], px ), _mm_mul_ps( rows[k][1], py ) ),
+                                      _mm_add_ps( _mm_mul_ps( rows[k][2], pz ), rows[k][3] ) );
+            normal[k] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( rows[k][0], nx ), _mm_mul_ps( rows[k][1], ny ) ), _mm_mul_ps( rows[k][2], nz ) );
+        }
+
+        // - - - octahedral normal: the projection onto |x| + |y| + |z| = 1 also normalizes - - - //
+        __m128 l1 = _mm_add_ps( _mm_add_ps( _mm_and_ps( normal[0], absMask ), _mm_and_ps( normal[1], absMask ) ), _mm_and_ps( normal[2], absMask ) );
+        __m128 invL1 = _mm_div_ps( one, _mm_max_ps( l1, _mm_set1_ps( 1e-20f ) ) );
+        __m128 octX = _mm_mul_ps( normal[0], invL1 );
+        __m128 octY = _mm_mul_ps( normal[1], invL1 );
+
+        __m128 signX = _mm_cmpge_ps( octX, zero );
+        __m128 signY = _mm_cmpge_ps( octY, zero );
+        signX = _mm_or_ps( _mm_and_ps( signX, one ), _mm_andnot_ps( signX, minusOne ) );
+        signY = _mm_or_ps( _mm_and_ps( signY, one ), _mm_andnot_ps( signY, minusOne ) );
+        __m128 foldedX = _mm_mul_ps( _mm_sub_ps( one, _mm_and_ps( octY, absMask ) ), signX );
+        __m128 foldedY = _mm_mul_ps( _mm_sub_ps( one, _mm_and_ps( octX, absMask ) ), signY );
+
+        __m128 lower = _mm_cmplt_ps( normal[2], zero );
+        octX = _mm_or_ps( _mm_and_ps( lower, foldedX ), _mm_andnot_ps( lower, octX ) );
+        octY = _mm_or_ps( _mm_and_ps( lower, foldedY ), _mm_andnot_ps( lower, octY ) );
+
+        // - - - quantize to SNORM16 (round to nearest, like XMStoreShortN4) - - - //
+        __m128 qx = _mm_mul_ps( _mm_sub_ps( position[0], offsetX ), invScaleX );
+        __m128 qy = _mm_mul_ps( _mm_sub_ps( position[1], offsetY ), invScaleY );
+        __m128 qz = _mm_mul_ps( _mm_sub_ps( position[2], offsetZ ), invScaleZ );
+
+        alignas(16) int packed[5][4];
+        _mm_store_si128( (__m128i*)packed[0], _mm_cvtps_epi32( _mm_mul_ps( _mm_min_ps( _mm_max_ps( qx, minusOne ), one ), snormScale ) ) );
+        _mm_store_si128( (__m128i*)packed[1], _mm_cvtps_epi32( _mm_mul_ps( _mm_min_ps( _mm_max_ps( qy, minusOne ), one ), snormScale ) ) );
+        _mm_store_si128( (__m128i*)packed[2], _mm_cvtps_epi32( _mm_mul_ps( _mm_min_ps( _mm_max_ps( qz, minusOne ), one ), snormScale ) ) );
+        _mm_store_si128( (__m128i*)packed[3], _mm_cvtps_epi32( _mm_mul_ps( octX, snormScale ) ) );
+        _mm_store_si128( (__m128i*)packed[4], _mm_cvtps_epi32( _mm_mul_ps( octY, snormScale ) ) );
+
+        // - - - write whole vertices front to back - - - //
+        UINT first = g * 4;
+        UINT count = std::min( 4u, mesh.vertexCount - first );
+        for ( UINT v = 0; v < count; v++ ) {
+            PackedVertex vertex = mesh.restVertices[first + v];
+            vertex.pos.x = (short)packed[0][v];
+            vertex.pos.y = (short)packed[1][v];
+            vertex.pos.z = (short)packed[2][v];
+            vertex.pos.w = 0;
+            vertex.normal.x = (short)packed[3][v];
+            vertex.normal.y = (short)packed[4][v];
+            pOutput[first + v] = vertex;
+        }
+    }
+}
+
+void skinVertices( const SkinnedMesh& mesh, const SkinMatrix* pPalette, const VertexQuantization& quantization, PackedVertex* pOutput, JobSystem* pJobSystem )
+{
+    UINT groupCount = (UINT)mesh.groups.size();
+    if ( pJobSystem ) {
+        pJobSystem->parallelFor( groupCount, skinGroupsPerBatch, [&]( UINT begin, UINT end ) {
+            skinGroups( mesh, pPalette, quantization, pOutput, begin, end );
+        } );
+    }
+    else {
+        skinGroups( mesh, pPalette, quantization, pOutput, 0, groupCount );
+    }
+}
+
+// * * * * * GPU * * * * * //
+bool createSkinnedMesh( ID3D11Device* pDevice, const SkinnedMesh& skinnedMesh, const UINT* pIndices, UINT indexCount, Mesh& mesh )
+{
+    PackedMeshData packedMesh;
+    packedMesh.vertices = skinnedMesh.restVertices;
+    packedMesh.quantization.positionScale = XMFLOAT3( 1.0f, 1.0f, 1.0f );
+    packedMesh.quantization.positionOffset = XMFLOAT3( 0.0f, 0.0f, 0.0f );
+
+    // One part: the vertex buffer is rewritten as a whole, splitting it would gain nothing
+    if ( skinnedMesh.vertexCount <= maxVerticesPer16BitPart ) {
+        packedMesh.indexFormat = DXGI_FORMAT_R16_UINT;
+        packedMesh.indices16.assign( pIndices, pIndices + indexCount );
+    }
+    else {
+        packedMesh.indexFormat = DXGI_FORMAT_R32_UINT;
+        packedMesh.indices32.assign( pIndices, pIndices + indexCount );
+    }
+
+    MeshPart part = { 0, indexCount, 0, skinnedMesh.vertexCount };
+    packedMesh.parts.push_back( part );
+
+    return createMesh( pDevice, packedMesh, mesh, true );
+}
+
+bool uploadSkinnedMesh( ID3D11DeviceContext* pDeviceContext, const SkinnedMesh& skinnedMesh, const SkinMatrix* pPalette, const VertexQuantization& quantization,
+                        Mesh& mesh, JobSystem* pJobSystem )
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = pDeviceContext->Map( mesh.pVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
+    if ( FAILED(hr) )
+        return false;
+
+    skinVertices( skinnedMesh, pPalette, quantization, (PackedVertex*)mapped.pData, pJobSystem );
+    pDeviceContext->Unmap( mesh.pVertexBuffer, 0 );
+
+    mesh.quantization = quantization;
+    return true;
+}
+
+// * * * * * PROCEDURAL * * * * * //
+void createSkinnedTubeMesh( UINT rings, UINT segments, float length, float radius, UINT boneCount,
+                            std::vector<VertexPositionNormalTangentColorTextureSkinning>& vertices, std::vector<UINT>& indices, Skeleton& skeleton )
+{
+    rings = std::max( rings, 2u );
+    segments = std::max( segments, 3u );
+    boneCount = std::min( std::max( boneCount, 1u ), SKINNING_MAX_BONES );
+    float boneLength = length / boneCount;
+
+    // - - - bone chain up the tube, bone b starts at b * boneLength - - - //
+    skeleton.parents.resize( boneCount );
+    skeleton.inverseBindPoses.resize( boneCount );
+    for ( UINT b = 0; b < boneCount; b++ ) {
+        skeleton.parents[b] = (int)b - 1;
+        XMStoreFloat4x4( &skeleton.inverseBindPoses[b], XMMatrixTranslation( 0.0f, -( b * boneLength ), 0.0f ) );
+    }
+
+    vertices.clear();
+    indices.clear();
+    vertices.reserve( rings * ( segments + 1 ) );
+    indices.reserve( ( rings - 1 ) * segments * 6 );
+
+    for ( UINT ring = 0; ring < rings; ring++ ) {
+        float v = (float)ring / ( rings - 1 );
+        float y = v * length;
+
+        // Blend between the two bones whose middles surround y
+        float bonePosition = std::min( std::max( y / boneLength - 0.5f, 0.0f ), (float)( boneCount - 1 ) );
+        UINT bone0 = (UINT)bonePosition;
+        UINT bone1 = std::min( bone0 + 1, boneCount - 1 );
+        float weight1 = bonePosition - bone0;
+
+        for ( UINT segment = 0; segment <= segments; segment++ ) {
+            float u = (float)segment / segments;
+            float theta = u * XM_2PI;
+            float c = cosf( theta ), s = sinf( theta );
+
+            VertexPositionNormalTangentColorTextureSkinning vertex;
+            vertex.position = XMFLOAT3( c * radius, y, s * radius );
+            vertex.normal = XMFLOAT3( c, 0.0f, s );
+            vertex.tangent = XMFLOAT4( -s, 0.0f, c, 1.0f );
+            vertex.color = 0xFFFFFFFF;
+            vertex.textureCoordinate = XMFLOAT2( u, 1.0f - v );
+            vertex.SetBlendIndices( XMUINT4( bone0, bone1, 0, 0 ) );
+            vertex.SetBlendWeights( XMFLOAT4( 1.0f - weight1, weight1, 0.0f, 0.0f ) );
+            vertices.push_back( vertex );
+        }
+    }
+
+    // Clockwise seen from outside, like createSphereMesh
+    for ( UINT ring = 0; ring + 1 < rings; ring++ ) {
+        for ( UINT segment = 0; segment < segments; segment++ ) {
+            UINT lowerLeft = ring * ( segments + 1 ) + segment;
+            UINT upperLeft = lowerLeft + ( segments + 1 );
+            UINT lowerRight = lowerLeft + 1;
+            UINT upperRight = upperLeft + 1;
+
+            indices.push_back( upperLeft );
+            indices.push_back( lowerRight );
+            indices.push_back( lowerLeft );
+            indices.push_back( upperLeft );
+            indices.push_back( upperRight );
+            indices.push_back( lowerRight );
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Windows.h>
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <VertexTypes.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Mesh.h"
+#include "JobSystem.h"
+
+// * * * Skeleton: bones ordered parents first * * * //
+const UINT SKINNING_MAX_BONES = 256;        // bone indices are bytes in the vertex
+
+struct Skeleton
+{
+    std::vector<int> parents;                               // -1 for roots
+    std::vector<DirectX::XMFLOAT4X4> inverseBindPoses;      // model space -> bone space
+};
+
+// Bone transform relative to its parent
+struct BonePose
+{
+    DirectX::XMFLOAT3 position;
+    DirectX::XMFLOAT4 rotation;     // quaternion
+    DirectX::XMFLOAT3 scale;
+};
+
+// Affine 3x4 skinning matrix stored as rows: x' = dot( rows[0], ( p, 1 ) ), normals use the 3x3 part
+struct SkinMatrix
+{
+    DirectX::XMFLOAT4 rows[3];
+};
+
+// Animated state of one skeleton instance: fill locals, updateSkeletonPose builds the palette
+struct SkeletonPose
+{
+    std::vector<BonePose> locals;
+    std::vector<DirectX::XMFLOAT4X4> models;    // bone -> model space
+    std::vector<SkinMatrix> palette;            // bind pose model space -> animated model space
+};
+
+void initSkeletonPose( const Skeleton& skeleton, SkeletonPose& pose );
+void updateSkeletonPose( const Skeleton& skeleton, SkeletonPose& pose );
+
+// * * * Skinned mesh, CPU side * * * //
+// Vertices in groups of 4, structure of arrays, so transforming, normalizing and quantizing run 4
+// vertices per SSE instruction. The tail group is padded with vertices bound to bone 0.
+struct SkinVertexGroup
+{
+    float positions[3][4];      // [axis][vertex], bind pose
+    float normals[3][4];
+    float weights[4][4];        // [vertex][influence], sum to 1
+    BYTE bones[4][4];           // [vertex][influence]
+};
+
+struct SkinnedMesh
+{
+    std::vector<SkinVertexGroup> groups;
+    std::vector<PackedVertex> restVertices;         // texcoord and color never change, copied with every skin
+    std::vector<DirectX::XMFLOAT3> boneMins;        // bind pose bounds of the vertices each bone moves
+    std::vector<DirectX::XMFLOAT3> boneMaxs;
+    UINT vertexCount;
+    UINT boneCount;
+};
+
+// Tangents aren't kept, PackedVertex has none
+void buildSkinnedMesh( const DirectX::VertexPositionNormalTangentColorTextureSkinning* pVertices, UINT vertexCount, SkinnedMesh& mesh );
+
+// Conservative bounds of the skinned vertices from the bone boxes (a skinned vertex is a weighted
+// average of bone transformed points, each inside its bone's transformed box), as the quantization
+// the packed output uses. Costs a few operations per bone instead of a pass over the vertices.
+VertexQuantization computeSkinnedQuantization( const SkinnedMesh& mesh, const SkinMatrix* pPalette );
+
+// Skins every vertex into pOutput (vertexCount PackedVertex, written front to back, so it can be
+// mapped write-combined memory), spread over the job system
+void skinVertices( const SkinnedMesh& mesh, const SkinMatrix* pPalette, const VertexQuantization& quantization, PackedVertex* pOutput, JobSystem* pJobSystem = NULL );
+
+// * * * GPU side: a Mesh with a dynamic vertex buffer * * * //
+bool createSkinnedMesh( ID3D11Device* pDevice, const SkinnedMesh& skinnedMesh, const UINT* pIndices, UINT indexCount, Mesh& mesh );
+
+// Map( WRITE_DISCARD ) -> skinVertices straight into the buffer -> Unmap, sets mesh.quantization
+bool uploadSkinnedMesh( ID3D11DeviceContext* pDeviceContext, const SkinnedMesh& skinnedMesh, const SkinMatrix* pPalette, const VertexQuantization& quantization,
+                        Mesh& mesh, JobSystem* pJobSystem = NULL );
+
+// * * * Procedural skinned mesh (tests / benchmarks) * * * //
+// Tube along +y, rings * segments vertices, driven by a chain of boneCount bones. Every vertex
+// blends the two bones nearest to its height.
+void createSkinnedTubeMesh( UINT rings, UINT segments, float length, float radius, UINT boneCount,
+                            std::vector<DirectX::VertexPositionNormalTangentColorTextureSkinning>& vertices, std::vector<UINT>& indices, Skeleton& skeleton );
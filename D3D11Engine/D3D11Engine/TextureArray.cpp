@@ -0,0 +1,287 @@
+#include "TextureArray.h"
+
+#include <assert.h>
+#include <WICTextureLoader.h>
+
+TextureArrayManager::TextureArrayManager()
+    : pDevice( NULL ), pDeviceContext( NULL ), maxSlicesPerArray( 0 ), currentFrame( 0 )
+{
+}
+
+bool TextureArrayManager::init( ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, UINT maxSlicesPerArray )
+{
+    assert( pDevice && pDeviceContext );
+    assert( maxSlicesPerArray > 0 && maxSlicesPerArray <= D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION );
+
+    this->pDevice = pDevice;
+    this->pDeviceContext = pDeviceContext;
+    this->maxSlicesPerArray = maxSlicesPerArray;
+    currentFrame = 0;
+
+    return true;
+}
+
+void TextureArrayManager::release()
+{
+    for ( size_t i = 0; i < arrays.size(); i++ ) {
+        arrays[i].pSRV->Release();
+        arrays[i].pTexture->Release();
+    }
+    arrays.clear();
+    textures.clear();
+}
+
+void TextureArrayManager::beginFrame()
+{
+    currentFrame++;
+}
+
+TextureID TextureArrayManager::loadTexture( const wchar_t* fileName )
+{
+    TextureEntry entry;
+    entry.fileName = fileName;
+    entry.resident = false;
+    entry.slot.arrayIndex = 0;
+    entry.slot.slice = 0;
+
+    TextureID id = (TextureID)textures.size();
+    textures.push_back( entry );
+
+    if ( !makeResident( id ) ) {
+        textures.pop_back();
+        return INVALID_TEXTURE_ID;
+    }
+
+    return id;
+}
+
+void TextureArrayManager::unloadTexture( TextureID id )
+{
+    assert( id < textures.size() );
+    TextureEntry& entry = textures[id];
+
+    if ( entry.resident ) {
+        arrays[entry.slot.arrayIndex].slices[entry.slot.slice].owner = INVALID_TEXTURE_ID;
+        entry.resident = false;
+    }
+    entry.fileName.clear();
+}
+
+bool TextureArrayManager::useTexture( TextureID id, TextureSlot& slot )
+{
+    assert( id < textures.size() );
+    TextureEntry& entry = textures[id];
+
+    if ( !entry.resident && !makeResident( id ) )
+        return false;
+
+    arrays[entry.slot.arrayIndex].slices[entry.slot.slice].lastUsedFrame = currentFrame;
+    slot = entry.slot;
+    return true;
+}
+
+ID3D11ShaderResourceView* TextureArrayManager::getSRV( UINT arrayIndex ) const
+{
+    assert( arrayIndex < arrays.size() );
+    return arrays[arrayIndex].pSRV;
+}
+
+bool TextureArrayManager::isCompatible( const D3D11_TEXTURE2D_DESC& a, const D3D11_TEXTURE2D_DESC& b ) const
+{
+    // CopySubresourceRegion needs identical size/format for every mip
+    return a.Width == b.Width && a.Height == b.Height && a.Format == b.Format && a.MipLevels == b.MipLevels;
+}
+
+bool TextureArrayManager::createArray( const D3D11_TEXTURE2D_DESC& sourceDesc, UINT capacity, TextureArray& texArray )
+{
+    D3D11_TEXTURE2D_DESC arrayDesc;
+    ZeroMemory( &arrayDesc, sizeof(D3D11_TEXTURE2D_DESC) );
+
+                arrayDesc.Width = sourceDesc.Width;
+                arrayDesc.Height = sourceDesc.Height;
+                arrayDesc.MipLevels = sourceDesc.MipLevels;
+                arrayDesc.ArraySize = capacity;
+                arrayDesc.Format = sourceDesc.Format;
+                arrayDesc.SampleDesc.Count = 1;
+                arrayDesc.SampleDesc.Quality = 0;
+                arrayDesc.Usage = D3D11_USAGE_DEFAULT;
+                arrayDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+                arrayDesc.CPUAccessFlags = 0;
+                arrayDesc.MiscFlags = 0;
+
+    HRESULT hr = pDevice->CreateTexture2D( &arrayDesc, NULL, &texArray.pTexture );
+    if ( FAILED(hr) )
+        return false;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    ZeroMemory( &srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC) );
+
+                srvDesc.Format = arrayDesc.Format;
+                srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+                srvDesc.Texture2DArray.MostDetailedMip = 0;
+                srvDesc.Texture2DArray.MipLevels = arrayDesc.MipLevels;
+                srvDesc.Texture2DArray.FirstArraySlice = 0;
+                srvDesc.Texture2DArray.ArraySize = capacity;
+
+    hr = pDevice->CreateShaderResourceView( texArray.pTexture, &srvDesc, &texArray.pSRV );
+    if ( FAILED(hr) ) {
+        texArray.pTexture->Release();
+        texArray.pTexture = NULL;
+        return false;
+    }
+
+    texArray.desc = arrayDesc;
+    return true;
+}
+
+bool TextureArrayManager::growArray( TextureArray& texArray )
+{
+    UINT oldCapacity = texArray.desc.ArraySize;
+    UINT newCapacity = oldCapacity * 2;
+    if ( newCapacity > maxSlicesPerArray )
+        newCapacity = maxSlicesPerArray;
+    if ( newCapacity <= oldCapacity )
+        return false;
+
+    TextureArray grown;
+    if ( !createArray( texArray.desc, newCapacity, grown ) )
+        return false;
+
+    // Move every occupied slice over, slice indices stay the same so handed out slots stay valid
+    UINT mipLevels = texArray.desc.MipLevels;
+    for ( UINT slice = 0; slice < oldCapacity; slice++ ) {
+        if ( texArray.slices[slice].owner == INVALID_TEXTURE_ID )
+            continue;
+
+        for ( UINT mip = 0; mip < mipLevels; mip++ ) {
+            pDeviceContext->CopySubresourceRegion( grown.pTexture, D3D11CalcSubresource( mip, slice, mipLevels ), 0, 0, 0,
+                                                   texArray.pTexture, D3D11CalcSubresource( mip, slice, mipLevels ), NULL );
+        }
+    }
+
+    texArray.pSRV->Release();
+    texArray.pTexture->Release();
+
+    texArray.pTexture = grown.pTexture;
+    texArray.pSRV = grown.pSRV;
+    texArray.desc = grown.desc;
+
+    Slice freeSlice = { INVALID_TEXTURE_ID, 0 };
+    texArray.slices.resize( newCapacity, freeSlice );
+
+    return true;
+}
+
+bool TextureArrayManager::allocateSlice( const D3D11_TEXTURE2D_DESC& sourceDesc, TextureSlot& slot )
+{
+    // 1. Free slice in a compatible array
+    for ( UINT a = 0; a < arrays.size(); a++ ) {
+        if ( !isCompatible( arrays[a].desc, sourceDesc ) )
+            continue;
+
+        for ( UINT s = 0; s < arrays[a].slices.size(); s++ ) {
+            if ( arrays[a].slices[s].owner == INVALID_TEXTURE_ID ) {
+                slot.arrayIndex = a;
+                slot.slice = s;
+                return true;
+            }
+        }
+    }
+
+    // 2. Grow a compatible array that hasn't reached its limit
+    for ( UINT a = 0; a < arrays.size(); a++ ) {
+        if ( !isCompatible( arrays[a].desc, sourceDesc ) )
+            continue;
+
+        UINT oldCapacity = arrays[a].desc.ArraySize;
+        if ( growArray( arrays[a] ) ) {
+            slot.arrayIndex = a;
+            slot.slice = oldCapacity;
+            return true;
+        }
+    }
+
+    // 3. Evict the least recently used slice that isn't used this frame
+    UINT64 oldestFrame = currentFrame;
+    bool found = false;
+    for ( UINT a = 0; a < arrays.size(); a++ ) {
+        if ( !isCompatible( arrays[a].desc, sourceDesc ) )
+            continue;
+
+        for ( UINT s = 0; s < arrays[a].slices.size(); s++ ) {
+            if ( arrays[a].slices[s].lastUsedFrame < oldestFrame ) {
+                oldestFrame = arrays[a].slices[s].lastUsedFrame;
+                slot.arrayIndex = a;
+                slot.slice = s;
+                found = true;
+            }
+        }
+    }
+
+    if ( found ) {
+        Slice& victim = arrays[slot.arrayIndex].slices[slot.slice];
+        textures[victim.owner].resident = false;
+        victim.owner = INVALID_TEXTURE_ID;
+        return true;
+    }
+
+    // 4. No room anywhere, start a new array for this size/format
+    TextureArray texArray;
+    UINT capacity = maxSlicesPerArray < 4 ? maxSlicesPerArray : 4;
+    if ( !createArray( sourceDesc, capacity, texArray ) )
+        return false;
+
+    Slice freeSlice = { INVALID_TEXTURE_ID, 0 };
+    texArray.slices.resize( capacity, freeSlice );
+    arrays.push_back( texArray );
+
+    slot.arrayIndex = (UINT)arrays.size() - 1;
+    slot.slice = 0;
+    return true;
+}
+
+bool TextureArrayManager::makeResident( TextureID id )
+{
+    TextureEntry& entry = textures[id];
+    if ( entry.resident )
+        return true;
+    if ( entry.fileName.empty() )
+        return false;
+
+    // - - - load texturefile with a full mip chain - - - //
+    ID3D11Resource* pSourceResource = NULL;
+    ID3D11ShaderResourceView* pSourceSRV = NULL;
+    HRESULT hr = DirectX::CreateWICTextureFromFileEx( pDevice, pDeviceContext, entry.fileName.c_str(), 0,
+                                                      D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET, 0,
+                                                      D3D11_RESOURCE_MISC_GENERATE_MIPS, DirectX::WIC_LOADER_DEFAULT,
+                                                      &pSourceResource, &pSourceSRV );
+    if ( FAILED(hr) ) {
+        OutputDebugStringA( "[TextureArrayManager] Failed to load texture file\n" );
+        return false;
+    }
+    pSourceSRV->Release();
+
+    ID3D11Texture2D* pSource = static_cast<ID3D11Texture2D*>( pSourceResource );
+    D3D11_TEXTURE2D_DESC sourceDesc;
+    pSource->GetDesc( &sourceDesc );
+
+    TextureSlot slot;
+    if ( !allocateSlice( sourceDesc, slot ) ) {
+        pSource->Release();
+        return false;
+    }
+
+    TextureArray& texArray = arrays[slot.arrayIndex];
+    for ( UINT mip = 0; mip < sourceDesc.MipLevels; mip++ ) {
+        pDeviceContext->CopySubresourceRegion( texArray.pTexture, D3D11CalcSubresource( mip, slot.slice, texArray.desc.MipLevels ), 0, 0, 0,
+                                               pSource, D3D11CalcSubresource( mip, 0, sourceDesc.MipLevels ), NULL );
+    }
+    pSource->Release();
+
+    texArray.slices[slot.slice].owner = id;
+    texArray.slices[slot.slice].lastUsedFrame = currentFrame;
+
+    entry.slot = slot;
+    entry.resident = true;
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+
+// * * * Useful * * * //
+#include <vector>
+#include <string>
+
+// * * * Texture IDs / slots * * * //
+typedef UINT TextureID;
+const TextureID INVALID_TEXTURE_ID = 0xFFFFFFFF;
+
+// Where a texture currently lives: which array (one SRV) and which slice inside it
+struct TextureSlot
+{
+    UINT arrayIndex;
+    UINT slice;
+};
+
+// * * * Texture2DArray manager * * * //
+// Packs textures with the same width/height/format/mips into slices of one Texture2DArray,
+// so draws that only differ in texture can share one SRV and pick the slice in the shader.
+// Arrays grow by doubling, and when an array hits its slice limit the least recently used
+// slice is evicted. Evicted textures are reloaded from file the next time they are used.
+class TextureArrayManager
+{
+public:
+    TextureArrayManager();
+
+    bool init( ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, UINT maxSlicesPerArray = 64 );
+    void release();
+
+    // Call once per frame, textures used in the current frame are never evicted
+    void beginFrame();
+
+    // Load a texture from file into a matching array, INVALID_TEXTURE_ID on failure
+    TextureID loadTexture( const wchar_t* fileName );
+    void unloadTexture( TextureID id );
+
+    // Make the texture resident (reload if evicted), mark it as used and return its slot
+    bool useTexture( TextureID id, TextureSlot& slot );
+
+    ID3D11ShaderResourceView* getSRV( UINT arrayIndex ) const;
+    UINT getArrayCount() const { return (UINT)arrays.size(); }
+
+private:
+    struct Slice
+    {
+        TextureID owner;            // INVALID_TEXTURE_ID when slice is free
+        UINT64 lastUsedFrame;
+    };
+
+    struct TextureArray
+    {
+        D3D11_TEXTURE2D_DESC desc;  // ArraySize = current capacity
+        ID3D11Texture2D* pTexture;
+        ID3D11ShaderResourceView* pSRV;
+        std::vector<Slice> slices;
+    };
+
+    struct TextureEntry
+    {
+        std::wstring fileName;
+        bool resident;
+        TextureSlot slot;
+    };
+
+    bool isCompatible( const D3D11_TEXTURE2D_DESC& a, const D3D11_TEXTURE2D_DESC& b ) const;
+    bool createArray( const D3D11_TEXTURE2D_DESC& sourceDesc, UINT capacity, TextureArray& texArray );
+    bool growArray( TextureArray& texArray );
+    bool allocateSlice( const D3D11_TEXTURE2D_DESC& sourceDesc, TextureSlot& slot );
+    bool makeResident( TextureID id );
+
+    ID3D11Device* pDevice;
+    ID3D11DeviceContext* pDeviceContext;
+    UINT maxSlicesPerArray;
+    UINT64 currentFrame;
+
+    std::vector<TextureArray> arrays;
+    std::vector<TextureEntry> textures;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Windows.h>
+
+// * * * High resolution CPU timer (QueryPerformanceCounter) * * * //
+class Timer
+{
+public:
+    Timer()
+    {
+        QueryPerformanceFrequency( &frequency );
+        reset();
+    }
+
+    void reset()
+    {
+        QueryPerformanceCounter( &start );
+    }
+
+    double elapsedMs() const
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter( &now );
+        return (double)( now.QuadPart - start.QuadPart ) * 1000.0 / (double)frequency.QuadPart;
+    }
+
+    double elapsedSeconds() const
+    {
+        return elapsedMs() / 1000.0;
+    }
+
+private:
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+};
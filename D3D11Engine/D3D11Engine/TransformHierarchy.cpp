@@ -0,0 +1,395 @@
+#include "TransformHierarchy.h"
+
+#include <string.h>
+#include <atomic>
+
+#include "JobSystem.h"
+#include "SimdLanes.h"
+
+const UINT transformParallelLevelSize = 16384;  // smaller levels aren't worth waking the workers
+const UINT transformJobBatchSize = 4096;        // nodes per job batch, a multiple of the SIMD width
+
+struct TransformArrays
+{
+    const float* pPosition[3];
+    const float* pRotation[4];
+    const float* pScale[3];
+    const UINT* pParentSlots;
+    const BYTE* pChanged;
+    DirectX::XMFLOAT4X4* pWorlds;
+};
+
+static const DirectX::XMFLOAT4X4 identityWorld( 1.0f, 0.0f, 0.0f, 0.0f,
+                                                0.0f, 1.0f, 0.0f, 0.0f,
+                                                0.0f, 0.0f, 1.0f, 0.0f,
+                                                0.0f, 0.0f, 0.0f, 1.0f );
+
+// world = scale * rotation * translation * parentWorld for Lanes::width nodes starting at first.
+// Parents are affine (last column 0, 0, 0, 1), so only 12 of the 16 entries are multiplied.
+template<typename Lanes>
+static void buildWorlds( const TransformArrays& arrays, UINT first, UINT laneCount )
+{
+    typedef typename Lanes::Reg Reg;
+    const UINT W = Lanes::width;
+
+    // - - - local rotation rows from the quaternions, scaled per row - - - //
+    Reg qx = Lanes::load( arrays.pRotation[0] + first );
+    Reg qy = Lanes::load( arrays.pRotation[1] + first );
+    Reg qz = Lanes::load( arrays.pRotation[2] + first );
+    Reg qw = Lanes::load( arrays.pRotation[3] + first );
+
+    Reg x2 = Lanes::add( qx, qx ), y2 = Lanes::add( qy, qy ), z2 = Lanes::add( qz, qz );
+    Reg xx = Lanes::mul( qx, x2 ), yy = Lanes::mul( qy, y2 ), zz = Lanes::mul( qz, z2 );
+    Reg xy = Lanes::mul( qx, y2 ), xz = Lanes::mul( qx, z2 ), yz = Lanes::mul( qy, z2 );
+    Reg wx = Lanes::mul( qw, x2 ), wy = Lanes::mul( qw, y2 ), wz = Lanes::mul( qw, z2 );
+    Reg one = Lanes::set( 1.0f );
+
+    Reg sx = Lanes::load( arrays.pScale[0] + first );
+    Reg sy = Lanes::load( arrays.pScale[1] + first );
+    Reg sz = Lanes::load( arrays.pScale[2] + first );
+
+    Reg local[4][3];
+    local[0][0] = Lanes::mul( Lanes::sub( one, Lanes::add( yy, zz ) ), sx );
+    local[0][1] = Lanes::mul( Lanes::add( xy, wz ), sx );
+    local[0][2] = Lanes::mul( Lanes::sub( xz, wy ), sx );
+    local[1][0] = Lanes::mul( Lanes::sub( xy, wz ), sy );
+    local[1][1] = Lanes::mul( Lanes::sub( one, Lanes::add( xx, zz ) ), sy );
+    local[1][2] = Lanes::mul( Lanes::add( yz, wx ), sy );
+    local[2][0] = Lanes::mul( Lanes::add( xz, wy ), sz );
+    local[2][1] = Lanes::mul( Lanes::sub( yz, wx ), sz );
+    local[2][2] = Lanes::mul( Lanes::sub( one, Lanes::add( xx, yy ) ), sz );
+    local[3][0] = Lanes::load( arrays.pPosition[0] + first );
+    local[3][1] = Lanes::load( arrays.pPosition[1] + first );
+    local[3][2] = Lanes::load( arrays.pPosition[2] + first );
+
+    // - - - gather the parent worlds into lanes, roots and padding lanes use identity - - - //
+    alignas(32) float parentLanes[12][W];
+    for ( UINT lane = 0; lane < W; lane++ ) {
+        UINT parentSlot = ( lane < laneCount ) ? arrays.pParentSlots[first + lane] : INVALID_TRANSFORM_ID;
+        const DirectX::XMFLOAT4X4& parent = ( parentSlot != INVALID_TRANSFORM_ID ) ? arrays.pWorlds[parentSlot] : identityWorld;
+
+        for ( UINT row = 0; row < 4; row++ )
+            for ( UINT column = 0; column < 3; column++ )
+                parentLanes[row * 3 + column][lane] = parent.m[row][column];
+    }
+
+    Reg parent[4][3];
+    for ( UINT row = 0; row < 4; row++ )
+        for ( UINT column = 0; column < 3; column++ )
+            parent[row][column] = Lanes::loadAligned( parentLanes[row * 3 + column] );
+
+    // - - - local * parent - - - //
+    alignas(32) float worldLanes[12][W];
+    for ( UINT row = 0; row < 4; row++ ) {
+        for ( UINT column = 0; column < 3; column++ ) {
+            Reg sum = Lanes::add( Lanes::add( Lanes::mul( local[row][0], parent[0][column] ),
+                                              Lanes::mul( local[row][1], parent[1][column] ) ),
+                                              Lanes::mul( local[row][2], parent[2][column] ) );
+            if ( row == 3 )
+                sum = Lanes::add( sum, parent[3][column] );
+
+            Lanes::storeAligned( worldLanes[row * 3 + column], sum );
+        }
+    }
+
+    for ( UINT lane = 0; lane < laneCount; lane++ ) {
+        if ( !arrays.pChanged[first + lane] )
+            continue;
+
+        DirectX::XMFLOAT4X4& world = arrays.pWorlds[first + lane];
+        for ( UINT row = 0; row < 4; row++ ) {
+            world.m[row][0] = worldLanes[row * 3 + 0][lane];
+            world.m[row][1] = worldLanes[row * 3 + 1][lane];
+            world.m[row][2] = worldLanes[row * 3 + 2][lane];
+            world.m[row][3] = ( row == 3 ) ? 1.0f : 0.0f;
+        }
+    }
+}
+
+// * * * * * HIERARCHY * * * * * //
+TransformHierarchy::TransformHierarchy()
+    : sorted( true ), levelsValid( true ), anyDirty( false ), anyChanged( false ), updatedCount( 0 )
+{
+}
+
+void TransformHierarchy::reserve( UINT nodeCount )
+{
+    std::vector<float>* floatArrays[] = { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ };
+    for ( UINT a = 0; a < ARRAYSIZE(floatArrays); a++ )
+        floatArrays[a]->reserve( nodeCount + simdMaxWidth );
+
+    parentSlots.reserve( nodeCount );
+    depths.reserve( nodeCount );
+    dirty.reserve( nodeCount );
+    changed.reserve( nodeCount );
+    worlds.reserve( nodeCount );
+    ids.reserve( nodeCount );
+    slots.reserve( nodeCount );
+}
+
+void TransformHierarchy::clear()
+{
+    std::vector<float>* floatArrays[] = { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ };
+    for ( UINT a = 0; a < ARRAYSIZE(floatArrays); a++ )
+        floatArrays[a]->clear();
+
+    parentSlots.clear();
+    depths.clear();
+    dirty.clear();
+    changed.clear();
+    worlds.clear();
+    ids.clear();
+    slots.clear();
+    levelStarts.clear();
+
+    sorted = true;
+    levelsValid = true;
+    anyDirty = false;
+    anyChanged = false;
+    updatedCount = 0;
+}
+
+// Writes slot n and keeps the zero padding behind it
+static void appendPadded( std::vector<float>& values, UINT n, float value )
+{
+    values.resize( n + 1 + simdMaxWidth, 0.0f );
+    values[n] = value;
+}
+
+TransformID TransformHierarchy::addNode( TransformID parent, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT4& rotation, const DirectX::XMFLOAT3& scale )
+{
+    UINT n = (UINT)ids.size();
+    if ( parent != INVALID_TRANSFORM_ID && parent >= n )
+        return INVALID_TRANSFORM_ID;
+
+    UINT parentSlot = ( parent != INVALID_TRANSFORM_ID ) ? slots[parent] : INVALID_TRANSFORM_ID;
+    UINT depth = ( parent != INVALID_TRANSFORM_ID ) ? depths[parentSlot] + 1 : 0;
+
+    DirectX::XMFLOAT4 unitRotation;
+    DirectX::XMStoreFloat4( &unitRotation, DirectX::XMQuaternionNormalize( DirectX::XMLoadFloat4( &rotation ) ) );
+
+    // New nodes go to the end, update() moves them into their level
+    appendPadded( positionX, n, position.x );
+    appendPadded( positionY, n, position.y );
+    appendPadded( positionZ, n, position.z );
+    appendPadded( rotationX, n, unitRotation.x );
+    appendPadded( rotationY, n, unitRotation.y );
+    appendPadded( rotationZ, n, unitRotation.z );
+    appendPadded( rotationW, n, unitRotation.w );
+    appendPadded( scaleX, n, scale.x );
+    appendPadded( scaleY, n, scale.y );
+    appendPadded( scaleZ, n, scale.z );
+
+    parentSlots.push_back( parentSlot );
+    depths.push_back( depth );
+    dirty.push_back( 1 );
+    changed.push_back( 0 );
+    worlds.push_back( identityWorld );
+    ids.push_back( n );
+    slots.push_back( n );
+
+    if ( n > 0 && depth < depths[n - 1] )
+        sorted = false;
+    levelsValid = false;
+    anyDirty = true;
+
+    return n;
+}
+
+TransformID TransformHierarchy::addNode( TransformID parent )
+{
+    return addNode( parent, DirectX::XMFLOAT3( 0.0f, 0.0f, 0.0f ), DirectX::XMFLOAT4( 0.0f, 0.0f, 0.0f, 1.0f ), DirectX::XMFLOAT3( 1.0f, 1.0f, 1.0f ) );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void TransformHierarchy::setPosition( TransformID id, const DirectX::XMFLOAT3& position )
+{
+    UINT slot = slots[id];
+    positionX[slot] = position.x;
+    positionY[slot] = position.y;
+    positionZ[slot] = position.z;
+    markDirty( slot );
+}
+
+void TransformHierarchy::setRotation( TransformID id, const DirectX::XMFLOAT4& rotation )
+{
+    setRotation( id, DirectX::XMLoadFloat4( &rotation ) );
+}
+
+void TransformHierarchy::setRotation( TransformID id, DirectX::FXMVECTOR rotation )
+{
+    DirectX::XMFLOAT4 unitRotation;
+    DirectX::XMStoreFloat4( &unitRotation, DirectX::XMQuaternionNormalize( rotation ) );
+
+    UINT slot = slots[id];
+    rotationX[slot] = unitRotation.x;
+    rotationY[slot] = unitRotation.y;
+    rotationZ[slot] = unitRotation.z;
+    rotationW[slot] = unitRotation.w;
+    markDirty( slot );
+}
+
+void TransformHierarchy::setScale( TransformID id, const DirectX::XMFLOAT3& scale )
+{
+    UINT slot = slots[id];
+    scaleX[slot] = scale.x;
+    scaleY[slot] = scale.y;
+    scaleZ[slot] = scale.z;
+    markDirty( slot );
+}
+
+DirectX::XMFLOAT3 TransformHierarchy::getPosition( TransformID id ) const
+{
+    UINT slot = slots[id];
+    return DirectX::XMFLOAT3( positionX[slot], positionY[slot], positionZ[slot] );
+}
+
+DirectX::XMFLOAT4 TransformHierarchy::getRotation( TransformID id ) const
+{
+    UINT slot = slots[id];
+    return DirectX::XMFLOAT4( rotationX[slot], rotationY[slot], rotationZ[slot], rotationW[slot] );
+}
+
+DirectX::XMFLOAT3 TransformHierarchy::getScale( TransformID id ) const
+{
+    UINT slot = slots[id];
+    return DirectX::XMFLOAT3( scaleX[slot], scaleY[slot], scaleZ[slot] );
+}
+
+TransformID TransformHierarchy::getParent( TransformID id ) const
+{
+    UINT parentSlot = parentSlots[slots[id]];
+    return ( parentSlot != INVALID_TRANSFORM_ID ) ? ids[parentSlot] : INVALID_TRANSFORM_ID;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+template<typename T>
+static void permute( std::vector<T>& values, const std::vector<UINT>& newSlots )
+{
+    std::vector<T> permuted( values.size() );   // float padding stays zero
+    for ( size_t s = 0; s < newSlots.size(); s++ )
+        permuted[newSlots[s]] = values[s];
+    values.swap( permuted );
+}
+
+// Stable counting sort by depth: every level becomes one slot range, parents before children
+void TransformHierarchy::sortByDepth()
+{
+    UINT n = (UINT)ids.size();
+
+    UINT levelCount = 0;
+    for ( UINT s = 0; s < n; s++ )
+        levelCount = ( depths[s] + 1 > levelCount ) ? depths[s] + 1 : levelCount;
+
+    levelStarts.assign( levelCount + 1, 0 );
+    for ( UINT s = 0; s < n; s++ )
+        levelStarts[depths[s] + 1]++;
+    for ( UINT d = 0; d < levelCount; d++ )
+        levelStarts[d + 1] += levelStarts[d];
+
+    if ( !sorted ) {
+        std::vector<UINT> cursors( levelStarts.begin(), levelStarts.end() - 1 );
+        std::vector<UINT> newSlots( n );
+        for ( UINT s = 0; s < n; s++ )
+            newSlots[s] = cursors[depths[s]]++;
+
+        std::vector<float>* floatArrays[] = { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ };
+        for ( UINT a = 0; a < ARRAYSIZE(floatArrays); a++ )
+            permute( *floatArrays[a], newSlots );
+
+        permute( parentSlots, newSlots );
+        permute( depths, newSlots );
+        permute( dirty, newSlots );
+        permute( changed, newSlots );
+        permute( worlds, newSlots );
+        permute( ids, newSlots );
+
+        for ( UINT s = 0; s < n; s++ ) {
+            if ( parentSlots[s] != INVALID_TRANSFORM_ID )
+                parentSlots[s] = newSlots[parentSlots[s]];
+            slots[ids[s]] = s;
+        }
+        sorted = true;
+    }
+    levelsValid = true;
+}
+
+// Slots of one level: propagate the dirty flags from the parents, then rebuild the batches that
+// contain a changed node
+UINT TransformHierarchy::updateRange( UINT begin, UINT end )
+{
+    TransformArrays arrays;
+    arrays.pPosition[0] = positionX.data();
+    arrays.pPosition[1] = positionY.data();
+    arrays.pPosition[2] = positionZ.data();
+    arrays.pRotation[0] = rotationX.data();
+    arrays.pRotation[1] = rotationY.data();
+    arrays.pRotation[2] = rotationZ.data();
+    arrays.pRotation[3] = rotationW.data();
+    arrays.pScale[0] = scaleX.data();
+    arrays.pScale[1] = scaleY.data();
+    arrays.pScale[2] = scaleZ.data();
+    arrays.pParentSlots = parentSlots.data();
+    arrays.pChanged = changed.data();
+    arrays.pWorlds = worlds.data();
+
+    const UINT W = SimdLanes::width;
+    UINT updated = 0;
+
+    for ( UINT first = begin; first < end; first += W ) {
+        UINT laneCount = ( end - first < W ) ? end - first : W;
+
+        BYTE batchChanged = 0;
+        for ( UINT s = first; s < first + laneCount; s++ ) {
+            UINT parentSlot = parentSlots[s];
+            BYTE nodeChanged = dirty[s] | ( ( parentSlot != INVALID_TRANSFORM_ID ) ? changed[parentSlot] : 0 );
+            changed[s] = nodeChanged;
+            dirty[s] = 0;
+
+            batchChanged |= nodeChanged;
+            updated += nodeChanged;
+        }
+
+        if ( batchChanged )
+            buildWorlds<SimdLanes>( arrays, first, laneCount );
+    }
+
+    return updated;
+}
+
+void TransformHierarchy::update( JobSystem* pJobSystem )
+{
+    if ( !anyDirty ) {
+        // Nothing moved, only last update's flags have to go
+        if ( anyChanged )
+            memset( changed.data(), 0, changed.size() );
+        anyChanged = false;
+        updatedCount = 0;
+        return;
+    }
+
+    if ( !levelsValid )
+        sortByDepth();
+
+    std::atomic<UINT> updated( 0 );
+    for ( UINT d = 0; d + 1 < levelStarts.size(); d++ ) {
+        UINT begin = levelStarts[d];
+        UINT levelSize = levelStarts[d + 1] - begin;
+
+        // Levels depend on each other, the nodes inside one level don't
+        if ( pJobSystem && levelSize >= transformParallelLevelSize ) {
+            pJobSystem->parallelFor( levelSize, transformJobBatchSize, [&]( UINT batchBegin, UINT batchEnd ) {
+                updated += updateRange( begin + batchBegin, begin + batchEnd );
+            } );
+        }
+        else {
+            updated += updateRange( begin, begin + levelSize );
+        }
+    }
+
+    updatedCount = updated.load();
+    anyDirty = false;
+    anyChanged = updatedCount > 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Windows.h>
+#include <DirectXMath.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+class JobSystem;
+
+// * * * Transform IDs * * * //
+typedef UINT TransformID;
+const TransformID INVALID_TRANSFORM_ID = 0xFFFFFFFF;
+
+// * * * Scene transform hierarchy * * * //
+// Local position / rotation (quaternion) / scale live in structure of arrays, ordered by depth so
+// every level is one contiguous range whose parents all sit in earlier levels. update() walks the
+// levels in order and builds the world matrices of 4 nodes at a time with SSE (8 with AVX when the
+// build targets it), large levels are split over the job system. Only nodes whose local transform
+// changed, or whose parent's world matrix changed, are rebuilt.
+//
+// IDs stay valid for the lifetime of the hierarchy, the storage order behind them is private.
+// A parent has to be added before its children.
+class TransformHierarchy
+{
+public:
+    TransformHierarchy();
+
+    void reserve( UINT nodeCount );
+    void clear();
+
+    TransformID addNode( TransformID parent, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT4& rotation, const DirectX::XMFLOAT3& scale );
+    TransformID addNode( TransformID parent = INVALID_TRANSFORM_ID );
+
+    void setPosition( TransformID id, const DirectX::XMFLOAT3& position );
+    void setRotation( TransformID id, const DirectX::XMFLOAT4& rotation );
+    void setRotation( TransformID id, DirectX::FXMVECTOR rotation );
+    void setScale( TransformID id, const DirectX::XMFLOAT3& scale );
+
+    DirectX::XMFLOAT3 getPosition( TransformID id ) const;
+    DirectX::XMFLOAT4 getRotation( TransformID id ) const;
+    DirectX::XMFLOAT3 getScale( TransformID id ) const;
+    TransformID getParent( TransformID id ) const;
+
+    // Rebuilds the dirty world matrices. pJobSystem NULL = single threaded
+    void update( JobSystem* pJobSystem = NULL );
+
+    // Valid after update()
+    DirectX::XMMATRIX getWorldMatrix( TransformID id ) const { return DirectX::XMLoadFloat4x4( &worlds[slots[id]] ); }
+    const DirectX::XMFLOAT4X4& getWorld( TransformID id ) const { return worlds[slots[id]]; }
+
+    // True when the last update() rebuilt the node's world matrix
+    bool worldChanged( TransformID id ) const { return changed[slots[id]] != 0; }
+
+    UINT getNodeCount() const { return (UINT)ids.size(); }
+    UINT getLevelCount() const { return levelStarts.empty() ? 0 : (UINT)levelStarts.size() - 1; }
+    UINT getUpdatedCount() const { return updatedCount; }
+
+private:
+    void markDirty( UINT slot ) { dirty[slot] = 1; anyDirty = true; }
+    void sortByDepth();
+    UINT updateRange( UINT begin, UINT end );
+
+    // Per slot (storage order), float arrays are padded for the last SIMD batch
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+    std::vector<UINT> parentSlots;          // INVALID_TRANSFORM_ID for roots
+    std::vector<UINT> depths;
+    std::vector<BYTE> dirty;                // local transform changed since the last update
+    std::vector<BYTE> changed;              // world matrix rebuilt by the last update
+    std::vector<DirectX::XMFLOAT4X4> worlds;
+
+    std::vector<TransformID> ids;           // slot -> id
+    std::vector<UINT> slots;                // id -> slot
+
+    std::vector<UINT> levelStarts;          // slot range of depth d = [levelStarts[d], levelStarts[d + 1])
+    bool sorted;                            // slots are in depth order
+    bool levelsValid;                       // levelStarts matches the node set
+    bool anyDirty;
+    bool anyChanged;
+    UINT updatedCount;
+};
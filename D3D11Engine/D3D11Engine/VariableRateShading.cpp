@@ -0,0 +1,53 @@
+#include "VariableRateShading.h"
+
+#include <math.h>
+
+// * * * * * SHADING RATE IMAGE * * * * * //
+ShadingRateImage::ShadingRateImage()
+    : width( 0 ), height( 0 ), tileSize( 16 ), tilesX( 0 ), tilesY( 0 )
+{
+}
+
+void ShadingRateImage::resize( UINT width, UINT height, UINT tileSize )
+{
+    this->width = width;
+    this->height = height;
+    this->tileSize = std::max( ( tileSize + 3 ) & ~3u, 4u );
+    tilesX = ( width + this->tileSize - 1 ) / this->tileSize;
+    tilesY = ( height + this->tileSize - 1 ) / this->tileSize;
+    rates.assign( tilesX * tilesY, (BYTE)SHADING_RATE_1X1 );
+}
+
+void ShadingRateImage::fill( ShadingRate rate )
+{
+    std::fill( rates.begin(), rates.end(), (BYTE)rate );
+}
+
+void ShadingRateImage::selectFromContrast( const float* pLuminance, const ShadingRateSettings& settings )
+{
+    for ( UINT tileY = 0; tileY < tilesY; tileY++ ) {
+        for ( UINT tileX = 0; tileX < tilesX; tileX++ ) {
+            UINT endX = std::min( ( tileX + 1 ) * tileSize, width );
+            UINT endY = std::min( ( tileY + 1 ) * tileSize, height );
+
+            // Steps to the right and lower neighbour, also across the tile border
+            float contrast = 0.0f;
+            for ( UINT y = tileY * tileSize; y < endY; y++ ) {
+                const float* pRow = pLuminance + y * width;
+                for ( UINT x = tileX * tileSize; x < endX; x++ ) {
+                    if ( x + 1 < width )
+                        contrast = std::max( contrast, fabsf( pRow[x + 1] - pRow[x] ) );
+                    if ( y + 1 < height )
+                        contrast = std::max( contrast, fabsf( pRow[x + width] - pRow[x] ) );
+                }
+            }
+
+            ShadingRate rate = SHADING_RATE_2X2;
+            if ( contrast > settings.fineContrast )
+                rate = SHADING_RATE_1X1;
+            else if ( contrast < settings.coarseContrast )
+                rate = SHADING_RATE_4X4;
+            setTileRate( tileX, tileY, rate );
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+
+// * * * Win Headers * * * //
+#include <Windows.h>
+
+// * * * Useful * * * //
+#include <vector>
+#include <algorithm>
+
+#include "VisibilityBuffer.h"
+#include "Timer.h"
+
+// Pixels per side of a coarse pixel
+enum ShadingRate
+{
+    SHADING_RATE_1X1 = 1,
+    SHADING_RATE_2X2 = 2,
+    SHADING_RATE_4X4 = 4,
+};
+
+// Largest luminance step between neighbouring pixels of a tile -> rate:
+// above fineContrast 1x1, below coarseContrast 4x4, 2x2 in between
+struct ShadingRateSettings
+{
+    float fineContrast;
+    float coarseContrast;
+};
+
+// Counters of the last shadeVariableRate
+struct VariableRateStats
+{
+    UINT tiles[3];                      // 1x1, 2x2, 4x4
+    UINT64 shadedSamples;               // shade calls
+    UINT64 coveredPixels;               // pixels written
+    double shadeMs;
+};
+
+// * * * Shading rate image * * * //
+// One rate per tileSize x tileSize tile of the screen, like a D3D12 tier 2 rate image. tileSize is
+// a multiple of 4 so coarse pixels never straddle tiles. Set by hand (fill / setTileRate) or from the
+// contrast of a luminance image, usually the last frame's
+class ShadingRateImage
+{
+public:
+    ShadingRateImage();
+
+    void resize( UINT width, UINT height, UINT tileSize );
+    void fill( ShadingRate rate );
+    void setTileRate( UINT tileX, UINT tileY, ShadingRate rate ) { rates[tileY * tilesX + tileX] = (BYTE)rate; }
+    // pLuminance: width * height
+    void selectFromContrast( const float* pLuminance, const ShadingRateSettings& settings );
+
+    ShadingRate getTileRate( UINT tileX, UINT tileY ) const { return (ShadingRate)rates[tileY * tilesX + tileX]; }
+    UINT getTileSize() const { return tileSize; }
+    UINT getTilesX() const { return tilesX; }
+    UINT getTilesY() const { return tilesY; }
+
+private:
+    UINT width, height;
+    UINT tileSize;
+    UINT tilesX, tilesY;
+    std::vector<BYTE> rates;
+};
+
+// * * * Coarse shading of the CPU visibility buffer * * * //
+// Every coarse pixel is shaded once per triangle that covers it, at the coarse pixel's center (the
+// attributes extrapolate outside the triangle, like hardware VRS), and the color goes to all of that
+// triangle's pixels in it. shade( drawId, triangle, x, y ) returns the color at pixel position x, y.
+// pColors is width * height of the visibility buffer, uncovered pixels keep their color
+template<typename ShadeFunction>
+void shadeVariableRate( const SoftwareVisibilityBuffer& visibility, const ShadingRateImage& rates, const ShadeFunction& shade,
+                        DirectX::XMFLOAT3* pColors, VariableRateStats& stats )
+{
+    Timer timer;
+    ZeroMemory( &stats, sizeof(VariableRateStats) );
+
+    const UINT width = visibility.getWidth(), height = visibility.getHeight();
+    const UINT tileSize = rates.getTileSize();
+
+    for ( UINT tileY = 0; tileY < rates.getTilesY(); tileY++ ) {
+        for ( UINT tileX = 0; tileX < rates.getTilesX(); tileX++ ) {
+            const UINT rate = rates.getTileRate( tileX, tileY );
+            stats.tiles[rate == SHADING_RATE_1X1 ? 0 : ( rate == SHADING_RATE_2X2 ? 1 : 2 )]++;
+
+            const UINT endX = std::min( ( tileX + 1 ) * tileSize, width );
+            const UINT endY = std::min( ( tileY + 1 ) * tileSize, height );
+
+            for ( UINT y0 = tileY * tileSize; y0 < endY; y0 += rate ) {
+                for ( UINT x0 = tileX * tileSize; x0 < endX; x0 += rate ) {
+                    const UINT x1 = std::min( x0 + rate, endX ), y1 = std::min( y0 + rate, endY );
+                    const float centerX = ( x0 + x1 ) * 0.5f, centerY = ( y0 + y1 ) * 0.5f;
+
+                    // Up to 16 pixels, a bit per pixel that has its color
+                    UINT done = 0;
+                    for ( UINT y = y0; y < y1; y++ ) {
+                        for ( UINT x = x0; x < x1; x++ ) {
+                            UINT bit = 1u << ( ( y - y0 ) * rate + ( x - x0 ) );
+                            if ( done & bit )
+                                continue;
+
+                            UINT drawId = visibility.getDrawId( x, y );
+                            if ( drawId == 0 ) {
+                                done |= bit;
+                                continue;
+                            }
+
+                            UINT triangle = visibility.getTriangle( x, y );
+                            DirectX::XMFLOAT3 color = shade( drawId, triangle, centerX, centerY );
+                            stats.shadedSamples++;
+
+                            // Broadcast to the rest of the coarse pixel on the same triangle
+                            for ( UINT by = y; by < y1; by++ ) {
+                                for ( UINT bx = ( by == y ? x : x0 ); bx < x1; bx++ ) {
+                                    UINT otherBit = 1u << ( ( by - y0 ) * rate + ( bx - x0 ) );
+                                    if ( ( done & otherBit ) || visibility.getDrawId( bx, by ) != drawId || visibility.getTriangle( bx, by ) != triangle )
+                                        continue;
+
+                                    pColors[by * width + bx] = color;
+                                    done |= otherBit;
+                                    stats.coveredPixels++;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    stats.shadeMs = timer.elapsedMs();
+}
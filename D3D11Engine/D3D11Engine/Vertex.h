@@ -0,0 +1,39 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+
+// * * * Full precision vertex - used at import time * * * //
+struct Vertex
+{    
+    Vertex() { }
+    Vertex( float x, float y, float z,
+            float colRed, float colGreen, float colBlue, float colAlpha, 
+            float u, float v,
+            float nx, float ny, float nz ) 
+            : pos( x, y, z ), col( colRed, colGreen, colBlue, colAlpha ), normal( nx, ny, nz ), texcoord( u, v ) { }
+
+    DirectX::XMFLOAT3 pos;
+    DirectX::XMFLOAT4 col;
+    DirectX::XMFLOAT3 normal;
+    DirectX::XMFLOAT2 texcoord;
+};
+
+// * * * Quantized vertex - what the GPU reads (20 bytes instead of 48) * * * //
+struct PackedVertex
+{
+    DirectX::PackedVector::XMSHORTN4 pos;       // R16G16B16A16_SNORM, decoded with VertexQuantization
+    DirectX::PackedVector::XMSHORTN2 normal;    // R16G16_SNORM, octahedral encoded
+    DirectX::PackedVector::XMHALF2 texcoord;    // R16G16_FLOAT
+    DirectX::PackedVector::XMUBYTEN4 col;       // R8G8B8A8_UNORM
+};
+
+static_assert( sizeof(PackedVertex) == 20, "PackedVertex must match the input layout" );
+
+// Position decode: pos = snorm * positionScale + positionOffset (per mesh bounds)
+struct VertexQuantization
+{
+    DirectX::XMFLOAT3 positionScale;
+    DirectX::XMFLOAT3 positionOffset;
+};
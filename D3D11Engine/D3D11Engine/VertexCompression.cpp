@@ -0,0 +1,206 @@
+#include "VertexCompression.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <float.h>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+static float signNotZero( float v )
+{
+    return ( v >= 0.0f ) ? 1.0f : -1.0f;
+}
+
+static float snorm16ToFloat( short v )
+{
+    float f = (float)v / 32767.0f;
+    return ( f < -1.0f ) ? -1.0f : f;
+}
+
+XMFLOAT2 encodeOctahedral( const XMFLOAT3& normal )
+{
+    float invL1 = 1.0f / ( fabsf( normal.x ) + fabsf( normal.y ) + fabsf( normal.z ) );
+    float x = normal.x * invL1;
+    float y = normal.y * invL1;
+
+    // Lower hemisphere folds over the diagonals
+    if ( normal.z < 0.0f ) {
+        float foldedX = ( 1.0f - fabsf( y ) ) * signNotZero( x );
+        float foldedY = ( 1.0f - fabsf( x ) ) * signNotZero( y );
+        x = foldedX;
+        y = foldedY;
+    }
+    return XMFLOAT2( x, y );
+}
+
+XMFLOAT3 decodeOctahedral( const XMFLOAT2& encoded )
+{
+    XMFLOAT3 n( encoded.x, encoded.y, 1.0f - fabsf( encoded.x ) - fabsf( encoded.y ) );
+    float t = ( -n.z > 0.0f ) ? -n.z : 0.0f;
+    n.x += ( n.x >= 0.0f ) ? -t : t;
+    n.y += ( n.y >= 0.0f ) ? -t : t;
+
+    float invLength = 1.0f / sqrtf( n.x * n.x + n.y * n.y + n.z * n.z );
+    return XMFLOAT3( n.x * invLength, n.y * invLength, n.z * invLength );
+}
+
+// Tries the four floor/ceil combinations around the encoded value and keeps the most accurate one
+static XMSHORTN2 encodeOctahedralPrecise( const XMFLOAT3& normal )
+{
+    XMFLOAT2 encoded = encodeOctahedral( normal );
+
+    float baseX = floorf( encoded.x * 32767.0f );
+    float baseY = floorf( encoded.y * 32767.0f );
+
+    XMSHORTN2 best;
+    float bestDot = -2.0f;
+    for ( int i = 0; i < 4; i++ ) {
+        float qx = baseX + (float)( i & 1 );
+        float qy = baseY + (float)( i >> 1 );
+        if ( qx < -32767.0f || qx > 32767.0f || qy < -32767.0f || qy > 32767.0f )
+            continue;
+
+        XMFLOAT3 decoded = decodeOctahedral( XMFLOAT2( qx / 32767.0f, qy / 32767.0f ) );
+        float d = decoded.x * normal.x + decoded.y * normal.y + decoded.z * normal.z;
+        if ( d > bestDot ) {
+            bestDot = d;
+            best.x = (short)qx;
+            best.y = (short)qy;
+        }
+    }
+    return best;
+}
+
+VertexQuantization computeVertexQuantization( const Vertex* pVertices, UINT vertexCount )
+{
+    XMFLOAT3 minPos( FLT_MAX, FLT_MAX, FLT_MAX );
+    XMFLOAT3 maxPos( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+    for ( UINT i = 0; i < vertexCount; i++ ) {
+        const XMFLOAT3& p = pVertices[i].pos;
+        minPos.x = ( p.x < minPos.x ) ? p.x : minPos.x;
+        minPos.y = ( p.y < minPos.y ) ? p.y : minPos.y;
+        minPos.z = ( p.z < minPos.z ) ? p.z : minPos.z;
+        maxPos.x = ( p.x > maxPos.x ) ? p.x : maxPos.x;
+        maxPos.y = ( p.y > maxPos.y ) ? p.y : maxPos.y;
+        maxPos.z = ( p.z > maxPos.z ) ? p.z : maxPos.z;
+    }
+
+    VertexQuantization quantization;
+    if ( vertexCount == 0 ) {
+        quantization.positionScale = XMFLOAT3( 1.0f, 1.0f, 1.0f );
+        quantization.positionOffset = XMFLOAT3( 0.0f, 0.0f, 0.0f );
+        return quantization;
+    }
+
+    // Center of bounds -> offset, half extents -> scale. Flat axes keep a non-zero scale
+    quantization.positionOffset = XMFLOAT3( ( minPos.x + maxPos.x ) * 0.5f, ( minPos.y + maxPos.y ) * 0.5f, ( minPos.z + maxPos.z ) * 0.5f );
+    quantization.positionScale = XMFLOAT3( ( maxPos.x - minPos.x ) * 0.5f, ( maxPos.y - minPos.y ) * 0.5f, ( maxPos.z - minPos.z ) * 0.5f );
+
+    if ( quantization.positionScale.x <= 0.0f ) quantization.positionScale.x = 1.0f;
+    if ( quantization.positionScale.y <= 0.0f ) quantization.positionScale.y = 1.0f;
+    if ( quantization.positionScale.z <= 0.0f ) quantization.positionScale.z = 1.0f;
+
+    return quantization;
+}
+
+void compressVertices( const Vertex* pVertices, UINT vertexCount, const VertexQuantization& quantization, PackedVertex* pPackedVertices )
+{
+    XMVECTOR offset = XMLoadFloat3( &quantization.positionOffset );
+    XMVECTOR invScale = XMVectorReciprocal( XMVectorSetW( XMLoadFloat3( &quantization.positionScale ), 1.0f ) );
+
+    for ( UINT i = 0; i < vertexCount; i++ ) {
+        const Vertex& v = pVertices[i];
+        PackedVertex& packed = pPackedVertices[i];
+
+        // Position in [-1, 1] relative to the bounds
+        XMVECTOR pos = XMVectorMultiply( XMVectorSubtract( XMLoadFloat3( &v.pos ), offset ), invScale );
+        XMStoreShortN4( &packed.pos, XMVectorSetW( pos, 0.0f ) );
+
+        // Normal - normalized first, the hand written quad normals aren't unit length
+        XMFLOAT3 normal;
+        XMStoreFloat3( &normal, XMVector3Normalize( XMLoadFloat3( &v.normal ) ) );
+        packed.normal = encodeOctahedralPrecise( normal );
+
+        packed.texcoord.x = XMConvertFloatToHalf( v.texcoord.x );
+        packed.texcoord.y = XMConvertFloatToHalf( v.texcoord.y );
+
+        XMStoreUByteN4( &packed.col, XMLoadFloat4( &v.col ) );
+    }
+}
+
+Vertex decompressVertex( const PackedVertex& packed, const VertexQuantization& quantization )
+{
+    Vertex v;
+
+    v.pos.x = snorm16ToFloat( packed.pos.x ) * quantization.positionScale.x + quantization.positionOffset.x;
+    v.pos.y = snorm16ToFloat( packed.pos.y ) * quantization.positionScale.y + quantization.positionOffset.y;
+    v.pos.z = snorm16ToFloat( packed.pos.z ) * quantization.positionScale.z + quantization.positionOffset.z;
+
+    v.normal = decodeOctahedral( XMFLOAT2( snorm16ToFloat( packed.normal.x ), snorm16ToFloat( packed.normal.y ) ) );
+
+    v.texcoord.x = XMConvertHalfToFloat( packed.texcoord.x );
+    v.texcoord.y = XMConvertHalfToFloat( packed.texcoord.y );
+
+    XMStoreFloat4( &v.col, XMLoadUByteN4( &packed.col ) );
+    return v;
+}
+
+VertexCompressionError measureCompressionError( const Vertex* pVertices, const PackedVertex* pPackedVertices, UINT vertexCount, const VertexQuantization& quantization )
+{
+    VertexCompressionError error;
+    ZeroMemory( &error, sizeof(VertexCompressionError) );
+
+    double positionSum = 0.0, normalSum = 0.0;
+    for ( UINT i = 0; i < vertexCount; i++ ) {
+        const Vertex& original = pVertices[i];
+        Vertex decoded = decompressVertex( pPackedVertices[i], quantization );
+
+        float dx = decoded.pos.x - original.pos.x;
+        float dy = decoded.pos.y - original.pos.y;
+        float dz = decoded.pos.z - original.pos.z;
+        float positionError = sqrtf( dx * dx + dy * dy + dz * dz );
+
+        XMVECTOR n = XMVector3Normalize( XMLoadFloat3( &original.normal ) );
+        float cosAngle = XMVectorGetX( XMVector3Dot( n, XMLoadFloat3( &decoded.normal ) ) );
+        cosAngle = ( cosAngle > 1.0f ) ? 1.0f : ( cosAngle < -1.0f ? -1.0f : cosAngle );
+        float normalError = acosf( cosAngle ) * 180.0f / XM_PI;
+
+        float texcoordError = fabsf( decoded.texcoord.x - original.texcoord.x );
+        float texcoordErrorV = fabsf( decoded.texcoord.y - original.texcoord.y );
+        texcoordError = ( texcoordErrorV > texcoordError ) ? texcoordErrorV : texcoordError;
+
+        float colorError = 0.0f;
+        const float* pOriginalColor = &original.col.x;
+        const float* pDecodedColor = &decoded.col.x;
+        for ( int c = 0; c < 4; c++ ) {
+            float e = fabsf( pDecodedColor[c] - pOriginalColor[c] );
+            colorError = ( e > colorError ) ? e : colorError;
+        }
+
+        error.maxPositionError = ( positionError > error.maxPositionError ) ? positionError : error.maxPositionError;
+        error.maxNormalError = ( normalError > error.maxNormalError ) ? normalError : error.maxNormalError;
+        error.maxTexcoordError = ( texcoordError > error.maxTexcoordError ) ? texcoordError : error.maxTexcoordError;
+        error.maxColorError = ( colorError > error.maxColorError ) ? colorError : error.maxColorError;
+
+        positionSum += positionError;
+        normalSum += normalError;
+    }
+
+    if ( vertexCount > 0 ) {
+        error.avgPositionError = (float)( positionSum / vertexCount );
+        error.avgNormalError = (float)( normalSum / vertexCount );
+    }
+    return error;
+}
+
+void logCompressionError( const char* meshName, const VertexCompressionError& error )
+{
+    char message[512];
+    sprintf_s( message, "[VertexCompression] %s: %u -> %u bytes/vertex | pos max %.6f avg %.6f | normal max %.4f avg %.4f deg | uv max %.6f | color max %.4f\n",
+               meshName, (UINT)sizeof(Vertex), (UINT)sizeof(PackedVertex),
+               error.maxPositionError, error.avgPositionError, error.maxNormalError, error.avgNormalError,
+               error.maxTexcoordError, error.maxColorError );
+    OutputDebugStringA( message );
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "Vertex.h"
+
+// * * * Import time conversion Vertex -> PackedVertex * * * //
+
+// Errors from quantization, measured by decoding the packed vertices again
+struct VertexCompressionError
+{
+    float maxPositionError;     // world units
+    float avgPositionError;
+    float maxNormalError;       // degrees
+    float avgNormalError;
+    float maxTexcoordError;
+    float maxColorError;
+};
+
+// Bounds based quantization so the 16 bit positions use the full range
+VertexQuantization computeVertexQuantization( const Vertex* pVertices, UINT vertexCount );
+
+void compressVertices( const Vertex* pVertices, UINT vertexCount, const VertexQuantization& quantization, PackedVertex* pPackedVertices );
+Vertex decompressVertex( const PackedVertex& packed, const VertexQuantization& quantization );
+
+VertexCompressionError measureCompressionError( const Vertex* pVertices, const PackedVertex* pPackedVertices, UINT vertexCount, const VertexQuantization& quantization );
+void logCompressionError( const char* meshName, const VertexCompressionError& error );
+
+// Octahedral normal encoding, in [-1, 1]
+DirectX::XMFLOAT2 encodeOctahedral( const DirectX::XMFLOAT3& normal );
+DirectX::XMFLOAT3 decodeOctahedral( const DirectX::XMFLOAT2& encoded );
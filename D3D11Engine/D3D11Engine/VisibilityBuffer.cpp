@@ -0,0 +1,497 @@
+#include "VisibilityBuffer.h"
+
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <algorithm>
+
+#include "SceneShaders.h"
+
+// * * * * * GPU BUFFERS * * * * * //
+// Immutable buffer the shading pass reads as a ByteAddressBuffer, bindFlags for the ID pass
+static bool createRawBuffer( ID3D11Device* pDevice, const void* pData, UINT bytes, UINT bindFlags, ID3D11Buffer** ppBuffer, ID3D11ShaderResourceView** ppSRV )
+{
+    D3D11_BUFFER_DESC bufferDesc;
+    ZeroMemory( &bufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+                bufferDesc.ByteWidth = bytes;
+                bufferDesc.BindFlags = bindFlags | D3D11_BIND_SHADER_RESOURCE;
+                bufferDesc.CPUAccessFlags = 0;
+                bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+
+    D3D11_SUBRESOURCE_DATA bufferData;
+    ZeroMemory( &bufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
+
+                bufferData.pSysMem = pData;
+
+    HRESULT hr = pDevice->CreateBuffer( &bufferDesc, &bufferData, ppBuffer );
+    if ( FAILED(hr) )
+        return false;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    ZeroMemory( &srvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC) );
+
+                srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+                srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+                srvDesc.BufferEx.FirstElement = 0;
+                srvDesc.BufferEx.NumElements = bytes / 4;
+                srvDesc.BufferEx.Flags = D3D11_BUFFEREX_SRV_FLAG_RAW;
+
+    hr = pDevice->CreateShaderResourceView( *ppBuffer, &srvDesc, ppSRV );
+    if ( FAILED(hr) ) {
+        ( *ppBuffer )->Release();
+        *ppBuffer = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static ID3D11PixelShader* createPixelShader( ID3D11Device* pDevice, ID3DBlob* pBlob )
+{
+    ID3D11PixelShader* pShader = NULL;
+    if ( pBlob )
+        pDevice->CreatePixelShader( pBlob->GetBufferPointer(), pBlob->GetBufferSize(), NULL, &pShader );
+    return pShader;
+}
+
+// * * * * * VISIBILITY BUFFER * * * * * //
+VisibilityBuffer::VisibilityBuffer()
+    : pIdTexture( NULL ), pIdRTV( NULL ), pIdSRV( NULL ),
+      pVertexBuffer( NULL ), pIndexBuffer( NULL ), pLightmapUvBuffer( NULL ), pDrawBuffer( NULL ),
+      pVertexSRV( NULL ), pIndexSRV( NULL ), pLightmapUvSRV( NULL ), pDrawSRV( NULL ), pObjectCBuffer( NULL ), pCBuffer( NULL ),
+      pIdVertexShader( NULL ), pShadeVertexShader( NULL ), pIdPixelShader( NULL ), pShadePixelShader( NULL ), pInputLayout( NULL ),
+      width( 0 ), height( 0 ), maxDraws( 0 )
+{
+    ZeroMemory( &stats, sizeof(VisibilityStats) );
+    DirectX::XMStoreFloat4x4( &viewProjection, DirectX::XMMatrixIdentity() );
+}
+
+bool VisibilityBuffer::init( ID3D11Device* pDevice, UINT width, UINT height, UINT maxDraws )
+{
+    this->width = width;
+    this->height = height;
+    this->maxDraws = maxDraws;
+
+    // * * * * * ID TARGET * * * * * //
+    D3D11_TEXTURE2D_DESC textureDesc;
+    ZeroMemory( &textureDesc, sizeof(D3D11_TEXTURE2D_DESC) );
+
+                textureDesc.Width = width;
+                textureDesc.Height = height;
+                textureDesc.MipLevels = 1;
+                textureDesc.ArraySize = 1;
+                textureDesc.Format = DXGI_FORMAT_R32G32_UINT;
+                textureDesc.SampleDesc.Count = 1;
+                textureDesc.SampleDesc.Quality = 0;
+                textureDesc.Usage = D3D11_USAGE_DEFAULT;
+                textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+                textureDesc.CPUAccessFlags = 0;
+                textureDesc.MiscFlags = 0;
+
+    if ( FAILED( pDevice->CreateTexture2D( &textureDesc, NULL, &pIdTexture ) ) ||
+         FAILED( pDevice->CreateRenderTargetView( pIdTexture, NULL, &pIdRTV ) ) ||
+         FAILED( pDevice->CreateShaderResourceView( pIdTexture, NULL, &pIdSRV ) ) ) {
+        release();
+        return false;
+    }
+
+    // * * * * * DRAW RECORDS + CONSTANTS * * * * * //
+    D3D11_BUFFER_DESC drawBufferDesc;
+    ZeroMemory( &drawBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                drawBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+                drawBufferDesc.ByteWidth = sizeof(VisibilityDraw) * std::max( maxDraws, 1u );
+                drawBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+                drawBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+                drawBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+                drawBufferDesc.StructureByteStride = sizeof(VisibilityDraw);
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC drawSrvDesc;
+    ZeroMemory( &drawSrvDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC) );
+
+                drawSrvDesc.Format = DXGI_FORMAT_UNKNOWN;
+                drawSrvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+                drawSrvDesc.Buffer.FirstElement = 0;
+                drawSrvDesc.Buffer.NumElements = std::max( maxDraws, 1u );
+
+    D3D11_BUFFER_DESC cBufferDesc;
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = sizeof( cBufferVisibilityObject );
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                cBufferDesc.CPUAccessFlags = 0;
+                cBufferDesc.MiscFlags = 0;
+
+    if ( FAILED( pDevice->CreateBuffer( &drawBufferDesc, NULL, &pDrawBuffer ) ) ||
+         FAILED( pDevice->CreateShaderResourceView( pDrawBuffer, &drawSrvDesc, &pDrawSRV ) ) ||
+         FAILED( pDevice->CreateBuffer( &cBufferDesc, NULL, &pObjectCBuffer ) ) ) {
+        release();
+        return false;
+    }
+
+    cBufferDesc.ByteWidth = sizeof( cBufferVisibility );
+    if ( FAILED( pDevice->CreateBuffer( &cBufferDesc, NULL, &pCBuffer ) ) ) {
+        release();
+        return false;
+    }
+
+    // * * * * * SHADERS * * * * * //
+    // The shading pass includes pixelShader.hlsl, so it gets the scene declarations too
+    SceneShaderDefines sceneDefines;
+    std::string objectDeclaration = getCBufferDeclaration<cBufferVisibilityObject>( "cBufferVisibilityObject", 5 );
+    std::string visibilityDeclaration = getCBufferDeclaration<cBufferVisibility>( "cBufferVisibility", 4 );
+
+    std::vector<D3D_SHADER_MACRO> defines( sceneDefines.pixelShader, sceneDefines.pixelShader + ARRAYSIZE(sceneDefines.pixelShader) - 1 );
+    D3D_SHADER_MACRO visibilityDefines[] = {
+        { "CBUFFER_VISIBILITY_OBJECT", objectDeclaration.c_str() },
+        { "CBUFFER_VISIBILITY", visibilityDeclaration.c_str() },
+        { NULL, NULL },
+    };
+    defines.insert( defines.end(), visibilityDefines, visibilityDefines + ARRAYSIZE(visibilityDefines) );
+
+    ID3DBlob* pIdVertexBlob = compileShader( L"visibilityBuffer.hlsl", defines.data(), "vs_ids", "vs_5_0" );
+    ID3DBlob* pIdPixelBlob = compileShader( L"visibilityBuffer.hlsl", defines.data(), "ps_ids", "ps_5_0" );
+    ID3DBlob* pShadeVertexBlob = compileShader( L"visibilityBuffer.hlsl", defines.data(), "vs_shade", "vs_5_0" );
+    ID3DBlob* pShadePixelBlob = compileShader( L"visibilityBuffer.hlsl", defines.data(), "ps_shade", "ps_5_0" );
+
+    // Only the position of the PackedVertex is read
+    D3D11_INPUT_ELEMENT_DESC inputElementDesc[] = {
+              { "POS", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+
+    bool created = pIdVertexBlob && pShadeVertexBlob &&
+                   SUCCEEDED( pDevice->CreateVertexShader( pIdVertexBlob->GetBufferPointer(), pIdVertexBlob->GetBufferSize(), NULL, &pIdVertexShader ) ) &&
+                   SUCCEEDED( pDevice->CreateVertexShader( pShadeVertexBlob->GetBufferPointer(), pShadeVertexBlob->GetBufferSize(), NULL, &pShadeVertexShader ) ) &&
+                   SUCCEEDED( pDevice->CreateInputLayout( inputElementDesc, ARRAYSIZE(inputElementDesc), pIdVertexBlob->GetBufferPointer(), pIdVertexBlob->GetBufferSize(), &pInputLayout ) );
+    pIdPixelShader = createPixelShader( pDevice, pIdPixelBlob );
+    pShadePixelShader = createPixelShader( pDevice, pShadePixelBlob );
+
+    if ( pIdVertexBlob ) pIdVertexBlob->Release();
+    if ( pIdPixelBlob ) pIdPixelBlob->Release();
+    if ( pShadeVertexBlob ) pShadeVertexBlob->Release();
+    if ( pShadePixelBlob ) pShadePixelBlob->Release();
+
+    if ( !created || !pIdPixelShader || !pShadePixelShader ) {
+        release();
+        return false;
+    }
+
+    return true;
+}
+
+void VisibilityBuffer::release()
+{
+    if ( pIdSRV ) pIdSRV->Release();
+    if ( pIdRTV ) pIdRTV->Release();
+    if ( pIdTexture ) pIdTexture->Release();
+    if ( pVertexSRV ) pVertexSRV->Release();
+    if ( pIndexSRV ) pIndexSRV->Release();
+    if ( pLightmapUvSRV ) pLightmapUvSRV->Release();
+    if ( pDrawSRV ) pDrawSRV->Release();
+    if ( pVertexBuffer ) pVertexBuffer->Release();
+    if ( pIndexBuffer ) pIndexBuffer->Release();
+    if ( pLightmapUvBuffer ) pLightmapUvBuffer->Release();
+    if ( pDrawBuffer ) pDrawBuffer->Release();
+    if ( pObjectCBuffer ) pObjectCBuffer->Release();
+    if ( pCBuffer ) pCBuffer->Release();
+    if ( pIdVertexShader ) pIdVertexShader->Release();
+    if ( pShadeVertexShader ) pShadeVertexShader->Release();
+    if ( pIdPixelShader ) pIdPixelShader->Release();
+    if ( pShadePixelShader ) pShadePixelShader->Release();
+    if ( pInputLayout ) pInputLayout->Release();
+
+    pIdSRV = NULL; pIdRTV = NULL; pIdTexture = NULL;
+    pVertexSRV = NULL; pIndexSRV = NULL; pLightmapUvSRV = NULL; pDrawSRV = NULL;
+    pVertexBuffer = NULL; pIndexBuffer = NULL; pLightmapUvBuffer = NULL; pDrawBuffer = NULL;
+    pObjectCBuffer = NULL; pCBuffer = NULL;
+    pIdVertexShader = NULL; pShadeVertexShader = NULL; pIdPixelShader = NULL; pShadePixelShader = NULL;
+    pInputLayout = NULL;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+UINT VisibilityBuffer::addGeometry( const PackedMeshData& mesh, const std::vector<DirectX::XMFLOAT2>* pLightmapUvs )
+{
+    assert( !pLightmapUvs || pLightmapUvs->size() == mesh.vertices.size() );
+
+    PoolGeometry geometry;
+    geometry.firstIndex = (UINT)poolIndices.size();
+    geometry.quantization = mesh.quantization;
+    geometry.lightmapped = ( pLightmapUvs != NULL );
+
+    // 16 bit indices are relative to their part's base vertex, pool indices are absolute
+    UINT vertexOffset = (UINT)poolVertices.size();
+    bool use16Bit = ( mesh.indexFormat == DXGI_FORMAT_R16_UINT );
+    for ( size_t p = 0; p < mesh.parts.size(); p++ ) {
+        const MeshPart& part = mesh.parts[p];
+        for ( UINT i = part.indexStart; i < part.indexStart + part.indexCount; i++ )
+            poolIndices.push_back( vertexOffset + part.baseVertex + ( use16Bit ? mesh.indices16[i] : mesh.indices32[i] ) );
+    }
+    geometry.indexCount = (UINT)poolIndices.size() - geometry.firstIndex;
+
+    poolVertices.insert( poolVertices.end(), mesh.vertices.begin(), mesh.vertices.end() );
+    for ( size_t v = 0; v < mesh.vertices.size(); v++ ) {
+        DirectX::PackedVector::XMUSHORTN2 uv;
+        DirectX::PackedVector::XMStoreUShortN2( &uv, pLightmapUvs ? DirectX::XMLoadFloat2( &( *pLightmapUvs )[v] ) : DirectX::XMVectorZero() );
+        poolLightmapUvs.push_back( (UINT)uv.x | ( (UINT)uv.y << 16 ) );
+    }
+
+    geometries.push_back( geometry );
+    return (UINT)geometries.size() - 1;
+}
+
+bool VisibilityBuffer::createGeometryBuffers( ID3D11Device* pDevice )
+{
+    if ( poolVertices.empty() || poolIndices.empty() )
+        return false;
+
+    return createRawBuffer( pDevice, poolVertices.data(), (UINT)( poolVertices.size() * sizeof(PackedVertex) ), D3D11_BIND_VERTEX_BUFFER, &pVertexBuffer, &pVertexSRV ) &&
+           createRawBuffer( pDevice, poolIndices.data(), (UINT)( poolIndices.size() * sizeof(UINT) ), D3D11_BIND_INDEX_BUFFER, &pIndexBuffer, &pIndexSRV ) &&
+           createRawBuffer( pDevice, poolLightmapUvs.data(), (UINT)( poolLightmapUvs.size() * sizeof(UINT) ), 0, &pLightmapUvBuffer, &pLightmapUvSRV );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+
+void VisibilityBuffer::beginFrame( ID3D11DeviceContext* pDeviceContext, ID3D11DepthStencilView* pDepthStencilView, const Camera& camera )
+{
+    DirectX::XMStoreFloat4x4( &viewProjection, getViewMatrix( camera ) * getProjectionMatrix( camera ) );
+    draws.clear();
+    ZeroMemory( &stats, sizeof(VisibilityStats) );
+
+    // Draw id 0 = no geometry
+    const float clearIds[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    pDeviceContext->ClearRenderTargetView( pIdRTV, clearIds );
+    pDeviceContext->OMSetRenderTargets( 1, &pIdRTV, pDepthStencilView );
+
+    UINT stride = sizeof(PackedVertex);
+    UINT offset = 0;
+    pDeviceContext->IASetInputLayout( pInputLayout );
+    pDeviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+    pDeviceContext->IASetVertexBuffers( 0, 1, &pVertexBuffer, &stride, &offset );
+    pDeviceContext->IASetIndexBuffer( pIndexBuffer, DXGI_FORMAT_R32_UINT, 0 );
+
+    pDeviceContext->VSSetShader( pIdVertexShader, nullptr, 0 );
+    pDeviceContext->PSSetShader( pIdPixelShader, nullptr, 0 );
+    pDeviceContext->VSSetConstantBuffers( 5, 1, &pObjectCBuffer );
+    pDeviceContext->PSSetConstantBuffers( 5, 1, &pObjectCBuffer );
+}
+
+void VisibilityBuffer::drawGeometry( ID3D11DeviceContext* pDeviceContext, UINT geometry, DirectX::FXMMATRIX world, UINT textureSlice )
+{
+    // More draws than the draw buffer holds can't be shaded, they aren't drawn either
+    if ( geometry >= geometries.size() || draws.size() >= maxDraws )
+        return;
+
+    const PoolGeometry& poolGeometry = geometries[geometry];
+
+    VisibilityDraw draw;
+    ZeroMemory( &draw, sizeof(VisibilityDraw) );
+    DirectX::XMStoreFloat4x4( &draw.world, DirectX::XMMatrixTranspose( world ) );
+    draw.positionScale = poolGeometry.quantization.positionScale;
+    draw.positionOffset = poolGeometry.quantization.positionOffset;
+    draw.firstIndex = poolGeometry.firstIndex;
+    draw.textureSlice = textureSlice;
+    draw.lightmapped = poolGeometry.lightmapped ? 1 : 0;
+    draws.push_back( draw );
+
+    cBufferVisibilityObject object;
+    object.worldViewProjection() = DirectX::XMMatrixTranspose( world * DirectX::XMLoadFloat4x4( &viewProjection ) );
+    object.positionScale() = poolGeometry.quantization.positionScale;
+    object.positionOffset() = poolGeometry.quantization.positionOffset;
+    object.drawId() = (UINT)draws.size();
+    pDeviceContext->UpdateSubresource( pObjectCBuffer, 0, NULL, &object, 0, 0 );
+
+    pDeviceContext->DrawIndexed( poolGeometry.indexCount, poolGeometry.firstIndex, 0 );
+
+    stats.draws++;
+    stats.triangles += poolGeometry.indexCount / 3;
+}
+
+bool VisibilityBuffer::shade( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pColorTarget )
+{
+    if ( !pCBuffer )
+        return false;
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = pDeviceContext->Map( pDrawBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped );
+    if ( FAILED(hr) )
+        return false;
+
+    if ( !draws.empty() )
+        memcpy( mapped.pData, draws.data(), draws.size() * sizeof(VisibilityDraw) );
+    pDeviceContext->Unmap( pDrawBuffer, 0 );
+
+    cBufferVisibility constants;
+    constants.inverseViewProjection() = DirectX::XMMatrixTranspose( DirectX::XMMatrixInverse( nullptr, DirectX::XMLoadFloat4x4( &viewProjection ) ) );
+    constants.inverseScreenSize() = DirectX::XMFLOAT2( 1.0f / width, 1.0f / height );
+    pDeviceContext->UpdateSubresource( pCBuffer, 0, NULL, &constants, 0, 0 );
+
+    // - - - one full screen triangle, corners from SV_VertexID - - - //
+    pDeviceContext->OMSetRenderTargets( 1, &pColorTarget, NULL );
+    pDeviceContext->IASetInputLayout( NULL );
+    pDeviceContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+
+    ID3D11ShaderResourceView* pSRVs[] = { pIdSRV, pVertexSRV, pIndexSRV, pLightmapUvSRV, pDrawSRV };
+    pDeviceContext->VSSetShader( pShadeVertexShader, nullptr, 0 );
+    pDeviceContext->PSSetShader( pShadePixelShader, nullptr, 0 );
+    pDeviceContext->PSSetShaderResources( 6, ARRAYSIZE(pSRVs), pSRVs );
+    pDeviceContext->PSSetConstantBuffers( 4, 1, &pCBuffer );
+
+    if ( !draws.empty() )
+        pDeviceContext->Draw( 3, 0 );
+
+    // The ID target is a render target again next frame
+    ID3D11ShaderResourceView* pNullSRVs[ARRAYSIZE(pSRVs)] = { NULL };
+    pDeviceContext->PSSetShaderResources( 6, ARRAYSIZE(pNullSRVs), pNullSRVs );
+    return true;
+}
+
+// * * * * * CPU REFERENCE * * * * * //
+SoftwareVisibilityBuffer::SoftwareVisibilityBuffer()
+    : width( 0 ), height( 0 )
+{
+    ZeroMemory( &stats, sizeof(SoftwareVisibilityStats) );
+    DirectX::XMStoreFloat4x4( &viewProjection, DirectX::XMMatrixIdentity() );
+    DirectX::XMStoreFloat4x4( &inverseViewProjection, DirectX::XMMatrixIdentity() );
+}
+
+void SoftwareVisibilityBuffer::resize( UINT width, UINT height )
+{
+    this->width = width;
+    this->height = height;
+    depths.resize( width * height );
+    drawIds.resize( width * height );
+    triangles.resize( width * height );
+}
+
+void SoftwareVisibilityBuffer::beginFrame( DirectX::FXMMATRIX viewProjection )
+{
+    DirectX::XMStoreFloat4x4( &this->viewProjection, viewProjection );
+    DirectX::XMStoreFloat4x4( &inverseViewProjection, DirectX::XMMatrixInverse( nullptr, viewProjection ) );
+    std::fill( depths.begin(), depths.end(), 1.0f );
+    std::fill( drawIds.begin(), drawIds.end(), 0u );
+    std::fill( triangles.begin(), triangles.end(), 0u );
+    ZeroMemory( &stats, sizeof(SoftwareVisibilityStats) );
+}
+
+// Edge from a to b, > 0 on the inside of a clockwise (on screen, y down) triangle
+static float edgeFunction( const DirectX::XMFLOAT4& a, const DirectX::XMFLOAT4& b, float x, float y )
+{
+    return ( b.x - a.x ) * ( y - a.y ) - ( b.y - a.y ) * ( x - a.x );
+}
+
+// D3D top-left rule: pixels exactly on a top or left edge belong to the triangle
+static bool isTopLeftEdge( const DirectX::XMFLOAT4& a, const DirectX::XMFLOAT4& b )
+{
+    return ( a.y == b.y && b.x > a.x ) || b.y < a.y;
+}
+
+void SoftwareVisibilityBuffer::drawTriangles( const DirectX::XMFLOAT3* pPositions, const UINT* pIndices, UINT indexCount, DirectX::FXMMATRIX world, UINT drawId )
+{
+    rasterTimer.reset();
+
+    // - - - vertices to pixels, once per vertex the indices use - - - //
+    UINT vertexCount = 0;
+    for ( UINT i = 0; i < indexCount; i++ )
+        vertexCount = std::max( vertexCount, pIndices[i] + 1 );
+
+    DirectX::XMMATRIX worldViewProjection = world * DirectX::XMLoadFloat4x4( &viewProjection );
+    screenVertices.resize( vertexCount );
+    for ( UINT v = 0; v < vertexCount; v++ ) {
+        DirectX::XMFLOAT4 clip;
+        DirectX::XMStoreFloat4( &clip, DirectX::XMVector3Transform( DirectX::XMLoadFloat3( &pPositions[v] ), worldViewProjection ) );
+
+        DirectX::XMFLOAT4& screen = screenVertices[v];
+        if ( clip.z < 0.0f || clip.w <= 0.0f ) {
+            screen = DirectX::XMFLOAT4( 0.0f, 0.0f, 0.0f, 0.0f );
+            continue;
+        }
+
+        float invW = 1.0f / clip.w;
+        screen = DirectX::XMFLOAT4( ( clip.x * invW * 0.5f + 0.5f ) * width, ( 0.5f - clip.y * invW * 0.5f ) * height, clip.z * invW, 1.0f );
+    }
+
+    // - - - triangles - - - //
+    for ( UINT t = 0; t + 2 < indexCount; t += 3 ) {
+        const DirectX::XMFLOAT4& a = screenVertices[pIndices[t + 0]];
+        const DirectX::XMFLOAT4& b = screenVertices[pIndices[t + 1]];
+        const DirectX::XMFLOAT4& c = screenVertices[pIndices[t + 2]];
+        if ( a.w == 0.0f || b.w == 0.0f || c.w == 0.0f )
+            continue;
+
+        // Back faces and zero area
+        float area = edgeFunction( a, b, c.x, c.y );
+        if ( area <= 0.0f )
+            continue;
+        stats.triangles++;
+
+        int minX = std::max( (int)floorf( std::min( a.x, std::min( b.x, c.x ) ) ), 0 );
+        int maxX = std::min( (int)ceilf( std::max( a.x, std::max( b.x, c.x ) ) ), (int)width - 1 );
+        int minY = std::max( (int)floorf( std::min( a.y, std::min( b.y, c.y ) ) ), 0 );
+        int maxY = std::min( (int)ceilf( std::max( a.y, std::max( b.y, c.y ) ) ), (int)height - 1 );
+
+        bool topLeftA = isTopLeftEdge( b, c ), topLeftB = isTopLeftEdge( c, a ), topLeftC = isTopLeftEdge( a, b );
+        float invArea = 1.0f / area;
+        UINT triangle = t / 3;
+
+        for ( int y = minY; y <= maxY; y++ ) {
+            for ( int x = minX; x <= maxX; x++ ) {
+                float px = x + 0.5f, py = y + 0.5f;
+                float wa = edgeFunction( b, c, px, py );
+                float wb = edgeFunction( c, a, px, py );
+                float wc = edgeFunction( a, b, px, py );
+                if ( wa < 0.0f || wb < 0.0f || wc < 0.0f ||
+                     ( wa == 0.0f && !topLeftA ) || ( wb == 0.0f && !topLeftB ) || ( wc == 0.0f && !topLeftC ) )
+                    continue;
+
+                // Screen space linear depth, like the rasterizer's z / w
+                float z = ( wa * a.z + wb * b.z + wc * c.z ) * invArea;
+                if ( z > 1.0f )
+                    continue;
+                stats.fragments++;
+
+                UINT pixel = y * width + x;
+                if ( z >= depths[pixel] )
+                    continue;
+
+                stats.depthPassed++;
+                depths[pixel] = z;
+                drawIds[pixel] = drawId;
+                triangles[pixel] = triangle;
+            }
+        }
+    }
+
+    stats.rasterMs += rasterTimer.elapsedMs();
+}
+
+void SoftwareVisibilityBuffer::endFrame()
+{
+    stats.visiblePixels = 0;
+    for ( size_t i = 0; i < drawIds.size(); i++ )
+        stats.visiblePixels += ( drawIds[i] != 0 ) ? 1 : 0;
+}
+
+DirectX::XMFLOAT3 SoftwareVisibilityBuffer::getBarycentrics( float x, float y, const DirectX::XMFLOAT3& p0, const DirectX::XMFLOAT3& p1, const DirectX::XMFLOAT3& p2 ) const
+{
+    DirectX::XMMATRIX inverse = DirectX::XMLoadFloat4x4( &inverseViewProjection );
+    float ndcX = x / width * 2.0f - 1.0f;
+    float ndcY = 1.0f - y / height * 2.0f;
+    DirectX::XMVECTOR origin = DirectX::XMVector3TransformCoord( DirectX::XMVectorSet( ndcX, ndcY, 0.0f, 1.0f ), inverse );
+    DirectX::XMVECTOR direction = DirectX::XMVectorSubtract( DirectX::XMVector3TransformCoord( DirectX::XMVectorSet( ndcX, ndcY, 1.0f, 1.0f ), inverse ), origin );
+
+    DirectX::XMVECTOR v0 = DirectX::XMLoadFloat3( &p0 );
+    DirectX::XMVECTOR edge1 = DirectX::XMVectorSubtract( DirectX::XMLoadFloat3( &p1 ), v0 );
+    DirectX::XMVECTOR edge2 = DirectX::XMVectorSubtract( DirectX::XMLoadFloat3( &p2 ), v0 );
+    DirectX::XMVECTOR pvec = DirectX::XMVector3Cross( direction, edge2 );
+    float invDet = 1.0f / DirectX::XMVectorGetX( DirectX::XMVector3Dot( edge1, pvec ) );
+    DirectX::XMVECTOR tvec = DirectX::XMVectorSubtract( origin, v0 );
+
+    float u = DirectX::XMVectorGetX( DirectX::XMVector3Dot( tvec, pvec ) ) * invDet;
+    float v = DirectX::XMVectorGetX( DirectX::XMVector3Dot( direction, DirectX::XMVector3Cross( tvec, edge1 ) ) ) * invDet;
+    return DirectX::XMFLOAT3( 1.0f - u - v, u, v );
+}
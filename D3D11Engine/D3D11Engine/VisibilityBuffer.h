@@ -0,0 +1,173 @@
+#pragma once
+
+// * * * For Math * * * //
+#include <DirectXMath.h>
+
+// * * * Win and DX Headers * * * //
+#include <Windows.h>
+#include <d3d11.h>
+#include <d3dcompiler.h>
+
+// * * * Useful * * * //
+#include <vector>
+
+#include "Camera.h"
+#include "Mesh.h"
+#include "CBufferLayout.h"
+#include "Timer.h"
+
+// Per draw constants of the ID pass (visibilityBuffer.hlsl, b5)
+#define VISIBILITY_OBJECT_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMMATRIX, worldViewProjection ) \
+    FIELD( DirectX::XMFLOAT3, positionScale ) \
+    FIELD( DirectX::XMFLOAT3, positionOffset ) \
+    FIELD( UINT, drawId )                               /* draw record + 1, 0 = nothing drawn */
+DECLARE_CBUFFER( cBufferVisibilityObject, VISIBILITY_OBJECT_CBUFFER_FIELDS )
+
+// Constants of the shading pass (b4, next to the scene's b0 - b3)
+#define VISIBILITY_CBUFFER_FIELDS( FIELD ) \
+    FIELD( DirectX::XMMATRIX, inverseViewProjection )   /* pixel -> world space ray */ \
+    FIELD( DirectX::XMFLOAT2, inverseScreenSize )
+DECLARE_CBUFFER( cBufferVisibility, VISIBILITY_CBUFFER_FIELDS )
+
+// What the shading pass knows about a draw, same layout as VisibilityDraw in visibilityBuffer.hlsl
+struct VisibilityDraw
+{
+    DirectX::XMFLOAT4X4 world;          // transposed, like the constant buffers
+    DirectX::XMFLOAT3 positionScale;
+    UINT firstIndex;                    // into the pooled index buffer
+    DirectX::XMFLOAT3 positionOffset;
+    UINT textureSlice;
+    UINT lightmapped;
+    UINT pad[3];
+};
+
+// Counters of the last frame
+struct VisibilityStats
+{
+    UINT draws;
+    UINT triangles;
+};
+
+// * * * Visibility buffer * * * //
+// Rasterization and shading are two passes, so the shading cost stops scaling with overdraw:
+//
+//     ID pass         positions only, writes ( draw + 1, SV_PrimitiveID ) per pixel, R32G32_UINT
+//     shading pass    one full screen triangle, every covered pixel fetches its draw, the three
+//                     indices and vertices of its triangle, rebuilds the barycentrics from the
+//                     pixel's ray (and its neighbours' for texture gradients) and shades once
+//
+// The shading pass can't bind per draw buffers, so meshes live in one geometry pool (addGeometry,
+// then createGeometryBuffers): vertices stay PackedVertex, indices become 32 bit pool indices,
+// optional lightmap UVs go into a parallel stream. Lighting is pixelShader.hlsl's, it gets the
+// same scene constant buffers and resources as the forward path. Meshes outside the pool
+// (skinned, meshlets) draw forward afterwards against the ID pass's depth.
+// t6 = IDs, t7 = vertices, t8 = indices, t9 = lightmap UVs, t10 = draws, b4 = shading constants.
+class VisibilityBuffer
+{
+public:
+    VisibilityBuffer();
+
+    // ID target of width x height, up to maxDraws drawGeometry calls per frame
+    bool init( ID3D11Device* pDevice, UINT width, UINT height, UINT maxDraws );
+    void release();
+
+    // Copied into the pool until createGeometryBuffers, returns the geometry index.
+    // pLightmapUvs: one per vertex, shades with the lightmap (Lightmap.h) instead of ambient + dynamic light
+    UINT addGeometry( const PackedMeshData& mesh, const std::vector<DirectX::XMFLOAT2>* pLightmapUvs = NULL );
+    bool createGeometryBuffers( ID3D11Device* pDevice );
+
+    // Clears the IDs and binds them with pDepthStencilView (cleared by the caller) for the ID pass
+    void beginFrame( ID3D11DeviceContext* pDeviceContext, ID3D11DepthStencilView* pDepthStencilView, const Camera& camera );
+    // Rasterizer and depth state are the caller's
+    void drawGeometry( ID3D11DeviceContext* pDeviceContext, UINT geometry, DirectX::FXMMATRIX world, UINT textureSlice );
+
+    // Shades the covered pixels into pColorTarget. The scene's pixel shader constants (b0 - b3, b6),
+    // resources (t0 - t5, t11) and samplers have to be bound. Leaves no depth buffer bound and changes
+    // input layout / topology / shaders
+    bool shade( ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pColorTarget );
+
+    UINT getGeometryCount() const { return (UINT)geometries.size(); }
+    const VisibilityStats& getStats() const { return stats; }
+
+private:
+    struct PoolGeometry
+    {
+        UINT firstIndex;
+        UINT indexCount;
+        VertexQuantization quantization;
+        bool lightmapped;
+    };
+
+    // - - - geometry pool - - - //
+    std::vector<PoolGeometry> geometries;
+    std::vector<PackedVertex> poolVertices;
+    std::vector<UINT> poolIndices;
+    std::vector<UINT> poolLightmapUvs;              // R16G16_UNORM per vertex, 0 without a lightmap
+
+    // - - - this frame - - - //
+    std::vector<VisibilityDraw> draws;
+    DirectX::XMFLOAT4X4 viewProjection;
+    VisibilityStats stats;
+
+    // - - - GPU - - - //
+    ID3D11Texture2D* pIdTexture;
+    ID3D11RenderTargetView* pIdRTV;
+    ID3D11ShaderResourceView* pIdSRV;
+    ID3D11Buffer* pVertexBuffer, * pIndexBuffer, * pLightmapUvBuffer, * pDrawBuffer;
+    ID3D11ShaderResourceView* pVertexSRV, * pIndexSRV, * pLightmapUvSRV, * pDrawSRV;
+    ID3D11Buffer* pObjectCBuffer, * pCBuffer;
+    ID3D11VertexShader* pIdVertexShader, * pShadeVertexShader;
+    ID3D11PixelShader* pIdPixelShader, * pShadePixelShader;
+    ID3D11InputLayout* pInputLayout;
+    UINT width, height;
+    UINT maxDraws;
+};
+
+// * * * CPU reference (tests / benchmarks) * * * //
+// Same IDs from a scalar depth + ID rasterizer (D3D fill rules, back faces culled, triangles that
+// cross the near plane are skipped). It counts the shading work of both paths: forward shades every
+// fragment that passes the depth test when it's drawn, the visibility buffer each covered pixel once.
+struct SoftwareVisibilityStats
+{
+    UINT64 triangles;
+    UINT64 fragments;                   // inside a triangle
+    UINT64 depthPassed;                 // forward shading work
+    UINT visiblePixels;                 // visibility buffer shading work, set by endFrame
+    double rasterMs;
+};
+
+class SoftwareVisibilityBuffer
+{
+public:
+    SoftwareVisibilityBuffer();
+
+    void resize( UINT width, UINT height );
+
+    void beginFrame( DirectX::FXMMATRIX viewProjection );
+    // Triangle list, object space positions, drawId as the GPU writes it (draw record + 1)
+    void drawTriangles( const DirectX::XMFLOAT3* pPositions, const UINT* pIndices, UINT indexCount, DirectX::FXMMATRIX world, UINT drawId );
+    void endFrame();
+
+    UINT getDrawId( UINT x, UINT y ) const { return drawIds[y * width + x]; }
+    UINT getTriangle( UINT x, UINT y ) const { return triangles[y * width + x]; }
+    const SoftwareVisibilityStats& getStats() const { return stats; }
+    UINT getWidth() const { return width; }
+    UINT getHeight() const { return height; }
+
+    // Where the ray through pixel position x, y meets the plane of the world space triangle p0 p1 p2,
+    // also outside the triangle. Same as getBarycentrics in visibilityBuffer.hlsl
+    DirectX::XMFLOAT3 getBarycentrics( float x, float y, const DirectX::XMFLOAT3& p0, const DirectX::XMFLOAT3& p1, const DirectX::XMFLOAT3& p2 ) const;
+
+private:
+    UINT width, height;
+    std::vector<float> depths;
+    std::vector<UINT> drawIds;
+    std::vector<UINT> triangles;
+
+    DirectX::XMFLOAT4X4 viewProjection;
+    DirectX::XMFLOAT4X4 inverseViewProjection;
+    std::vector<DirectX::XMFLOAT4> screenVertices;     // x, y in pixels, z = depth, w = 0 when behind the near plane
+    SoftwareVisibilityStats stats;
+    Timer rasterTimer;
+};
@@ -0,0 +1,68 @@
+// Declared by DeferredShading.cpp from the C++ definition (CBufferLayout.h), with packoffset
+// cBufferDeferred (b0): inverseViewProjection, viewDepth, inverseScreenSize
+CBUFFER_DEFERRED
+
+// * * * Light with its screen rect and depth range (DeferredShading.h) * * * //
+struct DeferredLight
+{
+	float4 rect;	// NDC min x, min y, max x, max y
+	float3 position;
+	float radius;
+	float3 color;	// * intensity
+	float minDepth;
+	float maxDepth;
+	float3 pad;
+};
+
+StructuredBuffer<DeferredLight> lights : register(t0);
+
+// G-buffer of the geometry pass
+Texture2D<float4> gbufferAlbedo : register(t1);
+Texture2D<float4> gbufferNormal : register(t2);	// * 0.5 + 0.5
+Texture2D<float> gbufferDepth : register(t3);
+
+struct vShader_output {
+	float4 position : SV_POSITION;
+	nointerpolation uint light : LIGHT;
+};
+
+// * * * * * one quad per light instance, no vertex buffer * * * * * //
+vShader_output vs_main(uint vertexId : SV_VertexID, uint instanceId : SV_InstanceID)
+{
+	float2 corner = float2(vertexId & 1, vertexId >> 1);
+	float4 rect = lights[instanceId].rect;
+
+	vShader_output output;
+	output.position = float4(lerp(rect.xy, rect.zw, corner), 0.0f, 1.0f);
+	output.light = instanceId;
+	return output;
+};
+
+// * * * * * same falloff as the clustered lights in pixelShader.hlsl * * * * * //
+float4 ps_main(vShader_output input) : SV_TARGET
+{
+	int3 pixel = int3(input.position.xy, 0);
+	float depth = gbufferDepth.Load(pixel);
+	if (depth >= 1.0f)
+		discard;	// background
+
+	// Pixel + depth -> world position
+	float2 ndc = input.position.xy * inverseScreenSize * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f);
+	float4 world = mul(float4(ndc, depth, 1.0f), inverseViewProjection);
+	float3 worldPos = world.xyz / world.w;
+
+	// Outside the light's depth range or radius: nothing to add, skip the G-buffer reads
+	DeferredLight light = lights[input.light];
+	float viewZ = dot(float4(worldPos, 1.0f), viewDepth);
+	float3 toLight = light.position - worldPos;
+	float distanceSq = dot(toLight, toLight);
+	if (viewZ < light.minDepth || viewZ > light.maxDepth || distanceSq >= light.radius * light.radius)
+		discard;
+
+	float3 normal = normalize(gbufferNormal.Load(pixel).xyz * 2.0f - 1.0f);
+	float3 albedo = gbufferAlbedo.Load(pixel).rgb;
+
+	float falloff = saturate(1.0f - distanceSq / (light.radius * light.radius));
+	float intensity = max(dot(normal, toLight * rsqrt(max(distanceSq, 0.0001f))), 0.0f) * falloff * falloff;
+	return float4(albedo * intensity * light.color, 0.0f);
+};
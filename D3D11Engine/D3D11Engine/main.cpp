@@ -15,8 +15,37 @@
 
 // * * * Useful * * * //
 #include <assert.h>
+#include <stdio.h>
+#include <algorithm>
 #include <WICTextureLoader.h>
 
+// * * * Engine * * * //
+#include "Vertex.h"
+#include "VertexCompression.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+#include "Lod.h"
+#include "Camera.h"
+#include "TextureArray.h"
+#include "QuadBatch.h"
+#include "JobSystem.h"
+#include "TransformHierarchy.h"
+#include "FrustumCuller.h"
+#include "Bvh.h"
+#include "OcclusionCuller.h"
+#include "EntityWorld.h"
+#include "Skinning.h"
+#include "AnimationClip.h"
+#include "ClusteredLighting.h"
+#include "PointShadowMap.h"
+#include "Lightmap.h"
+#include "DeferredShading.h"
+#include "VisibilityBuffer.h"
+#include "PostProcess.h"
+#include "SceneShaders.h"
+#include "Benchmark.h"
+
 // * * * Width / Height Window * * * //
 const int width = 800;
 const int height = 600;
@@ -26,7 +55,12 @@ void releasePtrs();
 bool initWin( HINSTANCE hInstance, HWND& hWnd, int width, int height, const wchar_t CLASSNAME[] );
 bool initD3D( HWND hWnd, RECT client );
 bool initScenegraphics();
-void updateCBuffs(float rot, float transform);
+void updateCBuffs();
+void createSceneEntities();
+bool createStaticGeometry();
+void updateObjectCBuffer(DirectX::FXMMATRIX worldSpace, const VertexQuantization& quantization);
+void pickObject(int x, int y);
+void drawShadowCaster( UINT caster, UINT face );
 
 // * * * Global pointers * * * //
 // Init Direct3D
@@ -41,76 +75,224 @@ ID3D11DepthStencilView* pDepthStencilView = NULL;
 ID3D11Texture2D* pDepthStencilBuffer = NULL;
 
 // Blobs to get shader-info from shader-hlsl
-ID3DBlob* pVertexShaderBlob = NULL, * pPixelShaderBlob = NULL, * pErrorBlob = NULL;
+ID3DBlob* pVertexShaderBlob = NULL, * pPixelShaderBlob = NULL;
+
+// Vertex/index buffers + decode info for the packed vertices
+Mesh quadMesh;
+UINT quadGeometry = 0;          // in visibilityBuffer's pool
+
+// Floor + pillars in world space, lit by a baked lightmap (cached in staticLightmapFile) through a second vertex stream
+Mesh staticMesh;
+UINT staticGeometry = 0;
+ID3D11Buffer* pStaticLightmapUvs = NULL;
+ID3D11ShaderResourceView* pLightmapSRV = NULL;
+const wchar_t* staticLightmapFile = L"staticLighting.lmap";
+
+// Indirect light for everything else: SH irradiance probes around the static geometry, baked at startup
+IrradianceProbeGrid sceneProbes;
+ID3D11ShaderResourceView* pProbeSRV = NULL;
+
+// Dense mesh drawn through per-frame meshlet culling, one meshlet mesh per LOD
+std::vector<MeshletMesh> sphereLods;
+LodSelection sphereLodSelection;
+
+// Bending tube, skinned on the CPU into a dynamic vertex buffer
+SkinnedMesh tubeSkin;
+Skeleton tubeSkeleton;
+SkeletonPose tubePose;
+Mesh tubeMesh;
+AnimationClip tubeBendClip;
+AnimationClip tubeSwayClip;
+
+Camera camera;
+
+// Worker threads for per frame data parallel work
+JobSystem jobSystem;
+
+// Scene transforms, world matrices are rebuilt once per frame by the transform system
+TransformHierarchy sceneTransforms;
+
+// World space bounds of the scene objects, culled against the camera every frame
+FrustumCuller sceneCuller;
+std::vector<UINT> visibleObjects;
+std::vector<EntityID> boundsEntities;           // culler / BVH object -> entity
+
+// Same bounds in a BVH, refit every frame, for mouse picking
+Bvh sceneBvh;
+
+// Occluders rasterized on the CPU, objects hidden behind them skip their draw
+OcclusionCuller occlusionCuller;
+OccluderMesh quadOccluder;
+
+// Scene objects are entities, their per frame work runs as systems
+EntityWorld sceneWorld;
+SystemScheduler sceneSystems;
+
+// Point lights around the scene, shaded per cluster of the view frustum
+std::vector<PointLight> scenePointLights;
+ClusteredLighting sceneLights;
+
+// Cube shadow map of the dynamic light, faces are only redrawn when a caster in them moved
+DirectX::XMFLOAT3 dynamicLightPosition( -0.90f, 0.0f, 0.0f );
+const DirectX::XMFLOAT3 dynamicLightAttenuation( 0.2f, 0.1f, 0.1f );
+PointShadowMap lightShadows;
+std::vector<EntityID> shadowCasterEntities;     // shadow map caster -> entity
+
+// How the scene is shaded, 'D' / 'V' switch between forward and the other two
+enum ShadingMode
+{
+    SHADING_FORWARD,            // point lights per cluster in the scene's pixel shaders
+    SHADING_DEFERRED,           // G-buffer + one screen rect per light
+    SHADING_VISIBILITY,         // triangle IDs, then every covered pixel of the pooled meshes shaded once
+};
+ShadingMode shadingMode = SHADING_FORWARD;
+
+// Deferred path for the point lights (G-buffer + one screen rect per light)
+DeferredShading deferredShading;
 
-// Vertex/index
-ID3D11Buffer* pVertexBuffer = NULL, * pIndexBuffer = NULL;
+// Visibility buffer path, quad and static geometry are in its geometry pool
+VisibilityBuffer visibilityBuffer;
+
+// The scene renders into the HDR target, bloom + tone mapping write the back buffer. 'T' / 'B' switch
+// the operator and bloom
+PostProcess postProcess;
+PostProcessSettings postSettings;
 
 // Constant buffers
-ID3D11Buffer* pCBuffer = NULL, * pCBufferLight = NULL; 
+ID3D11Buffer* pCBuffer = NULL, * pCBufferLight = NULL, * pCBufferMaterial = NULL, * pCBufferProbes = NULL; 
 
 // Input layout ptr
 ID3D11InputLayout* pInputLayout = NULL;
+ID3D11InputLayout* pLightmappedInputLayout = NULL;     // + lightmap UVs in stream 1
 
 // Shader ptrs
 ID3D11VertexShader* pVertexShader = NULL;
 ID3D11PixelShader* pPixelShader = NULL;
+ID3D11VertexShader* pLightmappedVertexShader = NULL;
+ID3D11PixelShader* pLightmappedPixelShader = NULL;
+ID3D11PixelShader* pGBufferPixelShader = NULL;          // deferred shading: surface attributes instead of the point lights
+ID3D11PixelShader* pGBufferLightmappedPixelShader = NULL;
 
-// Texturing
+// Texturing - textures are packed into Texture2DArray slices
 ID3D11SamplerState* pSamplerState = NULL;
-ID3D11ShaderResourceView* pChessTexture = NULL, * pGorillaTexture = NULL;
+TextureArrayManager textureArrays;
+TextureID gorillaTexture = INVALID_TEXTURE_ID;
+
+// Batched textured quads (sprites)
+QuadBatch quadBatch;
 
 // Rasterrizer
 ID3D11RasterizerState* pRasterizerState = NULL;
 
-// * * * Vertex / cBuffer structure
-struct cBuffer
-{   
-    DirectX::XMMATRIX WVP;      // WorldViewProjection Matrix (Combined)
-    DirectX::XMMATRIX World;    // World view
+// * * * Scene components * * * //
+struct NameComponent
+{
+    const char* pName;
 };
 
-// Light struct, and a cBufferLight that contains a Light struct
-struct Light
+struct TransformComponent
 {
-    Light()
-    {
-        ZeroMemory(this, sizeof(Light));
-    }
-    DirectX::XMFLOAT3 ambientLightColor;
-    float ambientLightStrength; // makes it 16 byte aligned
+    TransformID transform;      // node in sceneTransforms
+};
 
-    DirectX::XMFLOAT3 dynamicLightColor;
-    float dynamicLightStrength; // makes it 16 byte aligned
-    
-    DirectX::XMFLOAT3 dynamicLightPosition;
-    float padding;              // makes it 16 byte aligned
+// Keeps turning around axis
+struct SpinComponent
+{
+    DirectX::XMFLOAT3 axis;
+    float angle;
+    float speed;                // radians per frame
+};
 
-    // How lightning decreases when moving away from object
-    DirectX::XMFLOAT3 dynamicAttenuation;
-    float padding2;             // makes it 16 byte aligned
-    
+// Moves along axis from minOffset to maxOffset, then starts over
+struct SlideComponent
+{
+    DirectX::XMFLOAT3 origin;
+    DirectX::XMFLOAT3 axis;
+    float offset;
+    float speed;                // units per frame
+    float minOffset, maxOffset;
 };
 
-struct cBufferLight
+// Local box (the quantization box of the mesh) and its world space version for culling
+struct BoundsComponent
 {
-    Light light;
+    DirectX::XMFLOAT3 localCenter, localExtents;
+    DirectX::XMFLOAT3 worldCenter, worldExtents;
+    UINT cullIndex;             // object in sceneCuller / sceneBvh
+    BOOL visible;               // survived frustum and occlusion culling this frame
 };
 
-struct Vertex
-{    
-    Vertex( float x, float y, float z,
-            float colRed, float colGreen, float colBlue, float colAlpha, 
-            float u, float v,
-            float nx, float ny, float nz ) 
-            : pos( x, y, z ), col( colRed, colGreen, colBlue, colAlpha ), texcoord( u, v ), normal( nx, ny, nz ) { }
-
-    DirectX::XMFLOAT3 pos;
-    DirectX::XMFLOAT4 col;
-    DirectX::XMFLOAT3 normal;
-    DirectX::XMFLOAT2 texcoord;
+struct MeshComponent
+{
+    Mesh* pMesh;
+};
+
+// Meshlet LOD chain, lod is picked every frame from the projected error
+struct MeshletLodComponent
+{
+    MeshletMesh* pLods;
+    LodSelection* pSelection;
+    UINT lod;
+};
+
+struct OccluderComponent
+{
+    const OccluderMesh* pOccluder;
 };
 
+// Skeleton animated by the skeleton system, vertices skinned right before the draw
+struct SkinnedComponent
+{
+    const SkinnedMesh* pSkin;
+    const Skeleton* pSkeleton;
+    SkeletonPose* pPose;
+    Mesh* pMesh;
+    VertexQuantization quantization;    // bounds of the current pose
+    BOOL uploaded;                      // vertex buffer holds this frame's pose
+    UINT poseVersion;                   // bumped whenever the pose changes, redraws the cached shadow faces
+};
+
+// Two compressed clips played together, the blend weight swings between them
+struct AnimationComponent
+{
+    const AnimationClip* pClips[2];
+    float time;
+    float blendPhase;
+};
+
+// Caster in lightShadows, static casters never move
+struct ShadowCasterComponent
+{
+    UINT caster;
+};
+
+// Baked lighting: drawn with the lightmapped shaders, UVs into the lightmap from a second vertex buffer
+struct LightmapComponent
+{
+    ID3D11Buffer* pUvBuffer;
+};
+
+// Geometry in visibilityBuffer's pool, drawn into the ID buffer in visibility mode
+struct VisibilityComponent
+{
+    UINT geometry;
+};
+
+// State outside the world that systems share, declared in the read / write sets so the scheduler orders them
+struct SceneTransformsTag { };
+struct SceneBoundsTag { };
+struct OcclusionTag { };
+struct ShadowMapTag { };
+
+// * * * Scene systems * * * //
+void animateSystem( EntityWorld& world, JobSystem* pJobSystem );
+void skeletonSystem( EntityWorld& world, JobSystem* pJobSystem );
+void transformSystem( EntityWorld& world, JobSystem* pJobSystem );
+void boundsSystem( EntityWorld& world, JobSystem* pJobSystem );
+void lodSystem( EntityWorld& world, JobSystem* pJobSystem );
+void visibilitySystem( EntityWorld& world, JobSystem* pJobSystem );
+void shadowSystem( EntityWorld& world, JobSystem* pJobSystem );
+
 LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam );
 
 int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow ) {
@@ -121,6 +303,13 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     HWND hWnd = { 0 };
     ZeroMemory(&hWnd, sizeof(HWND));    
 
+    // * * *  ReleaseAVX2 needs AVX2, F16C and FMA  * * * //
+    if ( !DirectX::XMVerifyCPUSupport() ) {
+        MessageBeep( 1 );
+        MessageBoxA( 0, "[ERROR] This build needs a CPU with the instruction sets it was compiled for -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return -1;
+    }
+
     // * * *  Create and show window  * * * //
     if ( !initWin( hInstance, hWnd, width, height, CLASSNAME ) ) {
         MessageBeep( 1 );
@@ -151,14 +340,28 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
         return GetLastError();
     }    
 
-    // - - - - - Settings buffers - - - - - //
-    UINT stride = sizeof(Vertex);
-    UINT offset = 0;
-    //UINT vertexCount = 4;
-
-    float rot = 0.0f;   // Rotation cBuffer
-    float transform = -2.0f;    // translation cBuffer   
-    // - - - - - - - - - - - - - - - - - - - - - - //            
+    // * * *  Benchmark run -> no main loop  * * * //
+    if ( isBenchmarkRun( lpCmdLine ) ) {
+        BenchmarkContext benchmarkContext;
+        ZeroMemory( &benchmarkContext, sizeof(BenchmarkContext) );
+
+                    benchmarkContext.pDevice = pDevice;
+                    benchmarkContext.pDeviceContext = pDeviceContext;
+                    benchmarkContext.pSwapchain = pSwapchain;
+                    benchmarkContext.pRenderTarget = pRenderTarget;
+                    benchmarkContext.pDepthStencilView = pDepthStencilView;
+                    benchmarkContext.width = winRect.right - winRect.left;
+                    benchmarkContext.height = winRect.bottom - winRect.top;
+                    benchmarkContext.pTextureArrays = &textureArrays;
+                    benchmarkContext.pQuadBatch = &quadBatch;
+                    benchmarkContext.pJobSystem = &jobSystem;
+
+        runBenchmarks( lpCmdLine, benchmarkContext );
+
+        releasePtrs();
+        UnregisterClass( CLASSNAME, hInstance );
+        return 0;
+    }
 
     // * * * * * MAIN LOOP STARTS HERE * * * * * //
     MSG msg = { 0 };
@@ -177,15 +380,39 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
         }
         else {          
 
+            // - - - - - SCENE UPDATE - - - - - //
+            sceneSystems.run( sceneWorld, &jobSystem );
+
+            // - - - - - SHADOW PASS - - - - - //
+            lightShadows.setLight( dynamicLightPosition, 0.05f, 20.0f );
+            lightShadows.update();
+
+            // Skinned meshes - only skinned when visible or drawn into the shadow map, straight into their dynamic vertex buffer
+            sceneWorld.forEach<const BoundsComponent, const ShadowCasterComponent, SkinnedComponent>(
+                [&]( EntityID, const BoundsComponent& bounds, const ShadowCasterComponent& shadowCaster, SkinnedComponent& skinned ) {
+                skinned.uploaded = FALSE;
+                if ( bounds.visible || lightShadows.isCasterDrawn(shadowCaster.caster) )
+                    skinned.uploaded = uploadSkinnedMesh( pDeviceContext, *skinned.pSkin, skinned.pPose->palette.data(), skinned.quantization, *skinned.pMesh, &jobSystem );
+            } );
+
+            lightShadows.render( pDeviceContext, drawShadowCaster );
+
             // Clear background and set color
             float backgroundColor[4] = { 0.0f, 0.2f, 0.25f, 1.0f };
-            pDeviceContext->ClearRenderTargetView( pRenderTarget, backgroundColor );
+            ID3D11RenderTargetView* pSceneTarget = postProcess.getSceneTarget();
+            if ( shadingMode == SHADING_DEFERRED ) {
+                // HDR target + albedo + normal, the G-buffer's own depth
+                deferredShading.beginGeometry( pDeviceContext, pSceneTarget, backgroundColor );
+            }
+            else {
+                pDeviceContext->ClearRenderTargetView( pSceneTarget, backgroundColor );
 
-            // Clear Depth/Stencil view
-            pDeviceContext->ClearDepthStencilView(pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+                // Clear Depth/Stencil view
+                pDeviceContext->ClearDepthStencilView(pDepthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
                    
-            // Output Merger - Set render target and depth/stencil view
-            pDeviceContext->OMSetRenderTargets(1, &pRenderTarget, pDepthStencilView);
+                // Output Merger - Set render target and depth/stencil view
+                pDeviceContext->OMSetRenderTargets(1, &pSceneTarget, pDepthStencilView);
+            }
 
             // Input Assembler 
             pDeviceContext->IASetInputLayout(pInputLayout);
@@ -199,32 +426,128 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
 
             // Sets vertex- /pixelshader
             pDeviceContext->VSSetShader(pVertexShader, nullptr, 0);
-            pDeviceContext->PSSetShader(pPixelShader, nullptr, 0);
+            pDeviceContext->PSSetShader(shadingMode == SHADING_DEFERRED ? pGBufferPixelShader : pPixelShader, nullptr, 0);
 
             // Set sampler    
             pDeviceContext->PSSetSamplers(0, 1, &pSamplerState);     
 
 
-            // - - - - - CONSTANT BUFFER EFFECT SETTINGS - - - - - //
-            //Keep the quads rotating
-            rot += .0002f;
-            if (rot > 6.285f)
-                rot = 0.0f;    
+            // - - - - - LIGHTS - - - - - //
+            updateCBuffs();
+            lightShadows.bind( pDeviceContext );
+            pDeviceContext->PSSetConstantBuffers( 6, 1, &pCBufferProbes );
+            pDeviceContext->PSSetShaderResources( 11, 1, &pProbeSRV );
 
-            transform += 0.0001f;
-            if (transform >= 2.0f)
-                transform = -2.0f; 
-                   
-            updateCBuffs(rot, transform); 
+            // Light lists for this frame's view, the deferred path draws the lights after the scene instead
+            if ( shadingMode != SHADING_DEFERRED ) {
+                sceneLights.assignLights( scenePointLights.data(), (UINT)scenePointLights.size(), getViewMatrix(camera), camera, &jobSystem );
+                if ( sceneLights.upload( pDeviceContext, scenePointLights.data(), width, height ) )
+                    sceneLights.bind( pDeviceContext );
+            }
+
+            // Set texture array and the slice to sample
+            textureArrays.beginFrame();
 
-            // Set texture
-            pDeviceContext->PSSetShaderResources(0, 1, &pGorillaTexture);   
+            TextureSlot gorillaSlot = { 0, 0 };
+            if (textureArrays.useTexture(gorillaTexture, gorillaSlot)) {
+                cBufferMaterial material;
+                material.textureSlice() = gorillaSlot.slice;
 
-            // Input assembler - Set vertex/Indexbuffers
-            pDeviceContext->IASetVertexBuffers(0, 1, &pVertexBuffer, &stride, &offset);           
-            pDeviceContext->IASetIndexBuffer(pIndexBuffer, DXGI_FORMAT_R32_UINT, 0);            
+                pDeviceContext->UpdateSubresource(pCBufferMaterial, 0, NULL, &material, 0, 0);
+                pDeviceContext->PSSetConstantBuffers(1, 1, &pCBufferMaterial);
 
-            pDeviceContext->DrawIndexed( 6, 0, 0 );   
+                ID3D11ShaderResourceView* pTextureArraySRV = textureArrays.getSRV(gorillaSlot.arrayIndex);
+                pDeviceContext->PSSetShaderResources(0, 1, &pTextureArraySRV);
+            }
+
+            // - - - - - VISIBILITY BUFFER - - - - - //
+            // Pooled meshes (quad, static geometry) write IDs, then each covered pixel is shaded once.
+            // The rest draws forward below, depth tested against the ID pass
+            if ( shadingMode == SHADING_VISIBILITY ) {
+                visibilityBuffer.beginFrame( pDeviceContext, pDepthStencilView, camera );
+
+                sceneWorld.forEach<const TransformComponent, const BoundsComponent, const VisibilityComponent>(
+                    [&]( EntityID, const TransformComponent& transform, const BoundsComponent& bounds, const VisibilityComponent& visibility ) {
+                    if ( bounds.visible )
+                        visibilityBuffer.drawGeometry( pDeviceContext, visibility.geometry, sceneTransforms.getWorldMatrix(transform.transform), gorillaSlot.slice );
+                } );
+
+                pDeviceContext->PSSetShaderResources(5, 1, &pLightmapSRV);
+                visibilityBuffer.shade( pDeviceContext, pSceneTarget );
+
+                // Back to the forward state
+                pDeviceContext->OMSetRenderTargets(1, &pSceneTarget, pDepthStencilView);
+                pDeviceContext->IASetInputLayout(pInputLayout);
+                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                pDeviceContext->VSSetShader(pVertexShader, nullptr, 0);
+                pDeviceContext->PSSetShader(pPixelShader, nullptr, 0);
+            }
+
+            // Input assembler - Set vertex/Indexbuffers and draw every visible mesh entity
+            sceneWorld.forEach<const TransformComponent, const BoundsComponent, const MeshComponent>(
+                [&]( EntityID entity, const TransformComponent& transform, const BoundsComponent& bounds, const MeshComponent& mesh ) {
+                if ( !bounds.visible || sceneWorld.hasComponent<LightmapComponent>(entity) )
+                    return;
+                if ( shadingMode == SHADING_VISIBILITY && sceneWorld.hasComponent<VisibilityComponent>(entity) )
+                    return;
+
+                updateObjectCBuffer(sceneTransforms.getWorldMatrix(transform.transform), mesh.pMesh->quantization);
+                drawMesh( pDeviceContext, *mesh.pMesh );
+            } );
+
+            // Meshlet meshes - LOD from the lod system, cull meshlets against the camera, draw the survivors with one DrawIndexed
+            sceneWorld.forEach<const TransformComponent, const BoundsComponent, const MeshletLodComponent>(
+                [&]( EntityID, const TransformComponent& transform, const BoundsComponent& bounds, const MeshletLodComponent& lods ) {
+                if ( !bounds.visible )
+                    return;
+
+                DirectX::XMMATRIX world = sceneTransforms.getWorldMatrix(transform.transform);
+                MeshletMesh& meshletMesh = lods.pLods[lods.lod];
+                updateObjectCBuffer(world, meshletMesh.quantization);
+
+                cullMeshlets( pDeviceContext, meshletMesh, world, camera );
+                drawMeshletMesh( pDeviceContext, meshletMesh );
+            } );
+
+            // Skinned meshes - skinned before the shadow pass
+            sceneWorld.forEach<const TransformComponent, const BoundsComponent, const SkinnedComponent>(
+                [&]( EntityID, const TransformComponent& transform, const BoundsComponent& bounds, const SkinnedComponent& skinned ) {
+                if ( !bounds.visible || !skinned.uploaded )
+                    return;
+
+                updateObjectCBuffer(sceneTransforms.getWorldMatrix(transform.transform), skinned.pMesh->quantization);
+                drawMesh( pDeviceContext, *skinned.pMesh );
+            } );
+
+            // Static geometry - last, it is mostly behind the rest. Baked lighting, lightmap UVs from stream 1
+            pDeviceContext->IASetInputLayout(pLightmappedInputLayout);
+            pDeviceContext->VSSetShader(pLightmappedVertexShader, nullptr, 0);
+            pDeviceContext->PSSetShader(shadingMode == SHADING_DEFERRED ? pGBufferLightmappedPixelShader : pLightmappedPixelShader, nullptr, 0);
+            pDeviceContext->PSSetShaderResources(5, 1, &pLightmapSRV);
+
+            sceneWorld.forEach<const TransformComponent, const BoundsComponent, const MeshComponent, const LightmapComponent>(
+                [&]( EntityID entity, const TransformComponent& transform, const BoundsComponent& bounds, const MeshComponent& mesh, const LightmapComponent& lightmap ) {
+                if ( !bounds.visible )
+                    return;
+                if ( shadingMode == SHADING_VISIBILITY && sceneWorld.hasComponent<VisibilityComponent>(entity) )
+                    return;
+
+                UINT stride = sizeof(DirectX::PackedVector::XMUSHORTN2);
+                UINT offset = 0;
+                pDeviceContext->IASetVertexBuffers(1, 1, &lightmap.pUvBuffer, &stride, &offset);
+
+                updateObjectCBuffer(sceneTransforms.getWorldMatrix(transform.transform), mesh.pMesh->quantization);
+                drawMesh( pDeviceContext, *mesh.pMesh );
+            } );
+
+            // - - - - - DEFERRED LIGHTS - - - - - //
+            if ( shadingMode == SHADING_DEFERRED ) {
+                deferredShading.accumulateLights( pDeviceContext, pSceneTarget, scenePointLights.data(), (UINT)scenePointLights.size(), camera );
+            }
+
+            // - - - - - POST PROCESS - - - - - //
+            // Bloom + tone mapping from the HDR target into the back buffer, the next frame rebinds its state
+            postProcess.render( pDeviceContext, pRenderTarget, postSettings );
 
             // Present back and frontbuffer
             pSwapchain->Present( 0, 0 );
@@ -240,17 +563,36 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
 void releasePtrs()
 {
     pCBufferLight->Release();
-
-    pGorillaTexture->Release();
+    pCBufferMaterial->Release();
+    pCBufferProbes->Release();
+
+    quadBatch.release();
+    sceneLights.release();
+    deferredShading.release();
+    visibilityBuffer.release();
+    postProcess.release();
+    lightShadows.release();
+    textureArrays.release();
     pSamplerState->Release();
 
     pVertexShader->Release();
     pPixelShader->Release();
     pInputLayout->Release();
+    pLightmappedVertexShader->Release();
+    pLightmappedPixelShader->Release();
+    pGBufferPixelShader->Release();
+    pGBufferLightmappedPixelShader->Release();
+    pLightmappedInputLayout->Release();
 
     pCBuffer->Release();
-    pIndexBuffer->Release();
-    pVertexBuffer->Release();
+    releaseMesh( quadMesh );
+    releaseMesh( staticMesh );
+    if ( pStaticLightmapUvs ) pStaticLightmapUvs->Release();
+    if ( pLightmapSRV ) pLightmapSRV->Release();
+    if ( pProbeSRV ) pProbeSRV->Release();
+    releaseMesh( tubeMesh );
+    for ( size_t i = 0; i < sphereLods.size(); i++ )
+        releaseMeshletMesh( sphereLods[i] );
 
     pDepthStencilBuffer->Release();
     pDepthStencilView->Release();
@@ -261,6 +603,8 @@ void releasePtrs()
     pDeviceContext->Release();
     pSwapchain->Release();
     pDevice->Release();
+
+    jobSystem.release();
 }
 
 bool initWin(HINSTANCE hInstance, HWND& hWnd, int width, int height, const wchar_t CLASSNAME[])
@@ -421,107 +765,139 @@ bool initD3D(HWND hWnd, RECT client)
 bool initScenegraphics()
 {
     // * * * * * VERTEX- AND PIXEL-SHADER * * * * * //
-    // Get vertex shader info
-    HRESULT hr = D3DCompileFromFile( L"vertexShader.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "vs_main", "vs_5_0", NULL, NULL, &pVertexShaderBlob, &pErrorBlob );
-    if ( FAILED(hr) ) {
-        if ( pErrorBlob ) {
-            OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
-            pErrorBlob->Release();
-        }
+    // Constant buffer declarations generated from the C++ definitions
+    SceneShaderDefines defines;
+
+    // Get vertex / pixel shader info, the lightmapped entry points are for the static geometry
+    pVertexShaderBlob = compileShader( L"vertexShader.hlsl", defines.vertexShader, "vs_main", "vs_5_0" );
+    pPixelShaderBlob = compileShader( L"pixelShader.hlsl", defines.pixelShader, "ps_main", "ps_5_0" );
+    ID3DBlob* pLightmappedVertexShaderBlob = compileShader( L"vertexShader.hlsl", defines.vertexShader, "vs_lightmapped", "vs_5_0" );
+    ID3DBlob* pLightmappedPixelShaderBlob = compileShader( L"pixelShader.hlsl", defines.pixelShader, "ps_lightmapped", "ps_5_0" );
+    ID3DBlob* pGBufferPixelShaderBlob = compileShader( L"pixelShader.hlsl", defines.pixelShader, "ps_gbuffer", "ps_5_0" );
+    ID3DBlob* pGBufferLightmappedPixelShaderBlob = compileShader( L"pixelShader.hlsl", defines.pixelShader, "ps_gbuffer_lightmapped", "ps_5_0" );
+    assert( pVertexShaderBlob && pPixelShaderBlob && pLightmappedVertexShaderBlob && pLightmappedPixelShaderBlob );
+    assert( pGBufferPixelShaderBlob && pGBufferLightmappedPixelShaderBlob );
 
-        if ( pVertexShaderBlob ) {
-            pVertexShaderBlob->Release();
-        }
-        assert( false );
-    }
+    // Create a vertex and a pixel shader from blob-info to vertex/pixel_ptrs    
+    HRESULT hr = pDevice->CreateVertexShader( pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), NULL, &pVertexShader );
+    assert( SUCCEEDED(hr) );
 
-    // Get pixel shader info
-    hr = D3DCompileFromFile( L"pixelShader.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "ps_main", "ps_5_0", NULL, NULL, &pPixelShaderBlob, &pErrorBlob );
-    if (FAILED(hr)) {
-        if ( pErrorBlob ) {
-            OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
-            pErrorBlob->Release();
-        }
+    hr = pDevice->CreatePixelShader( pPixelShaderBlob->GetBufferPointer(), pPixelShaderBlob->GetBufferSize(), NULL, &pPixelShader );
+    assert( SUCCEEDED(hr) );
 
-        if (pPixelShaderBlob) {
-            pPixelShaderBlob->Release();
-        }
-        assert( false );
-    }
+    hr = pDevice->CreateVertexShader( pLightmappedVertexShaderBlob->GetBufferPointer(), pLightmappedVertexShaderBlob->GetBufferSize(), NULL, &pLightmappedVertexShader );
+    assert( SUCCEEDED(hr) );
 
-    // Create a vertex and a pixel shader from blob-info to vertex/pixel_ptrs    
-    hr = pDevice->CreateVertexShader( pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), NULL, &pVertexShader );
+    hr = pDevice->CreatePixelShader( pLightmappedPixelShaderBlob->GetBufferPointer(), pLightmappedPixelShaderBlob->GetBufferSize(), NULL, &pLightmappedPixelShader );
     assert( SUCCEEDED(hr) );
 
-    hr = pDevice->CreatePixelShader( pPixelShaderBlob->GetBufferPointer(), pPixelShaderBlob->GetBufferSize(), NULL, &pPixelShader );
+    hr = pDevice->CreatePixelShader( pGBufferPixelShaderBlob->GetBufferPointer(), pGBufferPixelShaderBlob->GetBufferSize(), NULL, &pGBufferPixelShader );
+    assert( SUCCEEDED(hr) );
+
+    hr = pDevice->CreatePixelShader( pGBufferLightmappedPixelShaderBlob->GetBufferPointer(), pGBufferLightmappedPixelShaderBlob->GetBufferSize(), NULL, &pGBufferLightmappedPixelShader );
     assert( SUCCEEDED(hr) );
 
     // * * * * * INPUT LAYOUT * * * * * //
     // An input layout how to handle data from vertexbuffers
     D3D11_INPUT_ELEMENT_DESC inputElementDesc[] = {
-              { "POS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-              { "COL", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-              { "NOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-              { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "POS", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "NOR", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "COL", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
     };
 
     hr = pDevice->CreateInputLayout( inputElementDesc, ARRAYSIZE(inputElementDesc), pVertexShaderBlob->GetBufferPointer(), pVertexShaderBlob->GetBufferSize(), &pInputLayout );
     assert( SUCCEEDED(hr) );
 
-    // * * * * * VERTEX BUFFER / INDEX BUFFER * * * * * // 
-    Vertex quad[] =
-    {
-                Vertex(-0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, -1.0f, -1.0f, -1.0f),
-                Vertex(-0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, -1.0f, 1.0f, -1.0f),
-                Vertex(0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, -1.0f),
-                Vertex(0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f, -1.0f),
+    // Static geometry: the same vertices + lightmap UVs from a second vertex buffer
+    D3D11_INPUT_ELEMENT_DESC lightmappedElementDesc[] = {
+              { "POS", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "NOR", 0, DXGI_FORMAT_R16G16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "COL", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+              { "LIGHTMAP", 0, DXGI_FORMAT_R16G16_UNORM, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
     };
 
+    hr = pDevice->CreateInputLayout( lightmappedElementDesc, ARRAYSIZE(lightmappedElementDesc), pLightmappedVertexShaderBlob->GetBufferPointer(), pLightmappedVertexShaderBlob->GetBufferSize(), &pLightmappedInputLayout );
+    assert( SUCCEEDED(hr) );
+
+    pLightmappedVertexShaderBlob->Release();
+    pLightmappedPixelShaderBlob->Release();
+    pGBufferPixelShaderBlob->Release();
+    pGBufferLightmappedPixelShaderBlob->Release();
+
+    // * * * * * VERTEX BUFFER / INDEX BUFFER * * * * * // 
+    MeshData quad;
+    quad.vertices.push_back( Vertex(-0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, -1.0f, -1.0f, -1.0f) );
+    quad.vertices.push_back( Vertex(-0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, -1.0f, 1.0f, -1.0f) );
+    quad.vertices.push_back( Vertex(0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, -1.0f) );
+    quad.vertices.push_back( Vertex(0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f, -1.0f) );
+
     // Indices for vertex buffer
-    DWORD indices[] = {
+    UINT indices[] = {
        0, 1, 2,
        0, 2, 3,
     };
+    quad.indices.assign( indices, indices + ARRAYSIZE(indices) );
 
+    // Triangle / vertex order for cache hits, overdraw and fetch locality
+    optimizeMesh( quad, "quad" );
+    buildOccluderMesh( quad, quadOccluder );
 
-    // Vertex buffer desciption
-    D3D11_BUFFER_DESC vertexBufferDesc;
-    ZeroMemory( &vertexBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+    // Quantize vertices, pick 16 bit indices (splits meshes > 65536 vertices)
+    PackedMeshData packedQuad;
+    buildPackedMesh( quad, packedQuad );
+    logCompressionError( "quad", measureCompressionError( quad.vertices.data(), packedQuad.vertices.data(), (UINT)quad.vertices.size(), packedQuad.quantization ) );
 
-                vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-                vertexBufferDesc.ByteWidth = sizeof(Vertex) * 4;
-                vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-                vertexBufferDesc.CPUAccessFlags = 0;
-                vertexBufferDesc.MiscFlags = 0;
-
-    // Create vertex buffer data
-    D3D11_SUBRESOURCE_DATA vertexBufferData;
-    ZeroMemory( &vertexBufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
-
-                vertexBufferData.pSysMem = quad;
-
-    hr = pDevice->CreateBuffer( &vertexBufferDesc, &vertexBufferData, &pVertexBuffer );
-    assert( SUCCEEDED(hr) );   
+    if ( !createMesh( pDevice, packedQuad, quadMesh ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create quad mesh failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
+    quadGeometry = visibilityBuffer.addGeometry( packedQuad );
 
+    // - - - dense sphere, LOD chain, every level split into meshlets - - - //
+    MeshData sphere;
+    createSphereMesh( 96, 48, 0.75f, sphere );
 
-    // Index buffer description
-    D3D11_BUFFER_DESC indexBufferDesc;
-    ZeroMemory( &indexBufferDesc, sizeof(D3D11_BUFFER_DESC) );
+    std::vector<LodLevel> sphereLodLevels;
+    generateLodChain( sphere, sphereLodLevels );
+    initLodSelection( sphereLodLevels, sphereLodSelection );
 
-                indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-                indexBufferDesc.ByteWidth = sizeof(DWORD) * 6;
-                indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-                indexBufferDesc.CPUAccessFlags = 0;
-                indexBufferDesc.MiscFlags = 0;
+    sphereLods.resize( sphereLodLevels.size() );
+    for ( size_t i = 0; i < sphereLodLevels.size(); i++ ) {
+        char message[128];
+        sprintf_s( message, "[Lod] sphere level %u: %u triangles, error %f\n", (UINT)i, (UINT)sphereLodLevels[i].mesh.indices.size() / 3, sphereLodLevels[i].error );
+        OutputDebugStringA( message );
 
-    // Create index buffer data
-    D3D11_SUBRESOURCE_DATA indexBufferData;
-    ZeroMemory( &indexBufferData, sizeof(D3D11_SUBRESOURCE_DATA) );
+        optimizeMesh( sphereLodLevels[i].mesh, "sphere lod" );
 
-                indexBufferData.pSysMem = indices;
+        if ( !createMeshletMesh( pDevice, sphereLodLevels[i].mesh, sphereLods[i] ) ) {
+            MessageBeep(1);
+            MessageBoxA(0, "[Error] Create sphere mesh failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+            return false;
+        }
+    }
 
-    hr = pDevice->CreateBuffer( &indexBufferDesc, &indexBufferData, &pIndexBuffer );
-    assert( SUCCEEDED(hr) );
+    // Tube: 8 bones, skinned every frame
+    std::vector<DirectX::VertexPositionNormalTangentColorTextureSkinning> tubeVertices;
+    std::vector<UINT> tubeIndices;
+    createSkinnedTubeMesh( 48, 24, 1.2f, 0.08f, 8, tubeVertices, tubeIndices, tubeSkeleton );
+    buildSkinnedMesh( tubeVertices.data(), (UINT)tubeVertices.size(), tubeSkin );
+    initSkeletonPose( tubeSkeleton, tubePose );
+
+    // Bend waves around z, sway around x, both loop after 4 seconds
+    AnimationSourceClip tubeSourceClip;
+    createChainWaveClip( tubeSkeleton, 121, 30.0f, DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f), 0.2f, 2.0f, 0.0f, tubeSourceClip );
+    compressAnimationClip( tubeSourceClip, AnimationCompressionSettings(), tubeBendClip );
+    createChainWaveClip( tubeSkeleton, 121, 30.0f, DirectX::XMFLOAT3(1.0f, 0.0f, 0.0f), 0.12f, 1.0f, 0.0f, tubeSourceClip );
+    compressAnimationClip( tubeSourceClip, AnimationCompressionSettings(), tubeSwayClip );
+
+    if ( !createSkinnedMesh( pDevice, tubeSkin, tubeIndices.data(), (UINT)tubeIndices.size(), tubeMesh ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create tube mesh failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
 
 	
@@ -540,15 +916,24 @@ bool initScenegraphics()
     hr = pDevice->CreateSamplerState( &samplerDesc, &pSamplerState );
     assert( SUCCEEDED(hr) );
 
-    // - - - load texturefile from file - - - //
-    hr = DirectX::CreateWICTextureFromFile(pDevice, L"Textures/gorilla.jpg", nullptr, &pGorillaTexture);
-    if (!SUCCEEDED(hr)) {
+    // - - - load texturefile into a texture array slice - - - //
+    textureArrays.init(pDevice, pDeviceContext);
+
+    gorillaTexture = textureArrays.loadTexture(L"Textures/gorilla.jpg");
+    if (gorillaTexture == INVALID_TEXTURE_ID) {
         MessageBeep(1);
         MessageBoxA(0, "[Error] Load texturefile failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
         return GetLastError();
     }
     // - - - - - - - - - - - - - - - - - - - - //
 
+    // - - - quad batch shares the texture arrays - - - //
+    if ( !quadBatch.init( pDevice, pDeviceContext, &textureArrays ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Initialize quad batch failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
+
 
     // * * * * * CONSTANT BUFFER CREATION * * * * * //
     // Create buffer to send to cbuffer in vertexshader
@@ -576,80 +961,489 @@ bool initScenegraphics()
     hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pCBufferLight );
     assert( SUCCEEDED(hr) );
 
-    return true;
-}
+    // - - - - -  MATERIAL BUFFER - - - - -  //
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
 
-void updateCBuffs(float rot, float transform)
-{
-    // - - Constantbuffer objects, matrix to setup - - //
-    cBuffer objectTransform;    
-    Light light;    // light object to modify
-    cBufferLight lightCBuffer;  // light-buffer to send into the shader       
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = sizeof( cBufferMaterial );
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                cBufferDesc.CPUAccessFlags = 0;
+                cBufferDesc.MiscFlags = 0;
 
-    // - - - - - Spaces Settings - - - - - //
-    DirectX::XMMATRIX worldViewProj;    // Used to send to cBuffer 
-    DirectX::XMMATRIX worldSpace = DirectX::XMMatrixIdentity();  // World view matrix
+    hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pCBufferMaterial );
+    assert( SUCCEEDED(hr) );
 
-    // - * * * - Viewspace settings - * * * - //
-    DirectX::XMVECTOR eyePosition = DirectX::XMVectorSet(0.0f, 0.0f, -2.0f, 0.0f);
-    DirectX::XMVECTOR targetPosition = DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-    DirectX::XMVECTOR camUpVector = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    // - - - - -  PROBE GRID BUFFER - - - - -  //
+    ZeroMemory( &cBufferDesc, sizeof(D3D11_BUFFER_DESC) );
 
-    // Viewspace matrix
-    DirectX::XMMATRIX viewSpace = DirectX::XMMatrixIdentity();
-    viewSpace = DirectX::XMMatrixLookAtLH(eyePosition, targetPosition, camUpVector); // left handed coordinate system
+                cBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+                cBufferDesc.ByteWidth = sizeof( cBufferProbes );
+                cBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                cBufferDesc.CPUAccessFlags = 0;
+                cBufferDesc.MiscFlags = 0;
+
+    hr = pDevice->CreateBuffer( &cBufferDesc, NULL, &pCBufferProbes );
+    assert( SUCCEEDED(hr) );
+
+
+    // * * * * * SCENE TRANSFORMS * * * * * //
+    jobSystem.init();
+
+    // Baked with the job system, before the entities that use it
+    if ( !createStaticGeometry() ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create static geometry failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
+
+    // Quad + static geometry are pooled by now
+    if ( !visibilityBuffer.createGeometryBuffers( pDevice ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create visibility geometry pool failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
+
+    createSceneEntities();
+
+    // Bounds are moved to world space every frame by the bounds system, the BVH is refit to them
+    std::vector<DirectX::XMFLOAT3> boundsMins( sceneCuller.getObjectCount() ), boundsMaxs( sceneCuller.getObjectCount() );
+    sceneBvh.build( boundsMins.data(), boundsMaxs.data(), sceneCuller.getObjectCount() );
+
+    // The read / write sets order the systems: animate + skeleton -> transforms -> bounds + lod -> visibility,
+    // systems joined by + share a stage
+    sceneSystems.addSystem( "animate", componentMask<TransformComponent>(), componentMask<SpinComponent, SlideComponent, SceneTransformsTag>(), animateSystem );
+    sceneSystems.addSystem( "skeleton", 0, componentMask<SkinnedComponent, AnimationComponent, BoundsComponent>(), skeletonSystem );
+    sceneSystems.addSystem( "transforms", 0, componentMask<SceneTransformsTag>(), transformSystem );
+    sceneSystems.addSystem( "bounds", componentMask<TransformComponent, SceneTransformsTag>(), componentMask<BoundsComponent, SceneBoundsTag>(), boundsSystem );
+    sceneSystems.addSystem( "lod", componentMask<TransformComponent, SceneTransformsTag>(), componentMask<MeshletLodComponent>(), lodSystem );
+    sceneSystems.addSystem( "visibility", componentMask<TransformComponent, OccluderComponent, SceneTransformsTag, SceneBoundsTag>(), componentMask<BoundsComponent, OcclusionTag>(), visibilitySystem );
+    sceneSystems.addSystem( "shadows", componentMask<TransformComponent, BoundsComponent, ShadowCasterComponent, MeshComponent, MeshletLodComponent, SkinnedComponent, SceneTransformsTag>(),
+                            componentMask<ShadowMapTag>(), shadowSystem );
+
+    // Quarter resolution is plenty for occlusion
+    occlusionCuller.resize( width / 4, height / 4 );
+
+    // Small colored lights in a box around the objects
+    createRandomLights( 512, DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f), DirectX::XMFLOAT3(3.0f, 1.5f, 3.0f), 0.3f, 0.9f, 1, scenePointLights );
+    for ( size_t i = 0; i < scenePointLights.size(); i++ )
+        scenePointLights[i].intensity = 0.6f;
+
+    if ( !sceneLights.init( pDevice, (UINT)scenePointLights.size() ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create light buffers failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
+
+    if ( !deferredShading.init( pDevice, width, height, (UINT)scenePointLights.size() ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create G-buffer failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
+
+    if ( !visibilityBuffer.init( pDevice, width, height, 16 ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create visibility buffer failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
+
+    if ( !postProcess.init( pDevice, width, height, 6 ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create HDR target failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
 
-    // - * * * - Projection settings - * * * - //
+    if ( !lightShadows.init( pDevice, 512 ) ) {
+        MessageBeep(1);
+        MessageBoxA(0, "[Error] Create shadow map failed! -> Closing program!", "Fatal Error", MB_OK | MB_ICONERROR);
+        return false;
+    }
+
+
+    // * * * * * CAMERA * * * * * //
     float fovInDegrees = 90.0f;  // field of view
-    float fovInRadians = (fovInDegrees / 360.0f) * 3.14f;
-    float aspectRatio = (float)width / height;
-    float nearZ = 0.1f;
-    float farZ = 1000.0f;
-
-    // Projection Space matrix
-    DirectX::XMMATRIX projectionSpace = DirectX::XMMatrixIdentity();
-    projectionSpace = DirectX::XMMatrixPerspectiveFovLH(fovInRadians, aspectRatio, nearZ, farZ);  // left handed coordinate system
-    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //   
-    
+
+    camera.position = DirectX::XMFLOAT3(0.0f, 0.0f, -2.0f);
+    camera.target = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+    camera.up = DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f);
+    camera.fovY = (fovInDegrees / 360.0f) * 3.14f;
+    camera.aspectRatio = (float)width / height;
+    camera.nearZ = 0.1f;
+    camera.farZ = 1000.0f;
+
+    return true;
+}
+
+void updateCBuffs()
+{
+    // - - Constantbuffer objects, matrix to setup - - //
+    cBufferLight light;    // light-buffer to send into the shader
 
     // - - - - - CBUFFER Light Setup - - - - - //
-    light.ambientLightColor = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);  // how much of objects rgb is used
-    light.ambientLightStrength = 0.2f;  // how lit object is
+    light.ambientLightColor() = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);  // how much of objects rgb is used
+    light.ambientLightStrength() = 0.2f;  // how lit object is
     
-    light.dynamicLightColor = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);  // light color
-    light.dynamicLightStrength = 1.0f;  // light strength
+    light.dynamicLightColor() = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);  // light color
+    light.dynamicLightStrength() = 1.0f;  // light strength
 
-    light.dynamicLightPosition = DirectX::XMFLOAT3(-0.90f, 0.0f, 0.0f);   // light position
+    light.dynamicLightPosition() = dynamicLightPosition;   // light position, also casts the cube shadows
 
-    light.dynamicAttenuation = DirectX::XMFLOAT3(0.2f, 0.1f, 0.1f);     // light falloff 
+    light.dynamicAttenuation() = dynamicLightAttenuation;     // light falloff 
 
-    lightCBuffer.light = light;
-    pDeviceContext->UpdateSubresource( pCBufferLight, 0, NULL, &lightCBuffer, 0, 0 );
+    pDeviceContext->UpdateSubresource( pCBufferLight, 0, NULL, &light, 0, 0 );
     pDeviceContext->PSSetConstantBuffers( 0, 1, &pCBufferLight );
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - //
+}
 
-    
-    // * * * * * CBUFFER MATRIX OBJECT TRANSFORM * * * * * //
-    // Translation and rotations
-    DirectX::XMMATRIX rotation = DirectX::XMMatrixRotationZ(rot);
-    DirectX::XMMATRIX translation = DirectX::XMMatrixTranslation(transform, 0.0f, 0.0f);
+void createSceneEntities()
+{
+    // Quad: spins around z while sliding along x, and hides what is behind it
+    TransformComponent quadTransform = { sceneTransforms.addNode() };
+    SpinComponent quadSpin = { DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f), 0.0f, 0.0002f };
+    SlideComponent quadSlide = { DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f), DirectX::XMFLOAT3(1.0f, 0.0f, 0.0f), -2.0f, 0.0001f, -2.0f, 2.0f };
+    MeshComponent quadMeshComponent = { &quadMesh };
+    OccluderComponent quadOccluderComponent = { &quadOccluder };
+    NameComponent quadName = { "quad" };
+    ShadowCasterComponent quadShadow = { lightShadows.addCaster( false ) };
+
+    BoundsComponent quadBounds;
+    ZeroMemory( &quadBounds, sizeof(BoundsComponent) );
+    quadBounds.localCenter = quadMesh.quantization.positionOffset;
+    quadBounds.localExtents = quadMesh.quantization.positionScale;
+    quadBounds.cullIndex = sceneCuller.addBox( quadBounds.localCenter, quadBounds.localExtents );
+
+    VisibilityComponent quadVisibility = { quadGeometry };
+
+    boundsEntities.push_back( sceneWorld.createEntity( quadName, quadTransform, quadSpin, quadSlide, quadBounds, quadMeshComponent, quadOccluderComponent, quadShadow, quadVisibility ) );
+    shadowCasterEntities.push_back( boundsEntities.back() );
+
+    // Sphere: turns around y behind the quad's path
+    TransformComponent sphereTransform = { sceneTransforms.addNode() };
+    sceneTransforms.setPosition( sphereTransform.transform, DirectX::XMFLOAT3(0.0f, 0.0f, 1.5f) );
+    SpinComponent sphereSpin = { DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f), 0.0f, 0.0002f };
+    MeshletLodComponent sphereLodComponent = { sphereLods.data(), &sphereLodSelection, 0 };
+    NameComponent sphereName = { "sphere" };
+    ShadowCasterComponent sphereShadow = { lightShadows.addCaster( false ) };
+
+    BoundsComponent sphereBounds;
+    ZeroMemory( &sphereBounds, sizeof(BoundsComponent) );
+    sphereBounds.localCenter = sphereLods[0].quantization.positionOffset;
+    sphereBounds.localExtents = sphereLods[0].quantization.positionScale;
+    sphereBounds.cullIndex = sceneCuller.addBox( sphereBounds.localCenter, sphereBounds.localExtents );
+
+    boundsEntities.push_back( sceneWorld.createEntity( sphereName, sphereTransform, sphereSpin, sphereBounds, sphereLodComponent, sphereShadow ) );
+    shadowCasterEntities.push_back( boundsEntities.back() );
+
+    // Tube: stands right of the quad's path and bends, its bounds follow the pose
+    TransformComponent tubeTransform = { sceneTransforms.addNode() };
+    sceneTransforms.setPosition( tubeTransform.transform, DirectX::XMFLOAT3(1.4f, -0.6f, 0.8f) );
+    SkinnedComponent tubeSkinned = { &tubeSkin, &tubeSkeleton, &tubePose, &tubeMesh, computeSkinnedQuantization( tubeSkin, tubePose.palette.data() ), FALSE, 0 };
+    AnimationComponent tubeAnimation = { { &tubeBendClip, &tubeSwayClip }, 0.0f, 0.0f };
+    NameComponent tubeName = { "tube" };
+    ShadowCasterComponent tubeShadow = { lightShadows.addCaster( false ) };
+
+    BoundsComponent tubeBounds;
+    ZeroMemory( &tubeBounds, sizeof(BoundsComponent) );
+    tubeBounds.localCenter = tubeSkinned.quantization.positionOffset;
+    tubeBounds.localExtents = tubeSkinned.quantization.positionScale;
+    tubeBounds.cullIndex = sceneCuller.addBox( tubeBounds.localCenter, tubeBounds.localExtents );
+
+    boundsEntities.push_back( sceneWorld.createEntity( tubeName, tubeTransform, tubeBounds, tubeSkinned, tubeAnimation, tubeShadow ) );
+    shadowCasterEntities.push_back( boundsEntities.back() );
+
+    // Static geometry: already in world space, receives the cube shadows and stays in the shadow map's static layer
+    TransformComponent staticTransform = { sceneTransforms.addNode() };
+    MeshComponent staticMeshComponent = { &staticMesh };
+    LightmapComponent staticLightmap = { pStaticLightmapUvs };
+    ShadowCasterComponent staticShadow = { lightShadows.addCaster( true ) };
+    NameComponent staticName = { "floor" };
+    VisibilityComponent staticVisibility = { staticGeometry };
+
+    BoundsComponent staticBounds;
+    ZeroMemory( &staticBounds, sizeof(BoundsComponent) );
+    staticBounds.localCenter = staticMesh.quantization.positionOffset;
+    staticBounds.localExtents = staticMesh.quantization.positionScale;
+    staticBounds.cullIndex = sceneCuller.addBox( staticBounds.localCenter, staticBounds.localExtents );
+
+    boundsEntities.push_back( sceneWorld.createEntity( staticName, staticTransform, staticBounds, staticMeshComponent, staticLightmap, staticShadow, staticVisibility ) );
+    shadowCasterEntities.push_back( boundsEntities.back() );
+}
+
+bool createStaticGeometry()
+{
+    LightmapMesh staticMeshes[2];
+
+    // Floor: grid turned from facing -z to facing up, below everything
+    createGridMesh( 8, 8, 6.0f, 6.0f, staticMeshes[0].mesh );
+    transformMesh( staticMeshes[0].mesh, DirectX::XMMatrixRotationX(DirectX::XM_PIDIV2) * DirectX::XMMatrixTranslation(0.0f, -1.2f, 1.0f) );
+    staticMeshes[0].albedo = DirectX::XMFLOAT3(0.6f, 0.6f, 0.6f);
+
+    // Pillars behind the moving objects, left and right
+    MeshData box;
+    createBoxMesh( DirectX::XMFLOAT3(0.25f, 0.75f, 0.25f), box );
+    appendMesh( staticMeshes[1].mesh, box, DirectX::XMFLOAT3(-2.0f, -0.45f, 2.5f) );
+    createBoxMesh( DirectX::XMFLOAT3(0.3f, 0.3f, 0.3f), box );
+    appendMesh( staticMeshes[1].mesh, box, DirectX::XMFLOAT3(2.0f, -0.9f, 2.2f) );
+    staticMeshes[1].albedo = DirectX::XMFLOAT3(0.7f, 0.5f, 0.4f);
+
+    // - - - lightmap: the dynamic light (it stays put) + the ambient light as sky - - - //
+    LightmapBakeSettings settings;
+    settings.skyColor = DirectX::XMFLOAT3(0.2f, 0.2f, 0.2f);   // ambientLightColor * ambientLightStrength
+
+    LightmapBakeStats stats;
+    ZeroMemory( &stats, sizeof(LightmapBakeStats) );
+    if ( !unwrapLightmap( staticMeshes, ARRAYSIZE(staticMeshes), settings, stats ) )
+        return false;
+
+    LightmapLight light = { dynamicLightPosition, 1.0f, DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f), dynamicLightAttenuation, true };
+    UINT64 bakeHash = getLightmapBakeHash( staticMeshes, ARRAYSIZE(staticMeshes), &light, 1, settings );
+
+    Lightmap lightmap;
+    if ( !readLightmapFile( staticLightmapFile, bakeHash, lightmap ) ) {
+        if ( !bakeLightmap( staticMeshes, ARRAYSIZE(staticMeshes), &light, 1, settings, lightmap, stats, &jobSystem ) )
+            return false;
+
+        char message[256];
+        sprintf_s( message, "[Lightmap] %u x %u, %u charts, %u texels, %llu rays on %u threads: %.1f ms, denoise %.1f ms\n",
+                   lightmap.width, lightmap.height, stats.charts, stats.texels, stats.rays, stats.threads, stats.traceMs, stats.denoiseMs );
+        OutputDebugStringA( message );
+
+        // Not fatal, the next run bakes again
+        if ( !writeLightmapFile( staticLightmapFile, lightmap, bakeHash ) )
+            OutputDebugStringA( "[Lightmap] Writing the lightmap file failed\n" );
+    }
+
+    // - - - one mesh, vertex order kept (no optimizeMesh / 16 bit split) so the UV stream lines up - - - //
+    MeshData combined = staticMeshes[0].mesh;
+    appendMesh( combined, staticMeshes[1].mesh, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f) );
+
+    std::vector<DirectX::XMFLOAT2> lightmapUvs = staticMeshes[0].lightmapUvs;
+    lightmapUvs.insert( lightmapUvs.end(), staticMeshes[1].lightmapUvs.begin(), staticMeshes[1].lightmapUvs.end() );
+
+    PackedMeshData packedStatic;
+    buildPackedMesh( combined, packedStatic, false );
+    staticGeometry = visibilityBuffer.addGeometry( packedStatic, &lightmapUvs );
+
+    // - - - probes over the floor, up to above the objects: same light and sky, fast enough to bake every run - - - //
+    ProbeBakeStats probeStats;
+    initProbeGrid( DirectX::XMFLOAT3(-3.0f, -1.1f, -2.0f), DirectX::XMFLOAT3(3.0f, 1.4f, 4.0f), 0.5f, sceneProbes );
+    if ( !bakeIrradianceProbes( staticMeshes, ARRAYSIZE(staticMeshes), &light, 1, settings, 256, sceneProbes, probeStats, &jobSystem ) )
+        return false;
+
+    char message[160];
+    sprintf_s( message, "[Probes] %u x %u x %u probes (%u inside geometry) on %u threads: %.1f ms\n",
+               sceneProbes.sizeX, sceneProbes.sizeY, sceneProbes.sizeZ, probeStats.insideProbes, probeStats.threads, probeStats.traceMs );
+    OutputDebugStringA( message );
+
+    cBufferProbes probes;
+    getProbeConstants( sceneProbes, probes );
+    pDeviceContext->UpdateSubresource( pCBufferProbes, 0, NULL, &probes, 0, 0 );
 
-    // Set worldSpace's using the transformations
-    worldSpace = rotation * translation;
+    return createMesh( pDevice, packedStatic, staticMesh ) &&
+           createLightmapUvBuffer( pDevice, lightmapUvs, &pStaticLightmapUvs ) &&
+           createLightmapTexture( pDevice, lightmap, &pLightmapSRV ) &&
+           createProbeTexture( pDevice, sceneProbes, &pProbeSRV );
+}
+
+// * * * * * SCENE SYSTEMS * * * * * //
+// Spin / slide state into the transform nodes
+void animateSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    world.forEach<const TransformComponent, SpinComponent>( [&]( EntityID, const TransformComponent& transform, SpinComponent& spin ) {
+        spin.angle += spin.speed;
+        if ( spin.angle > DirectX::XM_2PI )
+            spin.angle -= DirectX::XM_2PI;
+
+        sceneTransforms.setRotation( transform.transform, DirectX::XMQuaternionRotationAxis(DirectX::XMLoadFloat3(&spin.axis), spin.angle) );
+    } );
+
+    world.forEach<const TransformComponent, SlideComponent>( [&]( EntityID, const TransformComponent& transform, SlideComponent& slide ) {
+        slide.offset += slide.speed;
+        if ( slide.offset >= slide.maxOffset )
+            slide.offset = slide.minOffset;
+
+        DirectX::XMFLOAT3 position( slide.origin.x + slide.axis.x * slide.offset, slide.origin.y + slide.axis.y * slide.offset, slide.origin.z + slide.axis.z * slide.offset );
+        sceneTransforms.setPosition( transform.transform, position );
+    } );
+}
+
+// Clips -> bone poses -> palette, the local bounds follow the pose
+void skeletonSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    std::vector<AnimationInstance> instances;
+    world.forEach<const SkinnedComponent, AnimationComponent>( [&]( EntityID, const SkinnedComponent& skinned, AnimationComponent& animation ) {
+        animation.time += 0.008f;
+        if ( animation.time > animation.pClips[0]->duration )
+            animation.time -= animation.pClips[0]->duration;
+        animation.blendPhase += 0.002f;
+        if ( animation.blendPhase > DirectX::XM_2PI )
+            animation.blendPhase -= DirectX::XM_2PI;
+
+        AnimationInstance instance = { skinned.pSkeleton, skinned.pPose, animation.pClips[0], animation.time,
+                                       animation.pClips[1], animation.time, 0.5f + 0.5f * sinf(animation.blendPhase) };
+        instances.push_back( instance );
+    } );
+
+    evaluateAnimationInstances( instances.data(), (UINT)instances.size(), pJobSystem );
+
+    world.forEach<SkinnedComponent, BoundsComponent>( [&]( EntityID, SkinnedComponent& skinned, BoundsComponent& bounds ) {
+        const SkeletonPose& pose = *skinned.pPose;
+        skinned.quantization = computeSkinnedQuantization( *skinned.pSkin, pose.palette.data() );
+        skinned.poseVersion++;
+        bounds.localCenter = skinned.quantization.positionOffset;
+        bounds.localExtents = skinned.quantization.positionScale;
+    } );
+}
+
+void transformSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    sceneTransforms.update( pJobSystem );
+}
+
+// Local mesh bounds (the quantization box) into world space, for the culler and the BVH
+void boundsSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    world.forEach<const TransformComponent, BoundsComponent>( [&]( EntityID, const TransformComponent& transform, BoundsComponent& bounds ) {
+        transformBox( bounds.localCenter, bounds.localExtents, sceneTransforms.getWorldMatrix(transform.transform), bounds.worldCenter, bounds.worldExtents );
+
+        const DirectX::XMFLOAT3& center = bounds.worldCenter;
+        const DirectX::XMFLOAT3& extents = bounds.worldExtents;
+        sceneCuller.setBox( bounds.cullIndex, center, extents );
+        sceneBvh.setObjectBounds( bounds.cullIndex, DirectX::XMFLOAT3(center.x - extents.x, center.y - extents.y, center.z - extents.z),
+                                                    DirectX::XMFLOAT3(center.x + extents.x, center.y + extents.y, center.z + extents.z) );
+    } );
+
+    sceneBvh.refit();
+}
+
+// LOD by projected error
+void lodSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    DirectX::XMMATRIX view = getViewMatrix(camera);
+    DirectX::XMMATRIX projection = getProjectionMatrix(camera);
+
+    world.forEach<const TransformComponent, MeshletLodComponent>( [&]( EntityID, const TransformComponent& transform, MeshletLodComponent& lods ) {
+        lods.lod = selectLod( *lods.pSelection, sceneTransforms.getWorldMatrix(transform.transform), view, projection, (float)height );
+    } );
+}
+
+// Frustum culling, then the occluders are rasterized and the remaining objects tested against them
+void visibilitySystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    Frustum frustum;
+    DirectX::XMMATRIX viewProjection = getViewMatrix(camera) * getProjectionMatrix(camera);
+    extractFrustum( viewProjection, frustum );
+    sceneCuller.cull( frustum, visibleObjects, pJobSystem );
+
+    occlusionCuller.beginFrame( viewProjection );
+    world.forEach<const TransformComponent, const OccluderComponent>( [&]( EntityID, const TransformComponent& transform, const OccluderComponent& occluder ) {
+        occlusionCuller.renderOccluder( *occluder.pOccluder, sceneTransforms.getWorldMatrix(transform.transform) );
+    } );
+
+    // Occluders aren't tested against themselves
+    world.forEach<BoundsComponent>( [&]( EntityID entity, BoundsComponent& bounds ) {
+        bounds.visible = std::binary_search(visibleObjects.begin(), visibleObjects.end(), bounds.cullIndex);
+        if ( bounds.visible && !world.hasComponent<OccluderComponent>(entity) )
+            bounds.visible = occlusionCuller.testBox( bounds.worldCenter, bounds.worldExtents );
+    } );
+}
+
+// World matrices, decode info and bounds into the shadow map, it compares them with the last frame
+void shadowSystem( EntityWorld& world, JobSystem* pJobSystem )
+{
+    world.forEach<const TransformComponent, const BoundsComponent, const ShadowCasterComponent, const MeshComponent>(
+        [&]( EntityID, const TransformComponent& transform, const BoundsComponent& bounds, const ShadowCasterComponent& shadowCaster, const MeshComponent& mesh ) {
+        lightShadows.setCaster( shadowCaster.caster, sceneTransforms.getWorldMatrix(transform.transform), mesh.pMesh->quantization, bounds.worldCenter, bounds.worldExtents );
+    } );
+
+    world.forEach<const TransformComponent, const BoundsComponent, const ShadowCasterComponent, const MeshletLodComponent>(
+        [&]( EntityID, const TransformComponent& transform, const BoundsComponent& bounds, const ShadowCasterComponent& shadowCaster, const MeshletLodComponent& lods ) {
+        lightShadows.setCaster( shadowCaster.caster, sceneTransforms.getWorldMatrix(transform.transform), lods.pLods[lods.lod].quantization, bounds.worldCenter, bounds.worldExtents );
+    } );
+
+    world.forEach<const TransformComponent, const BoundsComponent, const ShadowCasterComponent, const SkinnedComponent>(
+        [&]( EntityID, const TransformComponent& transform, const BoundsComponent& bounds, const ShadowCasterComponent& shadowCaster, const SkinnedComponent& skinned ) {
+        lightShadows.setCaster( shadowCaster.caster, sceneTransforms.getWorldMatrix(transform.transform), skinned.quantization, bounds.worldCenter, bounds.worldExtents, skinned.poseVersion );
+    } );
+}
+
+// Called by lightShadows.render with its depth only shader and the caster's constants set
+void drawShadowCaster( UINT caster, UINT face )
+{
+    EntityID entity = shadowCasterEntities[caster];
+
+    if ( MeshComponent* pMesh = sceneWorld.getComponent<MeshComponent>(entity) ) {
+        drawMesh( pDeviceContext, *pMesh->pMesh );
+    }
+    else if ( MeshletLodComponent* pLods = sceneWorld.getComponent<MeshletLodComponent>(entity) ) {
+        // Meshlets culled against the cube face, back facing ones as seen from the light
+        DirectX::XMMATRIX world = sceneTransforms.getWorldMatrix(sceneWorld.getComponent<TransformComponent>(entity)->transform);
+        MeshletMesh& meshletMesh = pLods->pLods[pLods->lod];
+
+        Frustum objectFrustum;
+        extractFrustum( world * lightShadows.getFaceViewProjection(face), objectFrustum );
+
+        DirectX::XMFLOAT3 objectLight;
+        DirectX::XMStoreFloat3( &objectLight, DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&lightShadows.getLightPosition()), DirectX::XMMatrixInverse(NULL, world)) );
+
+        cullMeshlets( pDeviceContext, meshletMesh, objectFrustum, objectLight );
+        drawMeshletMesh( pDeviceContext, meshletMesh );
+    }
+    else if ( SkinnedComponent* pSkinned = sceneWorld.getComponent<SkinnedComponent>(entity) ) {
+        if ( pSkinned->uploaded )
+            drawMesh( pDeviceContext, *pSkinned->pMesh );
+    }
+}
+
+void updateObjectCBuffer(DirectX::FXMMATRIX worldSpace, const VertexQuantization& quantization)
+{
+    cBuffer objectTransform;
+
+    // View / projection from the camera (left handed coordinate system)
+    DirectX::XMMATRIX viewSpace = getViewMatrix(camera);
+    DirectX::XMMATRIX projectionSpace = getProjectionMatrix(camera);
 
     // constant buffer setting worldViewProj-matrix   
-    worldViewProj = DirectX::XMMatrixIdentity();
-    worldViewProj = worldSpace * viewSpace * projectionSpace;
+    DirectX::XMMATRIX worldViewProj = worldSpace * viewSpace * projectionSpace;
 
     // Switch from raw to column-major format -> put matrix to constant buffer
-    objectTransform.World = DirectX::XMMatrixTranspose(worldSpace); // For lightning
-    objectTransform.WVP = DirectX::XMMatrixTranspose(worldViewProj);
+    objectTransform.world() = DirectX::XMMatrixTranspose(worldSpace); // For lightning
+    objectTransform.worldViewProjection() = DirectX::XMMatrixTranspose(worldViewProj);
+
+    // Vertex decode info
+    objectTransform.positionScale() = quantization.positionScale;
+    objectTransform.positionOffset() = quantization.positionOffset;
 
     // Update resource and send to cbuffer
     pDeviceContext->UpdateSubresource( pCBuffer, 0, NULL, &objectTransform, 0, 0 );
     pDeviceContext->VSSetConstantBuffers( 0, 1, &pCBuffer );
 }
 
+void pickObject(int x, int y)
+{
+    // Pixel -> points on the near and far plane -> world space ray
+    DirectX::XMMATRIX inverseViewProj = DirectX::XMMatrixInverse( nullptr, getViewMatrix(camera) * getProjectionMatrix(camera) );
+    float ndcX = 2.0f * x / width - 1.0f;
+    float ndcY = 1.0f - 2.0f * y / height;
+
+    DirectX::XMVECTOR nearPoint = DirectX::XMVector3TransformCoord( DirectX::XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), inverseViewProj );
+    DirectX::XMVECTOR farPoint = DirectX::XMVector3TransformCoord( DirectX::XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), inverseViewProj );
+
+    DirectX::XMVECTOR ray = DirectX::XMVectorSubtract(farPoint, nearPoint);
+    DirectX::XMFLOAT3 origin, direction;
+    DirectX::XMStoreFloat3( &origin, nearPoint );
+    DirectX::XMStoreFloat3( &direction, ray );
+
+    char message[128];
+    BvhRayHit hit;
+    if ( sceneBvh.raycast( origin, direction, 1.0f, hit ) ) {
+        NameComponent* pName = sceneWorld.getComponent<NameComponent>( boundsEntities[hit.object] );
+        sprintf_s( message, "[Picking] %s, %.2f units from the near plane\n", pName ? pName->pName : "entity", hit.distance * DirectX::XMVectorGetX(DirectX::XMVector3Length(ray)) );
+    }
+    else
+        sprintf_s( message, "[Picking] nothing\n" );
+    OutputDebugStringA( message );
+}
+
 LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam ) {
 
     switch (message) {
@@ -658,6 +1452,32 @@ LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam
         break;
     }
 
+    case WM_LBUTTONDOWN: {
+        pickObject( (short)LOWORD(lParam), (short)HIWORD(lParam) );
+        break;
+    }
+
+    case WM_KEYDOWN: {
+        if ( wParam == 'D' || wParam == 'V' ) {
+            ShadingMode mode = wParam == 'D' ? SHADING_DEFERRED : SHADING_VISIBILITY;
+            shadingMode = shadingMode == mode ? SHADING_FORWARD : mode;
+
+            const char* names[] = { "[Shading] forward (clustered)\n", "[Shading] deferred\n", "[Shading] visibility buffer\n" };
+            OutputDebugStringA( names[shadingMode] );
+        }
+        else if ( wParam == 'T' ) {
+            postSettings.toneMapOperator = (ToneMapOperator)( ( postSettings.toneMapOperator + 1 ) % TONEMAP_OPERATOR_COUNT );
+
+            const char* names[] = { "[Post] tone mapping: saturate\n", "[Post] tone mapping: Reinhard\n", "[Post] tone mapping: ACES filmic\n" };
+            OutputDebugStringA( names[postSettings.toneMapOperator] );
+        }
+        else if ( wParam == 'B' ) {
+            postSettings.bloomStrength = postSettings.bloomStrength > 0.0f ? 0.0f : PostProcessSettings().bloomStrength;
+            OutputDebugStringA( postSettings.bloomStrength > 0.0f ? "[Post] bloom on\n" : "[Post] bloom off\n" );
+        }
+        break;
+    }
+
     }
     return DefWindowProc(hWnd, message, wParam, lParam);
 }
\ No newline at end of file
@@ -1,19 +1,50 @@
-struct Light
-{
-	float3 ambientLightColor;
-	float ambientLightStrength;
+// Constant buffers are declared by main.cpp from the C++ definitions (CBufferLayout.h), with packoffset
+// cBufferLight (b0): ambientLightColor, ambientLightStrength, dynamicLightColor, dynamicLightStrength,
+//                    dynamicLightPosition, dynamicAttenuation
+CBUFFER_LIGHT
 
-	float3 dynamicLightColor;
-	float dynamicLightStrength;
+// Slice of the texture array this draw samples from
+CBUFFER_MATERIAL
 
-	float3 dynamicLightPosition;
-	float3 dynamicAttenuation;	
+// * * * Clustered point lights (ClusteredLighting.h) * * * //
+struct PointLight
+{
+	float3 position;
+	float radius;
+	float3 color;
+	float intensity;
 };
 
-cbuffer cBufferLight
+// cBufferClusters (b2): viewDepth, tileScale, sliceScale, sliceBias, clusterCounts
+CBUFFER_CLUSTERS
+
+StructuredBuffer<PointLight> pointLights : register(t1);
+StructuredBuffer<uint2> clusterRanges : register(t2);	// offset, count into clusterLightIndices
+StructuredBuffer<uint> clusterLightIndices : register(t3);
+
+// * * * Cube shadow map of the dynamic light (PointShadowMap.h) * * * //
+// cBufferShadow (b3): shadowLightPosition, shadowDepthScale, shadowDepthOffset
+CBUFFER_SHADOW
+
+TextureCube<float> shadowCube : register(t4);
+SamplerComparisonState shadowSampler : register(s1);
+
+// 1 = lit, 0 = shadowed. The cube face is picked by the major axis, its projected depth is compared (2 x 2 PCF)
+float sampleShadow(float3 worldPos)
 {
-	Light light;
-};
+	float3 fromLight = worldPos - shadowLightPosition;
+	float3 distances = abs(fromLight);
+	float majorAxis = max(distances.x, max(distances.y, distances.z));
+	float depth = saturate(shadowDepthOffset + shadowDepthScale / majorAxis);
+	return shadowCube.SampleCmpLevelZero(shadowSampler, fromLight, depth);
+}
+
+// * * * Irradiance probes (IrradianceProbes.h) * * * //
+// cBufferProbes (b6): probeGridMin, probeInverseSpacing, probeGridSize
+CBUFFER_PROBES
+
+// 7 blocks of probeGridSize.x texels side by side in x, the 27 SH coefficients (rgb) of a probe
+Texture3D<float4> probeCoefficients : register(t11);
 
 // :::::::: inputs to pixel shader :::::::: //
 struct pShader_input {
@@ -22,46 +53,149 @@ struct pShader_input {
 	float3 inColor : COL;
 	float3 inNormal : NOR;	
 	float2 inTexCoord : TEXCOORD; // For texture
+	float2 inLightmapUv : TEXCOORD1;	// static geometry only (vs_lightmapped)
 };
 
-Texture2D objTexture : TEXTURE: register(t0);
+Texture2DArray objTexture : TEXTURE: register(t0);
 SamplerState objSamplerState : SAMPLER: register(s0);
 
-// :::::::: how to handle inputs :::::::: //	Return float4 pixelcolor
-float4 ps_main(pShader_input input) : SV_TARGET
-{
-	// color from texture
-	float3 sampleColor = objTexture.Sample(objSamplerState, input.inTexCoord);
-
-	// Ambient brightness and color setup
-	float3 ambientLight = light.ambientLightColor * light.ambientLightStrength;
-	float3 appliedFinalLight = ambientLight;
+// Baked static lighting (Lightmap.h): rgb = light arriving at the texel, a = share of it from the dynamic light
+Texture2D<float4> lightmap : register(t5);
 
+// :::::::: dynamic light, shadowed by the cube shadow map :::::::: //
+float3 getDynamicLight(float3 worldPos, float3 normal)
+{
 	// Get normalized vector from pixel to light
-	float3 vecToLight = normalize(light.dynamicLightPosition - input.inWorldPos);
+	float3 vecToLight = normalize(dynamicLightPosition - worldPos);
 
 	// Det dot-product to se how intense light is, angle between vectors, 
-	float3 diffuseLightIntensity = max(dot(input.inNormal, vecToLight),0); // "max" makes sure that the intensity-value isn't gonna be less than 0.0f
+	float3 diffuseLightIntensity = max(dot(normal, vecToLight),0); // "max" makes sure that the intensity-value isn't gonna be less than 0.0f
 
 	// * * * Attenuation * * * //
 	// Calculate lightIntensity with attentuation
-	float distanceVecToLight = distance(light.dynamicLightPosition, input.inWorldPos);	// distance, not normalized
+	float distanceVecToLight = distance(dynamicLightPosition, worldPos);	// distance, not normalized
 	// Get factor from equation
-	float attenuationFactor = 1 / (light.dynamicAttenuation[0]) + (light.dynamicAttenuation[1] * distanceVecToLight) + (light.dynamicAttenuation[2] * (distanceVecToLight * distanceVecToLight));
+	float attenuationFactor = 1 / (dynamicAttenuation[0] + (dynamicAttenuation[1] * distanceVecToLight) + (dynamicAttenuation[2] * (distanceVecToLight * distanceVecToLight)));
 
-	diffuseLightIntensity *= attenuationFactor;
+	diffuseLightIntensity *= attenuationFactor * sampleShadow(worldPos);
 	// * * *    * * *    * * * //
 
-	float3 diffuseLight = diffuseLightIntensity * light.dynamicLightStrength * light.dynamicLightColor;
+	return diffuseLightIntensity * dynamicLightStrength * dynamicLightColor;
+};
+
+// :::::::: indirect light from the probe grid, replaces the flat ambient light :::::::: //
+// The sampler blends the 8 probes around worldPos, the coordinates stay half a texel inside a block
+// so it never blends across blocks. Then 9 MADs per channel (IrradianceProbes.h)
+float3 getProbeIrradiance(float3 worldPos, float3 normal)
+{
+	float3 probe = clamp((worldPos - probeGridMin) * probeInverseSpacing + 0.5f, 0.5f, probeGridSize - 0.5f);
+	float3 uvw = float3(probe.x / (probeGridSize.x * 7.0f), probe.yz / probeGridSize.yz);
+
+	float4 c[7];
+	[unroll] for (uint k = 0; k < 7; k++)
+		c[k] = probeCoefficients.SampleLevel(objSamplerState, uvw + float3(k / 7.0f, 0.0f, 0.0f), 0.0f);
+
+	float3 n = normal;
+	float3 irradiance = c[0].xyz;
+	irradiance += float3(c[0].w, c[1].xy) * n.y;
+	irradiance += float3(c[1].zw, c[2].x) * n.z;
+	irradiance += c[2].yzw * n.x;
+	irradiance += c[3].xyz * (n.x * n.y);
+	irradiance += float3(c[3].w, c[4].xy) * (n.y * n.z);
+	irradiance += float3(c[4].zw, c[5].x) * (3.0f * n.z * n.z - 1.0f);
+	irradiance += c[5].yzw * (n.x * n.z);
+	irradiance += c[6].xyz * (n.x * n.x - n.y * n.y);
+	return max(irradiance, 0.0f);
+};
+
+// :::::::: clustered point lights :::::::: //
+// Only the lights of this pixel's cluster, falloff reaches 0 at the light radius
+float3 getClusteredLight(float4 svPosition, float3 worldPos, float3 normal)
+{
+	float depth = dot(float4(worldPos, 1.0f), viewDepth);
+	uint3 cluster = uint3(svPosition.xy * tileScale, max(log(depth) * sliceScale + sliceBias, 0.0f));
+	cluster = min(cluster, clusterCounts - 1);
+	uint2 range = clusterRanges[(cluster.z * clusterCounts.y + cluster.y) * clusterCounts.x + cluster.x];
+
+	float3 light = float3(0.0f, 0.0f, 0.0f);
+	for (uint i = 0; i < range.y; i++) {
+		PointLight pointLight = pointLights[clusterLightIndices[range.x + i]];
+
+		float3 toLight = pointLight.position - worldPos;
+		float distanceSq = dot(toLight, toLight);
+		float falloff = saturate(1.0f - distanceSq / (pointLight.radius * pointLight.radius));
+
+		float intensity = max(dot(normal, toLight * rsqrt(max(distanceSq, 0.0001f))), 0.0f) * falloff * falloff;
+		light += intensity * pointLight.intensity * pointLight.color;
+	}
+	return light;
+};
+
+// :::::::: how to handle inputs :::::::: //	Return float4 pixelcolor
+float4 ps_main(pShader_input input) : SV_TARGET
+{
+	// color from texture
+	float3 sampleColor = objTexture.Sample(objSamplerState, float3(input.inTexCoord, textureSlice));
+
+	// Indirect light from the probes instead of a flat ambient
+	float3 appliedFinalLight = getProbeIrradiance(input.inWorldPos, normalize(input.inNormal));
 
 	// ambient light + colorlight/brighness/falloff factor
-	appliedFinalLight += diffuseLight;
+	appliedFinalLight += getDynamicLight(input.inWorldPos, input.inNormal);
+
+	// * * * Clustered lights * * * //
+	appliedFinalLight += getClusteredLight(input.inPosition, input.inWorldPos, normalize(input.inNormal));
 
 	// Final color pixel = texturecolor * ambientlight
 	float3 finalcolor = sampleColor * appliedFinalLight;
 
 	return float4(finalcolor, 1.0f);
+};
+
+// :::::::: static geometry: ambient + dynamic light come baked (with bounce light), one fetch :::::::: //
+// Moving casters only take out the dynamic light's share, the static shadows are already baked.
+// The lightmap has no mips, so no gradients either (visibilityBuffer.hlsl calls this in a branch)
+float3 getBakedLight(float2 lightmapUv, float3 worldPos)
+{
+	float4 baked = lightmap.SampleLevel(objSamplerState, lightmapUv, 0.0f);
+	return baked.rgb * (1.0f - baked.a * (1.0f - sampleShadow(worldPos)));
+};
 
+float4 ps_lightmapped(pShader_input input) : SV_TARGET
+{
+	float3 sampleColor = objTexture.Sample(objSamplerState, float3(input.inTexCoord, textureSlice));
 
+	float3 appliedFinalLight = getBakedLight(input.inLightmapUv, input.inWorldPos);
+	appliedFinalLight += getClusteredLight(input.inPosition, input.inWorldPos, normalize(input.inNormal));
 
-};
\ No newline at end of file
+	return float4(sampleColor * appliedFinalLight, 1.0f);
+};
+
+// :::::::: deferred shading G-buffer (DeferredShading.h), the point lights are added per light afterwards :::::::: //
+struct pShader_gbuffer_output {
+	float4 color : SV_TARGET0;	// everything but the point lights
+	float4 albedo : SV_TARGET1;
+	float4 normal : SV_TARGET2;	// world space, * 0.5 + 0.5
+};
+
+pShader_gbuffer_output writeGBuffer(float3 sampleColor, float3 appliedFinalLight, float3 normal)
+{
+	pShader_gbuffer_output output;
+	output.color = float4(sampleColor * appliedFinalLight, 1.0f);
+	output.albedo = float4(sampleColor, 1.0f);
+	output.normal = float4(normalize(normal) * 0.5f + 0.5f, 0.0f);
+	return output;
+};
+
+pShader_gbuffer_output ps_gbuffer(pShader_input input)
+{
+	float3 sampleColor = objTexture.Sample(objSamplerState, float3(input.inTexCoord, textureSlice));
+	float3 appliedFinalLight = getProbeIrradiance(input.inWorldPos, normalize(input.inNormal)) + getDynamicLight(input.inWorldPos, input.inNormal);
+	return writeGBuffer(sampleColor, appliedFinalLight, input.inNormal);
+};
+
+pShader_gbuffer_output ps_gbuffer_lightmapped(pShader_input input)
+{
+	float3 sampleColor = objTexture.Sample(objSamplerState, float3(input.inTexCoord, textureSlice));
+	return writeGBuffer(sampleColor, getBakedLight(input.inLightmapUv, input.inWorldPos), input.inNormal);
+};
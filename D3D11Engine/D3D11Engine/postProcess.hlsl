@@ -0,0 +1,91 @@
+// Declared by PostProcess.cpp from the C++ definition (CBufferLayout.h), with packoffset
+// cBufferPost (b0): sourceTexelSize, targetTexelSize, bloomThreshold, bloomScale, bloomTexelSize,
+//                   linearExposure, toneMapOperator, transferFunction
+CBUFFER_POST
+
+Texture2D<float4> source : register(t0);	// scene or the bloom level the pass reads
+Texture2D<float4> bloom : register(t1);	// tone map: bloom level 0
+SamplerState linearClamp : register(s0);
+
+// * * * * * one full screen triangle, no vertex buffer * * * * * //
+float4 vs_main(uint vertexId : SV_VertexID) : SV_POSITION
+{
+	float2 corner = float2((vertexId << 1) & 2, vertexId & 2);
+	return float4(corner * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+};
+
+// Both mappings go through the pixel index instead of svPosition * targetTexelSize: odd sizes round the level
+// below up, so the source is not exactly twice the target, and SoftwarePostProcess maps by index too.
+// :::::::: [1 3 3 1] / 8 per axis: 4 bilinear taps, 0.75 source texels from source texel 2x + 1 :::::::: //
+float3 downsampleSource(float2 svPosition)
+{
+	float2 uv = (2.0f * floor(svPosition) + 1.0f) * sourceTexelSize;
+	float2 offset = 0.75f * sourceTexelSize;
+
+	float3 color = source.SampleLevel(linearClamp, uv + float2(-offset.x, -offset.y), 0).rgb;
+	color += source.SampleLevel(linearClamp, uv + float2(offset.x, -offset.y), 0).rgb;
+	color += source.SampleLevel(linearClamp, uv + float2(-offset.x, offset.y), 0).rgb;
+	color += source.SampleLevel(linearClamp, uv + float2(offset.x, offset.y), 0).rgb;
+	return color * 0.25f;
+};
+
+// * * * * * scene -> bloom level 0, only the light above the threshold * * * * * //
+float4 ps_brightPass(float4 svPosition : SV_POSITION) : SV_TARGET
+{
+	float3 color = downsampleSource(svPosition.xy);
+	float luminance = dot(color, float3(0.2126f, 0.7152f, 0.0722f));
+	return float4(color * (max(luminance - bloomThreshold, 0.0f) / max(luminance, 0.0001f)), 1.0f);
+};
+
+float4 ps_downsample(float4 svPosition : SV_POSITION) : SV_TARGET
+{
+	return float4(downsampleSource(svPosition.xy), 1.0f);
+};
+
+// :::::::: 2x tent = one bilinear tap at (x + 0.5) / 2 coarse texels :::::::: //
+float2 upsampleUV(float2 svPosition, float2 coarseTexelSize)
+{
+	return (floor(svPosition) + 0.5f) * 0.5f * coarseTexelSize;
+};
+
+// * * * * * level below, added by the blend state * * * * * //
+float4 ps_upsample(float4 svPosition : SV_POSITION) : SV_TARGET
+{
+	return float4(source.SampleLevel(linearClamp, upsampleUV(svPosition.xy, sourceTexelSize), 0).rgb, 1.0f);
+};
+
+// :::::::: ToneMapPostProcess operators, SoftwarePostProcess has the same ones :::::::: //
+float3 toneMapColor(float3 color)
+{
+	color = max(color, 0.0f);
+
+	if (toneMapOperator == 1)
+		return color / (1.0f + color);	// Reinhard
+	if (toneMapOperator == 2)
+		return saturate((color * (2.51f * color + 0.03f)) / (color * (2.43f * color + 0.59f) + 0.14f));	// ACES filmic
+	return saturate(color);
+};
+
+// sRGB encoding: the linear segment, above it a fit from square roots instead of pow,
+// within a quarter of an 8 bit step of the exact curve
+float3 linearToSrgb(float3 color)
+{
+	float3 s1 = sqrt(color);
+	float3 s2 = sqrt(s1);
+	float3 s3 = sqrt(s2);
+	float3 curve = 0.662002687f * s1 + 0.684122060f * s2 - 0.323583601f * s3 - 0.0225411470f * color;
+	return saturate(color <= 0.0031308f ? 12.92f * color : curve);
+};
+
+// * * * * * scene + bloom -> back buffer * * * * * //
+float4 ps_toneMap(float4 svPosition : SV_POSITION) : SV_TARGET
+{
+	float3 color = source.Load(int3(svPosition.xy, 0)).rgb;
+	color += bloom.SampleLevel(linearClamp, upsampleUV(svPosition.xy, bloomTexelSize), 0).rgb * bloomScale;
+
+	color = toneMapColor(color * linearExposure);
+	if (transferFunction == 1)
+		color = linearToSrgb(color);
+
+	return float4(color, 1.0f);
+};
@@ -0,0 +1,15 @@
+// :::::::: inputs to pixel shader :::::::: //
+struct pShader_input {
+	float4 inPosition : SV_POSITION;
+	float3 inTexCoord : TEXCOORD;	// uv + slice
+	float4 inColor : COLOR;
+};
+
+Texture2DArray objTexture : TEXTURE: register(t0);
+SamplerState objSamplerState : SAMPLER: register(s0);
+
+// :::::::: texture color tinted by vertex color :::::::: //
+float4 ps_main(pShader_input input) : SV_TARGET
+{
+	return objTexture.Sample(objSamplerState, input.inTexCoord) * input.inColor;
+};
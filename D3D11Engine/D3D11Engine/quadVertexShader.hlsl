@@ -0,0 +1,28 @@
+// Declared by QuadBatch.cpp from the C++ definition (CBufferLayout.h), with packoffset
+// cBufferQuad (b0): transform (quad space -> clip space)
+CBUFFER_QUAD
+
+// * * * * * inputs to vertex shader * * * * * //
+struct vShader_input {
+	float3 inPosition : POS;
+	float2 inTexCoord : TEXCOORD;
+	uint inSlice : SLICE;		// texture array slice
+	float4 inColor : COL;
+};
+
+// * * * * * outputs from vertex shader * * * * * //
+struct vShader_output {
+	float4 outPosition : SV_POSITION;
+	float3 outTexCoord : TEXCOORD;	// uv + slice
+	float4 outColor : COLOR;
+};
+
+vShader_output vs_main(vShader_input input) {
+	vShader_output output = (vShader_output)0;	// zero out memory
+
+	output.outPosition = mul(float4(input.inPosition, 1.0f), transform);
+	output.outTexCoord = float3(input.inTexCoord, input.inSlice);
+	output.outColor = input.inColor;
+
+	return output;
+};
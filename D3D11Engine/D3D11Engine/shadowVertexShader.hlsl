@@ -0,0 +1,10 @@
+// Declared by PointShadowMap.cpp from the C++ definition (CBufferLayout.h), with packoffset
+// cBufferShadowObject (b0): worldViewProjection (world * cube face view * projection), positionScale, positionOffset
+CBUFFER_SHADOW_OBJECT
+
+// * * * * * depth only: position in, clip position out, no pixel shader * * * * * //
+float4 vs_main(float4 inPosition : POS) : SV_POSITION
+{
+	float3 position = inPosition.xyz * positionScale + positionOffset;
+	return mul(float4(position, 1.0f), worldViewProjection);
+};
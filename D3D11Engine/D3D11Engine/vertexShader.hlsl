@@ -1,16 +1,14 @@
-cbuffer constantBuffer
-{	
-	float4x4 worldViewProjection;	
-	float4x4 world;	
-};
+// Declared by main.cpp from the C++ definition (CBufferLayout.h), with packoffset
+// constantBuffer (b0): worldViewProjection, world, positionScale, positionOffset
+// Quantized position decode: pos = snorm * scale + offset
+CBUFFER_OBJECT
 
-// * * * * * inputs to vertex shader * * * * * //
+// * * * * * inputs to vertex shader (PackedVertex, 20 bytes) * * * * * //
 struct vShader_input {
-	float3 inPosition : POS;
-	float3 inWorld : POS;	// Light, using input position coordinates
-	float3 inColor : COL;	
-	float3 inNormal : NOR;	
-	float2 inTexCoord : TEXCOORD;
+	float4 inPosition : POS;	// R16G16B16A16_SNORM
+	float2 inNormal : NOR;		// R16G16_SNORM, octahedral
+	float2 inTexCoord : TEXCOORD;	// R16G16_FLOAT
+	float4 inColor : COL;		// R8G8B8A8_UNORM
 };
 
 // * * * * * outputs from vertex shader * * * * * //
@@ -20,17 +18,52 @@ struct vShader_output {
 	float3 outColor : COLOR;	
 	float3 outNormal : NORMAL;
 	float2 outTexCoord : TEXCOORD;
+	float2 outLightmapUv : TEXCOORD1;	// vs_lightmapped only
 };
 
-// * * * * * how to handle inputs pos / col / nor / texcoord * * * * * //
+// * * * * * octahedral normal -> unit vector * * * * * //
+float3 decodeOctahedral(float2 e) {
+	float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += (n.xy >= 0.0f) ? -t : t;
+	return normalize(n);
+}
+
+// * * * * * how to handle inputs pos / nor / texcoord / col * * * * * //
 vShader_output vs_main(vShader_input input) {
 	vShader_output output = (vShader_output)0;	// zero out memory
 
-	output.outPosition = mul(float4(input.inPosition, 1.0f), worldViewProjection);
-	output.outWorld = mul(float4(input.inPosition, 1.0f), world);	// Light
-	output.outNormal = normalize(mul(float4(input.inNormal, 1.0f), world));
+	float3 position = input.inPosition.xyz * positionScale.xyz + positionOffset.xyz;
+	float3 normal = decodeOctahedral(input.inNormal);
+
+	output.outPosition = mul(float4(position, 1.0f), worldViewProjection);
+	output.outWorld = mul(float4(position, 1.0f), world);	// Light
+	output.outColor = input.inColor.rgb;
+	output.outNormal = normalize(mul(float4(normal, 1.0f), world));
 	output.outTexCoord = input.inTexCoord;
 	
 
 	return output;
-};
\ No newline at end of file
+};
+
+// * * * * * static geometry: lightmap UV from a second vertex stream * * * * * //
+struct vShader_lightmapped_input {
+	float4 inPosition : POS;
+	float2 inNormal : NOR;
+	float2 inTexCoord : TEXCOORD;
+	float4 inColor : COL;
+	float2 inLightmapUv : LIGHTMAP;	// R16G16_UNORM, stream 1
+};
+
+vShader_output vs_lightmapped(vShader_lightmapped_input input) {
+	vShader_input vertex;
+	vertex.inPosition = input.inPosition;
+	vertex.inNormal = input.inNormal;
+	vertex.inTexCoord = input.inTexCoord;
+	vertex.inColor = input.inColor;
+
+	vShader_output output = vs_main(vertex);
+	output.outLightmapUv = input.inLightmapUv;
+
+	return output;
+};
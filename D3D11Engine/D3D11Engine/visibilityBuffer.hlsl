@@ -0,0 +1,142 @@
+// Constant buffers declared by VisibilityBuffer.cpp from the C++ definitions (CBufferLayout.h), with
+// packoffset. The shading pass lights with pixelShader.hlsl and the scene's declarations (b0 - b3, b6)
+#include "pixelShader.hlsl"
+
+// cBufferVisibilityObject (b5): worldViewProjection, positionScale, positionOffset, drawId
+CBUFFER_VISIBILITY_OBJECT
+
+// cBufferVisibility (b4): inverseViewProjection, inverseScreenSize
+CBUFFER_VISIBILITY
+
+// * * * Draw records and the geometry pool (VisibilityBuffer.h) * * * //
+struct VisibilityDraw
+{
+	float4x4 world;
+	float3 positionScale;
+	uint firstIndex;
+	float3 positionOffset;
+	uint textureSlice;
+	uint lightmapped;
+	uint3 pad;
+};
+
+Texture2D<uint2> visibilityIds : register(t6);	// draw + 1, triangle of the draw
+ByteAddressBuffer geometryVertices : register(t7);	// PackedVertex, 20 bytes
+ByteAddressBuffer geometryIndices : register(t8);	// 32 bit pool vertex indices
+ByteAddressBuffer geometryLightmapUvs : register(t9);	// R16G16_UNORM per pool vertex
+StructuredBuffer<VisibilityDraw> visibilityDraws : register(t10);
+
+// * * * * * ID pass: positions only * * * * * //
+float4 vs_ids(float4 inPosition : POS) : SV_POSITION
+{
+	float3 position = inPosition.xyz * positionScale + positionOffset;
+	return mul(float4(position, 1.0f), worldViewProjection);
+};
+
+uint2 ps_ids(float4 position : SV_POSITION, uint primitiveId : SV_PrimitiveID) : SV_TARGET
+{
+	return uint2(drawId, primitiveId);
+};
+
+// * * * * * shading pass: attributes are fetched again per pixel * * * * * //
+struct GeometryVertex {
+	float3 worldPos;
+	float3 normal;
+	float2 texCoord;
+	float2 lightmapUv;
+};
+
+float decodeSnorm16(uint bits)
+{
+	return max((float)((int)(bits << 16) >> 16) / 32767.0f, -1.0f);
+};
+
+// same decode as vertexShader.hlsl
+float3 decodeOctahedral(float2 e)
+{
+	float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += (n.xy >= 0.0f) ? -t : t;
+	return normalize(n);
+};
+
+GeometryVertex loadVertex(uint index, VisibilityDraw draw)
+{
+	// position xy, position zw, normal, texcoord (the color isn't shaded)
+	uint4 words = geometryVertices.Load4(index * 20);
+	uint lightmapWord = geometryLightmapUvs.Load(index * 4);
+
+	float3 position = float3(decodeSnorm16(words.x & 0xffff), decodeSnorm16(words.x >> 16), decodeSnorm16(words.y & 0xffff));
+	position = position * draw.positionScale + draw.positionOffset;
+	float3 normal = decodeOctahedral(float2(decodeSnorm16(words.z & 0xffff), decodeSnorm16(words.z >> 16)));
+
+	GeometryVertex vertex;
+	vertex.worldPos = mul(float4(position, 1.0f), draw.world).xyz;
+	vertex.normal = mul(normal, (float3x3)draw.world);
+	vertex.texCoord = float2(f16tof32(words.w), f16tof32(words.w >> 16));
+	vertex.lightmapUv = float2(lightmapWord & 0xffff, lightmapWord >> 16) / 65535.0f;
+	return vertex;
+};
+
+// Where the pixel's ray meets the triangle's plane, also outside the triangle (for the neighbours)
+float3 getBarycentrics(float2 pixel, float3 p0, float3 p1, float3 p2)
+{
+	float2 ndc = pixel * inverseScreenSize * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f);
+	float4 nearPoint = mul(float4(ndc, 0.0f, 1.0f), inverseViewProjection);
+	float4 farPoint = mul(float4(ndc, 1.0f, 1.0f), inverseViewProjection);
+	float3 origin = nearPoint.xyz / nearPoint.w;
+	float3 direction = farPoint.xyz / farPoint.w - origin;
+
+	float3 edge1 = p1 - p0;
+	float3 edge2 = p2 - p0;
+	float3 pvec = cross(direction, edge2);
+	float invDet = 1.0f / dot(edge1, pvec);
+	float3 tvec = origin - p0;
+	float u = dot(tvec, pvec) * invDet;
+	float v = dot(direction, cross(tvec, edge1)) * invDet;
+	return float3(1.0f - u - v, u, v);
+};
+
+float4 vs_shade(uint vertexId : SV_VertexID) : SV_POSITION
+{
+	float2 corner = float2((vertexId << 1) & 2, vertexId & 2);
+	return float4(corner * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+};
+
+float4 ps_shade(float4 svPosition : SV_POSITION) : SV_TARGET
+{
+	uint2 id = visibilityIds.Load(int3(svPosition.xy, 0));
+	if (id.x == 0)
+		discard;
+
+	VisibilityDraw draw = visibilityDraws[id.x - 1];
+	uint3 indices = geometryIndices.Load3((draw.firstIndex + id.y * 3) * 4);
+	GeometryVertex v0 = loadVertex(indices.x, draw);
+	GeometryVertex v1 = loadVertex(indices.y, draw);
+	GeometryVertex v2 = loadVertex(indices.z, draw);
+
+	// The right and lower neighbour on the same plane give the texture gradients
+	float3 b = getBarycentrics(svPosition.xy, v0.worldPos, v1.worldPos, v2.worldPos);
+	float3 bx = getBarycentrics(svPosition.xy + float2(1.0f, 0.0f), v0.worldPos, v1.worldPos, v2.worldPos);
+	float3 by = getBarycentrics(svPosition.xy + float2(0.0f, 1.0f), v0.worldPos, v1.worldPos, v2.worldPos);
+
+	float2 texCoord = b.x * v0.texCoord + b.y * v1.texCoord + b.z * v2.texCoord;
+	float2 texCoordX = bx.x * v0.texCoord + bx.y * v1.texCoord + bx.z * v2.texCoord;
+	float2 texCoordY = by.x * v0.texCoord + by.y * v1.texCoord + by.z * v2.texCoord;
+	float3 worldPos = b.x * v0.worldPos + b.y * v1.worldPos + b.z * v2.worldPos;
+	float3 normal = normalize(b.x * v0.normal + b.y * v1.normal + b.z * v2.normal);
+
+	float3 sampleColor = objTexture.SampleGrad(objSamplerState, float3(texCoord, draw.textureSlice), texCoordX - texCoord, texCoordY - texCoord).rgb;
+
+	float3 appliedFinalLight;
+	if (draw.lightmapped) {
+		float2 lightmapUv = b.x * v0.lightmapUv + b.y * v1.lightmapUv + b.z * v2.lightmapUv;
+		appliedFinalLight = getBakedLight(lightmapUv, worldPos);
+	}
+	else {
+		appliedFinalLight = getProbeIrradiance(worldPos, normal) + getDynamicLight(worldPos, normal);
+	}
+	appliedFinalLight += getClusteredLight(svPosition, worldPos, normal);
+
+	return float4(sampleColor * appliedFinalLight, 1.0f);
+};